@@ -0,0 +1,700 @@
+/*
+Title: Advanced Ray Tracer
+File Name: BuildBVH.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This compute shader builds a Bounding Volume Hierarchy (BVH) over the
+triangles that Compute.glsl just transformed into compToFrag. It runs
+every frame, right after the transform pass, so moving meshes always
+have a correct hierarchy.
+
+Instead of testing every ray against every triangle, the fragment shader
+tests the ray against a box. If the ray misses the box, it skips every
+triangle inside of that box. Boxes contain smaller boxes, all the way
+down to a single triangle, so a ray only needs to test a handful of
+boxes and triangles instead of the entire scene.
+
+This is a "Linear BVH" (LBVH). Every pass is one thread per triangle
+(or per node), so it can build a tree over millions of triangles every
+frame. The passes are all in this one file. main.cpp picks the pass
+with the "pass" uniform and dispatches them in order:
+
+PASS_BOUNDS:    Find the box that holds the centers of all triangles
+PASS_MORTON:    Give every triangle a Morton code, which is a single
+                number that describes where it is in that box. Triangles
+                that are close to each other get numbers that are close
+                to each other.
+(RadixSort.glsl sorts the triangles by their Morton codes here)
+PASS_HIERARCHY: After sorting, neighbors in the array are neighbors in the
+                scene. Every interior node finds the range of sorted
+                triangles that it holds, and where that range splits into
+                its two children, by looking at the bits of the Morton
+                codes (Karras 2012, "Maximizing Parallelism in the
+                Construction of BVHs, Octrees, and k-d Trees").
+PASS_LEAVES:    Every sorted triangle becomes a leaf, with its own box.
+PASS_PROPAGATE: Every leaf walks up the tree, and merges the boxes of two
+                children into their parent. The second child to arrive at
+                a parent is the one that continues, so every parent is
+                finished after both of its children.
+PASS_RESTRUCTURE: (--bvh-restructure) Make the tree better after a full
+                build. Every leaf walks up like in PASS_PROPAGATE, and at
+                every node with enough leaves under it, the few nodes
+                just under it (a "treelet") are put together again in the
+                best of all possible ways (Karras and Aila 2013, "Fast
+                Parallel Construction of High-Quality Bounding Volume
+                Hierarchies"). main.cpp runs it once for every round.
+PASS_COST:      Measure how good the tree is, by adding up the surface
+                area of every box, compared to the root box.
+
+With --early-split, the leaves are pieces of the triangles instead of the
+triangles (see pieceCorners), so a huge triangle is many small boxes. Every
+pass above works on the leaves the same way, and a leaf of a piece points at
+its whole triangle, so the rays still test the triangle itself.
+
+When meshes move without changing shape, the sorted order from the last
+frame is still pretty good. Then main.cpp can "refit" the tree, which
+only runs PASS_LEAVES and PASS_PROPAGATE. That keeps the same tree, and
+only recalculates the boxes. Every refit makes the boxes a little worse,
+so main.cpp uses PASS_COST to decide when to do a full build again.
+
+With N triangles, there are N-1 interior nodes (0 to N-2), and then
+N leaves (N-1 to 2N-2). Node 0 is always the root.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// CompileSpirv.bat compiles this shader to SPIR-V ahead of time (--spirv), and then the
+// #include of SceneStructs.h needs this. GL_SPIRV is only defined for SPIR-V
+#ifdef GL_SPIRV
+#extension GL_GOOGLE_include_directive : require
+#endif
+
+// Each workgroup handles 64 triangles, or 64 nodes
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define PASS_BOUNDS 0
+#define PASS_MORTON 1
+#define PASS_HIERARCHY 2
+#define PASS_LEAVES 3
+#define PASS_PROPAGATE 4
+#define PASS_COST 5
+#define PASS_RESTRUCTURE 6
+
+// The most leaves a treelet of PASS_RESTRUCTURE can have. Every set of them is
+// one bit per leaf, so there are 2 to the power of that many sets
+#define MAX_TREELET_LEAVES 7
+#define TREELET_SETS 128
+
+// PASS_COST adds up fractions of the root area, and atomics only work on
+// integers, so each fraction is stored as a number out of this many
+#define COST_SCALE 1024.0
+
+// which pass of the build we are running
+layout(location = 0) uniform int pass;
+
+// number of leaves: the triangles, or with --early-split the pieces of them
+layout(location = 1) uniform int numLeaves;
+
+// how many leaves PASS_RESTRUCTURE puts in a treelet (3 to MAX_TREELET_LEAVES).
+// More leaves find better trees, but the number of ways to try grows very fast
+layout(location = 2) uniform int treeletSize;
+
+// with --early-split, every leaf is a piece of a triangle in pieces
+layout(location = 3) uniform bool earlySplit;
+
+// the same triangle struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+// Every node is 32 bytes.
+// Interior node: left and right are the indices of the two children
+// Leaf node: left is the bitwise-not (~) of the triangle index, so it
+// is always negative, and right is the number of triangles (always 1)
+struct BVHNode
+{
+	vec3 min;
+	int left;
+	vec3 max;
+	int right;
+};
+
+// Where each node is in the tree, so that leaves can walk up to the root.
+// visits counts how many children have finished their boxes
+struct NodeLink
+{
+	int parent;
+	uint visits;
+};
+
+// What PASS_RESTRUCTURE knows about a node once its walk has been there:
+// the area of every box under it (and its own) added up, and the number of leaves under it
+struct NodeCost
+{
+	float cost;
+	int leaves;
+};
+
+// The triangles that were written by Compute.glsl
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+// The final tree, which is read by the fragment shader.
+// It is coherent, because in PASS_PROPAGATE one thread reads
+// the boxes that other threads wrote in the same dispatch
+layout(binding = 3) coherent buffer bvhBlock
+{
+	BVHNode nodes[];
+};
+
+// The pieces of --early-split, one for every leaf. x is the triangle, and y says which piece of it: the low 4 bits
+// are how many times the triangle was cut, and above them are 2 bits for every cut, which of its 4 pieces to take.
+// main.cpp makes them once (see makeSplitPieces), because the pieces move with their triangle
+layout(binding = 39) readonly buffer splitBlock
+{
+	uvec2 pieces[];
+};
+
+// Temporary data that only the build needs
+layout(binding = 4) buffer bvhScratch
+{
+	// box that contains all triangle centers, stored with
+	// floatToOrderedUint so that we can use atomicMin/atomicMax
+	uint centerMin[3];
+	uint centerMax[3];
+
+	// the sum of the area of every interior node and leaf,
+	// divided by the area of the root, times COST_SCALE
+	uint cost;
+	uint junk;
+};
+
+// x is the morton code, y is the triangle index (or with --early-split, the piece).
+// These are sorted by RadixSort.glsl between PASS_MORTON and PASS_HIERARCHY
+layout(binding = 8) buffer bvhKeys
+{
+	uvec2 keys[];
+};
+
+// one link for every node
+layout(binding = 9) buffer bvhLinks
+{
+	NodeLink links[];
+};
+
+// one cost for every node, only for PASS_RESTRUCTURE. It is coherent for
+// the same reason as the nodes: the walk reads what other threads wrote
+layout(binding = 36) coherent buffer bvhTreeletCosts
+{
+	NodeCost costs[];
+};
+
+// Atomics only work on integers, so we flip the bits of the float
+// to make an integer that sorts in the same order as the float does
+uint floatToOrderedUint(float f)
+{
+	uint u = floatBitsToUint(f);
+	return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+float orderedUintToFloat(uint u)
+{
+	return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+}
+
+// Spread the lower 10 bits of v out, so that there are
+// two zeros between every bit: 0000abcd -> 00a00b00c00d
+uint expandBits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// Make a 30-bit morton code from a point inside the [0, 1] cube,
+// by interleaving the bits of x, y, and z
+uint morton3D(vec3 p)
+{
+	p = clamp(p * 1024.0, vec3(0.0), vec3(1023.0));
+	uint x = expandBits(uint(p.x));
+	uint y = expandBits(uint(p.y));
+	uint z = expandBits(uint(p.z));
+	return x * 4u + y * 2u + z;
+}
+
+float surfaceArea(vec3 boxMin, vec3 boxMax)
+{
+	vec3 size = max(boxMax - boxMin, vec3(0.0));
+	return 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// The box around the leaves of a treelet that are in set s (one bit per leaf)
+void boxOfSet(int s, int count, vec3 leafMin[MAX_TREELET_LEAVES], vec3 leafMax[MAX_TREELET_LEAVES], out vec3 boxMin, out vec3 boxMax)
+{
+	boxMin = vec3(1e30);
+	boxMax = vec3(-1e30);
+
+	for (int k = 0; k < count; k++)
+	{
+		if ((s & (1 << k)) != 0)
+		{
+			boxMin = min(boxMin, leafMin[k]);
+			boxMax = max(boxMax, leafMax[k]);
+		}
+	}
+}
+
+// Put the treelet under root together again in the way with the smallest cost, if that is better than the way it is now.
+// The treelet starts as the two children of root, and the leaf of the treelet with the biggest box is opened (replaced by its
+// two children) until it has treeletSize leaves. The leaves of a treelet are whole subtrees, which keep what is under them,
+// and the nodes that were opened are used again for the new tree, so root and everything above it stays the same.
+// Every thread does its own treelet, so instead of the sets of the paper being shared by a warp, they are all tried here
+void restructureTreelet(int root)
+{
+	int leafNodes[MAX_TREELET_LEAVES];
+	int innerNodes[MAX_TREELET_LEAVES - 1];
+
+	leafNodes[0] = nodes[root].left;
+	leafNodes[1] = nodes[root].right;
+	innerNodes[0] = root;
+	int count = 2;
+
+	while (count < treeletSize)
+	{
+		// only interior nodes can be opened
+		int biggest = -1;
+		float biggestArea = -1.0;
+
+		for (int k = 0; k < count; k++)
+		{
+			int n = leafNodes[k];
+			float area = surfaceArea(nodes[n].min, nodes[n].max);
+
+			if (n < numLeaves - 1 && area > biggestArea)
+			{
+				biggest = k;
+				biggestArea = area;
+			}
+		}
+
+		if (biggest < 0)
+			break;
+
+		int opened = leafNodes[biggest];
+		innerNodes[count - 1] = opened;
+		leafNodes[biggest] = nodes[opened].left;
+		leafNodes[count] = nodes[opened].right;
+		count++;
+	}
+
+	vec3 leafMin[MAX_TREELET_LEAVES];
+	vec3 leafMax[MAX_TREELET_LEAVES];
+
+	// The best cost of a tree over every set, and where that set is split into its two children.
+	// A set of one leaf is that leaf, with the cost it already has
+	float best[TREELET_SETS];
+	int bestSplit[TREELET_SETS];
+
+	for (int k = 0; k < count; k++)
+	{
+		leafMin[k] = nodes[leafNodes[k]].min;
+		leafMax[k] = nodes[leafNodes[k]].max;
+		best[1 << k] = costs[leafNodes[k]].cost;
+	}
+
+	// Every set that a set is split into is a smaller number than the set,
+	// so going through them in order finds the best of the small sets first
+	int all = (1 << count) - 1;
+
+	for (int s = 3; s <= all; s++)
+	{
+		if (bitCount(s) < 2)
+			continue;
+
+		// Try every split of s. Every split is found twice (p and s ^ p),
+		// so only the ones where p has the lowest leaf of s are tried
+		int lowest = s & -s;
+		float bestCost = 1e30;
+		int split = lowest;
+
+		for (int p = (s - 1) & s; p > 0; p = (p - 1) & s)
+		{
+			if ((p & lowest) != 0 && best[p] + best[s ^ p] < bestCost)
+			{
+				bestCost = best[p] + best[s ^ p];
+				split = p;
+			}
+		}
+
+		vec3 boxMin, boxMax;
+		boxOfSet(s, count, leafMin, leafMax, boxMin, boxMax);
+
+		best[s] = surfaceArea(boxMin, boxMax) + bestCost;
+		bestSplit[s] = split;
+	}
+
+	// keep the treelet as it is, unless the new one is really better
+	if (best[all] >= costs[root].cost * 0.999)
+		return;
+
+	// Write the new treelet from the top, with a stack of the sets that still need a node.
+	// There are count - 1 interior nodes, and root is the first of them
+	int stackSets[MAX_TREELET_LEAVES - 1];
+	int stackNodes[MAX_TREELET_LEAVES - 1];
+	stackSets[0] = all;
+	stackNodes[0] = root;
+	int top = 1;
+	int used = 1;
+
+	while (top > 0)
+	{
+		top--;
+		int s = stackSets[top];
+		int node = stackNodes[top];
+		int halves[2] = int[2](bestSplit[s], s ^ bestSplit[s]);
+		int children[2];
+
+		for (int h = 0; h < 2; h++)
+		{
+			if (bitCount(halves[h]) == 1)
+			{
+				children[h] = leafNodes[findLSB(halves[h])];
+			}
+			else
+			{
+				children[h] = innerNodes[used++];
+				stackSets[top] = halves[h];
+				stackNodes[top] = children[h];
+				top++;
+			}
+
+			links[children[h]].parent = node;
+		}
+
+		vec3 boxMin, boxMax;
+		boxOfSet(s, count, leafMin, leafMax, boxMin, boxMax);
+
+		int leaves = 0;
+		for (int k = 0; k < count; k++)
+		{
+			if ((s & (1 << k)) != 0)
+				leaves += costs[leafNodes[k]].leaves;
+		}
+
+		nodes[node].min = boxMin;
+		nodes[node].max = boxMax;
+		nodes[node].left = children[0];
+		nodes[node].right = children[1];
+		costs[node] = NodeCost(best[s], leaves);
+	}
+}
+
+// The triangle t of leaf i, and the corners of the piece of it. A cut puts a point in the middle of every
+// side, which makes a triangle at each of the 3 corners and one in the middle, so the pieces cover the
+// triangle exactly once. The points are made the same way for both pieces next to a side, so there are
+// no gaps between their boxes
+void pieceCorners(int i, out int t, out vec3 a, out vec3 b, out vec3 c)
+{
+	t = earlySplit ? int(pieces[i].x) : i;
+	a = triangles[t].a;
+	b = triangles[t].b;
+	c = triangles[t].c;
+
+	if (!earlySplit)
+		return;
+
+	uint piece = pieces[i].y;
+	int cuts = int(piece & 15u);
+
+	for (int k = 0; k < cuts; k++)
+	{
+		vec3 ab = (a + b) * 0.5;
+		vec3 bc = (b + c) * 0.5;
+		vec3 ca = (c + a) * 0.5;
+		uint corner = (piece >> (4 + 2 * k)) & 3u;
+
+		if (corner == 0u)
+		{
+			b = ab;
+			c = ca;
+		}
+		else if (corner == 1u)
+		{
+			a = ab;
+			c = bc;
+		}
+		else if (corner == 2u)
+		{
+			a = ca;
+			b = bc;
+		}
+		else
+		{
+			a = ab;
+			b = bc;
+			c = ca;
+		}
+	}
+}
+
+vec3 centerOf(int i)
+{
+	int t;
+	vec3 a, b, c;
+	pieceCorners(i, t, a, b, c);
+	return (a + b + c) / 3.0;
+}
+
+// How many of the highest bits are the same in the keys of sorted triangles i and j.
+// If two triangles have the same morton code, we pretend that their index is
+// added to the end of the code, so that every key is different.
+// Returns -1 if j is outside of the array
+int commonPrefix(int i, int j)
+{
+	if (j < 0 || j >= numLeaves)
+		return -1;
+
+	uint ki = keys[i].x;
+	uint kj = keys[j].x;
+
+	// findMSB gives the position of the highest bit that is set, so
+	// 31 - findMSB is how many zeros are in front of it
+	if (ki == kj)
+		return 32 + (31 - findMSB(uint(i ^ j)));
+
+	return 31 - findMSB(ki ^ kj);
+}
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+
+	if (pass == PASS_BOUNDS)
+	{
+		if (i >= numLeaves)
+			return;
+
+		vec3 center = centerOf(i);
+
+		for (int k = 0; k < 3; k++)
+		{
+			atomicMin(centerMin[k], floatToOrderedUint(center[k]));
+			atomicMax(centerMax[k], floatToOrderedUint(center[k]));
+		}
+	}
+
+	else if (pass == PASS_MORTON)
+	{
+		if (i >= numLeaves)
+			return;
+
+		vec3 lo = vec3(
+			orderedUintToFloat(centerMin[0]),
+			orderedUintToFloat(centerMin[1]),
+			orderedUintToFloat(centerMin[2]));
+
+		vec3 hi = vec3(
+			orderedUintToFloat(centerMax[0]),
+			orderedUintToFloat(centerMax[1]),
+			orderedUintToFloat(centerMax[2]));
+
+		// put the center in the [0, 1] range of the scene box
+		vec3 p = (centerOf(i) - lo) / max(hi - lo, vec3(0.00001));
+
+		keys[i] = uvec2(morton3D(p), uint(i));
+	}
+
+	else if (pass == PASS_HIERARCHY)
+	{
+		// one thread for every interior node
+		if (i >= numLeaves - 1)
+			return;
+
+		// The root has no parent
+		if (i == 0)
+			links[0].parent = -1;
+
+		// Which direction does the range of this node go? The neighbor
+		// that shares more bits with i is inside of the same node
+		int d = (commonPrefix(i, i + 1) - commonPrefix(i, i - 1)) >= 0 ? 1 : -1;
+
+		// Every key inside of the node shares more bits with i than
+		// the neighbor on the other side does
+		int minPrefix = commonPrefix(i, i - d);
+
+		// Find how far the range goes: first double the length until
+		// we are past the end, then do a binary search back to the end
+		int maxLength = 2;
+		while (commonPrefix(i, i + maxLength * d) > minPrefix)
+			maxLength *= 2;
+
+		int length = 0;
+		for (int t = maxLength / 2; t >= 1; t /= 2)
+		{
+			if (commonPrefix(i, i + (length + t) * d) > minPrefix)
+				length += t;
+		}
+
+		// the other end of the range
+		int j = i + length * d;
+
+		// Binary search for the split: the last key that still shares
+		// more bits with i than the other end of the range does
+		int nodePrefix = commonPrefix(i, j);
+		int split = 0;
+		int step = length;
+
+		do
+		{
+			step = (step + 1) / 2;
+
+			if (split + step < length && commonPrefix(i, i + (split + step) * d) > nodePrefix)
+				split += step;
+		} while (step > 1);
+
+		int gamma = i + split * d + min(d, 0);
+
+		// If a child holds only one triangle, it is a leaf.
+		// Leaves are stored after all N-1 interior nodes
+		int left = (min(i, j) == gamma) ? numLeaves - 1 + gamma : gamma;
+		int right = (max(i, j) == gamma + 1) ? numLeaves - 1 + gamma + 1 : gamma + 1;
+
+		nodes[i].left = left;
+		nodes[i].right = right;
+		links[left].parent = i;
+		links[right].parent = i;
+	}
+
+	else if (pass == PASS_LEAVES)
+	{
+		if (i >= numLeaves)
+			return;
+
+		// leaves are stored after all interior nodes
+		int nodeIndex = numLeaves - 1 + i;
+		int t;
+		vec3 a, b, c;
+		pieceCorners(int(keys[i].y), t, a, b, c);
+
+		nodes[nodeIndex].min = min(a, min(b, c));
+		nodes[nodeIndex].max = max(a, max(b, c));
+		nodes[nodeIndex].left = ~t;
+		nodes[nodeIndex].right = 1;
+
+		// no children have finished
+		// any interior nodes yet
+		if (i < numLeaves - 1)
+			links[i].visits = 0u;
+	}
+
+	else if (pass == PASS_PROPAGATE)
+	{
+		if (i >= numLeaves)
+			return;
+
+		int node = numLeaves - 1 + i;
+
+		while (true)
+		{
+			int parent = links[node].parent;
+
+			if (parent < 0)
+				break;
+
+			// Make sure that the box of this node is
+			// visible to the thread of the other child
+			memoryBarrierBuffer();
+
+			// The first child to arrive stops here. The second child knows
+			// that both boxes are done, so it makes the box of the parent
+			if (atomicAdd(links[parent].visits, 1u) == 0u)
+				break;
+
+			int left = nodes[parent].left;
+			int right = nodes[parent].right;
+
+			nodes[parent].min = min(nodes[left].min, nodes[right].min);
+			nodes[parent].max = max(nodes[left].max, nodes[right].max);
+
+			node = parent;
+		}
+	}
+
+	else if (pass == PASS_RESTRUCTURE)
+	{
+		// This is the walk of PASS_PROPAGATE, after the boxes are done (and after PASS_LEAVES emptied the
+		// visits again). When a thread continues from a node, every thread under it has stopped, so it is
+		// the only one that touches the nodes under it, and it can change them. The box of the node
+		// does not change, so the walks above it do not see a difference
+		if (i >= numLeaves)
+			return;
+
+		int node = numLeaves - 1 + i;
+		costs[node] = NodeCost(surfaceArea(nodes[node].min, nodes[node].max), 1);
+
+		while (true)
+		{
+			int parent = links[node].parent;
+
+			if (parent < 0)
+				break;
+
+			// make sure that the cost (and the treelet) under this
+			// node is visible to the thread of the other child
+			memoryBarrierBuffer();
+
+			if (atomicAdd(links[parent].visits, 1u) == 0u)
+				break;
+
+			NodeCost left = costs[nodes[parent].left];
+			NodeCost right = costs[nodes[parent].right];
+			costs[parent] = NodeCost(surfaceArea(nodes[parent].min, nodes[parent].max) + left.cost + right.cost, left.leaves + right.leaves);
+
+			// Small subtrees are left alone. They are most of the nodes, and
+			// a better tree there saves the least, because their boxes are small
+			if (left.leaves + right.leaves >= treeletSize)
+				restructureTreelet(parent);
+
+			node = parent;
+		}
+	}
+
+	else if (pass == PASS_COST)
+	{
+		// The chance that a random ray that hits the root also hits a node is
+		// the area of the node divided by the area of the root. Adding that up for
+		// every node gives the number of nodes an average ray visits, which is the
+		// "surface area heuristic" (SAH). Smaller is better.
+		if (i >= 2 * numLeaves - 1)
+			return;
+
+		float rootArea = surfaceArea(nodes[0].min, nodes[0].max);
+		float area = surfaceArea(nodes[i].min, nodes[i].max);
+
+		if (rootArea > 0.0)
+		{
+			atomicAdd(cost, uint(area / rootArea * COST_SCALE));
+		}
+	}
+}
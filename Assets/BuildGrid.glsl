@@ -0,0 +1,230 @@
+/*
+Title: Advanced Ray Tracer
+File Name: BuildGrid.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This compute shader builds a uniform grid over the triangles that
+Compute.glsl just transformed into compToFrag. The box around the whole
+scene is cut into GRID_RES x GRID_RES x GRID_RES cells, and every cell
+gets a list of the triangles whose box touches it. A ray then walks
+through the cells in the order that it passes through them, and only
+tests the triangles in those cells.
+
+A grid is much faster to build than a BVH, and it works very well when
+triangles are spread evenly over the scene. It does not work as well
+when most of the triangles are in one small place, because then most
+cells are empty and a few cells have almost every triangle.
+
+The passes are picked with the "pass" uniform, the same as BuildBVH.glsl:
+
+PASS_BOUNDS: Find the box around every triangle in the scene
+PASS_COUNT:  Every triangle adds one to the count of every cell it touches
+PASS_SCAN:   Add up the counts (a prefix sum), so that every cell knows
+             where its list starts in the list of all references
+PASS_FILL:   Every triangle writes its index into the list of every
+             cell that it touches
+
+main.cpp sets the box to empty and every count to zero before PASS_BOUNDS.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// CompileSpirv.bat compiles this shader to SPIR-V ahead of time (--spirv), and then the
+// #include of SceneStructs.h needs this. GL_SPIRV is only defined for SPIR-V
+#ifdef GL_SPIRV
+#extension GL_GOOGLE_include_directive : require
+#endif
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define PASS_BOUNDS 0
+#define PASS_COUNT 1
+#define PASS_SCAN 2
+#define PASS_FILL 3
+
+// This must match GRID_RES in main.cpp and FragmentShader.glsl
+#define GRID_RES 8
+#define GRID_CELLS (GRID_RES * GRID_RES * GRID_RES)
+
+layout(location = 0) uniform int pass;
+layout(location = 1) uniform int numTriangles;
+
+// the same triangle struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+// The triangles that were written by Compute.glsl
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+// The box of the scene is stored with floatToOrderedUint, so that we can use atomicMin and atomicMax.
+// The list of cell c is refs[cellStart[c]] to refs[cellStart[c + 1] - 1].
+// cellCount is the number of triangles in each cell, and then PASS_FILL uses it
+// again, to count how many triangles it has written into each cell so far.
+// After that are the triangle indices in every cell, one list after the other.
+// They are in the same buffer, because the wavefront renderer already uses
+// as many storage buffers as a shader can have
+layout(binding = 14) buffer gridBlock
+{
+	uint sceneMin[3];
+	uint junk1;
+	uint sceneMax[3];
+	uint junk2;
+	uint cellStart[GRID_CELLS + 1];
+	uint cellCount[GRID_CELLS];
+	uint refs[];
+};
+
+shared uint scanSums[64];
+
+uint floatToOrderedUint(float f)
+{
+	uint u = floatBitsToUint(f);
+	return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+float orderedUintToFloat(uint u)
+{
+	return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+}
+
+// Which cells the box of triangle i touches, from cellMin to cellMax (both included)
+void cellRange(int i, out ivec3 cellMin, out ivec3 cellMax)
+{
+	vec3 lo = vec3(orderedUintToFloat(sceneMin[0]), orderedUintToFloat(sceneMin[1]), orderedUintToFloat(sceneMin[2]));
+	vec3 hi = vec3(orderedUintToFloat(sceneMax[0]), orderedUintToFloat(sceneMax[1]), orderedUintToFloat(sceneMax[2]));
+
+	// a flat scene still needs cells with some size
+	vec3 cellSize = max(hi - lo, vec3(0.00001)) / float(GRID_RES);
+
+	vec3 triMin = min(triangles[i].a, min(triangles[i].b, triangles[i].c));
+	vec3 triMax = max(triangles[i].a, max(triangles[i].b, triangles[i].c));
+
+	cellMin = clamp(ivec3(floor((triMin - lo) / cellSize)), ivec3(0), ivec3(GRID_RES - 1));
+	cellMax = clamp(ivec3(floor((triMax - lo) / cellSize)), ivec3(0), ivec3(GRID_RES - 1));
+}
+
+int cellIndex(ivec3 cell)
+{
+	return cell.x + GRID_RES * (cell.y + GRID_RES * cell.z);
+}
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+	uint lid = gl_LocalInvocationID.x;
+
+	if (pass == PASS_BOUNDS)
+	{
+		if (i >= numTriangles)
+			return;
+
+		vec3 triMin = min(triangles[i].a, min(triangles[i].b, triangles[i].c));
+		vec3 triMax = max(triangles[i].a, max(triangles[i].b, triangles[i].c));
+
+		for (int k = 0; k < 3; k++)
+		{
+			atomicMin(sceneMin[k], floatToOrderedUint(triMin[k]));
+			atomicMax(sceneMax[k], floatToOrderedUint(triMax[k]));
+		}
+	}
+
+	else if (pass == PASS_COUNT)
+	{
+		if (i >= numTriangles)
+			return;
+
+		ivec3 cellMin, cellMax;
+		cellRange(i, cellMin, cellMax);
+
+		for (int z = cellMin.z; z <= cellMax.z; z++)
+			for (int y = cellMin.y; y <= cellMax.y; y++)
+				for (int x = cellMin.x; x <= cellMax.x; x++)
+					atomicAdd(cellCount[cellIndex(ivec3(x, y, z))], 1u);
+	}
+
+	else if (pass == PASS_SCAN)
+	{
+		// Only one workgroup runs this pass. Every thread adds up one chunk
+		// of the cells, then the 64 chunk sums are scanned together
+		uint chunk = (uint(GRID_CELLS) + 63u) / 64u;
+		uint start = lid * chunk;
+		uint end = min(start + chunk, uint(GRID_CELLS));
+
+		uint sum = 0u;
+		for (uint c = start; c < end; c++)
+			sum += cellCount[c];
+
+		scanSums[lid] = sum;
+		barrier();
+
+		for (uint offset = 1u; offset < 64u; offset *= 2u)
+		{
+			uint add = lid >= offset ? scanSums[lid - offset] : 0u;
+			barrier();
+			scanSums[lid] += add;
+			barrier();
+		}
+
+		uint running = scanSums[lid] - sum;
+
+		for (uint c = start; c < end; c++)
+		{
+			cellStart[c] = running;
+			running += cellCount[c];
+
+			// PASS_FILL counts up from zero again
+			cellCount[c] = 0u;
+		}
+
+		// the end of the last list
+		if (lid == 63u)
+			cellStart[GRID_CELLS] = scanSums[63];
+	}
+
+	else if (pass == PASS_FILL)
+	{
+		if (i >= numTriangles)
+			return;
+
+		ivec3 cellMin, cellMax;
+		cellRange(i, cellMin, cellMax);
+
+		for (int z = cellMin.z; z <= cellMax.z; z++)
+		{
+			for (int y = cellMin.y; y <= cellMax.y; y++)
+			{
+				for (int x = cellMin.x; x <= cellMax.x; x++)
+				{
+					int c = cellIndex(ivec3(x, y, z));
+					uint slot = atomicAdd(cellCount[c], 1u);
+
+					// main.cpp makes the list for the triangles of --obj as if they touch at most 8 cells,
+					// so a huge one could have more references than there is room for
+					if (cellStart[c] + slot < uint(refs.length()))
+						refs[cellStart[c] + slot] = uint(i);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,248 @@
+/*
+Title: Advanced Ray Tracer
+File Name: BuildInstanceGrid.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This compute shader builds the hashed grid of --instance-grid over the
+instances that main.cpp left out of the TLAS: the swarms of small ones,
+like debris or a crowd, where building even a TLAS over all of them every
+frame costs more than the frame. The cells all have the same size, which
+is the size of the biggest instance (see instanceGridCellSize in
+SceneStructs.h), so every instance is in at most 8 cells, and a cell is
+found by a hash of where it is instead of being stored, so the empty
+cells take no memory. Many cells share one bucket, and every bucket has
+a list of the instances in its cells. A ray walks through the cells in
+the order that it passes through them (3D-DDA, see intersectTwoLevel).
+
+The lists are made with a counting sort, the same as BuildGrid.glsl:
+
+PASS_BOUNDS: Find the box around every instance, and the longest side of
+             an instance
+PASS_COUNT:  Every instance adds one to the count of the bucket of every
+             cell it touches
+PASS_SCAN:   Add up the counts (a prefix sum), so that every bucket knows
+             where its list starts
+PASS_FILL:   Every instance writes its index into the list of the bucket
+             of every cell that it touches
+
+main.cpp writes the header (see instanceGrid in SceneStructs.h), with the
+box empty, and sets every count to zero before PASS_BOUNDS.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define PASS_BOUNDS 0
+#define PASS_COUNT 1
+#define PASS_SCAN 2
+#define PASS_FILL 3
+
+layout(location = 0) uniform int pass;
+
+#include "SceneStructs.h"
+
+// This must be the same as Instance in RayTracing.glsl, only the box and the matrices are used here
+struct Instance
+{
+	mat4 worldToObject;
+	int blasRoot;
+	int meshIndex;
+	int firstTriangle;
+	uint packedMaterial;
+	vec4 boxMin;
+	vec4 boxSize;
+	ivec4 lodRoots;
+	int primitive;
+	int primitiveJunk1;
+	int primitiveJunk2;
+	int primitiveJunk3;
+	mat4 shutterOpen;
+	mat4 shutterClose;
+};
+
+layout(binding = 7) readonly restrict buffer instanceBlock
+{
+	Instance instances[];
+};
+
+// lists has the count of every bucket, then where the list of every bucket starts (and where the last one ends),
+// then the lists. PASS_FILL uses the counts again, to count how many instances it has written into every bucket so far
+layout(binding = INSTANCE_GRID_BINDING) buffer instanceGridBlock
+{
+	instanceGrid grid;
+	uint lists[];
+};
+
+shared uint scanSums[64];
+
+uint floatToOrderedUint(float f)
+{
+	uint u = floatBitsToUint(f);
+	return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+float orderedUintToFloat(uint u)
+{
+	return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+}
+
+// The box around instance i in the world. With --motion-blur, the box holds it at both ends of the shutter,
+// and without it, both matrices are the same
+void instanceBox(int i, out vec3 lo, out vec3 hi)
+{
+	vec3 boxMin = instances[i].boxMin.xyz;
+	vec3 boxSize = instances[i].boxSize.xyz;
+
+	lo = vec3(1e30);
+	hi = vec3(-1e30);
+
+	for (int c = 0; c < 8; c++)
+	{
+		vec3 corner = boxMin + boxSize * vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+		vec3 open = (instances[i].shutterOpen * vec4(corner, 1.0)).xyz;
+		vec3 close = (instances[i].shutterClose * vec4(corner, 1.0)).xyz;
+
+		lo = min(lo, min(open, close));
+		hi = max(hi, max(open, close));
+	}
+}
+
+// Which cells the box of instance i touches, from cellMin to cellMax (both included)
+void cellRange(int i, out ivec3 cellMin, out ivec3 cellMax)
+{
+	vec3 gridMin = vec3(orderedUintToFloat(grid.boxMin[0]), orderedUintToFloat(grid.boxMin[1]), orderedUintToFloat(grid.boxMin[2]));
+	vec3 gridMax = vec3(orderedUintToFloat(grid.boxMax[0]), orderedUintToFloat(grid.boxMax[1]), orderedUintToFloat(grid.boxMax[2]));
+
+	float cellSize = instanceGridCellSize(gridMin, gridMax, uintBitsToFloat(grid.maxExtent));
+	ivec3 cells = instanceGridCells(gridMin, gridMax, cellSize);
+
+	vec3 lo, hi;
+	instanceBox(i, lo, hi);
+
+	cellMin = clamp(ivec3(floor((lo - gridMin) / cellSize)), ivec3(0), cells - 1);
+	cellMax = clamp(ivec3(floor((hi - gridMin) / cellSize)), ivec3(0), cells - 1);
+}
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+	uint lid = gl_LocalInvocationID.x;
+	int buckets = grid.buckets;
+
+	// the counts of the buckets, then where their lists start, then the lists
+	int starts = buckets;
+	int refs = 2 * buckets + 1;
+
+	if (pass == PASS_BOUNDS)
+	{
+		if (i >= grid.count)
+			return;
+
+		vec3 lo, hi;
+		instanceBox(grid.firstInstance + i, lo, hi);
+
+		for (int k = 0; k < 3; k++)
+		{
+			atomicMin(grid.boxMin[k], floatToOrderedUint(lo[k]));
+			atomicMax(grid.boxMax[k], floatToOrderedUint(hi[k]));
+		}
+
+		vec3 size = hi - lo;
+		atomicMax(grid.maxExtent, floatBitsToUint(max(size.x, max(size.y, size.z))));
+	}
+
+	else if (pass == PASS_COUNT)
+	{
+		if (i >= grid.count)
+			return;
+
+		ivec3 cellMin, cellMax;
+		cellRange(grid.firstInstance + i, cellMin, cellMax);
+
+		for (int z = cellMin.z; z <= cellMax.z; z++)
+			for (int y = cellMin.y; y <= cellMax.y; y++)
+				for (int x = cellMin.x; x <= cellMax.x; x++)
+					atomicAdd(lists[instanceGridBucket(ivec3(x, y, z), buckets)], 1u);
+	}
+
+	else if (pass == PASS_SCAN)
+	{
+		// Only one workgroup runs this pass. Every thread adds up one chunk
+		// of the buckets, then the 64 chunk sums are scanned together
+		uint chunk = (uint(buckets) + 63u) / 64u;
+		uint start = lid * chunk;
+		uint end = min(start + chunk, uint(buckets));
+
+		uint sum = 0u;
+		for (uint b = start; b < end; b++)
+			sum += lists[b];
+
+		scanSums[lid] = sum;
+		barrier();
+
+		for (uint offset = 1u; offset < 64u; offset *= 2u)
+		{
+			uint add = lid >= offset ? scanSums[lid - offset] : 0u;
+			barrier();
+			scanSums[lid] += add;
+			barrier();
+		}
+
+		uint running = scanSums[lid] - sum;
+
+		for (uint b = start; b < end; b++)
+		{
+			lists[starts + int(b)] = running;
+			running += lists[b];
+
+			// PASS_FILL counts up from zero again
+			lists[b] = 0u;
+		}
+
+		// the end of the last list
+		if (lid == 63u)
+			lists[starts + buckets] = scanSums[63];
+	}
+
+	else if (pass == PASS_FILL)
+	{
+		if (i >= grid.count)
+			return;
+
+		ivec3 cellMin, cellMax;
+		cellRange(grid.firstInstance + i, cellMin, cellMax);
+
+		for (int z = cellMin.z; z <= cellMax.z; z++)
+		{
+			for (int y = cellMin.y; y <= cellMax.y; y++)
+			{
+				for (int x = cellMin.x; x <= cellMax.x; x++)
+				{
+					uint b = instanceGridBucket(ivec3(x, y, z), buckets);
+					uint slot = atomicAdd(lists[b], 1u);
+					lists[refs + int(lists[starts + int(b)] + slot)] = uint(grid.firstInstance + i);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,81 @@
+/*
+Title: Advanced Ray Tracer
+File Name: Camera.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is not a shader by itself, it is included by FragmentShader.glsl
+
+Description:
+This is not a shader by itself, it is included by every shader that
+traces rays from the camera: FragmentShader.glsl, Wavefront.glsl,
+TiledRender.glsl, LightCull.glsl, and TriangleBench.glsl. The camera
+is a uniform block with up to MAX_VIEWS views (see cameraView in
+SceneStructs.h), which main.cpp writes once per frame in calcCameraRays,
+so every program sees the same camera without setting any uniforms.
+Only the fragment shader can render more than one view (--views), the
+other shaders always use view 0.
+
+With --camera, viewGrid.w is 1, and view 0 does not have its rays in the
+corners: the ray of every pixel is in cameraRayTexture, which
+CameraRays.glsl made, so the camera can be a fisheye or see all around.
+viewRay reads the ray the one way or the other.
+*/
+
+#include "SceneStructs.h"
+
+// viewGrid is how the views are laid out on the image: x columns, y rows, and z views
+layout(std140, binding = CAMERA_BINDING) uniform cameraBlock
+{
+	ivec4 viewGrid;
+	cameraView views[MAX_VIEWS];
+};
+
+// The view that eye and the corner rays come from. A shader that renders
+// more than one view defines this as the index of the view, before this file
+#ifndef CAMERA_VIEW
+#define CAMERA_VIEW 0
+#endif
+
+// The names that the shaders have always used for the camera
+#define eye views[CAMERA_VIEW].eye
+#define ray00 views[CAMERA_VIEW].ray00
+#define ray01 views[CAMERA_VIEW].ray01
+#define ray10 views[CAMERA_VIEW].ray10
+#define ray11 views[CAMERA_VIEW].ray11
+
+// The rays of --camera, with w 0 where the camera sees nothing. The texture is filtered,
+// so a place between the middles of two pixels (a jittered sample) gets the ray between theirs
+layout(binding = CAMERA_RAY_UNIT) uniform sampler2D cameraRayTexture;
+
+// The ray from the eye through pos, from 0 to 1 across and up on the image of the view, normalized.
+// False if the camera sees nothing there
+bool viewRay(vec2 pos, out vec3 dir)
+{
+	if (viewGrid.w != 0)
+	{
+		vec4 ray = textureLod(cameraRayTexture, pos, 0.0);
+		dir = normalize(ray.xyz);
+		return ray.w > 0.5;
+	}
+
+	dir = normalize(mix(mix(ray00, ray01, pos.y), mix(ray10, ray11, pos.y), pos.x));
+	return true;
+}
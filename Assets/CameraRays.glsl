@@ -0,0 +1,117 @@
+/*
+Title: Advanced Ray Tracer
+File Name: CameraRays.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The camera rays of --camera, for the projections that are not a
+rectangle. Every other camera ray is a mix of the four corner rays of
+calcCameraRays, which can only be a pinhole camera. This writes the ray
+of every pixel into cameraRays once, whenever the camera turns or the
+size changes, and the shaders that trace from the camera read it with
+one fetch (see viewRay in Camera.glsl).
+
+The rays go out from the camera around forward, with right and up, the
+same directions as the corner rays. pos is where the pixel is on the
+image, from 0 to 1 across and up, and p is the same from -1 to 1:
+
+- pinhole: the rays go through a rectangle, fov (in radians) is the
+  angle from the bottom to the top
+- fisheye: equidistant, the angle from forward grows with the distance
+  from the middle of the image, and fov is the angle across the circle
+  that touches the top and the bottom. Outside of the circle the camera
+  sees nothing, so w is 0 there
+- equirect: the whole sphere, 360 degrees across and 180 up, for a 360
+  render in one pass, without a cube map
+- panoramic: a cylinder, fov degrees across, and straight up and down
+  as much as the pixels are square
+
+jitter is the offset of --accumulate, in pixels.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+#include "SceneStructs.h"
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(rgba32f, binding = 0) uniform writeonly image2D cameraRays;
+
+uniform int imageWidth;
+uniform int imageHeight;
+uniform int cameraModel;
+uniform float fov;
+uniform vec3 forward;
+uniform vec3 right;
+uniform vec3 up;
+uniform vec2 jitter;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+
+	if (pixel.x >= imageWidth || pixel.y >= imageHeight)
+		return;
+
+	float aspect = float(imageWidth) / float(imageHeight);
+	vec2 pos = (vec2(pixel) + 0.5 + jitter) / vec2(imageWidth, imageHeight);
+	vec2 p = pos * 2.0 - 1.0;
+
+	vec3 dir = forward;
+	float seen = 1.0;
+
+	if (cameraModel == CAMERA_PINHOLE)
+	{
+		float h = tan(fov * 0.5);
+		dir = forward + right * (p.x * h * aspect) + up * (p.y * h);
+	}
+	else if (cameraModel == CAMERA_FISHEYE)
+	{
+		vec2 q = vec2(p.x * aspect, p.y);
+		float r = length(q);
+
+		if (r <= 1.0)
+		{
+			float theta = r * fov * 0.5;
+			vec2 around = r > 0.0 ? q / r : vec2(0.0);
+			dir = forward * cos(theta) + (right * around.x + up * around.y) * sin(theta);
+		}
+		else
+		{
+			seen = 0.0;
+		}
+	}
+	else if (cameraModel == CAMERA_EQUIRECT)
+	{
+		float longitude = p.x * 3.14159265;
+		float latitude = p.y * 1.57079633;
+		dir = (forward * cos(longitude) + right * sin(longitude)) * cos(latitude) + up * sin(latitude);
+	}
+	else
+	{
+		// the height on the cylinder is as far as the angle across, at the same pixels
+		float longitude = p.x * fov * 0.5;
+		float height = p.y * fov * 0.5 / aspect;
+		dir = forward * cos(longitude) + right * sin(longitude) + up * height;
+	}
+
+	imageStore(cameraRays, pixel, vec4(normalize(dir), seen));
+}
@@ -0,0 +1,94 @@
+/*
+Title: Advanced Ray Tracer
+File Name: CheckerboardResolve.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The last step of --checkerboard. FragmentShader.glsl only traces half of
+the pixels every frame, like the black squares of a checkerboard, and the
+other half the next frame. A pixel that is not traced uses its color from
+the frame before, if it can (see reprojectHistory), and otherwise it is a
+hole, with an alpha of 0. This draws on the same full-screen quad, and
+fills every hole with the pixels next to it, which were traced this frame.
+Only the ones that see a point about as far away as the hole count, so the
+color of an object does not leak onto what is behind it.
+*/
+
+#version 430
+
+// The output of the Fragment Shader, AKA the pixel color.
+out vec4 color;
+
+// The image that FragmentShader.glsl drew, and the points of the hit buffer
+layout(binding = 6) uniform sampler2D frameTexture;
+layout(binding = 3) uniform usampler2D hitTexture;
+
+void main(void)
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 center = texelFetch(frameTexture, pixel, 0);
+
+	if (center.a > 0.0)
+	{
+		color = vec4(center.rgb, 1.0);
+		return;
+	}
+
+	ivec2 size = textureSize(frameTexture, 0);
+	float t = uintBitsToFloat(texelFetch(hitTexture, pixel, 0).x);
+
+	// the four pixels next to this one are on the other color of the checkerboard
+	ivec2 offsets[4] = ivec2[](ivec2(1, 0), ivec2(-1, 0), ivec2(0, 1), ivec2(0, -1));
+
+	vec3 near = vec3(0);
+	float nearCount = 0.0;
+	vec3 all = vec3(0);
+	float allCount = 0.0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 q = clamp(pixel + offsets[i], ivec2(0), size - 1);
+		vec4 neighbor = texelFetch(frameTexture, q, 0);
+
+		// a hole next to a hole, where it was traced the frame before
+		if (neighbor.a <= 0.0)
+			continue;
+
+		float neighborT = uintBitsToFloat(texelFetch(hitTexture, q, 0).x);
+
+		if (neighborT >= 0.0 && abs(neighborT - t) < 0.05 * t)
+		{
+			near += neighbor.rgb;
+			nearCount += 1.0;
+		}
+
+		all += neighbor.rgb;
+		allCount += 1.0;
+	}
+
+	// If none of them are about as far away, the hole is on the edge of something thin,
+	// and all of them are better than nothing
+	if (nearCount > 0.0)
+		color = vec4(near / nearCount, 1.0);
+	else if (allCount > 0.0)
+		color = vec4(all / allCount, 1.0);
+	else
+		color = vec4(vec3(0), 1.0);
+}
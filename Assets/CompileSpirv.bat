@@ -0,0 +1,26 @@
+@echo off
+rem Compiles the shaders that main.cpp can load as SPIR-V (--spirv) into Assets\spirv, ahead of time.
+rem These are the shaders that main.cpp does not add any #define to (see startSpirvProgram).
+rem glslangValidator comes with the Vulkan SDK. Without it nothing is compiled,
+rem and --spirv compiles the GLSL at startup like it always did.
+setlocal
+
+set GLSLANG=glslangValidator
+if defined VULKAN_SDK set GLSLANG="%VULKAN_SDK%\Bin\glslangValidator.exe"
+
+if not defined VULKAN_SDK (
+	where /q glslangValidator || (
+		echo glslangValidator was not found, the SPIR-V shaders were not compiled
+		exit /b 0
+	)
+)
+
+cd /d "%~dp0"
+if not exist spirv mkdir spirv
+
+rem A shader that does not compile is deleted, so that main.cpp compiles its GLSL instead
+for %%f in (BuildBVH RadixSort BuildGrid LightCull) do (
+	%GLSLANG% -G -S comp -o spirv\%%f.glsl.spv %%f.glsl || del spirv\%%f.glsl.spv 2>nul
+)
+
+exit /b 0
@@ -43,82 +43,524 @@ rendering.
 // Compute shaders are part of openGL core since version 4.3
 #version 430
 
-// This will just run once for each particle.
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
-struct InTriangle {
-	vec4 a;
-	vec4 b;
-	vec4 c;
-	vec4 normal;
-	vec4 color;
-};
+// the box of the scene of emitKeys is added up by subgroups first, where the driver can
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
 
-struct OutTriangle
-{
-	vec3 a;
-	vec3 b;
-	vec3 c;
-	vec3 normal;
-	vec3 color;
-};
+// makeTriangleRecord, for the ray test that main.cpp picked
+#include "TriangleKernels.glsl"
+
+// How many triangles a workgroup does, one per thread. main.cpp can change it
+// (see addShaderDefines), and works out how many workgroups it needs from it
+#ifndef TRANSFORM_GROUP_SIZE
+#define TRANSFORM_GROUP_SIZE 64
+#endif
+
+// The meshes are indexed: every corner that more than one triangle of a mesh shares is one vertex,
+// so the cube has 8 vertices instead of 36 corners. This runs in two passes, and main.cpp waits
+// with a memory barrier between them:
+// PASS_VERTICES:  once for each vertex. Move it into the world with the matrix of its mesh,
+//                 and grow the box of the mesh to hold it
+// PASS_TRIANGLES: once for each triangle. Read its three moved vertices, and write the triangle
+//                 and its record. Only the normal is multiplied by a matrix here
+// PASS_REFIT:     only for the skinned meshes of the two-level BVH, after the other two passes wrote them in the
+//                 space of their mesh. Once for every node of one level of their BLAS, which gets the box around
+//                 its children, or around its triangles if it is a leaf. main.cpp runs it for every level, the
+//                 deepest first, with a barrier after each, so the children of a node are always done before it
+#define PASS_VERTICES 0
+#define PASS_TRIANGLES 1
+#define PASS_REFIT 2
+
+layout(local_size_x = TRANSFORM_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+uniform int pass;
+
+// How many vertices and triangles there are, which main.cpp knows when it loads the scene.
+// The last workgroup can have threads past the end, which have nothing to do
+uniform int numVertices;
+uniform int numTriangles;
+uniform int numMeshes;
+
+// Most meshes do not move in most frames. When dirtyOnly is true, only the meshes in dirtyMeshes
+// moved since the last time this ran, and there is one thread per vertex (or triangle) of those meshes,
+// numJobs in all. Everything else in outBuffer is still right from before, so it is left alone
+uniform bool dirtyOnly;
+uniform int numDirty;
+uniform int numJobs;
+
+// With emitKeys (--fused-morton), this also does PASS_BOUNDS and PASS_MORTON of BuildBVH.glsl, so they do
+// not read every triangle again. PASS_VERTICES grows the box of the scene around the moved vertices, which
+// holds every center of a triangle, and PASS_TRIANGLES writes the Morton key of every triangle from the corners
+// that it just put together. It is only used when every triangle is moved, never with dirtyOnly
+uniform bool emitKeys;
+
+// With skinning, the vertices of a mesh that has a skin (a glTF mesh that is moved by joints, see updateSkins
+// in main.cpp) are moved by the weighted sum of the matrices of their 4 joints first, and then by the matrix of the mesh
+uniform bool skinning;
+
+// With meshSpace, only the skin moves the vertices, and outBuffer is the triangles in the space of their mesh
+// that the BLAS of the two-level BVH are built over (triangleBuffer in main.cpp). Nothing else is written:
+// no records, no boxes of the meshes, and no keys. It is only used with dirtyOnly, for the skinned meshes
+uniform bool meshSpace;
+
+// Where the level of PASS_REFIT starts in refitNodes. It has numJobs nodes
+uniform int firstRefit;
+
+// The triangles, which are the same struct as in main.cpp.
+// The triangles of the meshes and the triangles in the world are the same struct
+#include "SceneStructs.h"
 
 // A layout describing the vertex buffer.
 layout(binding = 0) buffer b0
 {
-	OutTriangle triangles[14];
+	triangle triangles[];
 } outBuffer;
 
-#define MAX_MESHES 2
-#define MAX_TRIANGLES_PER_MESH 12
-
-struct Mesh
+// The same triangles again, in the form that the ray tests of RayTracing.glsl read
+// (see makeTriangleRecord). Vec4 k of triangle i is at k * numTriangles + i
+layout(binding = 24) buffer b24
 {
-	int numTriangles;
-	int junk1;
-	int junk2;
-	int junk3;
-	InTriangle t[MAX_TRIANGLES_PER_MESH];
-};
+	vec4 records[];
+} outRecords;
 
+// The vertices of every mesh, one mesh after the other, before they are moved
 layout (binding = 1) buffer b1
 {
-	Mesh m[MAX_MESHES];
-} inGeometry;
+	vec4 vertices[];
+} inVertices;
+
+// The triangles of every mesh, one mesh after the other. Triangle i here
+// becomes triangle i in outBuffer. The vertex numbers count from the first vertex of the scene
+layout (binding = 25) buffer b25
+{
+	indexedTriangle triangles[];
+} inTriangles;
+
+// The vertices after PASS_VERTICES moved them into the world
+layout (binding = 26) buffer b26
+{
+	vec4 vertices[];
+} worldVertices;
 
 layout (binding = 2) buffer b2
 {
-	mat4x4 m[MAX_MESHES];
+	mat4x4 m[];
 } inMatrices;
 
+// The box around every mesh after it was moved, so the fragment shader can skip a whole mesh
+// with one box test. Atomics only work on integers, so the box is stored with floatToOrderedUint.
+// first and count say which triangles in outBuffer belong to the mesh
+struct MeshBox
+{
+	uint boxMin[3];
+	int first;
+	uint boxMax[3];
+	int count;
+};
+
+layout (binding = 13) buffer b13
+{
+	MeshBox m[];
+} outBoxes;
+
+// The first triangle of every mesh, in order, and then the number of
+// triangles, so that mesh m has first[m + 1] - first[m] (see makeMeshOffsets in main.cpp).
+// After that is the same table for the vertices, which starts at first[VERTEX_TABLE]
+layout (binding = 23) buffer b23
+{
+	int first[];
+} meshOffsets;
+
+#define TRIANGLE_TABLE 0
+#define VERTEX_TABLE (numMeshes + 1)
+
+// The box of the scene and the keys of the BVH, the same buffers as bvhScratch and bvhKeys in BuildBVH.glsl
+layout (binding = 4) buffer b4
+{
+	uint boxMin[3];
+	uint boxMax[3];
+	uint cost;
+	uint junk;
+} bvhScratch;
+
+layout (binding = 8) buffer b8
+{
+	uvec2 keys[];
+} bvhKeys;
+
+// the box of the vertices of this workgroup, before it is added to the box of the scene
+shared uint groupBox[6];
+
+// The meshes that moved (see makeDirtyList in main.cpp). x is the mesh, y is the first
+// vertex job of the mesh and z is its first triangle job. There is one more entry at the end,
+// which has the number of all the vertex jobs in y and of all the triangle jobs in z
+layout (binding = 27) buffer b27
+{
+	ivec4 d[];
+} dirtyMeshes;
+
+// x is where the matrices of the joints of mesh m start in jointMatrices, or -1 if it has no skin,
+// and y is where the skins of its vertices start in vertexSkins, one for every vertex of the mesh
+layout (binding = 32) buffer b32
+{
+	ivec4 s[];
+} meshSkins;
+
+// The 4 joints of the skin of a vertex, and how much each one moves it. The weights add up to 1
+struct VertexSkin
+{
+	ivec4 joints;
+	vec4 weights;
+};
+
+layout (binding = 33) buffer b33
+{
+	VertexSkin v[];
+} vertexSkins;
+
+// The joints of every skin in this frame, each times its inverse bind matrix (see poseGltfSkin in GltfLoader.h)
+layout (binding = 34) buffer b34
+{
+	mat4x4 m[];
+} jointMatrices;
+
+// The nodes of the two-level BVH, the same as twoLevelBlock in RayTracing.glsl, which PASS_REFIT gives new boxes
+struct BVHNode
+{
+	vec3 min;
+	int left;
+	vec3 max;
+	int right;
+};
+
+layout (binding = 6) buffer b6
+{
+	BVHNode nodes[];
+} blasNodes;
+
+// The nodes of the BLAS of the skinned meshes, one level after the other (see makeSkinRefitList in main.cpp).
+// x is the node, and y is the first triangle of its mesh, which the leaves of a BLAS count from
+layout (binding = 35) buffer b35
+{
+	ivec4 n[];
+} refitNodes;
+
+// Find the mesh that triangle or vertex i belongs to, which is the last mesh that starts at or before i.
+// table says which of the two tables to look in. This is a binary search, so it takes log2(numMeshes)
+// steps no matter where the mesh is. Meshes with nothing in them start at the same place as the next mesh,
+// so they are never found
+int findMesh(int table, int i)
+{
+	int lo = 0;
+	int hi = numMeshes - 1;
+
+	while (lo < hi)
+	{
+		int mid = (lo + hi + 1) / 2;
+
+		if (meshOffsets.first[table + mid] <= i)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+// Flip the bits of a float to make an integer that
+// sorts in the same order as the float does
+uint floatToOrderedUint(float f)
+{
+	uint u = floatBitsToUint(f);
+	return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+float orderedUintToFloat(uint u)
+{
+	return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+}
+
+// The Morton code of a point in the [0, 1] cube, the same as morton3D in BuildBVH.glsl
+uint expandBits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+uint morton3D(vec3 p)
+{
+	p = clamp(p * 1024.0, vec3(0.0), vec3(1023.0));
+	return expandBits(uint(p.x)) * 4u + expandBits(uint(p.y)) * 2u + expandBits(uint(p.z));
+}
+
+// Find the vertex (or triangle) that job j of the dirty meshes is, and its mesh.
+// This is the same binary search as findMesh, over the first job of every dirty mesh.
+// table is TRIANGLE_TABLE or VERTEX_TABLE
+uint findDirtyElement(int table, int j, out int meshIndex)
+{
+	int lo = 0;
+	int hi = numDirty - 1;
+
+	while (lo < hi)
+	{
+		int mid = (lo + hi + 1) / 2;
+		int start = table == VERTEX_TABLE ? dirtyMeshes.d[mid].y : dirtyMeshes.d[mid].z;
+
+		if (start <= j)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	ivec4 dirty = dirtyMeshes.d[lo];
+	meshIndex = dirty.x;
+
+	int start = table == VERTEX_TABLE ? dirty.y : dirty.z;
+	return uint(meshOffsets.first[table + meshIndex] + (j - start));
+}
+
+// The matrix that the skin of mesh meshIndex moves its vertex i by, which is the weighted sum of the
+// matrices of its joints. All 4 are added up even if some weights are 0, which is cheaper than a branch
+mat4 skinMatrix(uint i, int meshIndex, ivec4 skin)
+{
+	VertexSkin s = vertexSkins.v[skin.y + int(i) - meshOffsets.first[VERTEX_TABLE + meshIndex]];
+
+	return s.weights.x * jointMatrices.m[skin.x + s.joints.x] +
+		s.weights.y * jointMatrices.m[skin.x + s.joints.y] +
+		s.weights.z * jointMatrices.m[skin.x + s.joints.z] +
+		s.weights.w * jointMatrices.m[skin.x + s.joints.w];
+}
+
+// Move vertex i of mesh meshIndex into the world, and grow the box of its mesh to hold it.
+// main.cpp empties the box of every mesh that moved before this shader runs
+vec3 transformVertex(uint i, int meshIndex)
+{
+	vec4 v = vec4(inVertices.vertices[i].xyz, 1.0);
+
+	if (skinning)
+	{
+		ivec4 skin = meshSkins.s[meshIndex];
+
+		if (skin.x >= 0)
+			v = skinMatrix(i, meshIndex, skin) * v;
+	}
+
+	// the BLAS are in the space of their mesh, and their boxes are made by PASS_REFIT
+	if (meshSpace)
+	{
+		worldVertices.vertices[i] = v;
+		return v.xyz;
+	}
+
+	v = inMatrices.m[meshIndex] * v;
+	worldVertices.vertices[i] = v;
+
+	for (int k = 0; k < 3; k++)
+	{
+		atomicMin(outBoxes.m[meshIndex].boxMin[k], floatToOrderedUint(v[k]));
+		atomicMax(outBoxes.m[meshIndex].boxMax[k], floatToOrderedUint(v[k]));
+	}
+
+	return v.xyz;
+}
+
+// Grow the box of the scene of emitKeys to hold the vertices of the workgroup. Every thread has to come here,
+// the ones past the end with inside false. The subgroups find their boxes first, then the workgroup adds those up
+// in shared memory, and only then is the box of the scene grown, with 6 atomics for the whole workgroup
+void growSceneBox(vec3 v, bool inside)
+{
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		groupBox[0] = groupBox[1] = groupBox[2] = 0xFFFFFFFFu;
+		groupBox[3] = groupBox[4] = groupBox[5] = 0u;
+	}
+
+	memoryBarrierShared();
+	barrier();
+
+	vec3 lo = inside ? v : vec3(3.4e38);
+	vec3 hi = inside ? v : vec3(-3.4e38);
+
+#ifdef GL_KHR_shader_subgroup_arithmetic
+	lo = subgroupMin(lo);
+	hi = subgroupMax(hi);
+
+	if (subgroupElect())
+#endif
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			atomicMin(groupBox[k], floatToOrderedUint(lo[k]));
+			atomicMax(groupBox[3 + k], floatToOrderedUint(hi[k]));
+		}
+	}
+
+	memoryBarrierShared();
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			atomicMin(bvhScratch.boxMin[k], groupBox[k]);
+			atomicMax(bvhScratch.boxMax[k], groupBox[3 + k]);
+		}
+	}
+}
+
+// The key of triangle i for the sort of BuildBVH.glsl, from where its center is in the box of the scene.
+// PASS_VERTICES finished the box before this pass started
+void writeMortonKey(uint i, vec3 a, vec3 b, vec3 c)
+{
+	vec3 lo = vec3(
+		orderedUintToFloat(bvhScratch.boxMin[0]),
+		orderedUintToFloat(bvhScratch.boxMin[1]),
+		orderedUintToFloat(bvhScratch.boxMin[2]));
+
+	vec3 hi = vec3(
+		orderedUintToFloat(bvhScratch.boxMax[0]),
+		orderedUintToFloat(bvhScratch.boxMax[1]),
+		orderedUintToFloat(bvhScratch.boxMax[2]));
+
+	vec3 p = ((a + b + c) / 3.0 - lo) / max(hi - lo, vec3(0.00001));
+	bvhKeys.keys[i] = uvec2(morton3D(p), i);
+}
+
+// Put triangle i of mesh meshIndex together from its three moved vertices
+void assembleTriangle(uint i, int meshIndex)
+{
+	indexedTriangle inTriangle = inTriangles.triangles[i];
+
+	vec3 a = worldVertices.vertices[inTriangle.a].xyz;
+	vec3 b = worldVertices.vertices[inTriangle.b].xyz;
+	vec3 c = worldVertices.vertices[inTriangle.c].xyz;
+
+	outBuffer.triangles[i].a = a;
+	outBuffer.triangles[i].b = b;
+	outBuffer.triangles[i].c = c;
+
+	vec3 normal = octDecode(unpackSnorm2x16(inTriangle.packedNormal));
+
+	if (!meshSpace)
+		normal = normalize(mat3(inMatrices.m[meshIndex]) * normal);
+
+	// Every corner of a skinned triangle can be moved by other joints, so no one matrix turns its normal.
+	// It is the normal of the moved corners, on the same side as the normal it had before
+	if (skinning && meshSkins.s[meshIndex].x >= 0)
+	{
+		vec3 face = cross(b - a, c - a);
+
+		if (dot(face, face) > 0.0)
+			normal = normalize(dot(face, normal) < 0.0 ? -face : face);
+	}
+
+	outBuffer.triangles[i].packedNormal = packTriangleNormal(normal);
+
+	// triangleBuffer is only the triangles, and keeps its color as it is
+	if (meshSpace)
+		return;
+
+	// The record is made the same way as rayIntersectsTriangle makes it.
+	// It gets the normal before it was packed, which is a little more exact
+	vec4 r0, r1, r2;
+	makeTriangleRecord(a, b, c, normal, r0, r1, r2);
+	outRecords.records[i] = r0;
+	outRecords.records[numTriangles + i] = r1;
+	outRecords.records[2 * numTriangles + i] = r2;
+
+	// the color and reflectivity do not move, so they are copied without unpacking them
+	outBuffer.triangles[i].packedRedGreen = inTriangle.packedRedGreen;
+	outBuffer.triangles[i].packedBlueReflectivity = inTriangle.packedBlueReflectivity;
+
+	// The first triangle of the mesh says where the mesh is
+	if (int(i) == meshOffsets.first[meshIndex])
+	{
+		outBoxes.m[meshIndex].first = int(i);
+		outBoxes.m[meshIndex].count = meshOffsets.first[meshIndex + 1] - meshOffsets.first[meshIndex];
+	}
+
+	if (emitKeys && !dirtyOnly)
+		writeMortonKey(i, a, b, c);
+}
+
+// Give node j of the level of PASS_REFIT the box around its two children, or around the triangles of its leaf
+void refitNode(int j)
+{
+	ivec4 job = refitNodes.n[firstRefit + j];
+	BVHNode node = blasNodes.nodes[job.x];
+
+	vec3 lo = vec3(3.4e38);
+	vec3 hi = vec3(-3.4e38);
+
+	if (node.left >= 0)
+	{
+		BVHNode left = blasNodes.nodes[node.left];
+		BVHNode right = blasNodes.nodes[node.right];
+		lo = min(left.min, right.min);
+		hi = max(left.max, right.max);
+	}
+	else
+	{
+		for (int k = 0; k < node.right; k++)
+		{
+			triangle t = outBuffer.triangles[job.y + ~node.left + k];
+			lo = min(lo, min(t.a, min(t.b, t.c)));
+			hi = max(hi, max(t.a, max(t.b, t.c)));
+		}
+	}
+
+	blasNodes.nodes[job.x].min = lo;
+	blasNodes.nodes[job.x].max = hi;
+}
+
 // Declare main program function which is executed when
 void main()
 {
-	// Get the index of this object into the buffer
-	uint i = gl_GlobalInvocationID.x;
+	// Get the index of this object into the buffer.
+	// There can only be 65535 workgroups in x, so when there are more, main.cpp adds rows of them in y
+	uint i = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
 
-	int meshIndex = 0;
-	uint count = i;
-	
-	// count is the triangle index of the mesh
-	// that is being processed
+	if (pass == PASS_REFIT)
+	{
+		if (i < uint(numJobs))
+			refitNode(int(i));
+
+		return;
+	}
 
-	while(count >= inGeometry.m[meshIndex].numTriangles)
+	int table = pass == PASS_VERTICES ? VERTEX_TABLE : TRIANGLE_TABLE;
+	int meshIndex;
+
+	// the threads past the end help with the box of the workgroup, so they do not stop first
+	if (emitKeys && !dirtyOnly && pass == PASS_VERTICES)
 	{
-		count -= inGeometry.m[meshIndex].numTriangles;
-		meshIndex++;
+		bool inside = i < uint(numVertices);
+		vec3 v = inside ? transformVertex(i, findMesh(VERTEX_TABLE, int(i))) : vec3(0.0);
+
+		growSceneBox(v, inside);
+		return;
 	}
 
-	vec4 a = inMatrices.m[meshIndex] * inGeometry.m[meshIndex].t[count].a;
-	vec4 b = inMatrices.m[meshIndex] * inGeometry.m[meshIndex].t[count].b;
-	vec4 c = inMatrices.m[meshIndex] * inGeometry.m[meshIndex].t[count].c;
+	if (dirtyOnly)
+	{
+		if (i >= uint(numJobs))
+			return;
 
-	outBuffer.triangles[i].a = a.xyz;
-	outBuffer.triangles[i].b = b.xyz;
-	outBuffer.triangles[i].c = c.xyz;
+		i = findDirtyElement(table, int(i), meshIndex);
+	}
+	else
+	{
+		if (i >= uint(pass == PASS_VERTICES ? numVertices : numTriangles))
+			return;
 
-	vec3 normal = mat3(inMatrices.m[meshIndex]) * inGeometry.m[meshIndex].t[count].normal.xyz;
+		meshIndex = findMesh(table, int(i));
+	}
 
-	outBuffer.triangles[i].normal = normalize(normal);
-	outBuffer.triangles[i].color = inGeometry.m[meshIndex].t[count].color.xyz;
-}
\ No newline at end of file
+	if (pass == PASS_VERTICES)
+		transformVertex(i, meshIndex);
+	else
+		assembleTriangle(i, meshIndex);
+}
@@ -0,0 +1,170 @@
+/*
+Title: Advanced Ray Tracer
+File Name: Denoise.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The denoiser of --denoise. A frame with few samples per pixel (with
+--roulette, for example, most paths of reflections stop at random) is
+noisy, and the noise of a pixel is not the noise of the pixel next to it.
+This blurs the image, but only across pixels that see the same surface,
+like the a-trous filter of SVGF ("Spatiotemporal Variance-Guided
+Filtering", Schied et al. 2017). The hit buffer is the guide: how far
+away every point is, its normal, and its color (the albedo).
+
+It draws on the same full-screen quad as FragmentShader.glsl, a few times.
+Every pass adds up 5x5 pixels, stepSize pixels apart, so pass 1 looks at
+the pixels next to it, pass 2 at pixels 2 apart, then 4, and so on. That is
+a big blur for the price of a few small ones. The first pass divides the
+color by the albedo, so that only the light is blurred and the colors of the
+triangles stay sharp, and the last pass multiplies it back.
+*/
+
+#version 430
+
+// the same octDecode as FragmentShader.glsl
+#include "SceneStructs.h"
+
+// The output of the Fragment Shader, AKA the pixel color.
+out vec4 color;
+
+// the image of the pass before (the frame, for the first pass), and the points of the hit buffer
+layout(binding = 6) uniform sampler2D frameTexture;
+layout(binding = 3) uniform usampler2D hitTexture;
+
+uniform int stepSize;
+uniform bool firstPass;
+uniform bool lastPass;
+
+// How quickly the weight of a pixel drops when its point is farther or closer (as a part of how far away
+// the point is), its normal turns away, or it is brighter or darker (the light, without the albedo). The light
+// is compared with how noisy the pixels around it are, so a noisy place is blurred a lot and a clean one is not
+#define DEPTH_SIGMA 0.02
+#define NORMAL_POWER 64.0
+#define LIGHT_SIGMA 4.0
+
+// The albedo is never 0, so that the light can always be found from the color
+vec3 albedo(uvec4 stored)
+{
+	return max(unpackUnorm4x8(stored.z).rgb, vec3(0.02));
+}
+
+// The color of a pixel of frameTexture, and without its albedo in the first pass
+vec3 pixelLight(ivec2 pixel, uvec4 stored)
+{
+	vec3 c = texelFetch(frameTexture, pixel, 0).rgb;
+	return firstPass ? c / albedo(stored) : c;
+}
+
+float luminance(vec3 c)
+{
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// How much the brightness of the 3x3 pixels around this one changes (the standard deviation), which is how
+// noisy it is here. SVGF also keeps it over time, but here it is found again in every pass
+float noiseAround(ivec2 pixel, ivec2 size)
+{
+	float sum = 0.0;
+	float sumSquares = 0.0;
+	float count = 0.0;
+
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			ivec2 q = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+			uvec4 stored = texelFetch(hitTexture, q, 0);
+
+			if (uintBitsToFloat(stored.x) < 0.0)
+				continue;
+
+			float l = luminance(pixelLight(q, stored));
+			sum += l;
+			sumSquares += l * l;
+			count += 1.0;
+		}
+	}
+
+	float mean = sum / count;
+	return sqrt(max(sumSquares / count - mean * mean, 0.0));
+}
+
+void main(void)
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(frameTexture, 0);
+
+	uvec4 center = texelFetch(hitTexture, pixel, 0);
+	float t = uintBitsToFloat(center.x);
+
+	// the pixels that see nothing have no noise
+	if (t < 0.0)
+	{
+		color = vec4(texelFetch(frameTexture, pixel, 0).rgb, 1.0);
+		return;
+	}
+
+	vec3 normal = octDecode(unpackSnorm2x16(center.y));
+	vec3 centerLight = pixelLight(pixel, center);
+	float centerLuminance = luminance(centerLight);
+
+	// a little more than 0, so that a place with no noise at all does not divide by 0
+	float lightScale = LIGHT_SIGMA * noiseAround(pixel, size) + 1e-4;
+
+	// the B3 spline, which is what the a-trous filter uses
+	float kernel[5] = float[](1.0 / 16.0, 1.0 / 4.0, 3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+	vec3 sum = vec3(0);
+	float weights = 0.0;
+
+	for (int y = -2; y <= 2; y++)
+	{
+		for (int x = -2; x <= 2; x++)
+		{
+			ivec2 q = pixel + ivec2(x, y) * stepSize;
+
+			if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size)))
+				continue;
+
+			uvec4 stored = texelFetch(hitTexture, q, 0);
+			float qT = uintBitsToFloat(stored.x);
+
+			if (qT < 0.0)
+				continue;
+
+			vec3 qLight = pixelLight(q, stored);
+			float qLuminance = luminance(qLight);
+
+			float w = kernel[x + 2] * kernel[y + 2];
+			w *= exp(-abs(qT - t) / (DEPTH_SIGMA * t));
+			w *= pow(max(dot(normal, octDecode(unpackSnorm2x16(stored.y))), 0.0), NORMAL_POWER);
+			w *= exp(-abs(qLuminance - centerLuminance) / lightScale);
+
+			sum += qLight * w;
+			weights += w;
+		}
+	}
+
+	// the pixel itself always has a weight, so weights is never 0
+	vec3 result = sum / weights;
+
+	color = vec4(lastPass ? result * albedo(center) : result, 1.0);
+}
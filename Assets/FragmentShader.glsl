@@ -42,324 +42,567 @@ rendering.
 
 #version 430 // Identifies the version of the shader, this line must be on a separate line from the rest of the shader code
 
-// The uniform variables, these storing the camera position and the four corner rays of the camera's view.
-uniform vec3 eye;
-uniform vec3 ray00;
-uniform vec3 ray01;
-uniform vec3 ray10;
-uniform vec3 ray11;
+// The camera position and the four corner rays of the camera's view, in a uniform block that every
+// program shares (see Camera.glsl). With --views, the image is a grid of views, and eye and the
+// rays are the ones of the view that this pixel is in, which main() finds first
+int viewIndex = 0;
+#define CAMERA_VIEW viewIndex
+#include "Camera.glsl"
 
 // The input textureCoord relative to the quad as given by the Vertex Shader.
 in vec2 textureCoord;
 
 // The output of the Fragment Shader, AKA the pixel color.
-out vec4 color;
-
-// Every one of our triangles contains 3 points, a normal, and a color.
-struct triangle {
-	vec3 a;
-	vec3 b;
-	vec3 c;
-	vec3 normal;
-	vec3 color;
+layout(location = 0) out vec4 color;
+
+// With --reflection-scale, the reflections are traced in a smaller image first (reflectionPass),
+// where color is the reflection and how far away the point is (-1 if there is none to reflect),
+// and this is the normal of the point. The normal pixels are then made from that image (see upsampleReflection)
+layout(location = 1) out vec4 reflectionNormal;
+uniform bool reflectionPass;
+uniform bool reducedReflections;
+uniform int reflectionScale;
+layout(binding = 1) uniform sampler2D reflectionTexture;
+layout(binding = 2) uniform sampler2D reflectionNormalTexture;
+
+// shade() gets the reflection from upsampleReflection, when it can
+#define REDUCED_REFLECTIONS
+
+// With --shadow-scale, the shadow rays of the points that the eye sees are traced for a grid that is that many
+// times coarser on each side first (shadowPass). A sample of the grid is shadowSampleStride words of shadowSamples:
+// how far away its point is (-1 if there is none) and its normal, then a bit for every light that its shadow ray was
+// traced for, and then a bit for every light that was blocked. A pixel only traces the shadow ray of a light when
+// the 4 samples around it do not agree on it (the edge of a shadow), or are not on its surface (see reducedShadow).
+// The point lights make hard shadows, so most pixels trace none at all
+uniform bool shadowPass;
+uniform bool reducedShadows;
+uniform int shadowScale;
+uniform ivec2 shadowGridSize;
+uniform int shadowWords;
+
+layout(binding = 31) buffer reducedShadowBlock
+{
+	uint shadowSamples[];
 };
 
-struct light {
-	vec4 pos;
-	vec4 color;
-	float radius;
-	float brightness;
-	float junk1;
-	float junk2;
+#define REDUCED_SHADOWS
+
+// If this is true, the triangle that every pixel sees was already found by
+// rasterizing the triangles into visibilityTexture (see VisibilityFragment.glsl),
+// and the camera rays do not need to be traced. -1 means no triangle
+uniform bool visibilityBuffer;
+layout(binding = 0) uniform isampler2D visibilityTexture;
+
+// With --hit-buffer, the point that every pixel sees is found once, in a pass of its own (hitPass),
+// which writes it into hitTexture, and the passes after it read it from there instead of tracing the
+// camera ray again (hitBuffer). A pixel of hitTexture is the hitinfo of the point: how far along the ray
+// it is (less than 0 if the ray hits nothing), the normal packed like a triangle, the color and reflectivity
+// in 8 bits each (like a compact triangle), and the index of the triangle
+uniform bool hitPass;
+uniform bool hitBuffer;
+layout(location = 2) out uvec4 packedHit;
+layout(binding = 3) uniform usampler2D hitTexture;
+
+// With --temporal, a pixel that sees the same triangle as the pixel it was in the frame before (found with the
+// motion of its mesh, and the camera of the frame before), about as far from the eye, uses the color of that pixel
+// again instead of tracing anything. The alpha of the color says how many frames ago it was traced (1 - frames / 255),
+// and a color is never used for more than temporalRefresh frames, so the lights and reflections that moved are not wrong
+// for longer than that. Which pixels are traced again every frame is spread over the screen, so it is not all of them at once. historyHit is what the next frame checks: how far
+// along the ray the point is, and its triangle. historyValid is false when there is no frame before to use
+uniform bool temporal;
+uniform bool historyValid;
+uniform int temporalRefresh;
+uniform mat4 prevViewProj;
+uniform vec3 prevEye;
+layout(location = 3) out uvec2 historyHit;
+layout(binding = 4) uniform sampler2D historyColorTexture;
+layout(binding = 5) uniform usampler2D historyHitTexture;
+
+// With --checkerboard, only half of the pixels are traced again every frame, like the black squares of a
+// checkerboard, and the other half the next frame. A pixel that is not traced, and cannot use its color from
+// the frame before, is left as a hole with an alpha of 0, which CheckerboardResolve.glsl fills in
+uniform bool checkerboard;
+
+// With --adaptive-aa <n>, a pixel on an edge traces n more rays through other points of the pixel, and its color is
+// the average of all of them. A pixel is on an edge when the hit buffer says that a pixel next to it sees nothing,
+// or another surface (another normal, color, or reflectivity), or something much closer or farther. Most pixels are not
+// on an edge, so they only trace their one ray
+uniform int adaptiveSamples;
+
+layout(binding = 28) buffer motionBlock
+{
+	meshMotion motions[];
 };
 
-// Create some constants
-#define MAX_SCENE_BOUNDS 100.0
-#define NUM_TRIANGLES 14
-#define MAX_LIGHTS 2
+// --bench and --ray-stats count the rays of this renderer
+#define COUNT_RAYS
 
-// A layout describing the vertex buffer.
-layout(binding = 0) buffer vertexBlock
-{
-	triangle triangles[NUM_TRIANGLES];
-};
+// --cost-view counts the work of every pixel, and draws it as a heatmap (see costColor)
+#define COUNT_PIXEL_COST
+
+// The scene, the acceleration structures, and the lighting
+// functions are in this file, so that Wavefront.glsl can use them too
+#include "RayTracing.glsl"
 
-layout (binding = 1) buffer lightBlock
+// The reflection of a point that the eye sees, made from the 4 pixels of the small image around it.
+// A pixel of the small image only counts if its point is about as far away as this one, and faces
+// about the same way, so a reflection does not leak over the edge of an object onto what is behind it.
+// False if none of them count (or are reflective), and then the pixel traces its own reflection
+bool upsampleReflection(ivec2 pixel, float dist, vec3 normal, out vec3 reflection)
 {
-	light lights[MAX_LIGHTS];
-};
+	reflection = vec3(0);
 
-struct hitinfo
+	// where the pixel is in the small image, with the pixel centers at whole numbers
+	vec2 p = (vec2(pixel) + 0.5) / float(reflectionScale) - 0.5;
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - vec2(base);
+	ivec2 size = textureSize(reflectionTexture, 0);
+
+	float totalWeight = 0.0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+		vec4 sampled = texelFetch(reflectionTexture, texel, 0);
+
+		// nothing to reflect there
+		if (sampled.a < 0.0)
+			continue;
+
+		vec3 sampledNormal = texelFetch(reflectionNormalTexture, texel, 0).xyz;
+
+		// bilinear, times how close the distance and the normal are
+		vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+		float depthWeight = max(0.0, 1.0 - abs(sampled.a - dist) / (0.05 * dist));
+		float normalWeight = pow(max(dot(sampledNormal, normal), 0.0), 8.0);
+		float w = bilinear.x * bilinear.y * depthWeight * normalWeight;
+
+		reflection += sampled.rgb * w;
+		totalWeight += w;
+	}
+
+	if (totalWeight < 0.001)
+		return false;
+
+	reflection /= totalWeight;
+	return true;
+}
+
+// A sample of the grid of --shadow-scale: the distance, the normal, and 2 * shadowWords words of bits
+int shadowSampleStride()
 {
-	vec3 point;
-	int index;
-};
+	return 4 + 2 * shadowWords;
+}
 
-// Determines whether or not a ray in a given direction hits a given triangle.
-// Returns -1.0 if it does not; otherwise returns the value t at which the ray hits the triangle, which can be used to determine the point of collision.
-// p is point on ray, d is ray direction, v0, v1, and v2 are points of the triangle.
-float rayIntersectsTriangle(vec3 p, vec3 d, vec3 v0, vec3 v1, vec3 v2)
+// The pixel of the coarse grid of --shadow-scale: trace the shadow ray of every light that reaches the point
+// that the ray sees, and keep which were blocked. With the hit buffer, this is the point of the full size pixel
+// in the middle of this one, like traceReflection
+void traceShadowSamples(ivec2 pixel, vec3 dirEyeToTriangle)
 {
-	vec3 e1,e2,h,s,q;
-	float a,f,u,v, t;
-
-	// Get two edges of triangle
-	e1 = vec3(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
-	e2 = vec3(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z);
-	
-	// Cross ray direction with triangle edge
-	h = cross(d, e2);
-	
-	// Dot the other triangle edge with the above cross product
-	a = dot(e1, h);
-
-	// If a is zero or realy close to zero, then there's no collision.
-	if (a > -0.00001 && a < 0.00001)
+	int base = (pixel.y * shadowGridSize.x + pixel.x) * shadowSampleStride();
+	hitinfo hit;
+	bool found;
+
+	if (hitBuffer)
 	{
-		return -1.0;
+		ivec2 size = textureSize(hitTexture, 0);
+		ivec2 fullPixel = min(pixel * shadowScale + shadowScale / 2, size - 1);
+
+		found = cameraRay((vec2(fullPixel) + 0.5) / vec2(size), dirEyeToTriangle) &&
+			loadHit(fullPixel, dirEyeToTriangle, hit);
 	}
+	else
+	{
+		COUNT_RAY(primaryRays);
+		found = intersectTriangles(eye, dirEyeToTriangle, hit);
+	}
+
+	for (int w = 0; w < 2 * shadowWords; w++)
+		shadowSamples[base + 4 + w] = 0u;
 
-	// Take the inverse of a.
-	f = 1/a;
-	
-	// Get vector from first triangle vertex toward cameraPos (or in the scope of this function, the vec3 p that is a point on the ray direction)
-	s = vec3(p.x - v0.x, p.y - v0.y, p.z - v0.z);
-	
-	// Dot your s value with your h value from earlier (cross(d, e2)), then multiply by the inverse of a.
-	u = f * dot(s, h);
-
-	// If this value is not between 0 and 1, then there's no collision.
-	if (u < 0.0 || u > 1.0)
+	if (!found || !lodShadows(0))
 	{
-		return -1.0;
+		shadowSamples[base] = floatBitsToUint(-1.0);
+		return;
 	}
 
-	// Cross your s value with edge 1 (e1).
-	q = cross(s, e1);
+	shadowSamples[base] = floatBitsToUint(distance(eye, hit.point));
+	shadowSamples[base + 1] = floatBitsToUint(hit.normal.x);
+	shadowSamples[base + 2] = floatBitsToUint(hit.normal.y);
+	shadowSamples[base + 3] = floatBitsToUint(hit.normal.z);
 
-	// Dot the ray direction with this new q value, and then multiply by the inverse of a.
-	v = f * dot(d, q);
+	// the lights that can reach the point, the same ray as addLightColorToPixColor
+	uint first, count;
+	lightsNear(hit.point, first, count);
 
-	// If v is less than 0, or u + v are greater than 1, then there's no collision.
-	if (v < 0.0 || u + v > 1.0)
+	for (uint k = 0u; k < count; k++)
 	{
-		return -1.0;
+		int j = nearLight(first, k);
+		vec3 pointToLight = lights[j].pos - hit.point;
+		float dist = length(pointToLight);
+
+		if (dist > lights[j].radius)
+			continue;
+
+		int word = j >> 5;
+		uint bit = 1u << uint(j & 31);
+
+		shadowSamples[base + 4 + word] |= bit;
+
+		if (occludedByLight(j, lights[j].pos, -normalize(pointToLight), dist - 0.1))
+			shadowSamples[base + 4 + shadowWords + word] |= bit;
 	}
+}
+
+// The samples of the grid around the pixel that is being shaded, which reducedShadow reads,
+// if all 4 of them are on the same surface as its point (found by prepareReducedShadows)
+int shadowCorners[4];
+bool shadowCornersUsable = false;
+
+// Find the 4 samples of the grid around the pixel, like upsampleReflection. A sample only counts if its point is
+// about as far away as this one, and faces about the same way. If any of them does not, the pixel traces every ray
+void prepareReducedShadows(ivec2 pixel, hitinfo hit)
+{
+	shadowCornersUsable = false;
+
+	if (!reducedShadows)
+		return;
 
-	// At this stage we can compute t to find out where the intersection point is on the line
-	t = f * dot(e2, q);
+	vec2 p = (vec2(pixel) + 0.5) / float(shadowScale) - 0.5;
+	ivec2 base = ivec2(floor(p));
+	float dist = distance(eye, hit.point);
 
-	// If t is greater than zero
-	if (t > 0.00001)
+	for (int i = 0; i < 4; i++)
 	{
-		// The ray does intersect the triangle, and we return the t value.
-		return t;
+		ivec2 sampled = clamp(base + ivec2(i & 1, i >> 1), ivec2(0), shadowGridSize - 1);
+		int corner = (sampled.y * shadowGridSize.x + sampled.x) * shadowSampleStride();
+		float sampledDist = uintBitsToFloat(shadowSamples[corner]);
+
+		if (sampledDist < 0.0 || abs(sampledDist - dist) > 0.05 * dist)
+			return;
+
+		vec3 sampledNormal = vec3(uintBitsToFloat(shadowSamples[corner + 1]),
+			uintBitsToFloat(shadowSamples[corner + 2]), uintBitsToFloat(shadowSamples[corner + 3]));
+
+		if (dot(sampledNormal, hit.normal) < 0.95)
+			return;
+
+		shadowCorners[i] = corner;
 	}
-	
-	// Otherwise, there is a line intersection, but not a ray intersection, so we return -1.0.
-	return -1.0;
+
+	shadowCornersUsable = true;
 }
 
-// Given an origin point, a direction, and a variable to pass information back out to, this will test a ray against every triangle in the scene.
-// It will then return true or false, based on whether or not the ray collided with anything.
-// If it did, then the hitinfo object will be filled with a point of collision and an index referring to which triangle it intersects with first.
-bool intersectTriangles(vec3 origin, vec3 dir, out hitinfo info)
+int reducedShadow(int j)
 {
-	// Start our variables for determining the closest triangle.
-	// Smallest will be the smallest distance between the origin point and the point of collision.
-	// Found just determines whether or not there was a collision at all.
-	float smallest = MAX_SCENE_BOUNDS;
-	bool found = false;
-
-	// For each triangle.
-	for(int i = 0; i < NUM_TRIANGLES; i++)
+	if (!shadowCornersUsable)
+		return -1;
+
+	int word = j >> 5;
+	uint bit = 1u << uint(j & 31);
+	int blocked = -1;
+
+	for (int i = 0; i < 4; i++)
 	{
-		// If the dot product is 0, the vectors are 90 degrees apart (orthogonal or perpendicular).
-		// If the dot product is less than 0, the vectors are more than 90 degrees apart.
-		// If the dot product is greater than 0, the vectors are less than 90 degrees apart.
-
-		// If our direction can't hit the triangle
-		// skip this triangle, and check the next triangle
-		
-		if(dot(triangles[i].normal, dir) > 0)
-			continue;
+		// a sample that did not trace it (the light was out of its range) knows nothing about it
+		if ((shadowSamples[shadowCorners[i] + 4 + word] & bit) == 0u)
+			return -1;
 
-		// Compute distance t using above function to determine how far along the ray the triangle collides.
-		float t = rayIntersectsTriangle(origin, dir, triangles[i].a, triangles[i].b, triangles[i].c);
+		int sampled = (shadowSamples[shadowCorners[i] + 4 + shadowWords + word] & bit) != 0u ? 1 : 0;
 
-		// If t = -1.0 then there was no intersection, we also ignore it if t is not < smallest, as that would mean we already found a triangle that 
-		// was closer (and thus collides first).
-		if(t != -1.0 && t < smallest)
-		{
-			// This t becomes the new smallest.
-			smallest = t;
+		// the edge of a shadow goes between them
+		if (blocked >= 0 && sampled != blocked)
+			return -1;
+
+		blocked = sampled;
+	}
+
+	return blocked;
+}
+
+// The lighting of the point that the eye sees, which the compute
+// renderer in TiledRender.glsl does the same way
+#include "ShadePixel.glsl"
+
+// Which count the heatmap shows, 0 is the normal image. These must match main.cpp
+#define COST_VIEW_OFF 0
+#define COST_VIEW_TRIANGLES 1
+#define COST_VIEW_NODES 2
+#define COST_VIEW_SHADOWS 3
+#define COST_VIEW_ALL 4
 
-			// color can be found via index as can the normal
-			// Thus, we just pass out a point of collision using t and the triangle index.
-			info.point = origin + (dir * t);
-			info.index = i;
+uniform int costView;
+
+// The count that is drawn white, anything more is white too
+uniform float costScale;
+
+// The false color of a count: black for nothing, then blue, green, yellow, red, and white at costScale.
+// COST_VIEW_ALL adds up the work, with a node visit counting as half of a triangle test
+vec4 costColor()
+{
+	float cost = float(costTriangleTests);
+
+	if (costView == COST_VIEW_NODES)
+		cost = float(costNodeVisits);
+	else if (costView == COST_VIEW_SHADOWS)
+		cost = float(costShadowRays);
+	else if (costView == COST_VIEW_ALL)
+		cost = float(costTriangleTests) + 0.5 * float(costNodeVisits);
+
+	float x = clamp(cost / costScale, 0.0, 1.0) * 5.0;
+
+	vec3 heat = mix(vec3(0.0), vec3(0.0, 0.0, 1.0), clamp(x, 0.0, 1.0));
+	heat = mix(heat, vec3(0.0, 1.0, 0.0), clamp(x - 1.0, 0.0, 1.0));
+	heat = mix(heat, vec3(1.0, 1.0, 0.0), clamp(x - 2.0, 0.0, 1.0));
+	heat = mix(heat, vec3(1.0, 0.0, 0.0), clamp(x - 3.0, 0.0, 1.0));
+	heat = mix(heat, vec3(1.0), clamp(x - 4.0, 0.0, 1.0));
+
+	return vec4(heat, 1.0);
+}
+
+// The ray from the eye through a point of the image (0 to 1 across and up, like textureCoord).
+// With more than one view, this finds the view that the point is in first (viewIndex), and where
+// the point is in that view. The first view is at the top left. False if the grid has no view there
+bool cameraRay(vec2 pos, out vec3 dir)
+{
+	if (viewGrid.z > 1)
+	{
+		ivec2 cell = min(ivec2(pos * vec2(viewGrid.xy)), viewGrid.xy - 1);
+		viewIndex = cell.x + (viewGrid.y - 1 - cell.y) * viewGrid.x;
+		pos = pos * vec2(viewGrid.xy) - vec2(cell);
 
-			// Make sure we set found to true, signifying that the ray collided with something.
-			found = true;
+		// the grid can have more cells than there are views
+		if (viewIndex >= viewGrid.z)
+		{
+			dir = vec3(0);
+			return false;
 		}
 	}
 
-	return found;
+	return viewRay(pos, dir);
+}
+
+// Read the point that a pixel sees from hitTexture, which the hit pass wrote. dir is the camera ray of the pixel
+bool loadHit(ivec2 pixel, vec3 dir, out hitinfo hit)
+{
+	uvec4 stored = texelFetch(hitTexture, pixel, 0);
+	float t = uintBitsToFloat(stored.x);
+
+	vec4 colorReflectivity = unpackUnorm4x8(stored.z);
+
+	hit.point = eye + dir * t;
+	hit.index = int(stored.w);
+	hit.normal = octDecode(unpackSnorm2x16(stored.y));
+	hit.color = colorReflectivity.rgb;
+	hit.reflectivity = colorReflectivity.a;
+
+	return t >= 0.0;
 }
 
-vec3 addLightColorToPixColor(light L, vec3 dirRayToPoint, hitinfo rayHitPoint)
+// Find the point that the eye sees through this pixel, in the direction dir: from hitTexture, or the one
+// triangle in the visibility buffer, or by tracing the camera ray. False if the ray hits nothing
+bool primaryHit(ivec2 pixel, vec3 dir, out hitinfo eyeHitTriangle)
 {
-	// get direction from point to light
-	vec3 pointToLight = L.pos.xyz - rayHitPoint.point;
-	
-	// Get the distance from point on surface to light
-	float dist = length(pointToLight);
-
-	// if the pixel is outside the range of the 
-	// light, return 0. Don't process the light 
-	// if the light doesn't touch the pixel anyways
-	if(dist > L.radius)
-		return vec3(0);
-
-	// normalize the distance, to get direction
-	pointToLight = normalize(pointToLight);
-
-	// Create a hitinfo object to store the collision.
-	hitinfo lightHitPoint;
-
-	// Now we check to see if any polygons are standing between the point
-	// that the ray hit, and the light. If a polygon blocks this new ray from
-	// the light, then don't light this pixel (shadow). Otherwise, light it.
-	// If you do NOT want shadows, delete the if-statment
-	if(intersectTriangles(L.pos.xyz, -pointToLight, lightHitPoint))
+	if (hitBuffer)
+		return loadHit(pixel, dir, eyeHitTriangle);
+
+	if (visibilityBuffer)
 	{
-		// If the distance from the point to the light is farther than the distance from the light to the first surface it hits
-		if(dist - length(L.pos.xyz - lightHitPoint.point) > 0.1)
+		int index = texelFetch(visibilityTexture, pixel, 0).r;
+
+		// the rasterizer did not draw any triangle here, so the ray hits nothing
+		if (index < 0)
+			return false;
+
+		// We already know which triangle it is, so one ray-triangle test finds the point
+		float t = rayIntersectsTriangle(eye, dir, MAX_SCENE_BOUNDS, triangles[index].a, triangles[index].b, triangles[index].c);
+
+		// The rasterizer and the ray test can disagree about pixels right on the edge of
+		// a triangle. Then we trace the ray like normal, so the edges look the same
+		if (t != -1.0)
 		{
-			// Then this is in shadow, since the light is hitting another object first.
-			return vec3(0);
+			eyeHitTriangle.point = eye + dir * t;
+			eyeHitTriangle.index = index;
+			eyeHitTriangle.normal = triangleNormal(triangles[index]);
+			eyeHitTriangle.color = triangleColor(triangles[index]);
+			eyeHitTriangle.reflectivity = triangleReflectivity(triangles[index]);
+			return true;
 		}
 	}
 
-	// Get a reflection vector bouncing the light ray off the surface of the triangle.
-	// Used for specular light calculations.
-	vec3 reflectedRayToPoint = reflect(pointToLight, triangles[rayHitPoint.index].normal);
+	COUNT_RAY(primaryRays);
 
-	// get the dot product, just like the basic tutorials
-	float NdotL = dot(triangles[rayHitPoint.index].normal, pointToLight);
+	// Trace the ray from the eye, and find the closest triangle it intersects
+	return intersectTriangles(eye, dir, eyeHitTriangle);
+}
+
+// The mesh that triangle i is in, from the first triangles of the meshes, which are in order
+int meshOfTriangle(int i)
+{
+	int low = 0;
+	int high = numMeshes - 1;
 
-	// clamp the color
-	NdotL = clamp(NdotL, 0.0, 1.0);
+	while (low < high)
+	{
+		int middle = (low + high + 1) / 2;
 
-	// Formula for range-based attenuation
-	float atten = 1.0 - (dist*dist) / (L.radius*L.radius);
-	
-	// clamp the attenuation
-	atten = clamp(atten, 0.0, 1.0);
+		if (motions[middle].first <= i)
+			low = middle;
+		else
+			high = middle - 1;
+	}
 
-	// Get the final color of the light on the pixel
-	float diffuse = NdotL;
+	return low;
+}
 
-	// Calculate specular and diffuse lighting normally.
-	float specular = max(0, pow(dot(reflectedRayToPoint, dirRayToPoint), 64));
+// Find the color that the point of this pixel had in the frame before, for --temporal. The point is moved back
+// with its mesh, and seen with the camera of the frame before. False if it was not on the screen then, or
+// the pixel it was in saw another triangle, or something closer (it was behind something, or it is not the same point)
+bool reprojectHistory(hitinfo hit, out vec4 history)
+{
+	history = vec4(0);
 
-	vec3 brightness = L.brightness * L.color.xyz * atten;
+	if (!historyValid || hit.index < 0)
+		return false;
 
-	// Return our diffuse light and specular (we do white light, for specula) and factor in the reflectionLevel and lightIntensity.
-	return (triangles[rayHitPoint.index].color * brightness * diffuse) + (brightness * specular);
+	vec3 prevPoint = (motions[meshOfTriangle(hit.index)].motion * vec4(hit.point, 1.0)).xyz;
+	vec4 clip = prevViewProj * vec4(prevPoint, 1.0);
+
+	// behind the camera of the frame before
+	if (clip.w <= 0.0)
+		return false;
+
+	ivec2 size = textureSize(historyHitTexture, 0);
+	ivec2 prevPixel = ivec2(floor((clip.xy / clip.w * 0.5 + 0.5) * vec2(size)));
+
+	if (any(lessThan(prevPixel, ivec2(0))) || any(greaterThanEqual(prevPixel, size)))
+		return false;
+
+	uvec2 prevHit = texelFetch(historyHitTexture, prevPixel, 0).xy;
+	float prevT = uintBitsToFloat(prevHit.x);
+
+	if (prevT < 0.0 || int(prevHit.y) != hit.index || abs(prevT - distance(prevEye, prevPoint)) > 0.01 * prevT)
+		return false;
+
+	history = texelFetch(historyColorTexture, prevPixel, 0);
+
+	// one frame older than it was then
+	history.a -= 1.0 / 255.0;
+
+	return history.a > 1.0 - float(temporalRefresh) / 255.0 + 0.5 / 255.0;
 }
 
-vec3 addReflectionToPixColor(light L, vec3 dir, hitinfo rayHitPoint, int maxBounces)
+// The pixel of the small image of --reflection-scale: the reflection of the point that
+// the ray sees, and how far away it is, and its normal in reflectionNormal
+vec4 traceReflection(ivec2 pixel, vec3 dirEyeToTriangle)
 {
-	// Gets a vector in the direction of the reflected ray.
-	vec3 reflectedRayToPoint;
-
-	// We're doing another collision test here to get the reflection.
-	// You can see how this starts to get intensive and can slow down your framerate, since every 
-	// one of these intersectTriangles calls tests a ray against every triangle in the scene. 
-	// There are ways to optimize this (spatial partitioning), but ultimately Ray Tracing is not a 
-	// technique for real-time rendering.
-	hitinfo reflectHit;
-	
-	// color that will be added for all reflections
-	vec3 color = vec3(0);
-
-	for(int i = 0; i < maxBounces; i++)
+	hitinfo eyeHitTriangle;
+	bool found;
+
+	reflectionNormal = vec4(0);
+
+	// With the hit buffer, this is the point of the full size pixel in the middle of this one
+	if (hitBuffer)
 	{
-		// Gets a vector in the direction of the reflected ray.
-		reflectedRayToPoint = reflect(dir, triangles[rayHitPoint.index].normal);
+		ivec2 size = textureSize(hitTexture, 0);
+		ivec2 fullPixel = min(pixel * reflectionScale + reflectionScale / 2, size - 1);
 
-		// If the reflected vector hits a triangle.
-		// Render the pixel of that triangle
-		if(intersectTriangles(rayHitPoint.point, reflectedRayToPoint, reflectHit))
-		{
-			// This is the lighting that is in the geometry that is reflected off of other geomtry
-			color += addLightColorToPixColor(L, reflectedRayToPoint, reflectHit) * pow(0.5, i);
+		found = cameraRay((vec2(fullPixel) + 0.5) / vec2(size), dirEyeToTriangle) &&
+			loadHit(fullPixel, dirEyeToTriangle, eyeHitTriangle);
+	}
+	else
+	{
+		COUNT_RAY(primaryRays);
+		found = intersectTriangles(eye, dirEyeToTriangle, eyeHitTriangle);
+	}
 
-			dir = reflectedRayToPoint;
-			rayHitPoint = reflectHit;
-		}
+	if (!found || eyeHitTriangle.reflectivity <= 0.0)
+		return vec4(vec3(0), -1.0);
 
-		// If we hit nothing
-		// exit the loop
-		else
-		{
-			break;
-		}
+	reflectionNormal = vec4(eyeHitTriangle.normal, 0.0);
+
+	// the same random numbers as the full size pixel would have
+	uint seed = pixelSeed(pixel);
+	samplePixel = pixel;
+
+	return vec4(addReflectionToPixColor(dirEyeToTriangle, eyeHitTriangle, seed), distance(eye, eyeHitTriangle.point));
+}
+
+#ifdef REFLECTION_PROBES
+// A pixel of a face of a probe of --reflection-probes (probePass), with the camera at the probe. It is the
+// point that the ray sees, lit like a first reflection, with its own reflections traced all the way
+vec4 traceProbe(ivec2 pixel, vec3 dir)
+{
+	hitinfo hit;
+
+	if (!intersectTriangles(eye, dir, hit))
+		return vec4(vec3(0), 1.0);
+
+	uint seed = pixelSeed(pixel);
+	samplePixel = pixel;
+
+	return vec4(addAllLightsToPixColor(dir, hit, 1) + addReflectionToPixColor(dir, hit, seed), 1.0);
+}
+#endif
+
+// True if this pixel is on an edge of --adaptive-aa, from the hits of the pixels next to it in the hit buffer
+bool edgePixel(ivec2 pixel)
+{
+	ivec2 size = textureSize(hitTexture, 0);
+	uvec4 center = texelFetch(hitTexture, pixel, 0);
+	float t = uintBitsToFloat(center.x);
+
+	ivec2 offsets[4] = ivec2[](ivec2(1, 0), ivec2(-1, 0), ivec2(0, 1), ivec2(0, -1));
+
+	for (int i = 0; i < 4; i++)
+	{
+		uvec4 neighbor = texelFetch(hitTexture, clamp(pixel + offsets[i], ivec2(0), size - 1), 0);
+		float neighborT = uintBitsToFloat(neighbor.x);
+
+		// the edge of the scene, where one of them sees nothing
+		if ((t < 0.0) != (neighborT < 0.0))
+			return true;
+
+		if (t < 0.0)
+			continue;
+
+		// The two triangles of a flat side of a cube have the same normal and color, so there is no edge between them.
+		// The normal and the color are compared as they are stored, so that the same ones are always equal
+		if (neighbor.y != center.y || neighbor.z != center.z || abs(neighborT - t) > 0.05 * t)
+			return true;
 	}
-	
-	// return final color
-	// Skybox can be added to color after calculations
-	return color;
+
+	return false;
 }
 
-// Trace a ray from an origin point in a given direction and calculate/return the color value of the point that ray hits.
-vec4 trace(vec3 origin, vec3 dirEyeToTriangle)
+// The color of a pixel on an edge of --adaptive-aa: the average of the color that it already has, and the colors
+// of adaptiveSamples more rays, spread over the pixel like the samples of 8x MSAA
+vec3 antialiasPixel(ivec2 pixel, vec3 centerColor)
 {
-	// Create object to get our hitinfo back out of the intersectTriangles function.
-	hitinfo eyeHitTriangle;
+	vec2 offsets[8] = vec2[](vec2(1, -3), vec2(-1, 3), vec2(5, 1), vec2(-3, -5),
+		vec2(-5, 5), vec2(-7, -1), vec2(3, 7), vec2(7, -7));
 
-	// If this ray intersects any of the triangles in the scene.
-	if (intersectTriangles(origin, dirEyeToTriangle, eyeHitTriangle))
+	vec2 size = vec2(textureSize(hitTexture, 0));
+	vec3 sum = centerColor;
+	int samples = min(adaptiveSamples, 8);
+
+	for (int i = 0; i < samples; i++)
 	{
+		vec3 sampleDir;
+		hitinfo sampleHit;
 
-		// Create a pixColor variable, which will determine the output color of this pixel. Start with some ambient light.
-		vec3 pixColor = triangles[eyeHitTriangle.index].color * 0.1;
+		if (!cameraRay((vec2(pixel) + 0.5 + offsets[i] / 16.0) / size, sampleDir))
+			continue;
 
-		// Loop through each light. By default, we have 4 lights.
-		// To use 4 lights, we have "j < MAX_LIGHTS" in our 'for' loop.
-		// If you want to use less lights, you can use "j < 1"
-		// or "j < 2", to reduce the amount of processing and boost FPS
-		for(int j = 0; j < MAX_LIGHTS; j++)
-		{
-			// color of reflected light
-			// This is a combination of the color of the polygon that the eye's ray hit,
-			// and the lighting that effects this point (4 lights, shadows, specular, etc)
-			// This function returns the geometry color
-			vec3 lightColor = addLightColorToPixColor(lights[j], dirEyeToTriangle, eyeHitTriangle);
-			
-			// color of reflections
-			// We set the number of ray bounces to 4, feel free to increase or decrease.
-			// If you do not want reflections, you can set that number to zero
-			vec3 reflection = addReflectionToPixColor(lights[j], dirEyeToTriangle, eyeHitTriangle, 2);
-
-			// Level of Reflectivity:
-			// 0.5 = half and half
-			// 1.0 = perfect mirror, plus the ambient color
-			// 0.0 = no reflection
-			float reflectionLevel = 0.5;
-	
-			// blend the two colors together
-			pixColor += mix(lightColor, reflection, reflectionLevel);
-		}
-		
-		// Return the final pixel color.		
-		return vec4(pixColor.rgb, 1.0);
+		// the hit buffer only has the middle of the pixel, so these are traced
+		COUNT_RAY(primaryRays);
+
+		if (intersectTriangles(eye, sampleDir, sampleHit))
+			sum += shade(pixel, sampleDir, sampleHit).rgb;
 	}
 
-	// If the ray doesn't hit any triangles, then this ray sees nothing and thus:
-	// Return 0, which can be replaced with skybox
-	return vec4(vec3(0), 1.0);
+	return sum / float(samples + 1);
 }
 
 void main(void)
@@ -371,7 +614,87 @@ void main(void)
 	// For your mental image, imagine this shader runes once for every single pixel on your screen.
 	// Every time it runs, dir is the ray that goes from the camera's position, through the pixel that it is rendering. Thus, we are tracing a ray through every pixel 
 	// on the screen to determine what to render.
-	vec2 pos = textureCoord;
-	vec3 dir = normalize(mix(mix(ray00, ray01, pos.y), mix(ray10, ray11, pos.y), pos.x));
-	color = trace(eye, dir);
-}
\ No newline at end of file
+	vec3 dir;
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	rayTime = pixelTime(pixel);
+
+	if (!cameraRay(textureCoord, dir))
+	{
+		color = vec4(vec3(0), 1.0);
+		packedHit = uvec4(floatBitsToUint(-1.0), 0u, 0u, 0u);
+		historyHit = uvec2(floatBitsToUint(-1.0), 0u);
+		return;
+	}
+
+#ifdef REFLECTION_PROBES
+	if (probePass)
+	{
+		color = traceProbe(pixel, dir);
+		return;
+	}
+#endif
+
+	if (reflectionPass)
+	{
+		color = traceReflection(pixel, dir);
+		return;
+	}
+
+	if (shadowPass)
+	{
+		traceShadowSamples(pixel, dir);
+		return;
+	}
+
+	// Create object to get our hitinfo back out of the intersectTriangles function.
+	hitinfo eyeHitTriangle;
+	bool found = primaryHit(pixel, dir, eyeHitTriangle);
+
+	if (hitPass)
+	{
+		packedHit = found ? uvec4(floatBitsToUint(distance(eye, eyeHitTriangle.point)), packTriangleNormal(eyeHitTriangle.normal),
+			packUnorm4x8(vec4(eyeHitTriangle.color, eyeHitTriangle.reflectivity)), uint(eyeHitTriangle.index)) :
+			uvec4(floatBitsToUint(-1.0), 0u, 0u, 0u);
+		return;
+	}
+
+	if (temporal)
+	{
+		historyHit = found ? uvec2(floatBitsToUint(distance(eye, eyeHitTriangle.point)), uint(eyeHitTriangle.index)) :
+			uvec2(floatBitsToUint(-1.0), 0u);
+
+		// the pixels that are traced again this frame, whatever they see, go across the screen in diagonal lines,
+		// or with --checkerboard, every other pixel
+		bool refresh = checkerboard ? ((pixel.x + pixel.y + int(frameSeed & 1u)) & 1) == 0 :
+			(pixel.x + pixel.y * 2) % temporalRefresh == int(frameSeed % uint(temporalRefresh));
+
+		if (found && !refresh)
+		{
+			if (reprojectHistory(eyeHitTriangle, color))
+				return;
+
+			if (checkerboard)
+			{
+				color = vec4(0);
+				return;
+			}
+		}
+	}
+
+	// If the ray doesn't hit any triangles, then this ray sees nothing and thus:
+	// Return 0, which can be replaced with skybox
+	if (found)
+		prepareReducedShadows(pixel, eyeHitTriangle);
+
+	color = found ? shade(pixel, dir, eyeHitTriangle) : vec4(vec3(0), 1.0);
+
+	// the samples of --adaptive-aa can see other surfaces
+	shadowCornersUsable = false;
+
+	if (adaptiveSamples > 0 && hitBuffer && edgePixel(pixel))
+		color.rgb = antialiasPixel(pixel, color.rgb);
+
+	// The pixel is still shaded, so that its shadow and reflection rays are counted too
+	if (costView != COST_VIEW_OFF)
+		color = costColor();
+}
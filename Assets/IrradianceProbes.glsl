@@ -0,0 +1,126 @@
+/*
+Title: Advanced Ray Tracer
+File Name: IrradianceProbes.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The irradiance probes of --irradiance-probes, which take the place of the
+constant ambient light (0.1 of the color) in the renderers. The probes are
+a grid across the box of the scene, and every probe is an ambient cube: 6
+colors, the light that comes from the +X, -X, +Y, -Y, +Z, and -Z sides of
+it (see ambientLight in RayTracing.glsl, which reads the 8 probes around
+a point and mixes the sides by the normal).
+
+Every frame, a few of the probes are traced again, in turns, so the cost
+of a frame is the same with any number of probes, and a light or a mesh
+that moves changes the ambient light a few frames later. Every workgroup
+is one probe, and every thread traces one ray from its center, in
+PROBE_RAYS directions that cover the sphere evenly (a Fibonacci sphere),
+turned at random every time, so the probe sees more of the scene every
+time it is traced. The light of a ray is the light of the point it hits,
+like a first reflection, plus the ambient light of that point from the
+probes, which is the light that bounced more than once. Then every side
+of the cube is the average of the rays on its side, weighted by the
+cosine, mixed into what it had before by probeBlend. A probe that was
+never traced has 0 in w, and ambientLight leaves it out.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// one ray of the probe per thread, must match IRRADIANCE_PROBE_RAYS in main.cpp
+#define PROBE_RAYS 64
+
+layout(local_size_x = PROBE_RAYS, local_size_y = 1, local_size_z = 1) in;
+
+// RayTracing.glsl has reflections, which start from the eye
+#include "Camera.glsl"
+
+// The scene, the acceleration structures, the lighting, and the probes
+#include "RayTracing.glsl"
+
+// The probes of this dispatch are firstProbe and the ones after it, in turns through all of them
+uniform int firstProbe;
+uniform float probeBlend;
+
+shared vec3 rayLight[PROBE_RAYS];
+shared vec3 rayDirection[PROBE_RAYS];
+
+void main()
+{
+	ivec3 count = ivec3(irradiance.countX, irradiance.countY, irradiance.countZ);
+	int totalProbes = count.x * count.y * count.z;
+	int probe = (firstProbe + int(gl_WorkGroupID.x)) % totalProbes;
+	uint i = gl_LocalInvocationIndex;
+
+	ivec3 cell = ivec3(probe % count.x, (probe / count.x) % count.y, probe / (count.x * count.y));
+	vec3 center = irradiance.boxMin + (irradiance.boxMax - irradiance.boxMin) * (vec3(cell) + 0.5) / vec3(count);
+
+	// the same turn for every ray of the probe
+	uint seed = hashUint(uint(probe) ^ hashUint(frameSeed));
+	float turn = randomFloat(seed) * 6.2831853;
+	float tilt = randomFloat(seed) * 2.0 - 1.0;
+
+	// the Fibonacci sphere: evenly spaced heights, and the golden angle around
+	float z = 1.0 - (2.0 * float(i) + 1.0) / float(PROBE_RAYS);
+	float r = sqrt(max(1.0 - z * z, 0.0));
+	float phi = float(i) * 2.3999632 + turn;
+	vec3 dir = vec3(r * cos(phi), z, r * sin(phi));
+
+	// tip the sphere over a little, so the poles are not always in the same place
+	float c = sqrt(1.0 - tilt * tilt * 0.25);
+	dir = vec3(dir.x, c * dir.y - 0.5 * tilt * dir.z, 0.5 * tilt * dir.y + c * dir.z);
+
+	hitinfo hit;
+	vec3 seen = vec3(0);
+
+	if (intersectTriangles(center, dir, hit))
+	{
+		seen = addAllLightsToPixColor(dir, hit, 1) * (1.0 - hit.reflectivity) +
+			hit.color * ambientLight(hit.point, hit.normal);
+	}
+
+	rayLight[i] = seen;
+	rayDirection[i] = dir;
+	barrier();
+
+	// one thread per side of the cube
+	if (i < 6u)
+	{
+		int axis = int(i) / 2;
+		float sign = (i % 2u == 0u) ? 1.0 : -1.0;
+		vec3 sum = vec3(0);
+		float weight = 0.0;
+
+		for (int k = 0; k < PROBE_RAYS; k++)
+		{
+			float w = max(rayDirection[k][axis] * sign, 0.0);
+			sum += rayLight[k] * w;
+			weight += w;
+		}
+
+		vec4 before = irradianceCubes[6 * probe + int(i)];
+		vec3 now = sum / max(weight, 1e-6);
+
+		// the first time, the probe has nothing to mix with
+		irradianceCubes[6 * probe + int(i)] = vec4(before.w > 0.0 ? mix(before.rgb, now, probeBlend) : now, 1.0);
+	}
+}
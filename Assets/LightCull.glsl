@@ -0,0 +1,159 @@
+/*
+Title: Advanced Ray Tracer
+File Name: LightCull.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Every light has a radius, and it does not light anything outside of it.
+With hundreds of small lights, most lights do not reach most pixels, but
+FragmentShader.glsl would still loop over every one of them for every
+pixel. This shader splits the screen into tiles of TILE_SIZE x TILE_SIZE
+pixels, and makes a list of the lights that can reach something in each
+tile, before the fragment shader runs.
+
+Everything that a tile sees is inside a pyramid: its tip is the eye, and
+its four sides go through the corner rays of the tile. A light can only
+light something in the tile if its sphere (pos and radius) touches that
+pyramid. The test is conservative: a light might be kept even though it
+does not light anything, but a light that does is never thrown away.
+
+Every workgroup does one tile, and its threads split up the lights. The
+list of a tile is a bit mask with one bit per light, so the fragment
+shader still goes through its lights in the same order as before, and
+the image is exactly the same as without the lists.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// CompileSpirv.bat compiles this shader to SPIR-V ahead of time (--spirv), and then the
+// #include of SceneStructs.h needs this. GL_SPIRV is only defined for SPIR-V
+#ifdef GL_SPIRV
+#extension GL_GOOGLE_include_directive : require
+#endif
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// must match the defines in FragmentShader.glsl, RayTracing.glsl, and main.cpp.
+// In SPIR-V these are specialization constants, which main.cpp sets from its own defines (see startSpirvProgram)
+#ifdef GL_SPIRV
+layout(constant_id = 0) const int MAX_LIGHTS = 4096;
+layout(constant_id = 1) const int TILE_SIZE = 16;
+#else
+#define TILE_SIZE 16
+#define MAX_LIGHTS 4096
+#endif
+#define MASK_WORDS (MAX_LIGHTS / 32)
+
+// the same camera as FragmentShader.glsl, view 0 of the camera block
+#include "Camera.glsl"
+
+layout(location = 5) uniform int numLights;
+
+// the size of the image, and how many tiles there are in a row
+layout(location = 6) uniform int imageWidth;
+layout(location = 7) uniform int imageHeight;
+layout(location = 8) uniform int tilesX;
+
+// the same light struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+// Only the start of the light buffer, this does not use the light grid
+layout(binding = 1) readonly restrict buffer lightBlock
+{
+	light lights[];
+};
+
+// MASK_WORDS uints for every tile. Bit b of word w is on if light w * 32 + b can reach the tile
+layout(binding = 21) buffer tileLightBlock
+{
+	uint tileLightMasks[];
+};
+
+shared uint mask[MASK_WORDS];
+
+// The ray through a point on the screen, the same as main() in FragmentShader.glsl.
+// (0, 0) is the bottom left corner, and (1, 1) is the top right corner
+vec3 cornerRay(vec2 pos)
+{
+	return mix(mix(ray00, ray01, pos.y), mix(ray10, ray11, pos.y), pos.x);
+}
+
+void main()
+{
+	uint lid = gl_LocalInvocationID.x;
+	ivec2 tile = ivec2(gl_WorkGroupID.xy);
+
+	// there can be more words than threads
+	for (uint w = lid; w < uint(MASK_WORDS); w += 64u)
+		mask[w] = 0u;
+
+	// The corners of the tile on the screen. The tiles on the right and
+	// top edges can be smaller, if the image size is not a multiple of TILE_SIZE
+	vec2 imageSize = vec2(imageWidth, imageHeight);
+	vec2 lo = vec2(tile * TILE_SIZE) / imageSize;
+	vec2 hi = min(vec2((tile + 1) * TILE_SIZE), imageSize) / imageSize;
+
+	vec3 c00 = cornerRay(vec2(lo.x, lo.y));
+	vec3 c10 = cornerRay(vec2(hi.x, lo.y));
+	vec3 c11 = cornerRay(vec2(hi.x, hi.y));
+	vec3 c01 = cornerRay(vec2(lo.x, hi.y));
+	vec3 center = cornerRay((lo + hi) * 0.5);
+
+	// The four sides of the pyramid. Every side goes through the eye and two
+	// corner rays, and its normal is flipped if needed, so that it points into the tile
+	vec3 planes[4];
+	planes[0] = normalize(cross(c00, c10));
+	planes[1] = normalize(cross(c10, c11));
+	planes[2] = normalize(cross(c11, c01));
+	planes[3] = normalize(cross(c01, c00));
+
+	for (int p = 0; p < 4; p++)
+	{
+		if (dot(planes[p], center) < 0.0)
+			planes[p] = -planes[p];
+	}
+
+	barrier();
+
+	for (int j = int(lid); j < numLights; j += 64)
+	{
+		vec3 toLight = lights[j].pos - eye;
+		float radius = lights[j].radius;
+
+		// if the sphere is completely outside of any side, it can't light anything in the tile
+		bool inside = true;
+		for (int p = 0; p < 4; p++)
+		{
+			if (dot(planes[p], toLight) < -radius)
+				inside = false;
+		}
+
+		if (inside)
+			atomicOr(mask[j / 32], 1u << uint(j % 32));
+	}
+
+	barrier();
+
+	int tileIndex = tile.y * tilesX + tile.x;
+
+	for (uint w = lid; w < uint(MASK_WORDS); w += 64u)
+		tileLightMasks[tileIndex * MASK_WORDS + int(w)] = mask[w];
+}
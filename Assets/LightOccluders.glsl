@@ -0,0 +1,152 @@
+/*
+Title: Advanced Ray Tracer
+File Name: LightOccluders.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The per-light occluder lists of --light-occluders. A shadow ray goes from
+its light to a point that is inside the radius of the light (farther than
+that, the light adds nothing, and no ray is traced), so the whole ray is
+inside the sphere of the light, and only a triangle that touches the
+sphere can block it. Every frame, after Compute.glsl moved the triangles
+into the world, this puts the index of every triangle into the list of
+every light whose sphere it touches, and the shadow rays of a light only
+test the triangles of its list (see occludedByLight in RayTracing.glsl).
+A small light in a big scene has a list of a few dozen triangles, which
+is much less than the nodes that a walk of the BVH from it reads.
+
+Every thread is a triangle, and goes through the lights. occluderData has
+a count for every light, and then OCCLUDER_LIST_SIZE indexes for every
+light. A list that gets more triangles than that keeps counting, and the
+rays of its light walk the BVH like before, so the shadows are the same
+with or without the lists. The order in a list is whatever order the
+atomics happened in, which does not matter, since a shadow ray only needs
+to know if anything is in the way.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// must match MAX_LIGHTS in main.cpp, and OCCLUDER_LIST_SIZE comes from --light-occluders
+#define MAX_LIGHTS 4096
+#ifndef OCCLUDER_LIST_SIZE
+#define OCCLUDER_LIST_SIZE 256
+#endif
+
+// the same triangle and light structs as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+// Only the start of the light buffer, this does not use the light grid
+layout(binding = 1) readonly restrict buffer lightBlock
+{
+	light lights[];
+};
+
+// the same as lightOccluderBlock in RayTracing.glsl
+layout(binding = 10) buffer lightOccluderBlock
+{
+	uint occluderCounts[MAX_LIGHTS];
+	uint occluderLists[];
+};
+
+uniform int numTriangles;
+uniform int numLights;
+
+// The point of the triangle that is closest to p (from Real-Time Collision Detection, by Christer Ericson).
+// It is a corner, a point on an edge, or a point inside the triangle, depending on which region of the triangle p is in
+vec3 closestPointOnTriangle(vec3 p, vec3 a, vec3 b, vec3 c)
+{
+	vec3 ab = b - a;
+	vec3 ac = c - a;
+	vec3 ap = p - a;
+
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if (d1 <= 0.0 && d2 <= 0.0)
+		return a;
+
+	vec3 bp = p - b;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if (d3 >= 0.0 && d4 <= d3)
+		return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+		return a + ab * (d1 / (d1 - d3));
+
+	vec3 cp = p - c;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if (d6 >= 0.0 && d5 <= d6)
+		return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+		return a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0 / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+
+	if (i >= numTriangles)
+		return;
+
+	vec3 a = triangles[i].a;
+	vec3 b = triangles[i].b;
+	vec3 c = triangles[i].c;
+	vec3 boxMin = min(a, min(b, c));
+	vec3 boxMax = max(a, max(b, c));
+
+	for (int j = 0; j < min(numLights, MAX_LIGHTS); j++)
+	{
+		vec3 pos = lights[j].pos;
+
+		// A little bigger than the radius, so that rounding never leaves out a triangle that a ray hits.
+		// The box of the triangle is checked first, since most triangles are far from most lights
+		float reach = lights[j].radius * 1.001 + 0.001;
+
+		if (distance(clamp(pos, boxMin, boxMax), pos) > reach)
+			continue;
+
+		if (distance(closestPointOnTriangle(pos, a, b, c), pos) > reach)
+			continue;
+
+		uint slot = atomicAdd(occluderCounts[j], 1u);
+
+		if (slot < uint(OCCLUDER_LIST_SIZE))
+			occluderLists[j * OCCLUDER_LIST_SIZE + int(slot)] = uint(i);
+	}
+}
@@ -0,0 +1,214 @@
+/*
+Title: Advanced Ray Tracer
+File Name: RadixSort.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A parallel radix sort, which sorts (key, value) pairs by their key. The
+BVH build uses it to sort triangles by their Morton code.
+
+A radix sort looks at a few bits of the key at a time (4 bits here,
+which is a "digit" with 16 possible values), and moves every pair into
+the right place for that digit, without changing the order of pairs
+that have the same digit. After doing that for every digit, from the
+lowest bits to the highest bits, the whole array is sorted.
+
+Every digit is three passes, and main.cpp picks the pass with the
+"pass" uniform:
+
+PASS_HISTOGRAM: Every workgroup counts how many of its keys have each
+                digit value.
+PASS_SCAN:      Add up the counts (a prefix sum), so that every workgroup
+                knows where its keys with each digit value go.
+PASS_SCATTER:   Every key goes to the place for its digit value, plus the
+                number of keys before it in its workgroup with the same
+                digit value. That keeps the sort stable.
+
+Every pass reads from keysIn and writes to keysOut, and main.cpp swaps
+them after every digit.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// Every workgroup sorts one block of 256 keys
+#define BLOCK_SIZE 256
+layout(local_size_x = BLOCK_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+#define PASS_HISTOGRAM 0
+#define PASS_SCAN 1
+#define PASS_SCATTER 2
+
+// 4 bits per digit, so 16 possible values
+#define RADIX_BITS 4
+#define RADIX 16
+
+// The uniforms are at fixed locations, because a SPIR-V program (--spirv) may not know their names
+layout(location = 0) uniform int pass;
+
+// how many keys there are, and how many blocks of 256 keys
+layout(location = 1) uniform int numKeys;
+layout(location = 2) uniform int numBlocks;
+
+// which bits of the key this digit is
+layout(location = 3) uniform int bitShift;
+
+// x is the key, y is the value that goes with it
+layout(binding = 8) buffer keysInBlock
+{
+	uvec2 keysIn[];
+};
+
+layout(binding = 10) buffer keysOutBlock
+{
+	uvec2 keysOut[];
+};
+
+// The count of every digit value in every block, stored with all
+// blocks of digit 0 first, then all blocks of digit 1, etc.
+// After PASS_SCAN, every count is replaced with the sum of the counts before it,
+// which is exactly where that block's keys with that digit go
+layout(binding = 11) buffer histogramBlock
+{
+	uint histogram[];
+};
+
+shared uint digitCount[RADIX];
+
+// For the scan, every thread holds one number
+shared uint scanSums[BLOCK_SIZE];
+
+// For the scatter, every thread holds a count for each of the 16 digits.
+// Each count is 16 bits, two counts fit in a uint, so 16 counts fit in two uvec4s
+shared uvec4 rankLow[BLOCK_SIZE];
+shared uvec4 rankHigh[BLOCK_SIZE];
+
+uint digitOf(uint key)
+{
+	return (key >> uint(bitShift)) & uint(RADIX - 1);
+}
+
+void main()
+{
+	uint lid = gl_LocalInvocationID.x;
+	uint block = gl_WorkGroupID.x;
+	uint i = gl_GlobalInvocationID.x;
+
+	if (pass == PASS_HISTOGRAM)
+	{
+		if (lid < uint(RADIX))
+			digitCount[lid] = 0u;
+
+		barrier();
+
+		if (i < uint(numKeys))
+			atomicAdd(digitCount[digitOf(keysIn[i].x)], 1u);
+
+		barrier();
+
+		if (lid < uint(RADIX))
+			histogram[lid * uint(numBlocks) + block] = digitCount[lid];
+	}
+
+	else if (pass == PASS_SCAN)
+	{
+		// Only one workgroup runs this pass. Every thread adds up one
+		// chunk of the histogram, then the 256 chunk sums are scanned together
+		uint total = uint(RADIX * numBlocks);
+		uint chunk = (total + uint(BLOCK_SIZE) - 1u) / uint(BLOCK_SIZE);
+		uint start = lid * chunk;
+		uint end = min(start + chunk, total);
+
+		uint sum = 0u;
+		for (uint k = start; k < end; k++)
+			sum += histogram[k];
+
+		scanSums[lid] = sum;
+		barrier();
+
+		// Hillis-Steele scan: after step s, every thread holds the
+		// sum of itself and the 2^s threads before it
+		for (uint offset = 1u; offset < uint(BLOCK_SIZE); offset *= 2u)
+		{
+			uint add = lid >= offset ? scanSums[lid - offset] : 0u;
+			barrier();
+			scanSums[lid] += add;
+			barrier();
+		}
+
+		// this thread's chunk starts after the sums of all chunks before it
+		uint running = scanSums[lid] - sum;
+
+		for (uint k = start; k < end; k++)
+		{
+			uint count = histogram[k];
+			histogram[k] = running;
+			running += count;
+		}
+	}
+
+	else if (pass == PASS_SCATTER)
+	{
+		bool valid = i < uint(numKeys);
+		uvec2 key = valid ? keysIn[i] : uvec2(0u);
+		uint digit = digitOf(key.x);
+
+		// Put a one in the 16 bit slot for this thread's digit
+		uvec4 low = uvec4(0u);
+		uvec4 high = uvec4(0u);
+
+		if (valid)
+		{
+			uint one = 1u << ((digit & 1u) * 16u);
+
+			if (digit < 8u)
+				low[digit / 2u] = one;
+			else
+				high[(digit - 8u) / 2u] = one;
+		}
+
+		rankLow[lid] = low;
+		rankHigh[lid] = high;
+		barrier();
+
+		// Scan all 16 counts at once. After this, every thread knows how many
+		// threads up to and including itself have each digit value
+		for (uint offset = 1u; offset < uint(BLOCK_SIZE); offset *= 2u)
+		{
+			uvec4 addLow = lid >= offset ? rankLow[lid - offset] : uvec4(0u);
+			uvec4 addHigh = lid >= offset ? rankHigh[lid - offset] : uvec4(0u);
+			barrier();
+			rankLow[lid] += addLow;
+			rankHigh[lid] += addHigh;
+			barrier();
+		}
+
+		if (valid)
+		{
+			uint packedCount = digit < 8u ? rankLow[lid][digit / 2u] : rankHigh[lid][(digit - 8u) / 2u];
+
+			// The count includes this thread, so subtract one
+			// to get the number of threads before it
+			uint rank = ((packedCount >> ((digit & 1u) * 16u)) & 0xFFFFu) - 1u;
+
+			keysOut[histogram[digit * uint(numBlocks) + block] + rank] = key;
+		}
+	}
+}
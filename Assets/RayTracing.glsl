@@ -0,0 +1,2651 @@
+/*
+Title: Advanced Ray Tracer
+File Name: RayTracing.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Everything that is needed to trace a ray through the scene, and to light
+the point that it hits: the triangles, meshes, and lights, every
+acceleration structure, and the lighting functions.
+
+This file is not a shader by itself. It is pasted into FragmentShader.glsl
+and Wavefront.glsl where they include it (see readShader in main.cpp), so
+both of them trace rays the same way.
+Because of that, it has no #version line, and no main function.
+*/
+
+// The triangles, the meshes, and the lights, which are the same structs as in main.cpp
+#include "SceneStructs.h"
+
+// Create some constants
+#define MAX_SCENE_BOUNDS 100.0
+// The most lights the scene can have. The real number is numLights
+#define MAX_LIGHTS 4096
+
+// How many buckets the hashed light grid has. Must be a power of two, and match main.cpp
+#define LIGHT_HASH_SIZE 4096
+
+// How big the scene is. main.cpp sizes the buffers for the scene when it loads it,
+// so nothing here has a fixed size. The locations are fixed, like the camera,
+// so main.cpp sets them the same way in every program (see setPathUniforms).
+// With SCENE_SPECIALIZED, main.cpp puts the size of the scene (and the number of lights and bounces
+// below) in as #defines before the shader is compiled (see sceneShaderDefines), so they are constants,
+// and the compiler knows how many times every loop over them runs. Then these are not uniforms at all
+#ifdef SCENE_SPECIALIZED
+#define numTriangles SCENE_TRIANGLES
+#define numMeshes SCENE_MESHES
+#else
+layout(location = 11) uniform int numTriangles;
+layout(location = 12) uniform int numMeshes;
+#endif
+
+// The ray-triangle tests, and the records that they read
+#include "TriangleKernels.glsl"
+
+// A layout describing the vertex buffer, with numTriangles triangles
+layout(binding = 0) readonly restrict buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+// Compute.glsl also writes every triangle again in a form that is faster to test a ray against:
+// the record from makeTriangleRecord (for Moller-Trumbore, its first point and its two edges).
+// Every vec4 of the records has its own part of the buffer (a "structure of arrays"):
+// first vec4 0 of every triangle, then vec4 1 of every triangle, then vec4 2.
+// So the ray test does not need to work the record out again, and it only reads 48 bytes
+layout(binding = 24) readonly restrict buffer recordBlock
+{
+	vec4 triangleRecords[];
+};
+
+// vec4 k of the record of triangle i
+vec4 triangleRecord(int k, int i)
+{
+	return triangleRecords[k * numTriangles + i];
+}
+
+// Which form of the triangles the ray tests read, picked by main.cpp.
+// The location is fixed, like the camera, so main.cpp sets it the same way in every program
+#define TRIANGLE_FORMAT_VERTICES 0
+#define TRIANGLE_FORMAT_RECORDS 1
+layout(location = 10) uniform int triangleFormat;
+
+// The lights, followed by a hashed grid of the lights, which main.cpp builds every frame.
+// Space is split into cubes of lightCellSize, and every cube is hashed into one of
+// LIGHT_HASH_SIZE buckets. Every bucket has a list of the lights that touch any cube
+// in that bucket (x is where the list starts in lightRefs, y is how many lights are in it).
+// The lights in a list are in the same order as in lights[].
+// With LIGHT_UNIFORMS (the number of lights that fit in a uniform block), every pixel reads
+// the lights, one after another, from the start of the same buffer bound as a uniform block,
+// and only the grid from here (see pickLightPlacement in main.cpp)
+#ifdef LIGHT_UNIFORMS
+layout(std140, binding = LIGHT_UNIFORM_BINDING) uniform lightUniformBlock
+{
+	light lights[LIGHT_UNIFORMS];
+};
+#endif
+
+layout (binding = 1) readonly restrict buffer lightBlock
+{
+#ifdef LIGHT_UNIFORMS
+	light storedLights[MAX_LIGHTS];
+#else
+	light lights[MAX_LIGHTS];
+#endif
+	float lightCellSize;
+	int lightGridBuilt;
+	int lightJunk1;
+	int lightJunk2;
+	uvec2 lightBuckets[LIGHT_HASH_SIZE];
+	uint lightRefs[];
+};
+
+// how many lights are in the light buffer, set by main.cpp
+#ifdef SCENE_SPECIALIZED
+#define numLights SCENE_LIGHTS
+#else
+uniform int numLights;
+#endif
+
+// Every node of the BVH is 32 bytes, see BuildBVH.glsl and BVH.h
+// Interior node: left and right are the indices of the two children
+// Leaf node: left is the bitwise-not (~) of the first triangle index, so it
+// is always negative, and right is the number of triangles
+struct BVHNode
+{
+	vec3 min;
+	int left;
+	vec3 max;
+	int right;
+};
+
+// The BVH that BuildBVH.glsl makes every frame, over the triangles in vertexBlock.
+// Node 0 is the root, which holds every triangle in the scene
+layout (binding = 3) readonly restrict buffer bvhBlock
+{
+	BVHNode nodes[];
+};
+
+// The triangles of every mesh one after the other, exactly as main.cpp uploaded them to triangleBuffer.
+// Triangle i here is triangle i in vertexBlock, before its mesh matrix moved it.
+// The two-level BVH reads triangles from here, without the compute shader moving them
+// With COMPACT_MESHES (--compact-meshes) they are compactTriangles, see loadMeshTriangle
+layout (binding = 5) readonly restrict buffer meshBlock
+{
+#ifdef COMPACT_MESHES
+	compactTriangle meshTriangles[];
+#else
+	triangle meshTriangles[];
+#endif
+};
+
+// One instance is one mesh, placed in the world by a matrix.
+// Rays are moved into the space of the mesh with worldToObject,
+// so that the mesh triangles never need to be moved. Many instances
+// can be the same mesh, and one can have a color and reflectivity of
+// its own (packedMaterial), which it uses when boxMin.w is 1.
+// With --motion-blur, an instance that moves while the shutter is open
+// has boxSize.w 1, and its matrix at both ends of the shutter (mesh to
+// world, not the inverse) in shutterOpen and shutterClose.
+// primitive is the shape of the mesh (PRIMITIVE_*), which --analytic
+// tests in closed form instead of walking its BLAS
+struct Instance
+{
+	mat4 worldToObject;
+	int blasRoot;
+	int meshIndex;
+	int firstTriangle;
+	uint packedMaterial;
+
+	// the box around the mesh before it is moved, which the compact triangles are stored in
+	vec4 boxMin;
+	vec4 boxSize;
+
+	// the BLAS roots of the coarser copies of the mesh (x and y), and their first triangles (z and w)
+	ivec4 lodRoots;
+
+	int primitive;
+	int primitiveJunk1;
+	int primitiveJunk2;
+	int primitiveJunk3;
+
+	mat4 shutterOpen;
+	mat4 shutterClose;
+};
+
+// With --motion-blur, every path is at rayTime in the shutter of the frame, from 0 (open) to 1 (closed), which
+// the renderers set from its pixel (see pixelTime in Sampling.glsl), so all of the rays of a path see the
+// meshes at the same time. The location is fixed, like the path uniforms
+layout(location = 20) uniform bool motionBlur;
+float rayTime = 0.0;
+
+// The two-level BVH, which is built on the CPU in main.cpp (see BVH.h).
+// The first nodes are the top level (TLAS), which is a BVH of instances that
+// is rebuilt every frame. Node 0 is the root of the TLAS.
+// After that are the bottom levels (BLAS), one BVH per mesh, which are built
+// once, because the triangles of a mesh never change.
+layout (binding = 6) readonly restrict buffer twoLevelBlock
+{
+	BVHNode levelNodes[];
+};
+
+// The leaves of the TLAS point into this array
+layout (binding = 7) readonly restrict buffer instanceBlock
+{
+	Instance instances[];
+};
+
+// A node with 4 children, see collapseBVH4 in BVH.h. Every child box is stored
+// with one byte per side: box = origin + byte * scale. Byte c of loX is the
+// min x of child c, and so on. This is 64 bytes, the same as two BVHNodes,
+// but it holds 4 boxes instead of 2, so rays read half as much memory per box.
+// child[c] >= 0 is another wide node, -1 is an empty slot, and anything else is
+// a leaf, where ~child[c] is (first triangle << 3) | number of triangles
+struct WideBVHNode
+{
+	vec3 origin;
+	uint loX;
+	vec3 scale;
+	uint loY;
+	uint loZ;
+	uint hiX;
+	uint hiY;
+	uint hiZ;
+	ivec4 child;
+};
+
+// The BLAS of every mesh, in the wide format
+layout (binding = 12) readonly restrict buffer wideBlock
+{
+	WideBVHNode wideNodes[];
+};
+
+// When this is true, the blasRoot of every instance is in wideNodes,
+// otherwise it is in levelNodes. The TLAS is always in levelNodes
+uniform bool wideBLAS;
+
+// The box around every mesh, written by Compute.glsl while it moves the triangles.
+// The box is stored as integers (see orderedUintToFloat). first and count
+// say which triangles in vertexBlock belong to the mesh
+struct MeshBox
+{
+	uint boxMin[3];
+	int first;
+	uint boxMax[3];
+	int count;
+};
+
+layout (binding = 13) readonly restrict buffer meshBoxBlock
+{
+	MeshBox meshBoxes[];
+};
+
+// The uniform grid from BuildGrid.glsl. See that file for how it is stored
+#define GRID_RES 8
+#define GRID_CELLS (GRID_RES * GRID_RES * GRID_RES)
+
+layout (binding = 14) readonly restrict buffer gridBlock
+{
+	uint gridSceneMin[3];
+	uint gridJunk1;
+	uint gridSceneMax[3];
+	uint gridJunk2;
+	uint cellStart[GRID_CELLS + 1];
+	uint cellCount[GRID_CELLS];
+	uint gridRefs[];
+};
+
+#ifdef INSTANCE_GRID
+// The hashed grid of the instances that --instance-grid leaves out of the TLAS, from BuildInstanceGrid.glsl.
+// swarmLists has the count of every bucket, where the list of every bucket starts, and then the lists
+layout (binding = INSTANCE_GRID_BINDING) readonly restrict buffer instanceGridBlock
+{
+	instanceGrid swarmGrid;
+	uint swarmLists[];
+};
+
+// The entry on the stack of intersectTwoLevel that walks the instance grid. It is not a node, which is never negative
+#define INSTANCE_GRID_STEP -1
+#endif
+
+// Which acceleration structure the rays use. These must match main.cpp
+// ACCEL_BRUTE_FORCE: test every triangle, with no acceleration structure at all
+// ACCEL_MESH_BOXES:  test the box of every mesh, then the triangles of meshes that were hit
+// ACCEL_GRID:        walk through the cells of the uniform grid from BuildGrid.glsl
+// ACCEL_BVH:         walk the BVH from BuildBVH.glsl
+// ACCEL_TWO_LEVEL:   walk the two-level BVH that main.cpp builds on the CPU
+#define ACCEL_BRUTE_FORCE 0
+#define ACCEL_MESH_BOXES 1
+#define ACCEL_GRID 2
+#define ACCEL_BVH 3
+#define ACCEL_TWO_LEVEL 4
+
+uniform int accel;
+
+// The tree is as deep as log2(number of leaves), so 32 is enough for billions.
+// The two-level BVH has one tree on top of another, so it needs two of those.
+// main.cpp puts in its own size (--bvh-stack, or the one --autotune found for the scene)
+#ifndef BVH_STACK_SIZE
+#define BVH_STACK_SIZE 64
+#endif
+
+// With COUNT_PIXEL_COST (FragmentShader.glsl), every pixel counts how much work its rays were,
+// for the heatmap of --cost-view in main.cpp: how many triangles were tested, how many
+// nodes (boxes, grid cells, or meshes) were visited, and how many shadow rays were traced.
+// These are plain variables, so every pixel has its own, and no atomics are needed
+#ifdef COUNT_PIXEL_COST
+int costTriangleTests = 0;
+int costNodeVisits = 0;
+int costShadowRays = 0;
+
+#define COUNT_COST(counter) counter++
+#else
+#define COUNT_COST(counter)
+#endif
+
+// With COUNT_RAYS (FragmentShader.glsl and TiledRender.glsl), the rays are counted into rayCount
+// (see rayCounts in SceneStructs.h) while countRays is true, for --bench and --ray-stats in main.cpp.
+// Wavefront.glsl has no room for another buffer, and does not count.
+// With COUNT_NODE_VISITS too, every node of the two-level BVH that a ray visits is counted in nodeVisits,
+// by its index in levelNodes, for --bvh-hot-layout in main.cpp
+#ifdef COUNT_RAYS
+uniform bool countRays;
+
+layout(binding = 22) buffer rayCountBlock
+{
+	rayCounts rayCount;
+#ifdef COUNT_NODE_VISITS
+	uint nodeVisits[];
+#endif
+};
+
+#define COUNT_RAY(counter) if (countRays) atomicAdd(rayCount.counter, 1u)
+#else
+#define COUNT_RAY(counter)
+#endif
+
+#if defined(COUNT_RAYS) && defined(COUNT_NODE_VISITS)
+#define COUNT_NODE_VISIT(n) if (countRays) atomicAdd(nodeVisits[n], 1u)
+#else
+#define COUNT_NODE_VISIT(n)
+#endif
+
+// Normal and color of the triangle that was hit are saved here,
+// because with the two-level BVH, the triangle that was hit is not
+// in the triangles array, it is in one of the meshes
+struct hitinfo
+{
+	vec3 point;
+	int index;
+	vec3 normal;
+	vec3 color;
+	float reflectivity;
+};
+
+// The same as intersectTriangleRecord, for a triangle that is given by its three points.
+// The record is made here, so this is slower than a record that Compute.glsl made
+float rayIntersectsTriangle(vec3 p, vec3 d, float tmax, vec3 v0, vec3 v1, vec3 v2)
+{
+	vec4 r0, r1, r2;
+	makeTriangleRecord(v0, v1, v2, vec3(0.0), r0, r1, r2);
+
+	return intersectTriangleRecord(p, d, tmax, r0, r1, r2);
+}
+
+// Test a ray against triangle i of vertexBlock, in the form picked by triangleFormat.
+// Triangles that face away from the ray are skipped, and return -1.0 like a miss.
+// Triangles that are not closer than tmax are a miss too.
+// If the dot product is 0, the vectors are 90 degrees apart (orthogonal or perpendicular).
+// If the dot product is less than 0, the vectors are more than 90 degrees apart.
+// If the dot product is greater than 0, the vectors are less than 90 degrees apart.
+float testTriangle(vec3 origin, vec3 dir, float tmax, int i)
+{
+	COUNT_COST(costTriangleTests);
+
+	if (triangleFormat == TRIANGLE_FORMAT_RECORDS)
+	{
+		vec4 r0 = triangleRecord(0, i);
+		vec4 r1 = triangleRecord(1, i);
+		vec4 r2 = triangleRecord(2, i);
+
+#ifdef TRIANGLE_RECORD_HAS_NORMAL
+		vec3 normal = vec3(r0.w, r1.w, r2.w);
+#else
+		vec3 normal = triangleNormal(triangles[i]);
+#endif
+
+		if (dot(normal, dir) > 0)
+			return -1.0;
+
+		return intersectTriangleRecord(origin, dir, tmax, r0, r1, r2);
+	}
+
+	if (dot(triangleNormal(triangles[i]), dir) > 0)
+		return -1.0;
+
+	return rayIntersectsTriangle(origin, dir, tmax, triangles[i].a, triangles[i].b, triangles[i].c);
+}
+
+// Determines whether or not a ray hits a box, and if it does, how far along the ray it hits.
+// invDir is 1.0 / ray direction, which is computed once per ray instead of once per box.
+// Returns -1.0 if the ray misses the box, or hits the box farther away than tmax.
+// This is called a "slab test", because the box is treated as three pairs of parallel planes (slabs).
+float rayIntersectsBox(vec3 origin, vec3 invDir, vec3 boxMin, vec3 boxMax, float tmax)
+{
+	// How far along the ray it crosses each plane of the box
+	vec3 t0 = (boxMin - origin) * invDir;
+	vec3 t1 = (boxMax - origin) * invDir;
+
+	// For each axis, which plane does the ray enter through, and which plane does it exit through
+	vec3 tNear = min(t0, t1);
+	vec3 tFar = max(t0, t1);
+
+	// The ray is only inside the box after it has entered all three slabs,
+	// and before it has exited any of them
+	float enter = max(max(tNear.x, tNear.y), tNear.z);
+	float exit = min(min(tFar.x, tFar.y), tFar.z);
+
+	// If it exits before it enters, it missed the box. If it exits behind the origin, the box is behind the ray.
+	if (enter > exit || exit < 0.0 || enter > tmax)
+	{
+		return -1.0;
+	}
+
+	return max(enter, 0.0);
+}
+
+// The walks only read what the ray test needs: the triangle records (or the points in triangles[]),
+// and the normal that culls the back faces. The point of the closest hit, and the normal, color and
+// reflectivity that shade it, are filled in here, once, after the walk, instead of every time the walk
+// finds a closer triangle. Shadow rays (anyHit) never call this, they only need to know that they hit
+void finishHit(vec3 origin, vec3 dir, float t, inout hitinfo info)
+{
+	info.point = origin + (dir * t);
+	info.normal = triangleNormal(triangles[info.index]);
+	info.color = triangleColor(triangles[info.index]);
+	info.reflectivity = triangleReflectivity(triangles[info.index]);
+}
+
+// This tests a ray against every triangle in the scene, one after the other.
+// It is the slowest way to do it, but it is the simplest, and nothing needs to be built
+bool intersectBruteForce(vec3 origin, vec3 dir, float tmax, bool anyHit, out hitinfo info)
+{
+	float smallest = tmax;
+	bool found = false;
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		float t = testTriangle(origin, dir, smallest, i);
+
+		if (t != -1.0 && t < smallest)
+		{
+			smallest = t;
+
+			info.index = i;
+
+			found = true;
+
+			if (anyHit)
+				return true;
+		}
+	}
+
+	if (found)
+		finishHit(origin, dir, smallest, info);
+
+	return found;
+}
+
+// Given an origin point, a direction, and a variable to pass information back out to, this will test a ray against the triangles in the scene.
+// It will then return true or false, based on whether or not the ray collided with anything.
+// If it did, then the hitinfo object will be filled with a point of collision and an index referring to which triangle it intersects with first.
+// Instead of testing every triangle, we walk through the BVH, and only test the triangles that are inside of boxes that the ray hits.
+// Nothing farther than tmax is tested. If anyHit is true, we return as soon as we find any triangle,
+// instead of looking for the closest one, and info is not finished (see occluded)
+bool intersectSceneBVH(vec3 origin, vec3 dir, float tmax, bool anyHit, out hitinfo info)
+{
+	// Start our variables for determining the closest triangle.
+	// Smallest will be the smallest distance between the origin point and the point of collision.
+	// Found just determines whether or not there was a collision at all.
+	float smallest = tmax;
+	bool found = false;
+
+	// Compute this once, so that every box test can multiply instead of divide.
+	// A tiny value replaces zero, to avoid dividing by zero
+	vec3 safeDir = mix(dir, vec3(0.0000001), equal(dir, vec3(0.0)));
+	vec3 invDir = 1.0 / safeDir;
+
+	// Instead of recursion (which GLSL does not have), we keep a stack
+	// of nodes that we still need to visit, and how far away each of their boxes is
+	int stack[BVH_STACK_SIZE];
+	float stackDist[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	// start at the root, if the ray misses the root, it misses everything
+	float tRoot = rayIntersectsBox(origin, invDir, nodes[0].min, nodes[0].max, smallest);
+
+	if (tRoot >= 0.0)
+	{
+		stack[stackSize] = 0;
+		stackDist[stackSize] = tRoot;
+		stackSize++;
+	}
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+		int n = stack[stackSize];
+
+		// If we found a triangle closer than this box after the box was pushed,
+		// skip the whole box (and everything inside of it)
+		if (stackDist[stackSize] > smallest)
+			continue;
+
+		COUNT_COST(costNodeVisits);
+
+		// If this is a leaf, test the triangles in the leaf
+		if (nodes[n].left < 0)
+		{
+			int first = ~nodes[n].left;
+
+			// empty leaves have a count of zero, so this loop does nothing
+			for (int i = first; i < first + nodes[n].right; i++)
+			{
+				// Compute distance t using above function to determine how far along the ray the triangle collides.
+				// If our direction can't hit the triangle, this is -1.0 too
+				float t = testTriangle(origin, dir, smallest, i);
+
+				// If t = -1.0 then there was no intersection, we also ignore it if t is not < smallest, as that would mean we already found a triangle that 
+				// was closer (and thus collides first).
+				if (t != -1.0 && t < smallest)
+				{
+					// This t becomes the new smallest.
+					smallest = t;
+
+					// Pass out the triangle index. The point and what we need to shade it are filled in
+					// at the end, once we know that this is the closest triangle (see finishHit)
+					info.index = i;
+
+					// Make sure we set found to true, signifying that the ray collided with something.
+					found = true;
+
+					// any triangle is enough, we don't need the closest one
+					if (anyHit)
+						return true;
+				}
+			}
+
+			continue;
+		}
+
+		// This is an interior node, so we test the boxes of both children,
+		// and visit the closer child first. Finding a close triangle early
+		// lets us skip more boxes later.
+		int left = nodes[n].left;
+		int right = nodes[n].right;
+
+		float tLeft = rayIntersectsBox(origin, invDir, nodes[left].min, nodes[left].max, smallest);
+		float tRight = rayIntersectsBox(origin, invDir, nodes[right].min, nodes[right].max, smallest);
+
+		// The stack is last-in-first-out, so the child that is pushed last is visited first.
+		// Swap them so that the closer child is always the "left" one
+		if (tRight >= 0.0 && (tLeft < 0.0 || tRight < tLeft))
+		{
+			int tempNode = left;
+			left = right;
+			right = tempNode;
+
+			float tempDist = tLeft;
+			tLeft = tRight;
+			tRight = tempDist;
+		}
+
+		if (tRight >= 0.0)
+		{
+			stack[stackSize] = right;
+			stackDist[stackSize] = tRight;
+			stackSize++;
+		}
+
+		if (tLeft >= 0.0)
+		{
+			stack[stackSize] = left;
+			stackDist[stackSize] = tLeft;
+			stackSize++;
+		}
+	}
+
+	if (found)
+		finishHit(origin, dir, smallest, info);
+
+	return found;
+}
+
+// Turn an integer from floatToOrderedUint (in Compute.glsl) back into a float
+float orderedUintToFloat(uint u)
+{
+	return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+}
+
+// This does the same thing as intersectSceneBVH, but without a BVH. Every mesh has one box,
+// so a ray that misses the box of a mesh skips every triangle of that mesh.
+// This costs almost nothing to build, so it is useful when building a BVH every frame is not worth it
+bool intersectMeshBoxes(vec3 origin, vec3 dir, float tmax, bool anyHit, out hitinfo info)
+{
+	float smallest = tmax;
+	bool found = false;
+
+	vec3 invDir = 1.0 / mix(dir, vec3(0.0000001), equal(dir, vec3(0.0)));
+
+	for (int m = 0; m < numMeshes; m++)
+	{
+		vec3 boxMin = vec3(
+			orderedUintToFloat(meshBoxes[m].boxMin[0]),
+			orderedUintToFloat(meshBoxes[m].boxMin[1]),
+			orderedUintToFloat(meshBoxes[m].boxMin[2]));
+
+		vec3 boxMax = vec3(
+			orderedUintToFloat(meshBoxes[m].boxMax[0]),
+			orderedUintToFloat(meshBoxes[m].boxMax[1]),
+			orderedUintToFloat(meshBoxes[m].boxMax[2]));
+
+		COUNT_COST(costNodeVisits);
+
+		// skip the whole mesh if the ray misses its box,
+		// or if we already hit something closer than the box
+		if (rayIntersectsBox(origin, invDir, boxMin, boxMax, smallest) < 0.0)
+			continue;
+
+		int first = meshBoxes[m].first;
+
+		for (int i = first; i < first + meshBoxes[m].count; i++)
+		{
+			float t = testTriangle(origin, dir, smallest, i);
+
+			if (t != -1.0 && t < smallest)
+			{
+				smallest = t;
+
+				info.index = i;
+
+				found = true;
+
+				if (anyHit)
+					return true;
+			}
+		}
+	}
+
+	if (found)
+		finishHit(origin, dir, smallest, info);
+
+	return found;
+}
+
+// This does the same thing as intersectSceneBVH, but with the uniform grid.
+// We find the cell where the ray enters the grid, and then step from cell to cell,
+// always into the next cell that the ray passes through (a "3D DDA").
+// A triangle can be in more than one cell, and a triangle in this cell might be hit
+// behind this cell. So we can only stop once the closest hit is before the exit of the cell
+bool intersectGrid(vec3 origin, vec3 dir, float tmax, bool anyHit, out hitinfo info)
+{
+	float smallest = tmax;
+	bool found = false;
+
+	vec3 invDir = 1.0 / mix(dir, vec3(0.0000001), equal(dir, vec3(0.0)));
+
+	vec3 lo = vec3(orderedUintToFloat(gridSceneMin[0]), orderedUintToFloat(gridSceneMin[1]), orderedUintToFloat(gridSceneMin[2]));
+	vec3 hi = vec3(orderedUintToFloat(gridSceneMax[0]), orderedUintToFloat(gridSceneMax[1]), orderedUintToFloat(gridSceneMax[2]));
+	vec3 cellSize = max(hi - lo, vec3(0.00001)) / float(GRID_RES);
+
+	float tEnter = rayIntersectsBox(origin, invDir, lo, hi, smallest);
+
+	if (tEnter < 0.0)
+		return false;
+
+	// the cell where the ray enters the grid
+	vec3 p = origin + dir * tEnter;
+	ivec3 cell = clamp(ivec3(floor((p - lo) / cellSize)), ivec3(0), ivec3(GRID_RES - 1));
+
+	// Which way the ray steps on each axis, how far along the ray the next
+	// cell border is on each axis, and how far it is from one border to the next
+	ivec3 cellStep = ivec3(sign(dir));
+	vec3 nextBorder = lo + (vec3(cell) + vec3(greaterThan(cellStep, ivec3(0)))) * cellSize;
+	vec3 tNext = mix((nextBorder - origin) * invDir, vec3(1e30), equal(cellStep, ivec3(0)));
+	vec3 tDelta = cellSize * abs(invDir);
+
+	// A ray can never pass through more cells than this
+	for (int steps = 0; steps < 3 * GRID_RES; steps++)
+	{
+		int c = cell.x + GRID_RES * (cell.y + GRID_RES * cell.z);
+
+		COUNT_COST(costNodeVisits);
+
+		for (uint r = cellStart[c]; r < cellStart[c + 1]; r++)
+		{
+			int i = int(gridRefs[r]);
+
+			float t = testTriangle(origin, dir, smallest, i);
+
+			if (t != -1.0 && t < smallest)
+			{
+				smallest = t;
+
+				info.index = i;
+
+				found = true;
+
+				if (anyHit)
+					return true;
+			}
+		}
+
+		// If the closest hit is inside of this cell,
+		// nothing in the cells after it can be closer
+		float tExit = min(tNext.x, min(tNext.y, tNext.z));
+
+		if (smallest <= tExit)
+			break;
+
+		// step into the next cell, on the axis with the closest border
+		if (tNext.x <= tNext.y && tNext.x <= tNext.z)
+		{
+			cell.x += cellStep.x;
+			tNext.x += tDelta.x;
+		}
+		else if (tNext.y <= tNext.z)
+		{
+			cell.y += cellStep.y;
+			tNext.y += tDelta.y;
+		}
+		else
+		{
+			cell.z += cellStep.z;
+			tNext.z += tDelta.z;
+		}
+
+		// we left the grid
+		if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(GRID_RES))))
+			break;
+	}
+
+	if (found)
+		finishHit(origin, dir, smallest, info);
+
+	return found;
+}
+
+// Triangle i of the meshes, in the space of its mesh. A compact triangle is unpacked here,
+// as soon as it is read, so the ray test is the same for both
+triangle loadMeshTriangle(int instance, int i)
+{
+#ifdef COMPACT_MESHES
+	return unpackCompactTriangle(meshTriangles[i], instances[instance].boxMin.xyz, instances[instance].boxSize.xyz);
+#else
+	return meshTriangles[i];
+#endif
+}
+
+// Which copy of the meshes the ray that is being traced walks in the two-level BVH (--lod-geometry):
+// 0 is the mesh, and 1 and 2 are its coarser copies (see MeshLod.h in main.cpp).
+// Whoever traces a ray sets it from the bounce of the ray, with geometryLod, and puts it back to 0
+int rayLod = 0;
+
+// The root of the BLAS of an instance, and the first triangle that its leaves count from, in the copy of rayLod
+int instanceBlasRoot(int instance)
+{
+	return rayLod == 0 ? instances[instance].blasRoot : instances[instance].lodRoots[rayLod - 1];
+}
+
+// The matrix that moves a ray into the space of the mesh of an instance, at rayTime. The matrices in between the
+// ones at the ends of the shutter move every point of the mesh along the line from where it was to where it went,
+// so the mesh never leaves its box in the TLAS, which holds both ends (see buildTLAS in main.cpp)
+mat4 instanceWorldToObject(int instance)
+{
+	if (!motionBlur || instances[instance].boxSize.w == 0.0)
+		return instances[instance].worldToObject;
+
+	mat4 open = instances[instance].shutterOpen;
+	return inverse(open + (instances[instance].shutterClose - open) * rayTime);
+}
+
+int instanceFirstTriangle(int instance)
+{
+	return rayLod == 0 ? instances[instance].firstTriangle : instances[instance].lodRoots[rayLod + 1];
+}
+
+// Test the ray against triangles first through first + count - 1 of the mesh of an instance.
+// rayOrigin and rayDir are in the space of the mesh. The closest hit keeps its instance in hitInstance,
+// and is finished by finishMeshHit when the walk is done
+void intersectMeshLeaf(int instance, int first, int count, vec3 rayOrigin, vec3 rayDir, inout float smallest, inout hitinfo info, inout int hitInstance, inout bool found)
+{
+	// The BLAS leaves count from the first triangle of the mesh
+	int base = instanceFirstTriangle(instance);
+
+	for (int i = base + first; i < base + first + count; i++)
+	{
+		triangle tri = loadMeshTriangle(instance, i);
+
+		COUNT_COST(costTriangleTests);
+
+		// The sign of this dot product is the same in mesh space and world space
+		if (dot(triangleNormal(tri), rayDir) > 0)
+			continue;
+
+		float t = rayIntersectsTriangle(rayOrigin, rayDir, smallest, tri.a, tri.b, tri.c);
+
+		if (t != -1.0 && t < smallest)
+		{
+			smallest = t;
+
+			info.index = i;
+			hitInstance = instance;
+
+			found = true;
+		}
+	}
+}
+
+#ifdef ANALYTIC_PRIMITIVES
+// The shapes of the meshes that main.cpp knows are a plane, a box, or a sphere (must match main.cpp).
+// The shape fills the box of its mesh: the plane is the bottom of a flat box, facing up (like the floor),
+// and the sphere touches the sides of a box that is a cube. The triangles of those meshes are still there,
+// for the other structures, and they give the hit its color
+#define PRIMITIVE_NONE 0
+#define PRIMITIVE_PLANE 1
+#define PRIMITIVE_BOX 2
+#define PRIMITIVE_SPHERE 3
+
+// the closest hit a ray can have on a shape, so that a ray that leaves it does not hit it again
+#define PRIMITIVE_EPSILON 0.0001
+
+// How far along the ray (in the space of the mesh of the instance) it hits the shape of the instance,
+// or -1.0 if it misses it, or the hit is not closer than tmax. Like the triangles, only the outside is hit:
+// a ray that starts inside the box or the sphere, or that comes to the plane from below, misses it
+float intersectPrimitive(int instance, vec3 rayOrigin, vec3 rayDir, float tmax)
+{
+	vec3 boxMin = instances[instance].boxMin.xyz;
+	vec3 boxSize = instances[instance].boxSize.xyz;
+	int primitive = instances[instance].primitive;
+	float t;
+
+	COUNT_COST(costTriangleTests);
+
+	if (primitive == PRIMITIVE_PLANE)
+	{
+		if (rayDir.y >= 0.0)
+			return -1.0;
+
+		t = (boxMin.y - rayOrigin.y) / rayDir.y;
+		vec2 p = rayOrigin.xz + rayDir.xz * t;
+
+		if (any(lessThan(p, boxMin.xz)) || any(greaterThan(p, boxMin.xz + boxSize.xz)))
+			return -1.0;
+	}
+	else if (primitive == PRIMITIVE_BOX)
+	{
+		// the slab test of rayIntersectsBox, but the ray has to enter the box in front of it
+		vec3 invDir = 1.0 / mix(rayDir, vec3(0.0000001), equal(rayDir, vec3(0.0)));
+		vec3 t0 = (boxMin - rayOrigin) * invDir;
+		vec3 t1 = (boxMin + boxSize - rayOrigin) * invDir;
+		vec3 tNear = min(t0, t1);
+		vec3 tFar = max(t0, t1);
+
+		t = max(tNear.x, max(tNear.y, tNear.z));
+
+		if (t > min(tFar.x, min(tFar.y, tFar.z)))
+			return -1.0;
+	}
+	else
+	{
+		// the direction is not normalized in the space of the mesh, so the quadratic keeps its a
+		vec3 oc = rayOrigin - (boxMin + boxSize * 0.5);
+		float radius = boxSize.x * 0.5;
+		float a = dot(rayDir, rayDir);
+		float b = dot(oc, rayDir);
+		float c = dot(oc, oc) - radius * radius;
+		float discriminant = b * b - a * c;
+
+		if (discriminant < 0.0)
+			return -1.0;
+
+		t = (-b - sqrt(discriminant)) / a;
+	}
+
+	return (t > PRIMITIVE_EPSILON && t < tmax) ? t : -1.0;
+}
+
+// intersectMeshLeaf for an instance that is a shape. The ray is in world space, and the hit is the first
+// triangle of the mesh, which has the color of the shape (finishMeshHit makes its normal)
+void intersectPrimitiveInstance(int instance, vec3 origin, vec3 dir, inout float smallest, inout hitinfo info, inout int hitInstance, inout bool found)
+{
+	mat4 worldToObject = instanceWorldToObject(instance);
+	float t = intersectPrimitive(instance, (worldToObject * vec4(origin, 1.0)).xyz, mat3(worldToObject) * dir, smallest);
+
+	if (t == -1.0)
+		return;
+
+	smallest = t;
+
+	info.index = instanceFirstTriangle(instance);
+	hitInstance = instance;
+
+	found = true;
+}
+
+// The normal of the shape of an instance at point p on it, in the space of the mesh
+vec3 primitiveNormal(int instance, vec3 p)
+{
+	vec3 boxMin = instances[instance].boxMin.xyz;
+	vec3 boxSize = instances[instance].boxSize.xyz;
+	vec3 center = boxMin + boxSize * 0.5;
+
+	if (instances[instance].primitive == PRIMITIVE_PLANE)
+		return vec3(0.0, 1.0, 0.0);
+
+	if (instances[instance].primitive == PRIMITIVE_SPHERE)
+		return p - center;
+
+	// the side of the box that p is closest to, which is the axis where it is farthest out
+	vec3 q = (p - center) / max(boxSize * 0.5, vec3(0.000001));
+	vec3 a = abs(q);
+
+	if (a.x >= a.y && a.x >= a.z)
+		return vec3(sign(q.x), 0.0, 0.0);
+
+	if (a.y >= a.z)
+		return vec3(0.0, sign(q.y), 0.0);
+
+	return vec3(0.0, 0.0, sign(q.z));
+}
+#endif
+
+// finishHit for the two-level BVH. The triangle is read again, from the mesh of the instance that was hit.
+// The normal has to be moved back to world space. Normals are moved with
+// the inverse-transpose of the mesh matrix, which is the transpose of worldToObject
+void finishMeshHit(vec3 origin, vec3 dir, float t, int instance, inout hitinfo info)
+{
+	triangle tri = loadMeshTriangle(instance, info.index);
+
+	info.point = origin + (dir * t);
+	info.normal = normalize(transpose(mat3(instanceWorldToObject(instance))) * triangleNormal(tri));
+	info.color = triangleColor(tri);
+	info.reflectivity = triangleReflectivity(tri);
+
+#ifdef ANALYTIC_PRIMITIVES
+	// the normal of a shape comes from where it was hit, not from its triangle
+	if (instances[instance].primitive != PRIMITIVE_NONE)
+	{
+		mat4 worldToObject = instanceWorldToObject(instance);
+		vec3 p = (worldToObject * vec4(info.point, 1.0)).xyz;
+		info.normal = normalize(transpose(mat3(worldToObject)) * primitiveNormal(instance, p));
+	}
+#endif
+
+	if (instances[instance].boxMin.w != 0.0)
+	{
+		vec4 material = unpackUnorm4x8(instances[instance].packedMaterial);
+		info.color = material.rgb;
+		info.reflectivity = material.a;
+	}
+}
+
+// Byte c of a packed uint, as a float
+float unpackByte(uint value, int c)
+{
+	return float((value >> uint(8 * c)) & 0xFFu);
+}
+
+// This does the same thing as intersectSceneBVH, but with the two-level BVH.
+// We walk the TLAS in world space. When we reach an instance, we move the ray into
+// the space of that mesh, and keep walking in the BLAS of that mesh. When we have
+// finished the BLAS, we move the ray back to world space, and continue with the TLAS.
+// Both trees share one stack: stack entries above blasStackBase belong to the BLAS.
+// With --instance-grid, the instances of the grid are walked with the TLAS: the grid is one entry on the stack,
+// INSTANCE_GRID_STEP, with the distance where the ray comes into the cell that it is in. Every time that it is popped,
+// it hands out the next instance in the list of the cell (its BLAS goes on the stack above it, like the BLAS of a TLAS
+// leaf), or steps to the next cell along the ray (3D-DDA). It is only pushed again while the cell is closer than the
+// closest hit, so the grid is done once the ray has passed the hit
+bool intersectTwoLevel(vec3 origin, vec3 dir, float tmax, bool anyHit, out hitinfo info)
+{
+	float smallest = tmax;
+	bool found = false;
+
+	// The ray that we are currently walking with, which is either
+	// the world-space ray, or the ray in the space of one mesh
+	vec3 rayOrigin = origin;
+	vec3 rayDir = dir;
+	vec3 invDir = 1.0 / mix(dir, vec3(0.0000001), equal(dir, vec3(0.0)));
+
+	// which instance we are inside of, -1 means we are in the TLAS,
+	// and which instance the closest hit so far is in
+	int instance = -1;
+	int hitInstance = -1;
+	int blasStackBase = 0;
+
+	int stack[BVH_STACK_SIZE];
+	float stackDist[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	float tRoot = rayIntersectsBox(rayOrigin, invDir, levelNodes[0].min, levelNodes[0].max, smallest);
+
+	if (tRoot >= 0.0)
+	{
+		stack[stackSize] = 0;
+		stackDist[stackSize] = tRoot;
+		stackSize++;
+	}
+
+#ifdef INSTANCE_GRID
+	// the box and cells of the grid, the cell that the ray is in, and where it leaves the grid
+	vec3 gridMin = vec3(orderedUintToFloat(swarmGrid.boxMin[0]), orderedUintToFloat(swarmGrid.boxMin[1]), orderedUintToFloat(swarmGrid.boxMin[2]));
+	vec3 gridMax = vec3(orderedUintToFloat(swarmGrid.boxMax[0]), orderedUintToFloat(swarmGrid.boxMax[1]), orderedUintToFloat(swarmGrid.boxMax[2]));
+	float cellSize = instanceGridCellSize(gridMin, gridMax, uintBitsToFloat(swarmGrid.maxExtent));
+	ivec3 gridCells = instanceGridCells(gridMin, gridMax, cellSize);
+	ivec3 cell = ivec3(0);
+	float tGridExit = 0.0;
+
+	// The step to the next cell on every axis, the distance along the ray to the next cell on every axis, and how far
+	// apart those are. A ray that does not move on an axis has an invDir so big that it never gets there
+	ivec3 cellStep = ivec3(greaterThanEqual(dir, vec3(0.0))) * 2 - 1;
+	vec3 tNext = vec3(0.0);
+	vec3 tDelta = abs(cellSize * invDir);
+
+	// the list of the cell (from swarmLists), the next instance in it, and the last instance that was walked,
+	// because an instance in two cells along the ray is often in both lists one after the other
+	int gridRef = 0;
+	int gridRefEnd = 0;
+	bool cellLoaded = false;
+	int lastGridInstance = -1;
+
+	if (swarmGrid.count > 0)
+	{
+		vec3 t0 = (gridMin - origin) * invDir;
+		vec3 t1 = (gridMax - origin) * invDir;
+		vec3 tNear = min(t0, t1);
+		vec3 tFar = max(t0, t1);
+		float tEnter = max(max(tNear.x, max(tNear.y, tNear.z)), 0.0);
+		tGridExit = min(tFar.x, min(tFar.y, tFar.z));
+
+		if (tEnter <= tGridExit && tEnter <= smallest)
+		{
+			cell = clamp(ivec3(floor((origin + dir * tEnter - gridMin) / cellSize)), ivec3(0), gridCells - 1);
+			tNext = (gridMin + vec3(cell + max(cellStep, ivec3(0))) * cellSize - origin) * invDir;
+
+			stack[stackSize] = INSTANCE_GRID_STEP;
+			stackDist[stackSize] = tEnter;
+			stackSize++;
+		}
+	}
+#endif
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+
+		// If we just left the last BLAS node of an instance,
+		// go back to the world-space ray
+		if (instance >= 0 && stackSize < blasStackBase)
+		{
+			instance = -1;
+			rayOrigin = origin;
+			rayDir = dir;
+			invDir = 1.0 / mix(dir, vec3(0.0000001), equal(dir, vec3(0.0)));
+		}
+
+		int n = stack[stackSize];
+
+		// The ray direction in mesh space is not normalized, which means that
+		// t is the same distance in both spaces, so we can compare it against
+		// smallest no matter which tree we are in
+		if (stackDist[stackSize] > smallest)
+			continue;
+
+		COUNT_COST(costNodeVisits);
+
+#ifdef INSTANCE_GRID
+		if (n == INSTANCE_GRID_STEP)
+		{
+			float tCell = stackDist[stackSize];
+
+			// the list of this cell is done, so go on to the next cell, unless the ray leaves the grid there
+			if (gridRef == gridRefEnd)
+			{
+				if (cellLoaded)
+				{
+					tCell = min(tNext.x, min(tNext.y, tNext.z));
+
+					if (tNext.x == tCell)
+					{
+						cell.x += cellStep.x;
+						tNext.x += tDelta.x;
+					}
+					else if (tNext.y == tCell)
+					{
+						cell.y += cellStep.y;
+						tNext.y += tDelta.y;
+					}
+					else
+					{
+						cell.z += cellStep.z;
+						tNext.z += tDelta.z;
+					}
+
+					if (tCell > tGridExit || tCell > smallest || any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, gridCells)))
+						continue;
+				}
+
+				uint b = instanceGridBucket(cell, swarmGrid.buckets);
+				gridRef = int(swarmLists[swarmGrid.buckets + int(b)]);
+				gridRefEnd = int(swarmLists[swarmGrid.buckets + int(b) + 1]);
+				cellLoaded = true;
+
+				stack[stackSize] = INSTANCE_GRID_STEP;
+				stackDist[stackSize] = tCell;
+				stackSize++;
+				continue;
+			}
+
+			int gridInstance = int(swarmLists[2 * swarmGrid.buckets + 1 + gridRef]);
+			gridRef++;
+
+			stack[stackSize] = INSTANCE_GRID_STEP;
+			stackDist[stackSize] = tCell;
+			stackSize++;
+
+			if (gridInstance == lastGridInstance)
+				continue;
+
+			lastGridInstance = gridInstance;
+
+#ifdef ANALYTIC_PRIMITIVES
+			if (instances[gridInstance].primitive != PRIMITIVE_NONE)
+			{
+				intersectPrimitiveInstance(gridInstance, origin, dir, smallest, info, hitInstance, found);
+
+				if (anyHit && found)
+					return true;
+
+				continue;
+			}
+#endif
+
+			// the same as a TLAS leaf, below
+			instance = gridInstance;
+			mat4 worldToObject = instanceWorldToObject(instance);
+
+			rayOrigin = (worldToObject * vec4(origin, 1.0)).xyz;
+			rayDir = mat3(worldToObject) * dir;
+			invDir = 1.0 / mix(rayDir, vec3(0.0000001), equal(rayDir, vec3(0.0)));
+
+			blasStackBase = stackSize;
+			stack[stackSize] = instanceBlasRoot(instance);
+			stackDist[stackSize] = tCell;
+			stackSize++;
+			continue;
+		}
+#endif
+
+		// A wide BLAS node: test all 4 child boxes. Leaves are tested right away,
+		// and the other children are pushed so that the closest one is on top
+		if (instance >= 0 && wideBLAS)
+		{
+			vec3 nodeOrigin = wideNodes[n].origin;
+			vec3 nodeScale = wideNodes[n].scale;
+
+			int pushNode[4];
+			float pushDist[4];
+			int numPush = 0;
+
+			for (int c = 0; c < 4; c++)
+			{
+				int child = wideNodes[n].child[c];
+
+				if (child == -1)
+					continue;
+
+				vec3 boxMin = nodeOrigin + vec3(unpackByte(wideNodes[n].loX, c), unpackByte(wideNodes[n].loY, c), unpackByte(wideNodes[n].loZ, c)) * nodeScale;
+				vec3 boxMax = nodeOrigin + vec3(unpackByte(wideNodes[n].hiX, c), unpackByte(wideNodes[n].hiY, c), unpackByte(wideNodes[n].hiZ, c)) * nodeScale;
+
+				float t = rayIntersectsBox(rayOrigin, invDir, boxMin, boxMax, smallest);
+
+				if (t < 0.0)
+					continue;
+
+				if (child < 0)
+				{
+					int leaf = ~child;
+					intersectMeshLeaf(instance, leaf >> 3, leaf & 7, rayOrigin, rayDir, smallest, info, hitInstance, found);
+
+					if (anyHit && found)
+						return true;
+
+					continue;
+				}
+
+				// keep the list sorted from far to near
+				int k = numPush;
+				while (k > 0 && pushDist[k - 1] < t)
+				{
+					pushNode[k] = pushNode[k - 1];
+					pushDist[k] = pushDist[k - 1];
+					k--;
+				}
+
+				pushNode[k] = child;
+				pushDist[k] = t;
+				numPush++;
+			}
+
+			for (int k = 0; k < numPush; k++)
+			{
+				stack[stackSize] = pushNode[k];
+				stackDist[stackSize] = pushDist[k];
+				stackSize++;
+			}
+
+			continue;
+		}
+
+		COUNT_NODE_VISIT(n);
+
+		if (levelNodes[n].left < 0)
+		{
+			int first = ~levelNodes[n].left;
+
+			// A TLAS leaf holds one instance. Move the ray into the space of the mesh,
+			// and start walking the BLAS of that mesh
+			if (instance < 0)
+			{
+				if (levelNodes[n].right == 0)
+					continue;
+
+#ifdef ANALYTIC_PRIMITIVES
+				// a shape has no BLAS to walk, it is tested right here
+				if (instances[first].primitive != PRIMITIVE_NONE)
+				{
+					intersectPrimitiveInstance(first, origin, dir, smallest, info, hitInstance, found);
+
+					if (anyHit && found)
+						return true;
+
+					continue;
+				}
+#endif
+
+				instance = first;
+				mat4 worldToObject = instanceWorldToObject(instance);
+
+				rayOrigin = (worldToObject * vec4(origin, 1.0)).xyz;
+				rayDir = mat3(worldToObject) * dir;
+				invDir = 1.0 / mix(rayDir, vec3(0.0000001), equal(rayDir, vec3(0.0)));
+
+				// The BLAS root takes the place of the instance on the stack, and keeps its distance
+				blasStackBase = stackSize;
+				stack[stackSize] = instanceBlasRoot(instance);
+				stackSize++;
+				continue;
+			}
+
+			// A BLAS leaf holds triangles of the mesh
+			intersectMeshLeaf(instance, first, levelNodes[n].right, rayOrigin, rayDir, smallest, info, hitInstance, found);
+
+			if (anyHit && found)
+				return true;
+
+			continue;
+		}
+
+		int left = levelNodes[n].left;
+		int right = levelNodes[n].right;
+
+		float tLeft = rayIntersectsBox(rayOrigin, invDir, levelNodes[left].min, levelNodes[left].max, smallest);
+		float tRight = rayIntersectsBox(rayOrigin, invDir, levelNodes[right].min, levelNodes[right].max, smallest);
+
+		if (tRight >= 0.0 && (tLeft < 0.0 || tRight < tLeft))
+		{
+			int tempNode = left;
+			left = right;
+			right = tempNode;
+
+			float tempDist = tLeft;
+			tLeft = tRight;
+			tRight = tempDist;
+		}
+
+		if (tRight >= 0.0)
+		{
+			stack[stackSize] = right;
+			stackDist[stackSize] = tRight;
+			stackSize++;
+		}
+
+		if (tLeft >= 0.0)
+		{
+			stack[stackSize] = left;
+			stackDist[stackSize] = tLeft;
+			stackSize++;
+		}
+	}
+
+	if (found)
+		finishMeshHit(origin, dir, smallest, hitInstance, info);
+
+	return found;
+}
+
+// Every ray goes through here, to whichever acceleration structure main.cpp has chosen
+bool intersectAccel(vec3 origin, vec3 dir, float tmax, bool anyHit, out hitinfo info)
+{
+	if (accel == ACCEL_TWO_LEVEL)
+		return intersectTwoLevel(origin, dir, tmax, anyHit, info);
+
+	if (accel == ACCEL_BVH)
+		return intersectSceneBVH(origin, dir, tmax, anyHit, info);
+
+	if (accel == ACCEL_GRID)
+		return intersectGrid(origin, dir, tmax, anyHit, info);
+
+	if (accel == ACCEL_MESH_BOXES)
+		return intersectMeshBoxes(origin, dir, tmax, anyHit, info);
+
+	return intersectBruteForce(origin, dir, tmax, anyHit, info);
+}
+
+// Every primary and reflection ray comes through here, and finds the closest triangle
+bool intersectTriangles(vec3 origin, vec3 dir, out hitinfo info)
+{
+	return intersectAccel(origin, dir, MAX_SCENE_BOUNDS, false, info);
+}
+
+// Shadow rays come through here. A shadow ray only needs to know if anything is in the way,
+// not what the closest thing is, so this stops at the first triangle it finds.
+// Triangles farther than tmax are ignored, so tmax should be the distance to the light
+bool occluded(vec3 origin, vec3 dir, float tmax)
+{
+	// not used, the traversal returns before it is finished
+	hitinfo unused;
+
+	COUNT_RAY(shadowRays);
+	COUNT_COST(costShadowRays);
+
+	return intersectAccel(origin, dir, tmax, true, unused);
+}
+
+#ifdef LIGHT_OCCLUDERS
+// With --light-occluders, LightOccluders.glsl lists the triangles that touch the sphere of every light every frame.
+// A shadow ray is inside the sphere of its light, so only those can block it. A light with more than
+// OCCLUDER_LIST_SIZE triangles has a list that is not complete, and its rays walk the accel like before
+layout(binding = 10) buffer lightOccluderBlock
+{
+	uint occluderCounts[MAX_LIGHTS];
+	uint occluderLists[];
+};
+
+// True if the list of light j has every triangle that touches its sphere
+bool hasOccluderList(int j)
+{
+	return occluderCounts[j] <= uint(OCCLUDER_LIST_SIZE);
+}
+
+// occluded for a shadow ray of light j, which only tests the triangles of the list of the light
+bool occludedByList(int j, vec3 origin, vec3 dir, float tmax)
+{
+	COUNT_RAY(shadowRays);
+	COUNT_COST(costShadowRays);
+
+	int count = int(occluderCounts[j]);
+
+	for (int k = 0; k < count; k++)
+	{
+		float t = testTriangle(origin, dir, tmax, int(occluderLists[j * OCCLUDER_LIST_SIZE + k]));
+
+		if (t != -1.0 && t < tmax)
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+// occluded for a shadow ray of light j, which tests the list of the light instead when it has one
+bool occludedByLight(int j, vec3 origin, vec3 dir, float tmax)
+{
+#ifdef LIGHT_OCCLUDERS
+	if (hasOccluderList(j))
+		return occludedByList(j, origin, dir, tmax);
+#endif
+
+	return occluded(origin, dir, tmax);
+}
+
+#ifdef REDUCED_SHADOWS
+// With --shadow-scale, the shadow of light j on the point that the eye sees, from the coarse grid of shadow rays
+// around the pixel: 1 if it is blocked, 0 if it is not, and -1 if the grid does not know, and the ray must be traced
+// (see FragmentShader.glsl)
+int reducedShadow(int j);
+#endif
+
+#ifdef SHADOW_BATCH
+// With --shadow-batch, the shadow rays of one point to up to SHADOW_BATCH lights walk the BVH together.
+// Ray k goes from its light to the point, like the ray of occluded, so every ray of a batch ends at the point,
+// and the nodes and triangles near it, which all of them walk through, are read once for the batch instead of
+// once for every light. The rays are bits of a mask: a ray leaves the walk as soon as it is blocked, and a node is
+// only walked by the rays that hit its box. These are globals, because GLSL copies the arrays that it passes
+vec3 batchOrigin[SHADOW_BATCH];
+vec3 batchDir[SHADOW_BATCH];
+vec3 batchInvDir[SHADOW_BATCH];
+float batchTmax[SHADOW_BATCH];
+
+// the rays of the batch moved into the space of the mesh that the two-level walk is in
+vec3 batchMeshOrigin[SHADOW_BATCH];
+vec3 batchMeshDir[SHADOW_BATCH];
+vec3 batchMeshInvDir[SHADOW_BATCH];
+
+// Which of the rays hit a box, in world space or in the space of the mesh
+uint batchBoxRays(uint rays, vec3 boxMin, vec3 boxMax, bool inMesh)
+{
+	uint hit = 0u;
+
+	while (rays != 0u)
+	{
+		int k = findLSB(rays);
+		rays &= rays - 1u;
+
+		float t = inMesh ?
+			rayIntersectsBox(batchMeshOrigin[k], batchMeshInvDir[k], boxMin, boxMax, batchTmax[k]) :
+			rayIntersectsBox(batchOrigin[k], batchInvDir[k], boxMin, boxMax, batchTmax[k]);
+
+		if (t >= 0.0)
+			hit |= 1u << uint(k);
+	}
+
+	return hit;
+}
+
+// intersectSceneBVH for a batch. Returns the rays that are blocked
+uint occludedBatchBVH(uint active)
+{
+	uint blocked = 0u;
+
+	int stack[BVH_STACK_SIZE];
+	uint stackRays[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	uint rays = batchBoxRays(active, nodes[0].min, nodes[0].max, false);
+
+	if (rays != 0u)
+	{
+		stack[stackSize] = 0;
+		stackRays[stackSize] = rays;
+		stackSize++;
+	}
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+		int n = stack[stackSize];
+
+		// the rays that were blocked since the node was pushed do not need it any more
+		rays = stackRays[stackSize] & ~blocked;
+
+		if (rays == 0u)
+			continue;
+
+		COUNT_COST(costNodeVisits);
+
+		if (nodes[n].left < 0)
+		{
+			int first = ~nodes[n].left;
+
+			for (int i = first; i < first + nodes[n].right && rays != 0u; i++)
+			{
+				uint left = rays;
+
+				while (left != 0u)
+				{
+					int k = findLSB(left);
+					left &= left - 1u;
+
+					float t = testTriangle(batchOrigin[k], batchDir[k], batchTmax[k], i);
+
+					if (t != -1.0 && t < batchTmax[k])
+						blocked |= 1u << uint(k);
+				}
+
+				rays &= ~blocked;
+			}
+
+			if (blocked == active)
+				return blocked;
+
+			continue;
+		}
+
+		// any triangle is enough, so the order of the children does not matter
+		int left = nodes[n].left;
+		int right = nodes[n].right;
+
+		uint leftRays = batchBoxRays(rays, nodes[left].min, nodes[left].max, false);
+		uint rightRays = batchBoxRays(rays, nodes[right].min, nodes[right].max, false);
+
+		if (rightRays != 0u)
+		{
+			stack[stackSize] = right;
+			stackRays[stackSize] = rightRays;
+			stackSize++;
+		}
+
+		if (leftRays != 0u)
+		{
+			stack[stackSize] = left;
+			stackRays[stackSize] = leftRays;
+			stackSize++;
+		}
+	}
+
+	return blocked;
+}
+
+// intersectMeshLeaf for a batch. Every triangle is read and made into a record once, for all of the rays.
+// Returns the rays that it blocks
+uint batchMeshLeaf(int instance, int first, int count, uint rays)
+{
+	int base = instanceFirstTriangle(instance);
+	uint blocked = 0u;
+
+	for (int i = base + first; i < base + first + count && rays != 0u; i++)
+	{
+		triangle tri = loadMeshTriangle(instance, i);
+		vec3 normal = triangleNormal(tri);
+
+		vec4 r0, r1, r2;
+		makeTriangleRecord(tri.a, tri.b, tri.c, vec3(0.0), r0, r1, r2);
+
+		uint left = rays;
+
+		while (left != 0u)
+		{
+			int k = findLSB(left);
+			left &= left - 1u;
+
+			COUNT_COST(costTriangleTests);
+
+			if (dot(normal, batchMeshDir[k]) > 0)
+				continue;
+
+			float t = intersectTriangleRecord(batchMeshOrigin[k], batchMeshDir[k], batchTmax[k], r0, r1, r2);
+
+			if (t != -1.0 && t < batchTmax[k])
+				blocked |= 1u << uint(k);
+		}
+
+		rays &= ~blocked;
+	}
+
+	return blocked;
+}
+
+// intersectTwoLevel for a batch. The rays that reach an instance are moved into the space of its mesh together,
+// and walk its BLAS together. Returns the rays that are blocked
+uint occludedBatchTwoLevel(uint active)
+{
+	uint blocked = 0u;
+
+	int instance = -1;
+	int blasStackBase = 0;
+
+	int stack[BVH_STACK_SIZE];
+	uint stackRays[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	uint rays = batchBoxRays(active, levelNodes[0].min, levelNodes[0].max, false);
+
+	if (rays != 0u)
+	{
+		stack[stackSize] = 0;
+		stackRays[stackSize] = rays;
+		stackSize++;
+	}
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+
+		// back to the TLAS, in world space
+		if (instance >= 0 && stackSize < blasStackBase)
+			instance = -1;
+
+		int n = stack[stackSize];
+		rays = stackRays[stackSize] & ~blocked;
+
+		if (rays == 0u)
+			continue;
+
+		COUNT_COST(costNodeVisits);
+
+		bool inMesh = instance >= 0;
+
+		if (inMesh && wideBLAS)
+		{
+			vec3 nodeOrigin = wideNodes[n].origin;
+			vec3 nodeScale = wideNodes[n].scale;
+
+			for (int c = 0; c < 4; c++)
+			{
+				int child = wideNodes[n].child[c];
+
+				if (child == -1)
+					continue;
+
+				vec3 boxMin = nodeOrigin + vec3(unpackByte(wideNodes[n].loX, c), unpackByte(wideNodes[n].loY, c), unpackByte(wideNodes[n].loZ, c)) * nodeScale;
+				vec3 boxMax = nodeOrigin + vec3(unpackByte(wideNodes[n].hiX, c), unpackByte(wideNodes[n].hiY, c), unpackByte(wideNodes[n].hiZ, c)) * nodeScale;
+
+				uint childRays = batchBoxRays(rays & ~blocked, boxMin, boxMax, true);
+
+				if (childRays == 0u)
+					continue;
+
+				if (child < 0)
+				{
+					int leaf = ~child;
+					blocked |= batchMeshLeaf(instance, leaf >> 3, leaf & 7, childRays);
+
+					if (blocked == active)
+						return blocked;
+
+					continue;
+				}
+
+				stack[stackSize] = child;
+				stackRays[stackSize] = childRays;
+				stackSize++;
+			}
+
+			continue;
+		}
+
+		COUNT_NODE_VISIT(n);
+
+		if (levelNodes[n].left < 0)
+		{
+			int first = ~levelNodes[n].left;
+
+			if (!inMesh)
+			{
+				if (levelNodes[n].right == 0)
+					continue;
+
+#ifdef ANALYTIC_PRIMITIVES
+				if (instances[first].primitive != PRIMITIVE_NONE)
+				{
+					mat4 worldToObject = instanceWorldToObject(first);
+					uint tested = rays;
+
+					while (tested != 0u)
+					{
+						int k = findLSB(tested);
+						tested &= tested - 1u;
+
+						if (intersectPrimitive(first, (worldToObject * vec4(batchOrigin[k], 1.0)).xyz, mat3(worldToObject) * batchDir[k], batchTmax[k]) != -1.0)
+							blocked |= 1u << uint(k);
+					}
+
+					if (blocked == active)
+						return blocked;
+
+					continue;
+				}
+#endif
+
+				instance = first;
+				mat4 worldToObject = instanceWorldToObject(instance);
+				uint moved = rays;
+
+				while (moved != 0u)
+				{
+					int k = findLSB(moved);
+					moved &= moved - 1u;
+
+					batchMeshOrigin[k] = (worldToObject * vec4(batchOrigin[k], 1.0)).xyz;
+					batchMeshDir[k] = mat3(worldToObject) * batchDir[k];
+					batchMeshInvDir[k] = 1.0 / mix(batchMeshDir[k], vec3(0.0000001), equal(batchMeshDir[k], vec3(0.0)));
+				}
+
+				blasStackBase = stackSize;
+				stack[stackSize] = instanceBlasRoot(instance);
+				stackRays[stackSize] = rays;
+				stackSize++;
+				continue;
+			}
+
+			blocked |= batchMeshLeaf(instance, first, levelNodes[n].right, rays);
+
+			if (blocked == active)
+				return blocked;
+
+			continue;
+		}
+
+		int left = levelNodes[n].left;
+		int right = levelNodes[n].right;
+
+		uint leftRays = batchBoxRays(rays, levelNodes[left].min, levelNodes[left].max, inMesh);
+		uint rightRays = batchBoxRays(rays, levelNodes[right].min, levelNodes[right].max, inMesh);
+
+		if (rightRays != 0u)
+		{
+			stack[stackSize] = right;
+			stackRays[stackSize] = rightRays;
+			stackSize++;
+		}
+
+		if (leftRays != 0u)
+		{
+			stack[stackSize] = left;
+			stackRays[stackSize] = leftRays;
+			stackSize++;
+		}
+	}
+
+	return blocked;
+}
+
+// occluded for the rays of active in the batch arrays. The grid, the mesh boxes, and the loop over every
+// triangle have no nodes to share, so they trace the rays one at a time. Returns the rays that are blocked
+uint occludedBatch(uint active)
+{
+	uint rays = active;
+
+	while (rays != 0u)
+	{
+		int k = findLSB(rays);
+		rays &= rays - 1u;
+
+		batchInvDir[k] = 1.0 / mix(batchDir[k], vec3(0.0000001), equal(batchDir[k], vec3(0.0)));
+
+		COUNT_RAY(shadowRays);
+		COUNT_COST(costShadowRays);
+	}
+
+	if (accel == ACCEL_TWO_LEVEL)
+		return occludedBatchTwoLevel(active);
+
+	if (accel == ACCEL_BVH)
+		return occludedBatchBVH(active);
+
+	uint blocked = 0u;
+	hitinfo unused;
+	rays = active;
+
+	while (rays != 0u)
+	{
+		int k = findLSB(rays);
+		rays &= rays - 1u;
+
+		if (intersectAccel(batchOrigin[k], batchDir[k], batchTmax[k], true, unused))
+			blocked |= 1u << uint(k);
+	}
+
+	return blocked;
+}
+#endif
+
+// The shading LOD of the points that the reflections hit (--lod-shadows, --lod-specular, and --lod-lights).
+// They add less to the pixel than the point the eye sees, so their light can be cheaper. The point the eye sees
+// is bounce 0, and the first reflection is bounce 1. From bounce lodShadowsFrom on, the lights trace no shadow rays;
+// from lodSpecularFrom on, they have no specular highlight; and from lodLightsFrom on, only the lodLightCount lights
+// that are brightest at the point are added (at most LOD_MAX_LIGHTS). 0 turns each one off.
+// The locations are fixed, like the path uniforms, so that main.cpp sets them the same way for every renderer
+#define LOD_MAX_LIGHTS 8
+layout(location = 13) uniform int lodShadowsFrom;
+layout(location = 14) uniform int lodSpecularFrom;
+layout(location = 15) uniform int lodLightsFrom;
+layout(location = 16) uniform int lodLightCount;
+
+bool lodShadows(int bounce)
+{
+	return lodShadowsFrom == 0 || bounce < lodShadowsFrom;
+}
+
+bool lodSpecular(int bounce)
+{
+	return lodSpecularFrom == 0 || bounce < lodSpecularFrom;
+}
+
+bool lodTopLights(int bounce)
+{
+	return lodLightsFrom > 0 && bounce >= lodLightsFrom;
+}
+
+// The geometry LOD (--lod-geometry): from bounce lodGeometryFrom on, the rays that find the points of a bounce,
+// and their shadow rays, walk the coarser copies of the meshes, one copy coarser every bounce (see rayLod).
+// 0 is off. Only the two-level BVH has the copies, the other structures always have the meshes
+#define MESH_LODS 2
+layout(location = 18) uniform int lodGeometryFrom;
+
+int geometryLod(int bounce)
+{
+	return lodGeometryFrom == 0 ? 0 : clamp(bounce - lodGeometryFrom + 1, 0, MESH_LODS);
+}
+
+// With --half-shading, the light of a point is worked out in 16-bit floats (float16_t of GL_AMD_gpu_shader_half_float
+// or GL_NV_gpu_shader5), which take half the registers. The points and distances stay in 32 bits like the ray tests,
+// since a place in the world needs more digits than a half has. Only the directions, the dot products, the attenuation,
+// the specular, and the colors are halves, and those are all between 0 and about the brightness of a light
+#ifdef HALF_SHADING
+#define shadeFloat float16_t
+#define shadeVec3 f16vec3
+#else
+#define shadeFloat float
+#define shadeVec3 vec3
+#endif
+
+// The light that L adds to a point, if nothing is in the way. This does not trace any rays,
+// so the shadow test is done by whoever calls this (see addLightColorToPixColor).
+// Without specular, the point only has the diffuse light
+vec3 lightContribution(light L, vec3 dirRayToPoint, hitinfo rayHitPoint, bool specular)
+{
+	// get direction from point to light
+	vec3 pointToLight = L.pos - rayHitPoint.point;
+	
+	// Get the distance from point on surface to light
+	float dist = length(pointToLight);
+
+	// if the pixel is outside the range of the 
+	// light, return 0. Don't process the light 
+	// if the light doesn't touch the pixel anyways
+	if(dist > L.radius)
+		return vec3(0);
+
+	// normalize the distance, to get direction
+	shadeVec3 toLight = shadeVec3(normalize(pointToLight));
+	shadeVec3 normal = shadeVec3(rayHitPoint.normal);
+
+	// Get a reflection vector bouncing the light ray off the surface of the triangle.
+	// Used for specular light calculations.
+	shadeVec3 reflectedRayToPoint = reflect(toLight, normal);
+
+	// get the dot product, just like the basic tutorials
+	shadeFloat NdotL = dot(normal, toLight);
+
+	// clamp the color
+	NdotL = clamp(NdotL, shadeFloat(0.0), shadeFloat(1.0));
+
+	// Formula for range-based attenuation
+	// (in 32 bits, because the square of a distance can be more than a half holds)
+	shadeFloat atten = shadeFloat(1.0 - (dist*dist) / (L.radius*L.radius));
+	
+	// clamp the attenuation
+	atten = clamp(atten, shadeFloat(0.0), shadeFloat(1.0));
+
+	// Get the final color of the light on the pixel
+	shadeFloat diffuse = NdotL;
+
+	shadeVec3 brightness = shadeVec3(L.brightness * L.color) * atten;
+	shadeVec3 color = shadeVec3(rayHitPoint.color);
+
+	if (!specular)
+		return vec3(color * brightness * diffuse);
+
+	// Calculate specular and diffuse lighting normally.
+	shadeFloat specularLevel = max(shadeFloat(0.0), pow(dot(reflectedRayToPoint, shadeVec3(dirRayToPoint)), shadeFloat(64.0)));
+
+	// Return our diffuse light and specular (we do white light, for specula) and factor in the reflectionLevel and lightIntensity.
+	return vec3((color * brightness * diffuse) + (brightness * specularLevel));
+}
+
+vec3 lightContribution(light L, vec3 dirRayToPoint, hitinfo rayHitPoint)
+{
+	return lightContribution(L, dirRayToPoint, rayHitPoint, true);
+}
+
+#ifdef SHADOW_CACHE
+// The shadow cache of --shadow-cache. main.cpp gives every light an epoch, which goes up when the light, or a mesh
+// inside its radius, moves. An entry of the table is 16 bits of the hash of its light and point (to tell it apart
+// from the others that land on the same entry), the epoch of the light when it was written (15 bits), and if the
+// shadow ray was blocked (1 bit). The point is the cell of SHADOW_CACHE_CELL that it is in, and its triangle,
+// so the points of one cell share the shadow of the first one that was traced
+layout(binding = 29) buffer shadowCacheBlock
+{
+	uint shadowEpochs[MAX_LIGHTS];
+	uint shadowCache[];
+};
+
+// the PCG hash, which mixes the bits well
+uint shadowHash(uint x)
+{
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// The entry of the table of this light and point, and what it has in it if it is the shadow of this epoch
+void shadowCacheKey(int lightIndex, hitinfo rayHitPoint, out uint slot, out uint stamp)
+{
+	uvec3 cell = uvec3(ivec3(floor(rayHitPoint.point / SHADOW_CACHE_CELL)));
+	uint h = shadowHash(cell.x ^ shadowHash(cell.y ^ shadowHash(cell.z ^ shadowHash(uint(lightIndex) ^ shadowHash(uint(rayHitPoint.index))))));
+
+	slot = h & uint(shadowCache.length() - 1);
+	stamp = (shadowHash(h) & 0xFFFF0000u) | ((shadowEpochs[lightIndex] & 0x7FFFu) << 1);
+}
+#endif
+
+// The light of light j on a point of this bounce, with its shadow ray, if the shading LOD of the bounce has one
+vec3 addLightColorToPixColor(int j, vec3 dirRayToPoint, hitinfo rayHitPoint, int bounce)
+{
+	light L = lights[j];
+
+	// get direction from point to light
+	vec3 pointToLight = L.pos - rayHitPoint.point;
+	
+	// Get the distance from point on surface to light
+	float dist = length(pointToLight);
+
+	// if the pixel is outside the range of the 
+	// light, return 0. Don't process the light 
+	// if the light doesn't touch the pixel anyways
+	if(dist > L.radius)
+	{
+		COUNT_RAY(lightsCulled);
+		return vec3(0);
+	}
+
+	// Now we check to see if any polygons are standing between the point
+	// that the ray hit, and the light. If a polygon blocks this new ray from
+	// the light, then don't light this pixel (shadow). Otherwise, light it.
+	// The ray goes from the light to the point, and only surfaces that are at least
+	// 0.1 closer to the light than the point count, so the surface can't shadow itself.
+	// If you do NOT want shadows, delete the if-statment
+	if (lodShadows(bounce))
+	{
+#ifdef REDUCED_SHADOWS
+		int known = bounce == 0 ? reducedShadow(j) : -1;
+
+		if (known >= 0)
+		{
+			COUNT_RAY(shadowsUpsampled);
+
+			if (known == 1)
+			{
+				COUNT_RAY(occludedShadows);
+				return vec3(0);
+			}
+
+			return lightContribution(L, dirRayToPoint, rayHitPoint, lodSpecular(bounce));
+		}
+#endif
+
+#ifdef SHADOW_CACHE
+		uint slot, stamp;
+		shadowCacheKey(j, rayHitPoint, slot, stamp);
+		uint entry = shadowCache[slot];
+		bool blocked;
+
+		// the light and the meshes near it did not move since this entry was written
+		if ((entry & ~1u) == stamp)
+		{
+			COUNT_RAY(shadowCacheHits);
+			blocked = (entry & 1u) != 0u;
+		}
+		else
+		{
+			COUNT_RAY(shadowRaysPerBounce[min(bounce, RAY_STATS_BOUNCES - 1)]);
+			rayLod = geometryLod(bounce);
+			blocked = occludedByLight(j, L.pos, -normalize(pointToLight), dist - 0.1);
+			rayLod = 0;
+			shadowCache[slot] = stamp | (blocked ? 1u : 0u);
+		}
+
+		if (blocked)
+#else
+		COUNT_RAY(shadowRaysPerBounce[min(bounce, RAY_STATS_BOUNCES - 1)]);
+		rayLod = geometryLod(bounce);
+		bool blocked = occludedByLight(j, L.pos, -normalize(pointToLight), dist - 0.1);
+		rayLod = 0;
+
+		if (blocked)
+#endif
+		{
+			COUNT_RAY(occludedShadows);
+
+			// Then this is in shadow, since the light is hitting another object first.
+			return vec3(0);
+		}
+	}
+
+	return lightContribution(L, dirRayToPoint, rayHitPoint, lodSpecular(bounce));
+}
+
+// The point the eye sees
+vec3 addLightColorToPixColor(int j, vec3 dirRayToPoint, hitinfo rayHitPoint)
+{
+	return addLightColorToPixColor(j, dirRayToPoint, rayHitPoint, 0);
+}
+
+#ifdef SHADOW_BATCH
+// The lights that wait for their shadow rays to be traced as a batch, and what their light is multiplied by
+int batchLights[SHADOW_BATCH];
+float batchScales[SHADOW_BATCH];
+int batchCount = 0;
+
+// Add the light of every light in the batch to color, the same as addLightColorToPixColor for each one in turn,
+// with the shadow rays that it needs traced together by occludedBatch
+void flushLightBatch(vec3 dirRayToPoint, hitinfo rayHitPoint, int bounce, inout vec3 color)
+{
+	uint reach = 0u;
+	uint traced = 0u;
+	uint blocked = 0u;
+	bool shadows = lodShadows(bounce);
+
+#ifdef SHADOW_CACHE
+	uint slots[SHADOW_BATCH];
+	uint stamps[SHADOW_BATCH];
+#endif
+
+	for (int k = 0; k < batchCount; k++)
+	{
+		int j = batchLights[k];
+		vec3 pointToLight = lights[j].pos - rayHitPoint.point;
+		float dist = length(pointToLight);
+
+		if (dist > lights[j].radius)
+		{
+			COUNT_RAY(lightsCulled);
+			continue;
+		}
+
+		uint bit = 1u << uint(k);
+		reach |= bit;
+
+		if (!shadows)
+			continue;
+
+#ifdef REDUCED_SHADOWS
+		int known = bounce == 0 ? reducedShadow(j) : -1;
+
+		if (known >= 0)
+		{
+			COUNT_RAY(shadowsUpsampled);
+
+			if (known == 1)
+				blocked |= bit;
+
+			continue;
+		}
+#endif
+
+#ifdef SHADOW_CACHE
+		shadowCacheKey(j, rayHitPoint, slots[k], stamps[k]);
+		uint entry = shadowCache[slots[k]];
+
+		if ((entry & ~1u) == stamps[k])
+		{
+			COUNT_RAY(shadowCacheHits);
+
+			if ((entry & 1u) != 0u)
+				blocked |= bit;
+
+			continue;
+		}
+#endif
+
+		COUNT_RAY(shadowRaysPerBounce[min(bounce, RAY_STATS_BOUNCES - 1)]);
+		batchOrigin[k] = lights[j].pos;
+		batchDir[k] = -normalize(pointToLight);
+		batchTmax[k] = dist - 0.1;
+		traced |= bit;
+	}
+
+	if (traced != 0u)
+	{
+		rayLod = geometryLod(bounce);
+		uint hit = 0u;
+		uint walked = traced;
+
+#ifdef LIGHT_OCCLUDERS
+		// the rays of the lights that have a list test it, and only the others walk the accel together
+		for (int k = 0; k < batchCount; k++)
+		{
+			uint bit = 1u << uint(k);
+
+			if ((traced & bit) != 0u && hasOccluderList(batchLights[k]))
+			{
+				walked &= ~bit;
+
+				if (occludedByList(batchLights[k], batchOrigin[k], batchDir[k], batchTmax[k]))
+					hit |= bit;
+			}
+		}
+#endif
+
+		if (walked != 0u)
+			hit |= occludedBatch(walked);
+
+		rayLod = 0;
+
+#ifdef SHADOW_CACHE
+		for (int k = 0; k < batchCount; k++)
+		{
+			if ((traced & (1u << uint(k))) != 0u)
+				shadowCache[slots[k]] = stamps[k] | ((hit & (1u << uint(k))) != 0u ? 1u : 0u);
+		}
+#endif
+
+		blocked |= hit;
+	}
+
+	for (int k = 0; k < batchCount; k++)
+	{
+		uint bit = 1u << uint(k);
+
+		if ((reach & bit) == 0u)
+			continue;
+
+		if ((blocked & bit) != 0u)
+		{
+			COUNT_RAY(occludedShadows);
+			continue;
+		}
+
+		color += lightContribution(lights[batchLights[k]], dirRayToPoint, rayHitPoint, lodSpecular(bounce)) * batchScales[k];
+	}
+
+	batchCount = 0;
+}
+
+// Add light j, whose light is multiplied by scale, to the batch, and trace the batch once it is full.
+// Whoever adds lights flushes the ones that are left with flushLightBatch
+void batchLight(int j, float scale, vec3 dirRayToPoint, hitinfo rayHitPoint, int bounce, inout vec3 color)
+{
+	batchLights[batchCount] = j;
+	batchScales[batchCount] = scale;
+	batchCount++;
+
+	if (batchCount == SHADOW_BATCH)
+		flushLightBatch(dirRayToPoint, rayHitPoint, bounce, color);
+}
+#endif
+
+// Which bucket of the light grid a point is in. This hash must be the same as lightBucketOf in main.cpp
+uint lightBucketOf(vec3 point)
+{
+	ivec3 cell = ivec3(floor(point / lightCellSize));
+	uvec3 u = uvec3(cell);
+	return ((u.x * 73856093u) ^ (u.y * 19349663u) ^ (u.z * 83492791u)) & uint(LIGHT_HASH_SIZE - 1);
+}
+
+// Find the lights that can reach a point. Light k of the list is lights[nearLight(first, k)].
+// If there is no grid, the list is every light
+void lightsNear(vec3 point, out uint first, out uint count)
+{
+	if (lightGridBuilt == 0)
+	{
+		first = 0u;
+		count = uint(numLights);
+		return;
+	}
+
+	uvec2 bucket = lightBuckets[lightBucketOf(point)];
+	first = bucket.x;
+	count = bucket.y;
+}
+
+int nearLight(uint first, uint k)
+{
+	return lightGridBuilt == 0 ? int(k) : int(lightRefs[first + k]);
+}
+
+// Find the lodLightCount lights of the list from lightsNear that are brightest at a point, if nothing is in the way,
+// brightest first. Lights that do not reach the point are never picked. Returns how many it found
+int brightestLights(vec3 dirRayToPoint, hitinfo rayHitPoint, uint first, uint count, bool specular, out int chosen[LOD_MAX_LIGHTS])
+{
+	float brightness[LOD_MAX_LIGHTS];
+	int wanted = clamp(lodLightCount, 1, LOD_MAX_LIGHTS);
+	int found = 0;
+
+	for (uint k = 0u; k < count; k++)
+	{
+		int j = nearLight(first, k);
+		float b = dot(lightContribution(lights[j], dirRayToPoint, rayHitPoint, specular), vec3(0.2126, 0.7152, 0.0722));
+
+		if (b <= 0.0 || (found == wanted && b <= brightness[wanted - 1]))
+			continue;
+
+		// Put it in its place in the list, which pushes the dimmest one out when the list is full
+		if (found < wanted)
+			found++;
+
+		int at = found - 1;
+
+		while (at > 0 && brightness[at - 1] < b)
+		{
+			brightness[at] = brightness[at - 1];
+			chosen[at] = chosen[at - 1];
+			at--;
+		}
+
+		brightness[at] = b;
+		chosen[at] = j;
+	}
+
+	return found;
+}
+
+// a different number every frame, for the random numbers of Russian roulette and of the light samples
+layout(location = 9) uniform uint frameSeed;
+
+// A random number from 0 to 1, which also moves seed on to the next one (PCG hash)
+float randomFloat(inout uint seed)
+{
+	seed = seed * 747796405u + 2891336453u;
+	uint word = ((seed >> ((seed >> 28u) + 4u)) ^ seed) * 277803737u;
+	word = (word >> 22u) ^ word;
+	return float(word) / 4294967296.0;
+}
+
+// the random numbers of --sampler, which fall back to randomFloat
+#include "Sampling.glsl"
+
+// Light sampling (--light-samples). When a point has more than lightSamples lights, only lightSamples of them are
+// added, picked at random, so a point costs the same with 10 lights or with 1000. Lights are picked more often
+// when they give more light to the point, if nothing is in the way (lightContribution, which has the brightness,
+// the attenuation of the radius, and the angle), and every picked light counts for the lights that were not picked:
+// its light is divided by the chance that it was picked, so that on average the image is the same as with every light.
+// Picking by the light itself means that only the shadows and the colors of the lights make noise.
+// One frame is noisy, which accumulation (--accumulate) and --denoise take out.
+// The location is fixed, like the shading LOD. 0 adds every light
+layout(location = 17) uniform int lightSamples;
+
+// How bright the light of L on a point is, if nothing is in the way. This is the brightest of red, green, and blue,
+// and not the luminance, so that a blue light that is picked is never brighter than the total of every light
+float lightWeight(light L, vec3 dirRayToPoint, hitinfo rayHitPoint, bool specular)
+{
+	vec3 c = lightContribution(L, dirRayToPoint, rayHitPoint, specular);
+	return max(c.r, max(c.g, c.b));
+}
+
+// The random numbers of the light samples of a point, which are different every frame
+uint lightSampleSeed(vec3 point, int bounce)
+{
+	uvec3 u = floatBitsToUint(point);
+	return (u.x * 73856093u) ^ (u.y * 19349663u) ^ (u.z * 83492791u) ^ (uint(bounce) * 6271u) ^ (frameSeed * 2654435761u);
+}
+
+// Pick lightSamples lights (at most LOD_MAX_LIGHTS) of the list from lightsNear, by lightWeight. scale[k] is what
+// the light of chosen[k] is multiplied by. The samples are spread out evenly over the total weight, with one random
+// number, so a bright light can be picked more than once: then it is in the list once, with a bigger scale.
+// Returns how many lights it picked, or -1 if the point has no more lights than samples, and every light should be added
+int sampleLights(vec3 dirRayToPoint, hitinfo rayHitPoint, uint first, uint count, bool specular, int bounce, inout uint seed, out int chosen[LOD_MAX_LIGHTS], out float scale[LOD_MAX_LIGHTS])
+{
+	int samples = clamp(lightSamples, 1, LOD_MAX_LIGHTS);
+
+	if (count <= uint(samples))
+		return -1;
+
+	float total = 0.0;
+
+	for (uint k = 0u; k < count; k++)
+		total += lightWeight(lights[nearLight(first, k)], dirRayToPoint, rayHitPoint, specular);
+
+	if (total <= 0.0)
+		return 0;
+
+	// sample s is at (s + r) / samples of the total weight, go through the lights until we pass it
+	float step = total / float(samples);
+	float next = sampleFloat(SAMPLE_LIGHTS(bounce), seed) * step;
+	float sum = 0.0;
+	int found = 0;
+	int s = 0;
+
+	for (uint k = 0u; k < count && s < samples; k++)
+	{
+		int j = nearLight(first, k);
+		float w = lightWeight(lights[j], dirRayToPoint, rayHitPoint, specular);
+		sum += w;
+
+		// the chance of a light to be picked by one sample is w / total
+		while (s < samples && next < sum)
+		{
+			if (found > 0 && chosen[found - 1] == j)
+				scale[found - 1] += step / w;
+			else
+			{
+				chosen[found] = j;
+				scale[found] = step / w;
+				found++;
+			}
+
+			s++;
+			next += step;
+		}
+	}
+
+	return found;
+}
+
+// The light of every light on one point of this bounce, added together, with the shading LOD of the bounce
+vec3 addAllLightsToPixColor(vec3 dirRayToPoint, hitinfo rayHitPoint, int bounce)
+{
+	vec3 color = vec3(0);
+
+	// Only loop over the lights in the bucket of this point. Every light that reaches
+	// the point is in the list, and they are in the same order as lights[],
+	// so this adds up to exactly the same color as looping over every light
+	uint first, count;
+	lightsNear(rayHitPoint.point, first, count);
+
+	if (lodTopLights(bounce))
+	{
+		int chosen[LOD_MAX_LIGHTS];
+		int found = brightestLights(dirRayToPoint, rayHitPoint, first, count, lodSpecular(bounce), chosen);
+
+		for (int k = 0; k < found; k++)
+		{
+#ifdef SHADOW_BATCH
+			batchLight(chosen[k], 1.0, dirRayToPoint, rayHitPoint, bounce, color);
+#else
+			color += addLightColorToPixColor(chosen[k], dirRayToPoint, rayHitPoint, bounce);
+#endif
+		}
+
+#ifdef SHADOW_BATCH
+		flushLightBatch(dirRayToPoint, rayHitPoint, bounce, color);
+#endif
+		return color;
+	}
+
+	if (lightSamples > 0)
+	{
+		int chosen[LOD_MAX_LIGHTS];
+		float scale[LOD_MAX_LIGHTS];
+		uint seed = lightSampleSeed(rayHitPoint.point, bounce);
+		int found = sampleLights(dirRayToPoint, rayHitPoint, first, count, lodSpecular(bounce), bounce, seed, chosen, scale);
+
+		for (int k = 0; k < found; k++)
+		{
+#ifdef SHADOW_BATCH
+			batchLight(chosen[k], scale[k], dirRayToPoint, rayHitPoint, bounce, color);
+#else
+			color += addLightColorToPixColor(chosen[k], dirRayToPoint, rayHitPoint, bounce) * scale[k];
+#endif
+		}
+
+#ifdef SHADOW_BATCH
+		flushLightBatch(dirRayToPoint, rayHitPoint, bounce, color);
+#endif
+
+		if (found >= 0)
+			return color;
+	}
+
+	for(uint k = 0u; k < count; k++)
+	{
+#ifdef SHADOW_BATCH
+		batchLight(nearLight(first, k), 1.0, dirRayToPoint, rayHitPoint, bounce, color);
+#else
+		color += addLightColorToPixColor(nearLight(first, k), dirRayToPoint, rayHitPoint, bounce);
+#endif
+	}
+
+#ifdef SHADOW_BATCH
+	flushLightBatch(dirRayToPoint, rayHitPoint, bounce, color);
+#endif
+
+	return color;
+}
+
+// The point the eye sees
+vec3 addAllLightsToPixColor(vec3 dirRayToPoint, hitinfo rayHitPoint)
+{
+	return addAllLightsToPixColor(dirRayToPoint, rayHitPoint, 0);
+}
+
+// How the reflections stop. A path of reflections stops after maxBounces, or when its
+// throughput (how much of the pixel color it still adds, the reflectivity of every surface
+// it bounced off, multiplied together) is less than throughputEpsilon.
+// With russianRoulette, paths below rouletteThreshold are stopped at random instead, and the
+// ones that keep going count for more, so that on average the image is the same.
+// The locations are fixed (right after the camera), so that main.cpp can set them
+// the same way for FragmentShader.glsl and Wavefront.glsl
+// With SCENE_SPECIALIZED, maxBounces and russianRoulette are constants, so a render with no bounces
+// has no reflection code at all, and one without Russian roulette has no random numbers
+#ifdef SCENE_SPECIALIZED
+#define maxBounces SCENE_MAX_BOUNCES
+#define russianRoulette SCENE_RUSSIAN_ROULETTE
+#else
+layout(location = 5) uniform int maxBounces;
+layout(location = 7) uniform bool russianRoulette;
+#endif
+layout(location = 6) uniform float throughputEpsilon;
+layout(location = 8) uniform float rouletteThreshold;
+
+// Decide if a path of reflections with this throughput bounces again, after the point of this bounce.
+// Russian roulette can make the throughput bigger, to make up for the paths it stopped
+bool continuePath(inout float throughput, int bounce, inout uint seed)
+{
+	if (throughput <= 0.0)
+		return false;
+
+	if (russianRoulette && throughput < rouletteThreshold)
+	{
+		float survive = throughput / rouletteThreshold;
+
+		if (sampleFloat(SAMPLE_ROULETTE(bounce), seed) >= survive)
+			return false;
+
+		throughput /= survive;
+		return true;
+	}
+
+	return throughput >= throughputEpsilon;
+}
+
+// The reflected ray only depends on the surface, not on the lights. So we follow
+// the reflections once, and at every point that they hit, we add the light of every light.
+// The light of every point is multiplied by the throughput of the path when it got there,
+// which starts as the reflectivity of the first point. Surfaces that are not reflective
+// end the path, so they do not trace any more rays
+#ifdef FLOOR_TEXTURE
+// --floor-texture: the floor (the plane y = 0, facing up) has the colors of a texture, repeated every
+// floorTextureScale units. The mip comes from the ray cone of the pixel: the cone opens by pixelSpread
+// (radians) per unit of the path, and flat mirrors do not open it more, so a cone is as wide as its path is
+// long times pixelSpread. A reflection has a longer path than the eye ray, so it reads a smaller mip, and
+// the texture cache is not filled with texels that the reflection cannot show. With ARB_bindless_texture,
+// the texture is a handle (main.cpp makes it resident), and otherwise it is on texture unit 6
+#ifdef BINDLESS_TEXTURES
+layout(bindless_sampler) uniform sampler2D floorTexture;
+#else
+layout(binding = 6) uniform sampler2D floorTexture;
+#endif
+uniform float floorTextureScale;
+uniform float pixelSpread;
+
+// Multiply the color of a hit by the floor texture, if it is on the floor. dir is the ray that hit it,
+// and coneWidth is how wide the ray cone is there
+void applyFloorTexture(inout hitinfo hit, vec3 dir, float coneWidth)
+{
+	if (hit.normal.y < 0.999 || abs(hit.point.y) > 0.001)
+		return;
+
+	// the cone is stretched over the floor when it hits it at a grazing angle
+	float footprint = coneWidth / max(abs(dot(hit.normal, dir)), 0.05);
+	float texels = footprint / floorTextureScale * float(textureSize(floorTexture, 0).x);
+
+	hit.color *= textureLod(floorTexture, hit.point.xz / floorTextureScale, log2(max(texels, 1.0))).rgb;
+}
+#endif
+
+#ifdef IRRADIANCE_PROBES
+// --irradiance-probes: the light that comes to the points of the scene from everything around them, which
+// IrradianceProbes.glsl traces a few probes of every frame, instead of the same ambient light everywhere
+layout(std430, binding = IRRADIANCE_BINDING) buffer irradianceProbeBlock
+{
+	irradianceGrid irradiance;
+	vec4 irradianceCubes[];
+};
+
+// The ambient light of a point with this normal, from the 8 probes around it. Every probe mixes the 3 sides
+// of its cube that the normal faces by the square of the normal, and the probes are mixed by how close they are.
+// The probes that were never traced are left out, and with none of them, it is the ambient light without probes
+vec3 ambientLight(vec3 point, vec3 normal)
+{
+	ivec3 count = ivec3(irradiance.countX, irradiance.countY, irradiance.countZ);
+
+	// the probes are in the middle of the cells of the grid
+	vec3 cell = clamp((point - irradiance.boxMin) / (irradiance.boxMax - irradiance.boxMin) * vec3(count) - 0.5, vec3(0.0), vec3(count - 1));
+	ivec3 base = min(ivec3(cell), max(count - 2, ivec3(0)));
+	vec3 f = cell - vec3(base);
+
+	vec3 square = normal * normal;
+	ivec3 side = ivec3(lessThan(normal, vec3(0.0)));
+	vec3 sum = vec3(0);
+	float total = 0.0;
+
+	for (int c = 0; c < 8; c++)
+	{
+		ivec3 corner = ivec3(c & 1, (c >> 1) & 1, c >> 2);
+		ivec3 p = min(base + corner, count - 1);
+		int probe = 6 * (p.x + count.x * (p.y + count.y * p.z));
+		vec3 w = mix(1.0 - f, f, vec3(corner));
+		float weight = w.x * w.y * w.z;
+
+		vec4 x = irradianceCubes[probe + side.x];
+		vec4 y = irradianceCubes[probe + 2 + side.y];
+		vec4 z = irradianceCubes[probe + 4 + side.z];
+
+		if (x.w > 0.0)
+		{
+			sum += (x.rgb * square.x + y.rgb * square.y + z.rgb * square.z) * weight;
+			total += weight;
+		}
+	}
+
+	return total > 1e-4 ? sum / total : vec3(0.1);
+}
+#endif
+
+#ifdef REFLECTION_PROBES
+// --reflection-probes: numProbes cube maps, each seen from probeCenters[k], which the tracer draws (probePass in
+// FragmentShader.glsl) when the scene has changed. The reflection ray of bounce probeBounce and after (the first reflection
+// is bounce 1), or one that starts more than probeDistance along its path from the eye, reads the probe closest to where it
+// starts instead of being traced, and the bounces after it are in the probe already. The probe saw the box of the scene
+// (probeBoxMin to probeBoxMax) from its center, so the ray is followed to the side of that box, and the probe is read in
+// the direction of that point instead of the direction of the ray. The mip is the one of the ray cone of the pixel, which
+// opens by probeSpread (the angle of a pixel) per unit of the path, like the floor texture
+#define MAX_REFLECTION_PROBES 8
+layout(binding = 10) uniform samplerCubeArray probeTexture;
+uniform bool probePass;
+uniform int numProbes;
+uniform vec3 probeCenters[MAX_REFLECTION_PROBES];
+uniform vec3 probeBoxMin;
+uniform vec3 probeBoxMax;
+uniform int probeBounce;
+uniform float probeDistance;
+uniform float probeSpread;
+
+// True if the reflection ray of this bounce, which starts pathLength along the path of the pixel, reads a probe.
+// The probes themselves trace all of their bounces
+bool probeReflection(int bounce, float pathLength)
+{
+	return !probePass && ((probeBounce > 0 && bounce >= probeBounce) || (probeDistance > 0.0 && pathLength > probeDistance));
+}
+
+// The light that comes to point from the direction dir, from the probe closest to it
+vec3 sampleProbe(vec3 point, vec3 dir, float pathLength)
+{
+	int closest = 0;
+	float closestDistance = 1e30;
+
+	for (int k = 0; k < numProbes; k++)
+	{
+		float d = distance(point, probeCenters[k]);
+
+		if (d < closestDistance)
+		{
+			closest = k;
+			closestDistance = d;
+		}
+	}
+
+	// where the ray leaves the box of the scene
+	vec3 invDir = 1.0 / dir;
+	vec3 far = max((probeBoxMin - point) * invDir, (probeBoxMax - point) * invDir);
+	float t = max(min(far.x, min(far.y, far.z)), 0.0);
+	vec3 lookup = point + dir * t - probeCenters[closest];
+
+	if (dot(lookup, lookup) < 1e-8)
+		lookup = dir;
+
+	// how wide the cone of the pixel is where the ray ends, in texels of the probe there
+	float coneWidth = (pathLength + t) * probeSpread;
+	float texelWidth = length(lookup) * 2.0 / float(textureSize(probeTexture, 0).x);
+	float lod = log2(max(coneWidth / max(texelWidth, 1e-6), 1.0));
+
+	return textureLod(probeTexture, vec4(lookup, float(closest)), lod).rgb;
+}
+#endif
+
+vec3 addReflectionToPixColor(vec3 dir, hitinfo rayHitPoint, inout uint seed)
+{
+	// Gets a vector in the direction of the reflected ray.
+	vec3 reflectedRayToPoint;
+
+	// We're doing another collision test here to get the reflection.
+	// You can see how this starts to get intensive and can slow down your framerate, since every 
+	// one of these intersectTriangles calls tests a ray against every triangle in the scene. 
+	// There are ways to optimize this (spatial partitioning), but ultimately Ray Tracing is not a 
+	// technique for real-time rendering.
+	hitinfo reflectHit;
+	
+	// color that will be added for all reflections
+	vec3 color = vec3(0);
+
+	float throughput = rayHitPoint.reflectivity;
+
+#ifdef FLOOR_TEXTURE
+	float pathLength = distance(eye, rayHitPoint.point);
+#endif
+
+#ifdef REFLECTION_PROBES
+	float travelled = distance(eye, rayHitPoint.point);
+#endif
+
+	for(int i = 0; i < maxBounces; i++)
+	{
+		if (!continuePath(throughput, i, seed))
+			break;
+
+		// Gets a vector in the direction of the reflected ray.
+		reflectedRayToPoint = reflect(dir, rayHitPoint.normal);
+
+#ifdef REFLECTION_PROBES
+		// a reflection that counts for little is read from a probe, with every bounce after it
+		if (probeReflection(i + 1, travelled))
+		{
+			color += sampleProbe(rayHitPoint.point, reflectedRayToPoint, travelled) * throughput;
+			break;
+		}
+#endif
+
+		COUNT_RAY(reflectionRays);
+		COUNT_RAY(reflectionRaysPerBounce[min(i, RAY_STATS_BOUNCES - 1)]);
+
+		// The point it finds is bounce i + 1, which may be on a coarser copy of its mesh
+		rayLod = geometryLod(i + 1);
+		bool hit = intersectTriangles(rayHitPoint.point, reflectedRayToPoint, reflectHit);
+		rayLod = 0;
+
+		// If the reflected vector hits a triangle.
+		// Render the pixel of that triangle
+		if(hit)
+		{
+#ifdef FLOOR_TEXTURE
+			pathLength += distance(rayHitPoint.point, reflectHit.point);
+			applyFloorTexture(reflectHit, reflectedRayToPoint, pathLength * pixelSpread);
+#endif
+
+#ifdef REFLECTION_PROBES
+			travelled += distance(rayHitPoint.point, reflectHit.point);
+#endif
+
+			// This is the lighting that is in the geometry that is reflected off of other geomtry
+			// with the shading LOD of this bounce, and the first reflection is bounce 1
+			color += addAllLightsToPixColor(reflectedRayToPoint, reflectHit, i + 1) * throughput;
+
+			// the next point is seen through this one
+			throughput *= reflectHit.reflectivity;
+
+			dir = reflectedRayToPoint;
+			rayHitPoint = reflectHit;
+		}
+
+		// If we hit nothing
+		// exit the loop
+		else
+		{
+			break;
+		}
+	}
+	
+	// return final color
+	// Skybox can be added to color after calculations
+	return color;
+}
@@ -0,0 +1,167 @@
+/*
+Title: Advanced Ray Tracer
+File Name: Sampling.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is not a shader by itself, it is included by RayTracing.glsl. It
+has the random numbers of the stochastic parts of the renderers (light
+sampling and Russian roulette, and whatever comes after them), picked by
+samplerKind (--sampler):
+
+SAMPLER_WHITE:      randomFloat, a hash of the seed that the caller
+                    keeps. Every number is on its own, so two pixels
+                    next to each other can get the same one, and the
+                    numbers of a pixel over the frames can clump.
+SAMPLER_BLUE_NOISE: the tile of BlueNoise.h, repeated over the image.
+                    The pixels next to each other get numbers that are
+                    far apart, so the noise of a frame is only high
+                    frequencies, which a blur and the eye take out.
+                    Every frame adds the golden ratio to every number,
+                    so a pixel also gets evenly spread numbers over time.
+SAMPLER_SOBOL:      the Sobol sequence over the frames, with the frame
+                    as the index, Owen-scrambled (Burley 2020, "Practical
+                    Hash-based Owen Scrambling"). The first 2^k frames
+                    of a pixel put exactly one number into every 2^-k of
+                    [0, 1), and the scramble is different for every
+                    pixel, so the pixels do not line up.
+
+A random number is for a "dimension", which is one decision of the path
+(see SAMPLE_LIGHTS and SAMPLE_ROULETTE), and for samplePixel, which the
+renderers set before they shade a pixel. Every dimension gets its own
+numbers, so the decisions are not tied to each other: the tile is moved
+by another offset for every dimension, and the Sobol sequence gets its
+own scramble and its own order of the frames (which is the padding of
+Burley 2020, as every decision takes one number). When there is no
+pixel (samplePixel is -1), every kind is randomFloat.
+*/
+
+// Must match main.cpp
+#define SAMPLER_WHITE 0
+#define SAMPLER_BLUE_NOISE 1
+#define SAMPLER_SOBOL 2
+
+// the tile of BlueNoise.h, must match BLUE_NOISE_SIZE there
+#define BLUE_NOISE_SIZE 64
+
+// The dimensions of the decisions of a bounce. The point the eye sees is bounce 0
+#define SAMPLE_LIGHTS(bounce) (2 * (bounce))
+#define SAMPLE_ROULETTE(bounce) (2 * (bounce) + 1)
+
+// The dimension of the time of a path in the shutter of --motion-blur, after the ones of any bounce
+#define SAMPLE_TIME 64
+
+// The location is fixed, like the path uniforms, so that main.cpp sets it the same way for every renderer
+layout(location = 19) uniform int samplerKind;
+
+// the blue noise tile, with the rank of every texel, on texture unit 9
+layout(binding = 9) uniform usampler2D blueNoiseTexture;
+
+// the pixel that is being shaded, -1 if there is none
+ivec2 samplePixel = ivec2(-1);
+
+// A hash of 32 bits that mixes every bit into every other bit (lowbias32)
+uint hashUint(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// A random permutation of the bits of x, where every bit only changes the bits above it (Laine and Karras 2011)
+uint laineKarrasPermutation(uint x, uint seed)
+{
+	x += seed;
+	x ^= x * 0x6C50B47Cu;
+	x ^= x * 0xB82F1E52u;
+	x ^= x * 0xC7AFE638u;
+	x ^= x * 0x8D22F6E6u;
+	return x;
+}
+
+// An Owen scramble of a number with its highest bit first, which keeps the numbers in the same halves, quarters,
+// and so on, as each other
+uint nestedUniformScramble(uint x, uint seed)
+{
+	return bitfieldReverse(laineKarrasPermutation(bitfieldReverse(x), seed));
+}
+
+// 24 bits of x as a number from 0 to 1
+float uintToUnitFloat(uint x)
+{
+	return float(x >> 8) / 16777216.0;
+}
+
+// The number of the tile at the pixel, moved by the golden ratio every frame. Every dimension
+// reads the tile at another place, from the R2 sequence, so they do not get the same numbers
+float blueNoiseSample(int dimension)
+{
+	ivec2 shift = ivec2(fract(float(dimension) * vec2(0.7548776662, 0.5698402910)) * float(BLUE_NOISE_SIZE));
+	uint rank = texelFetch(blueNoiseTexture, (samplePixel + shift) & (BLUE_NOISE_SIZE - 1), 0).r;
+
+	// the middle of the rank, and the golden ratio times the frame, in fixed point, so that it wraps around exactly
+	uint scale = 0xFFFFFFFFu / uint(BLUE_NOISE_SIZE * BLUE_NOISE_SIZE) + 1u;
+	return uintToUnitFloat(rank * scale + scale / 2u + frameSeed * 2654435769u);
+}
+
+// Frame frameSeed of the scrambled Sobol sequence of the pixel, for this dimension. The frames are shuffled with
+// a nested scramble too, which keeps every block of 2^k frames together, so they still cover [0, 1) evenly
+float sobolSample(int dimension)
+{
+	uint seed = hashUint(uint(samplePixel.x) ^ hashUint(uint(samplePixel.y) ^ hashUint(uint(dimension))));
+	uint index = nestedUniformScramble(frameSeed, seed);
+
+	// the first dimension of Sobol is the index with its bits the other way around
+	return uintToUnitFloat(nestedUniformScramble(bitfieldReverse(index), hashUint(seed)));
+}
+
+// A random number from 0 to 1 for this dimension of the path of samplePixel, with samplerKind.
+// seed is only used by SAMPLER_WHITE, which moves it on to the next number
+float sampleFloat(int dimension, inout uint seed)
+{
+	if (samplerKind == SAMPLER_WHITE || samplePixel.x < 0)
+		return randomFloat(seed);
+
+	if (samplerKind == SAMPLER_BLUE_NOISE)
+		return blueNoiseSample(dimension);
+
+	return sobolSample(dimension);
+}
+
+// The time in the shutter of the path of a pixel, for rayTime in RayTracing.glsl (--motion-blur). It only comes from
+// the pixel and the frame, so every stage of Wavefront.glsl finds the same time again, and with blue noise or Sobol
+// the pixels next to each other, and the frames of a pixel, are spread evenly over the shutter
+float pixelTime(ivec2 pixel)
+{
+	if (!motionBlur)
+		return 0.0;
+
+	ivec2 saved = samplePixel;
+	samplePixel = pixel;
+
+	uint seed = hashUint(uint(pixel.x) ^ hashUint(uint(pixel.y) ^ hashUint(frameSeed)));
+	float time = sampleFloat(SAMPLE_TIME, seed);
+
+	samplePixel = saved;
+	return time;
+}
@@ -0,0 +1,425 @@
+/*
+Title: Advanced Ray Tracer
+File Name: SceneStructs.h
+Copyright  2019
+Original authors: Niko Procopi
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The structs that main.cpp and the shaders share, written once.
+main.cpp includes this file as C++, and the shaders include it as GLSL
+(see readShader), so the two can never disagree about where anything is.
+Only the part between #ifdef __cplusplus and #endif is C++, and only
+the part between #ifndef __cplusplus and #endif is GLSL.
+
+The buffers use the std430 layout. In std430 a vec3 is 12 bytes but starts
+on a multiple of 16, so every vec3 here is followed by one 4-byte value,
+which fills the gap, and glm::vec3 followed by 4 bytes is in the same place in C++.
+The static_asserts at the bottom check that.
+*/
+
+#ifndef SCENE_STRUCTS_H
+#define SCENE_STRUCTS_H
+
+#ifdef __cplusplus
+#include <cstddef>
+
+// In C++ the GLSL types are the glm types with the same names
+typedef glm::vec3 vec3;
+typedef glm::mat4 mat4;
+typedef glm::uint uint;
+#endif
+
+// Every triangle is 3 points, a normal, a color, and how reflective it is
+// (how much of the color comes from the reflection, 0 is not reflective at all).
+// This is 48 bytes. It used to be 80, with a vec4 for every one of those:
+// the normal is packed into one uint (octahedral, two 16-bit numbers),
+// and the color and reflectivity are 4 half floats in two uints.
+// The meshes that main.cpp makes and the triangles that Compute.glsl moves into the world are both this.
+// A mesh is not a struct, its triangles are one after the other in a buffer of triangles, and
+// main.cpp says where every mesh starts (see makeMeshOffsets), so a mesh can have any number of them
+struct triangle
+{
+	vec3 a;
+	uint packedNormal;
+	vec3 b;
+	uint packedRedGreen;
+	vec3 c;
+	uint packedBlueReflectivity;
+};
+
+// The triangles of the meshes can also be stored in 32 bytes instead of 48 (--compact-meshes).
+// Every coordinate is a 16-bit number from 0 to 1 across the box of its mesh, so the corners of the box
+// are exact, and the corners that triangles share are the same numbers, so there are no cracks between them.
+// The normal is packed like in triangle, and the color and reflectivity are 8 bits each (RGBA8)
+struct compactTriangle
+{
+	uint packedAxAy;
+	uint packedAzBx;
+	uint packedByBz;
+	uint packedCxCy;
+	uint packedCz;
+	uint packedNormal;
+	uint packedColor;
+	uint junk;
+};
+
+// A triangle of an indexed mesh, which Compute.glsl puts together into a triangle.
+// a, b, and c say which vertices it uses, and the rest is the same as in triangle. 24 bytes
+struct indexedTriangle
+{
+	uint a;
+	uint b;
+	uint c;
+	uint packedNormal;
+	uint packedRedGreen;
+	uint packedBlueReflectivity;
+};
+
+// One entry of the material table of --material-table, 16 bytes. With it, packedRedGreen of a triangle is the
+// index of its material, and packedBlueReflectivity is 0, so a color is stored once for all of the triangles
+// that have it (every triangle of a cube, or of a model of --obj, has the same one), and a compactTriangle
+// keeps the whole material instead of 8 bits of every channel. main.cpp makes the table (see makeMaterialTable)
+#define MATERIAL_BINDING 31
+
+struct material
+{
+	vec3 color;
+	float reflectivity;
+};
+
+// A point light, 32 bytes. It used to be 48, with a vec4 for the position and color
+struct light
+{
+	vec3 pos;
+	float radius;
+	vec3 color;
+	float brightness;
+};
+
+// The counters of --bench and --ray-stats, which FragmentShader.glsl and TiledRender.glsl add to with atomics
+// (see COUNT_RAYS in RayTracing.glsl). Every reflection ray is counted twice: once in reflectionRays, and once
+// in the bounce it was, where the last one also has all of the deeper bounces. lightsCulled is how many times a light
+// was skipped because the point was outside of its radius, which costs no shadow ray. shadowRaysPerBounce are the shadow rays
+// of the points of every bounce, where the point the eye sees is bounce 0, to see what the shading LOD saves.
+// shadowCacheHits are the shadow rays that --shadow-cache did not have to trace, and shadowsUpsampled the ones that
+// the grid of --shadow-scale already knew. 92 bytes
+#define RAY_STATS_BOUNCES 8
+
+struct rayCounts
+{
+	uint shadowRays;
+	uint reflectionRays;
+	uint primaryRays;
+	uint occludedShadows;
+	uint lightsCulled;
+	uint reflectionRaysPerBounce[RAY_STATS_BOUNCES];
+	uint shadowRaysPerBounce[RAY_STATS_BOUNCES];
+	uint shadowCacheHits;
+	uint shadowsUpsampled;
+};
+
+// One view of the camera: where the eye is, and the rays through the four corners of the image. 80 bytes.
+// The camera uniform block (see Camera.glsl) has MAX_VIEWS of these, at uniform buffer binding CAMERA_BINDING.
+// It is std140, but a vec3 followed by a float is in the same place there as in std430
+#define MAX_VIEWS 16
+#define CAMERA_BINDING 0
+
+// The projections of --camera, whose rays are made by CameraRays.glsl into a texture on CAMERA_RAY_UNIT.
+// viewGrid.w of the camera block is 1 when the shaders read their rays from there
+#define CAMERA_PINHOLE 0
+#define CAMERA_FISHEYE 1
+#define CAMERA_EQUIRECT 2
+#define CAMERA_PANORAMIC 3
+#define CAMERA_RAY_UNIT 11
+
+// The uniform buffer binding of the lights, when they are in a uniform block (see LIGHT_UNIFORMS in RayTracing.glsl)
+#define LIGHT_UNIFORM_BINDING 1
+
+struct cameraView
+{
+	vec3 eye;
+	float junk0;
+	vec3 ray00;
+	float junk1;
+	vec3 ray01;
+	float junk2;
+	vec3 ray10;
+	float junk3;
+	vec3 ray11;
+	float junk4;
+};
+
+// The grid of --irradiance-probes: countX by countY by countZ probes, evenly across the box from boxMin to boxMax,
+// at the start of the storage buffer at binding IRRADIANCE_BINDING. After it, every probe has 6 vec4 (its ambient
+// cube, see IrradianceProbes.glsl), probe x + countX * (y + countY * z). 48 bytes
+#define IRRADIANCE_BINDING 37
+
+struct irradianceGrid
+{
+	vec3 boxMin;
+	int countX;
+	vec3 boxMax;
+	int countY;
+	int countZ;
+	int junk0;
+	int junk1;
+	int junk2;
+};
+
+// The hashed grid of --instance-grid (see BuildInstanceGrid.glsl), at the start of the storage buffer at binding
+// INSTANCE_GRID_BINDING. Instances firstInstance to firstInstance + count - 1 are in it. The box is stored with
+// floatToOrderedUint, and maxExtent is the bits of the longest side of an instance box, which is never negative,
+// so both can be found with atomics. After it are the count of every one of the buckets (a power of two), where
+// the list of every bucket starts (buckets + 1), and the lists, one after the other. 48 bytes
+#define INSTANCE_GRID_BINDING 38
+
+// The grid has at most this many cells along each axis, so a grid with a few huge instances does not become as many
+// cells as it has small ones
+#define INSTANCE_GRID_MAX_CELLS 128
+
+struct instanceGrid
+{
+	uint boxMin[3];
+	int firstInstance;
+	uint boxMax[3];
+	int count;
+	uint maxExtent;
+	int buckets;
+	int junk0;
+	int junk1;
+};
+
+// How a mesh moved since the frame before, for --temporal: motion moves a point of the mesh in the world now
+// to where it was in the world then (the old matrix times the inverse of the new one), and first is the first
+// triangle of the mesh, so the fragment shader can find the mesh of a triangle. 80 bytes
+struct meshMotion
+{
+	mat4 motion;
+	int first;
+	int junk0;
+	int junk1;
+	int junk2;
+};
+
+#ifdef __cplusplus
+
+// A normal becomes a point on an octahedron (|x| + |y| + |z| = 1), and the bottom half
+// of the octahedron is folded over the top, so two numbers from -1 to 1 are enough.
+// These are the same as octEncode and octDecode below, in GLSL
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+	n /= fabs(n.x) + fabs(n.y) + fabs(n.z);
+
+	if (n.z >= 0.0f)
+		return glm::vec2(n.x, n.y);
+
+	return glm::vec2(
+		(1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+		(1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+// Undo octEncode. The point is pushed back out of the fold, and made one unit long
+inline glm::vec3 octDecode(glm::vec2 p)
+{
+	glm::vec3 n = glm::vec3(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+	float fold = glm::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -fold : fold;
+	n.y += n.y >= 0.0f ? -fold : fold;
+	return glm::normalize(n);
+}
+
+inline glm::vec3 triangleNormal(const triangle& t)
+{
+	return octDecode(glm::unpackSnorm2x16(t.packedNormal));
+}
+
+inline triangle makeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 normal, glm::vec3 color, float reflectivity)
+{
+	triangle t;
+	t.a = a;
+	t.b = b;
+	t.c = c;
+	t.packedNormal = glm::packSnorm2x16(octEncode(glm::normalize(normal)));
+	t.packedRedGreen = glm::packHalf2x16(glm::vec2(color.r, color.g));
+	t.packedBlueReflectivity = glm::packHalf2x16(glm::vec2(color.b, reflectivity));
+	return t;
+}
+
+// Where a point is in a box, from 0 to 1 on every axis. A box with no size
+// on an axis (like the floor, which is flat) puts every point at 0 there
+inline glm::vec3 pointInBox(glm::vec3 p, glm::vec3 boxMin, glm::vec3 boxSize)
+{
+	glm::vec3 inBox;
+
+	for (int k = 0; k < 3; k++)
+		inBox[k] = boxSize[k] > 0.0f ? glm::clamp((p[k] - boxMin[k]) / boxSize[k], 0.0f, 1.0f) : 0.0f;
+
+	return inBox;
+}
+
+// The same triangle as a compactTriangle, in the box of its mesh. unpackCompactTriangle below undoes this
+inline compactTriangle makeCompactTriangle(const triangle& t, glm::vec3 boxMin, glm::vec3 boxSize, bool materialIndex = false)
+{
+	glm::vec3 a = pointInBox(t.a, boxMin, boxSize);
+	glm::vec3 b = pointInBox(t.b, boxMin, boxSize);
+	glm::vec3 c = pointInBox(t.c, boxMin, boxSize);
+	glm::vec2 redGreen = glm::unpackHalf2x16(t.packedRedGreen);
+	glm::vec2 blueReflectivity = glm::unpackHalf2x16(t.packedBlueReflectivity);
+
+	compactTriangle q;
+	q.packedAxAy = glm::packUnorm2x16(glm::vec2(a.x, a.y));
+	q.packedAzBx = glm::packUnorm2x16(glm::vec2(a.z, b.x));
+	q.packedByBz = glm::packUnorm2x16(glm::vec2(b.y, b.z));
+	q.packedCxCy = glm::packUnorm2x16(glm::vec2(c.x, c.y));
+	q.packedCz = glm::packUnorm2x16(glm::vec2(c.z, 0.0f));
+	q.packedNormal = t.packedNormal;
+	q.packedColor = materialIndex ? t.packedRedGreen : glm::packUnorm4x8(glm::vec4(redGreen, blueReflectivity));
+	q.junk = 0;
+	return q;
+}
+
+// the std430 offsets, which the shaders expect
+static_assert(sizeof(triangle) == 48, "triangle must be 48 bytes");
+static_assert(offsetof(triangle, b) == 16, "triangle.b must start at byte 16");
+static_assert(offsetof(triangle, c) == 32, "triangle.c must start at byte 32");
+static_assert(offsetof(triangle, packedBlueReflectivity) == 44, "triangle must end with packedBlueReflectivity");
+static_assert(sizeof(compactTriangle) == 32, "compactTriangle must be 32 bytes");
+static_assert(sizeof(indexedTriangle) == 24, "indexedTriangle must be 24 bytes");
+static_assert(sizeof(material) == 16, "material must be 16 bytes");
+static_assert(sizeof(light) == 32, "light must be 32 bytes");
+static_assert(offsetof(light, color) == 16, "light.color must start at byte 16");
+static_assert(sizeof(rayCounts) == 28 + 8 * RAY_STATS_BOUNCES, "rayCounts must have no padding");
+static_assert(sizeof(cameraView) == 80, "cameraView must be 80 bytes");
+static_assert(offsetof(cameraView, ray11) == 64, "cameraView.ray11 must start at byte 64");
+static_assert(sizeof(meshMotion) == 80, "meshMotion must be 80 bytes");
+static_assert(sizeof(instanceGrid) == 48, "instanceGrid must be 48 bytes");
+static_assert(sizeof(irradianceGrid) == 48, "irradianceGrid must be 48 bytes");
+
+#endif
+
+#ifndef __cplusplus
+
+vec2 octEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+
+	if (n.z >= 0.0)
+		return n.xy;
+
+	return (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Undo octEncode. The point is pushed back out of the fold, and made one unit long
+vec3 octDecode(vec2 p)
+{
+	vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+	float fold = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -fold : fold;
+	n.y += n.y >= 0.0 ? -fold : fold;
+	return normalize(n);
+}
+
+uint packTriangleNormal(vec3 n)
+{
+	return packSnorm2x16(octEncode(n));
+}
+
+vec3 triangleNormal(triangle t)
+{
+	return octDecode(unpackSnorm2x16(t.packedNormal));
+}
+
+// The side of a cell of the instance grid. It is at least the longest side of any instance box, so an instance box
+// is in at most 2 cells on every axis, and more when that would make more than INSTANCE_GRID_MAX_CELLS cells on one
+float instanceGridCellSize(vec3 boxMin, vec3 boxMax, float maxExtent)
+{
+	vec3 size = boxMax - boxMin;
+	return max(max(maxExtent, max(size.x, max(size.y, size.z)) / float(INSTANCE_GRID_MAX_CELLS)), 0.00001);
+}
+
+// How many cells the instance grid has on every axis
+ivec3 instanceGridCells(vec3 boxMin, vec3 boxMax, float cellSize)
+{
+	return clamp(ivec3(ceil((boxMax - boxMin) / cellSize)), ivec3(1), ivec3(INSTANCE_GRID_MAX_CELLS));
+}
+
+// The bucket of a cell of the instance grid. Cells that are far apart can share a bucket, and then the rays
+// of both test the instances of both
+uint instanceGridBucket(ivec3 cell, int buckets)
+{
+	return (uint(cell.x) * 73856093u ^ uint(cell.y) * 19349663u ^ uint(cell.z) * 83492791u) & uint(buckets - 1);
+}
+
+#ifdef MATERIAL_TABLE
+layout(binding = MATERIAL_BINDING) readonly buffer materialBlock
+{
+	material materials[];
+};
+
+vec3 triangleColor(triangle t)
+{
+	return materials[t.packedRedGreen].color;
+}
+
+float triangleReflectivity(triangle t)
+{
+	return materials[t.packedRedGreen].reflectivity;
+}
+#else
+vec3 triangleColor(triangle t)
+{
+	return vec3(unpackHalf2x16(t.packedRedGreen), unpackHalf2x16(t.packedBlueReflectivity).x);
+}
+
+float triangleReflectivity(triangle t)
+{
+	return unpackHalf2x16(t.packedBlueReflectivity).y;
+}
+#endif
+
+// Undo makeCompactTriangle. The ray tests read the triangle struct, so the color is packed again
+// the way triangle has it, which the compiler can see through
+triangle unpackCompactTriangle(compactTriangle q, vec3 boxMin, vec3 boxSize)
+{
+	vec2 axay = unpackUnorm2x16(q.packedAxAy);
+	vec2 azbx = unpackUnorm2x16(q.packedAzBx);
+	vec2 bybz = unpackUnorm2x16(q.packedByBz);
+	vec2 cxcy = unpackUnorm2x16(q.packedCxCy);
+	float cz = unpackUnorm2x16(q.packedCz).x;
+
+	triangle t;
+	t.a = boxMin + boxSize * vec3(axay, azbx.x);
+	t.b = boxMin + boxSize * vec3(azbx.y, bybz);
+	t.c = boxMin + boxSize * vec3(cxcy, cz);
+	t.packedNormal = q.packedNormal;
+#ifdef MATERIAL_TABLE
+	t.packedRedGreen = q.packedColor;
+	t.packedBlueReflectivity = 0u;
+#else
+	vec4 color = unpackUnorm4x8(q.packedColor);
+	t.packedRedGreen = packHalf2x16(color.rg);
+	t.packedBlueReflectivity = packHalf2x16(color.ba);
+#endif
+	return t;
+}
+
+#endif
+
+#endif
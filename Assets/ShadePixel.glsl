@@ -0,0 +1,152 @@
+/*
+Title: Advanced Ray Tracer
+File Name: ShadePixel.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is not a shader by itself, it is included by FragmentShader.glsl
+and TiledRender.glsl, after RayTracing.glsl. It has the color of the
+point that the eye sees through a pixel: the ambient light, the lights
+(only the ones in the list of the pixel's tile if tiledLights is on, see
+LightCull.glsl), and the reflections. The pixel is passed in, because the
+fragment shader has gl_FragCoord and the compute shader does not.
+*/
+
+// must match LightCull.glsl and main.cpp
+#define TILE_SIZE 16
+#define MASK_WORDS (MAX_LIGHTS / 32)
+
+// If this is true, LightCull.glsl has made a list of the lights that can reach each
+// tile of the screen, and the point that the eye sees only loops over those
+uniform bool tiledLights;
+uniform int tilesX;
+
+// MASK_WORDS uints for every tile, see LightCull.glsl
+layout(binding = 21) buffer tileLightBlock
+{
+	uint tileLightMasks[];
+};
+
+// The same as addAllLightsToPixColor, but only with the lights in the list of this pixel's tile.
+// This only works for the point the eye sees, because reflections can hit things that are not in the tile
+vec3 addTileLightsToPixColor(ivec2 pixel, vec3 dirRayToPoint, hitinfo rayHitPoint)
+{
+	vec3 color = vec3(0);
+
+	ivec2 tile = pixel / TILE_SIZE;
+	int tileIndex = tile.y * tilesX + tile.x;
+
+	// only the words that have lights in them
+	int words = (numLights + 31) / 32;
+
+	for (int w = 0; w < words; w++)
+	{
+		uint bits = tileLightMasks[tileIndex * MASK_WORDS + w];
+
+		// go through the bits that are on, from the lowest to the highest,
+		// which is the same order as addAllLightsToPixColor
+		while (bits != 0u)
+		{
+			int b = findLSB(bits);
+			bits &= bits - 1u;
+
+#ifdef SHADOW_BATCH
+			batchLight(int(w * 32u + b), 1.0, dirRayToPoint, rayHitPoint, 0, color);
+#else
+			color += addLightColorToPixColor(int(w * 32u + b), dirRayToPoint, rayHitPoint);
+#endif
+		}
+	}
+
+#ifdef SHADOW_BATCH
+	flushLightBatch(dirRayToPoint, rayHitPoint, 0, color);
+#endif
+
+	return color;
+}
+
+// Every pixel gets its own random numbers, which are different every frame
+uint pixelSeed(ivec2 pixel)
+{
+	return uint(pixel.x) + uint(pixel.y) * 65536u + frameSeed * 2654435761u;
+}
+
+// Calculate the color of the point that the eye sees through this pixel
+vec4 shade(ivec2 pixel, vec3 dirEyeToTriangle, hitinfo eyeHitTriangle)
+{
+	samplePixel = pixel;
+
+#ifdef FLOOR_TEXTURE
+	applyFloorTexture(eyeHitTriangle, dirEyeToTriangle, distance(eye, eyeHitTriangle.point) * pixelSpread);
+#endif
+
+	// Create a pixColor variable, which will determine the output color of this pixel. Start with some ambient light.
+#ifdef IRRADIANCE_PROBES
+	vec3 pixColor = eyeHitTriangle.color * ambientLight(eyeHitTriangle.point, eyeHitTriangle.normal);
+#else
+	vec3 pixColor = eyeHitTriangle.color * 0.1;
+#endif
+
+	// color of reflected light
+	// This is a combination of the color of the polygon that the eye's ray hit,
+	// and the lighting that effects this point (every light, shadows, specular, etc)
+	// This function returns the geometry color
+	// the tile lists add every light, so light sampling uses addAllLightsToPixColor
+	vec3 lightColor = (tiledLights && lightSamples == 0) ?
+		addTileLightsToPixColor(pixel, dirEyeToTriangle, eyeHitTriangle) :
+		addAllLightsToPixColor(dirEyeToTriangle, eyeHitTriangle);
+	
+	// Level of Reflectivity, which every triangle has its own of:
+	// 0.5 = half and half
+	// 1.0 = perfect mirror, plus the ambient color
+	// 0.0 = no reflection
+	float reflectionLevel = eyeHitTriangle.reflectivity;
+
+	// The light of the point itself is the part of the color that is not reflection
+	pixColor += lightColor * (1.0 - reflectionLevel);
+
+	// color of reflections, which already has the reflectivity of every surface in it.
+	// The number of bounces is maxBounces (2 by default), set by main.cpp.
+	// The reflections are only traced once, no matter how many lights there are.
+	// Surfaces that do not reflect anything do not trace any reflection rays
+	if (reflectionLevel > 0.0)
+	{
+		vec3 reflection;
+
+#ifdef REDUCED_REFLECTIONS
+		// the fragment shader can make the reflection from a smaller image (--reflection-scale)
+		bool upsampled = reducedReflections && upsampleReflection(pixel,
+			distance(eye, eyeHitTriangle.point), eyeHitTriangle.normal, reflection);
+#else
+		bool upsampled = false;
+#endif
+
+		if (!upsampled)
+		{
+			uint seed = pixelSeed(pixel);
+			reflection = addReflectionToPixColor(dirEyeToTriangle, eyeHitTriangle, seed);
+		}
+
+		pixColor += reflection;
+	}
+	
+	// Return the final pixel color.		
+	return vec4(pixColor.rgb, 1.0);
+}
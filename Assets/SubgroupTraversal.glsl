@@ -0,0 +1,201 @@
+/*
+Title: Advanced Ray Tracer
+File Name: SubgroupTraversal.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is not a shader by itself, it is included by Wavefront.glsl, after
+RayTracing.glsl. It walks the BVH from BuildBVH.glsl, like
+intersectSceneBVH, but the threads of a subgroup walk it together.
+
+The GPU runs the threads of a subgroup (32 or 64 of them, a "warp" or a
+"wavefront") in lock step. In intersectSceneBVH every thread has its own
+stack, so when two threads next to each other want different nodes, the
+subgroup has to do both, one after the other, while half of the threads
+wait. Eye rays and shadow rays from pixels next to each other go almost
+the same way, so here the subgroup has one stack, which all of its
+threads share:
+
+- The node at the top of the stack is the same for every thread, so it
+  is read once for the whole subgroup.
+- Every thread tests its own ray against the two children, and the
+  subgroup votes: a child is pushed if any thread's ray hits it.
+- If both children are pushed, every thread votes for the one that it
+  hits first, and the one with the most votes is visited first.
+- The node numbers on the stack are shared, but every thread keeps its
+  own distance to each box, so it can skip boxes that it missed, or that
+  are farther than the closest triangle it already found.
+
+The threads of a subgroup have to reach the votes together, so the
+threads without a ray still walk along (hasRay is false), they just do
+not test anything. Shadow rays stop when every thread found something.
+
+The votes come from GL_KHR_shader_subgroup, which the shader that includes
+this file has to ask for right after #version. If the driver only has the
+older GL_ARB_shader_group_vote and GL_ARB_shader_ballot (with
+GL_ARB_gpu_shader_int64 for the 64 bit ballot), those are used instead. With neither, every vote is just the thread's own answer, and
+every thread walks the BVH on its own again, the same as intersectSceneBVH.
+*/
+
+#if defined(GL_KHR_shader_subgroup_vote) && defined(GL_KHR_shader_subgroup_ballot)
+	#define SUBGROUP_KHR
+	#define subgroupVoteAny(x) subgroupAny(x)
+	#define subgroupVoteAll(x) subgroupAll(x)
+#elif defined(GL_ARB_shader_group_vote) && defined(GL_ARB_shader_ballot) && defined(GL_ARB_gpu_shader_int64)
+	#define SUBGROUP_ARB
+	#define subgroupVoteAny(x) anyInvocationARB(x)
+	#define subgroupVoteAll(x) allInvocationsARB(x)
+#else
+	#define subgroupVoteAny(x) (x)
+	#define subgroupVoteAll(x) (x)
+#endif
+
+// how many threads of the subgroup voted yes
+int subgroupVoteCount(bool vote)
+{
+#if defined(SUBGROUP_KHR)
+	return int(subgroupBallotBitCount(subgroupBallot(vote)));
+#elif defined(SUBGROUP_ARB)
+	uvec2 bits = unpackUint2x32(ballotARB(vote));
+	return bitCount(bits.x) + bitCount(bits.y);
+#else
+	return vote ? 1 : 0;
+#endif
+}
+
+// The same as intersectSceneBVH, but the threads of the subgroup share one stack.
+// Every thread of the subgroup has to call this at the same time, the ones with no ray
+// have hasRay set to false. If anyHit is true, info is not finished (see occluded)
+bool intersectSceneBVHSubgroup(vec3 origin, vec3 dir, float tmax, bool anyHit, bool hasRay, out hitinfo info)
+{
+	float smallest = tmax;
+	bool found = false;
+
+	// a thread is done when it has no ray, or when it is a shadow ray that found something
+	bool done = !hasRay;
+
+	vec3 safeDir = mix(dir, vec3(0.0000001), equal(dir, vec3(0.0)));
+	vec3 invDir = 1.0 / safeDir;
+
+	// The node numbers are the same in every thread. The distances are not,
+	// -1.0 means that this thread's ray missed the box of that node
+	int stack[BVH_STACK_SIZE];
+	float stackDist[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	float tRoot = done ? -1.0 : rayIntersectsBox(origin, invDir, nodes[0].min, nodes[0].max, smallest);
+
+	if (subgroupVoteAny(tRoot >= 0.0))
+	{
+		stack[stackSize] = 0;
+		stackDist[stackSize] = tRoot;
+		stackSize++;
+	}
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+		int n = stack[stackSize];
+
+		// This thread only tests what is inside the box if its ray hit the box,
+		// closer than the closest triangle it found so far
+		bool visit = !done && stackDist[stackSize] >= 0.0 && stackDist[stackSize] <= smallest;
+
+		if (nodes[n].left < 0)
+		{
+			int first = ~nodes[n].left;
+
+			for (int i = first; i < first + nodes[n].right && visit; i++)
+			{
+				float t = testTriangle(origin, dir, smallest, i);
+
+				if (t != -1.0 && t < smallest)
+				{
+					smallest = t;
+
+					info.index = i;
+
+					found = true;
+
+					// this shadow ray is done, but it keeps walking with the others
+					if (anyHit)
+						done = true;
+				}
+			}
+
+			// the shadow rays of the whole subgroup found something
+			if (anyHit && subgroupVoteAll(done))
+				break;
+
+			continue;
+		}
+
+		int left = nodes[n].left;
+		int right = nodes[n].right;
+
+		float tLeft = visit ? rayIntersectsBox(origin, invDir, nodes[left].min, nodes[left].max, smallest) : -1.0;
+		float tRight = visit ? rayIntersectsBox(origin, invDir, nodes[right].min, nodes[right].max, smallest) : -1.0;
+
+		bool hitLeft = tLeft >= 0.0;
+		bool hitRight = tRight >= 0.0;
+
+		// a child is visited if any ray of the subgroup hits its box
+		bool anyLeft = subgroupVoteAny(hitLeft);
+		bool anyRight = subgroupVoteAny(hitRight);
+
+		if (anyLeft && anyRight)
+		{
+			// Every thread that hit one of the boxes votes for the one it hits first.
+			// The child that most of them want is pushed last, so it is visited first
+			bool wantsLeft = hitLeft && (!hitRight || tLeft <= tRight);
+			bool voted = hitLeft || hitRight;
+			bool leftFirst = subgroupVoteCount(wantsLeft) * 2 >= subgroupVoteCount(voted);
+
+			int near = leftFirst ? left : right;
+			int far = leftFirst ? right : left;
+
+			stack[stackSize] = far;
+			stackDist[stackSize] = leftFirst ? tRight : tLeft;
+			stackSize++;
+
+			stack[stackSize] = near;
+			stackDist[stackSize] = leftFirst ? tLeft : tRight;
+			stackSize++;
+		}
+		else if (anyLeft)
+		{
+			stack[stackSize] = left;
+			stackDist[stackSize] = tLeft;
+			stackSize++;
+		}
+		else if (anyRight)
+		{
+			stack[stackSize] = right;
+			stackDist[stackSize] = tRight;
+			stackSize++;
+		}
+	}
+
+	// a shadow ray only needs to know that it hit
+	if (found && !anyHit)
+		finishHit(origin, dir, smallest, info);
+
+	return found;
+}
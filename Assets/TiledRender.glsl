@@ -0,0 +1,575 @@
+/*
+Title: Advanced Ray Tracer
+File Name: TiledRender.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This renders the same image as FragmentShader.glsl, but with a compute
+shader instead of a full screen quad. Every workgroup is one tile of
+8 x 8 pixels, and every thread is one pixel. The color is written into
+an image with imageStore, and main.cpp copies that image to the screen.
+
+In the fragment shader, every pixel reads every triangle it tests from
+the triangle buffer in global memory, so the same triangle is read once
+for every pixel on the screen. Here, the 64 threads of a workgroup first
+copy 64 triangles into shared memory (one triangle each), wait for each
+other with barrier(), and then every thread tests its eye ray against
+all of them, from shared memory. Then they load the next 64, until every
+triangle was tested. Each triangle is read from global memory once per
+workgroup, instead of once per pixel.
+
+The triangles are copied as the records that Compute.glsl made (see
+makeTriangleRecord), which is the smallest form that has everything the ray
+test needs. Only the Baldwin-Weber record has no room for the normal, so
+then the normals are copied too.
+All of the threads have to reach barrier(), so threads whose pixel is
+outside of the image still help to load, they just do not write a color.
+
+Only the eye rays use the shared memory. Reflections and shadow rays go
+in every direction, so they use the acceleration structure that main.cpp
+picked, like the fragment shader does. The eye rays test every triangle,
+like ACCEL_BRUTE_FORCE, so this is meant for small and medium scenes.
+With binned (--bin-triangles), TriangleBin.glsl has made a list of the
+triangles that can be seen in every tile, and the eye rays of a tile only
+test those, which makes this work for bigger scenes too.
+
+With variableRate (--foveated and --importance-map), a tile does not have
+to trace every pixel. Its rate is 1, 2, 4, or 8, and it only traces the
+pixels where x and y are both a multiple of the rate (every pixel, every
+4th, every 16th, or 1 of the 64). The tiles in the middle of the image (or
+that are bright in the importance map) trace all of them, and the farther
+a tile is from there, the fewer it traces. Then it runs a second time, with
+fillPass, and every pixel that was not traced gets its color from the 4
+traced pixels around it, like a texture that is stretched. Those can be in
+the tiles next to it, so there are no seams between the tiles.
+
+With persistent (--persistent-threads), only enough workgroups to fill the
+GPU are started, and each one takes the next tile from nextTile with an
+atomicAdd, renders it, and takes another, until every tile is taken. A
+workgroup that got tiles of sky is soon back for more, while one that got
+a tile of deep reflections is still tracing, so the GPU is not left with a
+few slow tiles at the end of the dispatch. A workgroup takes whole tiles,
+because its threads share the triangles and have to reach the same barrier().
+With costOrder (--cost-order), the queue does not hand out the tiles in
+rows, but in tileOrder, which main.cpp sorts by what every tile cost in an
+earlier frame, the most first. Every pixel counts its work like the
+heatmap of --cost-view, and the workgroup adds it to the cost of its tile.
+The tiles of deep reflections then start first, and the sky fills in the
+gaps at the end, instead of the other way around.
+
+With tileFrustum (--tile-frustum, and the BVH of --accel bvh), the eye rays
+of a tile are all inside the frustum of 4 planes from the eye through the
+edges of the tile. The workgroup walks the BVH once for the whole tile:
+thread 0 tests every node against the frustum, skips the ones that are
+outside of it with everything under them, and puts the triangles of the
+leaves that are left into the batches, which every ray then tests like
+above. So a node is tested once per tile instead of once per pixel, and a
+tile only loads the triangles of the part of the scene that it can see.
+With binned, it is only used by the tiles whose list did not fit.
+
+With pixelOrder PIXEL_ORDER_MORTON (--pixel-order morton), the threads of
+a workgroup take the pixels of the tile along the Z curve instead of in
+rows, so a subgroup of 16 is a 4x4 square instead of 2 rows of 8, and its
+rays start closer together and walk more of the same nodes. The tiles are
+also taken in blocks of TILE_BLOCK x TILE_BLOCK along the Z curve, so the
+workgroups that run at the same time render a square part of the image
+instead of a long row, and find more of the same nodes and triangles in
+the cache. The blocks at the right and top edges are only partly inside of
+the image, and the workgroups of their tiles that are outside do nothing.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// one tile of pixels, must match TILED_RENDER_GROUP_SIZE in main.cpp
+#define GROUP_SIZE 8
+#define GROUP_THREADS (GROUP_SIZE * GROUP_SIZE)
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE, local_size_z = 1) in;
+
+// the same camera as FragmentShader.glsl, view 0 of the camera block
+#include "Camera.glsl"
+
+// the image that the colors are written into, which fillPass also reads
+layout(binding = 0, rgba32f) uniform image2D outputImage;
+
+// How much of every tile is traced. The importance of a tile is from the importance map if there is one, and if not,
+// it is 1 up to foveaRadius from foveaCenter (as a part of the height of the image) and drops to 0 at 3 times that
+uniform bool variableRate;
+uniform bool fillPass;
+uniform vec2 foveaCenter;
+uniform float foveaRadius;
+uniform bool importanceMapped;
+layout(binding = 7) uniform sampler2D importanceMap;
+
+// The queue of the tiles of --persistent-threads, which main.cpp sets to 0 before every frame.
+// The tiles are taken in rows, from the bottom left, like the workgroups of a normal dispatch.
+// With costOrder, tileCosts has the order of the tiles for the queue, and then what every tile costs in this frame,
+// in half triangle tests, which main.cpp sets to 0 and reads back to sort the tiles of a later frame
+uniform bool persistent;
+uniform bool costOrder;
+layout(binding = 15) buffer tileQueueBlock
+{
+	uint nextTile;
+	uint tileCosts[];
+};
+shared uint takenTile;
+
+// The order of the pixels of a tile, and of the tiles, must match PIXEL_ORDER_ROWS, PIXEL_ORDER_MORTON, and TILE_BLOCK_SIZE in main.cpp.
+// With PIXEL_ORDER_MORTON, main.cpp starts TILE_BLOCK * TILE_BLOCK workgroups across for every block of tiles
+#define PIXEL_ORDER_ROWS 0
+#define PIXEL_ORDER_MORTON 1
+#define TILE_BLOCK 8
+uniform int pixelOrder;
+
+// The lists of triangles of the tiles, see TriangleBin.glsl. A tile whose list did not fit has BIN_OVERFLOW,
+// and then it tests every triangle, like without bins
+#define BIN_OVERFLOW 0xFFFFFFFFu
+uniform bool binned;
+layout(binding = 30) buffer triangleBinBlock
+{
+	uint binData[];
+};
+
+// --bench and --ray-stats count the rays of this renderer
+#define COUNT_RAYS
+
+// --cost-order counts the work of every pixel, like the heatmap of --cost-view
+#define COUNT_PIXEL_COST
+
+// The scene, the acceleration structures, and the lighting
+#include "RayTracing.glsl"
+
+// the same lighting as FragmentShader.glsl
+#include "ShadePixel.glsl"
+
+// one batch of triangles, as records
+shared vec4 batchRecord0[GROUP_THREADS];
+shared vec4 batchRecord1[GROUP_THREADS];
+shared vec4 batchRecord2[GROUP_THREADS];
+
+#ifndef TRIANGLE_RECORD_HAS_NORMAL
+shared vec3 batchNormal[GROUP_THREADS];
+#endif
+
+// the index of every triangle of the batch, which is not first + j when it comes from a list
+shared int batchIndex[GROUP_THREADS];
+
+// The walk of tileFrustum, which only thread 0 does: the nodes that are still to be tested, the triangles
+// of the leaf that is being put into the batches (leafNext to leafEnd - 1), and how many are in this batch.
+// Like the stack of intersectSceneBVH, it only has to be as deep as the BVH
+uniform bool tileFrustum;
+shared int tileStack[BVH_STACK_SIZE];
+shared int tileStackSize;
+shared int leafNext;
+shared int leafEnd;
+shared int batchCount;
+
+// Every how many pixels the tile traces one, across and up
+int tileRate(ivec2 tile, ivec2 size)
+{
+	if (!variableRate)
+		return 1;
+
+	vec2 center = (vec2(tile * GROUP_SIZE) + 0.5 * float(GROUP_SIZE)) / vec2(size);
+	float importance;
+
+	if (importanceMapped)
+	{
+		importance = textureLod(importanceMap, center, 0.0).r;
+	}
+	else
+	{
+		// the distance is in heights of the image, so the fovea is round on any screen
+		float d = length((center - foveaCenter) * vec2(float(size.x) / float(size.y), 1.0));
+		importance = 1.0 - clamp((d - foveaRadius) / (2.0 * foveaRadius), 0.0, 1.0);
+	}
+
+	return importance >= 0.75 ? 1 : importance >= 0.5 ? 2 : importance >= 0.25 ? 4 : 8;
+}
+
+// True if this pixel is one that its tile traces
+bool tracedPixel(ivec2 pixel, ivec2 size)
+{
+	int rate = tileRate(pixel / GROUP_SIZE, size);
+	return pixel.x % rate == 0 && pixel.y % rate == 0;
+}
+
+// The second pass of variableRate: a pixel that was not traced mixes the traced pixels at the corners of the
+// square of its rate, by how close it is to each of them. The rates are powers of 2, so a corner in a tile with
+// a higher rate (a smaller one is always traced) may not be traced, and then it is left out
+void fillPixel(ivec2 pixel, ivec2 size)
+{
+	int rate = tileRate(pixel / GROUP_SIZE, size);
+	ivec2 base = (pixel / rate) * rate;
+
+	if (base == pixel)
+		return;
+
+	vec2 f = vec2(pixel - base) / float(rate);
+	vec4 sum = vec4(0);
+	float weights = 0.0;
+
+	for (int y = 0; y <= 1; y++)
+	{
+		for (int x = 0; x <= 1; x++)
+		{
+			ivec2 q = min(base + ivec2(x, y) * rate, size - 1);
+
+			if (!tracedPixel(q, size))
+				continue;
+
+			// base is always traced, and always has some weight, so weights is never 0
+			float w = (x == 1 ? f.x : 1.0 - f.x) * (y == 1 ? f.y : 1.0 - f.y);
+			sum += imageLoad(outputImage, q) * w;
+			weights += w;
+		}
+	}
+
+	imageStore(outputImage, pixel, sum / weights);
+}
+
+// The ray through a place on the image, from 0 to 1, not normalized
+vec3 imageRay(vec2 pos)
+{
+	return mix(mix(ray00, ray01, pos.y), mix(ray10, ray11, pos.y), pos.x);
+}
+
+// The 4 planes through the eye and the edges of the tile, with their normals pointing into it.
+// The edges are the edges of its pixels, so the rays through their centers are all inside
+void tileFrustumPlanes(ivec2 tile, ivec2 size, out vec3 planes[4])
+{
+	vec2 low = vec2(tile * GROUP_SIZE) / vec2(size);
+	vec2 high = vec2(min((tile + 1) * GROUP_SIZE, size)) / vec2(size);
+
+	vec3 corners[4];
+	corners[0] = imageRay(low);
+	corners[1] = imageRay(vec2(high.x, low.y));
+	corners[2] = imageRay(high);
+	corners[3] = imageRay(vec2(low.x, high.y));
+
+	vec3 center = corners[0] + corners[1] + corners[2] + corners[3];
+
+	for (int i = 0; i < 4; i++)
+	{
+		vec3 n = cross(corners[i], corners[(i + 1) % 4]);
+		planes[i] = dot(n, center) < 0.0 ? -n : n;
+	}
+}
+
+// False if the box is all on the outside of one of the planes. For every plane, only the corner
+// of the box that is the farthest in along its normal has to be tested
+bool boxInFrustum(vec3 boxMin, vec3 boxMax, vec3 planes[4])
+{
+	for (int i = 0; i < 4; i++)
+	{
+		vec3 inner = mix(boxMin, boxMax, step(vec3(0.0), planes[i]));
+
+		if (dot(planes[i], inner - eye) < 0.0)
+			return false;
+	}
+
+	return true;
+}
+
+// Thread 0 of tileFrustum: go on with the walk of the BVH until the batch has GROUP_THREADS triangles
+// or there are no more nodes, and put their indexes into batchIndex
+void fillFrustumBatch(vec3 planes[4])
+{
+	batchCount = 0;
+
+	while (batchCount < GROUP_THREADS)
+	{
+		// the rest of the leaf that did not fit into the last batch
+		if (leafNext < leafEnd)
+		{
+			batchIndex[batchCount] = leafNext;
+			batchCount++;
+			leafNext++;
+			continue;
+		}
+
+		if (tileStackSize == 0)
+			return;
+
+		tileStackSize--;
+		int n = tileStack[tileStackSize];
+
+		if (!boxInFrustum(nodes[n].min, nodes[n].max, planes))
+			continue;
+
+		if (nodes[n].left < 0)
+		{
+			leafNext = ~nodes[n].left;
+			leafEnd = leafNext + nodes[n].right;
+			continue;
+		}
+
+		tileStack[tileStackSize] = nodes[n].left;
+		tileStack[tileStackSize + 1] = nodes[n].right;
+		tileStackSize += 2;
+	}
+}
+
+// x and y of the point that is index along the Z curve: the even bits of index are x, and the odd bits are y
+ivec2 mortonToPoint(uint index)
+{
+	uvec2 p = uvec2(index, index >> 1u) & 0x55555555u;
+	p = (p | (p >> 1u)) & 0x33333333u;
+	p = (p | (p >> 2u)) & 0x0F0F0F0Fu;
+	p = (p | (p >> 4u)) & 0x00FF00FFu;
+	p = (p | (p >> 8u)) & 0x0000FFFFu;
+	return ivec2(p);
+}
+
+// The tile of the index'th workgroup with PIXEL_ORDER_MORTON: the blocks are in rows, and the tiles of a block are along
+// the Z curve. It can be outside of the image, in the blocks at the edges
+ivec2 mortonTile(int index, int blocksAcross)
+{
+	int block = index / (TILE_BLOCK * TILE_BLOCK);
+	ivec2 blockCorner = ivec2(block % blocksAcross, block / blocksAcross) * TILE_BLOCK;
+	return blockCorner + mortonToPoint(uint(index % (TILE_BLOCK * TILE_BLOCK)));
+}
+
+// Add the work of this thread to the cost of the tile that is the index'th in the queue, and start counting again
+// for the next one. A triangle test is 2, and a node visit 1, like COST_VIEW_ALL
+void addTileCost(int index, int numTiles)
+{
+	uint cost = uint(costTriangleTests * 2 + costNodeVisits);
+
+	if (cost > 0u)
+		atomicAdd(tileCosts[numTiles + index], cost);
+
+	costTriangleTests = 0;
+	costNodeVisits = 0;
+	costShadowRays = 0;
+}
+
+// Render one tile, with every thread of the workgroup
+void renderTile(ivec2 tile, ivec2 size)
+{
+	// GROUP_SIZE is a power of 2, so the Z curve fills the tile
+	ivec2 lane = (pixelOrder == PIXEL_ORDER_MORTON) ? mortonToPoint(gl_LocalInvocationIndex) : ivec2(gl_LocalInvocationID.xy);
+	ivec2 pixel = tile * GROUP_SIZE + lane;
+	bool inside = pixel.x < size.x && pixel.y < size.y;
+
+	// the threads whose pixels are not traced still load triangles for the others
+	bool traced = tracedPixel(pixel, size);
+
+	// The same ray as main() in FragmentShader.glsl, through the center of the pixel
+	vec2 pos = (vec2(pixel) + vec2(0.5)) / vec2(size);
+	vec3 dir = normalize(imageRay(pos));
+
+	float smallest = MAX_SCENE_BOUNDS;
+	int closest = -1;
+
+	// the triangles that the eye rays test, all of them, or the list of the tile
+	int listStart = 0;
+	int listCount = numTriangles;
+
+	if (binned)
+	{
+		int binTile = tile.y * ((size.x + GROUP_SIZE - 1) / GROUP_SIZE) + tile.x;
+		uint count = binData[binTile * 2];
+
+		if (count != BIN_OVERFLOW)
+		{
+			listStart = int(binData[binTile * 2 + 1] - count);
+			listCount = int(count);
+		}
+	}
+
+	bool fromList = listCount != numTriangles || listStart != 0;
+
+	// the walk of the BVH starts at the root
+	bool frustum = tileFrustum && !fromList;
+	vec3 planes[4];
+
+	if (frustum && gl_LocalInvocationIndex == 0u)
+	{
+		tileFrustumPlanes(tile, size, planes);
+		tileStack[0] = 0;
+		tileStackSize = 1;
+		leafNext = 0;
+		leafEnd = 0;
+	}
+
+	for (int first = 0; frustum || first < listCount; first += GROUP_THREADS)
+	{
+		int batchSize = min(GROUP_THREADS, listCount - first);
+
+		// Thread 0 finds the triangles of the batch. batchCount is the same for every thread,
+		// so they all stop together once the walk has found no more
+		if (frustum)
+		{
+			if (gl_LocalInvocationIndex == 0u)
+				fillFrustumBatch(planes);
+
+			memoryBarrierShared();
+			barrier();
+			batchSize = batchCount;
+
+			if (batchSize == 0)
+				break;
+		}
+
+		// every thread loads one triangle of the batch
+		int slot = first + int(gl_LocalInvocationIndex);
+
+		if (int(gl_LocalInvocationIndex) < batchSize)
+		{
+			int load = frustum ? batchIndex[gl_LocalInvocationIndex] : fromList ? int(binData[listStart + slot]) : slot;
+
+			batchRecord0[gl_LocalInvocationIndex] = triangleRecord(0, load);
+			batchRecord1[gl_LocalInvocationIndex] = triangleRecord(1, load);
+			batchRecord2[gl_LocalInvocationIndex] = triangleRecord(2, load);
+			batchIndex[gl_LocalInvocationIndex] = load;
+
+#ifndef TRIANGLE_RECORD_HAS_NORMAL
+			batchNormal[gl_LocalInvocationIndex] = triangleNormal(triangles[load]);
+#endif
+		}
+
+		// wait until the whole batch is in shared memory
+		barrier();
+
+		int count = traced ? batchSize : 0;
+
+		for (int j = 0; j < count; j++)
+		{
+			vec4 r0 = batchRecord0[j];
+			vec4 r1 = batchRecord1[j];
+			vec4 r2 = batchRecord2[j];
+
+#ifdef TRIANGLE_RECORD_HAS_NORMAL
+			vec3 normal = vec3(r0.w, r1.w, r2.w);
+#else
+			vec3 normal = batchNormal[j];
+#endif
+
+			// skip triangles that face away from the ray, like testTriangle does
+			if (dot(normal, dir) > 0)
+				continue;
+
+			float t = intersectTriangleRecord(eye, dir, smallest, r0, r1, r2);
+
+			// A list is in no order, so of two triangles at the same distance, the one with the smaller index
+			// is kept, which is the one that the loop over all of them in order finds first
+			if (t != -1.0 && (t < smallest || (t == smallest && batchIndex[j] < closest)))
+			{
+				smallest = t;
+				closest = batchIndex[j];
+			}
+		}
+
+		// wait until every thread is done with this batch, before it is replaced
+		barrier();
+		costTriangleTests += count;
+	}
+
+	if (!inside || !traced)
+		return;
+
+	COUNT_RAY(primaryRays);
+
+	// If the ray doesn't hit any triangles, then this ray sees nothing
+	vec4 color = vec4(vec3(0), 1.0);
+
+	if (closest != -1)
+	{
+		hitinfo eyeHitTriangle;
+		eyeHitTriangle.point = eye + dir * smallest;
+		eyeHitTriangle.index = closest;
+		eyeHitTriangle.normal = triangleNormal(triangles[closest]);
+		eyeHitTriangle.color = triangleColor(triangles[closest]);
+		eyeHitTriangle.reflectivity = triangleReflectivity(triangles[closest]);
+
+		color = shade(pixel, dir, eyeHitTriangle);
+	}
+
+	imageStore(outputImage, pixel, color);
+}
+
+void main(void)
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(outputImage);
+
+	// The whole dispatch is one pass or the other, so no thread skips a barrier() that the others wait at.
+	// This pass only reads traced pixels and only writes the others, so it can read and write the same image
+	if (fillPass)
+	{
+		if (pixel.x < size.x && pixel.y < size.y)
+			fillPixel(pixel, size);
+
+		return;
+	}
+
+	int tilesAcross = (size.x + GROUP_SIZE - 1) / GROUP_SIZE;
+	int tilesDown = (size.y + GROUP_SIZE - 1) / GROUP_SIZE;
+	int blocksAcross = (tilesAcross + TILE_BLOCK - 1) / TILE_BLOCK;
+	bool morton = pixelOrder == PIXEL_ORDER_MORTON;
+
+	if (!persistent)
+	{
+		// every row of workgroups is one row of blocks
+		ivec2 tile = morton ? mortonTile(int(gl_WorkGroupID.y) * blocksAcross * TILE_BLOCK * TILE_BLOCK + int(gl_WorkGroupID.x), blocksAcross)
+			: ivec2(gl_WorkGroupID.xy);
+
+		// the same for every thread of the workgroup, so none of them waits at a barrier()
+		if (tile.x < tilesAcross && tile.y < tilesDown)
+			renderTile(tile, size);
+
+		return;
+	}
+
+	// the queue counts the tiles of whole blocks too
+	int numTiles = morton ? blocksAcross * ((tilesDown + TILE_BLOCK - 1) / TILE_BLOCK) * TILE_BLOCK * TILE_BLOCK
+		: tilesAcross * tilesDown;
+
+	while (true)
+	{
+		// one thread takes the tile for the whole workgroup
+		if (gl_LocalInvocationIndex == 0u)
+			takenTile = atomicAdd(nextTile, 1u);
+
+		memoryBarrierShared();
+		barrier();
+		int taken = int(takenTile);
+
+		// every thread has read it before the next one is taken
+		barrier();
+
+		// the same for every thread, so they all stop together
+		if (taken >= numTiles)
+			return;
+
+		int tile = costOrder ? int(tileCosts[taken]) : taken;
+		ivec2 tilePos = morton ? mortonTile(tile, blocksAcross) : ivec2(tile % tilesAcross, tile / tilesAcross);
+
+		if (tilePos.x < tilesAcross && tilePos.y < tilesDown)
+		{
+			renderTile(tilePos, size);
+
+			if (costOrder)
+				addTileCost(tile, numTiles);
+		}
+	}
+}
@@ -0,0 +1,122 @@
+/*
+Title: Advanced Ray Tracer
+File Name: TriangleBench.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is only used by --bench-tri-kernels in main.cpp, which compiles it
+once for every test in TriangleKernels.glsl, and measures how long it
+takes on the GPU. It does nothing but ray-triangle tests: every thread
+is the eye ray of one pixel, and it tests that ray against every
+triangle, "repeats" times, keeping the closest one like a real trace
+would (so that the tmax of the tests gets smaller).
+
+Every workgroup makes the records of the triangles into shared memory
+first, so the time is the time of the tests, not of reading the
+triangles or making the records. The number of hits is added up in
+hitCount, which main.cpp prints, so that the tests can be compared with
+each other, and so that the compiler can not throw the tests away.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+#include "TriangleKernels.glsl"
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// The records are in shared memory, which needs a size that the compiler knows,
+// so main.cpp adds the number of triangles in the scene here (see addShaderDefines)
+#ifndef NUM_TRIANGLES
+#define NUM_TRIANGLES 14
+#endif
+
+// the same camera as FragmentShader.glsl, view 0 of the camera block
+#include "Camera.glsl"
+
+uniform int imageWidth;
+uniform int imageHeight;
+
+// how many times every ray tests every triangle
+uniform int repeats;
+
+// the same triangle struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+// Only the start of the vertex buffer, the records are made again below
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[NUM_TRIANGLES];
+};
+
+layout(binding = 22) buffer benchBlock
+{
+	uint hitCount;
+};
+
+shared vec4 record0[NUM_TRIANGLES];
+shared vec4 record1[NUM_TRIANGLES];
+shared vec4 record2[NUM_TRIANGLES];
+
+void main()
+{
+	uint local = gl_LocalInvocationIndex;
+
+	if (local < uint(NUM_TRIANGLES))
+		makeTriangleRecord(triangles[local].a, triangles[local].b, triangles[local].c, triangleNormal(triangles[local]),
+			record0[local], record1[local], record2[local]);
+
+	barrier();
+
+	int i = int(gl_GlobalInvocationID.x);
+
+	if (i >= imageWidth * imageHeight)
+		return;
+
+	// the same ray as STAGE_GENERATE in Wavefront.glsl
+	vec2 pos = (vec2(i % imageWidth, i / imageWidth) + vec2(0.5)) / vec2(imageWidth, imageHeight);
+	vec3 dir = normalize(mix(mix(ray00, ray01, pos.y), mix(ray10, ray11, pos.y), pos.x));
+
+	uint hits = 0u;
+
+	for (int r = 0; r < repeats; r++)
+	{
+		// A little farther every time, so that the compiler can not
+		// do the loop once and use the same answer for every repeat
+		float smallest = 100.0 + float(r);
+		bool found = false;
+
+		for (int j = 0; j < NUM_TRIANGLES; j++)
+		{
+			float t = intersectTriangleRecord(eye, dir, smallest, record0[j], record1[j], record2[j]);
+
+			if (t != -1.0)
+			{
+				smallest = t;
+				found = true;
+			}
+		}
+
+		if (found)
+			hits++;
+	}
+
+	atomicAdd(hitCount, hits);
+}
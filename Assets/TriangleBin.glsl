@@ -0,0 +1,216 @@
+/*
+Title: Advanced Ray Tracer
+File Name: TriangleBin.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The triangle bins of --bin-triangles, for the eye rays of TiledRender.glsl.
+Every eye ray starts at the eye, so it can only hit a triangle that covers
+its pixel on the screen. This projects every triangle that Compute.glsl
+moved into the world with viewProj (the same matrix as the visibility
+buffer, see calcCameraRays in main.cpp), and puts its index into the list
+of every tile of TILE_SIZE x TILE_SIZE pixels that its box on the screen
+touches. The eye rays of a tile then only test the triangles of its list.
+The box is a pixel bigger on every side, and a triangle that reaches
+behind the eye is put into every tile, so a list never misses a triangle
+that a ray of the tile hits, and the hits are the same as without bins.
+
+The lists are made in three passes, picked with the "pass" uniform:
+
+PASS_COUNT: every thread is a triangle, and adds 1 to the count of every
+            tile that it touches
+PASS_SCAN:  one workgroup adds the counts up, so every tile knows where its
+            list starts in binData. A tile whose list does not fit in the
+            capacity gets BIN_OVERFLOW, and its rays test every triangle
+PASS_FILL:  every triangle writes its index into the lists of its tiles.
+            The start of a list moves to its end while it is filled, so
+            the list of a tile is from binData[2t + 1] - count to there
+
+binData has 2 uints for every tile (the count and the end of the list),
+and then the lists. The order in a list is whatever order the atomics
+happened in, so TiledRender.glsl picks the smaller index when two
+triangles are hit at the same distance, like the loop over all of them.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// must match TILED_RENDER_GROUP_SIZE in main.cpp and GROUP_SIZE in TiledRender.glsl
+#define TILE_SIZE 8
+
+// must match TRIANGLE_BIN_OVERFLOW in main.cpp
+#define BIN_OVERFLOW 0xFFFFFFFFu
+
+#define PASS_COUNT 0
+#define PASS_SCAN 1
+#define PASS_FILL 2
+
+// the same triangle struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+layout(binding = 30) buffer triangleBinBlock
+{
+	uint binData[];
+};
+
+uniform int pass;
+uniform int numTriangles;
+uniform mat4 viewProj;
+uniform int imageWidth;
+uniform int imageHeight;
+uniform int tilesX;
+uniform int tilesY;
+
+// how many triangle indexes fit after the counts
+uniform uint capacity;
+
+shared uint partialSums[64];
+
+// The tiles that triangle t can be seen in, as the first and last tile across and up.
+// Returns false if no eye ray can hit it: it is all behind the eye, or off the screen
+bool triangleTiles(int t, out ivec2 first, out ivec2 last)
+{
+	vec4 clip[3];
+	clip[0] = viewProj * vec4(triangles[t].a, 1.0);
+	clip[1] = viewProj * vec4(triangles[t].b, 1.0);
+	clip[2] = viewProj * vec4(triangles[t].c, 1.0);
+
+	int behind = 0;
+	vec2 low = vec2(1e30);
+	vec2 high = vec2(-1e30);
+
+	for (int k = 0; k < 3; k++)
+	{
+		if (clip[k].w <= 0.0)
+		{
+			behind++;
+			continue;
+		}
+
+		vec2 pixel = (clip[k].xy / clip[k].w * 0.5 + 0.5) * vec2(imageWidth, imageHeight);
+		low = min(low, pixel);
+		high = max(high, pixel);
+	}
+
+	// every ray goes forward from the eye
+	if (behind == 3)
+		return false;
+
+	// a triangle that reaches behind the eye can cover any part of the screen
+	if (behind > 0)
+	{
+		first = ivec2(0);
+		last = ivec2(tilesX - 1, tilesY - 1);
+		return true;
+	}
+
+	if (high.x < 0.0 || high.y < 0.0 || low.x > float(imageWidth) || low.y > float(imageHeight))
+		return false;
+
+	// A pixel more on every side, for the rays through the centers of the pixels at its edges.
+	// A corner close to the plane of the eye can be far off the screen, so it is clamped before it is made an int
+	vec2 size = vec2(imageWidth, imageHeight);
+	first = min(ivec2(clamp(low - 1.0, vec2(0.0), size)) / TILE_SIZE, ivec2(tilesX - 1, tilesY - 1));
+	last = min(ivec2(clamp(high + 1.0, vec2(0.0), size)) / TILE_SIZE, ivec2(tilesX - 1, tilesY - 1));
+	return true;
+}
+
+void main()
+{
+	int numTiles = tilesX * tilesY;
+
+	if (pass == PASS_SCAN)
+	{
+		// every thread adds up one run of the tiles, then the runs are added up in shared memory
+		uint lid = gl_LocalInvocationID.x;
+		int run = (numTiles + 63) / 64;
+		int begin = min(int(lid) * run, numTiles);
+		int end = min(begin + run, numTiles);
+
+		uint sum = 0u;
+		for (int tile = begin; tile < end; tile++)
+			sum += binData[tile * 2];
+
+		partialSums[lid] = sum;
+		barrier();
+
+		// one thread is enough for 64 sums
+		if (lid == 0u)
+		{
+			uint total = 0u;
+
+			for (int k = 0; k < 64; k++)
+			{
+				uint s = partialSums[k];
+				partialSums[k] = total;
+				total += s;
+			}
+		}
+
+		barrier();
+
+		// The end of every list starts at its start, and PASS_FILL moves it on
+		uint start = partialSums[lid];
+
+		for (int tile = begin; tile < end; tile++)
+		{
+			uint count = binData[tile * 2];
+
+			binData[tile * 2 + 1] = uint(numTiles * 2) + start;
+
+			if (start + count > capacity)
+				binData[tile * 2] = BIN_OVERFLOW;
+
+			start += count;
+		}
+
+		return;
+	}
+
+	int t = int(gl_GlobalInvocationID.x);
+
+	if (t >= numTriangles)
+		return;
+
+	ivec2 first, last;
+
+	if (!triangleTiles(t, first, last))
+		return;
+
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+		{
+			int tile = y * tilesX + x;
+
+			if (pass == PASS_COUNT)
+				atomicAdd(binData[tile * 2], 1u);
+			else if (binData[tile * 2] != BIN_OVERFLOW)
+				binData[atomicAdd(binData[tile * 2 + 1], 1u)] = uint(t);
+		}
+	}
+}
@@ -0,0 +1,267 @@
+/*
+Title: Advanced Ray Tracer
+File Name: TriangleKernels.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is not a shader by itself. It has the ray-triangle tests, and is
+included by every shader that tests rays against triangles, and by
+Compute.glsl, which makes the records that the tests read.
+
+There are three, and main.cpp picks one of them when it compiles the
+shaders, by putting "#define TRIANGLE_KERNEL n" right after #version
+(see specializeShader). Only the test that was picked is compiled, so
+choosing one does not cost anything while the rays are traced.
+
+Every test reads a triangle as a "record" of three vec4s, which
+makeTriangleRecord makes from the three points of the triangle. What is
+in the record depends on the test:
+
+TRIANGLE_KERNEL_MOLLER_TRUMBORE:
+  The test from the first version of this tutorial, by Moller and
+  Trumbore. The record is the first point and the two edges from it.
+TRIANGLE_KERNEL_BALDWIN_WEBER:
+  Baldwin and Weber move the ray into a space where the triangle is the
+  triangle (0, 0), (1, 0), (0, 1). The record is the 3 x 4 matrix that
+  does that. Making it needs a few divisions, but once it is made, the
+  test is a few dot products, and t is found first.
+TRIANGLE_KERNEL_WATERTIGHT:
+  The watertight test by Woop, Benthin, and Wald. The points of the
+  triangle are moved so that the ray goes straight down one axis, and
+  then the test is done in 2D. It never lets a ray slip through the
+  edge between two triangles, which the other two can do, because of
+  their epsilons. The record is the three points.
+
+For Moller-Trumbore and the watertight test, the w of the three vec4s is
+the normal of the triangle. The matrix of Baldwin-Weber fills all 12
+floats, so then TRIANGLE_RECORD_HAS_NORMAL is not defined, and the normal
+has to be read from somewhere else.
+
+Every test gets tmax, the closest triangle that was found so far, and
+returns -1.0 for triangles that are not closer, so that it can stop as
+early as it can. Baldwin-Weber stops before it works out where in the
+triangle the ray hits.
+*/
+
+#define TRIANGLE_KERNEL_MOLLER_TRUMBORE 0
+#define TRIANGLE_KERNEL_BALDWIN_WEBER 1
+#define TRIANGLE_KERNEL_WATERTIGHT 2
+
+#ifndef TRIANGLE_KERNEL
+#define TRIANGLE_KERNEL TRIANGLE_KERNEL_MOLLER_TRUMBORE
+#endif
+
+#if TRIANGLE_KERNEL != TRIANGLE_KERNEL_BALDWIN_WEBER
+#define TRIANGLE_RECORD_HAS_NORMAL
+#endif
+
+// Make the record of the triangle with points v0, v1, and v2, for the test that was picked
+void makeTriangleRecord(vec3 v0, vec3 v1, vec3 v2, vec3 normal, out vec4 r0, out vec4 r1, out vec4 r2)
+{
+	// Get two edges of triangle
+	vec3 e1 = vec3(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
+	vec3 e2 = vec3(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z);
+
+#if TRIANGLE_KERNEL == TRIANGLE_KERNEL_BALDWIN_WEBER
+	// The matrix is made for the axis that the triangle faces the most,
+	// so that it never has to divide by a small number
+	vec3 n = cross(e1, e2);
+	vec3 an = abs(n);
+
+	if (an.x > an.y && an.x > an.z)
+	{
+		r0 = vec4(0.0, e2.z, -e2.y, cross(v2, v0).x) / n.x;
+		r1 = vec4(0.0, -e1.z, e1.y, -cross(v1, v0).x) / n.x;
+		r2 = vec4(n.x, n.y, n.z, -dot(v0, n)) / n.x;
+	}
+	else if (an.y > an.z)
+	{
+		r0 = vec4(-e2.z, 0.0, e2.x, cross(v2, v0).y) / n.y;
+		r1 = vec4(e1.z, 0.0, -e1.x, -cross(v1, v0).y) / n.y;
+		r2 = vec4(n.x, n.y, n.z, -dot(v0, n)) / n.y;
+	}
+	else
+	{
+		r0 = vec4(e2.y, -e2.x, 0.0, cross(v2, v0).z) / n.z;
+		r1 = vec4(-e1.y, e1.x, 0.0, -cross(v1, v0).z) / n.z;
+		r2 = vec4(n.x, n.y, n.z, -dot(v0, n)) / n.z;
+	}
+#elif TRIANGLE_KERNEL == TRIANGLE_KERNEL_WATERTIGHT
+	r0 = vec4(v0, normal.x);
+	r1 = vec4(v1, normal.y);
+	r2 = vec4(v2, normal.z);
+#else
+	r0 = vec4(v0, normal.x);
+	r1 = vec4(e1, normal.y);
+	r2 = vec4(e2, normal.z);
+#endif
+}
+
+// Determines whether or not a ray in a given direction hits a given triangle.
+// Returns -1.0 if it does not, or if it hits it at tmax or farther; otherwise returns the value t
+// at which the ray hits the triangle, which can be used to determine the point of collision.
+// p is point on ray, d is ray direction, r0, r1, and r2 are the record from makeTriangleRecord
+float intersectTriangleRecord(vec3 p, vec3 d, float tmax, vec4 r0, vec4 r1, vec4 r2)
+{
+#if TRIANGLE_KERNEL == TRIANGLE_KERNEL_BALDWIN_WEBER
+	// The third row of the matrix is the plane of the triangle,
+	// so it says where the ray crosses that plane
+	float tDist = dot(r2.xyz, p) + r2.w;
+	float tDir = dot(r2.xyz, d);
+
+	// the ray is parallel to the triangle
+	if (tDir == 0.0)
+		return -1.0;
+
+	float t = -tDist / tDir;
+
+	// Behind the ray, or not closer than what was already found.
+	// Written this way around, so that a NaN is a miss too
+	if (!(t > 0.00001 && t < tmax))
+		return -1.0;
+
+	// The first two rows give where in the triangle the point is
+	vec3 hit = p + t * d;
+	float u = dot(r0.xyz, hit) + r0.w;
+
+	if (u < 0.0 || u > 1.0)
+		return -1.0;
+
+	float v = dot(r1.xyz, hit) + r1.w;
+
+	if (v < 0.0 || u + v > 1.0)
+		return -1.0;
+
+	return t;
+#elif TRIANGLE_KERNEL == TRIANGLE_KERNEL_WATERTIGHT
+	// kz is the axis that the ray goes along the most, and kx and ky are the other two.
+	// Swapping kx and ky when the ray goes backwards keeps the winding of the triangle the same
+	vec3 ad = abs(d);
+	int kz = (ad.x > ad.y) ? (ad.x > ad.z ? 0 : 2) : (ad.y > ad.z ? 1 : 2);
+	int kx = (kz + 1) % 3;
+	int ky = (kx + 1) % 3;
+
+	if (d[kz] < 0.0)
+	{
+		int swap = kx;
+		kx = ky;
+		ky = swap;
+	}
+
+	// the shear that makes the ray go straight along kz
+	float sx = d[kx] / d[kz];
+	float sy = d[ky] / d[kz];
+	float sz = 1.0 / d[kz];
+
+	// the points of the triangle, relative to the start of the ray
+	vec3 a = r0.xyz - p;
+	vec3 b = r1.xyz - p;
+	vec3 c = r2.xyz - p;
+
+	// sheared into the 2D space of the ray
+	float ax = a[kx] - sx * a[kz];
+	float ay = a[ky] - sy * a[kz];
+	float bx = b[kx] - sx * b[kz];
+	float by = b[ky] - sy * b[kz];
+	float cx = c[kx] - sx * c[kz];
+	float cy = c[ky] - sy * c[kz];
+
+	// Which side of each edge the ray is on. The ray is inside if it is on the same side of all three.
+	// A ray right on an edge gets a 0, which counts as inside for both triangles of the edge
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+
+	if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0))
+		return -1.0;
+
+	float det = u + v + w;
+
+	if (det == 0.0)
+		return -1.0;
+
+	// how far along the ray, without dividing yet
+	float tScaled = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+	float t = tScaled / det;
+
+	if (t <= 0.00001 || t >= tmax)
+		return -1.0;
+
+	return t;
+#else
+	vec3 v0 = r0.xyz;
+	vec3 e1 = r1.xyz;
+	vec3 e2 = r2.xyz;
+
+	vec3 h,s,q;
+	float a,f,u,v, t;
+
+	// Cross ray direction with triangle edge
+	h = cross(d, e2);
+	
+	// Dot the other triangle edge with the above cross product
+	a = dot(e1, h);
+
+	// If a is zero or realy close to zero, then there's no collision.
+	if (a > -0.00001 && a < 0.00001)
+	{
+		return -1.0;
+	}
+
+	// Take the inverse of a.
+	f = 1/a;
+	
+	// Get vector from first triangle vertex toward cameraPos (or in the scope of this function, the vec3 p that is a point on the ray direction)
+	s = vec3(p.x - v0.x, p.y - v0.y, p.z - v0.z);
+	
+	// Dot your s value with your h value from earlier (cross(d, e2)), then multiply by the inverse of a.
+	u = f * dot(s, h);
+
+	// If this value is not between 0 and 1, then there's no collision.
+	if (u < 0.0 || u > 1.0)
+	{
+		return -1.0;
+	}
+
+	// Cross your s value with edge 1 (e1).
+	q = cross(s, e1);
+
+	// At this stage we can compute t to find out where the intersection point is on the line.
+	// If it is not between the start of the ray and tmax, there is no need to finish the test
+	t = f * dot(e2, q);
+
+	if (t <= 0.00001 || t >= tmax)
+	{
+		return -1.0;
+	}
+
+	// Dot the ray direction with this new q value, and then multiply by the inverse of a.
+	v = f * dot(d, q);
+
+	// If v is less than 0, or u + v are greater than 1, then there's no collision.
+	if (v < 0.0 || u + v > 1.0)
+	{
+		return -1.0;
+	}
+
+	// The ray does intersect the triangle, and we return the t value.
+	return t;
+#endif
+}
@@ -0,0 +1,60 @@
+/*
+Title: Advanced Ray Tracer
+File Name: VisibilityFragment.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A visibility buffer is an image that stores, for every pixel, which
+triangle the eye sees there. The closest triangle is found by the depth
+buffer, just like in any rasterized game, which is much cheaper than
+tracing a camera ray through the whole scene.
+
+FragmentShader.glsl then reads the triangle of its pixel, finds the
+exact point with one ray-triangle test, and only traces the rays that
+really need ray tracing: shadows and reflections.
+*/
+
+#version 430
+
+// the same triangle struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+uniform vec3 eye;
+
+flat in int triangleIndex;
+in vec3 worldPos;
+
+// the triangle index, in an integer texture
+out int visibility;
+
+void main(void)
+{
+	// The ray tracer skips triangles that face away from the ray,
+	// so the rasterizer does too, with the same test
+	if (dot(triangleNormal(triangles[triangleIndex]), worldPos - eye) > 0.0)
+		discard;
+
+	visibility = triangleIndex;
+}
@@ -0,0 +1,61 @@
+/*
+Title: Advanced Ray Tracer
+File Name: VisibilityVertex.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The first half of the visibility buffer (see VisibilityFragment.glsl).
+This draws the triangles that Compute.glsl moved into the world, with
+normal rasterization, instead of tracing a ray through every pixel to
+find the closest triangle. The triangles are read straight out of the
+triangle buffer, 3 vertices per triangle, so no vertex buffer is needed.
+
+viewProj is made by calcCameraRays in main.cpp, from the same corner
+rays that FragmentShader.glsl uses, so every pixel sees the same triangle
+that its camera ray would hit.
+*/
+
+#version 430
+
+// the same triangle struct as main.cpp and RayTracing.glsl
+#include "SceneStructs.h"
+
+layout(binding = 0) buffer vertexBlock
+{
+	triangle triangles[];
+};
+
+uniform mat4 viewProj;
+
+// which triangle this is, and where the vertex is in the world
+flat out int triangleIndex;
+out vec3 worldPos;
+
+void main(void)
+{
+	int t = gl_VertexID / 3;
+	int corner = gl_VertexID % 3;
+
+	vec3 p = corner == 0 ? triangles[t].a : (corner == 1 ? triangles[t].b : triangles[t].c);
+
+	triangleIndex = t;
+	worldPos = p;
+	gl_Position = viewProj * vec4(p, 1.0);
+}
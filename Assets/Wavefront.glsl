@@ -0,0 +1,574 @@
+/*
+Title: Advanced Ray Tracer
+File Name: Wavefront.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+This is another way to render the same image as FragmentShader.glsl.
+In the fragment shader, one thread does everything for its pixel: it
+finds what the eye ray hits, traces a shadow ray to every light, then
+follows the reflections and does it all again. The threads next to each
+other quickly end up doing different things (one is tracing a shadow
+ray, its neighbor is already done), which wastes a lot of the GPU.
+
+A "wavefront" renderer splits that work into small stages, and runs each
+stage for every ray at once, one compute dispatch per stage. Between the
+stages, the rays wait in queues (SSBOs). Rays that hit nothing are not
+put into the next queue, so every stage only runs threads that have
+real work to do. The stages are picked with the "stage" uniform:
+
+STAGE_GENERATE: Make one eye ray per pixel
+STAGE_EXTEND:   Find the closest triangle that every ray hits. Rays that
+                hit something go into the hit queue, the others stop.
+STAGE_SHADE:    For every hit, and every light that reaches it, put a
+                shadow ray into the shadow queue, with the light it would
+                add. If the ray can still bounce, put its reflection into
+                the next ray queue.
+STAGE_SHADOW:   For every shadow ray, if nothing is in the way, add its
+                light to the pixel.
+
+STAGE_SORT_KEYS: Give every ray in the ray queue a sort key, for
+                RadixSort.glsl. See below.
+STAGE_ARGS:     Write how many workgroups EXTEND, SHADE, and SHADOW need
+                for the rays that are really in their queues. See below.
+
+main.cpp runs GENERATE once, then EXTEND, SHADE, and SHADOW once per
+bounce. WavefrontResolve.glsl then adds up the light of every pixel, and
+draws it to the screen.
+
+Many threads can add light to the same pixel at the same time (one
+shadow ray for every light), so the colors are added with atomicAdd.
+There is no atomicAdd for floats in GLSL 4.30, so every pixel color is
+kept as three uints in fixed point: the color times COLOR_SCALE.
+
+The shadow queue has room for SHADOW_RAYS_PER_PIXEL rays per pixel. If a
+hit point is reached by more lights than that (there can be hundreds of
+lights), the shadow rays that do not fit are traced right away in SHADE.
+
+The eye rays all start at the eye and go through pixels next to each
+other, so threads next to each other walk through the same BVH nodes.
+The reflections do not: after one bounce, two rays next to each other in
+the queue can start on different cubes and go in opposite directions.
+If sortRays is on, main.cpp runs STAGE_SORT_KEYS before EXTEND (except
+for the eye rays), which gives every ray a key made of the octant of its
+direction (which way it goes in x, y, and z), then a Morton code of its
+origin. RadixSort.glsl sorts the keys, and EXTEND then takes its rays in
+the sorted order, so threads next to each other start near each other
+and go the same way.
+
+Only the GPU knows how many rays are in each queue. Reading the counts
+back would make the CPU wait for every stage, so instead main.cpp runs
+STAGE_ARGS (one thread) before EXTEND, SHADE, and SHADOW, which writes
+a DispatchIndirectCommand for each of them next to the counts, and
+main.cpp starts those stages with glDispatchComputeIndirect. Later
+bounces have fewer rays (the rays that hit nothing stop), so their
+dispatches are smaller too.
+
+Every ray that goes on (a hit in EXTEND, a reflection in SHADE) takes
+its place in the next queue with an atomicAdd on the count, so the rays
+that stopped leave no holes, but the rays of a workgroup land in the
+queue in whatever order the atomics happen, mixed with the rays of the
+other workgroups. With compactQueues (--wave-compact), the threads of a
+workgroup first find their places with a prefix sum in shared memory
+(see compactedSlot), and one thread adds the total to the count for all
+of them. That is one atomic per workgroup instead of one per ray, and
+the rays that go on stay in the order they had, so the neighbors of the
+eye rays are still neighbors in the next stage.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+// The votes of SubgroupTraversal.glsl. These have to come before everything else,
+// and "enable" (instead of "require") means that the shader still compiles without them
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_vote : enable
+#extension GL_KHR_shader_subgroup_ballot : enable
+#extension GL_ARB_shader_group_vote : enable
+#extension GL_ARB_shader_ballot : enable
+#extension GL_ARB_gpu_shader_int64 : enable
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// The same camera as FragmentShader.glsl, view 0 of the camera block
+#include "Camera.glsl"
+
+// The scene, the acceleration structures, and the lighting functions
+#include "RayTracing.glsl"
+
+// the BVH walk where the threads of a subgroup share one stack
+#include "SubgroupTraversal.glsl"
+
+// If this is true, EXTEND and SHADOW walk the BVH from BuildBVH.glsl with intersectSceneBVHSubgroup.
+// It is only for ACCEL_BVH, every other acceleration structure is walked like before
+uniform bool subgroupTraversal;
+
+#define STAGE_GENERATE 0
+#define STAGE_EXTEND 1
+#define STAGE_SHADE 2
+#define STAGE_SHADOW 3
+#define STAGE_SORT_KEYS 4
+#define STAGE_ARGS 5
+
+// Colors are stored as uints, in steps of 1/65536
+#define COLOR_SCALE 65536.0
+
+// must match WAVE_SHADOW_RAYS_PER_PIXEL in main.cpp
+#define SHADOW_RAYS_PER_PIXEL 4
+
+uniform int stage;
+
+// which bounce we are on, 0 is the eye ray
+uniform int bounce;
+
+// The ray queue is split in two halves, and every bounce reads from one half
+// and writes the reflections into the other half. These say where each half starts
+uniform int rayInOffset;
+uniform int rayOutOffset;
+
+// the size of the image
+uniform int imageWidth;
+uniform int imageHeight;
+
+// If this is true, EXTEND reads its rays in the order of sortKeys.
+// The Morton codes of the ray origins are made inside this box
+uniform bool sortRays;
+uniform vec3 sortBoundsMin;
+uniform vec3 sortBoundsMax;
+
+// the prefix sum of the rays that go on, see compactedSlot
+uniform bool compactQueues;
+
+struct WaveRay
+{
+	vec3 origin;
+	int pixel;
+	vec3 dir;
+	float throughput;
+};
+
+struct WaveHit
+{
+	vec3 point;
+	int pixel;
+	vec3 normal;
+	float throughput;
+	vec3 color;
+	float reflectivity;
+	vec3 dir;
+	float junk3;
+};
+
+// light is what gets added to the pixel, if nothing is in the way
+struct WaveShadowRay
+{
+	vec3 origin;
+	int pixel;
+	vec3 dir;
+	float tmax;
+	vec3 light;
+	float junk;
+};
+
+layout(binding = 16) buffer rayQueueBlock
+{
+	WaveRay rays[];
+};
+
+layout(binding = 17) buffer hitQueueBlock
+{
+	WaveHit hits[];
+};
+
+layout(binding = 18) buffer shadowQueueBlock
+{
+	WaveShadowRay shadowRays[];
+};
+
+// How many rays are in each queue. rayCount[0] and rayCount[1]
+// are the two halves of the ray queue. main.cpp resets these between stages.
+// After them are the DispatchIndirectCommands (x, y, and z workgroups, and one uint
+// that is not used) of EXTEND, SHADE, and SHADOW, which STAGE_ARGS writes
+layout(binding = 19) buffer queueCountBlock
+{
+	uint rayCount[2];
+	uint hitCount;
+	uint shadowCount;
+	uvec4 dispatchArgs[3];
+};
+
+// x is the sort key of a ray, y is where the ray is in its half of the ray queue.
+// STAGE_SORT_KEYS writes these, and RadixSort.glsl sorts them
+layout(binding = 8) buffer sortKeyBlock
+{
+	uvec2 sortKeys[];
+};
+
+// 4 uints for every pixel: red, green, and blue times COLOR_SCALE, and one that is not used.
+// WavefrontResolve.glsl turns them back into a color
+layout(binding = 20) buffer pixelColorBlock
+{
+	uint pixelColors[];
+};
+
+// The queues that compactedSlot adds to
+#define QUEUE_HITS 0
+#define QUEUE_NEXT_RAYS 1
+
+// What each thread of the workgroup adds to the queue, and then the prefix sum of it
+shared uint compactCounts[64];
+shared uint compactBase;
+
+// The place in the queue of a ray that goes on. Every thread of the workgroup has to call this, also the ones
+// whose ray stopped, because of the barriers. Without compactQueues it is one atomicAdd for every ray
+uint compactedSlot(bool append, int queue)
+{
+	if (!compactQueues)
+	{
+		if (!append)
+			return 0u;
+
+		return queue == QUEUE_HITS ? atomicAdd(hitCount, 1u) : atomicAdd(rayCount[(bounce + 1) % 2], 1u);
+	}
+
+	uint id = gl_LocalInvocationIndex;
+	compactCounts[id] = append ? 1u : 0u;
+	barrier();
+
+	// After step s, every count is the sum of the 2s counts up to it (Hillis and Steele).
+	// Every thread reads before any of them writes, so no sum is read after it was changed
+	for (uint step = 1u; step < 64u; step *= 2u)
+	{
+		uint add = id >= step ? compactCounts[id - step] : 0u;
+		barrier();
+		compactCounts[id] += add;
+		barrier();
+	}
+
+	// the last sum is the total of the workgroup, which takes that many places at once
+	if (id == 63u && compactCounts[63] > 0u)
+		compactBase = queue == QUEUE_HITS ? atomicAdd(hitCount, compactCounts[63]) : atomicAdd(rayCount[(bounce + 1) % 2], compactCounts[63]);
+
+	barrier();
+
+	// the sums include the thread itself
+	return compactBase + compactCounts[id] - 1u;
+}
+
+// Add a color to a pixel. Any number of threads can do this at the same time
+void addPixelColor(int pixel, vec3 color)
+{
+	uvec3 fixedColor = uvec3(color * COLOR_SCALE + 0.5);
+
+	atomicAdd(pixelColors[pixel * 4 + 0], fixedColor.r);
+	atomicAdd(pixelColors[pixel * 4 + 1], fixedColor.g);
+	atomicAdd(pixelColors[pixel * 4 + 2], fixedColor.b);
+}
+
+// Spread the lower 10 bits of v out, so that there are
+// two zeros between every bit: 0000abcd -> 00a00b00c00d
+// This is the same as BuildBVH.glsl
+uint expandBits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// The sort key of a ray. The top 3 bits are the octant of the direction,
+// and the 27 bits below are a Morton code of the origin (9 bits for each axis).
+// Rays with the same octant all go the same way in x, y, and z
+uint raySortKey(WaveRay ray)
+{
+	uint octant = (ray.dir.x < 0.0 ? 4u : 0u) + (ray.dir.y < 0.0 ? 2u : 0u) + (ray.dir.z < 0.0 ? 1u : 0u);
+
+	vec3 p = (ray.origin - sortBoundsMin) / (sortBoundsMax - sortBoundsMin);
+	p = clamp(p * 512.0, vec3(0.0), vec3(511.0));
+	uint morton = expandBits(uint(p.x)) * 4u + expandBits(uint(p.y)) * 2u + expandBits(uint(p.z));
+
+	return (octant << 27) | morton;
+}
+
+// SHADE for one hit: its ambient light, its shadow rays, and the light of the lights that need none.
+// Returns true if the path goes on, with the reflection in next
+bool shadeHit(WaveHit hit, out WaveRay next)
+{
+	hitinfo info;
+	info.point = hit.point;
+	info.index = 0;
+	info.normal = hit.normal;
+	info.color = hit.color;
+	info.reflectivity = hit.reflectivity;
+
+	// the random numbers of --sampler are the ones of the pixel of the path, and so is the time of --motion-blur
+	samplePixel = ivec2(hit.pixel % imageWidth, hit.pixel / imageWidth);
+	rayTime = pixelTime(samplePixel);
+
+	// How much of the pixel color this point is. The point the eye sees gives the part of
+	// the color that is not reflection, and every reflection gives the throughput of its ray
+	float weight = (bounce == 0) ? (1.0 - hit.reflectivity) : hit.throughput;
+
+	// the ambient light, only for the point the eye sees
+	if (bounce == 0)
+	{
+#ifdef IRRADIANCE_PROBES
+		addPixelColor(hit.pixel, hit.color * ambientLight(hit.point, hit.normal));
+#else
+		addPixelColor(hit.pixel, hit.color * 0.1);
+#endif
+	}
+
+	uint shadowCapacity = uint(imageWidth * imageHeight * SHADOW_RAYS_PER_PIXEL);
+
+	// the lights that can reach this point, from the light grid
+	uint first, count;
+	lightsNear(hit.point, first, count);
+
+	// the same shading LOD as addAllLightsToPixColor, where the point the eye sees is bounce 0
+	bool specular = lodSpecular(bounce);
+	bool topLights = lodTopLights(bounce);
+	int chosen[LOD_MAX_LIGHTS];
+	float scale[LOD_MAX_LIGHTS];
+	bool sampled = false;
+
+	if (topLights)
+		count = uint(brightestLights(hit.dir, info, first, count, specular, chosen));
+	else if (lightSamples > 0)
+	{
+		// and the same light samples
+		uint lightSeed = lightSampleSeed(hit.point, bounce);
+		int found = sampleLights(hit.dir, info, first, count, specular, bounce, lightSeed, chosen, scale);
+
+		if (found >= 0)
+		{
+			count = uint(found);
+			sampled = true;
+		}
+	}
+
+	for (uint k = 0u; k < count; k++)
+	{
+		int j = (topLights || sampled) ? chosen[k] : nearLight(first, k);
+
+		vec3 light = lightContribution(lights[j], hit.dir, info, specular) * weight;
+
+		if (sampled)
+			light *= scale[k];
+
+		// the light does not reach this point, so there is no need for a shadow ray
+		if (light == vec3(0.0))
+			continue;
+
+		if (!lodShadows(bounce))
+		{
+			addPixelColor(hit.pixel, light);
+			continue;
+		}
+
+		// the same shadow ray as addLightColorToPixColor
+		vec3 pointToLight = lights[j].pos - hit.point;
+		vec3 dir = -normalize(pointToLight);
+		float tmax = length(pointToLight) - 0.1;
+
+		uint s = atomicAdd(shadowCount, 1u);
+
+		// the queue is full, so test this one now
+		if (s >= shadowCapacity)
+		{
+			if (!occluded(lights[j].pos, dir, tmax))
+				addPixelColor(hit.pixel, light);
+
+			continue;
+		}
+
+		shadowRays[s].origin = lights[j].pos;
+		shadowRays[s].pixel = hit.pixel;
+		shadowRays[s].dir = dir;
+		shadowRays[s].tmax = tmax;
+		shadowRays[s].light = light;
+	}
+
+	// The reflection is the ray for the next bounce, if the path keeps going.
+	// The eye ray has a throughput of 1, but its reflection only adds the reflectivity
+	// of the first point, just like addReflectionToPixColor
+	float throughput = (bounce == 0) ? hit.reflectivity : hit.throughput * hit.reflectivity;
+	uint seed = uint(hit.pixel) * 9781u + uint(bounce) * 6271u + frameSeed * 2654435761u;
+
+	if (bounce < maxBounces && continuePath(throughput, bounce, seed))
+	{
+		next.origin = hit.point;
+		next.pixel = hit.pixel;
+		next.dir = reflect(hit.dir, hit.normal);
+		next.throughput = throughput;
+		return true;
+	}
+
+	return false;
+}
+
+void main()
+{
+	int i = int(gl_GlobalInvocationID.x);
+
+	// every ray of a stage is on the same bounce, and so are its shadow rays (--lod-geometry)
+	rayLod = geometryLod(bounce);
+
+	if (stage == STAGE_GENERATE)
+	{
+		if (i >= imageWidth * imageHeight)
+			return;
+
+		// The same ray as main() in FragmentShader.glsl, through the center of the pixel.
+		// textureCoord is (0, 0) at the bottom left pixel, and so is pixel 0
+		vec2 pos = (vec2(i % imageWidth, i / imageWidth) + vec2(0.5)) / vec2(imageWidth, imageHeight);
+
+		rays[rayOutOffset + i].origin = eye;
+		rays[rayOutOffset + i].pixel = i;
+		vec3 dir;
+		viewRay(pos, dir);
+		rays[rayOutOffset + i].dir = dir;
+		rays[rayOutOffset + i].throughput = 1.0;
+
+		// every pixel starts black
+		for (int c = 0; c < 4; c++)
+			pixelColors[i * 4 + c] = 0u;
+	}
+
+	else if (stage == STAGE_EXTEND)
+	{
+		bool hasRay = i < int(rayCount[bounce % 2]);
+
+		// Every thread of the subgroup has to walk the BVH together,
+		// so the threads without a ray only stop after that.
+		// With compactQueues, every thread of the workgroup takes part in the prefix sum too
+		if (!hasRay && !(subgroupTraversal && accel == ACCEL_BVH) && !compactQueues)
+			return;
+
+		WaveRay ray;
+		ray.origin = vec3(0.0);
+		ray.dir = vec3(0.0);
+
+		// after the sort, thread i takes the i-th ray in sorted order
+		if (hasRay)
+		{
+			ray = rays[rayInOffset + (sortRays ? int(sortKeys[i].y) : i)];
+			rayTime = pixelTime(ivec2(ray.pixel % imageWidth, ray.pixel / imageWidth));
+		}
+
+		hitinfo info;
+		bool hit = false;
+
+		if (subgroupTraversal && accel == ACCEL_BVH)
+			hit = intersectSceneBVHSubgroup(ray.origin, ray.dir, MAX_SCENE_BOUNDS, false, hasRay, info);
+		else if (hasRay)
+			hit = intersectTriangles(ray.origin, ray.dir, info);
+
+		uint h = compactedSlot(hasRay && hit, QUEUE_HITS);
+
+		// rays that hit nothing just stop here
+		if (!hasRay || !hit)
+			return;
+
+		hits[h].point = info.point;
+		hits[h].pixel = ray.pixel;
+		hits[h].normal = info.normal;
+		hits[h].throughput = ray.throughput;
+		hits[h].color = info.color;
+		hits[h].reflectivity = info.reflectivity;
+		hits[h].dir = ray.dir;
+	}
+
+	else if (stage == STAGE_SHADE)
+	{
+		if (i >= int(hitCount) && !compactQueues)
+			return;
+
+		WaveRay next;
+		bool goesOn = i < int(hitCount) && shadeHit(hits[i], next);
+		uint r = compactedSlot(goesOn, QUEUE_NEXT_RAYS);
+
+		if (goesOn)
+			rays[rayOutOffset + int(r)] = next;
+	}
+
+	else if (stage == STAGE_SHADOW)
+	{
+		// shadowCount also counts the rays that did not fit in the queue
+		bool hasRay = i < int(shadowCount) && i < imageWidth * imageHeight * SHADOW_RAYS_PER_PIXEL;
+
+		if (subgroupTraversal && accel == ACCEL_BVH)
+		{
+			WaveShadowRay shadowRay;
+			shadowRay.origin = vec3(0.0);
+			shadowRay.dir = vec3(0.0);
+			shadowRay.tmax = 0.0;
+
+			if (hasRay)
+				shadowRay = shadowRays[i];
+
+			// not used, the walk stops before it is finished
+			hitinfo unused;
+
+			// the threads without a shadow ray walk along, but do not add anything
+			if (!intersectSceneBVHSubgroup(shadowRay.origin, shadowRay.dir, shadowRay.tmax, true, hasRay, unused) && hasRay)
+				addPixelColor(shadowRay.pixel, shadowRay.light);
+
+			return;
+		}
+
+		if (!hasRay)
+			return;
+
+		WaveShadowRay shadowRay = shadowRays[i];
+		rayTime = pixelTime(ivec2(shadowRay.pixel % imageWidth, shadowRay.pixel / imageWidth));
+
+		if (!occluded(shadowRay.origin, shadowRay.dir, shadowRay.tmax))
+			addPixelColor(shadowRay.pixel, shadowRay.light);
+	}
+
+	else if (stage == STAGE_ARGS)
+	{
+		if (i != 0)
+			return;
+
+		// shadowCount also counts the rays that did not fit in the queue
+		uint shadowRays = min(shadowCount, uint(imageWidth * imageHeight * SHADOW_RAYS_PER_PIXEL));
+
+		dispatchArgs[0] = uvec4((rayCount[bounce % 2] + 63u) / 64u, 1u, 1u, 0u);
+		dispatchArgs[1] = uvec4((hitCount + 63u) / 64u, 1u, 1u, 0u);
+		dispatchArgs[2] = uvec4((shadowRays + 63u) / 64u, 1u, 1u, 0u);
+	}
+
+	else if (stage == STAGE_SORT_KEYS)
+	{
+		// The sort runs on the whole half of the queue, because main.cpp does not know
+		// how many rays are in it. The empty places get the biggest key,
+		// so they are sorted after every real ray
+		if (i >= imageWidth * imageHeight)
+			return;
+
+		if (i < int(rayCount[bounce % 2]))
+			sortKeys[i] = uvec2(raySortKey(rays[rayInOffset + i]), uint(i));
+		else
+			sortKeys[i] = uvec2(0xFFFFFFFFu, uint(i));
+	}
+}
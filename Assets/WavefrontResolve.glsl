@@ -0,0 +1,53 @@
+/*
+Title: Advanced Ray Tracer
+File Name: WavefrontResolve.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The last step of the wavefront renderer (see Wavefront.glsl). This draws
+on the same full-screen quad as FragmentShader.glsl, and for every pixel,
+it turns the fixed point color that the compute shaders added up back
+into a float color.
+*/
+
+#version 430
+
+// must match Wavefront.glsl
+#define COLOR_SCALE 65536.0
+
+uniform int imageWidth;
+
+// The output of the Fragment Shader, AKA the pixel color.
+out vec4 color;
+
+layout(binding = 20) buffer pixelColorBlock
+{
+	uint pixelColors[];
+};
+
+void main(void)
+{
+	// gl_FragCoord is the center of the pixel, so (0.5, 0.5) is pixel 0
+	int pixel = int(gl_FragCoord.y) * imageWidth + int(gl_FragCoord.x);
+
+	uvec3 fixedColor = uvec3(pixelColors[pixel * 4 + 0], pixelColors[pixel * 4 + 1], pixelColors[pixel * 4 + 2]);
+
+	color = vec4(vec3(fixedColor) / COLOR_SCALE, 1.0);
+}
@@ -0,0 +1,117 @@
+/*
+Title: Advanced Ray Tracer
+File Name: YuvConvert.glsl
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The color conversion of --yuv-readback. Without it, every frame is read
+back as 3 bytes of BGR for every pixel, and ffmpeg turns them into YUV
+4:2:0 before it encodes them, on the CPU. This does that conversion on the
+GPU, right before the readback, so only 1.5 bytes of every pixel cross the
+bus and ffmpeg gets the planes that the encoder reads.
+
+The frame is copied into frameTexture, and every thread reads a block of
+8 x 2 of its pixels. The rows are flipped, because ffmpeg wants the top row
+first and glReadPixels gave the bottom row first, which is why the pipe had
+-vf vflip. The colors are BT.601 with the limited range (16 to 235 for Y,
+16 to 240 for U and V), like the conversion ffmpeg does from bgr24 to
+yuv420p, and U and V are the average of every 2 x 2 pixels.
+
+yuvData is the slot of the readback ring, with the three planes of I420
+one after the other: the width x height bytes of Y, then the quarter size
+planes of U and V. 4 bytes are written as one uint, which is why the width
+must be a multiple of 8 and the height a multiple of 2 (see main.cpp).
+The frame is already 8 bits per channel in display colors, so there is no
+curve to apply before the matrix.
+*/
+
+// Compute shaders are part of openGL core since version 4.3
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(binding = 0) buffer yuvBlock
+{
+	uint yuvData[];
+};
+
+uniform sampler2D frameTexture;
+uniform int imageWidth;
+uniform int imageHeight;
+
+// Y, U, and V from 0 to 255 of a color from 0 to 1
+vec3 rgbToYuv(vec3 c)
+{
+	return vec3(16.0 + dot(c, vec3(65.481, 128.553, 24.966)),
+		128.0 + dot(c, vec3(-37.797, -74.203, 112.0)),
+		128.0 + dot(c, vec3(112.0, -93.786, -18.214)));
+}
+
+// 4 bytes from 0 to 255, the first one in the lowest byte
+uint packBytes(vec4 bytes)
+{
+	return packUnorm4x8(clamp(bytes, 0.0, 255.0) / 255.0);
+}
+
+void main()
+{
+	// the block is 8 pixels of rows 2y and 2y + 1, counted from the top
+	ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+	int blocksX = imageWidth / 8;
+
+	if (block.x >= blocksX || block.y >= imageHeight / 2)
+		return;
+
+	float luma[16];
+	vec2 chroma[4];
+
+	for (int k = 0; k < 4; k++)
+		chroma[k] = vec2(0.0);
+
+	for (int row = 0; row < 2; row++)
+	{
+		int y = imageHeight - 1 - (block.y * 2 + row);
+
+		for (int x = 0; x < 8; x++)
+		{
+			vec3 yuv = rgbToYuv(texelFetch(frameTexture, ivec2(block.x * 8 + x, y), 0).rgb);
+
+			luma[row * 8 + x] = yuv.x;
+			chroma[x / 2] += yuv.yz * 0.25;
+		}
+	}
+
+	// the rows of Y
+	for (int row = 0; row < 2; row++)
+	{
+		int first = ((block.y * 2 + row) * imageWidth) / 4 + block.x * 2;
+
+		yuvData[first] = packBytes(vec4(luma[row * 8], luma[row * 8 + 1], luma[row * 8 + 2], luma[row * 8 + 3]));
+		yuvData[first + 1] = packBytes(vec4(luma[row * 8 + 4], luma[row * 8 + 5], luma[row * 8 + 6], luma[row * 8 + 7]));
+	}
+
+	// U and V have a row for every 2 rows, and 4 bytes for the block
+	int lumaWords = imageWidth * imageHeight / 4;
+	int chromaWords = lumaWords / 4;
+	int word = block.y * blocksX + block.x;
+
+	yuvData[lumaWords + word] = packBytes(vec4(chroma[0].x, chroma[1].x, chroma[2].x, chroma[3].x));
+	yuvData[lumaWords + chromaWords + word] = packBytes(vec4(chroma[0].y, chroma[1].y, chroma[2].y, chroma[3].y));
+}
@@ -0,0 +1,390 @@
+/*
+Title: Basic Ray Tracer
+File Name: Animation.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+
+#include "Animation.h"
+#include "Profiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <xmmintrin.h>
+
+const char* easingNames[NUM_EASINGS] = { "linear", "smooth", "ease-in", "ease-out", "step" };
+
+void addAnimationTrack(AnimationTracks& tracks, int mesh, float length)
+{
+	tracks.mesh.push_back(mesh);
+	tracks.length.push_back(length);
+	tracks.firstKey.push_back((int)tracks.time.size());
+	tracks.keyCount.push_back(0);
+}
+
+void addAnimationKey(AnimationTracks& tracks, float time, int easing, glm::vec3 position, glm::vec3 axis, float degrees, glm::vec3 scale)
+{
+	float half = glm::radians(degrees) * 0.5f;
+	glm::vec3 v = glm::normalize(axis) * sinf(half);
+	glm::vec4 q(v, cosf(half));
+
+	// q and -q are the same rotation, and the one closer to the key before goes the shorter way to it
+	int& count = tracks.keyCount.back();
+
+	if (count > 0)
+	{
+		size_t last = tracks.time.size() - 1;
+		glm::vec4 before(tracks.qx[last], tracks.qy[last], tracks.qz[last], tracks.qw[last]);
+
+		if (glm::dot(before, q) < 0.0f)
+			q = -q;
+	}
+
+	count++;
+
+	tracks.time.push_back(time);
+	tracks.easing.push_back(easing);
+	tracks.px.push_back(position.x);
+	tracks.py.push_back(position.y);
+	tracks.pz.push_back(position.z);
+	tracks.qx.push_back(q.x);
+	tracks.qy.push_back(q.y);
+	tracks.qz.push_back(q.z);
+	tracks.qw.push_back(q.w);
+	tracks.sx.push_back(scale.x);
+	tracks.sy.push_back(scale.y);
+	tracks.sz.push_back(scale.z);
+}
+
+bool sameAnimation(const AnimationTracks& a, const AnimationTracks& b)
+{
+	return a.mesh == b.mesh && a.length == b.length && a.firstKey == b.firstKey && a.keyCount == b.keyCount &&
+		a.time == b.time && a.easing == b.easing && a.px == b.px && a.py == b.py && a.pz == b.pz &&
+		a.qx == b.qx && a.qy == b.qy && a.qz == b.qz && a.qw == b.qw && a.sx == b.sx && a.sy == b.sy && a.sz == b.sz;
+}
+
+bool loadAnimation(const std::string& fileName, AnimationTracks& tracks)
+{
+	std::ifstream file(fileName);
+
+	if (!file)
+	{
+		std::cout << "Can't read the animation " << fileName << std::endl;
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		std::istringstream words(line);
+		std::string kind;
+
+		if (!(words >> kind) || kind[0] == '#')
+			continue;
+
+		if (kind == "track")
+		{
+			int mesh;
+			float length;
+
+			if (!(words >> mesh >> length) || mesh < 0)
+			{
+				std::cout << fileName << " line " << lineNumber << ": a track is \"track <mesh> <length>\"" << std::endl;
+				return false;
+			}
+
+			addAnimationTrack(tracks, mesh, length);
+		}
+		else if (kind == "key")
+		{
+			float time, degrees;
+			std::string easingName;
+			glm::vec3 position, axis, scale;
+
+			if (!(words >> time >> easingName >> position.x >> position.y >> position.z
+				>> axis.x >> axis.y >> axis.z >> degrees >> scale.x >> scale.y >> scale.z))
+			{
+				std::cout << fileName << " line " << lineNumber << ": a key is \"key <time> <easing> <x y z> <axis x y z> <degrees> <scale x y z>\"" << std::endl;
+				return false;
+			}
+
+			int easing = -1;
+
+			for (int e = 0; e < NUM_EASINGS; e++)
+			{
+				if (easingName == easingNames[e])
+					easing = e;
+			}
+
+			if (easing < 0)
+			{
+				std::cout << fileName << " line " << lineNumber << ": " << easingName << " is not an easing" << std::endl;
+				return false;
+			}
+
+			if (tracks.mesh.empty())
+			{
+				std::cout << fileName << " line " << lineNumber << ": a key needs a track before it" << std::endl;
+				return false;
+			}
+
+			if (tracks.keyCount.back() > 0 && time < tracks.time.back())
+			{
+				std::cout << fileName << " line " << lineNumber << ": the keys of a track must be in the order of their times" << std::endl;
+				return false;
+			}
+
+			if (glm::length(axis) == 0.0f)
+				axis = glm::vec3(0.0f, 1.0f, 0.0f);
+
+			addAnimationKey(tracks, time, easing, position, axis, degrees, scale);
+		}
+		else
+		{
+			std::cout << fileName << " line " << lineNumber << ": " << kind << " is not a track or a key" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// How far from key a to key b the mesh is, for w from 0 to 1 of the time between them
+static float ease(float w, int easing)
+{
+	switch (easing)
+	{
+	case EASE_SMOOTH:
+		return w * w * (3.0f - 2.0f * w);
+	case EASE_IN:
+		return w * w;
+	case EASE_OUT:
+		return 1.0f - (1.0f - w) * (1.0f - w);
+	case EASE_STEP:
+		return 0.0f;
+	default:
+		return w;
+	}
+}
+
+// The two keys of a track around time, and how far from the first to the second it is (after the easing).
+// Before the first key, and after the last one, it stays on that key. A track with a length starts again after it
+static void findKeys(const AnimationTracks& tracks, int track, float time, int& a, int& b, float& w)
+{
+	int first = tracks.firstKey[track];
+	int last = first + tracks.keyCount[track] - 1;
+	float length = tracks.length[track];
+
+	if (length > 0.0f)
+	{
+		time = fmodf(time, length);
+
+		if (time < 0.0f)
+			time += length;
+	}
+
+	a = b = first;
+	w = 0.0f;
+
+	if (time <= tracks.time[first])
+		return;
+
+	if (time >= tracks.time[last])
+	{
+		a = b = last;
+		return;
+	}
+
+	// the last key that is not after time
+	int low = first;
+	int high = last;
+
+	while (high - low > 1)
+	{
+		int middle = (low + high) / 2;
+
+		if (tracks.time[middle] <= time)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	a = low;
+	b = low + 1;
+	w = ease((time - tracks.time[a]) / (tracks.time[b] - tracks.time[a]), tracks.easing[a]);
+}
+
+static float lerp(float a, float b, float w)
+{
+	return a + (b - a) * w;
+}
+
+void evaluateAnimationScalar(const AnimationTracks& tracks, float time, glm::mat4* matrices, int numMatrices)
+{
+	for (int i = 0; i < (int)tracks.mesh.size(); i++)
+	{
+		if (tracks.mesh[i] >= numMatrices || tracks.keyCount[i] == 0)
+			continue;
+
+		int a, b;
+		float w;
+		findKeys(tracks, i, time, a, b, w);
+
+		glm::vec3 p(lerp(tracks.px[a], tracks.px[b], w), lerp(tracks.py[a], tracks.py[b], w), lerp(tracks.pz[a], tracks.pz[b], w));
+		glm::vec3 s(lerp(tracks.sx[a], tracks.sx[b], w), lerp(tracks.sy[a], tracks.sy[b], w), lerp(tracks.sz[a], tracks.sz[b], w));
+		glm::vec4 q(lerp(tracks.qx[a], tracks.qx[b], w), lerp(tracks.qy[a], tracks.qy[b], w),
+			lerp(tracks.qz[a], tracks.qz[b], w), lerp(tracks.qw[a], tracks.qw[b], w));
+
+		// the blend of two rotations is shorter than 1, so it is made a rotation again
+		q *= 1.0f / sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+
+		// translate * rotate * scale: the columns of the rotation of q, times the scale
+		glm::mat4& m = matrices[tracks.mesh[i]];
+		m[0] = glm::vec4(1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y + q.w * q.z), 2.0f * (q.x * q.z - q.w * q.y), 0.0f) * s.x;
+		m[1] = glm::vec4(2.0f * (q.x * q.y - q.w * q.z), 1.0f - 2.0f * (q.x * q.x + q.z * q.z), 2.0f * (q.y * q.z + q.w * q.x), 0.0f) * s.y;
+		m[2] = glm::vec4(2.0f * (q.x * q.z + q.w * q.y), 2.0f * (q.y * q.z - q.w * q.x), 1.0f - 2.0f * (q.x * q.x + q.y * q.y), 0.0f) * s.z;
+		m[3] = glm::vec4(p, 1.0f);
+	}
+}
+
+// 4 numbers of the keys in keys, one for every lane, from the same array
+static __m128 gather(const std::vector<float>& values, const int keys[4])
+{
+	return _mm_set_ps(values[keys[3]], values[keys[2]], values[keys[1]], values[keys[0]]);
+}
+
+// The same blend as lerp, in every lane
+static __m128 lerp4(__m128 a, __m128 b, __m128 w)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), w));
+}
+
+// Make the matrices of up to 4 tracks, with the keys and blends that findKeys found for them
+static void evaluateBatch(const AnimationTracks& tracks, const int trackOf[4], const int keysA[4], const int keysB[4], const float blends[4], int lanes, glm::mat4* matrices)
+{
+	__m128 w = _mm_loadu_ps(blends);
+
+	__m128 px = lerp4(gather(tracks.px, keysA), gather(tracks.px, keysB), w);
+	__m128 py = lerp4(gather(tracks.py, keysA), gather(tracks.py, keysB), w);
+	__m128 pz = lerp4(gather(tracks.pz, keysA), gather(tracks.pz, keysB), w);
+	__m128 sx = lerp4(gather(tracks.sx, keysA), gather(tracks.sx, keysB), w);
+	__m128 sy = lerp4(gather(tracks.sy, keysA), gather(tracks.sy, keysB), w);
+	__m128 sz = lerp4(gather(tracks.sz, keysA), gather(tracks.sz, keysB), w);
+	__m128 qx = lerp4(gather(tracks.qx, keysA), gather(tracks.qx, keysB), w);
+	__m128 qy = lerp4(gather(tracks.qy, keysA), gather(tracks.qy, keysB), w);
+	__m128 qz = lerp4(gather(tracks.qz, keysA), gather(tracks.qz, keysB), w);
+	__m128 qw = lerp4(gather(tracks.qw, keysA), gather(tracks.qw, keysB), w);
+
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	// made a rotation again, like in evaluateAnimationScalar
+	__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_mul_ps(qz, qz)), _mm_mul_ps(qw, qw));
+	__m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+	qx = _mm_mul_ps(qx, inverse);
+	qy = _mm_mul_ps(qy, inverse);
+	qz = _mm_mul_ps(qz, inverse);
+	qw = _mm_mul_ps(qw, inverse);
+
+	__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+	__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+	__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+	// the columns, with one track in every lane
+	__m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+	__m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+	__m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+	__m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+	__m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+	__m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+	__m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+	__m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+	__m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+	__m128 c0w = zero, c1w = zero, c2w = zero, c3w = one;
+
+	// turn the lanes around, so that every register is one column of one track
+	_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+	_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+	_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+	_MM_TRANSPOSE4_PS(px, py, pz, c3w);
+
+	__m128 columns[4][4] = {
+		{ c0x, c1x, c2x, px },
+		{ c0y, c1y, c2y, py },
+		{ c0z, c1z, c2z, pz },
+		{ c0w, c1w, c2w, c3w } };
+
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		float* m = &matrices[tracks.mesh[trackOf[lane]]][0][0];
+
+		for (int c = 0; c < 4; c++)
+			_mm_storeu_ps(m + c * 4, columns[lane][c]);
+	}
+}
+
+void evaluateAnimation(const AnimationTracks& tracks, float time, glm::mat4* matrices, int numMatrices)
+{
+	PROFILE_ZONE("evaluateAnimation");
+
+	int trackOf[4];
+	int keysA[4];
+	int keysB[4];
+	float blends[4];
+	int lanes = 0;
+
+	for (int i = 0; i < (int)tracks.mesh.size(); i++)
+	{
+		if (tracks.mesh[i] >= numMatrices || tracks.keyCount[i] == 0)
+			continue;
+
+		trackOf[lanes] = i;
+		findKeys(tracks, i, time, keysA[lanes], keysB[lanes], blends[lanes]);
+		lanes++;
+
+		if (lanes == 4)
+		{
+			evaluateBatch(tracks, trackOf, keysA, keysB, blends, 4, matrices);
+			lanes = 0;
+		}
+	}
+
+	if (lanes > 0)
+	{
+		// the empty lanes do the last track again, and are not written
+		for (int lane = lanes; lane < 4; lane++)
+		{
+			trackOf[lane] = trackOf[lanes - 1];
+			keysA[lane] = keysA[lanes - 1];
+			keysB[lane] = keysB[lanes - 1];
+			blends[lane] = blends[lanes - 1];
+		}
+
+		evaluateBatch(tracks, trackOf, keysA, keysB, blends, lanes, matrices);
+	}
+}
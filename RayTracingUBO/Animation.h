@@ -0,0 +1,96 @@
+/*
+Title: Basic Ray Tracer
+File Name: Animation.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Keyframe animation of the meshes, for --animation <file>. A track moves
+one mesh. It is a list of keys, and every key has a time, a position, a
+rotation, a size, and an easing, which is how the mesh gets from that key
+to the next one (linear, smooth, ease-in, ease-out, or step, which jumps).
+The matrix of the mesh is translate * rotate * scale, like the matrices
+in sceneMatrices in main.cpp, and the rotation goes from key to key along
+the shorter way around.
+
+The keys of every track are in the same arrays, one array for each number
+(structure of arrays). evaluateAnimation first finds the two keys around
+the time for every track, and then makes the matrices of 4 tracks at a
+time with SSE: every lane of a register is one track, so the same
+instructions make all 4 matrices, however many tracks there are, instead
+of running the code of each mesh one at a time.
+
+The file has a line for every track, and a line for every key after it:
+  track <mesh> <length>
+  key <time> <easing> <x y z> <axis x y z> <degrees> <scale x y z>
+A track with a length longer than 0 starts again from the beginning after
+that many seconds. Lines that start with # are comments.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// How a mesh goes from one key to the next one
+#define EASE_LINEAR 0
+#define EASE_SMOOTH 1
+#define EASE_IN 2
+#define EASE_OUT 3
+#define EASE_STEP 4
+#define NUM_EASINGS 5
+
+extern const char* easingNames[NUM_EASINGS];
+
+// Every track, and every key of every track, as structure of arrays.
+// The keys of track i are firstKey[i] to firstKey[i] + keyCount[i] - 1, in the order of their times.
+// Rotations are unit quaternions, and every one is on the same side as the one before it,
+// so blending them goes the shorter way around
+struct AnimationTracks
+{
+	std::vector<int> mesh;
+	std::vector<float> length;
+	std::vector<int> firstKey;
+	std::vector<int> keyCount;
+
+	std::vector<float> time;
+	std::vector<int> easing;
+	std::vector<float> px, py, pz;
+	std::vector<float> qx, qy, qz, qw;
+	std::vector<float> sx, sy, sz;
+};
+
+// Start a track for a mesh, and add keys to the end of the last track, in the order of their times
+void addAnimationTrack(AnimationTracks& tracks, int mesh, float length);
+void addAnimationKey(AnimationTracks& tracks, float time, int easing, glm::vec3 position, glm::vec3 axis, float degrees, glm::vec3 scale);
+
+// true if a and b have the same tracks, with the same keys
+bool sameAnimation(const AnimationTracks& a, const AnimationTracks& b);
+
+// Read the tracks from a file. Returns false, and says why, if it could not be read
+bool loadAnimation(const std::string& fileName, AnimationTracks& tracks);
+
+// Write the matrix of every track at time into matrices[mesh] of its mesh, 4 tracks at a time with SSE.
+// Tracks of meshes that are not in matrices are skipped
+void evaluateAnimation(const AnimationTracks& tracks, float time, glm::mat4* matrices, int numMatrices);
+
+// The same as evaluateAnimation, one track at a time with glm, which --bench-animation compares it with
+void evaluateAnimationScalar(const AnimationTracks& tracks, float time, glm::mat4* matrices, int numMatrices);
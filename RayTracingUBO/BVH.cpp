@@ -0,0 +1,913 @@
+/*
+Title: Basic Ray Tracer
+File Name: BVH.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BVH.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <queue>
+#include <utility>
+
+AABB emptyAABB()
+{
+	AABB box;
+	box.min = glm::vec3(1e30f);
+	box.max = glm::vec3(-1e30f);
+	return box;
+}
+
+void growAABB(AABB& box, glm::vec3 point)
+{
+	box.min = glm::min(box.min, point);
+	box.max = glm::max(box.max, point);
+}
+
+void growAABB(AABB& box, const AABB& other)
+{
+	box.min = glm::min(box.min, other.min);
+	box.max = glm::max(box.max, other.max);
+}
+
+AABB transformAABB(const AABB& box, const glm::mat4& matrix)
+{
+	AABB result = emptyAABB();
+
+	// each corner picks min or max on every axis, with the bits of i
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner(
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z);
+
+		growAABB(result, glm::vec3(matrix * glm::vec4(corner, 1.0f)));
+	}
+
+	return result;
+}
+
+// Build the node at nodeIndex, which holds order[first] through order[first + count - 1].
+// We split the boxes in half, along the longest axis of the box around their centers
+// (a "median split"), and then build each half.
+static void buildNode(const std::vector<AABB>& boxes, int maxLeafSize, std::vector<BVHNode>& nodes, std::vector<int>& order, int nodeIndex, int first, int count)
+{
+	AABB bounds = emptyAABB();
+	AABB centers = emptyAABB();
+
+	for (int i = first; i < first + count; i++)
+	{
+		growAABB(bounds, boxes[order[i]]);
+		growAABB(centers, (boxes[order[i]].min + boxes[order[i]].max) * 0.5f);
+	}
+
+	nodes[nodeIndex].min = bounds.min;
+	nodes[nodeIndex].max = bounds.max;
+
+	// If there are few enough boxes, this is a leaf
+	if (count <= maxLeafSize)
+	{
+		nodes[nodeIndex].left = ~first;
+		nodes[nodeIndex].right = count;
+		return;
+	}
+
+	// pick the longest axis
+	glm::vec3 size = centers.max - centers.min;
+	int axis = 0;
+	if (size.y > size.x) axis = 1;
+	if (size.z > size[axis]) axis = 2;
+
+	// Put the half of the boxes with the smaller centers first.
+	// nth_element does this without sorting the whole list
+	int half = count / 2;
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+		[&](int a, int b) { return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis]; });
+
+	// make room for both children, then build them
+	int left = (int)nodes.size();
+	nodes.resize(nodes.size() + 2);
+
+	nodes[nodeIndex].left = left;
+	nodes[nodeIndex].right = left + 1;
+
+	buildNode(boxes, maxLeafSize, nodes, order, left, first, half);
+	buildNode(boxes, maxLeafSize, nodes, order, left + 1, first + half, count - half);
+}
+
+void buildBVH(const std::vector<AABB>& boxes, int maxLeafSize, std::vector<BVHNode>& nodes, std::vector<int>& order)
+{
+	nodes.clear();
+	order.resize(boxes.size());
+
+	for (int i = 0; i < (int)boxes.size(); i++)
+		order[i] = i;
+
+	// the root
+	nodes.resize(1);
+
+	// An empty tree is one empty leaf, with an inside-out box that no ray can hit
+	if (boxes.empty())
+	{
+		nodes[0].min = glm::vec3(1e30f);
+		nodes[0].max = glm::vec3(-1e30f);
+		nodes[0].left = ~0;
+		nodes[0].right = 0;
+		return;
+	}
+
+	buildNode(boxes, maxLeafSize, nodes, order, 0, 0, (int)boxes.size());
+}
+
+// How many bins the SAH tries on each axis
+#define SAH_BINS 16
+
+// Subtrees with at least this many boxes are built in a job of their own
+#define SAH_THREAD_MIN_BOXES 4096
+
+// This goes at the start of every cache file. If the file format or the builder
+// ever changes, change this too, so that old files are not used by mistake
+#define BVH_CACHE_VERSION 1
+
+static float surfaceArea(const AABB& box)
+{
+	glm::vec3 size = glm::max(box.max - box.min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Build the node at nodeIndex with the SAH, which holds order[first] through order[first + count - 1].
+// threadDepth is how many more times we are allowed to give a child to a job of its own
+static void buildNodeSAH(const std::vector<AABB>& boxes, int maxLeafSize, std::vector<BVHNode>& nodes, std::vector<int>& order, int nodeIndex, int first, int count, int threadDepth)
+{
+	AABB bounds = emptyAABB();
+	AABB centers = emptyAABB();
+
+	for (int i = first; i < first + count; i++)
+	{
+		growAABB(bounds, boxes[order[i]]);
+		growAABB(centers, (boxes[order[i]].min + boxes[order[i]].max) * 0.5f);
+	}
+
+	nodes[nodeIndex].min = bounds.min;
+	nodes[nodeIndex].max = bounds.max;
+
+	// one box is always a leaf
+	if (count == 1)
+	{
+		nodes[nodeIndex].left = ~first;
+		nodes[nodeIndex].right = count;
+		return;
+	}
+
+	// If the ray reaches this node, a leaf costs one test per box.
+	// A split costs one test for the node, plus the boxes of each child, times
+	// the chance that the ray also hits that child (its area divided by our area)
+	float leafCost = (float)count;
+	float bestCost = 1e30f;
+	int bestAxis = -1;
+	int bestBin = 0;
+
+	float parentArea = surfaceArea(bounds);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centers.max[axis] - centers.min[axis];
+
+		// every center is in the same place on this axis
+		if (extent <= 0.0f)
+			continue;
+
+		AABB binBounds[SAH_BINS];
+		int binCount[SAH_BINS];
+
+		for (int b = 0; b < SAH_BINS; b++)
+		{
+			binBounds[b] = emptyAABB();
+			binCount[b] = 0;
+		}
+
+		float scale = SAH_BINS / extent;
+
+		for (int i = first; i < first + count; i++)
+		{
+			const AABB& box = boxes[order[i]];
+			float center = (box.min[axis] + box.max[axis]) * 0.5f;
+			int b = std::min(SAH_BINS - 1, (int)((center - centers.min[axis]) * scale));
+			growAABB(binBounds[b], box);
+			binCount[b]++;
+		}
+
+		// Sweep from the right, to get the area and count of every
+		// right side, then sweep from the left and try every split
+		float rightArea[SAH_BINS];
+		int rightCount[SAH_BINS];
+		AABB right = emptyAABB();
+		int rightSum = 0;
+
+		for (int b = SAH_BINS - 1; b > 0; b--)
+		{
+			growAABB(right, binBounds[b]);
+			rightSum += binCount[b];
+			rightArea[b] = surfaceArea(right);
+			rightCount[b] = rightSum;
+		}
+
+		AABB left = emptyAABB();
+		int leftSum = 0;
+
+		// split between bin b - 1 and bin b
+		for (int b = 1; b < SAH_BINS; b++)
+		{
+			growAABB(left, binBounds[b - 1]);
+			leftSum += binCount[b - 1];
+
+			if (leftSum == 0 || rightCount[b] == 0)
+				continue;
+
+			float cost = 1.0f + (surfaceArea(left) * leftSum + rightArea[b] * rightCount[b]) / parentArea;
+
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	// Make a leaf if that is cheaper than splitting, as long as it is not too big
+	if (count <= maxLeafSize && (bestAxis < 0 || leafCost <= bestCost))
+	{
+		nodes[nodeIndex].left = ~first;
+		nodes[nodeIndex].right = count;
+		return;
+	}
+
+	int half;
+
+	if (bestAxis >= 0)
+	{
+		// put every box that is in a bin before bestBin first
+		float extent = centers.max[bestAxis] - centers.min[bestAxis];
+		float scale = SAH_BINS / extent;
+		float minCenter = centers.min[bestAxis];
+		int axis = bestAxis;
+
+		int* middle = std::partition(order.data() + first, order.data() + first + count, [&](int i) {
+			float center = (boxes[i].min[axis] + boxes[i].max[axis]) * 0.5f;
+			return std::min(SAH_BINS - 1, (int)((center - minCenter) * scale)) < bestBin;
+		});
+
+		half = (int)(middle - (order.data() + first));
+	}
+	else
+	{
+		// All centers are in the same place, so there is nothing
+		// to choose from. The leaf is too big, so just cut it in half
+		half = count / 2;
+	}
+
+	int leftChild = (int)nodes.size();
+	nodes.resize(nodes.size() + 1);
+	nodes[nodeIndex].left = leftChild;
+
+	if (threadDepth > 0 && count >= SAH_THREAD_MIN_BOXES)
+	{
+		// The right child gets its own list of nodes in a job, so that the two threads
+		// never resize the same vector. The two halves of "order" do not overlap, so that is safe to share
+		std::vector<BVHNode> rightNodes(1);
+
+		JobHandle rightJob = addJob("build BVH subtree", [&]() {
+			buildNodeSAH(boxes, maxLeafSize, rightNodes, order, 0, first + half, count - half, threadDepth - 1);
+		});
+
+		buildNodeSAH(boxes, maxLeafSize, nodes, order, leftChild, first, half, threadDepth - 1);
+		waitJob(rightJob);
+
+		// move the right nodes to the end of our list,
+		// and fix the children of its interior nodes to point there too
+		int base = (int)nodes.size();
+		for (BVHNode& node : rightNodes)
+		{
+			if (node.left >= 0)
+			{
+				node.left += base;
+				node.right += base;
+			}
+		}
+
+		nodes[nodeIndex].right = base;
+		nodes.insert(nodes.end(), rightNodes.begin(), rightNodes.end());
+	}
+	else
+	{
+		int rightChild = (int)nodes.size();
+		nodes.resize(nodes.size() + 1);
+		nodes[nodeIndex].right = rightChild;
+
+		buildNodeSAH(boxes, maxLeafSize, nodes, order, leftChild, first, half, threadDepth);
+		buildNodeSAH(boxes, maxLeafSize, nodes, order, rightChild, first + half, count - half, threadDepth);
+	}
+}
+
+void buildBVHSAH(const std::vector<AABB>& boxes, int maxLeafSize, std::vector<BVHNode>& nodes, std::vector<int>& order)
+{
+	nodes.clear();
+	order.resize(boxes.size());
+
+	for (int i = 0; i < (int)boxes.size(); i++)
+		order[i] = i;
+
+	nodes.resize(1);
+
+	if (boxes.empty())
+	{
+		nodes[0].min = glm::vec3(1e30f);
+		nodes[0].max = glm::vec3(-1e30f);
+		nodes[0].left = ~0;
+		nodes[0].right = 0;
+		return;
+	}
+
+	// Every level of jobs doubles the number of jobs, so stop when there are about as many
+	// as there are threads to run them (the pool, and this thread). Without a pool, there are none
+	int threadDepth = 0;
+	int threads = jobThreadCount() + 1;
+	while ((1 << threadDepth) < threads)
+		threadDepth++;
+
+	buildNodeSAH(boxes, maxLeafSize, nodes, order, 0, 0, (int)boxes.size(), threadDepth);
+}
+
+uint64_t hashBVHInput(const std::vector<AABB>& boxes, int maxLeafSize)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	auto add = [&](const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	int version = BVH_CACHE_VERSION;
+	add(&version, sizeof(version));
+	add(&maxLeafSize, sizeof(maxLeafSize));
+
+	if (!boxes.empty())
+		add(boxes.data(), sizeof(AABB) * boxes.size());
+
+	return hash;
+}
+
+bool buildBVHCached(const std::vector<AABB>& boxes, int maxLeafSize, const char* cacheFolder, std::vector<BVHNode>& nodes, std::vector<int>& order)
+{
+	uint64_t hash = hashBVHInput(boxes, maxLeafSize);
+
+	char fileName[512];
+	snprintf(fileName, sizeof(fileName), "%s/%016llx.bvh", cacheFolder, (unsigned long long)hash);
+
+	// The file is: the hash, the number of nodes, the number of boxes, then all nodes, then the order.
+	// The hash is also inside of the file, in case the file was renamed
+	FILE* file = fopen(fileName, "rb");
+	if (file)
+	{
+		uint64_t fileHash = 0;
+		int numNodes = 0;
+		int numBoxes = 0;
+
+		bool ok = fread(&fileHash, sizeof(fileHash), 1, file) == 1 &&
+			fread(&numNodes, sizeof(numNodes), 1, file) == 1 &&
+			fread(&numBoxes, sizeof(numBoxes), 1, file) == 1 &&
+			fileHash == hash && numNodes > 0 && numBoxes == (int)boxes.size();
+
+		if (ok)
+		{
+			nodes.resize(numNodes);
+			order.resize(numBoxes);
+
+			ok = fread(nodes.data(), sizeof(BVHNode), numNodes, file) == (size_t)numNodes &&
+				fread(order.data(), sizeof(int), numBoxes, file) == (size_t)numBoxes;
+		}
+
+		fclose(file);
+
+		if (ok)
+			return true;
+	}
+
+	// Not in the cache (or the file was broken), so build it and save it for next time.
+	// If the file can't be written, we still have the tree, it just won't be saved
+	buildBVHSAH(boxes, maxLeafSize, nodes, order);
+
+	file = fopen(fileName, "wb");
+	if (file)
+	{
+		int numNodes = (int)nodes.size();
+		int numBoxes = (int)order.size();
+
+		fwrite(&hash, sizeof(hash), 1, file);
+		fwrite(&numNodes, sizeof(numNodes), 1, file);
+		fwrite(&numBoxes, sizeof(numBoxes), 1, file);
+		fwrite(nodes.data(), sizeof(BVHNode), numNodes, file);
+		if (numBoxes > 0)
+			fwrite(order.data(), sizeof(int), numBoxes, file);
+		fclose(file);
+	}
+
+	return false;
+}
+
+// Turn one side of a child box into a number from 0 to 255. The box must never get smaller,
+// or rays could miss triangles, so the min side rounds down and the max side rounds up.
+// The extra 0.001 covers any rounding difference between this and the shader
+static uint32_t quantizeDown(float value, float origin, float scale)
+{
+	if (scale <= 0.0f)
+		return 0;
+
+	float q = floorf((value - origin) / scale - 0.001f);
+	return (uint32_t)std::min(255.0f, std::max(0.0f, q));
+}
+
+static uint32_t quantizeUp(float value, float origin, float scale)
+{
+	if (scale <= 0.0f)
+		return 0;
+
+	float q = ceilf((value - origin) / scale + 0.001f);
+	return (uint32_t)std::min(255.0f, std::max(0.0f, q));
+}
+
+// Make the wide node for binary node b, and everything under it. Returns the index of the wide node
+static int collapseNode(const std::vector<BVHNode>& binary, std::vector<WideBVHNode>& wide, int b)
+{
+	// Start with the two children of b. Then keep opening the biggest child that is not a leaf,
+	// and replacing it with its own two children, until there are 4 children
+	int children[4];
+	int numChildren = 0;
+
+	if (binary[b].left < 0)
+	{
+		// only happens if the root itself is a leaf
+		children[numChildren++] = b;
+	}
+	else
+	{
+		children[numChildren++] = binary[b].left;
+		children[numChildren++] = binary[b].right;
+	}
+
+	while (numChildren < 4)
+	{
+		int biggest = -1;
+		float biggestArea = -1.0f;
+
+		for (int c = 0; c < numChildren; c++)
+		{
+			const BVHNode& node = binary[children[c]];
+			if (node.left < 0)
+				continue;
+
+			AABB box = { node.min, node.max };
+			float area = surfaceArea(box);
+
+			if (area > biggestArea)
+			{
+				biggestArea = area;
+				biggest = c;
+			}
+		}
+
+		// every child is a leaf
+		if (biggest < 0)
+			break;
+
+		int opened = children[biggest];
+		children[biggest] = binary[opened].left;
+		children[numChildren++] = binary[opened].right;
+	}
+
+	int index = (int)wide.size();
+	wide.resize(wide.size() + 1);
+
+	// The boxes of the children are stored relative to the box of this node.
+	// Dividing by a little less than 255 makes sure that 255 always reaches the max side
+	glm::vec3 nodeMin = binary[b].min;
+	glm::vec3 nodeMax = binary[b].max;
+	glm::vec3 origin = nodeMin;
+	glm::vec3 scale = glm::max(nodeMax - nodeMin, glm::vec3(0.0f)) / 254.0f;
+
+	uint32_t lo[3] = { 0, 0, 0 };
+	uint32_t hi[3] = { 0, 0, 0 };
+	int child[4] = { -1, -1, -1, -1 };
+
+	for (int c = 0; c < numChildren; c++)
+	{
+		const BVHNode& node = binary[children[c]];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			lo[axis] |= quantizeDown(node.min[axis], origin[axis], scale[axis]) << (8 * c);
+			hi[axis] |= quantizeUp(node.max[axis], origin[axis], scale[axis]) << (8 * c);
+		}
+
+		if (node.left < 0)
+			child[c] = ~(((~node.left) << 3) | node.right);
+		else
+			child[c] = collapseNode(binary, wide, children[c]);
+	}
+
+	// wide may have been resized by the children, so we
+	// write the node only after all of them are done
+	WideBVHNode& w = wide[index];
+	w.origin = origin;
+	w.scale = scale;
+	w.loX = lo[0];
+	w.loY = lo[1];
+	w.loZ = lo[2];
+	w.hiX = hi[0];
+	w.hiY = hi[1];
+	w.hiZ = hi[2];
+
+	for (int c = 0; c < 4; c++)
+		w.child[c] = child[c];
+
+	return index;
+}
+
+void collapseBVH4(const std::vector<BVHNode>& binary, std::vector<WideBVHNode>& wide)
+{
+	wide.clear();
+	collapseNode(binary, wide, 0);
+}
+
+// A node waiting to be put in a treelet: the most visited comes first, and of two that were visited as often,
+// the one that was first before, so that nodes that were never visited keep the order of the builder
+typedef std::pair<uint32_t, int> HotNode;
+
+void layoutBVHByVisits(std::vector<BVHNode>& nodes, int root, int count, const std::vector<uint32_t>& visits, int treeletSize)
+{
+	std::vector<int> place(count, -1);
+	int next = 0;
+
+	std::priority_queue<HotNode> treeletRoots;
+	std::priority_queue<HotNode> frontier;
+	treeletRoots.push(HotNode(visits[root], -root));
+
+	while (!treeletRoots.empty())
+	{
+		frontier.push(treeletRoots.top());
+		treeletRoots.pop();
+
+		for (int size = 0; size < treeletSize && !frontier.empty(); size++)
+		{
+			int n = -frontier.top().second;
+			frontier.pop();
+
+			place[n - root] = root + next++;
+
+			if (nodes[n].left >= 0)
+			{
+				frontier.push(HotNode(visits[nodes[n].left], -nodes[n].left));
+				frontier.push(HotNode(visits[nodes[n].right], -nodes[n].right));
+			}
+		}
+
+		// the nodes under a full treelet start treelets of their own
+		while (!frontier.empty())
+		{
+			treeletRoots.push(frontier.top());
+			frontier.pop();
+		}
+	}
+
+	// a node that the root can't reach still needs a place
+	for (int i = 0; i < count; i++)
+	{
+		if (place[i] < 0)
+			place[i] = root + next++;
+	}
+
+	std::vector<BVHNode> moved(count);
+	for (int i = 0; i < count; i++)
+	{
+		BVHNode node = nodes[root + i];
+
+		if (node.left >= 0)
+		{
+			node.left = place[node.left - root];
+			node.right = place[node.right - root];
+		}
+
+		moved[place[i] - root] = node;
+	}
+
+	std::copy(moved.begin(), moved.end(), nodes.begin() + root);
+}
+
+// How much bigger than its box the fat box of a leaf of a DynamicBVH is, as a part of the size of the box
+#define DYNAMIC_BVH_FATTEN 0.1f
+
+static AABB unionAABB(const AABB& a, const AABB& b)
+{
+	AABB box = a;
+	growAABB(box, b);
+	return box;
+}
+
+static bool insideAABB(const AABB& inner, const AABB& outer)
+{
+	return glm::all(glm::greaterThanEqual(inner.min, outer.min)) && glm::all(glm::lessThanEqual(inner.max, outer.max));
+}
+
+static int allocateDynamicNode(DynamicBVH& tree)
+{
+	if (!tree.freeNodes.empty())
+	{
+		int node = tree.freeNodes.back();
+		tree.freeNodes.pop_back();
+		return node;
+	}
+
+	tree.nodes.push_back(DynamicBVHNode());
+	return (int)tree.nodes.size() - 1;
+}
+
+// Try to make node smaller by swapping one of its children with a child of the other one, where the
+// child that stays gets the smallest box. Only the box of the child that the swap changes gets different
+static void rotateDynamicNode(DynamicBVH& tree, int node)
+{
+	std::vector<DynamicBVHNode>& nodes = tree.nodes;
+	int bestGain = 0;
+	float best = 0.0f;
+
+	// swap child[side] of node with grandchild g of child[1 - side], which keeps its other child
+	for (int side = 0; side < 2; side++)
+	{
+		int moved = nodes[node].child[side];
+		int other = nodes[node].child[1 - side];
+
+		if (nodes[other].child[0] < 0)
+			continue;
+
+		for (int g = 0; g < 2; g++)
+		{
+			int kept = nodes[other].child[1 - g];
+			float gain = surfaceArea(unionAABB(nodes[moved].box, nodes[kept].box)) - surfaceArea(nodes[other].box);
+
+			if (gain < best)
+			{
+				best = gain;
+				bestGain = 1 + side * 2 + g;
+			}
+		}
+	}
+
+	if (bestGain == 0)
+		return;
+
+	int side = (bestGain - 1) / 2;
+	int g = (bestGain - 1) % 2;
+	int moved = nodes[node].child[side];
+	int other = nodes[node].child[1 - side];
+	int grandchild = nodes[other].child[g];
+
+	nodes[node].child[side] = grandchild;
+	nodes[grandchild].parent = node;
+	nodes[other].child[g] = moved;
+	nodes[moved].parent = other;
+	nodes[other].box = unionAABB(nodes[nodes[other].child[0]].box, nodes[nodes[other].child[1]].box);
+}
+
+// Make the boxes of the nodes above node fit their children again, and turn them where it helps
+static void refitDynamicNodes(DynamicBVH& tree, int node)
+{
+	while (node >= 0)
+	{
+		DynamicBVHNode& n = tree.nodes[node];
+		n.box = unionAABB(tree.nodes[n.child[0]].box, tree.nodes[n.child[1]].box);
+		rotateDynamicNode(tree, node);
+		node = tree.nodes[node].parent;
+	}
+}
+
+// Put a leaf that is not in the tree next to the node where the tree grows the least (Bittner et al. 2015).
+// The cost of a place is the area of the new node, plus how much every node above it grows. A subtree cannot cost
+// less than the area of the leaf plus how much the nodes above it grow, so it is only looked into if that is less
+// than the best place so far, and the cheapest subtrees are looked into first
+static void attachDynamicLeaf(DynamicBVH& tree, int leaf)
+{
+	std::vector<DynamicBVHNode>& nodes = tree.nodes;
+
+	if (tree.root < 0)
+	{
+		tree.root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+
+	const AABB box = nodes[leaf].box;
+	float leafArea = surfaceArea(box);
+	int best = tree.root;
+	float bestCost = surfaceArea(unionAABB(nodes[tree.root].box, box));
+
+	typedef std::pair<float, int> Candidate;
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> open;
+	open.push(Candidate(0.0f, tree.root));
+
+	while (!open.empty())
+	{
+		float inherited = open.top().first;
+		int node = open.top().second;
+		open.pop();
+
+		if (inherited + leafArea >= bestCost)
+			break;
+
+		float direct = surfaceArea(unionAABB(nodes[node].box, box));
+
+		if (direct + inherited < bestCost)
+		{
+			bestCost = direct + inherited;
+			best = node;
+		}
+
+		if (nodes[node].child[0] < 0)
+			continue;
+
+		float childInherited = inherited + direct - surfaceArea(nodes[node].box);
+
+		if (childInherited + leafArea < bestCost)
+		{
+			open.push(Candidate(childInherited, nodes[node].child[0]));
+			open.push(Candidate(childInherited, nodes[node].child[1]));
+		}
+	}
+
+	// a new node takes the place of best, with best and the leaf under it
+	int parent = allocateDynamicNode(tree);
+	int oldParent = nodes[best].parent;
+
+	nodes[parent].parent = oldParent;
+	nodes[parent].child[0] = best;
+	nodes[parent].child[1] = leaf;
+	nodes[parent].item = -1;
+	nodes[best].parent = parent;
+	nodes[leaf].parent = parent;
+
+	if (oldParent < 0)
+		tree.root = parent;
+	else
+		nodes[oldParent].child[nodes[oldParent].child[0] == best ? 0 : 1] = parent;
+
+	refitDynamicNodes(tree, parent);
+}
+
+// Take a leaf out of the tree, without freeing its node. Its sibling takes the place of their parent
+static void detachDynamicLeaf(DynamicBVH& tree, int leaf)
+{
+	std::vector<DynamicBVHNode>& nodes = tree.nodes;
+
+	if (leaf == tree.root)
+	{
+		tree.root = -1;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandparent = nodes[parent].parent;
+	int sibling = nodes[parent].child[nodes[parent].child[0] == leaf ? 1 : 0];
+
+	nodes[sibling].parent = grandparent;
+	tree.freeNodes.push_back(parent);
+
+	if (grandparent < 0)
+	{
+		tree.root = sibling;
+		return;
+	}
+
+	nodes[grandparent].child[nodes[grandparent].child[0] == parent ? 0 : 1] = sibling;
+	refitDynamicNodes(tree, grandparent);
+}
+
+static AABB fattenAABB(const AABB& box)
+{
+	glm::vec3 margin = (box.max - box.min) * DYNAMIC_BVH_FATTEN;
+	AABB fat = { box.min - margin, box.max + margin };
+	return fat;
+}
+
+int insertDynamicLeaf(DynamicBVH& tree, const AABB& box, int item)
+{
+	int leaf = allocateDynamicNode(tree);
+	tree.nodes[leaf].box = fattenAABB(box);
+	tree.nodes[leaf].child[0] = -1;
+	tree.nodes[leaf].child[1] = -1;
+	tree.nodes[leaf].item = item;
+
+	attachDynamicLeaf(tree, leaf);
+	tree.leafCount++;
+	return leaf;
+}
+
+void removeDynamicLeaf(DynamicBVH& tree, int leaf)
+{
+	detachDynamicLeaf(tree, leaf);
+	tree.freeNodes.push_back(leaf);
+	tree.leafCount--;
+}
+
+bool moveDynamicLeaf(DynamicBVH& tree, int leaf, const AABB& box)
+{
+	if (insideAABB(box, tree.nodes[leaf].box))
+		return false;
+
+	detachDynamicLeaf(tree, leaf);
+	tree.nodes[leaf].box = fattenAABB(box);
+	attachDynamicLeaf(tree, leaf);
+	return true;
+}
+
+void flattenDynamicBVH(const DynamicBVH& tree, const std::vector<AABB>& itemBoxes, std::vector<BVHNode>& nodes, std::vector<int>& order)
+{
+	nodes.clear();
+	order.clear();
+	nodes.resize(1);
+
+	if (tree.root < 0)
+	{
+		nodes[0].min = glm::vec3(1e30f);
+		nodes[0].max = glm::vec3(-1e30f);
+		nodes[0].left = ~0;
+		nodes[0].right = 0;
+		return;
+	}
+
+	// Every node is written where its parent made room for it, in the order that buildNode makes them.
+	// The boxes are made on the way back up, so "path" keeps the nodes that are still waiting for their children
+	struct Pending { int source; int index; };
+	std::vector<Pending> stack;
+	std::vector<Pending> path;
+	stack.push_back({ tree.root, 0 });
+
+	while (!stack.empty())
+	{
+		Pending p = stack.back();
+		stack.pop_back();
+
+		const DynamicBVHNode& n = tree.nodes[p.source];
+
+		if (n.child[0] < 0)
+		{
+			const AABB& box = itemBoxes[n.item];
+			nodes[p.index].min = box.min;
+			nodes[p.index].max = box.max;
+			nodes[p.index].left = ~(int)order.size();
+			nodes[p.index].right = 1;
+			order.push_back(n.item);
+			continue;
+		}
+
+		int left = (int)nodes.size();
+		nodes.resize(nodes.size() + 2);
+		nodes[p.index].left = left;
+		nodes[p.index].right = left + 1;
+		path.push_back(p);
+
+		stack.push_back({ n.child[1], left + 1 });
+		stack.push_back({ n.child[0], left });
+	}
+
+	// a parent is always before its children, so going backwards makes the children first
+	for (int i = (int)path.size() - 1; i >= 0; i--)
+	{
+		BVHNode& node = nodes[path[i].index];
+		node.min = glm::min(nodes[node.left].min, nodes[node.right].min);
+		node.max = glm::max(nodes[node.left].max, nodes[node.right].max);
+	}
+}
@@ -0,0 +1,172 @@
+/*
+Title: Basic Ray Tracer
+File Name: BVH.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A small BVH builder that runs on the CPU. It is used for the two-level
+BVH: one BVH per mesh (the bottom level, or BLAS) which is built once,
+and one BVH over all of the meshes (the top level, or TLAS) which is
+rebuilt every frame. The nodes are exactly the same as the nodes that
+BuildBVH.glsl makes on the GPU, so the fragment shader can walk both.
+
+There are two builders. buildBVH is a quick median split, which is good
+enough for the TLAS, because it is rebuilt every frame anyway. The BLAS
+never changes, so it uses buildBVHSAH, which takes longer but makes a
+better tree, and it can be saved to a file so that the next run of the
+program does not need to build it at all (see buildBVHCached).
+
+A finished binary BVH can also be turned into a "wide" BVH, where every
+node has 4 children instead of 2 (see collapseBVH4). The boxes of the
+children are stored with 8 bits per side instead of a float, so one wide
+node (64 bytes) holds 4 boxes in the space of two binary nodes.
+
+The nodes of a BVH that never changes can also be put in a new order once
+it is known how often the rays visit each of them (see layoutBVHByVisits),
+so that the nodes the rays need most are in the fewest cache lines.
+
+A DynamicBVH is a TLAS that is not built again every frame: leaves are
+put into it and taken out of it one at a time (insertion-based SAH), for
+scenes where only a few of many instances change (see --incremental-tlas).
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+// One node of a BVH. This matches BVHNode in the shaders (32 bytes, std430)
+// Interior node: left and right are the indices of the two children
+// Leaf node: left is the bitwise-not (~) of the first primitive, and right is the number of primitives
+struct BVHNode {
+	glm::vec3 min;
+	int left;
+	glm::vec3 max;
+	int right;
+};
+
+// An axis-aligned bounding box
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// A box that contains nothing, growing it with any point gives a box around that point
+AABB emptyAABB();
+
+// Make the box big enough to hold a point, or another box
+void growAABB(AABB& box, glm::vec3 point);
+void growAABB(AABB& box, const AABB& other);
+
+// The box around a box that was moved by a matrix, which is the
+// box around all 8 corners after they were moved
+AABB transformAABB(const AABB& box, const glm::mat4& matrix);
+
+// Build a BVH over a list of boxes (one box per triangle, or one box per mesh).
+// Node 0 is the root. A leaf holds at most maxLeafSize boxes.
+// The leaves point into "order", which is the list of box indices, sorted so that the
+// boxes in each leaf are next to each other. The caller should put its triangles (or meshes)
+// in that order, so that leaf "left = ~first, right = count" points at the right ones.
+void buildBVH(const std::vector<AABB>& boxes, int maxLeafSize, std::vector<BVHNode>& nodes, std::vector<int>& order);
+
+// Build a BVH with the Surface Area Heuristic (SAH). At every node, we try splitting the boxes
+// into 16 "bins" on every axis, and pick the split where a ray would need to test the fewest triangles.
+// The result looks exactly like the result of buildBVH, so both can be used the same way.
+// Big subtrees are built in jobs (see JobSystem.h) at the same time, which is why this is fast enough for big meshes
+void buildBVHSAH(const std::vector<AABB>& boxes, int maxLeafSize, std::vector<BVHNode>& nodes, std::vector<int>& order);
+
+// A number that only depends on the boxes and maxLeafSize, so two
+// calls with the same input always get the same hash (FNV-1a, 64 bits)
+uint64_t hashBVHInput(const std::vector<AABB>& boxes, int maxLeafSize);
+
+// Same as buildBVHSAH, but first this looks in cacheFolder for a file with the content hash of
+// the boxes in its name. If it is there, the tree is read from the file instead of built.
+// If not, the tree is built and saved there for next time. Returns true if the file was used
+bool buildBVHCached(const std::vector<AABB>& boxes, int maxLeafSize, const char* cacheFolder, std::vector<BVHNode>& nodes, std::vector<int>& order);
+
+// One node of a wide BVH, with up to 4 children. This matches WideBVHNode in FragmentShader.glsl (64 bytes, std430).
+// The box of child c is origin + q * scale, where q is a number from 0 to 255, which is byte c of loX, loY, loZ
+// (the min side of the box) or hiX, hiY, hiZ (the max side of the box).
+// child[c] >= 0 is the index of another wide node. child[c] == -1 means there is no child there.
+// Otherwise child[c] is a leaf, and ~child[c] is (first primitive << 3) | number of primitives
+struct WideBVHNode {
+	glm::vec3 origin;
+	uint32_t loX;
+	glm::vec3 scale;
+	uint32_t loY;
+	uint32_t loZ;
+	uint32_t hiX;
+	uint32_t hiY;
+	uint32_t hiZ;
+	int child[4];
+};
+
+// A wide leaf can hold at most this many primitives, because the count has 3 bits
+#define WIDE_BVH_MAX_LEAF_SIZE 7
+
+// Turn a binary BVH (from buildBVH or buildBVHSAH) into a wide BVH. Node 0 of "wide" is the root.
+// The leaves point to the same primitives as before, so "order" does not change.
+// Every leaf of the binary BVH must hold at most WIDE_BVH_MAX_LEAF_SIZE primitives
+void collapseBVH4(const std::vector<BVHNode>& binary, std::vector<WideBVHNode>& wide);
+
+// Put the count nodes of the BVH that starts at root (node root, up to root + count - 1) in a new order by how many
+// times they were visited (visits, by index). The nodes are cut into treelets of treeletSize nodes: a treelet starts
+// at a node, and takes the most visited node under the ones it has until it is full. The treelets are stored one
+// after another, the most visited first, so the nodes that rays visit one after another share cache lines, and the
+// nodes that are hardly visited are at the end. The root stays where it is, and the leaves point to the same primitives
+void layoutBVHByVisits(std::vector<BVHNode>& nodes, int root, int count, const std::vector<uint32_t>& visits, int treeletSize);
+
+// One node of a DynamicBVH. child[0] is -1 for a leaf, and item is then the number that the caller gave it.
+// The box of a leaf is its fat box, a bit bigger than the box it was given, so a leaf that moves a little stays
+// where it is in the tree (see moveDynamicLeaf)
+struct DynamicBVHNode {
+	AABB box;
+	int parent;
+	int child[2];
+	int item;
+};
+
+// A BVH with one item per leaf, that leaves can be put into and taken out of without building it again.
+// A leaf goes next to the node where it adds the least surface area to the tree (found with branch and bound),
+// and the nodes above it are turned (a child swapped with a grandchild) where that makes them smaller, so the tree
+// stays good after many changes. The nodes of the leaves that were taken out are used again, so the number of
+// a leaf stays the same as long as it is in the tree
+struct DynamicBVH {
+	std::vector<DynamicBVHNode> nodes;
+	std::vector<int> freeNodes;
+	int root = -1;
+	int leafCount = 0;
+};
+
+// Put a box into the tree, and return its leaf
+int insertDynamicLeaf(DynamicBVH& tree, const AABB& box, int item);
+
+// Take a leaf out of the tree
+void removeDynamicLeaf(DynamicBVH& tree, int leaf);
+
+// Give a leaf a new box. It is only put somewhere else in the tree if the box is not inside of its fat box
+// anymore, and then it returns true
+bool moveDynamicLeaf(DynamicBVH& tree, int leaf, const AABB& box);
+
+// Write the tree the way buildBVH with maxLeafSize 1 does, for the shaders: node 0 is the root, and leaf
+// "left = ~k, right = 1" is item order[k]. The boxes are the exact boxes of itemBoxes (by item), not the fat ones
+void flattenDynamicBVH(const DynamicBVH& tree, const std::vector<AABB>& itemBoxes, std::vector<BVHNode>& nodes, std::vector<int>& order);
@@ -0,0 +1,157 @@
+/*
+Title: Basic Ray Tracer
+File Name: BlueNoise.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BlueNoise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// How far the energy of one point reaches, in texels
+#define BLUE_NOISE_SIGMA 1.5f
+
+// One point in ten is in the first set
+#define BLUE_NOISE_START_DENSITY 10
+
+namespace
+{
+	// The texels that are on, and the energy that they give every texel
+	struct NoisePattern
+	{
+		int size;
+		std::vector<float> kernel;
+		std::vector<bool> on;
+		std::vector<float> energy;
+
+		// Turn texel p on or off, and add its Gaussian to the energy of every texel, or take it away
+		void set(int p, bool value)
+		{
+			on[p] = value;
+			float sign = value ? 1.0f : -1.0f;
+			int px = p % size;
+			int py = p / size;
+
+			for (int y = 0; y < size; y++)
+			{
+				int dy = (y - py + size) % size;
+
+				for (int x = 0; x < size; x++)
+				{
+					int dx = (x - px + size) % size;
+					energy[y * size + x] += sign * kernel[dy * size + dx];
+				}
+			}
+		}
+
+		// The texel that is on and has the most energy, or the one that is off and has the least
+		int find(bool value) const
+		{
+			int best = -1;
+
+			for (int p = 0; p < (int)on.size(); p++)
+			{
+				if (on[p] != value)
+					continue;
+
+				if (best < 0 || (value ? energy[p] > energy[best] : energy[p] < energy[best]))
+					best = p;
+			}
+
+			return best;
+		}
+	};
+}
+
+std::vector<unsigned short> makeBlueNoise(int size)
+{
+	int n = size * size;
+
+	NoisePattern pattern;
+	pattern.size = size;
+	pattern.kernel.resize(n);
+	pattern.on.assign(n, false);
+	pattern.energy.assign(n, 0.0f);
+
+	// the distance wraps around the tile, so the kernel of an offset is the one of its shortest way
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			float dx = (float)std::min(x, size - x);
+			float dy = (float)std::min(y, size - y);
+			pattern.kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+		}
+	}
+
+	// the first points at random, with a fixed seed, so that the tile is the same every time
+	std::mt19937 rng(1);
+	int first = std::max(1, n / BLUE_NOISE_START_DENSITY);
+
+	for (int placed = 0; placed < first;)
+	{
+		int p = (int)(rng() % (unsigned int)n);
+
+		if (pattern.on[p])
+			continue;
+
+		pattern.set(p, true);
+		placed++;
+	}
+
+	// Move the tightest cluster into the largest void, until the point that was taken out is the largest void itself.
+	// This always ends in practice, but it is stopped after every point has had a chance to move, to be sure
+	for (int moves = 0; moves < n; moves++)
+	{
+		int cluster = pattern.find(true);
+		pattern.set(cluster, false);
+
+		int gap = pattern.find(false);
+		pattern.set(gap, true);
+
+		if (gap == cluster)
+			break;
+	}
+
+	std::vector<unsigned short> rank(n);
+	NoisePattern start = pattern;
+
+	// the first points get the ranks below first, the tightest cluster the highest of them
+	for (int r = first - 1; r >= 0; r--)
+	{
+		int cluster = pattern.find(true);
+		pattern.set(cluster, false);
+		rank[cluster] = (unsigned short)r;
+	}
+
+	// and every other texel gets the next rank when it is the largest void
+	pattern = start;
+
+	for (int r = first; r < n; r++)
+	{
+		int gap = pattern.find(false);
+		pattern.set(gap, true);
+		rank[gap] = (unsigned short)r;
+	}
+
+	return rank;
+}
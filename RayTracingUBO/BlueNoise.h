@@ -0,0 +1,50 @@
+/*
+Title: Basic Ray Tracer
+File Name: BlueNoise.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The blue noise of --sampler blue (see Sampling.glsl). A blue noise tile
+is a square of every number from 0 to size * size - 1, one per texel,
+placed so that numbers that are close to each other are never close on
+the tile: any threshold of it is a set of points that are spread out
+evenly, with no clumps and no holes. Random numbers that are taken from
+it are still random for every pixel, but the pixels next to each other
+get different ones, so the noise of one frame has no low frequencies,
+which the eye sees the least and a blur takes out the best.
+
+It is made with void-and-cluster (Ulichney 1993). Every texel that is on
+spreads a Gaussian of energy over the tile (which wraps around, so the
+tile repeats without seams). A first set of points is moved from the
+tightest cluster (the point with the most energy) into the largest void
+(the empty texel with the least) until they are even. Then those points
+are numbered from the last, by taking out the tightest cluster, and the
+rest from there on, by filling the largest void, one at a time.
+*/
+
+#pragma once
+
+#include <vector>
+
+// The tile is this many texels across, must match BLUE_NOISE_SIZE in Sampling.glsl
+#define BLUE_NOISE_SIZE 64
+
+// Make a blue noise tile of size x size, with its texels in rows. The same every time
+std::vector<unsigned short> makeBlueNoise(int size);
@@ -0,0 +1,101 @@
+/*
+Title: Basic Ray Tracer
+File Name: CpuArena.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CpuArena.h"
+
+#include <algorithm>
+
+#include "Platform.h"
+
+CpuArena cpuSceneArena;
+
+void* cpuArenaAlloc(CpuArena& arena, size_t bytes)
+{
+	bytes = (bytes + CPU_ARENA_ALIGNMENT - 1) / CPU_ARENA_ALIGNMENT * CPU_ARENA_ALIGNMENT;
+
+	std::lock_guard<std::mutex> lock(arena.lock);
+
+	if (arena.chunks.empty() || arena.chunks.back().size - arena.chunks.back().used < bytes)
+	{
+		// the rest of the last chunk is left, a vector that grew out of it would not fit there anyway
+		CpuArenaChunk chunk;
+		chunk.size = std::max(bytes, CPU_ARENA_CHUNK_BYTES);
+		chunk.used = 0;
+		chunk.memory = (char*)allocateLargePages(chunk.size, arena.huge, chunk.large);
+
+		if (chunk.memory == nullptr)
+			throw std::bad_alloc();
+
+		arena.chunks.push_back(chunk);
+	}
+
+	CpuArenaChunk& chunk = arena.chunks.back();
+	void* memory = chunk.memory + chunk.used;
+	chunk.used += bytes;
+	return memory;
+}
+
+bool cpuArenaOwns(CpuArena& arena, const void* memory)
+{
+	std::lock_guard<std::mutex> lock(arena.lock);
+
+	for (const CpuArenaChunk& chunk : arena.chunks)
+	{
+		if (memory >= chunk.memory && memory < chunk.memory + chunk.size)
+			return true;
+	}
+
+	return false;
+}
+
+void cpuArenaRelease(CpuArena& arena)
+{
+	std::lock_guard<std::mutex> lock(arena.lock);
+
+	for (const CpuArenaChunk& chunk : arena.chunks)
+		freeLargePages(chunk.memory, chunk.size);
+
+	arena.chunks.clear();
+}
+
+size_t cpuArenaBytes(CpuArena& arena)
+{
+	std::lock_guard<std::mutex> lock(arena.lock);
+	size_t bytes = 0;
+
+	for (const CpuArenaChunk& chunk : arena.chunks)
+		bytes += chunk.size;
+
+	return bytes;
+}
+
+size_t cpuArenaLargeBytes(CpuArena& arena)
+{
+	std::lock_guard<std::mutex> lock(arena.lock);
+	size_t bytes = 0;
+
+	for (const CpuArenaChunk& chunk : arena.chunks)
+		bytes += chunk.large ? chunk.size : 0;
+
+	return bytes;
+}
@@ -0,0 +1,130 @@
+/*
+Title: Basic Ray Tracer
+File Name: CpuArena.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Memory for the scene of the CPU renderer in large pages (--large-pages).
+The rays of a frame jump all over the BVH and the blocks of triangles,
+and with 4 KB pages, a scene of a few GB is far more pages than the TLB of
+a core holds, so many steps of a ray also miss in the TLB and wait for a
+walk of the page tables. A 2 MB page covers 512 times as much, and a 1 GB
+page (--large-pages 1g, on Linux with 1 GB pages set aside at boot) all
+of a big scene. The pages come from allocateLargePages in Platform.h:
+VirtualAlloc with MEM_LARGE_PAGES on Windows (which needs the privilege to
+lock memory), and transparent huge pages (madvise) on Linux. Where the OS
+does not give large pages, the arena still works, with normal pages.
+
+The arena takes chunks of at least CPU_ARENA_CHUNK_BYTES from the OS and
+hands them out in order. Nothing is given back on its own: the vectors of
+CpuScene keep their memory from frame to frame, so after the first frames
+they take nothing new, and all of it is given back at once when the scene
+is unloaded (cpuArenaRelease). Without --large-pages, CpuArenaAllocator is
+new and delete, like the allocator of any other vector.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Every chunk is at least this big (a whole number of 2 MB pages), and what it hands out starts on a cache line
+#define CPU_ARENA_CHUNK_BYTES ((size_t)64 << 20)
+#define CPU_ARENA_ALIGNMENT 64
+
+// One piece of memory from the OS, of which used bytes are handed out
+struct CpuArenaChunk
+{
+	char* memory;
+	size_t size;
+	size_t used;
+	bool large;
+};
+
+// enabled and huge are set before anything is allocated, and stay the same until cpuArenaRelease
+struct CpuArena
+{
+	bool enabled = false;
+	bool huge = false;
+	std::mutex lock;
+	std::vector<CpuArenaChunk> chunks;
+};
+
+// The arena of the blocks, surfaces, and nodes of every CpuScene
+extern CpuArena cpuSceneArena;
+
+// bytes of the arena, from its last chunk, or from a new one. Throws std::bad_alloc if the OS has no more
+void* cpuArenaAlloc(CpuArena& arena, size_t bytes);
+
+// If memory is in one of the chunks of the arena
+bool cpuArenaOwns(CpuArena& arena, const void* memory);
+
+// Give every chunk back to the OS. Nothing that was allocated from the arena may be used after this
+void cpuArenaRelease(CpuArena& arena);
+
+// How many bytes the chunks of the arena have, and how many of them are in large pages
+size_t cpuArenaBytes(CpuArena& arena);
+size_t cpuArenaLargeBytes(CpuArena& arena);
+
+// The allocator of the vectors that are in the arena. It frees nothing that is in the arena (see cpuArenaRelease),
+// and without enabled, it is new and delete
+template <typename T>
+struct CpuArenaAllocator
+{
+	typedef T value_type;
+
+	CpuArena* arena = &cpuSceneArena;
+
+	CpuArenaAllocator() = default;
+
+	template <typename U>
+	CpuArenaAllocator(const CpuArenaAllocator<U>& other) : arena(other.arena)
+	{
+	}
+
+	T* allocate(size_t count)
+	{
+		if (!arena->enabled)
+			return static_cast<T*>(::operator new(count * sizeof(T)));
+
+		return static_cast<T*>(cpuArenaAlloc(*arena, count * sizeof(T)));
+	}
+
+	void deallocate(T* memory, size_t count)
+	{
+		(void)count;
+		if (!cpuArenaOwns(*arena, memory))
+			::operator delete(memory);
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const CpuArenaAllocator<T>& a, const CpuArenaAllocator<U>& b)
+{
+	return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const CpuArenaAllocator<T>& a, const CpuArenaAllocator<U>& b)
+{
+	return a.arena != b.arena;
+}
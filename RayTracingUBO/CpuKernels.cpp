@@ -0,0 +1,233 @@
+/*
+Title: Basic Ray Tracer
+File Name: CpuKernels.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "CpuKernels.h"
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Visual Studio compiles AVX intrinsics in any function, other compilers only in functions that ask for them.
+// Nothing else in the program is compiled for AVX, so it still runs on CPUs without it
+#ifdef _MSC_VER
+#define CPU_TARGET_AVX
+#else
+#define CPU_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+void clearTriangleBlock(CpuTriangleBlock& block, int first, int count)
+{
+	memset(&block, 0, sizeof(block));
+	block.first = first;
+	block.count = count;
+}
+
+void setTriangleBlockLane(CpuTriangleBlock& block, int lane, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 normal)
+{
+	glm::vec3 e1 = b - a;
+	glm::vec3 e2 = c - a;
+
+	block.v0x[lane] = a.x; block.v0y[lane] = a.y; block.v0z[lane] = a.z;
+	block.e1x[lane] = e1.x; block.e1y[lane] = e1.y; block.e1z[lane] = e1.z;
+	block.e2x[lane] = e2.x; block.e2y[lane] = e2.y; block.e2z[lane] = e2.z;
+	block.nx[lane] = normal.x; block.ny[lane] = normal.y; block.nz[lane] = normal.z;
+}
+
+// One lane at a time, which is Moller-Trumbore of TriangleKernels.glsl
+static int intersectBlockScalar(const CpuTriangleBlock& block, glm::vec3 p, glm::vec3 d, float& tmax, bool anyHit)
+{
+	int hitLane = -1;
+
+	for (int i = 0; i < block.count; i++)
+	{
+		// the triangles that face away from the ray are skipped, like testTriangle
+		if (glm::dot(glm::vec3(block.nx[i], block.ny[i], block.nz[i]), d) > 0.0f)
+			continue;
+
+		glm::vec3 e1(block.e1x[i], block.e1y[i], block.e1z[i]);
+		glm::vec3 e2(block.e2x[i], block.e2y[i], block.e2z[i]);
+
+		glm::vec3 h = glm::cross(d, e2);
+		float a = glm::dot(e1, h);
+
+		if (a > -CPU_TRIANGLE_EPSILON && a < CPU_TRIANGLE_EPSILON)
+			continue;
+
+		float f = 1.0f / a;
+		glm::vec3 s = p - glm::vec3(block.v0x[i], block.v0y[i], block.v0z[i]);
+		float u = f * glm::dot(s, h);
+
+		if (u < 0.0f || u > 1.0f)
+			continue;
+
+		glm::vec3 q = glm::cross(s, e1);
+		float t = f * glm::dot(e2, q);
+
+		if (t <= CPU_TRIANGLE_EPSILON || t >= tmax)
+			continue;
+
+		float v = f * glm::dot(d, q);
+
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+
+		tmax = t;
+		hitLane = i;
+
+		if (anyHit)
+			break;
+	}
+
+	return hitLane;
+}
+
+// the lowest bit that is set in mask, which is not 0
+static int lowestBit(int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, (unsigned long)mask);
+	return (int)index;
+#else
+	return __builtin_ctz((unsigned int)mask);
+#endif
+}
+
+// All 8 lanes at once, with the same operations in the same order as intersectBlockScalar,
+// so that both find the same hits at the same distances
+CPU_TARGET_AVX static int intersectBlockAVX(const CpuTriangleBlock& block, glm::vec3 p, glm::vec3 d, float& tmax, bool anyHit)
+{
+	__m256 dx = _mm256_set1_ps(d.x);
+	__m256 dy = _mm256_set1_ps(d.y);
+	__m256 dz = _mm256_set1_ps(d.z);
+
+	__m256 e1x = _mm256_loadu_ps(block.e1x);
+	__m256 e1y = _mm256_loadu_ps(block.e1y);
+	__m256 e1z = _mm256_loadu_ps(block.e1z);
+	__m256 e2x = _mm256_loadu_ps(block.e2x);
+	__m256 e2y = _mm256_loadu_ps(block.e2y);
+	__m256 e2z = _mm256_loadu_ps(block.e2z);
+
+	// back faces
+	__m256 facing = _mm256_add_ps(_mm256_add_ps(
+		_mm256_mul_ps(_mm256_loadu_ps(block.nx), dx),
+		_mm256_mul_ps(_mm256_loadu_ps(block.ny), dy)),
+		_mm256_mul_ps(_mm256_loadu_ps(block.nz), dz));
+	__m256 hit = _mm256_cmp_ps(facing, _mm256_setzero_ps(), _CMP_LE_OQ);
+
+	// h = cross(d, e2), a = dot(e1, h)
+	__m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+	__m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+	__m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+	__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+
+	__m256 epsilon = _mm256_set1_ps(CPU_TRIANGLE_EPSILON);
+	__m256 parallel = _mm256_and_ps(
+		_mm256_cmp_ps(a, _mm256_set1_ps(-CPU_TRIANGLE_EPSILON), _CMP_GT_OQ),
+		_mm256_cmp_ps(a, epsilon, _CMP_LT_OQ));
+	hit = _mm256_andnot_ps(parallel, hit);
+
+	// the parallel lanes divide by 0 here, but they have already missed
+	__m256 f = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+
+	// u = f * dot(s, h)
+	__m256 sx = _mm256_sub_ps(_mm256_set1_ps(p.x), _mm256_loadu_ps(block.v0x));
+	__m256 sy = _mm256_sub_ps(_mm256_set1_ps(p.y), _mm256_loadu_ps(block.v0y));
+	__m256 sz = _mm256_sub_ps(_mm256_set1_ps(p.z), _mm256_loadu_ps(block.v0z));
+	__m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+
+	__m256 one = _mm256_set1_ps(1.0f);
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+
+	// q = cross(s, e1), t = f * dot(e2, q), v = f * dot(d, q)
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(e1y, sz));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(e1z, sx));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(e1x, sy));
+	__m256 t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+	__m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, epsilon, _CMP_GT_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(tmax), _CMP_LT_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+
+	int mask = _mm256_movemask_ps(hit);
+
+	if (mask == 0)
+		return -1;
+
+	if (!anyHit)
+	{
+		// the smallest t of the lanes that hit, in every lane, and then the first lane that has it
+		__m256 tHit = _mm256_blendv_ps(_mm256_set1_ps(tmax), t, hit);
+		__m256 smallest = _mm256_min_ps(tHit, _mm256_permute2f128_ps(tHit, tHit, 1));
+		smallest = _mm256_min_ps(smallest, _mm256_permute_ps(smallest, _MM_SHUFFLE(1, 0, 3, 2)));
+		smallest = _mm256_min_ps(smallest, _mm256_permute_ps(smallest, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		mask &= _mm256_movemask_ps(_mm256_cmp_ps(tHit, smallest, _CMP_EQ_OQ));
+	}
+
+	int lane = lowestBit(mask);
+	float lanes[CPU_BLOCK_WIDTH];
+	_mm256_storeu_ps(lanes, t);
+
+	tmax = lanes[lane];
+	return lane;
+}
+
+const CpuBlockKernel cpuBlockKernels[NUM_CPU_KERNELS] = { intersectBlockScalar, intersectBlockAVX };
+const char* cpuKernelNames[NUM_CPU_KERNELS] = { "scalar", "avx" };
+
+// AVX needs the CPU to have it, and the OS to save the 256-bit registers when it switches threads
+static bool cpuHasAVX()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+
+	return avx && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+
+bool cpuKernelSupported(int k)
+{
+	if (k == CPU_KERNEL_AVX)
+		return cpuHasAVX();
+
+	return true;
+}
+
+int pickCpuBlockKernel()
+{
+	return cpuKernelSupported(CPU_KERNEL_AVX) ? CPU_KERNEL_AVX : CPU_KERNEL_SCALAR;
+}
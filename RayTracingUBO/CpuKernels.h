@@ -0,0 +1,82 @@
+/*
+Title: Basic Ray Tracer
+File Name: CpuKernels.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The ray-triangle tests of the CPU renderer (CpuRenderer.cpp). A leaf of
+its BVH holds at most WIDE_BVH_MAX_LEAF_SIZE triangles, the leaves that
+collapseBVH4 makes, so all the triangles of a leaf fit in one block of 8.
+A block keeps every coordinate of its triangles in its own array
+(structure of arrays), so that 8 triangles are one load, and the AVX
+kernel tests one ray against all 8 of them at once, with the same math as
+Moller-Trumbore in TriangleKernels.glsl. The scalar kernel tests them one
+at a time, for CPUs without AVX, and both give the same hits.
+
+Which one is used is picked when the program runs (pickCpuBlockKernel),
+not when it is compiled, so the same executable runs on every CPU.
+*/
+
+#pragma once
+
+#include "glm/glm.hpp"
+
+// How many triangles a block holds, the 8 floats of an AVX register
+#define CPU_BLOCK_WIDTH 8
+
+// the epsilon of intersectTriangleRecord in TriangleKernels.glsl, and the closest hit a ray can have
+#define CPU_TRIANGLE_EPSILON 0.00001f
+
+// Up to 8 triangles in the world, as structure of arrays: the first point, the two edges from it,
+// and the normal, which culls the back faces. Lanes from count to 7 are zero, and a zero triangle
+// never passes the test, so the kernels do not need to know count
+struct CpuTriangleBlock
+{
+	float v0x[CPU_BLOCK_WIDTH], v0y[CPU_BLOCK_WIDTH], v0z[CPU_BLOCK_WIDTH];
+	float e1x[CPU_BLOCK_WIDTH], e1y[CPU_BLOCK_WIDTH], e1z[CPU_BLOCK_WIDTH];
+	float e2x[CPU_BLOCK_WIDTH], e2y[CPU_BLOCK_WIDTH], e2z[CPU_BLOCK_WIDTH];
+	float nx[CPU_BLOCK_WIDTH], ny[CPU_BLOCK_WIDTH], nz[CPU_BLOCK_WIDTH];
+
+	// lane i is triangle first + i
+	int first;
+	int count;
+};
+
+// Empty every lane of a block, and put the triangle a, b, c with its normal into one of them
+void clearTriangleBlock(CpuTriangleBlock& block, int first, int count);
+void setTriangleBlockLane(CpuTriangleBlock& block, int lane, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 normal);
+
+// Test the ray from origin along dir against the triangles of a block that face it.
+// Returns the lane of the closest one that is closer than tmax, and sets tmax to its distance,
+// or returns -1 if none is. With anyHit, the first lane that is hit is returned instead of the closest
+typedef int (*CpuBlockKernel)(const CpuTriangleBlock& block, glm::vec3 origin, glm::vec3 dir, float& tmax, bool anyHit);
+
+// --cpu-kernel, in the order of cpuBlockKernels
+#define CPU_KERNEL_SCALAR 0
+#define CPU_KERNEL_AVX 1
+#define NUM_CPU_KERNELS 2
+extern const CpuBlockKernel cpuBlockKernels[NUM_CPU_KERNELS];
+extern const char* cpuKernelNames[NUM_CPU_KERNELS];
+
+// If this CPU, and the OS, can run kernel k
+bool cpuKernelSupported(int k);
+
+// The fastest kernel that this CPU can run
+int pickCpuBlockKernel();
@@ -0,0 +1,574 @@
+/*
+Title: Basic Ray Tracer
+File Name: CpuRenderer.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+
+#include "CpuRenderer.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// the same numbers as RayTracing.glsl
+#define CPU_MAX_SCENE_BOUNDS 100.0f
+#define CPU_BVH_STACK_SIZE 64
+
+// The leaves of the BVH are as big as the leaves of the wide BVH, which all fit in one block
+#define CPU_BVH_LEAF_SIZE WIDE_BVH_MAX_LEAF_SIZE
+
+// The features of a frame that the functions that shade a pixel are templates on (see CpuRenderer.h).
+// Without one of them, its code is left out: without CPU_FEATURE_LOD every bounce has shadows and highlights,
+// without CPU_FEATURE_REFLECTIONS maxBounces is 0, and without CPU_FEATURE_RECORD no rays are kept
+#define CPU_FEATURE_REFLECTIONS 1
+#define CPU_FEATURE_ROULETTE 2
+#define CPU_FEATURE_LOD 4
+#define CPU_FEATURE_RECORD 8
+#define CPU_FEATURES_ALL 15
+
+// The point that a ray hit, like hitinfo in RayTracing.glsl
+struct CpuHit
+{
+	glm::vec3 point;
+	int index;
+	glm::vec3 normal;
+	glm::vec3 color;
+	float reflectivity;
+};
+
+void buildCpuScene(const std::vector<triangle>& meshTriangles, const std::vector<int>& meshOffsets,
+	const std::vector<glm::mat4>& matrices, const std::vector<light>& lights, CpuScene& scene)
+{
+	PROFILE_ZONE("buildCpuScene");
+
+	int n = (int)meshTriangles.size();
+	std::vector<triangle> world(n);
+	std::vector<AABB> boxes(n);
+
+	// what Compute.glsl does: the points are moved by the matrix of their mesh,
+	// and the normal by its upper 3x3, and packed again
+	for (size_t m = 0; m + 1 < meshOffsets.size(); m++)
+	{
+		glm::mat4 matrix = matrices[m];
+		glm::mat3 turn = glm::mat3(matrix);
+
+		for (int i = meshOffsets[m]; i < meshOffsets[m + 1]; i++)
+		{
+			const triangle& t = meshTriangles[i];
+
+			world[i] = t;
+			world[i].a = glm::vec3(matrix * glm::vec4(t.a, 1.0f));
+			world[i].b = glm::vec3(matrix * glm::vec4(t.b, 1.0f));
+			world[i].c = glm::vec3(matrix * glm::vec4(t.c, 1.0f));
+			world[i].packedNormal = glm::packSnorm2x16(octEncode(glm::normalize(turn * triangleNormal(t))));
+
+			boxes[i] = emptyAABB();
+			growAABB(boxes[i], world[i].a);
+			growAABB(boxes[i], world[i].b);
+			growAABB(boxes[i], world[i].c);
+		}
+	}
+
+	// the nodes are built in a vector of their own, and copied into the memory of the scene
+	std::vector<BVHNode> nodes;
+	std::vector<int> order;
+	buildBVHSAH(boxes, CPU_BVH_LEAF_SIZE, nodes, order);
+	scene.nodes.assign(nodes.begin(), nodes.end());
+
+	// the triangles in the order of the leaves
+	scene.surfaces.resize(n);
+
+	for (int i = 0; i < n; i++)
+	{
+		const triangle& t = world[order[i]];
+		glm::vec2 redGreen = glm::unpackHalf2x16(t.packedRedGreen);
+		glm::vec2 blueReflectivity = glm::unpackHalf2x16(t.packedBlueReflectivity);
+
+		scene.surfaces[i].normal = triangleNormal(t);
+		scene.surfaces[i].color = glm::vec3(redGreen, blueReflectivity.x);
+		scene.surfaces[i].reflectivity = blueReflectivity.y;
+	}
+
+	// one block for every leaf, which the leaf points to instead of its first triangle
+	scene.blocks.clear();
+
+	for (BVHNode& node : scene.nodes)
+	{
+		if (node.left >= 0)
+			continue;
+
+		int first = ~node.left;
+		CpuTriangleBlock block;
+		clearTriangleBlock(block, first, node.right);
+
+		for (int k = 0; k < node.right; k++)
+		{
+			const triangle& t = world[order[first + k]];
+			setTriangleBlockLane(block, k, t.a, t.b, t.c, scene.surfaces[first + k].normal);
+		}
+
+		node.left = ~(int)scene.blocks.size();
+		scene.blocks.push_back(block);
+	}
+
+	scene.lights = lights;
+}
+
+// The slab test of rayIntersectsBox in RayTracing.glsl
+static float intersectCpuBox(glm::vec3 origin, glm::vec3 invDir, glm::vec3 boxMin, glm::vec3 boxMax, float tmax)
+{
+	glm::vec3 t0 = (boxMin - origin) * invDir;
+	glm::vec3 t1 = (boxMax - origin) * invDir;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float enter = std::max(std::max(tNear.x, tNear.y), tNear.z);
+	float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+
+	if (enter > exit || exit < 0.0f || enter > tmax)
+		return -1.0f;
+
+	return std::max(enter, 0.0f);
+}
+
+// intersectSceneBVH of RayTracing.glsl: the closer child is visited first, and boxes that are
+// farther than the closest triangle so far are skipped. A leaf is one call of the kernel of the scene.
+// With anyHit, the first triangle is enough
+static bool intersectCpuScene(const CpuScene& scene, glm::vec3 origin, glm::vec3 dir, float tmax, bool anyHit, CpuHit& info)
+{
+	float smallest = tmax;
+	int hitIndex = -1;
+
+	glm::vec3 safeDir = glm::vec3(
+		dir.x == 0.0f ? 0.0000001f : dir.x,
+		dir.y == 0.0f ? 0.0000001f : dir.y,
+		dir.z == 0.0f ? 0.0000001f : dir.z);
+	glm::vec3 invDir = 1.0f / safeDir;
+
+	int stack[CPU_BVH_STACK_SIZE];
+	float stackDist[CPU_BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	const BVHNode* nodes = scene.nodes.data();
+	CpuBlockKernel kernel = cpuBlockKernels[scene.kernel];
+	float tRoot = intersectCpuBox(origin, invDir, nodes[0].min, nodes[0].max, smallest);
+
+	if (tRoot >= 0.0f)
+	{
+		stack[stackSize] = 0;
+		stackDist[stackSize] = tRoot;
+		stackSize++;
+	}
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+		int n = stack[stackSize];
+
+		if (stackDist[stackSize] > smallest)
+			continue;
+
+		if (nodes[n].left < 0)
+		{
+			const CpuTriangleBlock& block = scene.blocks[~nodes[n].left];
+			int lane = kernel(block, origin, dir, smallest, anyHit);
+
+			if (lane >= 0)
+			{
+				hitIndex = block.first + lane;
+
+				if (anyHit)
+					return true;
+			}
+
+			continue;
+		}
+
+		int left = nodes[n].left;
+		int right = nodes[n].right;
+
+		float tLeft = intersectCpuBox(origin, invDir, nodes[left].min, nodes[left].max, smallest);
+		float tRight = intersectCpuBox(origin, invDir, nodes[right].min, nodes[right].max, smallest);
+
+		if (tRight >= 0.0f && (tLeft < 0.0f || tRight < tLeft))
+		{
+			std::swap(left, right);
+			std::swap(tLeft, tRight);
+		}
+
+		if (tRight >= 0.0f)
+		{
+			stack[stackSize] = right;
+			stackDist[stackSize] = tRight;
+			stackSize++;
+		}
+
+		if (tLeft >= 0.0f)
+		{
+			stack[stackSize] = left;
+			stackDist[stackSize] = tLeft;
+			stackSize++;
+		}
+	}
+
+	if (hitIndex < 0)
+		return false;
+
+	// the hit is only filled in once, for the closest triangle
+	info.point = origin + dir * smallest;
+	info.index = hitIndex;
+	info.normal = scene.surfaces[hitIndex].normal;
+	info.color = scene.surfaces[hitIndex].color;
+	info.reflectivity = scene.surfaces[hitIndex].reflectivity;
+	return true;
+}
+
+// A random number from 0 to 1, which also moves seed on to the next one (PCG hash, the same as RayTracing.glsl)
+static float cpuRandomFloat(unsigned int& seed)
+{
+	seed = seed * 747796405u + 2891336453u;
+	unsigned int word = ((seed >> ((seed >> 28u) + 4u)) ^ seed) * 277803737u;
+	word = (word >> 22u) ^ word;
+	return (float)word / 4294967296.0f;
+}
+
+// lightContribution of RayTracing.glsl
+static glm::vec3 cpuLightContribution(const light& L, glm::vec3 dirRayToPoint, const CpuHit& hit, bool specular)
+{
+	glm::vec3 pointToLight = L.pos - hit.point;
+	float dist = glm::length(pointToLight);
+
+	if (dist > L.radius)
+		return glm::vec3(0.0f);
+
+	pointToLight = glm::normalize(pointToLight);
+
+	glm::vec3 reflectedRayToPoint = glm::reflect(pointToLight, hit.normal);
+	float NdotL = glm::clamp(glm::dot(hit.normal, pointToLight), 0.0f, 1.0f);
+	float atten = glm::clamp(1.0f - (dist * dist) / (L.radius * L.radius), 0.0f, 1.0f);
+
+	glm::vec3 brightness = L.brightness * L.color * atten;
+
+	if (!specular)
+		return hit.color * brightness * NdotL;
+
+	// a negative dot product has no highlight (pow of a negative number is undefined in GLSL)
+	float specularLevel = powf(std::max(glm::dot(reflectedRayToPoint, dirRayToPoint), 0.0f), 64.0f);
+
+	return (hit.color * brightness * NdotL) + (brightness * specularLevel);
+}
+
+// addAllLightsToPixColor of RayTracing.glsl, with the shadow ray of every light that reaches the point.
+// With CPU_FEATURE_RECORD, and if record is not nullptr, the rays are added to it (see collectCpuRays)
+template <int Features>
+static glm::vec3 cpuAddAllLights(const CpuScene& scene, const CpuPathSettings& path, glm::vec3 dirRayToPoint, const CpuHit& hit, int bounce,
+	CpuRaySets* record)
+{
+	bool shadows = (Features & CPU_FEATURE_LOD) == 0 || path.lodShadowsFrom == 0 || bounce < path.lodShadowsFrom;
+	bool specular = (Features & CPU_FEATURE_LOD) == 0 || path.lodSpecularFrom == 0 || bounce < path.lodSpecularFrom;
+	glm::vec3 color(0.0f);
+
+	for (const light& L : scene.lights)
+	{
+		glm::vec3 pointToLight = L.pos - hit.point;
+		float dist = glm::length(pointToLight);
+
+		if (dist > L.radius)
+			continue;
+
+		// from the light to the point, and only surfaces at least 0.1 closer to the light than the point count
+		if ((Features & CPU_FEATURE_RECORD) != 0 && shadows && record != nullptr)
+			record->shadow.push_back({ L.pos, -glm::normalize(pointToLight), dist - 0.1f });
+
+		CpuHit unused;
+		if (shadows && intersectCpuScene(scene, L.pos, -glm::normalize(pointToLight), dist - 0.1f, true, unused))
+			continue;
+
+		color += cpuLightContribution(L, dirRayToPoint, hit, specular);
+	}
+
+	return color;
+}
+
+// continuePath of RayTracing.glsl
+template <int Features>
+static bool cpuContinuePath(const CpuPathSettings& path, float& throughput, unsigned int& seed)
+{
+	if (throughput <= 0.0f)
+		return false;
+
+	if ((Features & CPU_FEATURE_ROULETTE) != 0 && path.russianRoulette && throughput < path.rouletteThreshold)
+	{
+		float survive = throughput / path.rouletteThreshold;
+
+		if (cpuRandomFloat(seed) >= survive)
+			return false;
+
+		throughput /= survive;
+		return true;
+	}
+
+	return throughput >= path.throughputEpsilon;
+}
+
+// addReflectionToPixColor of RayTracing.glsl
+template <int Features>
+static glm::vec3 cpuAddReflection(const CpuScene& scene, const CpuPathSettings& path, glm::vec3 dir, CpuHit hit, unsigned int& seed,
+	CpuRaySets* record)
+{
+	glm::vec3 color(0.0f);
+	float throughput = hit.reflectivity;
+
+	for (int i = 0; i < path.maxBounces; i++)
+	{
+		if (!cpuContinuePath<Features>(path, throughput, seed))
+			break;
+
+		glm::vec3 reflected = glm::reflect(dir, hit.normal);
+		CpuHit reflectHit;
+
+		if ((Features & CPU_FEATURE_RECORD) != 0 && record != nullptr)
+			record->reflection.push_back({ hit.point, reflected, CPU_MAX_SCENE_BOUNDS });
+
+		if (!intersectCpuScene(scene, hit.point, reflected, CPU_MAX_SCENE_BOUNDS, false, reflectHit))
+			break;
+
+		color += cpuAddAllLights<Features>(scene, path, reflected, reflectHit, i + 1, record) * throughput;
+		throughput *= reflectHit.reflectivity;
+
+		dir = reflected;
+		hit = reflectHit;
+	}
+
+	return color;
+}
+
+// The color of a pixel, which is main in FragmentShader.glsl, and shade in ShadePixel.glsl
+template <int Features>
+static glm::vec3 cpuShadePixel(const CpuScene& scene, const cameraView& camera, const CpuPathSettings& path, int x, int y, int width, int height,
+	CpuRaySets* record)
+{
+	// the middle of the pixel, like textureCoord at gl_FragCoord
+	glm::vec2 pos((x + 0.5f) / width, (y + 0.5f) / height);
+	glm::vec3 dir = glm::normalize(glm::mix(
+		glm::mix(camera.ray00, camera.ray01, pos.y),
+		glm::mix(camera.ray10, camera.ray11, pos.y), pos.x));
+
+	CpuHit hit;
+
+	if ((Features & CPU_FEATURE_RECORD) != 0 && record != nullptr)
+		record->primary.push_back({ camera.eye, dir, CPU_MAX_SCENE_BOUNDS });
+
+	if (!intersectCpuScene(scene, camera.eye, dir, CPU_MAX_SCENE_BOUNDS, false, hit))
+		return glm::vec3(0.0f);
+
+	glm::vec3 color = hit.color * 0.1f;
+	color += cpuAddAllLights<Features>(scene, path, dir, hit, 0, record) * (1.0f - hit.reflectivity);
+
+	if ((Features & CPU_FEATURE_REFLECTIONS) != 0 && hit.reflectivity > 0.0f)
+	{
+		// pixelSeed of ShadePixel.glsl
+		unsigned int seed = (unsigned int)x + (unsigned int)y * 65536u + path.frameSeed * 2654435761u;
+		color += cpuAddReflection<Features>(scene, path, dir, hit, seed, record);
+	}
+
+	return color;
+}
+
+typedef glm::vec3 (*CpuPixelShader)(const CpuScene& scene, const cameraView& camera, const CpuPathSettings& path,
+	int x, int y, int width, int height, CpuRaySets* record);
+
+// The sets of features that cpuShadePixel is made for, from the smallest up. Most frames of the animation
+// have reflections and nothing else, and the last set has every feature, for every other frame
+struct CpuShaderPreset
+{
+	int features;
+	CpuPixelShader shade;
+};
+
+static const CpuShaderPreset cpuShaderPresets[] = {
+	{ 0, cpuShadePixel<0> },
+	{ CPU_FEATURE_REFLECTIONS, cpuShadePixel<CPU_FEATURE_REFLECTIONS> },
+	{ CPU_FEATURE_REFLECTIONS | CPU_FEATURE_ROULETTE, cpuShadePixel<CPU_FEATURE_REFLECTIONS | CPU_FEATURE_ROULETTE> },
+	{ CPU_FEATURE_REFLECTIONS | CPU_FEATURE_LOD, cpuShadePixel<CPU_FEATURE_REFLECTIONS | CPU_FEATURE_LOD> },
+	{ CPU_FEATURES_ALL, cpuShadePixel<CPU_FEATURES_ALL> },
+};
+
+// The smallest preset that has every feature that the path needs, and CPU_FEATURE_RECORD if the rays are kept
+static CpuPixelShader pickCpuPixelShader(const CpuPathSettings& path, bool record)
+{
+	int features = 0;
+
+	if (path.maxBounces > 0)
+		features |= CPU_FEATURE_REFLECTIONS;
+	if (path.russianRoulette)
+		features |= CPU_FEATURE_ROULETTE;
+	if (path.lodShadowsFrom > 0 || path.lodSpecularFrom > 0)
+		features |= CPU_FEATURE_LOD;
+	if (record)
+		features |= CPU_FEATURE_RECORD;
+
+	for (const CpuShaderPreset& preset : cpuShaderPresets)
+	{
+		if ((preset.features & features) == features)
+			return preset.shade;
+	}
+
+	return cpuShadePixel<CPU_FEATURES_ALL>;
+}
+
+// The copy of the scene of a frame for one NUMA node of the job system (see startJobs), which the first tile that
+// runs on the node makes, so that its pages are in the memory of that node. The vectors keep their memory from
+// frame to frame, so after the first frame, it is only copied into the same pages again
+struct CpuNodeScene
+{
+	std::mutex lock;
+	std::atomic<bool> copied { false };
+	CpuScene scene;
+};
+
+static std::vector<std::unique_ptr<CpuNodeScene>> cpuNodeScenes;
+
+// The scene that the tiles of node trace: its copy, or the scene itself while another tile of the node is still copying it
+static const CpuScene& cpuLocalScene(const CpuScene& scene, int node)
+{
+	if (node >= (int)cpuNodeScenes.size())
+		return scene;
+
+	CpuNodeScene& local = *cpuNodeScenes[node];
+
+	if (local.copied)
+		return local.scene;
+
+	std::unique_lock<std::mutex> lock(local.lock, std::try_to_lock);
+
+	if (!lock.owns_lock())
+		return scene;
+
+	if (!local.copied)
+	{
+		PROFILE_ZONE("copy cpu scene to node");
+		local.scene = scene;
+		local.copied = true;
+	}
+
+	return local.scene;
+}
+
+void releaseCpuNodeScenes()
+{
+	cpuNodeScenes.clear();
+}
+
+void renderCpuFrame(const CpuScene& scene, const cameraView& camera, const CpuPathSettings& path,
+	int width, int height, int firstRow, int lastRow, unsigned char* pixels)
+{
+	PROFILE_ZONE("renderCpuFrame");
+
+	// On one node, every tile reads the scene itself. On more, they read the copy of their node
+	int nodes = jobNumaNodes();
+
+	if (nodes == 1)
+		cpuNodeScenes.clear();
+
+	while ((int)cpuNodeScenes.size() < nodes)
+		cpuNodeScenes.push_back(std::unique_ptr<CpuNodeScene>(new CpuNodeScene()));
+
+	for (std::unique_ptr<CpuNodeScene>& local : cpuNodeScenes)
+		local->copied = false;
+
+	int tilesX = (width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+	int tilesY = (lastRow - firstRow + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+	CpuPixelShader shade = pickCpuPixelShader(path, false);
+
+	// every tile is a job, and the threads of the pool (and this one) take them until there are none left
+	parallelJobs("cpu render tile", tilesX * tilesY, [&](int tile) {
+		int x0 = (tile % tilesX) * CPU_TILE_SIZE;
+		int y0 = firstRow + (tile / tilesX) * CPU_TILE_SIZE;
+		const CpuScene& local = cpuLocalScene(scene, jobNumaNode());
+
+		for (int y = y0; y < std::min(y0 + CPU_TILE_SIZE, lastRow); y++)
+		{
+			for (int x = x0; x < std::min(x0 + CPU_TILE_SIZE, width); x++)
+			{
+				glm::vec3 color = glm::clamp(shade(local, camera, path, x, y, width, height, nullptr), 0.0f, 1.0f);
+				unsigned char* out = pixels + ((size_t)y * width + x) * 3;
+
+				// rounded like the GPU writes a color into an 8-bit framebuffer, in the order of GL_BGR
+				out[0] = (unsigned char)(color.b * 255.0f + 0.5f);
+				out[1] = (unsigned char)(color.g * 255.0f + 0.5f);
+				out[2] = (unsigned char)(color.r * 255.0f + 0.5f);
+			}
+		}
+	});
+}
+
+void collectCpuRays(const CpuScene& scene, const cameraView& camera, const CpuPathSettings& path,
+	int width, int height, CpuRaySets& rays)
+{
+	PROFILE_ZONE("collectCpuRays");
+
+	// every row keeps its own rays, and they are put together in the order of the rows
+	std::vector<CpuRaySets> rows(height);
+	CpuPixelShader shade = pickCpuPixelShader(path, true);
+
+	parallelJobs("collect cpu rays", height, [&](int y) {
+		for (int x = 0; x < width; x++)
+			shade(scene, camera, path, x, y, width, height, &rows[y]);
+	});
+
+	rays = CpuRaySets();
+
+	for (const CpuRaySets& row : rows)
+	{
+		rays.primary.insert(rays.primary.end(), row.primary.begin(), row.primary.end());
+		rays.shadow.insert(rays.shadow.end(), row.shadow.begin(), row.shadow.end());
+		rays.reflection.insert(rays.reflection.end(), row.reflection.begin(), row.reflection.end());
+	}
+}
+
+int traceCpuRays(const CpuScene& scene, const std::vector<CpuRay>& rays, bool anyHit)
+{
+	PROFILE_ZONE("traceCpuRays");
+
+	// a job is a run of rays, so that the jobs are not too small to be worth it
+	int runs = ((int)rays.size() + CPU_RAY_RUN - 1) / CPU_RAY_RUN;
+	std::atomic<int> hits(0);
+
+	parallelJobs("trace cpu rays", runs, [&](int run) {
+		int runHits = 0;
+		CpuHit hit;
+
+		for (int i = run * CPU_RAY_RUN; i < std::min((run + 1) * CPU_RAY_RUN, (int)rays.size()); i++)
+		{
+			if (intersectCpuScene(scene, rays[i].origin, rays[i].dir, rays[i].tmax, anyHit, hit))
+				runHits++;
+		}
+
+		hits += runHits;
+	});
+
+	return hits;
+}
@@ -0,0 +1,150 @@
+/*
+Title: Basic Ray Tracer
+File Name: CpuRenderer.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A renderer that runs on the CPU, for --cpu-render, so that a computer
+without a GPU can still render the video. It traces the same rays as
+FragmentShader.glsl, with the same functions as RayTracing.glsl and
+ShadePixel.glsl written in C++: the ambient light, every light with its
+shadow ray and specular highlight, and the reflections, which stop the
+same way (maxBounces, the throughput, and Russian roulette with the same
+random numbers). The shaders are the reference, so a change to them
+should be made here too, and --check-golden with --cpu-render compares
+the frames with the golden frames of the GPU.
+
+Every frame, the triangles are moved into the world by the matrices of
+their meshes (what Compute.glsl does), and a BVH is built over them with
+buildBVHSAH. A leaf holds up to WIDE_BVH_MAX_LEAF_SIZE triangles, like
+the leaves of the wide BVH, and they are kept as one block of 8, which a
+ray is tested against all at once (see CpuKernels.h). The image is cut
+into tiles, and every tile is a job of the job system (JobSystem.h), so
+the threads that got the easy part of the image (the sky) take more tiles
+than the ones that got the reflections. With the job system on more than
+one NUMA node (--numa), every node traces a copy of the scene in its own
+memory, instead of half of the threads reading all of it from the other
+socket.
+
+The settings of a path that are the same for the whole frame (if there are
+reflections, Russian roulette, the shading LOD, and if the rays are kept
+for collectCpuRays) are like the #defines of the shaders: the functions
+that shade a pixel are templates on the set of them (CPU_FEATURE_*), and
+the code of a feature that is not in the set is not compiled in, instead
+of being a branch for every light and every bounce. A few sets are made
+(cpuShaderPresets), and a frame uses the smallest one that has every
+feature it needs. The last one has all of them, and checks them at run
+time like before, so every frame has one that is right for it.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "BVH.h"
+#include "CpuArena.h"
+#include "CpuKernels.h"
+#include "../Assets/SceneStructs.h"
+
+// The tiles, which are the jobs of a frame, are this many pixels across
+#define CPU_TILE_SIZE 16
+
+// traceCpuRays gives every job this many rays
+#define CPU_RAY_RUN 4096
+
+// How the paths of reflections stop, and the shading LOD of the bounces,
+// which are the path uniforms of RayTracing.glsl (see setPathUniforms in main.cpp)
+struct CpuPathSettings
+{
+	int maxBounces;
+	float throughputEpsilon;
+	bool russianRoulette;
+	float rouletteThreshold;
+	unsigned int frameSeed;
+	int lodShadowsFrom;
+	int lodSpecularFrom;
+};
+
+// What a hit needs of a triangle: its normal, color and reflectivity, unpacked once per frame instead of at every hit
+struct CpuSurface
+{
+	glm::vec3 normal;
+	glm::vec3 color;
+	float reflectivity;
+};
+
+// What the rays walk, in the large pages of cpuSceneArena with --large-pages (see CpuArena.h)
+template <typename T>
+using CpuSceneVector = std::vector<T, CpuArenaAllocator<T>>;
+
+// The scene of one frame, in the world. Every leaf of nodes has one block of triangles (see CpuKernels.h),
+// and its left is ~ the index of the block. surfaces are in the order of the leaves, like the triangles of the blocks.
+// kernel is the index in cpuBlockKernels of the test that the leaves use
+struct CpuScene
+{
+	CpuSceneVector<CpuTriangleBlock> blocks;
+	CpuSceneVector<CpuSurface> surfaces;
+	CpuSceneVector<BVHNode> nodes;
+	std::vector<light> lights;
+	int kernel = CPU_KERNEL_SCALAR;
+};
+
+// A ray that the CPU renderer traced, from origin along dir, up to tmax
+struct CpuRay
+{
+	glm::vec3 origin;
+	glm::vec3 dir;
+	float tmax;
+};
+
+// The rays of a frame, in the three sets that --bench-embree times: one camera ray for every pixel,
+// the shadow rays (which only need to know if anything is in the way), and the reflection rays of every bounce
+struct CpuRaySets
+{
+	std::vector<CpuRay> primary;
+	std::vector<CpuRay> shadow;
+	std::vector<CpuRay> reflection;
+};
+
+// Move the triangles of every mesh into the world by its matrix, and build the BVH over them.
+// Mesh m is meshTriangles[meshOffsets[m]] to meshTriangles[meshOffsets[m + 1] - 1] (see makeMeshOffsets in main.cpp)
+void buildCpuScene(const std::vector<triangle>& meshTriangles, const std::vector<int>& meshOffsets,
+	const std::vector<glm::mat4>& matrices, const std::vector<light>& lights, CpuScene& scene);
+
+// Render rows firstRow to lastRow - 1 of a frame of width x height with the camera, on the threads of the
+// job system and this one. 0 to height renders all of it. pixels is the whole frame, and gets 3 bytes for every
+// pixel, blue, green, and red, with the bottom row first, which is what glReadPixels with GL_BGR gives,
+// so it can be saved the same way. The other rows are not touched, so --hybrid can read the GPU into them
+void renderCpuFrame(const CpuScene& scene, const cameraView& camera, const CpuPathSettings& path,
+	int width, int height, int firstRow, int lastRow, unsigned char* pixels);
+
+// Forget the copies of the scene that renderCpuFrame made for the NUMA nodes, before the scene is unloaded
+void releaseCpuNodeScenes();
+
+// Trace a frame like renderCpuFrame, and keep every ray that it traced instead of the colors.
+// The rays are in the order of the pixels, so every renderer that traces them gets the same work
+void collectCpuRays(const CpuScene& scene, const cameraView& camera, const CpuPathSettings& path,
+	int width, int height, CpuRaySets& rays);
+
+// Trace every ray through the BVH of the scene on the threads of the job system, and return how many
+// hit something. With anyHit, the first hit is enough, like a shadow ray
+int traceCpuRays(const CpuScene& scene, const std::vector<CpuRay>& rays, bool anyHit);
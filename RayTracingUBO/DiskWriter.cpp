@@ -0,0 +1,677 @@
+/*
+Title: Basic Ray Tracer
+File Name: DiskWriter.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DiskWriter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#define DISK_WRITER_OVERLAPPED
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define DISK_WRITER_IO_URING
+#endif
+#endif
+#endif
+
+// bytes rounded up to the sector size
+static size_t alignDiskBytes(size_t bytes)
+{
+	return (bytes + DISK_WRITE_ALIGNMENT - 1) / DISK_WRITE_ALIGNMENT * DISK_WRITE_ALIGNMENT;
+}
+
+static unsigned char* allocateAligned(size_t bytes)
+{
+#ifdef _WIN32
+	return (unsigned char*)_aligned_malloc(bytes, DISK_WRITE_ALIGNMENT);
+#else
+	void* data = nullptr;
+	return posix_memalign(&data, DISK_WRITE_ALIGNMENT, bytes) == 0 ? (unsigned char*)data : nullptr;
+#endif
+}
+
+static void freeAligned(unsigned char* data)
+{
+#ifdef _WIN32
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+// Write the file on this thread, through the page cache, for when there is no asynchronous I/O or it failed
+static bool writeFileBlocking(const DiskWrite* write)
+{
+	FILE* file = fopen(write->fileName.c_str(), "wb");
+
+	if (file == nullptr)
+		return false;
+
+	bool written = fwrite(write->data, 1, write->bytes, file) == write->bytes;
+	return fclose(file) == 0 && written;
+}
+
+#if defined(DISK_WRITER_IO_URING)
+
+// The rings that are shared with the kernel. The writer puts the writes into the submission ring, and io_uring_enter
+// hands them to the kernel and waits for the first one to be done, in one call, and the kernel puts the results into
+// the completion ring. unsubmitted are the ones in the submission ring that the kernel was not given yet
+struct DiskWriterSystem
+{
+	int ring = -1;
+	void* sqMemory = nullptr;
+	size_t sqBytes = 0;
+	void* cqMemory = nullptr;
+	size_t cqBytes = 0;
+	io_uring_sqe* sqes = nullptr;
+	size_t sqesBytes = 0;
+
+	unsigned* sqTail = nullptr;
+	unsigned* sqMask = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned* cqMask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	unsigned unsubmitted = 0;
+};
+
+// The file of a write, and how much of it the kernel has written. A write can be cut short, and then the rest is written again
+struct DiskWriteRequest
+{
+	int fd = -1;
+	size_t length = 0;
+	size_t written = 0;
+};
+
+static void stopSystem(DiskWriterSystem* system);
+
+// Make the rings, with room for entries writes. There is no liburing in the build, so this is the system calls
+// themselves. nullptr if the kernel has no io_uring, or does not let this program use it
+static DiskWriterSystem* startSystem(int entries)
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	int ring = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+	if (ring < 0)
+		return nullptr;
+
+	DiskWriterSystem* system = new DiskWriterSystem();
+	system->ring = ring;
+	system->sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	system->cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	// a newer kernel has both rings in one mapping
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		system->sqBytes = system->cqBytes = std::max(system->sqBytes, system->cqBytes);
+
+	system->sqMemory = mmap(nullptr, system->sqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+
+	if (system->sqMemory == MAP_FAILED)
+	{
+		system->sqMemory = nullptr;
+		stopSystem(system);
+		return nullptr;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		system->cqMemory = system->sqMemory;
+	}
+	else
+	{
+		system->cqMemory = mmap(nullptr, system->cqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+
+		if (system->cqMemory == MAP_FAILED)
+		{
+			system->cqMemory = nullptr;
+			stopSystem(system);
+			return nullptr;
+		}
+	}
+
+	system->sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes = mmap(nullptr, system->sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+
+	if (sqes == MAP_FAILED)
+	{
+		stopSystem(system);
+		return nullptr;
+	}
+
+	system->sqes = (io_uring_sqe*)sqes;
+
+	unsigned char* sq = (unsigned char*)system->sqMemory;
+	system->sqTail = (unsigned*)(sq + params.sq_off.tail);
+	system->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	system->sqArray = (unsigned*)(sq + params.sq_off.array);
+
+	unsigned char* cq = (unsigned char*)system->cqMemory;
+	system->cqHead = (unsigned*)(cq + params.cq_off.head);
+	system->cqTail = (unsigned*)(cq + params.cq_off.tail);
+	system->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	system->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return system;
+}
+
+static void stopSystem(DiskWriterSystem* system)
+{
+	if (system->sqes != nullptr)
+		munmap(system->sqes, system->sqesBytes);
+
+	if (system->cqMemory != nullptr && system->cqMemory != system->sqMemory)
+		munmap(system->cqMemory, system->cqBytes);
+
+	if (system->sqMemory != nullptr)
+		munmap(system->sqMemory, system->sqBytes);
+
+	close(system->ring);
+	delete system;
+}
+
+// Put the part of the file that is not written yet into the submission ring. Only this thread writes the tail
+static void queueSystemWrite(DiskWriterSystem* system, DiskWrite* write)
+{
+	DiskWriteRequest* request = write->request;
+	unsigned tail = *system->sqTail;
+	unsigned index = tail & *system->sqMask;
+
+	io_uring_sqe* sqe = &system->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = request->fd;
+	sqe->off = request->written;
+	sqe->addr = (uint64_t)(uintptr_t)(write->data + request->written);
+	sqe->len = (uint32_t)(request->length - request->written);
+	sqe->user_data = (uint64_t)(uintptr_t)write;
+
+	system->sqArray[index] = index;
+
+	// the kernel must see the entry before the tail that covers it
+	__atomic_store_n(system->sqTail, tail + 1, __ATOMIC_RELEASE);
+	system->unsubmitted++;
+}
+
+// Open the file and allocate it, and queue its write. False if the file could not be opened
+static bool startSystemWrite(DiskWriterSystem* system, DiskWrite* write, bool direct)
+{
+	DiskWriteRequest* request = write->request;
+
+	// Not O_TRUNC, which would give back the extents of a file that is written again.
+	// tmpfs and a few others refuse O_DIRECT, and get the writes through the page cache
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	int fd = direct ? open(write->fileName.c_str(), flags | O_DIRECT, 0644) : -1;
+
+	if (fd < 0)
+		fd = open(write->fileName.c_str(), flags, 0644);
+
+	if (fd < 0)
+		return false;
+
+	request->fd = fd;
+	request->length = alignDiskBytes(write->bytes);
+	request->written = 0;
+
+	// one extent for the whole file. A file system that can't is still written, just in more pieces
+	fallocate(fd, 0, 0, (off_t)request->length);
+
+	queueSystemWrite(system, write);
+	return true;
+}
+
+// Hand the queued writes to the kernel, and wait until one of the writes in flight is done. Its file is cut back to
+// its size and closed, and ok is false if it was not written. nullptr if the kernel can't be asked
+static DiskWrite* waitSystemWrite(DiskWriterSystem* system, bool& ok)
+{
+	while (true)
+	{
+		unsigned head = *system->cqHead;
+
+		if (head != __atomic_load_n(system->cqTail, __ATOMIC_ACQUIRE))
+		{
+			io_uring_cqe* cqe = &system->cqes[head & *system->cqMask];
+			DiskWrite* write = (DiskWrite*)(uintptr_t)cqe->user_data;
+			int result = cqe->res;
+
+			// the kernel can use the entry again once the head is past it
+			__atomic_store_n(system->cqHead, head + 1, __ATOMIC_RELEASE);
+
+			DiskWriteRequest* request = write->request;
+
+			if (result > 0 && request->written + result < request->length)
+			{
+				request->written += result;
+				queueSystemWrite(system, write);
+				continue;
+			}
+
+			ok = result > 0 && ftruncate(request->fd, (off_t)write->bytes) == 0;
+			close(request->fd);
+			request->fd = -1;
+			return write;
+		}
+
+		int submitted = (int)syscall(__NR_io_uring_enter, system->ring, system->unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+		if (submitted >= 0)
+		{
+			system->unsubmitted -= submitted;
+		}
+		else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			std::cout << "io_uring_enter failed: " << strerror(errno) << std::endl;
+			return nullptr;
+		}
+	}
+}
+
+// The file of a write that the kernel will not finish, so that it can be written with blocking writes
+static void abandonSystemWrite(DiskWrite* write)
+{
+	if (write->request->fd >= 0)
+		close(write->request->fd);
+
+	write->request->fd = -1;
+}
+
+#define DISK_WRITER_METHOD "io_uring"
+
+#elif defined(DISK_WRITER_OVERLAPPED)
+
+// The completion port, which every file of the writer is added to
+struct DiskWriterSystem
+{
+	HANDLE port = nullptr;
+};
+
+// overlapped is first, so that the OVERLAPPED that the completion port gives back is the request
+struct DiskWriteRequest
+{
+	OVERLAPPED overlapped;
+	HANDLE file = INVALID_HANDLE_VALUE;
+	DiskWrite* write = nullptr;
+	size_t length = 0;
+};
+
+static DiskWriterSystem* startSystem(int entries)
+{
+	HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+
+	if (port == nullptr)
+		return nullptr;
+
+	DiskWriterSystem* system = new DiskWriterSystem();
+	system->port = port;
+	return system;
+}
+
+static void stopSystem(DiskWriterSystem* system)
+{
+	CloseHandle(system->port);
+	delete system;
+}
+
+// Open the file and allocate it, and start its write. False if the file could not be opened or the write not started
+static bool startSystemWrite(DiskWriterSystem* system, DiskWrite* write, bool direct)
+{
+	DiskWriteRequest* request = write->request;
+
+	// OPEN_ALWAYS keeps the extents of a file that is written again
+	DWORD flags = FILE_FLAG_OVERLAPPED | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+	HANDLE file = CreateFileA(write->fileName.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, flags, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (CreateIoCompletionPort(file, system->port, 0, 0) == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	request->file = file;
+	request->write = write;
+	request->length = alignDiskBytes(write->bytes);
+
+	// one extent for the whole file. A file system that can't is still written, just in more pieces
+	FILE_ALLOCATION_INFO allocation;
+	allocation.AllocationSize.QuadPart = (LONGLONG)request->length;
+	SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation));
+
+	memset(&request->overlapped, 0, sizeof(request->overlapped));
+
+	if (!WriteFile(file, write->data, (DWORD)request->length, nullptr, &request->overlapped) && GetLastError() != ERROR_IO_PENDING)
+	{
+		CloseHandle(file);
+		request->file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	return true;
+}
+
+// Wait until one of the writes in flight is done. Its file is cut back to its size and closed,
+// and ok is false if it was not written. nullptr if the completion port can't be waited for
+static DiskWrite* waitSystemWrite(DiskWriterSystem* system, bool& ok)
+{
+	DWORD transferred = 0;
+	ULONG_PTR key = 0;
+	OVERLAPPED* overlapped = nullptr;
+	BOOL done = GetQueuedCompletionStatus(system->port, &transferred, &key, &overlapped, INFINITE);
+
+	if (overlapped == nullptr)
+	{
+		std::cout << "GetQueuedCompletionStatus failed: " << GetLastError() << std::endl;
+		return nullptr;
+	}
+
+	DiskWriteRequest* request = (DiskWriteRequest*)overlapped;
+	DiskWrite* write = request->write;
+
+	FILE_END_OF_FILE_INFO end;
+	end.EndOfFile.QuadPart = (LONGLONG)write->bytes;
+	ok = done && transferred == request->length &&
+		SetFileInformationByHandle(request->file, FileEndOfFileInfo, &end, sizeof(end));
+
+	CloseHandle(request->file);
+	request->file = INVALID_HANDLE_VALUE;
+	return write;
+}
+
+static void abandonSystemWrite(DiskWrite* write)
+{
+	if (write->request->file != INVALID_HANDLE_VALUE)
+	{
+		CancelIo(write->request->file);
+		CloseHandle(write->request->file);
+	}
+
+	write->request->file = INVALID_HANDLE_VALUE;
+}
+
+#define DISK_WRITER_METHOD "overlapped I/O"
+
+#else
+
+// Every file is written with blocking writes
+struct DiskWriterSystem
+{
+};
+
+struct DiskWriteRequest
+{
+};
+
+static DiskWriterSystem* startSystem(int entries)
+{
+	return nullptr;
+}
+
+static void stopSystem(DiskWriterSystem* system)
+{
+}
+
+static bool startSystemWrite(DiskWriterSystem* system, DiskWrite* write, bool direct)
+{
+	return false;
+}
+
+static DiskWrite* waitSystemWrite(DiskWriterSystem* system, bool& ok)
+{
+	return nullptr;
+}
+
+static void abandonSystemWrite(DiskWrite* write)
+{
+}
+
+#define DISK_WRITER_METHOD "blocking writes"
+
+#endif
+
+// Tell whoever gave the file to the writer that it is written, and put its buffer back
+static void finishDiskWrite(DiskWriter& writer, DiskWrite* write, bool ok, bool blocking)
+{
+	if (write->done)
+		write->done(ok);
+
+	std::lock_guard<std::mutex> lock(writer.mutex);
+
+	if (ok)
+	{
+		writer.bytes += write->bytes;
+		writer.files++;
+	}
+	else
+	{
+		writer.failed++;
+		std::cout << "could not write " << write->fileName << std::endl;
+	}
+
+	if (blocking)
+		writer.blockingFiles++;
+
+	write->done = nullptr;
+	writer.freeWrites.push_back(write);
+	writer.busy--;
+	writer.changed.notify_all();
+}
+
+// The thread of the writer: start the writes that are queued, up to inFlight, and wait for one of them to be done
+static void runDiskWriter(DiskWriter& writer)
+{
+	std::vector<DiskWrite*> flying;
+
+	while (true)
+	{
+		std::vector<DiskWrite*> starting;
+
+		{
+			std::unique_lock<std::mutex> lock(writer.mutex);
+
+			// with nothing in flight, there is nothing to wait for but the next file
+			if (flying.empty())
+				writer.wake.wait(lock, [&writer]() { return !writer.queued.empty() || writer.stopping; });
+
+			if (flying.empty() && writer.queued.empty())
+				break;
+
+			while (!writer.queued.empty() && (int)(flying.size() + starting.size()) < writer.inFlight)
+			{
+				starting.push_back(writer.queued.front());
+				writer.queued.pop_front();
+			}
+		}
+
+		for (DiskWrite* write : starting)
+		{
+			if (writer.system != nullptr && startSystemWrite(writer.system, write, writer.direct))
+				flying.push_back(write);
+			else
+				finishDiskWrite(writer, write, writeFileBlocking(write), true);
+		}
+
+		if (flying.empty())
+			continue;
+
+		bool ok = false;
+		DiskWrite* done = waitSystemWrite(writer.system, ok);
+
+		// The system can't be waited for any more, so the files in flight are written again
+		// with blocking writes, and so is every file after them
+		if (done == nullptr)
+		{
+			for (DiskWrite* write : flying)
+			{
+				abandonSystemWrite(write);
+				finishDiskWrite(writer, write, writeFileBlocking(write), true);
+			}
+
+			flying.clear();
+			stopSystem(writer.system);
+			writer.system = nullptr;
+			continue;
+		}
+
+		flying.erase(std::find(flying.begin(), flying.end(), done));
+
+		// a file system that took the file but not the write (O_DIRECT on some network file systems) gets a blocking write
+		if (!ok)
+			finishDiskWrite(writer, done, writeFileBlocking(done), true);
+		else
+			finishDiskWrite(writer, done, true, false);
+	}
+}
+
+bool startDiskWriter(DiskWriter& writer, int inFlight, bool direct)
+{
+	writer.inFlight = std::max(1, inFlight);
+	writer.direct = direct;
+	writer.stopping = false;
+	writer.busy = 0;
+	writer.system = startSystem(writer.inFlight);
+	writer.method = (writer.system != nullptr) ? DISK_WRITER_METHOD : "blocking writes";
+
+	// the buffers are allocated the first time they are used, when the size of the files is known
+	for (int i = 0; i < 2 * writer.inFlight; i++)
+	{
+		DiskWrite* write = new DiskWrite();
+		write->request = new DiskWriteRequest();
+		writer.allWrites.push_back(write);
+		writer.freeWrites.push_back(write);
+	}
+
+	try
+	{
+		writer.thread = std::thread(runDiskWriter, std::ref(writer));
+	}
+	catch (const std::system_error&)
+	{
+		stopDiskWriter(writer);
+		return false;
+	}
+
+	writer.running = true;
+	return true;
+}
+
+DiskWrite* beginDiskWrite(DiskWriter& writer, size_t bytes)
+{
+	DiskWrite* write;
+
+	{
+		std::unique_lock<std::mutex> lock(writer.mutex);
+
+		if (writer.freeWrites.empty())
+		{
+			writer.bufferWaits++;
+			writer.changed.wait(lock, [&writer]() { return !writer.freeWrites.empty(); });
+		}
+
+		write = writer.freeWrites.back();
+		writer.freeWrites.pop_back();
+		writer.busy++;
+	}
+
+	// a file that is bigger than the buffer was made for (a QOI frame that did not compress well) gets a bigger one
+	size_t needed = alignDiskBytes(bytes);
+
+	if (needed > write->capacity)
+	{
+		freeAligned(write->data);
+		write->data = allocateAligned(needed);
+		write->capacity = needed;
+	}
+
+	return write;
+}
+
+void endDiskWrite(DiskWriter& writer, DiskWrite* write, const std::string& fileName, size_t bytes, std::function<void(bool)> done)
+{
+	// the end of the last sector is written too, and cut off after, so it should not be whatever was in the buffer before
+	memset(write->data + bytes, 0, alignDiskBytes(bytes) - bytes);
+
+	write->fileName = fileName;
+	write->bytes = bytes;
+	write->done = std::move(done);
+
+	std::lock_guard<std::mutex> lock(writer.mutex);
+	writer.queued.push_back(write);
+	writer.wake.notify_one();
+}
+
+void flushDiskWriter(DiskWriter& writer)
+{
+	if (!writer.running)
+		return;
+
+	std::unique_lock<std::mutex> lock(writer.mutex);
+	writer.changed.wait(lock, [&writer]() { return writer.busy == 0; });
+}
+
+void stopDiskWriter(DiskWriter& writer)
+{
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		writer.stopping = true;
+		writer.wake.notify_one();
+	}
+
+	if (writer.thread.joinable())
+		writer.thread.join();
+
+	if (writer.system != nullptr)
+		stopSystem(writer.system);
+
+	for (DiskWrite* write : writer.allWrites)
+	{
+		freeAligned(write->data);
+		delete write->request;
+		delete write;
+	}
+
+	writer.system = nullptr;
+	writer.allWrites.clear();
+	writer.freeWrites.clear();
+	writer.queued.clear();
+	writer.running = false;
+}
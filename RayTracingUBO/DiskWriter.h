@@ -0,0 +1,126 @@
+/*
+Title: Basic Ray Tracer
+File Name: DiskWriter.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The frames that --export-png saves as raw or QOI files at 4K are tens of
+megabytes each, and writing them with an ofstream on the jobs that encode
+them makes those jobs wait on the disk, and fills the page cache with
+files that are only read once, by ffmpeg, at the end. With --disk-writer,
+the jobs only encode the frame into a buffer of the writer and go on. The
+writer has a thread of its own that keeps many files in flight at once
+(DiskWriter::inFlight), with the asynchronous I/O of the system: io_uring
+on Linux, and overlapped I/O with a completion port on Windows.
+
+The files are written past the page cache where the system allows it
+(O_DIRECT on Linux, FILE_FLAG_NO_BUFFERING on Windows). That needs the
+buffer, the offset and the length to be multiples of the sector size, so
+the buffers are DISK_WRITE_ALIGNMENT aligned, a file is written as one
+write of its bytes rounded up to that, and it is cut back to its size
+once the write is done. Before the write, the whole file is allocated at
+once (fallocate, or FileAllocationInfo), so the file system gives it one
+extent instead of growing it write by write, and a file that is already
+there (a frame that --resume saves again) is written over in place,
+keeping the extents that it has, instead of being truncated first.
+
+A file system that does not take O_DIRECT (tmpfs) gets the same writes
+through the page cache. Without io_uring (an old kernel, or one where it
+is turned off), or when a write fails, the file is written on the thread
+of the writer with plain blocking writes, so the jobs still do not wait.
+
+There is a fixed number of buffers, twice inFlight, which are reused for
+every file. beginDiskWrite waits for one when all of them are in use, so
+a disk that is slower than the renderer slows the encoding down instead of
+piling up frames in memory.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The buffers and the writes are multiples of this, which is the sector size of every disk we know of
+#define DISK_WRITE_ALIGNMENT 4096
+
+// The state that the asynchronous I/O of the system needs, in DiskWriter.cpp
+struct DiskWriterSystem;
+struct DiskWriteRequest;
+
+// One file: the buffer that its bytes are put into, and what is done once it is written.
+// done gets false if the file could not be written
+struct DiskWrite
+{
+	unsigned char* data = nullptr;
+	size_t capacity = 0;
+	size_t bytes = 0;
+	std::string fileName;
+	std::function<void(bool)> done;
+	DiskWriteRequest* request = nullptr;
+};
+
+// The writer, and what it did
+struct DiskWriter
+{
+	bool running = false;
+	int inFlight = 0;
+	bool direct = true;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable changed;
+	std::deque<DiskWrite*> queued;
+	std::vector<DiskWrite*> freeWrites;
+	std::vector<DiskWrite*> allWrites;
+	int busy = 0;
+	bool stopping = false;
+	DiskWriterSystem* system = nullptr;
+
+	// counted by the thread of the writer, and read after stopDiskWriter
+	long long bytes = 0;
+	int files = 0;
+	int failed = 0;
+	int blockingFiles = 0;
+	int bufferWaits = 0;
+	const char* method = "blocking writes";
+};
+
+// Start the thread of the writer, with up to inFlight files written at once. With direct, the files are written
+// past the page cache where the file system allows it. Returns false if the thread could not be started
+bool startDiskWriter(DiskWriter& writer, int inFlight, bool direct);
+
+// A free buffer for a file of up to bytes, once there is one. The caller fills in data, and gives it to endDiskWrite
+DiskWrite* beginDiskWrite(DiskWriter& writer, size_t bytes);
+
+// Write the first bytes of data of the buffer into fileName, and call done on the thread of the writer when it is written
+void endDiskWrite(DiskWriter& writer, DiskWrite* write, const std::string& fileName, size_t bytes, std::function<void(bool)> done);
+
+// Wait until every file that was given to the writer is written
+void flushDiskWriter(DiskWriter& writer);
+
+// Write the files that are left, stop the thread, and free the buffers
+void stopDiskWriter(DiskWriter& writer);
@@ -0,0 +1,190 @@
+/*
+Title: Basic Ray Tracer
+File Name: EmbreeBaseline.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EmbreeBaseline.h"
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#ifdef RAYTRACER_EMBREE
+#include <embree3/rtcore.h>
+
+struct EmbreeBaseline
+{
+	RTCDevice device;
+	RTCScene scene;
+
+	// the normal of every triangle, by its primID, for the back faces
+	std::vector<glm::vec3> normals;
+};
+
+// The triangles that face away from the ray are not hit, like in the CPU kernels
+static void cullBackFaces(const RTCFilterFunctionNArguments* args)
+{
+	const EmbreeBaseline* baseline = (const EmbreeBaseline*)args->geometryUserPtr;
+
+	for (unsigned int i = 0; i < args->N; i++)
+	{
+		if (args->valid[i] != -1)
+			continue;
+
+		glm::vec3 dir(RTCRayN_dir_x(args->ray, args->N, i), RTCRayN_dir_y(args->ray, args->N, i), RTCRayN_dir_z(args->ray, args->N, i));
+
+		if (glm::dot(baseline->normals[RTCHitN_primID(args->hit, args->N, i)], dir) > 0.0f)
+			args->valid[i] = 0;
+	}
+}
+#endif
+
+EmbreeBaseline* makeEmbreeBaseline(const CpuScene& scene)
+{
+#ifdef RAYTRACER_EMBREE
+	EmbreeBaseline* baseline = new EmbreeBaseline();
+	baseline->device = rtcNewDevice(nullptr);
+
+	if (baseline->device == nullptr)
+	{
+		std::cout << "could not make the Embree device" << std::endl;
+		delete baseline;
+		return nullptr;
+	}
+
+	int n = (int)scene.surfaces.size();
+	baseline->normals.resize(n);
+
+	RTCGeometry geometry = rtcNewGeometry(baseline->device, RTC_GEOMETRY_TYPE_TRIANGLE);
+	float* vertices = (float*)rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 3 * sizeof(float), (size_t)n * 3);
+	unsigned int* indices = (unsigned int*)rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(unsigned int), n);
+
+	// the triangles of every block, back from the first point and its edges, with the number that the renderer has for them
+	for (const CpuTriangleBlock& block : scene.blocks)
+	{
+		for (int k = 0; k < block.count; k++)
+		{
+			int t = block.first + k;
+			glm::vec3 a(block.v0x[k], block.v0y[k], block.v0z[k]);
+			glm::vec3 b = a + glm::vec3(block.e1x[k], block.e1y[k], block.e1z[k]);
+			glm::vec3 c = a + glm::vec3(block.e2x[k], block.e2y[k], block.e2z[k]);
+			glm::vec3 points[3] = { a, b, c };
+
+			for (int p = 0; p < 3; p++)
+			{
+				vertices[(t * 3 + p) * 3 + 0] = points[p].x;
+				vertices[(t * 3 + p) * 3 + 1] = points[p].y;
+				vertices[(t * 3 + p) * 3 + 2] = points[p].z;
+				indices[t * 3 + p] = (unsigned int)(t * 3 + p);
+			}
+
+			baseline->normals[t] = glm::vec3(block.nx[k], block.ny[k], block.nz[k]);
+		}
+	}
+
+	rtcSetGeometryUserData(geometry, baseline);
+	rtcSetGeometryIntersectFilterFunction(geometry, cullBackFaces);
+	rtcSetGeometryOccludedFilterFunction(geometry, cullBackFaces);
+	rtcCommitGeometry(geometry);
+
+	baseline->scene = rtcNewScene(baseline->device);
+	rtcSetSceneBuildQuality(baseline->scene, RTC_BUILD_QUALITY_HIGH);
+	rtcAttachGeometry(baseline->scene, geometry);
+	rtcReleaseGeometry(geometry);
+	rtcCommitScene(baseline->scene);
+
+	return baseline;
+#else
+	(void)scene;
+	std::cout << "this build has no Embree, build it with RAYTRACER_EMBREE and link embree3 for --bench-embree" << std::endl;
+	return nullptr;
+#endif
+}
+
+int traceEmbreeRays(EmbreeBaseline* baseline, const std::vector<CpuRay>& rays, bool anyHit)
+{
+#ifdef RAYTRACER_EMBREE
+	int runs = ((int)rays.size() + CPU_RAY_RUN - 1) / CPU_RAY_RUN;
+	std::atomic<int> hits(0);
+
+	parallelJobs("trace embree rays", runs, [&](int run) {
+		RTCIntersectContext context;
+		rtcInitIntersectContext(&context);
+		int runHits = 0;
+
+		for (int i = run * CPU_RAY_RUN; i < std::min((run + 1) * CPU_RAY_RUN, (int)rays.size()); i++)
+		{
+			RTCRayHit rayHit;
+			RTCRay& ray = rayHit.ray;
+			ray.org_x = rays[i].origin.x;
+			ray.org_y = rays[i].origin.y;
+			ray.org_z = rays[i].origin.z;
+			ray.dir_x = rays[i].dir.x;
+			ray.dir_y = rays[i].dir.y;
+			ray.dir_z = rays[i].dir.z;
+			ray.tnear = CPU_TRIANGLE_EPSILON;
+			ray.tfar = rays[i].tmax;
+			ray.time = 0.0f;
+			ray.mask = 0xFFFFFFFF;
+			ray.id = 0;
+			ray.flags = 0;
+
+			// an occluded ray gets a tfar of -inf
+			if (anyHit)
+			{
+				rtcOccluded1(baseline->scene, &context, &ray);
+				runHits += ray.tfar < 0.0f;
+				continue;
+			}
+
+			rayHit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+			rayHit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+			rtcIntersect1(baseline->scene, &context, &rayHit);
+			runHits += rayHit.hit.geomID != RTC_INVALID_GEOMETRY_ID;
+		}
+
+		hits += runHits;
+	});
+
+	return hits;
+#else
+	(void)baseline;
+	(void)rays;
+	(void)anyHit;
+	return 0;
+#endif
+}
+
+void freeEmbreeBaseline(EmbreeBaseline* baseline)
+{
+#ifdef RAYTRACER_EMBREE
+	if (baseline == nullptr)
+		return;
+
+	rtcReleaseScene(baseline->scene);
+	rtcReleaseDevice(baseline->device);
+	delete baseline;
+#else
+	(void)baseline;
+#endif
+}
@@ -0,0 +1,56 @@
+/*
+Title: Basic Ray Tracer
+File Name: EmbreeBaseline.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The reference of --bench-embree: the same rays that the CPU renderer
+traces, traced by Embree (Intel's CPU ray tracing kernels), so that the
+rays per second of the GPU renderers and of the CPU renderer can be put
+next to what a state of the art CPU tracer does with the same scene.
+
+The triangles are the ones of a CpuScene, which are already in the world,
+in one triangle geometry of an Embree 3 scene, built with the high
+quality BVH. The CPU kernels skip the triangles that face away from the
+ray, and Embree does not, unless it is built with backface culling, so a
+filter function throws those hits away, which keeps the hits the same.
+The rays run on the threads of the job system in runs of CPU_RAY_RUN,
+one at a time (rtcIntersect1 and rtcOccluded1), like traceCpuRays.
+
+It is only built with RAYTRACER_EMBREE, linked with embree3, because
+the project does not ship Embree. Without it, makeEmbreeBaseline says so.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "CpuRenderer.h"
+
+struct EmbreeBaseline;
+
+// Put the triangles of the scene into an Embree scene, and build it. Returns nullptr, and says why,
+// if this build has no Embree or the device could not be made
+EmbreeBaseline* makeEmbreeBaseline(const CpuScene& scene);
+
+// Trace every ray with Embree, and return how many hit something. With anyHit, they are occlusion rays
+int traceEmbreeRays(EmbreeBaseline* baseline, const std::vector<CpuRay>& rays, bool anyHit);
+
+void freeEmbreeBaseline(EmbreeBaseline* baseline);
@@ -0,0 +1,182 @@
+/*
+Title: Basic Ray Tracer
+File Name: Farm.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Farm.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static std::string farmFile(const std::string& folder, const char* name, int chunk)
+{
+	return folder + "/" + name + "_" + std::to_string(chunk) + ".txt";
+}
+
+// The whole file, or an empty string if there is none
+static std::string readFarmFile(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	std::stringstream text;
+	text << file.rdbuf();
+	return text.str();
+}
+
+static bool farmFileExists(const std::string& fileName)
+{
+	return std::ifstream(fileName).good();
+}
+
+FarmPlan makeFarmPlan(int firstFrame, int lastFrame, int chunkFrames)
+{
+	FarmPlan plan;
+	plan.firstFrame = firstFrame;
+	plan.lastFrame = lastFrame;
+	plan.chunkFrames = std::max(1, chunkFrames);
+	plan.chunks = (lastFrame - firstFrame + plan.chunkFrames) / plan.chunkFrames;
+	return plan;
+}
+
+void farmChunkFrames(const FarmPlan& plan, int chunk, int& first, int& last)
+{
+	first = plan.firstFrame + chunk * plan.chunkFrames;
+	last = std::min(first + plan.chunkFrames - 1, plan.lastFrame);
+}
+
+bool startFarm(const std::string& folder, const FarmPlan& plan, bool keepDone)
+{
+	for (int c = 0; c < plan.chunks; c++)
+	{
+		std::remove(farmFile(folder, "claim", c).c_str());
+
+		if (!keepDone)
+			std::remove(farmFile(folder, "done", c).c_str());
+	}
+
+	std::ofstream file(folder + "/farm.txt");
+	file << plan.firstFrame << " " << plan.lastFrame << " " << plan.chunkFrames << std::endl;
+	return file.good();
+}
+
+bool readFarmPlan(const std::string& folder, FarmPlan& plan)
+{
+	std::ifstream file(folder + "/farm.txt");
+	int first, last, chunkFrames;
+
+	if (!(file >> first >> last >> chunkFrames) || first < 1 || last < first)
+		return false;
+
+	plan = makeFarmPlan(first, last, chunkFrames);
+	return true;
+}
+
+bool claimFarmChunk(const std::string& folder, const FarmPlan& plan, const std::string& worker, int& chunk)
+{
+	for (int c = 0; c < plan.chunks; c++)
+	{
+		if (farmFileExists(farmFile(folder, "done", c)))
+			continue;
+
+		// "x" only makes the file if it is not there, which a file server does for one of the workers that try at once
+		FILE* claim = fopen(farmFile(folder, "claim", c).c_str(), "wx");
+
+		if (claim == nullptr)
+			continue;
+
+		fprintf(claim, "%s 0\n", worker.c_str());
+		fclose(claim);
+
+		// the chunk can have been finished between the two looks
+		if (farmFileExists(farmFile(folder, "done", c)))
+		{
+			std::remove(farmFile(folder, "claim", c).c_str());
+			continue;
+		}
+
+		chunk = c;
+		return true;
+	}
+
+	return false;
+}
+
+bool beatFarmClaim(const std::string& folder, int chunk, const std::string& worker, int beat)
+{
+	// "r+" does not make the file again if the coordinator deleted it
+	FILE* claim = fopen(farmFile(folder, "claim", chunk).c_str(), "r+");
+
+	if (claim == nullptr)
+		return false;
+
+	fprintf(claim, "%s %d\n", worker.c_str(), beat);
+	fclose(claim);
+	return true;
+}
+
+void releaseFarmChunk(const std::string& folder, int chunk)
+{
+	std::remove(farmFile(folder, "claim", chunk).c_str());
+}
+
+void finishFarmChunk(const std::string& folder, int chunk, const std::string& worker)
+{
+	std::ofstream(farmFile(folder, "done", chunk)) << worker << std::endl;
+	std::remove(farmFile(folder, "claim", chunk).c_str());
+}
+
+std::string farmChunkWorker(const std::string& folder, int chunk)
+{
+	std::string name;
+	std::ifstream(farmFile(folder, "done", chunk)) >> name;
+	return name;
+}
+
+std::vector<int> reissueStaleFarmChunks(const std::string& folder, const FarmPlan& plan, FarmWatch& watch, double now, double timeout)
+{
+	watch.beats.resize(plan.chunks);
+	watch.changed.resize(plan.chunks, now);
+
+	std::vector<int> reissued;
+
+	for (int c = 0; c < plan.chunks; c++)
+	{
+		std::string beat = readFarmFile(farmFile(folder, "claim", c));
+
+		if (beat != watch.beats[c])
+		{
+			watch.beats[c] = beat;
+			watch.changed[c] = now;
+			continue;
+		}
+
+		if (beat.empty() || now - watch.changed[c] < timeout)
+			continue;
+
+		releaseFarmChunk(folder, c);
+		watch.beats[c].clear();
+		watch.changed[c] = now;
+		reissued.push_back(c);
+	}
+
+	return reissued;
+}
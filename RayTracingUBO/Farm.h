@@ -0,0 +1,100 @@
+/*
+Title: Basic Ray Tracer
+File Name: Farm.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The files that a render farm shares in one folder (--farm and
+--farm-worker in main.cpp), which every machine of the farm can reach,
+like a network share. The coordinator cuts the frames of the video into
+chunks, and writes the plan into farm.txt. A worker takes a chunk by
+making claim_<chunk>.txt, which only one of them can make, renders it,
+and then makes done_<chunk>.txt. A worker that is done with a chunk
+takes the next one that nobody has, so a fast GPU takes more chunks than
+a slow one, and nothing has to know how fast they are.
+
+While a worker renders a chunk, it writes a new heartbeat into its claim
+every FARM_HEARTBEAT_SECONDS. The coordinator looks at the claims, and a
+claim whose heartbeat has not changed for the timeout is deleted, so
+the chunk of a worker that died (or a machine that went away) is taken
+by another worker. The coordinator only compares the heartbeats with what
+it saw before, and never with the clocks of the other machines, which
+need not agree with its own.
+
+Nothing here is atomic but making the claim. A worker that was only slow,
+and lost its claim, still renders its chunk, and the frames are the same
+ones, so two workers that render one chunk do no harm.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// How often a worker writes its heartbeat, in seconds
+#define FARM_HEARTBEAT_SECONDS 2
+
+// The frames of a farm, counting from 1 like the files, in chunks of chunkFrames (the last one can be shorter)
+struct FarmPlan
+{
+	int firstFrame;
+	int lastFrame;
+	int chunkFrames;
+	int chunks;
+};
+
+// Make the plan of a farm over firstFrame to lastFrame
+FarmPlan makeFarmPlan(int firstFrame, int lastFrame, int chunkFrames);
+
+// The first and last frame of a chunk
+void farmChunkFrames(const FarmPlan& plan, int chunk, int& first, int& last);
+
+// Write farm.txt, and delete the claims and done chunks of a farm before it.
+// With keepDone, the done chunks are kept, like --resume keeps the saved frames
+bool startFarm(const std::string& folder, const FarmPlan& plan, bool keepDone);
+
+// Read the plan from farm.txt. Returns false if there is no farm in the folder
+bool readFarmPlan(const std::string& folder, FarmPlan& plan);
+
+// Take the first chunk that is not claimed and not done. Returns false if there is none
+bool claimFarmChunk(const std::string& folder, const FarmPlan& plan, const std::string& worker, int& chunk);
+
+// Write a new heartbeat into the claim of a chunk. Returns false if the claim was taken away
+bool beatFarmClaim(const std::string& folder, int chunk, const std::string& worker, int beat);
+
+// Give a chunk back without finishing it, so that another worker takes it
+void releaseFarmChunk(const std::string& folder, int chunk);
+
+// Say that a chunk is done, and who did it
+void finishFarmChunk(const std::string& folder, int chunk, const std::string& worker);
+
+// Which worker did a chunk, or an empty string if it is not done
+std::string farmChunkWorker(const std::string& folder, int chunk);
+
+// What the coordinator saw of the claims: the last heartbeat of every chunk, and when it last changed
+struct FarmWatch
+{
+	std::vector<std::string> beats;
+	std::vector<double> changed;
+};
+
+// Delete the claims whose heartbeat has not changed for timeout seconds, now being the time of the
+// coordinator in seconds. Returns the chunks that were given back
+std::vector<int> reissueStaleFarmChunks(const std::string& folder, const FarmPlan& plan, FarmWatch& watch, double now, double timeout);
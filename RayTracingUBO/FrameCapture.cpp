@@ -0,0 +1,154 @@
+/*
+Title: Basic Ray Tracer
+File Name: FrameCapture.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameCapture.h"
+
+bool openFrameCapture(FrameCaptureWriter& writer, const char* fileName, const FrameCaptureHeader& header)
+{
+	writer.file = fopen(fileName, "wb");
+	if (!writer.file)
+		return false;
+
+	fwrite(&header, sizeof(header), 1, writer.file);
+	writer.lastMatrices.clear();
+	writer.lastFrame = -1;
+	writer.frames = 0;
+	writer.bytes = sizeof(header);
+	return true;
+}
+
+void writeCapturedFrame(FrameCaptureWriter& writer, const CapturedFrame& frame)
+{
+	if (!writer.file || frame.frame <= writer.lastFrame)
+		return;
+
+	// the first frame has nothing to compare with, so all of its matrices are written
+	std::vector<int32_t> changed;
+	for (int m = 0; m < (int)frame.matrices.size(); m++)
+	{
+		if (m >= (int)writer.lastMatrices.size() || frame.matrices[m] != writer.lastMatrices[m])
+			changed.push_back(m);
+	}
+
+	int32_t number = frame.frame;
+	float camera[10] = {
+		frame.cameraPos.x, frame.cameraPos.y, frame.cameraPos.z,
+		frame.cameraTarget.x, frame.cameraTarget.y, frame.cameraTarget.z,
+		frame.cameraUp.x, frame.cameraUp.y, frame.cameraUp.z,
+		frame.cameraFov
+	};
+	int32_t numChanged = (int32_t)changed.size();
+	int32_t numLights = (int32_t)frame.lights.size();
+
+	fwrite(&number, sizeof(number), 1, writer.file);
+	fwrite(&frame.time, sizeof(frame.time), 1, writer.file);
+	fwrite(camera, sizeof(camera), 1, writer.file);
+	fwrite(&numChanged, sizeof(numChanged), 1, writer.file);
+
+	for (int32_t m : changed)
+	{
+		fwrite(&m, sizeof(m), 1, writer.file);
+		fwrite(&frame.matrices[m], sizeof(glm::mat4), 1, writer.file);
+	}
+
+	fwrite(&numLights, sizeof(numLights), 1, writer.file);
+	if (numLights > 0)
+		fwrite(frame.lights.data(), sizeof(light), numLights, writer.file);
+
+	writer.bytes += sizeof(number) + sizeof(frame.time) + sizeof(camera) + sizeof(numChanged)
+		+ changed.size() * (sizeof(int32_t) + sizeof(glm::mat4)) + sizeof(numLights) + numLights * sizeof(light);
+
+	writer.lastMatrices = frame.matrices;
+	writer.lastFrame = frame.frame;
+	writer.frames++;
+}
+
+void closeFrameCapture(FrameCaptureWriter& writer)
+{
+	if (!writer.file)
+		return;
+
+	fclose(writer.file);
+	writer.file = nullptr;
+}
+
+bool readFrameCapture(const char* fileName, FrameCaptureHeader& header, std::vector<CapturedFrame>& frames)
+{
+	frames.clear();
+
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return false;
+
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+		header.magic == FRAME_CAPTURE_MAGIC && header.version == FRAME_CAPTURE_VERSION && header.meshes >= 0;
+
+	// the matrices that a record leaves out are the ones of the record before
+	std::vector<glm::mat4> matrices(ok ? header.meshes : 0, glm::mat4(1.0f));
+
+	while (ok)
+	{
+		int32_t number;
+		if (fread(&number, sizeof(number), 1, file) != 1)
+			break;
+
+		CapturedFrame frame;
+		float camera[10];
+		int32_t numChanged = 0;
+		int32_t numLights = 0;
+
+		frame.frame = number;
+		ok = fread(&frame.time, sizeof(frame.time), 1, file) == 1 &&
+			fread(camera, sizeof(camera), 1, file) == 1 &&
+			fread(&numChanged, sizeof(numChanged), 1, file) == 1 &&
+			numChanged >= 0 && numChanged <= header.meshes;
+
+		for (int i = 0; ok && i < numChanged; i++)
+		{
+			int32_t m;
+			ok = fread(&m, sizeof(m), 1, file) == 1 && m >= 0 && m < header.meshes &&
+				fread(&matrices[m], sizeof(glm::mat4), 1, file) == 1;
+		}
+
+		ok = ok && fread(&numLights, sizeof(numLights), 1, file) == 1 && numLights >= 0;
+
+		if (ok)
+		{
+			frame.lights.resize(numLights);
+			ok = numLights == 0 || fread(frame.lights.data(), sizeof(light), numLights, file) == (size_t)numLights;
+		}
+
+		if (!ok)
+			break;
+
+		frame.cameraPos = glm::vec3(camera[0], camera[1], camera[2]);
+		frame.cameraTarget = glm::vec3(camera[3], camera[4], camera[5]);
+		frame.cameraUp = glm::vec3(camera[6], camera[7], camera[8]);
+		frame.cameraFov = camera[9];
+		frame.matrices = matrices;
+		frames.push_back(frame);
+	}
+
+	fclose(file);
+	return ok;
+}
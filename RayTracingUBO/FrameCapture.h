@@ -0,0 +1,106 @@
+/*
+Title: Basic Ray Tracer
+File Name: FrameCapture.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The frame inputs of --capture and --replay. When a frame of a long render
+is slow, finding out why needs that frame again, without the rest of the
+render before it. --capture writes what every frame was made from into a
+file: the matrices of the meshes, the lights, the camera, and the time.
+--replay reads it back, and renders any range of those frames headless,
+with the frame timers and the CPU trace, from the same inputs, so a slow
+frame can be looked at as many times as needed.
+
+The file starts with a FrameCaptureHeader. The scene itself is not in it,
+only its hash (the triangles and the meshes), so a replay with another
+scene is found and warned about. Then every frame is a record of:
+  frame, time (int, float), camera position, target, up (9 floats), fov
+  the number of matrices that changed since the frame before, and then
+    every one of them as its mesh (int) and its 16 floats
+  the number of lights, and then every light (see SceneStructs.h)
+Most meshes of a scene don't move, and only the ones that did are written,
+so a frame of a big scene is a few hundred bytes, not a few megabytes.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "../Assets/SceneStructs.h"
+
+// The first bytes of a capture file, "RCAP", and the version of the records after the header
+#define FRAME_CAPTURE_MAGIC 0x50414352
+#define FRAME_CAPTURE_VERSION 1
+
+// What a capture needs to know to be replayed: the scene it was made with (see sceneCaptureHash in main.cpp),
+// how many meshes that has, and the render size and frame rate
+struct FrameCaptureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sceneHash;
+	int32_t meshes;
+	int32_t width;
+	int32_t height;
+	float fps;
+};
+
+// The inputs of one frame, with the matrices of every mesh (not only the ones that changed)
+struct CapturedFrame
+{
+	int frame;
+	float time;
+	glm::vec3 cameraPos;
+	glm::vec3 cameraTarget;
+	glm::vec3 cameraUp;
+	float cameraFov;
+	std::vector<glm::mat4> matrices;
+	std::vector<light> lights;
+};
+
+// A capture file that is being written. lastMatrices are the ones of the frame before, which the matrices
+// of the next frame are compared with, and lastFrame is its number, since only new frames are written
+struct FrameCaptureWriter
+{
+	FILE* file = nullptr;
+	std::vector<glm::mat4> lastMatrices;
+	int lastFrame = -1;
+	int frames = 0;
+	size_t bytes = 0;
+};
+
+// Make the file and write the header. Returns false if the file could not be made
+bool openFrameCapture(FrameCaptureWriter& writer, const char* fileName, const FrameCaptureHeader& header);
+
+// Write the record of a frame, if it is after the last one that was written. A frame can ask for its inputs
+// more than once (the CPU renderer makes the next frame early), and it is only written the first time
+void writeCapturedFrame(FrameCaptureWriter& writer, const CapturedFrame& frame);
+
+// Close the file, which is complete after every record
+void closeFrameCapture(FrameCaptureWriter& writer);
+
+// Read the header and every frame of a capture file, with the matrices that did not change filled in.
+// Returns false if it is not a capture, is of another version, or ends in the middle of a record
+bool readFrameCapture(const char* fileName, FrameCaptureHeader& header, std::vector<CapturedFrame>& frames);
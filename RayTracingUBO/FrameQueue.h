@@ -0,0 +1,302 @@
+/*
+Title: Basic Ray Tracer
+File Name: FrameQueue.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Bounded queues that hand frames from one thread to another without a
+lock, for the saving of the frames, which at small sizes can be hundreds
+of frames per second. Both hold a fixed number of items (a power of two),
+and both have a try that never waits, and a push and pop that wait when
+the queue is full or empty: they try again a few times, then give the
+processor away, and then sleep between tries, so a side that has to wait
+for long does not take a core from the jobs.
+
+SpscQueue has one thread that pushes and one that pops. pushed is only
+changed by the one that pushes, and popped only by the one that pops, so
+each is a plain store, and each side keeps its own copy of the other's
+count, which it only reads again when the queue looks full or empty.
+
+MpmcQueue can be pushed and popped by any number of threads. Every cell
+has a sequence number, which says if the cell is free for the push of
+that turn of the ring or holds the item for its pop (Dmitry Vyukov's
+bounded queue), so a push or pop is one compare-and-swap of the position,
+and threads only wait for each other when the queue is full or empty.
+
+The counts that the pushing side changes and the ones that the popping
+side changes are on cache lines of their own, so the two sides do not
+take the lines from each other on every item. The queues are meant to be
+globals, since new does not keep the alignment of the lines before C++17.
+Every queue keeps how often a side had to wait, and the most items it
+held, for the end of the run and --metrics-port.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+// The size of a cache line
+#define FRAME_QUEUE_LINE 64
+
+// A side that finds the queue full or empty tries again this many times, then yields as many times, and then sleeps
+#define FRAME_QUEUE_SPINS 64
+#define FRAME_QUEUE_YIELDS 64
+#define FRAME_QUEUE_SLEEP std::chrono::microseconds(50)
+
+// Wait before the next try, after tries tries that failed
+inline void frameQueueBackoff(int tries)
+{
+	if (tries < FRAME_QUEUE_SPINS)
+		return;
+
+	if (tries < FRAME_QUEUE_SPINS + FRAME_QUEUE_YIELDS)
+		std::this_thread::yield();
+	else
+		std::this_thread::sleep_for(FRAME_QUEUE_SLEEP);
+}
+
+// How often the sides of a queue waited, and the most items it held, as the side that pushes saw it (which can
+// be a few more than it was, if the pops since it last looked are not counted yet). Either side can change them
+struct FrameQueueStats
+{
+	std::atomic<int> fullWaits{ 0 };
+	std::atomic<int> emptyWaits{ 0 };
+	std::atomic<size_t> maxDepth{ 0 };
+};
+
+// Keep depth as the most items, if it is more
+inline void noteQueueDepth(FrameQueueStats& stats, size_t depth)
+{
+	size_t most = stats.maxDepth.load(std::memory_order_relaxed);
+
+	while (depth > most && !stats.maxDepth.compare_exchange_weak(most, depth, std::memory_order_relaxed))
+		;
+}
+
+// A queue of Size items with one thread that pushes and one that pops
+template <typename T, size_t Size>
+struct SpscQueue
+{
+	static_assert(Size > 0 && (Size & (Size - 1)) == 0, "the size of a queue must be a power of two");
+
+	T items[Size];
+
+	// the side that pushes: how many items it pushed, and how many it last saw popped
+	alignas(FRAME_QUEUE_LINE) std::atomic<size_t> pushed{ 0 };
+	size_t poppedSeen = 0;
+
+	// the side that pops: how many items it popped, and how many it last saw pushed
+	alignas(FRAME_QUEUE_LINE) std::atomic<size_t> popped{ 0 };
+	size_t pushedSeen = 0;
+
+	// once it is closed, pop returns false when the queue is empty, instead of waiting
+	alignas(FRAME_QUEUE_LINE) std::atomic<bool> closed{ false };
+	FrameQueueStats stats;
+};
+
+// Push an item if there is room, without waiting
+template <typename T, size_t Size>
+bool tryPushQueue(SpscQueue<T, Size>& queue, const T& item)
+{
+	size_t pushed = queue.pushed.load(std::memory_order_relaxed);
+
+	if (pushed - queue.poppedSeen >= Size)
+	{
+		queue.poppedSeen = queue.popped.load(std::memory_order_acquire);
+
+		if (pushed - queue.poppedSeen >= Size)
+			return false;
+	}
+
+	queue.items[pushed & (Size - 1)] = item;
+	queue.pushed.store(pushed + 1, std::memory_order_release);
+	noteQueueDepth(queue.stats, pushed + 1 - queue.poppedSeen);
+	return true;
+}
+
+// Pop an item if there is one, without waiting
+template <typename T, size_t Size>
+bool tryPopQueue(SpscQueue<T, Size>& queue, T& item)
+{
+	size_t popped = queue.popped.load(std::memory_order_relaxed);
+
+	if (popped == queue.pushedSeen)
+	{
+		queue.pushedSeen = queue.pushed.load(std::memory_order_acquire);
+
+		if (popped == queue.pushedSeen)
+			return false;
+	}
+
+	item = queue.items[popped & (Size - 1)];
+	queue.popped.store(popped + 1, std::memory_order_release);
+	return true;
+}
+
+// How many items are in the queue. Any thread can ask, but it can be old by the time it returns
+template <typename T, size_t Size>
+size_t queueDepth(const SpscQueue<T, Size>& queue)
+{
+	size_t popped = queue.popped.load(std::memory_order_acquire);
+	return queue.pushed.load(std::memory_order_acquire) - popped;
+}
+
+// A cell of an MpmcQueue, and the number that says whose turn it is
+template <typename T>
+struct MpmcCell
+{
+	std::atomic<size_t> sequence;
+	T item;
+};
+
+// A queue of Size items that any number of threads push and pop
+template <typename T, size_t Size>
+struct MpmcQueue
+{
+	static_assert(Size > 0 && (Size & (Size - 1)) == 0, "the size of a queue must be a power of two");
+
+	// cell i is free for the push at position i
+	MpmcQueue()
+	{
+		for (size_t i = 0; i < Size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpmcCell<T> cells[Size];
+
+	// the position of the next push, and of the next pop
+	alignas(FRAME_QUEUE_LINE) std::atomic<size_t> pushPosition{ 0 };
+	alignas(FRAME_QUEUE_LINE) std::atomic<size_t> popPosition{ 0 };
+
+	alignas(FRAME_QUEUE_LINE) std::atomic<bool> closed{ false };
+	FrameQueueStats stats;
+};
+
+template <typename T, size_t Size>
+bool tryPushQueue(MpmcQueue<T, Size>& queue, const T& item)
+{
+	size_t position = queue.pushPosition.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		MpmcCell<T>& cell = queue.cells[position & (Size - 1)];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+		// the cell is free for this push, if no other thread takes the position first
+		if (sequence == position)
+		{
+			if (queue.pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.item = item;
+				cell.sequence.store(position + 1, std::memory_order_release);
+				noteQueueDepth(queue.stats, position + 1 - queue.popPosition.load(std::memory_order_relaxed));
+				return true;
+			}
+		}
+		// the pop of the turn before has not taken the item out yet, so the queue is full
+		else if (sequence < position)
+			return false;
+		else
+			position = queue.pushPosition.load(std::memory_order_relaxed);
+	}
+}
+
+template <typename T, size_t Size>
+bool tryPopQueue(MpmcQueue<T, Size>& queue, T& item)
+{
+	size_t position = queue.popPosition.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		MpmcCell<T>& cell = queue.cells[position & (Size - 1)];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+		// the push of this position is done
+		if (sequence == position + 1)
+		{
+			if (queue.popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				item = cell.item;
+				cell.sequence.store(position + Size, std::memory_order_release);
+				return true;
+			}
+		}
+		// the push of this position has not written the item yet, so the queue is empty
+		else if (sequence < position + 1)
+			return false;
+		else
+			position = queue.popPosition.load(std::memory_order_relaxed);
+	}
+}
+
+template <typename T, size_t Size>
+size_t queueDepth(const MpmcQueue<T, Size>& queue)
+{
+	size_t popped = queue.popPosition.load(std::memory_order_acquire);
+	size_t pushed = queue.pushPosition.load(std::memory_order_acquire);
+	return pushed > popped ? pushed - popped : 0;
+}
+
+// Push an item, and wait while the queue is full
+template <typename Queue, typename T>
+void pushQueue(Queue& queue, const T& item)
+{
+	if (tryPushQueue(queue, item))
+		return;
+
+	queue.stats.fullWaits.fetch_add(1, std::memory_order_relaxed);
+
+	for (int tries = 0; !tryPushQueue(queue, item); tries++)
+		frameQueueBackoff(tries);
+}
+
+// Pop an item, and wait while the queue is empty. Returns false once the queue is closed and empty
+template <typename Queue, typename T>
+bool popQueue(Queue& queue, T& item)
+{
+	if (tryPopQueue(queue, item))
+		return true;
+
+	queue.stats.emptyWaits.fetch_add(1, std::memory_order_relaxed);
+
+	for (int tries = 0; ; tries++)
+	{
+		// an item that was pushed before the queue was closed is still popped
+		bool closed = queue.closed.load(std::memory_order_acquire);
+
+		if (tryPopQueue(queue, item))
+			return true;
+
+		if (closed)
+			return false;
+
+		frameQueueBackoff(tries);
+	}
+}
+
+// Tell the threads that pop that no more items come
+template <typename Queue>
+void closeQueue(Queue& queue)
+{
+	queue.closed.store(true, std::memory_order_release);
+}
@@ -0,0 +1,176 @@
+/*
+Title: Basic Ray Tracer
+File Name: FrameRing.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameRing.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// How long a side sleeps before it looks at the other one again, when the ring is full or empty
+#define FRAME_RING_SLEEP std::chrono::microseconds(200)
+
+// bytes rounded up to the alignment of the slots
+static size_t alignRingBytes(size_t bytes)
+{
+	return (bytes + FRAME_RING_ALIGNMENT - 1) / FRAME_RING_ALIGNMENT * FRAME_RING_ALIGNMENT;
+}
+
+// The slot of a frame. The slots are after the header
+static unsigned char* ringSlot(FrameRingHeader* header, uint64_t frame)
+{
+	return (unsigned char*)header + alignRingBytes(sizeof(FrameRingHeader)) + (frame % header->slots) * header->slotBytes;
+}
+
+bool startFrameRing(FrameRing& ring, int slots, size_t frameBytes, const std::string& command)
+{
+	if (command.size() >= FRAME_RING_COMMAND_SIZE)
+	{
+		std::cout << "the command of the encoder is too long for the frame ring" << std::endl;
+		return false;
+	}
+
+	size_t slotBytes = alignRingBytes(frameBytes);
+
+	if (!createSharedMemory(alignRingBytes(sizeof(FrameRingHeader)) + slotBytes * slots, ring.memory))
+	{
+		std::cout << "could not make the shared memory of the frame ring" << std::endl;
+		return false;
+	}
+
+	// the memory starts as zeros, so the counts and closed are 0
+	ring.header = (FrameRingHeader*)ring.memory.data;
+	ring.header->slots = (uint32_t)slots;
+	ring.header->frameBytes = frameBytes;
+	ring.header->slotBytes = slotBytes;
+	strcpy(ring.header->command, command.c_str());
+	ring.header->magic = FRAME_RING_MAGIC;
+	ring.waits = 0;
+
+	if (!startProcess("\"" + programPath() + "\" --encode-shm \"" + ring.memory.name + "\"", ring.encoder))
+	{
+		std::cout << "could not start the encoder of the frame ring" << std::endl;
+		closeSharedMemory(ring.memory);
+		ring.header = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+unsigned char* beginRingFrame(FrameRing& ring)
+{
+	FrameRingHeader* header = ring.header;
+	uint64_t written = header->written.load(std::memory_order_relaxed);
+
+	if (written - header->read.load(std::memory_order_acquire) < header->slots)
+		return ringSlot(header, written);
+
+	ring.waits++;
+
+	while (written - header->read.load(std::memory_order_acquire) >= header->slots)
+	{
+		int exitCode;
+		if (waitProcess(ring.encoder, 0, exitCode))
+			return nullptr;
+
+		std::this_thread::sleep_for(FRAME_RING_SLEEP);
+	}
+
+	return ringSlot(header, written);
+}
+
+void endRingFrame(FrameRing& ring)
+{
+	// the bytes of the slot are there before the encoder can see the count
+	ring.header->written.fetch_add(1, std::memory_order_release);
+}
+
+void stopFrameRing(FrameRing& ring)
+{
+	if (ring.header == nullptr)
+		return;
+
+	ring.header->closed.store(1, std::memory_order_release);
+
+	int exitCode;
+	waitProcess(ring.encoder, -1, exitCode);
+
+	closeSharedMemory(ring.memory);
+	ring.header = nullptr;
+}
+
+bool runRingEncoder(const std::string& name)
+{
+	SharedMemory memory;
+
+	if (!openSharedMemory(name, memory) || memory.size < sizeof(FrameRingHeader))
+	{
+		std::cout << "could not open the frame ring " << name << std::endl;
+		return false;
+	}
+
+	FrameRingHeader* header = (FrameRingHeader*)memory.data;
+
+	if (header->magic != FRAME_RING_MAGIC)
+	{
+		std::cout << name << " is not a frame ring" << std::endl;
+		closeSharedMemory(memory);
+		return false;
+	}
+
+	FILE* pipe = openPipe(header->command, true);
+
+	if (pipe == nullptr)
+	{
+		std::cout << "could not start " << header->command << std::endl;
+		closeSharedMemory(memory);
+		return false;
+	}
+
+	uint64_t next = header->read.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		if (next == header->written.load(std::memory_order_acquire))
+		{
+			// closed is set after the last frame was counted, so if it is set, the count is the last one
+			if (header->closed.load(std::memory_order_acquire) && next == header->written.load(std::memory_order_acquire))
+				break;
+
+			std::this_thread::sleep_for(FRAME_RING_SLEEP);
+			continue;
+		}
+
+		fwrite(ringSlot(header, next), 1, (size_t)header->frameBytes, pipe);
+
+		// the slot can be written again once the pipe has the bytes
+		next++;
+		header->read.store(next, std::memory_order_release);
+	}
+
+	closePipe(pipe);
+	closeSharedMemory(memory);
+	return true;
+}
@@ -0,0 +1,100 @@
+/*
+Title: Basic Ray Tracer
+File Name: FrameRing.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The frames of --shm-encoder go to the encoder through a ring of slots in
+shared memory (see SharedMemory in Platform.h) instead of through a pipe,
+so the renderer copies every frame once, from the mapped pixel buffer of
+the readback into a slot, and never waits for the kernel to take the
+bytes. The encoder is a copy of this program with --encode-shm <name>,
+which maps the same memory, and feeds the frames into the command in the
+header of the ring (the ffmpeg that the pipe would have started), so the
+copy into ffmpeg is on its own process, off the render thread.
+
+There is one writer and one reader, so the ring needs no lock: written is
+the count of frames that the renderer has put in, and only it changes
+it, and read is the count that the encoder has taken, and only the
+encoder changes it. Frame n is in slot n % slots. The renderer waits
+while every slot is full, and the encoder waits while every slot is
+empty, with short sleeps, and it ends when closed is set and it has taken
+every frame.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "Platform.h"
+
+#define FRAME_RING_MAGIC 0x474E4952u
+#define FRAME_RING_COMMAND_SIZE 2048
+
+// The slots start at this alignment, and are a multiple of it, so a frame is copied with whole cache lines
+#define FRAME_RING_ALIGNMENT 64
+
+// The start of the shared memory, before the slots
+struct FrameRingHeader
+{
+	uint32_t magic;
+	uint32_t slots;
+	uint64_t frameBytes;
+	uint64_t slotBytes;
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> read;
+	std::atomic<uint32_t> closed;
+	char command[FRAME_RING_COMMAND_SIZE];
+};
+
+// The atomics are used by two processes, which only works if they are not a lock inside of one of them.
+// The project is C++14, so this is the macro of <atomic>, not is_always_lock_free (2 means always lock free)
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the frame ring needs lock-free 64 bit atomics");
+
+// The ring of the renderer, and the encoder that it started
+struct FrameRing
+{
+	SharedMemory memory;
+	FrameRingHeader* header = nullptr;
+	ChildProcess encoder;
+
+	// how many times a frame had to wait for a free slot
+	int waits = 0;
+};
+
+// Make a ring of slots for frames of frameBytes, and start the encoder, which runs command with the frames
+// on its standard input. Returns false if the memory could not be made or the encoder not started
+bool startFrameRing(FrameRing& ring, int slots, size_t frameBytes, const std::string& command);
+
+// The slot that the next frame is copied into, once there is one that is free.
+// Returns nullptr if the encoder has ended, and the frame cannot go anywhere
+unsigned char* beginRingFrame(FrameRing& ring);
+
+// Give the frame that was copied into the slot of beginRingFrame to the encoder
+void endRingFrame(FrameRing& ring);
+
+// Tell the encoder that there are no more frames, and wait for it to write the ones that are left, and end
+void stopFrameRing(FrameRing& ring);
+
+// The encoder of --encode-shm: map the ring of name, run its command, and write every frame into it until the ring
+// is closed. Returns false if the ring or the command could not be opened
+bool runRingEncoder(const std::string& name);
@@ -0,0 +1,200 @@
+/*
+Title: Basic Ray Tracer
+File Name: GlDebug.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GlDebug.h"
+
+#include "GL/glew.h"
+
+#include "Platform.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// One kind of message, which the driver can send many times
+struct GlMessageKind
+{
+	GLenum type;
+	GLenum severity;
+	std::string text;
+	int count = 0;
+	int frames = 0;
+	int firstFrame = -1;
+	int lastFrame = -1;
+};
+
+// The calls of one GL_STALL_ZONE name that took too long
+struct GlStall
+{
+	int count = 0;
+	double totalMs = 0.0;
+	double worstMs = 0.0;
+	int worstFrame = -1;
+};
+
+static bool debugging = false;
+static double stallSeconds = 0.0;
+static int debugFrame = -1;
+
+// The loader thread of --async-upload has a context too, so the callback can come from either thread
+static std::mutex debugMutex;
+static std::map<std::tuple<GLenum, GLenum, GLuint, std::string>, GlMessageKind> messageKinds;
+static std::map<const char*, GlStall> stalls;
+
+static const char* messageTypeName(GLenum type)
+{
+	switch (type)
+	{
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+static void GLAPIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void*)
+{
+	// the groups of glPushDebugGroup are not about the program
+	if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP || type == GL_DEBUG_TYPE_MARKER)
+		return;
+
+	std::string text = length >= 0 ? std::string(message, length) : std::string(message);
+
+	// Most drivers give every kind an id of its own, and the same kind can name other buffers in its text.
+	// The ones that give every message id 0 only have the text to tell them apart
+	std::lock_guard<std::mutex> lock(debugMutex);
+	GlMessageKind& kind = messageKinds[std::make_tuple(source, type, id, id == 0 ? text : std::string())];
+
+	if (kind.count == 0)
+	{
+		kind.type = type;
+		kind.severity = severity;
+		kind.text = text;
+		kind.firstFrame = debugFrame;
+
+		// the notifications (like where a buffer was put) come all the time, and are only in the report
+		if (severity != GL_DEBUG_SEVERITY_NOTIFICATION)
+			std::cout << "GL " << messageTypeName(type) << " in frame " << debugFrame << ": " << text << std::endl;
+	}
+
+	kind.count++;
+
+	if (kind.lastFrame != debugFrame || kind.frames == 0)
+		kind.frames++;
+
+	kind.lastFrame = debugFrame;
+}
+
+bool startGlDebug(double stallMs)
+{
+	if (!GLEW_KHR_debug && !GLEW_VERSION_4_3)
+		return false;
+
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(debugMessage, nullptr);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+
+	stallSeconds = stallMs / 1000.0;
+	debugging = true;
+	return true;
+}
+
+bool isGlDebugging()
+{
+	return debugging;
+}
+
+void setGlDebugFrame(int frame)
+{
+	debugFrame = frame;
+}
+
+void printGlDebugReport()
+{
+	if (!debugging)
+		return;
+
+	std::lock_guard<std::mutex> lock(debugMutex);
+
+	std::vector<const GlMessageKind*> kinds;
+	for (const auto& kind : messageKinds)
+		kinds.push_back(&kind.second);
+
+	// the ones that came the most first
+	std::sort(kinds.begin(), kinds.end(), [](const GlMessageKind* a, const GlMessageKind* b) { return a->count > b->count; });
+
+	std::cout << "GL debug: " << kinds.size() << " kinds of messages" << std::endl;
+
+	for (const GlMessageKind* kind : kinds)
+	{
+		std::cout << "  " << messageTypeName(kind->type) << ", " << kind->count << " times in " << kind->frames
+			<< " frames from frame " << kind->firstFrame << ": " << kind->text << std::endl;
+	}
+
+	for (const auto& stall : stalls)
+	{
+		std::cout << "  " << stall.first << " stalled " << stall.second.count << " times, " << stall.second.totalMs
+			<< " ms in all, the longest " << stall.second.worstMs << " ms in frame " << stall.second.worstFrame << std::endl;
+	}
+}
+
+GlStallZone::GlStallZone(const char* zoneName)
+{
+	name = zoneName;
+	start = debugging ? platformTime() : 0.0;
+}
+
+GlStallZone::~GlStallZone()
+{
+	if (!debugging)
+		return;
+
+	double seconds = platformTime() - start;
+
+	if (seconds <= stallSeconds)
+		return;
+
+	double ms = seconds * 1000.0;
+
+	std::lock_guard<std::mutex> lock(debugMutex);
+	GlStall& stall = stalls[name];
+
+	if (stall.count == 0)
+		std::cout << "GL stall in frame " << debugFrame << ": " << name << " took " << ms << " ms" << std::endl;
+
+	stall.count++;
+	stall.totalMs += ms;
+
+	if (ms > stall.worstMs)
+	{
+		stall.worstMs = ms;
+		stall.worstFrame = debugFrame;
+	}
+}
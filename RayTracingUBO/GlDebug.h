@@ -0,0 +1,69 @@
+/*
+Title: Basic Ray Tracer
+File Name: GlDebug.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The debug output of --gl-debug. The driver knows when the program does
+something slow that still works, like a glBufferData that has to make a
+new buffer every frame, or a call that waits for the GPU, and with
+KHR_debug (core since OpenGL 4.3) it says so in a message. startGlDebug
+asks for every message, right in the call that causes it (synchronous
+output), so the callback sorts them into kinds (by source, type, and id,
+or the text when the driver gives every message id 0), and counts how
+many times every kind came, and in how many frames. A kind is printed
+the first time it comes, and all of them with their counts at the end.
+
+And the stalls: GL_STALL_ZONE("name") at the start of a block times a
+call that can make the CPU wait for the GPU (glReadPixels into memory,
+mapping a buffer, reading a query or a buffer back), and if it took
+longer than stallMs, it is a stall, which is printed the first time, and
+counted for the report. Without --gl-debug, a zone only checks a bool.
+*/
+
+#pragma once
+
+// Turn on the debug output of the current context, and count its messages from now on.
+// A call that takes longer than stallMs is a stall. Returns false if the context has no debug output
+bool startGlDebug(double stallMs);
+
+// True after startGlDebug
+bool isGlDebugging();
+
+// The frame that the messages and stalls from now on come in
+void setGlDebugFrame(int frame);
+
+// Print every kind of message with its counts, and every call that stalled, with how often and how long
+void printGlDebugReport();
+
+// Times the block that it is in, and counts it as a stall if it took too long. The name must be
+// a string that lives forever, like a string literal, because only the pointer is saved
+struct GlStallZone
+{
+	const char* name;
+	double start;
+
+	GlStallZone(const char* zoneName);
+	~GlStallZone();
+};
+
+#define GL_STALL_JOIN2(a, b) a##b
+#define GL_STALL_JOIN(a, b) GL_STALL_JOIN2(a, b)
+#define GL_STALL_ZONE(name) GlStallZone GL_STALL_JOIN(glStallZone, __LINE__)(name)
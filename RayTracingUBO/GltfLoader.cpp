@@ -0,0 +1,698 @@
+/*
+Title: Basic Ray Tracer
+File Name: GltfLoader.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GltfLoader.h"
+#include "Json.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+// The component types of an accessor
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+
+// The mode of a primitive that is a list of triangles (the default)
+#define GLTF_TRIANGLES 4
+
+// The whole file, or false if it could not be read
+static bool readFile(const std::string& fileName, std::vector<unsigned char>& bytes)
+{
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+
+	if (!file)
+		return false;
+
+	bytes.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)bytes.data(), bytes.size());
+
+	return (bool)file;
+}
+
+// The bytes of a data: URI in base64
+static bool decodeBase64(const std::string& text, std::vector<unsigned char>& bytes)
+{
+	unsigned int bits = 0;
+	int numBits = 0;
+
+	for (char c : text)
+	{
+		int v;
+
+		if (c >= 'A' && c <= 'Z') v = c - 'A';
+		else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+		else if (c >= '0' && c <= '9') v = c - '0' + 52;
+		else if (c == '+') v = 62;
+		else if (c == '/') v = 63;
+		else if (c == '=') break;
+		else return false;
+
+		bits = (bits << 6) | (unsigned int)v;
+		numBits += 6;
+
+		if (numBits >= 8)
+		{
+			numBits -= 8;
+			bytes.push_back((unsigned char)(bits >> numBits));
+		}
+	}
+
+	return true;
+}
+
+// A URI of a file next to the glTF file, with its %20 and the like turned back into characters
+static std::string decodeUri(const std::string& uri)
+{
+	std::string out;
+
+	for (size_t i = 0; i < uri.size(); i++)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size())
+		{
+			out += (char)strtoul(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+			i += 2;
+		}
+		else
+			out += uri[i];
+	}
+
+	return out;
+}
+
+// A glTF file while it is read: its JSON and the bytes of its buffers
+struct GltfFile
+{
+	JsonValue json;
+	std::vector<std::vector<unsigned char>> buffers;
+};
+
+// Where the elements of an accessor are: element i starts at data + i * stride
+struct GltfAccessor
+{
+	const unsigned char* data = nullptr;
+	size_t stride = 0;
+	int count = 0;
+	int componentType = 0;
+	std::string type;
+};
+
+// Find accessor a in the buffers. Returns false if it is not there, or goes past the end of its buffer
+static bool findAccessor(const GltfFile& gltf, int a, GltfAccessor& accessor)
+{
+	const JsonValue& json = gltf.json["accessors"][a];
+	const JsonValue& view = gltf.json["bufferViews"][json["bufferView"].intOr(-1)];
+	int buffer = view["buffer"].intOr(-1);
+
+	if (json.type != JsonValue::OBJECT || view.type != JsonValue::OBJECT || buffer < 0 || buffer >= (int)gltf.buffers.size())
+		return false;
+
+	accessor.count = json["count"].intOr(0);
+	accessor.componentType = json["componentType"].intOr(0);
+	accessor.type = json["type"].string;
+
+	size_t componentSize = accessor.componentType == GLTF_UNSIGNED_BYTE ? 1 : accessor.componentType == GLTF_UNSIGNED_SHORT ? 2 : 4;
+	size_t components = accessor.type == "VEC3" ? 3 : accessor.type == "VEC4" ? 4 : accessor.type == "VEC2" ? 2 : accessor.type == "MAT4" ? 16 : 1;
+	size_t elementSize = componentSize * components;
+
+	size_t offset = (size_t)view["byteOffset"].intOr(0) + (size_t)json["byteOffset"].intOr(0);
+	accessor.stride = view.has("byteStride") ? (size_t)view["byteStride"].intOr(0) : elementSize;
+
+	const std::vector<unsigned char>& bytes = gltf.buffers[buffer];
+
+	if (accessor.count <= 0 || offset + accessor.stride * (accessor.count - 1) + elementSize > bytes.size())
+		return false;
+
+	accessor.data = bytes.data() + offset;
+	return true;
+}
+
+// Index i of an accessor of indices
+static unsigned int readIndex(const GltfAccessor& accessor, int i)
+{
+	const unsigned char* p = accessor.data + accessor.stride * i;
+
+	if (accessor.componentType == GLTF_UNSIGNED_BYTE)
+		return *p;
+
+	if (accessor.componentType == GLTF_UNSIGNED_SHORT)
+	{
+		unsigned short index;
+		memcpy(&index, p, sizeof(index));
+		return index;
+	}
+
+	unsigned int index;
+	memcpy(&index, p, sizeof(index));
+	return index;
+}
+
+// Component k of element i of an accessor, as a float. With normalized, the bytes and shorts
+// are a fraction of their biggest value (the weights of a skin), and without it they are numbers (its joints)
+static float readComponent(const GltfAccessor& accessor, int i, int k, bool normalized)
+{
+	const unsigned char* p = accessor.data + accessor.stride * i;
+
+	if (accessor.componentType == GLTF_UNSIGNED_BYTE)
+		return normalized ? p[k] / 255.0f : (float)p[k];
+
+	if (accessor.componentType == GLTF_UNSIGNED_SHORT)
+	{
+		unsigned short value;
+		memcpy(&value, p + 2 * k, sizeof(value));
+		return normalized ? value / 65535.0f : (float)value;
+	}
+
+	float value;
+	memcpy(&value, p + 4 * k, sizeof(value));
+	return value;
+}
+
+// Add the triangles of every primitive of mesh m to mesh, and with readSkins,
+// the joints and weights of their corners, if every primitive has them
+static bool readMesh(const GltfFile& gltf, int m, glm::vec3 color, float reflectivity, bool readSkins, GltfMesh& mesh)
+{
+	bool skinned = readSkins;
+
+	const JsonValue& primitives = gltf.json["meshes"][m]["primitives"];
+
+	for (int p = 0; p < primitives.size(); p++)
+	{
+		const JsonValue& primitive = primitives[p];
+
+		// points and lines cannot be hit by a ray
+		if (primitive["mode"].intOr(GLTF_TRIANGLES) != GLTF_TRIANGLES)
+			continue;
+
+		GltfAccessor positions;
+		if (!findAccessor(gltf, primitive["attributes"]["POSITION"].intOr(-1), positions) ||
+			positions.componentType != GLTF_FLOAT || positions.type != "VEC3")
+		{
+			std::cout << "mesh " << m << " has a primitive without float points" << std::endl;
+			return false;
+		}
+
+		GltfAccessor indices;
+		bool indexed = primitive.has("indices");
+		if (indexed && (!findAccessor(gltf, primitive["indices"].intOr(-1), indices) || indices.type != "SCALAR"))
+		{
+			std::cout << "mesh " << m << " has a primitive with indices that cannot be read" << std::endl;
+			return false;
+		}
+
+		// the material of the primitive, where it has one
+		glm::vec3 primitiveColor = color;
+		float primitiveReflectivity = reflectivity;
+		const JsonValue& pbr = gltf.json["materials"][primitive["material"].intOr(-1)]["pbrMetallicRoughness"];
+
+		if (pbr.has("baseColorFactor"))
+		{
+			for (int k = 0; k < 3; k++)
+				primitiveColor[k] = (float)pbr["baseColorFactor"][k].numberOr(1.0);
+		}
+
+		if (pbr.has("metallicFactor"))
+			primitiveReflectivity = (float)pbr["metallicFactor"].numberOr(1.0);
+
+		// the joints are bytes or shorts, and the weights are floats, or bytes or shorts that are fractions
+		GltfAccessor joints, weights;
+		skinned = skinned &&
+			findAccessor(gltf, primitive["attributes"]["JOINTS_0"].intOr(-1), joints) && joints.type == "VEC4" &&
+			joints.componentType != GLTF_FLOAT && joints.count == positions.count &&
+			findAccessor(gltf, primitive["attributes"]["WEIGHTS_0"].intOr(-1), weights) && weights.type == "VEC4" &&
+			weights.count == positions.count;
+
+		int numCorners = indexed ? indices.count : positions.count;
+
+		for (int t = 0; t + 2 < numCorners; t += 3)
+		{
+			glm::vec3 corner[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int index = indexed ? readIndex(indices, t + k) : (unsigned int)(t + k);
+
+				if (index >= (unsigned int)positions.count)
+				{
+					std::cout << "mesh " << m << " has an index of a point that is not in it" << std::endl;
+					return false;
+				}
+
+				memcpy(&corner[k], positions.data + positions.stride * index, sizeof(glm::vec3));
+
+				if (!skinned)
+					continue;
+
+				GltfCornerSkin skin;
+				for (int j = 0; j < 4; j++)
+				{
+					skin.joints[j] = (int)readComponent(joints, index, j, false);
+					skin.weights[j] = readComponent(weights, index, j, weights.componentType != GLTF_FLOAT);
+				}
+
+				// the weights should add up to 1, but bytes and shorts do not always, exactly
+				float sum = skin.weights.x + skin.weights.y + skin.weights.z + skin.weights.w;
+				skin.weights = sum > 0.0f ? skin.weights / sum : glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+				mesh.cornerSkins.push_back(skin);
+			}
+
+			// a face with no area has no normal, and no ray can hit it
+			glm::vec3 normal = glm::cross(corner[1] - corner[0], corner[2] - corner[0]);
+			if (glm::dot(normal, normal) == 0.0f)
+				normal = glm::vec3(0.0f, 1.0f, 0.0f);
+
+			mesh.triangles.push_back(makeTriangle(corner[0], corner[1], corner[2], normal, primitiveColor, primitiveReflectivity));
+		}
+	}
+
+	// a mesh with some primitives that have no joints cannot be moved by its skin
+	if (!skinned)
+		mesh.cornerSkins.clear();
+
+	return true;
+}
+
+// The matrix of a node, from its parent's space to its own
+static glm::mat4 nodeMatrix(const JsonValue& node)
+{
+	glm::mat4 matrix;
+
+	if (node.has("matrix"))
+	{
+		// glTF matrices are column-major, like glm
+		for (int i = 0; i < 16; i++)
+			matrix[i / 4][i % 4] = (float)node["matrix"][i].numberOr(i % 5 == 0 ? 1.0 : 0.0);
+
+		return matrix;
+	}
+
+	const JsonValue& t = node["translation"];
+	const JsonValue& r = node["rotation"];
+	const JsonValue& s = node["scale"];
+
+	glm::vec3 translation((float)t[0].numberOr(0.0), (float)t[1].numberOr(0.0), (float)t[2].numberOr(0.0));
+	glm::quat rotation((float)r[3].numberOr(1.0), (float)r[0].numberOr(0.0), (float)r[1].numberOr(0.0), (float)r[2].numberOr(0.0));
+	glm::vec3 scale((float)s[0].numberOr(1.0), (float)s[1].numberOr(1.0), (float)s[2].numberOr(1.0));
+
+	return glm::translate(glm::mat4(), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(), scale);
+}
+
+// A node of the skeleton, with its rest translation, rotation, and scale, which the channels replace
+static GltfNode readNode(const JsonValue& node)
+{
+	const JsonValue& t = node["translation"];
+	const JsonValue& r = node["rotation"];
+	const JsonValue& s = node["scale"];
+
+	GltfNode out;
+	out.parent = -1;
+	out.hasMatrix = node.has("matrix");
+	out.matrix = nodeMatrix(node);
+	out.translation = glm::vec3((float)t[0].numberOr(0.0), (float)t[1].numberOr(0.0), (float)t[2].numberOr(0.0));
+	out.rotation = glm::quat((float)r[3].numberOr(1.0), (float)r[0].numberOr(0.0), (float)r[1].numberOr(0.0), (float)r[2].numberOr(0.0));
+	out.scale = glm::vec3((float)s[0].numberOr(1.0), (float)s[1].numberOr(1.0), (float)s[2].numberOr(1.0));
+	return out;
+}
+
+// Read the nodes, the skins, and the channels of the first animation into skeleton.
+// Something that cannot be read is left out, so the mesh stays in its bind pose, or the node stays where it is
+static void readSkeleton(const GltfFile& gltf, GltfSkeleton& skeleton)
+{
+	const JsonValue& nodes = gltf.json["nodes"];
+	skeleton.nodes.resize(nodes.size());
+
+	for (int n = 0; n < nodes.size(); n++)
+		skeleton.nodes[n] = readNode(nodes[n]);
+
+	for (int n = 0; n < nodes.size(); n++)
+	{
+		for (int c = 0; c < nodes[n]["children"].size(); c++)
+		{
+			int child = nodes[n]["children"][c].intOr(-1);
+			if (child >= 0 && child < nodes.size())
+				skeleton.nodes[child].parent = n;
+		}
+	}
+
+	// Every parent before its children: from every root, down its tree.
+	// loadGltf already said no if the scene is not a tree, and a node that is in a loop outside of it is left out
+	std::vector<bool> placed(nodes.size(), false);
+	for (int root = 0; root < nodes.size(); root++)
+	{
+		if (skeleton.nodes[root].parent >= 0)
+			continue;
+
+		std::vector<int> stack(1, root);
+		while (!stack.empty())
+		{
+			int n = stack.back();
+			stack.pop_back();
+
+			if (placed[n])
+				continue;
+
+			placed[n] = true;
+			skeleton.order.push_back(n);
+
+			for (int c = 0; c < nodes[n]["children"].size(); c++)
+			{
+				int child = nodes[n]["children"][c].intOr(-1);
+				if (child >= 0 && child < nodes.size())
+					stack.push_back(child);
+			}
+		}
+	}
+
+	const JsonValue& skins = gltf.json["skins"];
+	skeleton.skins.resize(skins.size());
+
+	for (int s = 0; s < skins.size(); s++)
+	{
+		GltfSkin& skin = skeleton.skins[s];
+		const JsonValue& joints = skins[s]["joints"];
+
+		GltfAccessor inverseBind;
+		bool hasInverseBind = findAccessor(gltf, skins[s]["inverseBindMatrices"].intOr(-1), inverseBind) &&
+			inverseBind.type == "MAT4" && inverseBind.componentType == GLTF_FLOAT && inverseBind.count >= joints.size();
+
+		for (int j = 0; j < joints.size(); j++)
+		{
+			int joint = joints[j].intOr(-1);
+			skin.joints.push_back(joint >= 0 && joint < nodes.size() ? joint : -1);
+
+			// without them, every inverse bind matrix is the identity
+			glm::mat4 matrix;
+			if (hasInverseBind)
+				memcpy(&matrix, inverseBind.data + inverseBind.stride * j, sizeof(matrix));
+			skin.inverseBind.push_back(matrix);
+		}
+	}
+
+	const JsonValue& animation = gltf.json["animations"][0];
+
+	for (int c = 0; c < animation["channels"].size(); c++)
+	{
+		const JsonValue& channel = animation["channels"][c];
+		const JsonValue& sampler = animation["samplers"][channel["sampler"].intOr(-1)];
+		const std::string& path = channel["target"]["path"].string;
+
+		GltfChannel out;
+		out.node = channel["target"]["node"].intOr(-1);
+		out.path = path == "rotation" ? GltfChannel::ROTATION : path == "scale" ? GltfChannel::SCALE : GltfChannel::TRANSLATION;
+		out.step = sampler["interpolation"].string == "STEP";
+
+		// the weights of morph targets are not read
+		GltfAccessor input, output;
+		if (out.node < 0 || out.node >= nodes.size() || (path != "translation" && path != "rotation" && path != "scale") ||
+			!findAccessor(gltf, sampler["input"].intOr(-1), input) || input.componentType != GLTF_FLOAT ||
+			!findAccessor(gltf, sampler["output"].intOr(-1), output) || output.componentType != GLTF_FLOAT)
+			continue;
+
+		// a cubic spline has an in tangent, the value, and an out tangent for every time
+		bool cubic = sampler["interpolation"].string == "CUBICSPLINE";
+		int components = out.path == GltfChannel::ROTATION ? 4 : 3;
+
+		if (output.count < input.count * (cubic ? 3 : 1))
+			continue;
+
+		for (int k = 0; k < input.count; k++)
+		{
+			out.times.push_back(readComponent(input, k, 0, false));
+
+			glm::vec4 value(0.0f);
+			for (int i = 0; i < components; i++)
+				value[i] = readComponent(output, cubic ? 3 * k + 1 : k, i, false);
+			out.values.push_back(value);
+		}
+
+		skeleton.duration = std::max(skeleton.duration, out.times.back());
+		skeleton.channels.push_back(out);
+	}
+}
+
+// The value of a channel at time, between the two keys around it
+static glm::vec4 sampleChannel(const GltfChannel& channel, float time)
+{
+	size_t next = std::upper_bound(channel.times.begin(), channel.times.end(), time) - channel.times.begin();
+
+	if (next == 0)
+		return channel.values.front();
+	if (next == channel.times.size())
+		return channel.values.back();
+
+	const glm::vec4& a = channel.values[next - 1];
+	const glm::vec4& b = channel.values[next];
+	float span = channel.times[next] - channel.times[next - 1];
+	float t = (channel.step || span <= 0.0f) ? 0.0f : (time - channel.times[next - 1]) / span;
+
+	if (channel.path != GltfChannel::ROTATION)
+		return glm::mix(a, b, t);
+
+	glm::quat q = glm::slerp(glm::quat(a.w, a.x, a.y, a.z), glm::quat(b.w, b.x, b.y, b.z), t);
+	return glm::vec4(q.x, q.y, q.z, q.w);
+}
+
+void poseGltfSkin(const GltfSkeleton& skeleton, int skin, float time, std::vector<glm::mat4>& jointMatrices)
+{
+	std::vector<GltfNode> nodes = skeleton.nodes;
+
+	if (skeleton.duration > 0.0f)
+		time = fmodf(std::max(time, 0.0f), skeleton.duration);
+
+	// a node that a channel moves is made from its translation, rotation, and scale, even if it has a matrix
+	for (const GltfChannel& channel : skeleton.channels)
+	{
+		GltfNode& node = nodes[channel.node];
+		glm::vec4 value = sampleChannel(channel, time);
+
+		if (channel.path == GltfChannel::TRANSLATION)
+			node.translation = glm::vec3(value);
+		else if (channel.path == GltfChannel::SCALE)
+			node.scale = glm::vec3(value);
+		else
+			node.rotation = glm::normalize(glm::quat(value.w, value.x, value.y, value.z));
+
+		node.hasMatrix = false;
+	}
+
+	std::vector<glm::mat4> world(nodes.size());
+
+	for (int n : skeleton.order)
+	{
+		const GltfNode& node = nodes[n];
+		glm::mat4 local = node.hasMatrix ? node.matrix :
+			glm::translate(glm::mat4(), node.translation) * glm::mat4_cast(node.rotation) * glm::scale(glm::mat4(), node.scale);
+
+		world[n] = node.parent >= 0 ? world[node.parent] * local : local;
+	}
+
+	const GltfSkin& joints = skeleton.skins[skin];
+	jointMatrices.resize(joints.joints.size());
+
+	for (size_t j = 0; j < joints.joints.size(); j++)
+		jointMatrices[j] = (joints.joints[j] >= 0 ? world[joints.joints[j]] : glm::mat4()) * joints.inverseBind[j];
+}
+
+bool loadGltf(const std::string& fileName, glm::vec3 color, float reflectivity,
+	std::vector<GltfMesh>& meshes, std::vector<GltfInstance>& instances, GltfSkeleton* skeleton)
+{
+	PROFILE_ZONE("loadGltf");
+
+	std::vector<unsigned char> bytes;
+
+	if (!readFile(fileName, bytes))
+	{
+		std::cout << "Can't read " << fileName << std::endl;
+		return false;
+	}
+
+	// A .glb is a header, then a chunk of JSON, then a chunk with the bytes of the first buffer
+	const char* text = (const char*)bytes.data();
+	size_t textSize = bytes.size();
+	std::vector<unsigned char> binaryChunk;
+	bool binary = bytes.size() >= 12 && memcmp(bytes.data(), "glTF", 4) == 0;
+
+	if (binary)
+	{
+		textSize = 0;
+
+		for (size_t offset = 12; offset + 8 <= bytes.size();)
+		{
+			unsigned int chunkSize, chunkType;
+			memcpy(&chunkSize, &bytes[offset], 4);
+			memcpy(&chunkType, &bytes[offset + 4], 4);
+
+			if (offset + 8 + chunkSize > bytes.size())
+				break;
+
+			if (chunkType == 0x4E4F534A)
+			{
+				text = (const char*)&bytes[offset + 8];
+				textSize = chunkSize;
+			}
+			else if (chunkType == 0x004E4942)
+				binaryChunk.assign(bytes.begin() + offset + 8, bytes.begin() + offset + 8 + chunkSize);
+
+			offset += 8 + ((chunkSize + 3) & ~3u);
+		}
+	}
+
+	GltfFile gltf;
+	if (!parseJson(text, textSize, gltf.json) || gltf.json.type != JsonValue::OBJECT)
+	{
+		std::cout << fileName << " is not a glTF file" << std::endl;
+		return false;
+	}
+
+	// the buffers in other files are next to this one
+	std::string folder = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+	const JsonValue& buffers = gltf.json["buffers"];
+	gltf.buffers.resize(buffers.size());
+
+	for (int b = 0; b < buffers.size(); b++)
+	{
+		const std::string& uri = buffers[b]["uri"].string;
+		bool read;
+
+		if (uri.empty())
+		{
+			gltf.buffers[b].swap(binaryChunk);
+			read = binary && b == 0;
+		}
+		else if (uri.compare(0, 5, "data:") == 0)
+			read = decodeBase64(uri.substr(uri.find(',') + 1), gltf.buffers[b]);
+		else
+			read = readFile(folder + decodeUri(uri), gltf.buffers[b]);
+
+		if (!read)
+		{
+			std::cout << "Can't read buffer " << b << " of " << fileName << std::endl;
+			return false;
+		}
+	}
+
+	// The nodes of the scene, walked from its roots, with the matrix of every node in the world.
+	// A scene is a tree, so a node that is visited twice is in a loop
+	const JsonValue& nodes = gltf.json["nodes"];
+	const JsonValue& scene = gltf.json["scenes"][gltf.json["scene"].intOr(0)];
+	std::vector<std::pair<int, glm::mat4>> stack;
+	std::vector<bool> visited(nodes.size(), false);
+
+	if (scene.has("nodes"))
+	{
+		// backwards, so that the first root is taken first
+		for (int i = scene["nodes"].size() - 1; i >= 0; i--)
+			stack.push_back({ scene["nodes"][i].intOr(-1), glm::mat4() });
+	}
+	else
+	{
+		// without scenes, every node that is not a child is a root
+		std::vector<bool> child(nodes.size(), false);
+		for (int n = 0; n < nodes.size(); n++)
+		{
+			for (int c = 0; c < nodes[n]["children"].size(); c++)
+			{
+				int index = nodes[n]["children"][c].intOr(-1);
+				if (index >= 0 && index < nodes.size())
+					child[index] = true;
+			}
+		}
+
+		for (int n = nodes.size() - 1; n >= 0; n--)
+		{
+			if (!child[n])
+				stack.push_back({ n, glm::mat4() });
+		}
+	}
+
+	int numMeshes = gltf.json["meshes"].size();
+	size_t firstInstance = instances.size();
+
+	while (!stack.empty())
+	{
+		int n = stack.back().first;
+		glm::mat4 parent = stack.back().second;
+		stack.pop_back();
+
+		if (n < 0 || n >= nodes.size() || visited[n])
+		{
+			std::cout << fileName << " has a node that is not in a tree" << std::endl;
+			instances.resize(firstInstance);
+			return false;
+		}
+
+		visited[n] = true;
+
+		const JsonValue& node = nodes[n];
+		glm::mat4 matrix = parent * nodeMatrix(node);
+		int mesh = node["mesh"].intOr(-1);
+		int skin = node["skin"].intOr(-1);
+
+		if (skeleton == nullptr || skin >= gltf.json["skins"].size())
+			skin = -1;
+
+		if (mesh >= 0 && mesh < numMeshes)
+			instances.push_back({ mesh, matrix, skin });
+
+		for (int c = node["children"].size() - 1; c >= 0; c--)
+			stack.push_back({ node["children"][c].intOr(-1), matrix });
+	}
+
+	// only the meshes that a node uses are read, each once, no matter how many nodes use it,
+	// and only the meshes that a node with a skin uses have the joints and weights of their corners
+	meshes.assign(numMeshes, GltfMesh());
+	std::vector<bool> used(numMeshes, false);
+	std::vector<bool> skinned(numMeshes, false);
+
+	for (size_t i = firstInstance; i < instances.size(); i++)
+	{
+		used[instances[i].mesh] = true;
+		if (instances[i].skin >= 0)
+			skinned[instances[i].mesh] = true;
+	}
+
+	for (int m = 0; m < numMeshes; m++)
+	{
+		if (used[m] && !readMesh(gltf, m, color, reflectivity, skinned[m], meshes[m]))
+		{
+			std::cout << "Can't read the meshes of " << fileName << std::endl;
+			instances.resize(firstInstance);
+			return false;
+		}
+	}
+
+	if (skeleton != nullptr)
+		readSkeleton(gltf, *skeleton);
+
+	return true;
+}
@@ -0,0 +1,139 @@
+/*
+Title: Basic Ray Tracer
+File Name: GltfLoader.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Reads scenes from glTF 2.0 files, for --gltf <file>, either a .gltf file
+(JSON, with its buffers in .bin files next to it or in data: URIs) or a
+.glb file (the JSON and one buffer in one file). Only what the scene
+has a place for is read: the triangles of the primitives (POSITION and
+the indices), the base color and metallic factor of their material,
+which become the color and reflectivity of the triangles, and the nodes
+of the scene, with their matrix or translation, rotation, and scale.
+Textures, normals, morph targets, and sparse accessors are not.
+
+The skins are read too, if the caller asks for them (see GltfSkeleton):
+the joints and weights of every corner of a skinned mesh (JOINTS_0 and
+WEIGHTS_0), the joints and inverse bind matrices of every skin, and the
+channels of the first animation that move the nodes. poseGltfSkin then
+gives the matrix of every joint of a skin at any time of the animation,
+which main.cpp uploads for Compute.glsl to move the vertices with.
+
+A glTF mesh that many nodes use is kept once: it becomes one GltfMesh,
+in the space of its mesh, and every node that uses it is a GltfInstance
+with the matrix of that node in the world. main.cpp decides what to do
+with the instances (see loadScene).
+
+The JSON is parsed into a tree of values by the small parser of Json.h,
+since the project has no JSON library and a glTF file is mostly small
+JSON and big buffers.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include "../Assets/SceneStructs.h"
+
+// The 4 joints of its skin that move a corner, and how much each of them does, which add up to 1
+struct GltfCornerSkin
+{
+	glm::ivec4 joints;
+	glm::vec4 weights;
+};
+
+// The triangles of one glTF mesh (all of its primitives), in the space of the mesh.
+// If the skins are read and the mesh has joints and weights, cornerSkins has one
+// for every corner, a, b, and c of every triangle one after the other, and is empty if not
+struct GltfMesh
+{
+	std::vector<triangle> triangles;
+	std::vector<GltfCornerSkin> cornerSkins;
+};
+
+// One node of the scene that has a mesh: meshes[mesh] is placed in the world by matrix.
+// skin is the skin of the node in GltfSkeleton::skins, or -1
+struct GltfInstance
+{
+	int mesh;
+	glm::mat4 matrix;
+	int skin;
+};
+
+// A node of the file, the way it is when the animation does not move it. Every node of the file is one of these,
+// not only the joints, because a joint is moved by the nodes above it too. parent is -1 for a root
+struct GltfNode
+{
+	int parent;
+	bool hasMatrix;
+	glm::mat4 matrix;
+	glm::vec3 translation;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+
+// The nodes that are the joints of a skin, and the inverse bind matrix of each one,
+// which moves a vertex of the mesh into the space of the joint
+struct GltfSkin
+{
+	std::vector<int> joints;
+	std::vector<glm::mat4> inverseBind;
+};
+
+// The translation, rotation, or scale of one node through the animation. values has one
+// vec4 for every time (a vec3 with 0 after it for translation and scale, and x, y, z, w for rotation).
+// The keys of a CUBICSPLINE channel are read without their tangents, and are blended like LINEAR ones
+struct GltfChannel
+{
+	enum Path { TRANSLATION, ROTATION, SCALE };
+
+	int node;
+	Path path;
+	bool step;
+	std::vector<float> times;
+	std::vector<glm::vec4> values;
+};
+
+// What poseGltfSkin needs: the nodes, in an order with every parent before its children,
+// the skins, and the channels of the first animation, which loops every duration seconds
+struct GltfSkeleton
+{
+	std::vector<GltfNode> nodes;
+	std::vector<int> order;
+	std::vector<GltfSkin> skins;
+	std::vector<GltfChannel> channels;
+	float duration = 0.0f;
+};
+
+// Read a glTF 2.0 file. A primitive without a material gets color and reflectivity.
+// Meshes that no node of the scene uses are left empty. The skins and the animation are only read
+// if skeleton is not null. Returns false, and says why, if it could not be read
+bool loadGltf(const std::string& fileName, glm::vec3 color, float reflectivity,
+	std::vector<GltfMesh>& meshes, std::vector<GltfInstance>& instances, GltfSkeleton* skeleton = nullptr);
+
+// The matrix of every joint of skin at time seconds into the animation (which loops), times its inverse bind matrix.
+// A vertex of the mesh in its bind pose is moved to its place in the file by the weighted sum of these
+void poseGltfSkin(const GltfSkeleton& skeleton, int skin, float time, std::vector<glm::mat4>& jointMatrices);
@@ -0,0 +1,391 @@
+/*
+Title: Basic Ray Tracer
+File Name: GpuCounters.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GpuCounters.h"
+
+#include "GL/glew.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+const char* gpuCounterPassNames[GPU_COUNTER_PASSES] = { "transform", "draw" };
+
+#define COUNTERS_NONE 0
+#define COUNTERS_AMD 1
+#define COUNTERS_INTEL 2
+
+// An AMD counter that was picked, and its column
+struct AmdCounter
+{
+	GLuint group;
+	GLuint counter;
+	GLenum type;
+};
+
+// An Intel counter of the query, where its value is in the data of the query
+struct IntelCounter
+{
+	GLuint offset;
+	GLuint dataType;
+};
+
+// A sample of one pass: an AMD monitor, or an Intel query handle
+struct CounterSample
+{
+	GLuint handle = 0;
+	bool sampled = false;
+};
+
+static int backend = COUNTERS_NONE;
+static std::vector<std::string> counterNames;
+static std::vector<AmdCounter> amdCounters;
+static std::map<std::pair<GLuint, GLuint>, int> amdColumns;
+static std::vector<IntelCounter> intelCounters;
+static GLuint intelQuery = 0;
+static GLuint intelDataSize = 0;
+static std::vector<CounterSample> samples;
+static CounterSample* activeSample = nullptr;
+
+static std::string lowerCase(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return text;
+}
+
+// True if the name has one of the patterns in it
+static bool matchesPattern(const std::string& name, const std::vector<std::string>& patterns)
+{
+	std::string lower = lowerCase(name);
+
+	for (const std::string& pattern : patterns)
+	{
+		if (!pattern.empty() && lower.find(pattern) != std::string::npos)
+			return true;
+	}
+
+	return false;
+}
+
+// Pick the counters of every group that match, up to as many as the group can count at once
+static void pickAmdCounters(const std::vector<std::string>& patterns)
+{
+	GLint numGroups = 0;
+	glGetPerfMonitorGroupsAMD(&numGroups, 0, nullptr);
+
+	std::vector<GLuint> groups(numGroups);
+	glGetPerfMonitorGroupsAMD(nullptr, numGroups, groups.data());
+
+	for (GLuint group : groups)
+	{
+		char groupName[256] = {};
+		glGetPerfMonitorGroupStringAMD(group, sizeof(groupName), nullptr, groupName);
+
+		GLint numCounters = 0;
+		GLint maxActive = 0;
+		glGetPerfMonitorCountersAMD(group, &numCounters, &maxActive, 0, nullptr);
+
+		std::vector<GLuint> counters(numCounters);
+		glGetPerfMonitorCountersAMD(group, nullptr, nullptr, numCounters, counters.data());
+
+		int picked = 0;
+
+		for (GLuint counter : counters)
+		{
+			if (picked >= maxActive)
+				break;
+
+			char counterName[256] = {};
+			glGetPerfMonitorCounterStringAMD(group, counter, sizeof(counterName), nullptr, counterName);
+
+			std::string name = std::string(groupName) + "/" + counterName;
+
+			if (!matchesPattern(name, patterns))
+				continue;
+
+			GLenum type = 0;
+			glGetPerfMonitorCounterInfoAMD(group, counter, GL_COUNTER_TYPE_AMD, &type);
+
+			amdColumns[{ group, counter }] = (int)counterNames.size();
+			amdCounters.push_back({ group, counter, type });
+			counterNames.push_back(name);
+			picked++;
+		}
+	}
+}
+
+// Pick the query that has the most counters that match, since only one query can be sampled at a time
+static void pickIntelCounters(const std::vector<std::string>& patterns)
+{
+	GLuint query = 0;
+	glGetFirstPerfQueryIdINTEL(&query);
+
+	int best = 0;
+
+	while (query != 0)
+	{
+		char queryName[256] = {};
+		GLuint dataSize = 0, numCounters = 0, numInstances = 0, caps = 0;
+		glGetPerfQueryInfoINTEL(query, sizeof(queryName), queryName, &dataSize, &numCounters, &numInstances, &caps);
+
+		std::vector<std::string> names;
+		std::vector<IntelCounter> counters;
+
+		// the counters of a query are numbered from 1
+		for (GLuint c = 1; c <= numCounters; c++)
+		{
+			char counterName[256] = {};
+			char description[1024] = {};
+			GLuint offset = 0, size = 0, type = 0, dataType = 0;
+			GLuint64 maxValue = 0;
+			glGetPerfCounterInfoINTEL(query, c, sizeof(counterName), counterName, sizeof(description), description,
+				&offset, &size, &type, &dataType, &maxValue);
+
+			if (matchesPattern(counterName, patterns))
+			{
+				names.push_back(counterName);
+				counters.push_back({ offset, dataType });
+			}
+		}
+
+		if ((int)counters.size() > best)
+		{
+			best = (int)counters.size();
+			intelQuery = query;
+			intelDataSize = dataSize;
+			counterNames = names;
+			intelCounters = counters;
+		}
+
+		GLuint next = 0;
+		glGetNextPerfQueryIdINTEL(query, &next);
+		query = next;
+	}
+}
+
+bool startGpuCounters(const std::string& patterns, int slots)
+{
+	std::vector<std::string> patternList;
+	std::stringstream split(lowerCase(patterns));
+	std::string pattern;
+
+	while (std::getline(split, pattern, ','))
+		patternList.push_back(pattern);
+
+	if (GLEW_AMD_performance_monitor)
+	{
+		backend = COUNTERS_AMD;
+		pickAmdCounters(patternList);
+	}
+	else if (GLEW_INTEL_performance_query)
+	{
+		backend = COUNTERS_INTEL;
+		pickIntelCounters(patternList);
+	}
+	else
+	{
+		std::cout << "--gpu-counters needs GL_AMD_performance_monitor or GL_INTEL_performance_query, which this driver does not have" << std::endl;
+		return false;
+	}
+
+	if (counterNames.empty())
+	{
+		std::cout << "no counter of this GPU has " << patterns << " in its name" << std::endl;
+		backend = COUNTERS_NONE;
+		return false;
+	}
+
+	samples.assign((size_t)slots * GPU_COUNTER_PASSES, CounterSample());
+
+	for (CounterSample& sample : samples)
+	{
+		if (backend == COUNTERS_AMD)
+		{
+			glGenPerfMonitorsAMD(1, &sample.handle);
+
+			for (AmdCounter& counter : amdCounters)
+				glSelectPerfMonitorCountersAMD(sample.handle, GL_TRUE, counter.group, 1, &counter.counter);
+		}
+		else
+		{
+			glCreatePerfQueryINTEL(intelQuery, &sample.handle);
+		}
+	}
+
+	std::cout << "sampling " << counterNames.size() << " GPU counters:";
+	for (const std::string& name : counterNames)
+		std::cout << " " << name;
+	std::cout << std::endl;
+
+	return true;
+}
+
+const std::vector<std::string>& gpuCounterNames()
+{
+	return counterNames;
+}
+
+void beginGpuCounters(int slot, int pass)
+{
+	if (backend == COUNTERS_NONE)
+		return;
+
+	endGpuCounters();
+
+	activeSample = &samples[(size_t)slot * GPU_COUNTER_PASSES + pass];
+
+	if (backend == COUNTERS_AMD)
+		glBeginPerfMonitorAMD(activeSample->handle);
+	else
+		glBeginPerfQueryINTEL(activeSample->handle);
+}
+
+void endGpuCounters()
+{
+	if (activeSample == nullptr)
+		return;
+
+	if (backend == COUNTERS_AMD)
+		glEndPerfMonitorAMD(activeSample->handle);
+	else
+		glEndPerfQueryINTEL(activeSample->handle);
+
+	activeSample->sampled = true;
+	activeSample = nullptr;
+}
+
+// The values of an AMD monitor are (group, counter, value) tuples, and the value is as long as its type
+static void readAmdSample(GLuint monitor, std::vector<double>& values)
+{
+	GLuint available = 0;
+
+	while (!available)
+		glGetPerfMonitorCounterDataAMD(monitor, GL_PERFMON_RESULT_AVAILABLE_AMD, sizeof(available), &available, nullptr);
+
+	GLuint size = 0;
+	glGetPerfMonitorCounterDataAMD(monitor, GL_PERFMON_RESULT_SIZE_AMD, sizeof(size), &size, nullptr);
+
+	std::vector<GLuint> data(size / sizeof(GLuint));
+	GLint written = 0;
+	glGetPerfMonitorCounterDataAMD(monitor, GL_PERFMON_RESULT_AMD, size, data.data(), &written);
+
+	size_t words = (size_t)written / sizeof(GLuint);
+	size_t i = 0;
+
+	while (i + 2 < words)
+	{
+		auto column = amdColumns.find({ data[i], data[i + 1] });
+		GLenum type = column != amdColumns.end() ? amdCounters[column->second].type : GL_UNSIGNED_INT;
+		double value;
+
+		if (type == GL_UNSIGNED_INT64_AMD)
+		{
+			uint64_t wide;
+			memcpy(&wide, &data[i + 2], sizeof(wide));
+			value = (double)wide;
+			i += 4;
+		}
+		else if (type == GL_FLOAT || type == GL_PERCENTAGE_AMD)
+		{
+			float narrow;
+			memcpy(&narrow, &data[i + 2], sizeof(narrow));
+			value = narrow;
+			i += 3;
+		}
+		else
+		{
+			value = data[i + 2];
+			i += 3;
+		}
+
+		if (column != amdColumns.end())
+			values[column->second] = value;
+	}
+}
+
+// The values of an Intel query are at the offsets of its counters, in the type of each
+static void readIntelSample(GLuint handle, std::vector<double>& values)
+{
+	std::vector<unsigned char> data(intelDataSize);
+	GLuint written = 0;
+	glGetPerfQueryDataINTEL(handle, GL_PERFQUERY_WAIT_INTEL, intelDataSize, data.data(), &written);
+
+	for (size_t c = 0; c < intelCounters.size(); c++)
+	{
+		const unsigned char* value = data.data() + intelCounters[c].offset;
+
+		switch (intelCounters[c].dataType)
+		{
+		case GL_PERFQUERY_COUNTER_DATA_UINT32_INTEL: { uint32_t v; memcpy(&v, value, sizeof(v)); values[c] = v; break; }
+		case GL_PERFQUERY_COUNTER_DATA_UINT64_INTEL: { uint64_t v; memcpy(&v, value, sizeof(v)); values[c] = (double)v; break; }
+		case GL_PERFQUERY_COUNTER_DATA_FLOAT_INTEL: { float v; memcpy(&v, value, sizeof(v)); values[c] = v; break; }
+		case GL_PERFQUERY_COUNTER_DATA_DOUBLE_INTEL: { double v; memcpy(&v, value, sizeof(v)); values[c] = v; break; }
+		case GL_PERFQUERY_COUNTER_DATA_BOOL32_INTEL: { uint32_t v; memcpy(&v, value, sizeof(v)); values[c] = v != 0; break; }
+		}
+	}
+}
+
+bool readGpuCounters(int slot, int pass, std::vector<double>& values)
+{
+	if (backend == COUNTERS_NONE)
+		return false;
+
+	CounterSample& sample = samples[(size_t)slot * GPU_COUNTER_PASSES + pass];
+
+	if (!sample.sampled || &sample == activeSample)
+		return false;
+
+	values.assign(counterNames.size(), 0.0);
+
+	if (backend == COUNTERS_AMD)
+		readAmdSample(sample.handle, values);
+	else
+		readIntelSample(sample.handle, values);
+
+	sample.sampled = false;
+	return true;
+}
+
+void stopGpuCounters()
+{
+	endGpuCounters();
+
+	for (CounterSample& sample : samples)
+	{
+		if (backend == COUNTERS_AMD)
+			glDeletePerfMonitorsAMD(1, &sample.handle);
+		else if (backend == COUNTERS_INTEL)
+			glDeletePerfQueryINTEL(sample.handle);
+	}
+
+	samples.clear();
+	counterNames.clear();
+	amdCounters.clear();
+	amdColumns.clear();
+	intelCounters.clear();
+	backend = COUNTERS_NONE;
+}
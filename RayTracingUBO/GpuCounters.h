@@ -0,0 +1,77 @@
+/*
+Title: Basic Ray Tracer
+File Name: GpuCounters.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The hardware counters of --gpu-counters. The frame timers say how long
+the transform and the draw took, and these say why: how full the shader
+cores were, how often the caches hit, and how many bytes went to memory.
+There is no standard way to read them in OpenGL, so this uses what the
+driver has: GL_AMD_performance_monitor, with counters in groups that
+every one can be picked from, or GL_INTEL_performance_query, with
+queries that each have a fixed set of counters, of which the one with
+the most counters that were asked for is used. NVIDIA has neither (its
+counters are only in Nsight Perf SDK), and then there are no counters.
+
+The counters are picked by their names: a counter is read if its name
+has one of the patterns in it (without case), like "occupancy", "hit",
+"bandwidth", or "busy", which are the kinds of counters that every
+vendor has, under different names. The names that were picked are
+printed, so the patterns can be made better for a GPU.
+
+The passes are sampled into a ring of slots, the same ring as the frame
+timers in main.cpp, so a sample is only read back when the slot is used
+again, a few frames later, when the GPU is long done with it. Only one
+pass can be sampled at a time, which is why the transform and the draw
+are one after another.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// The passes that are sampled
+#define GPU_COUNTER_TRANSFORM 0
+#define GPU_COUNTER_DRAW 1
+#define GPU_COUNTER_PASSES 2
+
+extern const char* gpuCounterPassNames[GPU_COUNTER_PASSES];
+
+// Pick the counters whose names have one of the patterns (split by commas) in them, and make the samples
+// of slots slots. Returns false, and says why, if the driver has no counters, or none that match
+bool startGpuCounters(const std::string& patterns, int slots);
+
+// The names of the counters that were picked, in the order of the values of readGpuCounters
+const std::vector<std::string>& gpuCounterNames();
+
+// Start sampling a pass into a slot. A pass that is still being sampled is ended first
+void beginGpuCounters(int slot, int pass);
+
+// End the pass that is being sampled, if there is one
+void endGpuCounters();
+
+// Read the counters of a pass of a slot, waiting for the GPU if it has not written them yet.
+// Returns false if the pass was not sampled since it was read last
+bool readGpuCounters(int slot, int pass, std::vector<double>& values);
+
+// Delete the samples
+void stopGpuCounters();
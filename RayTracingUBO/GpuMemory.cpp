@@ -0,0 +1,314 @@
+/*
+Title: Advanced Ray Tracer
+File Name: GpuMemory.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+// How big one buffer or image is, and what it is for
+struct GpuAllocation
+{
+	size_t bytes;
+	int category;
+};
+
+static const char* gpuMemoryCategoryNames[GPU_MEMORY_CATEGORIES] =
+{
+	"scene", "acceleration", "uploads", "renderer", "images", "readback", "benchmarks"
+};
+
+// Every allocation that is alive, by its kind (GL_BUFFER, GL_TEXTURE, or GL_RENDERBUFFER)
+// and its name, because a buffer and a texture can have the same number
+static std::map<std::pair<GLenum, GLuint>, GpuAllocation> allocations;
+
+static size_t categoryBytes[GPU_MEMORY_CATEGORIES] = {};
+static size_t categoryPeak[GPU_MEMORY_CATEGORIES] = {};
+static size_t totalBytes = 0;
+static size_t totalPeak = 0;
+
+// Forget the old size of this name, if it had one
+static void forget(GLenum kind, GLuint name)
+{
+	auto found = allocations.find(std::make_pair(kind, name));
+
+	if (found == allocations.end())
+		return;
+
+	categoryBytes[found->second.category] -= found->second.bytes;
+	totalBytes -= found->second.bytes;
+	allocations.erase(found);
+}
+
+static void track(GLenum kind, GLuint name, size_t bytes, int category)
+{
+	forget(kind, name);
+
+	GpuAllocation allocation = { bytes, category };
+	allocations[std::make_pair(kind, name)] = allocation;
+
+	categoryBytes[category] += bytes;
+	totalBytes += bytes;
+
+	if (categoryBytes[category] > categoryPeak[category])
+		categoryPeak[category] = categoryBytes[category];
+
+	if (totalBytes > totalPeak)
+		totalPeak = totalBytes;
+}
+
+void gpuBufferData(GLenum target, GLuint buffer, GLsizeiptr size, const void* data, GLenum usage, int category)
+{
+	glBufferData(target, size, data, usage);
+	track(GL_BUFFER, buffer, (size_t)size, category);
+}
+
+void gpuBufferStorage(GLenum target, GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags, int category)
+{
+	glBufferStorage(target, size, data, flags);
+	track(GL_BUFFER, buffer, (size_t)size, category);
+}
+
+void gpuSparseBufferStorage(GLenum target, GLuint buffer, GLsizeiptr size, GLbitfield flags, int category)
+{
+	glBufferStorage(target, size, nullptr, flags | GL_SPARSE_STORAGE_BIT_ARB);
+	track(GL_BUFFER, buffer, 0, category);
+}
+
+void gpuBufferCommit(GLenum target, GLuint buffer, GLintptr offset, GLsizeiptr size, bool commit)
+{
+	glBufferPageCommitmentARB(target, offset, size, commit ? GL_TRUE : GL_FALSE);
+
+	auto found = allocations.find(std::make_pair((GLenum)GL_BUFFER, buffer));
+
+	if (found == allocations.end())
+		return;
+
+	size_t bytes = found->second.bytes;
+	bytes = commit ? bytes + (size_t)size : bytes - std::min(bytes, (size_t)size);
+	track(GL_BUFFER, buffer, bytes, found->second.category);
+}
+
+void gpuDeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	for (int i = 0; i < count; i++)
+		forget(GL_BUFFER, buffers[i]);
+
+	glDeleteBuffers(count, buffers);
+}
+
+void trackGpuImage(GLenum kind, GLuint image, size_t bytes, int category)
+{
+	track(kind, image, bytes, category);
+}
+
+void forgetGpuImage(GLenum kind, GLuint image)
+{
+	forget(kind, image);
+}
+
+size_t gpuMemoryBytes(int category)
+{
+	return categoryBytes[category];
+}
+
+size_t gpuMemoryPeak(int category)
+{
+	return categoryPeak[category];
+}
+
+size_t gpuMemoryTotalPeak()
+{
+	return totalPeak;
+}
+
+const char* gpuMemoryCategoryName(int category)
+{
+	return gpuMemoryCategoryNames[category];
+}
+
+// Put a range back into the free ranges of the arena, joined with the free ranges right before and after it
+static void addFreeRange(GpuArena& arena, GpuRange range)
+{
+	auto next = std::lower_bound(arena.freeRanges.begin(), arena.freeRanges.end(), range,
+		[](const GpuRange& a, const GpuRange& b) { return a.offset < b.offset; });
+
+	if (next != arena.freeRanges.end() && range.offset + range.size == next->offset)
+	{
+		range.size += next->size;
+		next = arena.freeRanges.erase(next);
+	}
+
+	if (next != arena.freeRanges.begin())
+	{
+		auto before = next - 1;
+
+		if (before->offset + before->size == range.offset)
+		{
+			before->size += range.size;
+			return;
+		}
+	}
+
+	arena.freeRanges.insert(next, range);
+}
+
+// Move the arena into a buffer of capacity bytes, with what it had at the start
+static void growArena(GpuArena& arena, GLsizeiptr capacity)
+{
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	gpuBufferData(GL_COPY_WRITE_BUFFER, grown, capacity, nullptr, GL_DYNAMIC_DRAW, arena.category);
+
+	if (arena.buffer)
+	{
+		// the shaders may have written the ranges
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, arena.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, arena.capacity);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		gpuDeleteBuffers(1, &arena.buffer);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	GpuRange added;
+	added.offset = arena.capacity;
+	added.size = capacity - arena.capacity;
+
+	arena.buffer = grown;
+	arena.capacity = capacity;
+	addFreeRange(arena, added);
+
+	for (auto& binding : arena.bindings)
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding.first, arena.buffer, binding.second.offset, binding.second.size);
+}
+
+GpuRange gpuArenaAlloc(GpuArena& arena, GLsizeiptr size)
+{
+	if (arena.alignment == 0)
+	{
+		GLint alignment = 0;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		arena.alignment = std::max(alignment, 4);
+	}
+
+	// every size is a multiple of the alignment, so every free range starts at one
+	size = std::max((size + arena.alignment - 1) / arena.alignment * arena.alignment, arena.alignment);
+
+	auto fits = [&]() {
+		return std::find_if(arena.freeRanges.begin(), arena.freeRanges.end(), [&](const GpuRange& r) { return r.size >= size; });
+	};
+
+	auto found = fits();
+
+	if (found == arena.freeRanges.end())
+	{
+		// a megabyte at the start, so the first few ranges do not grow it every time
+		growArena(arena, std::max(std::max(arena.capacity * 2, arena.capacity + size), (GLsizeiptr)1 << 20));
+		found = fits();
+	}
+
+	GpuRange range;
+	range.offset = found->offset;
+	range.size = size;
+
+	found->offset += size;
+	found->size -= size;
+
+	if (found->size == 0)
+		arena.freeRanges.erase(found);
+
+	return range;
+}
+
+void gpuArenaFree(GpuArena& arena, GpuRange& range)
+{
+	if (range.size == 0)
+		return;
+
+	for (auto binding = arena.bindings.begin(); binding != arena.bindings.end();)
+	{
+		if (binding->second.offset == range.offset)
+			binding = arena.bindings.erase(binding);
+		else
+			++binding;
+	}
+
+	addFreeRange(arena, range);
+	range = GpuRange();
+}
+
+void gpuArenaBind(GpuArena& arena, GLuint binding, const GpuRange& range)
+{
+	arena.bindings[binding] = range;
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, arena.buffer, range.offset, range.size);
+}
+
+static double megabytes(size_t bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+void printGpuMemoryReport()
+{
+	printf("GPU memory on %s\n", (const char*)glGetString(GL_RENDERER));
+	printf("%-14s %10s %10s\n", "", "now MB", "peak MB");
+
+	for (int c = 0; c < GPU_MEMORY_CATEGORIES; c++)
+		printf("%-14s %10.2f %10.2f\n", gpuMemoryCategoryNames[c], megabytes(categoryBytes[c]), megabytes(categoryPeak[c]));
+
+	printf("%-14s %10.2f %10.2f\n", "total", megabytes(totalBytes), megabytes(totalPeak));
+
+	// The driver counts in kilobytes
+	if (GLEW_NVX_gpu_memory_info)
+	{
+		GLint dedicated = 0;
+		GLint available = 0;
+		GLint freeMemory = 0;
+		glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicated);
+		glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &available);
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &freeMemory);
+
+		printf("the driver has %.0f MB of video memory, %.0f MB can be used, and %.0f MB is free\n",
+			dedicated / 1024.0, available / 1024.0, freeMemory / 1024.0);
+	}
+	else if (GLEW_ATI_meminfo)
+	{
+		// the total that is free, the biggest free block, and the same for memory outside of the GPU
+		GLint buffers[4] = {};
+		GLint textures[4] = {};
+		glGetIntegerv(GL_VBO_FREE_MEMORY_ATI, buffers);
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, textures);
+
+		printf("the driver has %.0f MB free for buffers (the biggest block is %.0f MB), and %.0f MB for textures\n",
+			buffers[0] / 1024.0, buffers[1] / 1024.0, textures[0] / 1024.0);
+	}
+	else
+	{
+		printf("the driver does not say how much memory is free (no GL_NVX_gpu_memory_info or GL_ATI_meminfo)\n");
+	}
+}
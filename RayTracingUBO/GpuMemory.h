@@ -0,0 +1,130 @@
+/*
+Title: Advanced Ray Tracer
+File Name: GpuMemory.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Keeps count of the GPU memory that main.cpp allocates, for --memory-report.
+Every buffer is made with gpuBufferData or gpuBufferStorage instead of
+glBufferData or glBufferStorage, which do the same thing and also remember
+how big the buffer is, and which category it is in. Making a buffer again
+(like glBufferData does on a buffer that already has storage) replaces its
+old size, and gpuDeleteBuffers forgets it. Textures and renderbuffers are
+not made by one call, so they are counted with trackGpuImage after they are made.
+A sparse buffer (GL_ARB_sparse_buffer) is only addresses until its pages are
+committed, so it is counted as the pages that gpuBufferCommit committed.
+
+Small buffers that come and go with the window or the scene do not need a
+buffer each: a GpuArena is one buffer that gpuArenaAlloc hands out aligned
+ranges of, and gpuArenaFree gives back. A range is bound to its binding once,
+with gpuArenaBind, and the arena binds it again itself if it has to grow.
+
+The counts are only what this program asked for. The driver may round
+every allocation up, and keeps memory of its own, so printGpuMemoryReport also asks
+the driver how much memory is free, with GL_NVX_gpu_memory_info (NVIDIA)
+or GL_ATI_meminfo (AMD), if the driver has one of them.
+*/
+
+#pragma once
+
+#include "GL/glew.h"
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// What the memory is used for. These must match gpuMemoryCategoryNames in GpuMemory.cpp
+#define GPU_MEMORY_SCENE 0		// the triangles, vertices, meshes, instances, lights, and matrices
+#define GPU_MEMORY_ACCEL 1		// the acceleration structures, and what their builds need
+#define GPU_MEMORY_UPLOAD 2		// the upload rings, and the lists of moved meshes
+#define GPU_MEMORY_RENDER 3		// the queues of the wavefront renderer, the light tiles, and the ray counters
+#define GPU_MEMORY_IMAGES 4		// the textures and framebuffers
+#define GPU_MEMORY_READBACK 5	// the pixel buffers that the frames are read back into
+#define GPU_MEMORY_BENCH 6		// the buffers that only a benchmark uses
+#define GPU_MEMORY_CATEGORIES 7
+
+// glBufferData, and remember that the buffer is size bytes now
+void gpuBufferData(GLenum target, GLuint buffer, GLsizeiptr size, const void* data, GLenum usage, int category);
+
+// glBufferStorage, and remember that the buffer is size bytes
+void gpuBufferStorage(GLenum target, GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags, int category);
+
+// glBufferStorage of size bytes of addresses with GL_SPARSE_STORAGE_BIT_ARB, which have no memory until
+// gpuBufferCommit commits their pages. The buffer counts as 0 bytes until then
+void gpuSparseBufferStorage(GLenum target, GLuint buffer, GLsizeiptr size, GLbitfield flags, int category);
+
+// glBufferPageCommitmentARB of the sparse buffer bound to target: commit the pages from offset to offset + size
+// (multiples of GL_SPARSE_BUFFER_PAGE_SIZE_ARB, or up to the end of the buffer), or give their memory back.
+// A page must not be committed twice, or given back when it is not committed, or it is counted wrong
+void gpuBufferCommit(GLenum target, GLuint buffer, GLintptr offset, GLsizeiptr size, bool commit);
+
+// glDeleteBuffers, and forget the buffers
+void gpuDeleteBuffers(GLsizei count, const GLuint* buffers);
+
+// Remember a texture or a renderbuffer (kind is GL_TEXTURE or GL_RENDERBUFFER) after it is made,
+// and forget it with forgetGpuImage before it is deleted
+void trackGpuImage(GLenum kind, GLuint image, size_t bytes, int category);
+void forgetGpuImage(GLenum kind, GLuint image);
+
+// The bytes that a category has now, and the most that it ever had
+size_t gpuMemoryBytes(int category);
+size_t gpuMemoryPeak(int category);
+
+// The most that every category together ever had, which is not the sum of the peaks
+size_t gpuMemoryTotalPeak();
+
+// The name of a category, the way the report prints it
+const char* gpuMemoryCategoryName(int category);
+
+// Print the bytes of every category, the peaks, and what the driver says is free
+void printGpuMemoryReport();
+
+// Some bytes of a GpuArena. A size of 0 is no range
+struct GpuRange
+{
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+};
+
+// One shader storage buffer that the ranges are parts of. freeRanges are the parts that nobody has,
+// in the order of their offsets, and bindings are the ranges that gpuArenaBind bound, by their binding.
+// The arena is counted in category, like a buffer of its own
+struct GpuArena
+{
+	GLuint buffer = 0;
+	GLsizeiptr capacity = 0;
+	GLsizeiptr alignment = 0;
+	int category = GPU_MEMORY_RENDER;
+	std::vector<GpuRange> freeRanges;
+	std::map<GLuint, GpuRange> bindings;
+};
+
+// Give out size bytes of the arena, at a multiple of GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT.
+// The buffer is made the first time. When no free range is big enough, the arena grows into a new buffer
+// twice as big (or big enough), what it had is copied over, so every range keeps its offset, and every
+// binding of gpuArenaBind is bound again. arena.buffer is a new name after that, so do not keep it
+GpuRange gpuArenaAlloc(GpuArena& arena, GLsizeiptr size);
+
+// Give the range back to the arena, and make it no range
+void gpuArenaFree(GpuArena& arena, GpuRange& range);
+
+// glBindBufferRange of a range to a shader storage binding, which stays bound when the arena grows.
+// Nothing else should be bound to that binding
+void gpuArenaBind(GpuArena& arena, GLuint binding, const GpuRange& range);
@@ -0,0 +1,368 @@
+/*
+Title: Basic Ray Tracer
+File Name: JobSystem.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+
+#include "JobSystem.h"
+#include "Platform.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct Job
+{
+	const char* name;
+	std::function<void()> work;
+
+	// the jobs it waits for that are not done yet, plus one while addJob is still adding it
+	std::atomic<int> waitingFor;
+	std::atomic<bool> done;
+
+	// the jobs that wait for this one, which it lets go when it is done
+	std::mutex lock;
+	std::vector<JobHandle> next;
+};
+
+// The jobs that are ready to run, of one thread. Its owner takes them from the back, the others from the front.
+// node is the NUMA node of the thread
+struct JobQueue
+{
+	std::mutex lock;
+	std::deque<JobHandle> jobs;
+	int node = 0;
+};
+
+// one queue for every thread in the pool, and the last one for every thread that is not
+static std::vector<std::unique_ptr<JobQueue>> queues;
+static std::vector<std::thread> workers;
+
+// the queue of this thread, -1 for the threads that are not in the pool, and its NUMA node
+static thread_local int ownQueue = -1;
+static thread_local int ownNode = 0;
+static int numaNodes = 1;
+
+// Jobs that are in a queue, and jobs that were added and have not run yet.
+// Threads with nothing to do sleep on wake, which is told about new jobs and done jobs
+static std::atomic<int> readyJobs(0);
+static std::atomic<int> unfinishedJobs(0);
+static std::mutex sleepLock;
+static std::condition_variable wake;
+static bool stopping = false;
+
+// Wake the sleeping threads. The lock makes sure that a thread that just saw nothing to do
+// is already waiting, so it cannot miss this
+static void wakeThreads()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+	}
+
+	wake.notify_all();
+}
+
+// Put a job whose jobs before it are all done into queue q, or the queue of this thread
+static void readyJob(const JobHandle& job, int q = -1)
+{
+	if (q < 0)
+		q = ownQueue >= 0 ? ownQueue : (int)queues.size() - 1;
+
+	{
+		std::lock_guard<std::mutex> lock(queues[q]->lock);
+		queues[q]->jobs.push_back(job);
+	}
+
+	readyJobs++;
+	wakeThreads();
+}
+
+// Take a job: the newest one of this thread's queue, or else the oldest one of another queue,
+// of the queues of the same NUMA node before the others
+static bool takeJob(JobHandle& job)
+{
+	int n = (int)queues.size();
+	int self = ownQueue >= 0 ? ownQueue : n - 1;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int k = 0; k < n; k++)
+		{
+			JobQueue& queue = *queues[(self + k) % n];
+
+			// the own queue is in the first pass, and then every queue of the own node, and then the rest
+			if ((queue.node == ownNode) != (pass == 0))
+				continue;
+
+			std::lock_guard<std::mutex> lock(queue.lock);
+
+			if (queue.jobs.empty())
+				continue;
+
+			if (k == 0 && ownQueue >= 0)
+			{
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			}
+			else
+			{
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+			}
+
+			readyJobs--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Run a job, and then let go of the jobs that were waiting for it
+static void runJob(const JobHandle& job)
+{
+	{
+		PROFILE_ZONE(job->name);
+		job->work();
+	}
+
+	// the function may hold on to big things (like the pixels of a frame), which are not needed anymore
+	job->work = nullptr;
+
+	std::vector<JobHandle> next;
+
+	{
+		std::lock_guard<std::mutex> lock(job->lock);
+		job->done = true;
+		next.swap(job->next);
+	}
+
+	for (const JobHandle& waiting : next)
+	{
+		if (--waiting->waitingFor == 0)
+			readyJob(waiting);
+	}
+
+	unfinishedJobs--;
+
+	// someone may be waiting for this one
+	wakeThreads();
+}
+
+static void workerThread(int index)
+{
+	std::string name = "job " + std::to_string(index + 1);
+	nameProfileThread(name.c_str());
+
+	ownQueue = index;
+	ownNode = queues[index]->node;
+
+	if (numaNodes > 1)
+		pinThreadToNumaNode(ownNode);
+
+	while (true)
+	{
+		JobHandle job;
+
+		if (takeJob(job))
+		{
+			runJob(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [] { return readyJobs > 0 || stopping; });
+
+		if (stopping && readyJobs == 0)
+			return;
+	}
+}
+
+void startJobs(int threads, bool numa)
+{
+	if (threads < 0)
+		threads = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+
+	stopping = false;
+	queues.clear();
+
+	// every node needs a thread, and the calling thread is on node 0 with the first ones
+	numaNodes = numa ? std::max(1, std::min(numaNodeCount(), threads)) : 1;
+	ownNode = 0;
+
+	if (numaNodes > 1 && !pinThreadToNumaNode(0))
+		numaNodes = 1;
+
+	for (int i = 0; i <= threads; i++)
+	{
+		queues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+
+		// the last queue is for the threads that are not in the pool
+		if (i < threads)
+			queues.back()->node = i * numaNodes / threads;
+	}
+
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(workerThread, i));
+}
+
+void stopJobs()
+{
+	// every job that is left is run, by the pool and by this thread
+	while (unfinishedJobs > 0)
+	{
+		JobHandle job;
+
+		if (takeJob(job))
+		{
+			runJob(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [] { return unfinishedJobs == 0 || readyJobs > 0; });
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	workers.clear();
+	queues.clear();
+	numaNodes = 1;
+}
+
+int jobThreadCount()
+{
+	return (int)workers.size();
+}
+
+int jobNumaNodes()
+{
+	return numaNodes;
+}
+
+int jobNumaNode()
+{
+	return ownNode;
+}
+
+// addJob, into queue q when it is ready right away
+static JobHandle addJobTo(int q, const char* name, std::function<void()> work, const std::vector<JobHandle>& after)
+{
+	JobHandle job = std::make_shared<Job>();
+	job->name = name;
+	job->work = std::move(work);
+	job->waitingFor = 1;
+	job->done = false;
+
+	unfinishedJobs++;
+
+	for (const JobHandle& before : after)
+	{
+		if (!before)
+			continue;
+
+		std::lock_guard<std::mutex> lock(before->lock);
+
+		if (!before->done)
+		{
+			before->next.push_back(job);
+			job->waitingFor++;
+		}
+	}
+
+	// without startJobs, there is nowhere to put it, and nothing else is running, so it runs now
+	if (queues.empty())
+	{
+		runJob(job);
+		return job;
+	}
+
+	if (--job->waitingFor == 0)
+		readyJob(job, q);
+
+	return job;
+}
+
+JobHandle addJob(const char* name, std::function<void()> work, const std::vector<JobHandle>& after)
+{
+	return addJobTo(-1, name, std::move(work), after);
+}
+
+bool jobDone(const JobHandle& job)
+{
+	return !job || job->done;
+}
+
+void waitJob(const JobHandle& job)
+{
+	while (!jobDone(job))
+	{
+		JobHandle other;
+
+		if (takeJob(other))
+		{
+			runJob(other);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [&] { return job->done || readyJobs > 0; });
+	}
+}
+
+void parallelJobs(const char* name, int count, const std::function<void(int)>& work)
+{
+	std::vector<JobHandle> jobs;
+	int threads = (int)workers.size();
+
+	for (int i = 0; i < count; i++)
+	{
+		// In blocks, one for every node, and in turns over the threads of the node.
+		// Thread t is on node t * numaNodes / threads, so node k has threads first to last - 1
+		int q = -1;
+
+		if (numaNodes > 1)
+		{
+			int node = (int)((long long)i * numaNodes / count);
+			int first = (node * threads + numaNodes - 1) / numaNodes;
+			int last = ((node + 1) * threads + numaNodes - 1) / numaNodes;
+			q = first + i % std::max(last - first, 1);
+		}
+
+		jobs.push_back(addJobTo(q, name, [&work, i]() { work(i); }, std::vector<JobHandle>()));
+	}
+
+	for (const JobHandle& job : jobs)
+		waitJob(job);
+}
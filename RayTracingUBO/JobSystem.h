@@ -0,0 +1,86 @@
+/*
+Title: Basic Ray Tracer
+File Name: JobSystem.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+One pool of threads that does the work of the CPU for every part of the
+program: saving the frames, writing them to ffmpeg, building the BVHs,
+and the tiles and scenes of the CPU renderer. A job is a function, and
+the jobs it has to wait for. It is only run once all of those are done,
+so a frame can be written to ffmpeg after the frame before it was, and
+the scene of the next frame can be built while this one is traced.
+
+Every thread in the pool has its own queue. The jobs that a thread adds
+go into its own queue, and it takes the newest one first, which is the
+one whose data is most likely still in its cache. A thread that has
+nothing left steals the oldest job of another queue. Threads that are
+not in the pool (the render thread) add to a queue of their own. A thread
+that waits for a job runs other jobs until that one is done, instead of
+sleeping, so waiting inside of a job is fine, and with no threads in the
+pool, every job is run by whoever waits for it.
+
+On a server with more than one socket (startJobs with numa), the threads
+are split over the NUMA nodes in blocks, and every one is kept on the
+processors of its node. A thread that has nothing left steals from the
+threads of its own node first, and from the other nodes only when its
+node has nothing, so the data of a job stays in the memory and caches of
+one socket. parallelJobs hands out its jobs to the nodes in as many
+blocks, and the CPU renderer gives every node its own copy of the scene.
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct Job;
+
+// A job that was added. It stays valid after the job is done, and an empty handle is a job that is already done
+typedef std::shared_ptr<Job> JobHandle;
+
+// Start threads threads in the pool, -1 is one fewer than the CPU has cores, because the render thread helps too.
+// With numa, they are spread over the NUMA nodes, and the calling thread is kept on node 0
+void startJobs(int threads, bool numa = false);
+
+// Run every job that is left, and end the threads
+void stopJobs();
+
+// How many threads are in the pool (not counting the render thread)
+int jobThreadCount();
+
+// How many NUMA nodes the pool is on, 1 without numa, and the node of the calling thread
+int jobNumaNodes();
+int jobNumaNode();
+
+// Add a job that runs work once every job in after is done. The name is a zone of the profiler,
+// so it must be a string that lives forever, like a string literal
+JobHandle addJob(const char* name, std::function<void()> work, const std::vector<JobHandle>& after = std::vector<JobHandle>());
+
+// If the job has run
+bool jobDone(const JobHandle& job);
+
+// Wait until the job has run, running other jobs in the meantime
+void waitJob(const JobHandle& job);
+
+// Run work(0) to work(count - 1) as count jobs, and wait for all of them.
+// On more than one NUMA node, the first ones go to the threads of node 0, the next ones to node 1, and so on
+void parallelJobs(const char* name, int count, const std::function<void(int)>& work);
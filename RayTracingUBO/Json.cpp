@@ -0,0 +1,229 @@
+/*
+Title: Basic Ray Tracer
+File Name: Json.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Json.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+// A recursive descent parser of JSON. ok becomes false at the first thing that is not JSON
+struct JsonParser
+{
+	const char* p;
+	const char* end;
+	bool ok = true;
+
+	void skipSpace()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+			p++;
+	}
+
+	bool take(char c)
+	{
+		skipSpace();
+
+		if (p < end && *p == c)
+		{
+			p++;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool takeWord(const char* word)
+	{
+		size_t length = strlen(word);
+
+		if ((size_t)(end - p) < length || strncmp(p, word, length) != 0)
+			return false;
+
+		p += length;
+		return true;
+	}
+
+	void parseString(std::string& out)
+	{
+		if (!take('"'))
+		{
+			ok = false;
+			return;
+		}
+
+		while (p < end && *p != '"')
+		{
+			char c = *p++;
+
+			if (c != '\\')
+			{
+				out += c;
+				continue;
+			}
+
+			if (p >= end)
+				break;
+
+			c = *p++;
+
+			switch (c)
+			{
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				// only the basic plane, which is all that the names of a glTF file use, as UTF-8
+				if (end - p < 4)
+				{
+					ok = false;
+					return;
+				}
+
+				unsigned int code = (unsigned int)strtoul(std::string(p, 4).c_str(), nullptr, 16);
+				p += 4;
+
+				if (code < 0x80)
+					out += (char)code;
+				else if (code < 0x800)
+				{
+					out += (char)(0xC0 | (code >> 6));
+					out += (char)(0x80 | (code & 0x3F));
+				}
+				else
+				{
+					out += (char)(0xE0 | (code >> 12));
+					out += (char)(0x80 | ((code >> 6) & 0x3F));
+					out += (char)(0x80 | (code & 0x3F));
+				}
+				break;
+			}
+			default: out += c; break;
+			}
+		}
+
+		if (p >= end)
+			ok = false;
+		else
+			p++;
+	}
+
+	void parseValue(JsonValue& value, int depth)
+	{
+		skipSpace();
+
+		if (p >= end || depth > 256)
+		{
+			ok = false;
+			return;
+		}
+
+		if (*p == '{')
+		{
+			p++;
+			value.type = JsonValue::OBJECT;
+
+			if (take('}'))
+				return;
+
+			do
+			{
+				value.keys.emplace_back();
+				parseString(value.keys.back());
+
+				if (!ok || !take(':'))
+				{
+					ok = false;
+					return;
+				}
+
+				value.items.emplace_back();
+				parseValue(value.items.back(), depth + 1);
+			} while (ok && take(','));
+
+			if (ok && !take('}'))
+				ok = false;
+		}
+		else if (*p == '[')
+		{
+			p++;
+			value.type = JsonValue::ARRAY;
+
+			if (take(']'))
+				return;
+
+			do
+			{
+				value.items.emplace_back();
+				parseValue(value.items.back(), depth + 1);
+			} while (ok && take(','));
+
+			if (ok && !take(']'))
+				ok = false;
+		}
+		else if (*p == '"')
+		{
+			value.type = JsonValue::STRING;
+			parseString(value.string);
+		}
+		else if (takeWord("true"))
+		{
+			value.type = JsonValue::BOOLEAN;
+			value.boolean = true;
+		}
+		else if (takeWord("false"))
+		{
+			value.type = JsonValue::BOOLEAN;
+		}
+		else if (takeWord("null"))
+		{
+			value.type = JsonValue::NUL;
+		}
+		else
+		{
+			// strtod needs the end of the number, which the buffer may not have right after it
+			const char* start = p;
+			while (p < end && (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+				p++;
+
+			if (p == start)
+			{
+				ok = false;
+				return;
+			}
+
+			value.type = JsonValue::NUMBER;
+			value.number = strtod(std::string(start, p).c_str(), nullptr);
+		}
+	}
+};
+
+bool parseJson(const char* text, size_t size, JsonValue& value)
+{
+	JsonParser parser = { text, text + size };
+	parser.parseValue(value, 0);
+	return parser.ok;
+}
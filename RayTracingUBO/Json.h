@@ -0,0 +1,79 @@
+/*
+Title: Basic Ray Tracer
+File Name: Json.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A small JSON parser, since the project has no JSON library. A file is
+parsed into a tree of values (JsonValue), which are looked up by key or
+index, and give a null value for anything that is not there, so a
+reader can ask for what it wants without checking every step. glTF
+files (GltfLoader.h) and scene files (SceneFile.h) are read with it.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A value of the JSON. An object keeps its keys in keys, and its values in items, in the same order
+struct JsonValue
+{
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Type type = NUL;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	std::vector<std::string> keys;
+	std::vector<JsonValue> items;
+
+	// The value of a key of an object, or a null value if there is none
+	const JsonValue& operator[](const char* key) const
+	{
+		static const JsonValue none;
+
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			if (keys[i] == key)
+				return items[i];
+		}
+
+		return none;
+	}
+
+	// Item i of an array, or a null value if there is none
+	const JsonValue& operator[](int i) const
+	{
+		static const JsonValue none;
+		return (type == ARRAY && i >= 0 && i < (int)items.size()) ? items[i] : none;
+	}
+
+	bool has(const char* key) const { return (*this)[key].type != NUL; }
+	int size() const { return (int)items.size(); }
+	double numberOr(double fallback) const { return type == NUMBER ? number : fallback; }
+	int intOr(int fallback) const { return type == NUMBER ? (int)number : fallback; }
+	bool boolOr(bool fallback) const { return type == BOOLEAN ? boolean : fallback; }
+};
+
+// Parse the JSON of text (size bytes, which do not need a 0 at the end) into value.
+// Returns false at the first thing that is not JSON
+bool parseJson(const char* text, size_t size, JsonValue& value);
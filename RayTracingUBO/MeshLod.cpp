@@ -0,0 +1,243 @@
+/*
+Title: Basic Ray Tracer
+File Name: MeshLod.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MeshLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+
+// The finest grid that is tried, in cells across the longest side of the mesh
+#define LOD_MAX_CELLS 1024
+
+// A grid over the box of a mesh, with cells on each side. A side with no size (like a flat mesh) has one cell
+struct LodGrid
+{
+	glm::vec3 min;
+	glm::vec3 cellSize;
+	glm::ivec3 cells;
+};
+
+// The corners of a cell, and the planes of the triangles around them: the sum of the squared
+// distances to the planes is x A x - 2 b x + c, which is smallest where A x = b (c does not matter)
+struct LodCluster
+{
+	glm::dmat3 A = glm::dmat3(0.0);
+	glm::dvec3 b = glm::dvec3(0.0);
+	glm::dvec3 cornerSum = glm::dvec3(0.0);
+	int corners = 0;
+	glm::ivec3 cell;
+};
+
+static LodGrid makeGrid(glm::vec3 boxMin, glm::vec3 boxMax, int across)
+{
+	glm::vec3 size = boxMax - boxMin;
+	float longest = std::max(size.x, std::max(size.y, size.z));
+
+	LodGrid grid;
+	grid.min = boxMin;
+
+	for (int k = 0; k < 3; k++)
+	{
+		grid.cells[k] = longest > 0.0f ? std::max(1, (int)std::ceil(size[k] / longest * across)) : 1;
+		grid.cellSize[k] = size[k] / grid.cells[k];
+	}
+
+	return grid;
+}
+
+static glm::ivec3 cellOf(const LodGrid& grid, glm::vec3 p)
+{
+	glm::ivec3 cell;
+
+	for (int k = 0; k < 3; k++)
+	{
+		int c = grid.cellSize[k] > 0.0f ? (int)std::floor((p[k] - grid.min[k]) / grid.cellSize[k]) : 0;
+		cell[k] = glm::clamp(c, 0, grid.cells[k] - 1);
+	}
+
+	return cell;
+}
+
+static long long cellKey(const LodGrid& grid, glm::ivec3 cell)
+{
+	return ((long long)cell.z * grid.cells.y + cell.y) * grid.cells.x + cell.x;
+}
+
+// Put every corner of the triangles in the cluster of its cell. corners[3 * i + j] is the cluster of corner j of triangle i.
+// Returns how many triangles have their corners in three different clusters, which are the ones that are kept
+static int clusterCorners(const triangle* triangles, int count, const LodGrid& grid, std::vector<LodCluster>* clusters, std::vector<int>& corners)
+{
+	std::unordered_map<long long, int> clusterOfCell;
+	corners.resize(3 * count);
+
+	int kept = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3* points[3] = { &triangles[i].a, &triangles[i].b, &triangles[i].c };
+
+		for (int j = 0; j < 3; j++)
+		{
+			glm::ivec3 cell = cellOf(grid, *points[j]);
+			auto found = clusterOfCell.emplace(cellKey(grid, cell), (int)clusterOfCell.size());
+			corners[3 * i + j] = found.first->second;
+
+			if (clusters && found.second)
+			{
+				clusters->emplace_back();
+				clusters->back().cell = cell;
+			}
+		}
+
+		int a = corners[3 * i], b = corners[3 * i + 1], c = corners[3 * i + 2];
+		if (a != b && b != c && a != c)
+			kept++;
+	}
+
+	return kept;
+}
+
+// The point of a cluster, where the squared distances to the planes around it are smallest. A little of the average
+// of its corners is mixed in, so a cluster on a flat part (where every point of the plane is as good) or along an edge
+// still has one point, near its corners. The point is kept inside its cell
+static glm::vec3 clusterPoint(const LodCluster& cluster, const LodGrid& grid)
+{
+	glm::dvec3 average = cluster.cornerSum / (double)cluster.corners;
+
+	double weight = 1e-3 * (cluster.A[0][0] + cluster.A[1][1] + cluster.A[2][2]) + 1e-12;
+	glm::dmat3 A = cluster.A + glm::dmat3(weight);
+	glm::dvec3 b = cluster.b + weight * average;
+
+	glm::dvec3 point = average;
+	if (std::abs(glm::determinant(A)) > 1e-30)
+		point = glm::inverse(A) * b;
+
+	glm::vec3 cellMin = grid.min + glm::vec3(cluster.cell) * grid.cellSize;
+	return glm::clamp(glm::vec3(point), cellMin, cellMin + grid.cellSize);
+}
+
+bool simplifyMesh(const triangle* triangles, int count, int target, std::vector<triangle>& out)
+{
+	out.clear();
+
+	if (count <= 0 || target <= 0 || target >= count)
+		return false;
+
+	glm::vec3 boxMin = triangles[0].a;
+	glm::vec3 boxMax = triangles[0].a;
+	for (int i = 0; i < count; i++)
+	{
+		boxMin = glm::min(boxMin, glm::min(triangles[i].a, glm::min(triangles[i].b, triangles[i].c)));
+		boxMax = glm::max(boxMax, glm::max(triangles[i].a, glm::max(triangles[i].b, triangles[i].c)));
+	}
+
+	// Finer grids keep more triangles, so look for the finest one that keeps at most target
+	std::vector<int> corners;
+	int low = 1;
+	int high = LOD_MAX_CELLS;
+	while (low < high)
+	{
+		int across = (low + high + 1) / 2;
+
+		if (clusterCorners(triangles, count, makeGrid(boxMin, boxMax, across), nullptr, corners) <= target)
+			low = across;
+		else
+			high = across - 1;
+	}
+
+	LodGrid grid = makeGrid(boxMin, boxMax, low);
+	std::vector<LodCluster> clusters;
+	if (clusterCorners(triangles, count, grid, &clusters, corners) == 0)
+		return false;
+
+	// Every triangle adds its plane to the clusters of its corners, by its area,
+	// so the big triangles decide where the points go more than the small ones
+	for (int i = 0; i < count; i++)
+	{
+		glm::dvec3 a = triangles[i].a, b = triangles[i].b, c = triangles[i].c;
+		glm::dvec3 cross = glm::cross(b - a, c - a);
+		double length = glm::length(cross);
+
+		glm::dvec3 n = length > 0.0 ? cross / length : glm::dvec3(0.0);
+		double d = -glm::dot(n, a);
+		double area = 0.5 * length;
+
+		const glm::dvec3 points[3] = { a, b, c };
+		for (int j = 0; j < 3; j++)
+		{
+			LodCluster& cluster = clusters[corners[3 * i + j]];
+			cluster.A += area * glm::outerProduct(n, n);
+			cluster.b -= area * d * n;
+			cluster.cornerSum += points[j];
+			cluster.corners++;
+		}
+	}
+
+	std::vector<glm::vec3> points(clusters.size());
+	for (size_t k = 0; k < clusters.size(); k++)
+		points[k] = clusterPoint(clusters[k], grid);
+
+	// Two triangles that end up on the same three clusters, in the same order, are the same triangle
+	std::set<std::tuple<int, int, int>> made;
+
+	for (int i = 0; i < count; i++)
+	{
+		int a = corners[3 * i], b = corners[3 * i + 1], c = corners[3 * i + 2];
+		if (a == b || b == c || a == c)
+			continue;
+
+		glm::vec3 normal = glm::cross(points[b] - points[a], points[c] - points[a]);
+		if (glm::length(normal) == 0.0f)
+			continue;
+
+		// the new triangle faces the way the old one did
+		if (glm::dot(normal, triangleNormal(triangles[i])) < 0.0f)
+		{
+			std::swap(b, c);
+			normal = -normal;
+		}
+
+		// the same triangle can start at any of its corners
+		int first = std::min(a, std::min(b, c));
+		std::tuple<int, int, int> key = (first == a) ? std::make_tuple(a, b, c) : (first == b) ? std::make_tuple(b, c, a) : std::make_tuple(c, a, b);
+		if (!made.insert(key).second)
+			continue;
+
+		triangle t = triangles[i];
+		t.a = points[a];
+		t.b = points[b];
+		t.c = points[c];
+		t.packedNormal = glm::packSnorm2x16(octEncode(glm::normalize(normal)));
+		out.push_back(t);
+	}
+
+	if (out.empty() || (int)out.size() >= count)
+	{
+		out.clear();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+Title: Basic Ray Tracer
+File Name: MeshLod.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Coarser copies of the meshes, for the reflections (--lod-geometry). A
+reflection of a mesh is small, blurred by the bounces before it, and
+dimmed by their reflectivity, so it does not need every triangle of the
+mesh. Each mesh gets MESH_LODS copies with about a half and a quarter of
+its triangles, and each copy gets a BLAS of its own, which the
+reflections from some bounce on walk instead of the one of the mesh (see
+rayLod in RayTracing.glsl).
+
+The copies are made by clustering the corners: the box of the mesh is
+cut into a grid of cells, every corner in a cell becomes one point, and
+the triangles with two corners in the same cell are gone. The point of a
+cell is the one closest to the planes of all of its triangles (the
+quadric error of Garland and Heckbert, put where it is smallest, like
+Lindstrom does), so the flat parts stay flat and the edges stay sharp,
+and it is kept inside its cell, so a copy never leaves the box of its
+mesh. The grid is made finer or coarser until the copy has about as many
+triangles as it should.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "../Assets/SceneStructs.h"
+
+// How many coarser copies every mesh has, after the mesh itself
+#define MESH_LODS 2
+
+// A mesh with fewer triangles than this is not made coarser, its copies are the mesh itself
+#define LOD_MIN_TRIANGLES 256
+
+// Make a copy of the count triangles with about target triangles (at most target), into out.
+// The triangles keep their colors and reflectivities, and get new normals that face the same
+// way as the ones they came from. Returns false, and leaves out empty, if no grid made the mesh smaller
+bool simplifyMesh(const triangle* triangles, int count, int target, std::vector<triangle>& out);
@@ -0,0 +1,85 @@
+/*
+Title: Basic Ray Tracer
+File Name: Metrics.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Metrics.h"
+
+#include <cstdio>
+
+// The bounds of the buckets, in milliseconds, from a quick pass to a frame that is stuck
+static const double metricBounds[METRIC_BUCKETS] = { 0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 5000 };
+
+void observeMetric(MetricHistogram& histogram, double ms)
+{
+	int bucket = 0;
+
+	while (bucket < METRIC_BUCKETS && ms > metricBounds[bucket])
+		bucket++;
+
+	histogram.counts[bucket]++;
+	histogram.count++;
+	histogram.sum += ms;
+}
+
+void writeMetricHeader(std::string& out, const char* name, const char* type, const char* help)
+{
+	out += std::string("# HELP ") + name + " " + help + "\n";
+	out += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+void writeMetric(std::string& out, const char* name, const std::string& labels, double value)
+{
+	// %.17g keeps every digit of a counter, and a whole number has no decimals
+	char text[64];
+	snprintf(text, sizeof(text), "%.17g", value);
+
+	out += name;
+
+	if (!labels.empty())
+		out += "{" + labels + "}";
+
+	out += std::string(" ") + text + "\n";
+}
+
+void writeMetricHistogram(std::string& out, const char* name, const std::string& labels, const MetricHistogram& histogram)
+{
+	std::string bucketName = std::string(name) + "_bucket";
+	std::string separator = labels.empty() ? "" : ",";
+	uint64_t upTo = 0;
+
+	// every bucket counts the ones before it too
+	for (int b = 0; b <= METRIC_BUCKETS; b++)
+	{
+		upTo += histogram.counts[b];
+
+		char bound[32];
+		if (b < METRIC_BUCKETS)
+			snprintf(bound, sizeof(bound), "%g", metricBounds[b]);
+		else
+			snprintf(bound, sizeof(bound), "+Inf");
+
+		writeMetric(out, bucketName.c_str(), labels + separator + "le=\"" + bound + "\"", (double)upTo);
+	}
+
+	writeMetric(out, (std::string(name) + "_sum").c_str(), labels, histogram.sum);
+	writeMetric(out, (std::string(name) + "_count").c_str(), labels, (double)histogram.count);
+}
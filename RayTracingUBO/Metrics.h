@@ -0,0 +1,64 @@
+/*
+Title: Basic Ray Tracer
+File Name: Metrics.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The numbers of --metrics-port, in the text format of Prometheus, which a
+Prometheus server (or anything else that reads that format) scrapes over
+HTTP from a render server of --serve (see startMetricsServer in
+RenderServer.h). A counter only goes up, a gauge is a number as it is
+now, and a histogram counts every time it was given into buckets, where
+a bucket counts the times up to its bound (le, "less or equal"), so the
+last one, +Inf, is all of them. Every series of a histogram also has the
+sum and the count, which give the average.
+
+Nothing here knows about the renderer: main.cpp keeps the histograms of
+its stages, and writes every number with these when it publishes them.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// The bounds of the buckets of a histogram, in milliseconds, and then +Inf
+#define METRIC_BUCKETS 12
+
+// The times that a stage took, counted into the buckets of METRIC_BUCKETS
+struct MetricHistogram
+{
+	uint64_t counts[METRIC_BUCKETS + 1] = {};
+	uint64_t count = 0;
+	double sum = 0.0;
+};
+
+// Count one time, in milliseconds
+void observeMetric(MetricHistogram& histogram, double ms);
+
+// The # HELP and # TYPE lines of a metric (type is "counter", "gauge", or "histogram"), once before all of its series
+void writeMetricHeader(std::string& out, const char* name, const char* type, const char* help);
+
+// One series of a counter or a gauge. labels is empty, or like stage="render"
+void writeMetric(std::string& out, const char* name, const std::string& labels, double value);
+
+// One series of a histogram: a line for every bucket, the sum, and the count
+void writeMetricHistogram(std::string& out, const char* name, const std::string& labels, const MetricHistogram& histogram);
@@ -0,0 +1,455 @@
+/*
+Title: Basic Ray Tracer
+File Name: Mezzanine.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Mezzanine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "Platform.h"
+
+// LZ4 finds matches with a table of where every 4 bytes were last seen, by a hash of them
+#define LZ4_HASH_BITS 12
+
+// a match is at least 4 bytes, and is up to 65535 bytes back
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+
+// The format wants the last 5 bytes to be literals, and no match to start in the last 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+
+static uint32_t read32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// A length of 15 or more in a token goes on in bytes of 255, and ends with a byte below that
+static unsigned char* writeLength(unsigned char* op, size_t length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+size_t lz4Bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t lz4Compress(const unsigned char* src, size_t size, unsigned char* dst)
+{
+	uint32_t table[1 << LZ4_HASH_BITS] = {};
+	unsigned char* op = dst;
+	size_t anchor = 0;
+	size_t ip = 0;
+
+	if (size > LZ4_MATCH_LIMIT)
+	{
+		size_t matchStartLimit = size - LZ4_MATCH_LIMIT;
+		size_t matchEndLimit = size - LZ4_LAST_LITERALS;
+
+		// after many misses in a row, the bytes are not alike, so more of them are skipped
+		unsigned misses = 0;
+
+		while (ip < matchStartLimit)
+		{
+			uint32_t sequence = read32(src + ip);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+
+			// the positions are kept one up, so that 0 is none
+			size_t candidate = table[hash];
+			table[hash] = (uint32_t)(ip + 1);
+
+			if (candidate == 0 || ip - (candidate - 1) > LZ4_MAX_OFFSET || read32(src + candidate - 1) != sequence)
+			{
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+
+			misses = 0;
+			size_t match = candidate - 1;
+			size_t length = LZ4_MIN_MATCH;
+
+			while (ip + length < matchEndLimit && src[match + length] == src[ip + length])
+				length++;
+
+			// the match can also start earlier, in the literals
+			while (ip > anchor && match > 0 && src[ip - 1] == src[match - 1])
+			{
+				ip--;
+				match--;
+				length++;
+			}
+
+			size_t literals = ip - anchor;
+			unsigned char* token = op++;
+			*token = (unsigned char)((literals < 15 ? literals : 15) << 4);
+
+			if (literals >= 15)
+				op = writeLength(op, literals - 15);
+
+			memcpy(op, src + anchor, literals);
+			op += literals;
+
+			size_t offset = ip - match;
+			*op++ = (unsigned char)offset;
+			*op++ = (unsigned char)(offset >> 8);
+
+			size_t extra = length - LZ4_MIN_MATCH;
+			*token |= (unsigned char)(extra < 15 ? extra : 15);
+
+			if (extra >= 15)
+				op = writeLength(op, extra - 15);
+
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	// the rest is one last run of literals, with no match after it
+	size_t literals = size - anchor;
+	*op++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+
+	if (literals >= 15)
+		op = writeLength(op, literals - 15);
+
+	memcpy(op, src + anchor, literals);
+	op += literals;
+
+	return op - dst;
+}
+
+bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t size)
+{
+	const unsigned char* ip = src;
+	const unsigned char* srcEnd = src + srcSize;
+	unsigned char* op = dst;
+	unsigned char* dstEnd = dst + size;
+
+	while (ip < srcEnd)
+	{
+		unsigned token = *ip++;
+		size_t literals = token >> 4;
+
+		if (literals == 15)
+		{
+			unsigned char more;
+
+			do
+			{
+				if (ip >= srcEnd)
+					return false;
+
+				more = *ip++;
+				literals += more;
+			} while (more == 255);
+		}
+
+		if (literals > (size_t)(srcEnd - ip) || literals > (size_t)(dstEnd - op))
+			return false;
+
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		// the last sequence has no match
+		if (ip == srcEnd)
+			break;
+
+		if (srcEnd - ip < 2)
+			return false;
+
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		size_t length = token & 15;
+
+		if (length == 15)
+		{
+			unsigned char more;
+
+			do
+			{
+				if (ip >= srcEnd)
+					return false;
+
+				more = *ip++;
+				length += more;
+			} while (more == 255);
+		}
+
+		length += LZ4_MIN_MATCH;
+
+		if (offset == 0 || offset > (size_t)(op - dst) || length > (size_t)(dstEnd - op))
+			return false;
+
+		const unsigned char* match = op - offset;
+
+		// A match can overlap the bytes that it makes, so it repeats the last offset bytes.
+		// A run of one byte (the 0 of the XOR) is the most common one
+		if (offset >= length)
+		{
+			memcpy(op, match, length);
+		}
+		else if (offset == 1)
+		{
+			memset(op, *match, length);
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+				op[i] = match[i];
+		}
+
+		op += length;
+	}
+
+	return op == dstEnd;
+}
+
+// dst ^= src, a word at a time
+static void xorBytes(unsigned char* dst, const unsigned char* src, size_t size)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t a, b;
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+
+	for (; i < size; i++)
+		dst[i] ^= src[i];
+}
+
+void encodeMezzanine(const unsigned char* pixels, const unsigned char* reference, int referenceFrame,
+	int width, int height, int frame, std::vector<unsigned char>& file)
+{
+	size_t rowBytes = (size_t)3 * width;
+	int blocks = (height + MEZZANINE_BLOCK_ROWS - 1) / MEZZANINE_BLOCK_ROWS;
+
+	MezzanineHeader header = { MEZZANINE_MAGIC, MEZZANINE_VERSION, width, height, frame,
+		reference ? referenceFrame : -1, MEZZANINE_BLOCK_ROWS, blocks };
+
+	// the header and the table of sizes, which is filled in as the blocks are made
+	size_t tableStart = sizeof(header);
+	file.resize(tableStart + sizeof(uint32_t) * blocks);
+	memcpy(file.data(), &header, sizeof(header));
+
+	std::vector<unsigned char> delta(rowBytes * MEZZANINE_BLOCK_ROWS);
+	std::vector<unsigned char> compressed(lz4Bound(delta.size()));
+
+	for (int b = 0; b < blocks; b++)
+	{
+		int rows = std::min(MEZZANINE_BLOCK_ROWS, height - b * MEZZANINE_BLOCK_ROWS);
+		size_t bytes = rowBytes * rows;
+		size_t start = rowBytes * b * MEZZANINE_BLOCK_ROWS;
+		const unsigned char* data = pixels + start;
+		uint32_t size = 0;
+
+		// a block that did not change is only its size of 0
+		if (reference && memcmp(data, reference + start, bytes) == 0)
+		{
+			memcpy(file.data() + tableStart + sizeof(uint32_t) * b, &size, sizeof(size));
+			continue;
+		}
+
+		if (reference)
+		{
+			memcpy(delta.data(), data, bytes);
+			xorBytes(delta.data(), reference + start, bytes);
+			data = delta.data();
+		}
+
+		size_t packed = lz4Compress(data, bytes, compressed.data());
+
+		if (packed < bytes)
+		{
+			file.insert(file.end(), compressed.data(), compressed.data() + packed);
+			size = (uint32_t)packed;
+		}
+		else
+		{
+			file.insert(file.end(), data, data + bytes);
+			size = (uint32_t)bytes | MEZZANINE_STORED;
+		}
+
+		memcpy(file.data() + tableStart + sizeof(uint32_t) * b, &size, sizeof(size));
+	}
+}
+
+bool readMezzanineHeader(const std::vector<unsigned char>& file, MezzanineHeader& header)
+{
+	if (file.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, file.data(), sizeof(header));
+
+	return header.magic == MEZZANINE_MAGIC && header.version == MEZZANINE_VERSION && header.width > 0 && header.height > 0 &&
+		header.blockRows > 0 && header.blocks == (header.height + header.blockRows - 1) / header.blockRows &&
+		file.size() >= sizeof(header) + sizeof(uint32_t) * header.blocks;
+}
+
+bool decodeMezzanine(const std::vector<unsigned char>& file, unsigned char* pixels)
+{
+	MezzanineHeader header;
+
+	if (!readMezzanineHeader(file, header))
+		return false;
+
+	size_t rowBytes = (size_t)3 * header.width;
+	bool keyframe = header.reference < 0;
+	const unsigned char* table = file.data() + sizeof(header);
+	size_t next = sizeof(header) + sizeof(uint32_t) * header.blocks;
+
+	std::vector<unsigned char> block(rowBytes * header.blockRows);
+
+	for (int b = 0; b < header.blocks; b++)
+	{
+		uint32_t size;
+		memcpy(&size, table + sizeof(uint32_t) * b, sizeof(size));
+
+		// the same as in the reference, which is already in pixels
+		if (size == 0)
+			continue;
+
+		int rows = std::min(header.blockRows, header.height - b * header.blockRows);
+		size_t bytes = rowBytes * rows;
+		unsigned char* out = pixels + rowBytes * b * header.blockRows;
+		size_t stored = size & ~MEZZANINE_STORED;
+
+		if (stored > file.size() - next)
+			return false;
+
+		const unsigned char* data = file.data() + next;
+		next += stored;
+
+		if (size & MEZZANINE_STORED)
+		{
+			if (stored != bytes)
+				return false;
+		}
+		else
+		{
+			if (!lz4Decompress(data, stored, keyframe ? out : block.data(), bytes))
+				return false;
+
+			if (keyframe)
+				continue;
+
+			data = block.data();
+		}
+
+		if (keyframe)
+			memcpy(out, data, bytes);
+		else
+			xorBytes(out, data, bytes);
+	}
+
+	return true;
+}
+
+static bool loadMezzanineFile(const std::string& fileName, std::vector<unsigned char>& file)
+{
+	std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+
+	if (!in)
+		return false;
+
+	file.resize((size_t)in.tellg());
+	in.seekg(0);
+	return (bool)in.read((char*)file.data(), file.size());
+}
+
+bool readMezzanineFrame(MezzanineReader& reader, int frame)
+{
+	if (frame == reader.frame)
+		return true;
+
+	double start = platformTime();
+
+	// the files from this frame back to a keyframe, or to the frame that the reader has already
+	std::vector<std::vector<unsigned char>> chain;
+	int next = frame;
+
+	while (true)
+	{
+		chain.emplace_back();
+		MezzanineHeader header;
+
+		if (!loadMezzanineFile(reader.folder + "/" + std::to_string(next) + ".mzf", chain.back()) ||
+			!readMezzanineHeader(chain.back(), header))
+			return false;
+
+		if (header.reference < 0 || header.reference == reader.frame)
+			break;
+
+		// the reference is always a frame before, so a broken file can't make this go around forever
+		if (header.reference >= next)
+			return false;
+
+		next = header.reference;
+	}
+
+	// the oldest first, each one into the pixels of the one before
+	for (auto file = chain.rbegin(); file != chain.rend(); file++)
+	{
+		MezzanineHeader header;
+		readMezzanineHeader(*file, header);
+
+		if (header.reference < 0)
+		{
+			reader.width = header.width;
+			reader.height = header.height;
+			reader.pixels.resize((size_t)3 * header.width * header.height);
+		}
+		else if (header.width != reader.width || header.height != reader.height)
+		{
+			return false;
+		}
+
+		if (!decodeMezzanine(*file, reader.pixels.data()))
+		{
+			reader.frame = -1;
+			return false;
+		}
+
+		reader.decoded++;
+	}
+
+	reader.frame = frame;
+	reader.seconds += platformTime() - start;
+	return true;
+}
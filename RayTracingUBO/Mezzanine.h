@@ -0,0 +1,117 @@
+/*
+Title: Basic Ray Tracer
+File Name: Mezzanine.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The frames of --frame-format mzf, a lossless format for masters that are
+encoded again later, which is much faster to write and read than PNG, and
+much smaller than the raw frames. Most of a frame of the animation is the
+same as the frame before (the floor, the sky, and every mesh that did not
+move), so only every n-th frame (--mezzanine-keyframes) is stored whole
+(a keyframe), and the others are stored as the XOR of their pixels with the
+pixels of the frame before. The XOR is 0 wherever the two frames are the
+same, and runs of 0 are what compression is best at.
+
+The frame is cut into blocks of MEZZANINE_BLOCK_ROWS rows. A block that is
+the same as in the frame before is only a size of 0 in the table, and the
+others are compressed with LZ4 (the block format, which is simple enough
+to be written here, since the build has no compression library besides
+the zlib inside FreeImage, which is what makes PNG slow). LZ4 finds the
+runs of 0 and the repeated pixels, and is about as fast as a copy to
+decode. A block that LZ4 can't make smaller is stored as it is.
+
+The file is a MezzanineHeader, the table of the sizes of the blocks, and
+the blocks. The pixels are BGR, with the bottom row first, like the raw
+frames. A frame that is not a keyframe names the frame that it is the XOR
+with, which is usually the one before, so the jobs that encode the frames
+can still run at the same time: every job has the pixels of its frame and
+of the one before. To decode a frame, the frames back to the keyframe are
+decoded first. MezzanineReader keeps the last frame it decoded, so reading
+the frames in order (which feeding ffmpeg does) decodes every file once.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define MEZZANINE_MAGIC 0x31465A4D
+#define MEZZANINE_VERSION 1
+
+// the rows of a block, so a frame of 1080 rows has 68 blocks
+#define MEZZANINE_BLOCK_ROWS 16
+
+// the bit of the size of a block that is stored without compression
+#define MEZZANINE_STORED 0x80000000u
+
+// The start of a file. reference is the frame that the blocks are the XOR with, or -1 for a keyframe
+struct MezzanineHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t frame;
+	int32_t reference;
+	int32_t blockRows;
+	int32_t blocks;
+};
+
+// The frames of a folder, as frame <n> is the file <folder>/<n>.mzf, and the last frame that was decoded
+struct MezzanineReader
+{
+	std::string folder;
+	std::vector<unsigned char> pixels;
+	int frame = -1;
+	int width = 0;
+	int height = 0;
+
+	// how many files were decoded, and how long it took, to compare with the other formats
+	int decoded = 0;
+	double seconds = 0.0;
+};
+
+// Compress size bytes of src in the LZ4 block format into dst, which must have room for lz4Bound(size) bytes.
+// Returns the size of the compressed bytes
+size_t lz4Compress(const unsigned char* src, size_t size, unsigned char* dst);
+
+// The most bytes that lz4Compress can make of size bytes
+size_t lz4Bound(size_t size);
+
+// Decompress an LZ4 block into exactly size bytes of dst. False if the block is broken, or is not size bytes
+bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t size);
+
+// Encode frame of width x height BGR pixels into file. With reference, which has the pixels of frame referenceFrame,
+// the blocks are the XOR with those, and without it, it is a keyframe
+void encodeMezzanine(const unsigned char* pixels, const unsigned char* reference, int referenceFrame,
+	int width, int height, int frame, std::vector<unsigned char>& file);
+
+// The header of a file, if it is one
+bool readMezzanineHeader(const std::vector<unsigned char>& file, MezzanineHeader& header);
+
+// Decode a file into pixels, which must already have the pixels of its reference frame if it has one
+// (the blocks are XOR'd into them). False if the file is broken
+bool decodeMezzanine(const std::vector<unsigned char>& file, unsigned char* pixels);
+
+// Decode frame of the folder of the reader into reader.pixels, after the frames back to the keyframe that it needs.
+// False if a file is missing or broken
+bool readMezzanineFrame(MezzanineReader& reader, int frame);
@@ -0,0 +1,483 @@
+/*
+Title: Basic Ray Tracer
+File Name: ObjLoader.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ObjLoader.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// (without the min and max macros of windows.h, which would break std::min and std::max)
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// Every chunk is about this many bytes of the file
+#define OBJ_CHUNK_SIZE (4 * 1024 * 1024)
+
+// A file that is mapped into memory, or read into it where there is no mapping
+struct MappedFile
+{
+	const char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	std::vector<char> bytes;
+#endif
+
+	bool open(const std::string& fileName)
+	{
+#ifdef _WIN32
+		file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+			return false;
+
+		size = (size_t)fileSize.QuadPart;
+
+		// an empty file cannot be mapped, and has nothing in it anyway
+		if (size == 0)
+			return true;
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+			return false;
+
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		return data != nullptr;
+#else
+		std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+		if (!in)
+			return false;
+
+		bytes.resize((size_t)in.tellg());
+		in.seekg(0);
+		in.read(bytes.data(), bytes.size());
+
+		data = bytes.data();
+		size = bytes.size();
+		return (bool)in;
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (data != nullptr)
+			UnmapViewOfFile(data);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#endif
+	}
+};
+
+// What one chunk of the file has. A corner of a triangle is the number of a point from the start of the file,
+// or, if its bit in relative is set, from the first point of this chunk (it can be negative, a point of a chunk before)
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+
+	std::vector<glm::vec3> points;
+	std::vector<int> corners;
+	std::vector<unsigned char> relative;
+
+	bool failed = false;
+};
+
+static bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Parse a number like 12, -0.5, or 1.5e-3 at p, and return where it ends, or nullptr if there is no number.
+// The digits are added up as an integer, and only multiplied by the power of ten at the end
+static const char* parseFloat(const char* p, const char* end, float& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	while (p < end && isSpace(*p))
+		p++;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	unsigned long long digits = 0;
+	int exponent = 0;
+	int count = 0;
+
+	for (; p < end && isDigit(*p); p++, count++)
+	{
+		// after 19 digits, the rest are too small to matter, and would not fit
+		if (digits < 1000000000000000000ull)
+			digits = digits * 10 + (*p - '0');
+		else
+			exponent++;
+	}
+
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && isDigit(*p); p++, count++)
+		{
+			if (digits < 1000000000000000000ull)
+			{
+				digits = digits * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+
+	if (count == 0)
+		return nullptr;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+
+		if (q < end && (*q == '-' || *q == '+'))
+			negativeExponent = *q++ == '-';
+
+		if (q < end && isDigit(*q))
+		{
+			int e = 0;
+			for (; q < end && isDigit(*q); q++)
+				e = std::min(e * 10 + (*q - '0'), 1000);
+
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = (double)digits;
+
+	if (exponent < 0)
+		result = -exponent <= 22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+	else if (exponent > 0)
+		result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+// Parse a corner of a face, like 7, 7/2, 7//3, or 7/2/3, and keep only the number of the point
+static const char* parseCorner(const char* p, const char* end, int& index)
+{
+	while (p < end && isSpace(*p))
+		p++;
+
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+
+	if (p >= end || !isDigit(*p))
+		return nullptr;
+
+	int value = 0;
+	for (; p < end && isDigit(*p); p++)
+		value = value * 10 + (*p - '0');
+
+	// the texture coordinate and the normal
+	while (p < end && !isSpace(*p) && *p != '\r' && *p != '\n')
+		p++;
+
+	index = negative ? -value : value;
+	return p;
+}
+
+// Parse the lines of a chunk
+static void parseChunk(ObjChunk& chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+
+	// the corners of the face on this line, before it is cut into triangles
+	std::vector<int> face;
+
+	while (p < end)
+	{
+		while (p < end && isSpace(*p))
+			p++;
+
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		if (lineEnd - p > 1 && p[0] == 'v' && isSpace(p[1]))
+		{
+			glm::vec3 point;
+			const char* q = parseFloat(p + 1, lineEnd, point.x);
+
+			q = q ? parseFloat(q, lineEnd, point.y) : nullptr;
+			q = q ? parseFloat(q, lineEnd, point.z) : nullptr;
+
+			if (q == nullptr)
+			{
+				chunk.failed = true;
+				return;
+			}
+
+			chunk.points.push_back(point);
+		}
+		else if (lineEnd - p > 1 && p[0] == 'f' && isSpace(p[1]))
+		{
+			face.clear();
+			const char* q = p + 1;
+			int index;
+
+			while ((q = parseCorner(q, lineEnd, index)) != nullptr)
+			{
+				// a negative number counts back from the last point before the face, -1 is the last one
+				face.push_back(index);
+			}
+
+			if (face.size() < 3 || std::find(face.begin(), face.end(), 0) != face.end())
+			{
+				chunk.failed = true;
+				return;
+			}
+
+			int pointsBefore = (int)chunk.points.size();
+
+			for (size_t i = 1; i + 1 < face.size(); i++)
+			{
+				int corners[3] = { face[0], face[i], face[i + 1] };
+				unsigned char relative = 0;
+
+				for (int k = 0; k < 3; k++)
+				{
+					if (corners[k] < 0)
+					{
+						corners[k] += pointsBefore;
+						relative |= 1 << k;
+					}
+					else
+					{
+						corners[k] -= 1;
+					}
+
+					chunk.corners.push_back(corners[k]);
+				}
+
+				chunk.relative.push_back(relative);
+			}
+		}
+
+		// comments, and everything that is not a point or a face (normals, groups, materials)
+		p = lineEnd + 1;
+	}
+}
+
+bool loadObj(const std::string& fileName, glm::vec3 color, float reflectivity, std::vector<triangle>& triangles)
+{
+	PROFILE_ZONE("loadObj");
+
+	MappedFile file;
+
+	if (!file.open(fileName))
+	{
+		std::cout << "Can't read the OBJ file " << fileName << std::endl;
+		return false;
+	}
+
+	// Cut the file into chunks, every one of which starts at the start of a line
+	int numChunks = (int)std::max((size_t)1, (file.size + OBJ_CHUNK_SIZE - 1) / OBJ_CHUNK_SIZE);
+	std::vector<ObjChunk> chunks(numChunks);
+	const char* fileEnd = file.data + file.size;
+
+	for (int i = 0; i < numChunks; i++)
+	{
+		const char* start = file.data + file.size / numChunks * i;
+
+		if (i > 0)
+		{
+			while (start < fileEnd && start[-1] != '\n')
+				start++;
+		}
+
+		chunks[i].begin = start;
+		if (i > 0)
+			chunks[i - 1].end = start;
+	}
+
+	chunks[numChunks - 1].end = fileEnd;
+
+	parallelJobs("parse OBJ chunk", numChunks, [&chunks](int i) { parseChunk(chunks[i]); });
+
+	// where the points and the triangles of every chunk start
+	std::vector<int> firstPoint(numChunks + 1, 0);
+	std::vector<size_t> firstTriangle(numChunks + 1, triangles.size());
+
+	for (int i = 0; i < numChunks; i++)
+	{
+		if (chunks[i].failed)
+		{
+			std::cout << fileName << " has a point or a face that could not be read" << std::endl;
+			return false;
+		}
+
+		firstPoint[i + 1] = firstPoint[i] + (int)chunks[i].points.size();
+		firstTriangle[i + 1] = firstTriangle[i] + chunks[i].relative.size();
+	}
+
+	int numPoints = firstPoint[numChunks];
+	triangles.resize(firstTriangle[numChunks]);
+
+	// The points of every chunk are numbered now, so the triangles can be made, again one chunk per job
+	std::vector<glm::vec3> points(numPoints);
+	std::vector<char> outside(numChunks, 0);
+
+	parallelJobs("copy OBJ points", numChunks, [&](int i) {
+		std::copy(chunks[i].points.begin(), chunks[i].points.end(), points.begin() + firstPoint[i]);
+	});
+
+	parallelJobs("make OBJ triangles", numChunks, [&](int i) {
+		const ObjChunk& chunk = chunks[i];
+
+		for (size_t t = 0; t < chunk.relative.size(); t++)
+		{
+			glm::vec3 corner[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				int index = chunk.corners[t * 3 + k];
+				if (chunk.relative[t] & (1 << k))
+					index += firstPoint[i];
+
+				if (index < 0 || index >= numPoints)
+				{
+					outside[i] = 1;
+					return;
+				}
+
+				corner[k] = points[index];
+			}
+
+			// a face with no area has no normal, and no ray can hit it
+			glm::vec3 normal = glm::cross(corner[1] - corner[0], corner[2] - corner[0]);
+			if (glm::dot(normal, normal) == 0.0f)
+				normal = glm::vec3(0.0f, 1.0f, 0.0f);
+
+			triangles[firstTriangle[i] + t] = makeTriangle(corner[0], corner[1], corner[2], normal, color, reflectivity);
+		}
+	});
+
+	if (std::find(outside.begin(), outside.end(), 1) != outside.end())
+	{
+		std::cout << fileName << " has a face with a point that is not in the file" << std::endl;
+		triangles.resize(firstTriangle[0]);
+		return false;
+	}
+
+	return true;
+}
+
+// The start of a model file, then the triangles
+struct ModelHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int triangleSize;
+	unsigned long long numTriangles;
+};
+
+static const char modelMagic[8] = { 'R', 'T', 'M', 'O', 'D', 'E', 'L', 0 };
+
+bool saveModel(const std::string& fileName, const std::vector<triangle>& triangles, size_t first)
+{
+	ModelHeader header = {};
+	memcpy(header.magic, modelMagic, sizeof(modelMagic));
+	header.version = MODEL_FILE_VERSION;
+	header.triangleSize = sizeof(triangle);
+	header.numTriangles = triangles.size() - first;
+
+	FILE* file = fopen(fileName.c_str(), "wb");
+
+	bool ok = file != nullptr && fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(triangles.data() + first, sizeof(triangle), header.numTriangles, file) == header.numTriangles;
+
+	if (file != nullptr)
+		ok = fclose(file) == 0 && ok;
+
+	if (!ok)
+		std::cout << "Can't write the model " << fileName << std::endl;
+
+	return ok;
+}
+
+bool loadModel(const std::string& fileName, std::vector<triangle>& triangles)
+{
+	PROFILE_ZONE("loadModel");
+
+	MappedFile file;
+
+	if (!file.open(fileName) || file.size < sizeof(ModelHeader))
+	{
+		std::cout << "Can't read the model " << fileName << std::endl;
+		return false;
+	}
+
+	ModelHeader header;
+	memcpy(&header, file.data, sizeof(header));
+
+	if (memcmp(header.magic, modelMagic, sizeof(modelMagic)) != 0 || header.version != MODEL_FILE_VERSION || header.triangleSize != sizeof(triangle))
+	{
+		std::cout << fileName << " is not a model of this version, convert it again with --convert-obj" << std::endl;
+		return false;
+	}
+
+	if (file.size < sizeof(header) + header.numTriangles * sizeof(triangle))
+	{
+		std::cout << fileName << " is shorter than its triangles" << std::endl;
+		return false;
+	}
+
+	size_t first = triangles.size();
+	triangles.resize(first + header.numTriangles);
+
+	if (header.numTriangles > 0)
+		memcpy(&triangles[first], file.data + sizeof(header), header.numTriangles * sizeof(triangle));
+
+	return true;
+}
@@ -0,0 +1,68 @@
+/*
+Title: Basic Ray Tracer
+File Name: ObjLoader.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Reads meshes from Wavefront OBJ files, for --obj <file>. Only the points
+(v) and the faces (f) are read, and every face is cut into triangles
+around its first corner. A triangle gets the normal of its face, because
+a triangle of the scene has only one (see SceneStructs.h), and every
+triangle of a file has the same color and reflectivity.
+
+Big files load about as fast as the disk can give them: the file is
+mapped into memory instead of read, and cut into chunks at the ends of
+lines, which are parsed by jobs (JobSystem.h) at the same time, with a
+float parser that is much faster than strtod. A face can point at a
+point by its number from the start of the file, or (with a negative
+number) from the face back, so the faces of a chunk are kept with the
+points of that chunk until every chunk is done, and then numbered.
+
+Parsing is still work, so --convert-obj <file> <model> turns an OBJ into
+a model file once, and --obj loads that (any file that ends in .rtmodel)
+without any parsing at all: after a small header, it is the triangles
+just the way the scene has them (see SceneStructs.h), with their points,
+normals, colors, and reflectivities, so they are copied out of the mapped
+file in one go. The header has MODEL_FILE_VERSION and the size of a
+triangle, and a file with others is not read, so it has to be converted
+again when the triangles change. The BVH of the mesh is not in it,
+because buildBVHCached already keeps that on the disk.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "../Assets/SceneStructs.h"
+
+// Change this when the file of a model changes, or the triangles do
+#define MODEL_FILE_VERSION 1
+
+// Read an OBJ file, and add its triangles to the end of triangles, all with color and reflectivity.
+// Returns false, and says why, if it could not be read, or has a face with a point that is not in it
+bool loadObj(const std::string& fileName, glm::vec3 color, float reflectivity, std::vector<triangle>& triangles);
+
+// Write triangles first to the end of triangles into a model file, and read one back onto the end of triangles.
+// Both return false, and say why, if the file could not be written or read
+bool saveModel(const std::string& fileName, const std::vector<triangle>& triangles, size_t first);
+bool loadModel(const std::string& fileName, std::vector<triangle>& triangles);
@@ -0,0 +1,695 @@
+/*
+Title: Basic Ray Tracer
+File Name: ObjectStorage.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ObjectStorage.h"
+
+#include "Sockets.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#endif
+
+// How many times a request is sent before the upload is given up
+#define UPLOAD_ATTEMPTS 3
+
+typedef std::vector<std::pair<std::string, std::string>> QueryList;
+
+// The host, port, and path (/bucket/key) of an object
+struct ObjectUrl
+{
+	std::string host;
+	std::string port;
+	std::string path;
+};
+
+// The keys that sign the requests, from the environment
+struct ObjectKeys
+{
+	std::string accessKey;
+	std::string secretKey;
+	std::string sessionToken;
+	std::string region;
+};
+
+//=================================================================
+// SHA-256 and HMAC-SHA256, which Signature Version 4 is made of (FIPS 180-4 and RFC 2104)
+
+static const uint32_t sha256Constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+static uint32_t rotateRight(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+// Add one block of 64 bytes to the state
+static void sha256Block(uint32_t state[8], const unsigned char* block)
+{
+	uint32_t w[64];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+
+	for (int i = 16; i < 64; i++)
+	{
+		uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+		uint32_t choose = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + choose + sha256Constants[i] + w[i];
+		uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+		uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + majority;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// The 32 bytes of the hash of size bytes of data
+static std::string sha256(const void* data, size_t size)
+{
+	uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	const unsigned char* bytes = (const unsigned char*)data;
+	size_t whole = size - size % 64;
+
+	for (size_t i = 0; i < whole; i += 64)
+		sha256Block(state, bytes + i);
+
+	// the rest, a 1 bit, zeros, and the length in bits, which can take one more block
+	unsigned char tail[128] = {};
+	size_t rest = size - whole;
+	if (rest > 0)
+		memcpy(tail, bytes + whole, rest);
+	tail[rest] = 0x80;
+
+	size_t tailSize = rest < 56 ? 64 : 128;
+	uint64_t bits = (uint64_t)size * 8;
+
+	for (int i = 0; i < 8; i++)
+		tail[tailSize - 1 - i] = (unsigned char)(bits >> (i * 8));
+
+	for (size_t i = 0; i < tailSize; i += 64)
+		sha256Block(state, tail + i);
+
+	std::string hash(32, '\0');
+
+	for (int i = 0; i < 32; i++)
+		hash[i] = (char)(state[i / 4] >> (24 - (i % 4) * 8));
+
+	return hash;
+}
+
+static std::string sha256(const std::string& text)
+{
+	return sha256(text.data(), text.size());
+}
+
+static std::string hmacSha256(const std::string& key, const std::string& message)
+{
+	std::string block = key.size() > 64 ? sha256(key) : key;
+	block.resize(64, '\0');
+
+	std::string inner(64, '\0');
+	std::string outer(64, '\0');
+
+	for (int i = 0; i < 64; i++)
+	{
+		inner[i] = block[i] ^ 0x36;
+		outer[i] = block[i] ^ 0x5c;
+	}
+
+	return sha256(outer + sha256(inner + message));
+}
+
+static std::string toHex(const std::string& bytes)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+
+	for (unsigned char c : bytes)
+	{
+		hex += digits[c >> 4];
+		hex += digits[c & 15];
+	}
+
+	return hex;
+}
+
+//=================================================================
+// Signature Version 4
+
+// Percent-encode everything but the unreserved characters (and the slashes of a path, with keepSlash)
+static std::string uriEncode(const std::string& text, bool keepSlash)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	std::string encoded;
+
+	for (unsigned char c : text)
+	{
+		if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (keepSlash && c == '/'))
+			encoded += (char)c;
+		else
+		{
+			encoded += '%';
+			encoded += digits[c >> 4];
+			encoded += digits[c & 15];
+		}
+	}
+
+	return encoded;
+}
+
+// The query of a request, which is the same in the request line and in the signature, because the names are in order
+static std::string canonicalQuery(const QueryList& query)
+{
+	std::string text;
+
+	for (const auto& pair : query)
+		text += (text.empty() ? "" : "&") + uriEncode(pair.first, false) + "=" + uriEncode(pair.second, false);
+
+	return text;
+}
+
+// The headers of a request, with its Authorization. query must be in the order of the names
+static std::string signRequest(const ObjectUrl& url, const ObjectKeys& keys, const std::string& method,
+	const QueryList& query, const std::string& payloadHash, const std::string& hostHeader)
+{
+	// the time of the request, in UTC
+	time_t now = time(nullptr);
+	char amzDate[20];
+	strftime(amzDate, sizeof(amzDate), "%Y%m%dT%H%M%SZ", gmtime(&now));
+	std::string date(amzDate, 8);
+
+	std::string headers = "host:" + hostHeader + "\n" +
+		"x-amz-content-sha256:" + payloadHash + "\n" +
+		"x-amz-date:" + amzDate + "\n";
+	std::string signedHeaders = "host;x-amz-content-sha256;x-amz-date";
+
+	if (!keys.sessionToken.empty())
+	{
+		headers += "x-amz-security-token:" + keys.sessionToken + "\n";
+		signedHeaders += ";x-amz-security-token";
+	}
+
+	std::string canonical = method + "\n" + uriEncode(url.path, true) + "\n" + canonicalQuery(query) + "\n" +
+		headers + "\n" + signedHeaders + "\n" + payloadHash;
+
+	std::string scope = date + "/" + keys.region + "/s3/aws4_request";
+	std::string toSign = std::string("AWS4-HMAC-SHA256\n") + amzDate + "\n" + scope + "\n" + toHex(sha256(canonical));
+
+	std::string signingKey = hmacSha256(hmacSha256(hmacSha256(hmacSha256("AWS4" + keys.secretKey, date), keys.region), "s3"), "aws4_request");
+	std::string signature = toHex(hmacSha256(signingKey, toSign));
+
+	std::string lines = "Host: " + hostHeader + "\r\n" +
+		"x-amz-content-sha256: " + payloadHash + "\r\n" +
+		"x-amz-date: " + amzDate + "\r\n" +
+		"Authorization: AWS4-HMAC-SHA256 Credential=" + keys.accessKey + "/" + scope +
+		", SignedHeaders=" + signedHeaders + ", Signature=" + signature + "\r\n";
+
+	if (!keys.sessionToken.empty())
+		lines += "x-amz-security-token: " + keys.sessionToken + "\r\n";
+
+	return lines;
+}
+
+//=================================================================
+// HTTP
+
+// Read http://host[:port]/bucket/key. Returns false, and says why (for the option that has the url), if it is not one
+static bool parseObjectUrl(const std::string& text, ObjectUrl& url, const char* option)
+{
+	if (text.compare(0, 8, "https://") == 0)
+	{
+		std::cout << option << " has no TLS, give it an http:// url of a proxy that has (see ObjectStorage.h)" << std::endl;
+		return false;
+	}
+
+	if (text.compare(0, 7, "http://") != 0)
+	{
+		std::cout << option << " needs a url like http://host:9000/bucket/key" << std::endl;
+		return false;
+	}
+
+	size_t slash = text.find('/', 7);
+	std::string authority = text.substr(7, slash == std::string::npos ? std::string::npos : slash - 7);
+	url.path = slash == std::string::npos ? "" : text.substr(slash);
+
+	// the bucket and a key after it
+	size_t keyStart = url.path.find('/', 1);
+
+	if (authority.empty() || keyStart == std::string::npos || keyStart + 1 >= url.path.size())
+	{
+		std::cout << option << " needs a url like http://host:9000/bucket/key" << std::endl;
+		return false;
+	}
+
+	size_t colon = authority.find(':');
+	url.host = authority.substr(0, colon);
+	url.port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+	return true;
+}
+
+// Read the keys from the environment. Returns false, and says why (for the option that needs them), if they are not there
+static bool readObjectKeys(ObjectKeys& keys, const char* option)
+{
+	const char* access = getenv("AWS_ACCESS_KEY_ID");
+	const char* secret = getenv("AWS_SECRET_ACCESS_KEY");
+	const char* token = getenv("AWS_SESSION_TOKEN");
+	const char* region = getenv("AWS_REGION");
+
+	if (access == nullptr || secret == nullptr)
+	{
+		std::cout << option << " needs AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY in the environment" << std::endl;
+		return false;
+	}
+
+	keys.accessKey = access;
+	keys.secretKey = secret;
+	keys.sessionToken = token != nullptr ? token : "";
+	keys.region = region != nullptr && region[0] != '\0' ? region : "us-east-1";
+	return true;
+}
+
+// The keys of --shared-cache, which it can do without: with no AWS_ACCESS_KEY_ID, its requests are not
+// signed, for a plain HTTP server that takes GET and PUT (like a WebDAV folder of nginx)
+static void readCacheKeys(ObjectKeys& keys)
+{
+	if (getenv("AWS_ACCESS_KEY_ID") == nullptr || !readObjectKeys(keys, "--shared-cache"))
+		keys = ObjectKeys();
+}
+
+// The value of a header, whose name is in lower case, or "" if there is none
+static std::string findHeader(const std::string& headers, const std::string& name)
+{
+	size_t start = 0;
+
+	while (start < headers.size())
+	{
+		size_t end = headers.find("\r\n", start);
+		std::string line = headers.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		size_t colon = line.find(':');
+
+		if (colon == name.size())
+		{
+			std::string lower = line.substr(0, colon);
+
+			for (char& c : lower)
+				c = (char)tolower((unsigned char)c);
+
+			if (lower == name)
+				return line.substr(line.find_first_not_of(' ', colon + 1));
+		}
+
+		if (end == std::string::npos)
+			break;
+
+		start = end + 2;
+	}
+
+	return "";
+}
+
+// The body of an answer in chunks (Transfer-Encoding: chunked), which CompleteMultipartUpload can be,
+// since it sends spaces while it puts the parts together, as one piece
+static std::string joinChunks(const std::string& body)
+{
+	std::string joined;
+	size_t at = 0;
+
+	while (at < body.size())
+	{
+		size_t end = body.find("\r\n", at);
+
+		if (end == std::string::npos)
+			break;
+
+		size_t size = strtoul(body.c_str() + at, nullptr, 16);
+
+		if (size == 0)
+			break;
+
+		joined += body.substr(end + 2, size);
+		at = end + 2 + size + 2;
+	}
+
+	return joined;
+}
+
+// The text of an element of an XML answer, or "" if there is none
+static std::string findElement(const std::string& xml, const std::string& name)
+{
+	size_t start = xml.find("<" + name + ">");
+	size_t end = xml.find("</" + name + ">");
+
+	if (start == std::string::npos || end == std::string::npos)
+		return "";
+
+	start += name.size() + 2;
+	return end > start ? xml.substr(start, end - start) : "";
+}
+
+// Send all of size bytes, which send does not have to do at once
+static bool sendAll(SOCKET s, const char* data, size_t size)
+{
+	size_t done = 0;
+
+	while (done < size)
+	{
+		int sent = send(s, data + done, (int)std::min(size - done, (size_t)1 << 20), 0);
+
+		if (sent <= 0)
+			return false;
+
+		done += sent;
+	}
+
+	return true;
+}
+
+// Send one signed request with size bytes of body, on a connection of its own, and read the answer until the server
+// closes it. status is the HTTP status, 0 if the server could not be reached, and headers and response are the rest
+static void sendRequest(const ObjectUrl& url, const ObjectKeys& keys, const std::string& method, const QueryList& query,
+	const char* body, size_t size, int& status, std::string& headers, std::string& response)
+{
+	status = 0;
+	headers.clear();
+	response.clear();
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = nullptr;
+
+	if (getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &found) != 0)
+		return;
+
+	SOCKET s = INVALID_SOCKET;
+
+	for (addrinfo* a = found; a != nullptr && s == INVALID_SOCKET; a = a->ai_next)
+	{
+		s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+
+		if (s != INVALID_SOCKET && connect(s, a->ai_addr, (int)a->ai_addrlen) != 0)
+		{
+			closesocket(s);
+			s = INVALID_SOCKET;
+		}
+	}
+
+	freeaddrinfo(found);
+
+	if (s == INVALID_SOCKET)
+		return;
+
+	// the port is in the host that is signed, unless it is the one of http
+	std::string hostHeader = url.port == "80" ? url.host : url.host + ":" + url.port;
+	std::string queryText = canonicalQuery(query);
+
+	// a request without keys (see readCacheKeys) only says who it is for
+	std::string headerLines = keys.accessKey.empty() ? "Host: " + hostHeader + "\r\n" :
+		signRequest(url, keys, method, query, toHex(sha256(body, size)), hostHeader);
+
+	std::string request = method + " " + uriEncode(url.path, true) + (queryText.empty() ? "" : "?" + queryText) + " HTTP/1.1\r\n" +
+		headerLines +
+		"Content-Length: " + std::to_string(size) + "\r\n" +
+		"Connection: close\r\n\r\n";
+
+	if (sendAll(s, request.data(), request.size()) && sendAll(s, body, size))
+	{
+		std::string answer;
+		char buffer[4096];
+		int got;
+
+		while ((got = recv(s, buffer, sizeof(buffer), 0)) > 0)
+			answer.append(buffer, got);
+
+		size_t end = answer.find("\r\n\r\n");
+
+		if (answer.compare(0, 5, "HTTP/") == 0 && end != std::string::npos)
+		{
+			status = atoi(answer.c_str() + answer.find(' '));
+			headers = answer.substr(0, end);
+			response = answer.substr(end + 4);
+
+			if (findHeader(headers, "transfer-encoding").find("chunked") != std::string::npos)
+				response = joinChunks(response);
+		}
+	}
+
+	closesocket(s);
+}
+
+// Send a request until it gets an answer of 200 that is not an error (CompleteMultipartUpload can be one),
+// a few times. Says why, if it never does. A plain HTTP server can answer a PUT with 201 or 204, which are done too
+static bool sendUntilDone(const ObjectUrl& url, const ObjectKeys& keys, const std::string& method, const QueryList& query,
+	const char* body, size_t size, std::string& headers, std::string& response)
+{
+	int status = 0;
+
+	for (int attempt = 0; attempt < UPLOAD_ATTEMPTS; attempt++)
+	{
+		sendRequest(url, keys, method, query, body, size, status, headers, response);
+
+		if (status / 100 == 2 && response.find("<Error>") == std::string::npos)
+			return true;
+
+		if (attempt + 1 < UPLOAD_ATTEMPTS)
+			std::this_thread::sleep_for(std::chrono::seconds(1 << attempt));
+	}
+
+	if (status == 0)
+		std::cout << "the object storage at " << url.host << ":" << url.port << " could not be reached" << std::endl;
+	else
+		std::cout << "the object storage answered " << status << " " << findElement(response, "Code") << " " << findElement(response, "Message") << std::endl;
+
+	return false;
+}
+
+//=================================================================
+
+bool checkObjectStorage(const std::string& url)
+{
+	ObjectUrl object;
+	ObjectKeys keys;
+	return parseObjectUrl(url, object, "--upload") && readObjectKeys(keys, "--upload");
+}
+
+bool checkSharedCache(const std::string& url)
+{
+	ObjectUrl object;
+	return parseObjectUrl(url + "/check", object, "--shared-cache");
+}
+
+int getObject(const std::string& url, std::string& data)
+{
+	ObjectUrl object;
+	ObjectKeys keys;
+	data.clear();
+
+	if (!parseObjectUrl(url, object, "--shared-cache"))
+		return 0;
+
+	readCacheKeys(keys);
+
+	WSADATA wsa;
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 0;
+
+	// Only one try, because an object that is not there is the usual answer of a cache
+	// that is still empty, and then the caller makes the file on its own
+	int status = 0;
+	std::string headers;
+	sendRequest(object, keys, "GET", QueryList(), nullptr, 0, status, headers, data);
+	WSACleanup();
+
+	// a connection that broke off gives the first part of the object, which must not be used
+	std::string length = findHeader(headers, "content-length");
+
+	if (status == 200 && !length.empty() && strtoull(length.c_str(), nullptr, 10) != data.size())
+		status = 0;
+
+	if (status != 200)
+		data.clear();
+
+	return status;
+}
+
+bool putObject(const std::string& url, const std::string& data)
+{
+	ObjectUrl object;
+	ObjectKeys keys;
+
+	if (!parseObjectUrl(url, object, "--shared-cache"))
+		return false;
+
+	readCacheKeys(keys);
+
+	WSADATA wsa;
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return false;
+
+	std::string headers, response;
+	bool done = sendUntilDone(object, keys, "PUT", QueryList(), data.data(), data.size(), headers, response);
+	WSACleanup();
+	return done;
+}
+
+bool uploadStream(FILE* input, const std::string& url, size_t partBytes)
+{
+	ObjectUrl object;
+	ObjectKeys keys;
+
+	if (!parseObjectUrl(url, object, "--upload") || !readObjectKeys(keys, "--upload"))
+		return false;
+
+	partBytes = std::max(partBytes, (size_t)MIN_UPLOAD_PART_BYTES);
+
+	WSADATA data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		return false;
+
+	std::string headers, response;
+
+	if (!sendUntilDone(object, keys, "POST", { { "uploads", "" } }, nullptr, 0, headers, response))
+	{
+		WSACleanup();
+		return false;
+	}
+
+	std::string uploadId = findElement(response, "UploadId");
+
+	// the part that is uploaded, and the one that is read meanwhile
+	std::vector<char> parts[2];
+	std::vector<std::string> etags;
+	std::thread uploader;
+	bool failed = false;
+	bool partFailed = false;
+	size_t total = 0;
+
+	for (int number = 1; !failed; number++)
+	{
+		std::vector<char>& part = parts[number % 2];
+		part.resize(partBytes);
+
+		// fread only returns less than all of it at the end
+		size_t size = fread(part.data(), 1, partBytes, input);
+		part.resize(size);
+
+		if (uploader.joinable())
+			uploader.join();
+
+		failed = partFailed;
+
+		// an object has at least one part, which can be empty if it is the only one
+		if (failed || (size == 0 && number > 1))
+			break;
+
+		etags.push_back("");
+		total += size;
+
+		std::string* etag = &etags.back();
+		uploader = std::thread([&object, &keys, &part, &partFailed, uploadId, number, etag]
+		{
+			std::string partHeaders, partResponse;
+			QueryList query = { { "partNumber", std::to_string(number) }, { "uploadId", uploadId } };
+
+			partFailed = !sendUntilDone(object, keys, "PUT", query, part.data(), part.size(), partHeaders, partResponse);
+			*etag = findHeader(partHeaders, "etag");
+		});
+
+		if (size < partBytes)
+			break;
+	}
+
+	if (uploader.joinable())
+		uploader.join();
+
+	failed = failed || partFailed;
+
+	if (!failed)
+	{
+		std::string complete = "<CompleteMultipartUpload>";
+
+		for (size_t i = 0; i < etags.size(); i++)
+			complete += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" + etags[i] + "</ETag></Part>";
+
+		complete += "</CompleteMultipartUpload>";
+
+		failed = !sendUntilDone(object, keys, "POST", { { "uploadId", uploadId } }, complete.data(), complete.size(), headers, response);
+	}
+
+	// the parts of an upload that is not finished are kept (and paid for) until it is aborted
+	if (failed)
+	{
+		int status;
+		sendRequest(object, keys, "DELETE", { { "uploadId", uploadId } }, nullptr, 0, status, headers, response);
+		std::cout << "the upload to " << url << " failed, and was aborted" << std::endl;
+	}
+	else
+		std::cout << "uploaded " << total / (1 << 20) << " MB to " << url << " in " << etags.size() << " parts" << std::endl;
+
+	WSACleanup();
+	return !failed;
+}
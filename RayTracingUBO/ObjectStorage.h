@@ -0,0 +1,73 @@
+/*
+Title: Basic Ray Tracer
+File Name: ObjectStorage.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The upload of --upload <url>, which puts the video in S3-compatible
+object storage (Amazon S3, MinIO, and the others that speak its API)
+while it is encoded, instead of in a file on the disk of the render node.
+ffmpeg writes the video to its standard output, into a copy of this
+program with --upload-stdin, which cuts it into parts as it comes and
+sends every part with a multipart upload (CreateMultipartUpload,
+UploadPart, and CompleteMultipartUpload), so the object is done soon
+after the last frame. A part is uploaded while the next one is read, so
+only two parts are ever in memory, and a part that fails is sent again
+a few times before the upload is given up and aborted.
+
+The url is http://host[:port]/bucket/key, the bucket in the path, which
+every one of them takes. The requests are signed with AWS Signature
+Version 4, with the keys of the AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY,
+and AWS_SESSION_TOKEN (if there is one) environment variables, and the
+region of AWS_REGION (us-east-1 if it is not set). There is no TLS here,
+so https needs a proxy on the node that the upload goes through, like a
+MinIO gateway or stunnel.
+
+The same requests also get and put the single objects of --shared-cache,
+the program binaries and BLAS files that the nodes of a farm share. Its
+keys are optional: without them, the requests are not signed, so any
+HTTP server that answers GET and PUT can be the cache.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// Every part but the last one has to be at least this big
+#define MIN_UPLOAD_PART_BYTES (5 << 20)
+
+// True if url is one that --upload can use, and the keys are in the environment. Says why not, if it is not
+bool checkObjectStorage(const std::string& url);
+
+// Upload everything that can be read from input as the object at url, in parts of partBytes,
+// and return true once the object is complete. Says why, and aborts the upload, if it fails
+bool uploadStream(FILE* input, const std::string& url, size_t partBytes);
+
+// True if url is one that --shared-cache can use (http://host[:port]/bucket, the keys are put after it). Says why not, if it is not
+bool checkSharedCache(const std::string& url);
+
+// Read the object at url into data, with one GET. Returns the HTTP status: 200 with the object in data, 404 (or 403,
+// which S3 answers without the right to list the bucket) if it is not there, and 0 if the server could not be reached,
+// or the object did not arrive whole. It says nothing, because an object that is not in the cache yet is no error
+int getObject(const std::string& url, std::string& data);
+
+// Put data as the object at url, with one PUT (up to 5 GB). Says why, if it fails
+bool putObject(const std::string& url, const std::string& data);
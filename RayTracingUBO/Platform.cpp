@@ -0,0 +1,568 @@
+/*
+Title: Basic Ray Tracer
+File Name: Platform.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <limits.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef RAYTRACER_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+static std::chrono::steady_clock::time_point platformStart = std::chrono::steady_clock::now();
+
+double platformTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - platformStart).count();
+}
+
+void makeFolder(const std::string& folder)
+{
+#ifdef _WIN32
+	CreateDirectoryA(folder.c_str(), NULL);
+#else
+	mkdir(folder.c_str(), 0777);
+#endif
+}
+
+bool linkFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	DeleteFileA(to.c_str());
+
+	if (CreateHardLinkA(to.c_str(), from.c_str(), NULL))
+		return true;
+#else
+	unlink(to.c_str());
+
+	if (link(from.c_str(), to.c_str()) == 0)
+		return true;
+#endif
+
+	std::ifstream in(from, std::ios::binary);
+	std::ofstream out(to, std::ios::binary);
+	out << in.rdbuf();
+	return in && out;
+}
+
+std::string programPath()
+{
+#ifdef _WIN32
+	char program[MAX_PATH];
+	GetModuleFileNameA(NULL, program, MAX_PATH);
+	return program;
+#else
+	char program[PATH_MAX];
+	ssize_t length = readlink("/proc/self/exe", program, sizeof(program) - 1);
+	return length > 0 ? std::string(program, length) : "RayTracingUBO";
+#endif
+}
+
+int processId()
+{
+#ifdef _WIN32
+	return (int)GetCurrentProcessId();
+#else
+	return (int)getpid();
+#endif
+}
+
+std::string computerName()
+{
+#ifdef _WIN32
+	const char* computer = getenv("COMPUTERNAME");
+	return computer != nullptr ? computer : "worker";
+#else
+	char computer[256];
+	return gethostname(computer, sizeof(computer)) == 0 ? computer : "worker";
+#endif
+}
+
+bool startProcess(const std::string& commandLine, ChildProcess& child)
+{
+	child = ChildProcess();
+
+#ifdef _WIN32
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION process = {};
+
+	// CreateProcessA can change the command line, so it gets a copy
+	std::string command = commandLine;
+
+	if (!CreateProcessA(NULL, &command[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process))
+		return false;
+
+	child.process = process.hProcess;
+	child.thread = process.hThread;
+	return true;
+#else
+	// the shell splits the command line, quotes and all, the way CreateProcess does on Windows
+	pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		execl("/bin/sh", "sh", "-c", commandLine.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+
+	child.pid = pid;
+	return pid > 0;
+#endif
+}
+
+bool waitProcess(ChildProcess& child, int milliseconds, int& exitCode)
+{
+#ifdef _WIN32
+	if (WaitForSingleObject(child.process, milliseconds < 0 ? INFINITE : (DWORD)milliseconds) == WAIT_TIMEOUT)
+		return false;
+
+	DWORD code = 1;
+	GetExitCodeProcess(child.process, &code);
+	CloseHandle(child.process);
+	CloseHandle(child.thread);
+
+	exitCode = (int)code;
+	child = ChildProcess();
+	return true;
+#else
+	// waitpid has no timeout, so the child is looked at every few milliseconds until it ends or the time is over
+	int status = 0;
+	pid_t ended = 0;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+
+	while ((ended = waitpid(child.pid, &status, milliseconds < 0 ? 0 : WNOHANG)) == 0)
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+			return false;
+
+		usleep(20000);
+	}
+
+	exitCode = ended > 0 && WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+	child = ChildProcess();
+	return true;
+#endif
+}
+
+FILE* openPipe(const std::string& command, bool write)
+{
+#ifdef _WIN32
+	return _popen(command.c_str(), write ? "wb" : "rb");
+#else
+	// a pipe has no text mode on Linux, and a closed pipe should not kill the program
+	signal(SIGPIPE, SIG_IGN);
+	return popen(command.c_str(), write ? "w" : "r");
+#endif
+}
+
+void closePipe(FILE* pipe)
+{
+#ifdef _WIN32
+	_pclose(pipe);
+#else
+	pclose(pipe);
+#endif
+}
+
+bool runQuietCommand(const std::string& command)
+{
+#ifdef _WIN32
+	return system((command + " > NUL 2>&1").c_str()) == 0;
+#else
+	return system((command + " > /dev/null 2>&1").c_str()) == 0;
+#endif
+}
+
+FILE* binaryStandardInput()
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	return stdin;
+}
+
+bool createSharedMemory(size_t size, SharedMemory& memory)
+{
+	memory = SharedMemory();
+
+#ifdef _WIN32
+	// one mapping per process is enough, the ring of the frames is the only one
+	memory.name = "Local\\RayTracingUBO-" + std::to_string(processId());
+	memory.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32),
+		(DWORD)(size & 0xFFFFFFFF), memory.name.c_str());
+
+	if (memory.mapping == NULL)
+		return false;
+
+	memory.data = MapViewOfFile(memory.mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+	// The fd is left open in the processes that startProcess forks, and any of them can open it by its path
+	memory.fd = memfd_create("RayTracingUBO", 0);
+
+	if (memory.fd < 0 || ftruncate(memory.fd, (off_t)size) != 0)
+	{
+		closeSharedMemory(memory);
+		return false;
+	}
+
+	memory.name = "/proc/" + std::to_string(processId()) + "/fd/" + std::to_string(memory.fd);
+	memory.data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory.fd, 0);
+
+	if (memory.data == MAP_FAILED)
+		memory.data = nullptr;
+#endif
+
+	if (memory.data == nullptr)
+	{
+		closeSharedMemory(memory);
+		return false;
+	}
+
+	memory.size = size;
+	return true;
+}
+
+bool openSharedMemory(const std::string& name, SharedMemory& memory)
+{
+	memory = SharedMemory();
+	memory.name = name;
+
+#ifdef _WIN32
+	memory.mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+
+	if (memory.mapping == NULL)
+		return false;
+
+	// a view of size 0 is all of it, which VirtualQuery gives the size of, in whole pages
+	memory.data = MapViewOfFile(memory.mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+	MEMORY_BASIC_INFORMATION info = {};
+	if (memory.data != nullptr && VirtualQuery(memory.data, &info, sizeof(info)) != 0)
+		memory.size = info.RegionSize;
+#else
+	memory.fd = open(name.c_str(), O_RDWR);
+	struct stat status;
+
+	if (memory.fd < 0 || fstat(memory.fd, &status) != 0)
+	{
+		closeSharedMemory(memory);
+		return false;
+	}
+
+	memory.size = (size_t)status.st_size;
+	memory.data = mmap(nullptr, memory.size, PROT_READ | PROT_WRITE, MAP_SHARED, memory.fd, 0);
+
+	if (memory.data == MAP_FAILED)
+		memory.data = nullptr;
+#endif
+
+	if (memory.data == nullptr)
+	{
+		closeSharedMemory(memory);
+		return false;
+	}
+
+	return true;
+}
+
+void closeSharedMemory(SharedMemory& memory)
+{
+#ifdef _WIN32
+	if (memory.data != nullptr)
+		UnmapViewOfFile(memory.data);
+
+	if (memory.mapping != nullptr)
+		CloseHandle(memory.mapping);
+#else
+	if (memory.data != nullptr)
+		munmap(memory.data, memory.size);
+
+	if (memory.fd >= 0)
+		close(memory.fd);
+#endif
+
+	memory = SharedMemory();
+}
+
+int numaNodeCount()
+{
+#ifdef _WIN32
+	ULONG highest = 0;
+
+	if (!GetNumaHighestNodeNumber(&highest))
+		return 1;
+
+	return (int)highest + 1;
+#else
+	// the nodes are numbered from 0, and every one has a folder
+	int nodes = 0;
+
+	while (std::ifstream("/sys/devices/system/node/node" + std::to_string(nodes) + "/cpulist"))
+		nodes++;
+
+	return std::max(nodes, 1);
+#endif
+}
+
+bool pinThreadToNumaNode(int node)
+{
+#ifdef _WIN32
+	GROUP_AFFINITY affinity = {};
+
+	if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || affinity.Mask == 0)
+		return false;
+
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+	// the processors of the node, like 0-15,32-47
+	std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	std::string list;
+
+	if (!std::getline(file, list))
+		return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	size_t start = 0;
+
+	while (start < list.size())
+	{
+		size_t end = list.find(',', start);
+		std::string range = list.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		int first = 0;
+		int last = 0;
+		int values = sscanf(range.c_str(), "%d-%d", &first, &last);
+
+		for (int cpu = first; values > 0 && cpu <= (values == 2 ? last : first) && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &set);
+
+		if (end == std::string::npos)
+			break;
+
+		start = end + 1;
+	}
+
+	// 0 is the calling thread
+	return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+}
+
+#ifdef _WIN32
+// Large pages need the privilege to lock memory (Lock pages in memory, in the local security policy),
+// which even a user that has it has to turn on in its process
+static bool enableLockMemoryPrivilege()
+{
+	HANDLE token;
+
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	bool enabled = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(token);
+	return enabled;
+}
+#endif
+
+void* allocateLargePages(size_t& bytes, bool huge, bool& large)
+{
+#ifdef _WIN32
+	// Windows picks the size of its large pages itself, so huge makes no difference here
+	static bool privilege = enableLockMemoryPrivilege();
+	size_t page = GetLargePageMinimum();
+
+	if (privilege && page > 0)
+	{
+		size_t rounded = (bytes + page - 1) / page * page;
+		void* memory = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+		if (memory != nullptr)
+		{
+			bytes = rounded;
+			large = true;
+			return memory;
+		}
+	}
+
+	large = false;
+	return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	size_t page = (size_t)2 << 20;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+	// 1 GB pages only come from the ones that were set aside at boot (hugepagesz=1G)
+	if (huge)
+	{
+		size_t hugePage = (size_t)1 << 30;
+		size_t rounded = (bytes + hugePage - 1) / hugePage * hugePage;
+		void* memory = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), -1, 0);
+
+		if (memory != MAP_FAILED)
+		{
+			bytes = rounded;
+			large = true;
+			return memory;
+		}
+	}
+#endif
+
+	// Transparent huge pages: the memory starts on a 2 MB boundary, and the kernel is asked to back it with 2 MB pages.
+	// The parts before and after the boundaries are given back
+	bytes = (bytes + page - 1) / page * page;
+	char* mapped = (char*)mmap(nullptr, bytes + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (mapped == (char*)MAP_FAILED)
+		return nullptr;
+
+	char* memory = (char*)(((uintptr_t)mapped + page - 1) & ~(uintptr_t)(page - 1));
+
+	if (memory > mapped)
+		munmap(mapped, memory - mapped);
+
+	munmap(memory + bytes, mapped + page - memory);
+
+	large = madvise(memory, bytes, MADV_HUGEPAGE) == 0;
+	return memory;
+#endif
+}
+
+void freeLargePages(void* memory, size_t bytes)
+{
+#ifdef _WIN32
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, bytes);
+#endif
+}
+
+#ifdef RAYTRACER_EGL
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+bool makeEglContext(int device)
+{
+#ifdef RAYTRACER_EGL
+	PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (queryDevices == nullptr || getPlatformDisplay == nullptr)
+	{
+		std::cout << "this EGL cannot list the GPUs (EGL_EXT_device_enumeration and EGL_EXT_platform_device)" << std::endl;
+		return false;
+	}
+
+	EGLDeviceEXT devices[16];
+	EGLint count = 0;
+
+	if (!queryDevices(16, devices, &count) || device >= count)
+	{
+		std::cout << "there is no EGL device " << device << ", there are " << count << std::endl;
+		return false;
+	}
+
+	eglDisplay = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[device], nullptr);
+
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr))
+	{
+		std::cout << "could not open EGL device " << device << std::endl;
+		return false;
+	}
+
+	// the frames go into framebuffers, so the config only has to make a desktop OpenGL context
+	EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+
+	eglBindAPI(EGL_OPENGL_API);
+
+	if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configs) || configs == 0)
+	{
+		std::cout << "EGL device " << device << " has no OpenGL config" << std::endl;
+		return false;
+	}
+
+	// the compute shaders need 4.3, and without a surface, the context is current with EGL_NO_SURFACE
+	// (EGL_KHR_surfaceless_context), and draws into the framebuffers of --headless only
+	EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3, EGL_NONE };
+	eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+
+	if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+	{
+		std::cout << "EGL device " << device << " could not make an OpenGL 4.3 context without a surface" << std::endl;
+		return false;
+	}
+
+	return true;
+#else
+	(void)device;
+	std::cout << "this build has no EGL, build it with RAYTRACER_EGL and GLEW_EGL for --egl" << std::endl;
+	return false;
+#endif
+}
+
+void destroyEglContext()
+{
+#ifdef RAYTRACER_EGL
+	if (eglDisplay == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	if (eglContext != EGL_NO_CONTEXT)
+		eglDestroyContext(eglDisplay, eglContext);
+
+	eglTerminate(eglDisplay);
+	eglDisplay = EGL_NO_DISPLAY;
+	eglContext = EGL_NO_CONTEXT;
+#endif
+}
@@ -0,0 +1,136 @@
+/*
+Title: Basic Ray Tracer
+File Name: Platform.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+What the program needs of the operating system, for Windows and for
+Linux: the clock, folders, starting copies of itself (--gpus and the
+workers of --farm), the pipes to ffmpeg, and the shared memory that the
+frames of --shm-encoder go through, and the NUMA nodes that the threads
+of --numa are kept on, and the large pages of CpuArena.h. main.cpp only calls these,
+and not windows.h, so it builds on both.
+
+And the context of a render node without a display server: --egl makes
+an OpenGL context with EGL on a GPU device (EGL_EXT_platform_device),
+without a window or a surface, which renders into the framebuffers of
+--headless. Nothing of GLFW is used then, not even glfwInit, which needs
+a display on Linux. It is only built with RAYTRACER_EGL (and GLEW_EGL,
+so that glewInit finds the functions with EGL), because the Windows build
+has no EGL to link.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// A program that startProcess started
+struct ChildProcess
+{
+#ifdef _WIN32
+	void* process = nullptr;
+	void* thread = nullptr;
+#else
+	int pid = 0;
+#endif
+};
+
+// Memory that another process can map too, by its name. On Windows, it is a named file mapping, and on Linux,
+// a memfd, whose name is its path in /proc, which the copies of this program that this one starts can open
+struct SharedMemory
+{
+	void* data = nullptr;
+	size_t size = 0;
+	std::string name;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+// Seconds since the program started, which every time of the frames and the animation is measured with
+double platformTime();
+
+// Make a folder, if it is not there yet
+void makeFolder(const std::string& folder);
+
+// Make the file to the same file as from, with a hard link, or a copy where the file system has no hard links.
+// A file that is already called to is replaced. Returns false if neither worked
+bool linkFile(const std::string& from, const std::string& to);
+
+// The path of this program, to start copies of it
+std::string programPath();
+
+// The number of this process, which is different for every copy of the program on this computer
+int processId();
+
+// The name of this computer
+std::string computerName();
+
+// Start a command line, with the program first, and the options that have spaces in quotes
+bool startProcess(const std::string& commandLine, ChildProcess& child);
+
+// Wait for the program to end, or for milliseconds, if it is not negative. Returns false if it has not ended yet.
+// When it has ended, exitCode is its exit code, and the child is done with
+bool waitProcess(ChildProcess& child, int milliseconds, int& exitCode);
+
+// A pipe to or from a command, in binary, so that Windows does not change the bytes of the frames
+FILE* openPipe(const std::string& command, bool write);
+
+// Close the pipe, and wait for the command to end
+void closePipe(FILE* pipe);
+
+// Run a command with everything that it prints thrown away (into NUL on Windows, and /dev/null on Linux),
+// and wait for it. Returns true if it ended with exit code 0
+bool runQuietCommand(const std::string& command);
+
+// The standard input, in binary, for the bytes that a pipe sends into this program
+FILE* binaryStandardInput();
+
+// Make shared memory of size bytes, filled with zeros, and map it. Returns false if it could not be made
+bool createSharedMemory(size_t size, SharedMemory& memory);
+
+// Map all of the shared memory that another process made, by its name. Returns false if it is not there
+bool openSharedMemory(const std::string& name, SharedMemory& memory);
+
+// Unmap the memory. It is gone once every process that had it has closed it
+void closeSharedMemory(SharedMemory& memory);
+
+// How many NUMA nodes this computer has (the sockets of a server with more than one), 1 if the OS does not say
+int numaNodeCount();
+
+// Keep the calling thread on the processors of NUMA node node, so that the memory it touches first is on that node too.
+// Returns false if there is no such node, or the OS did not let it
+bool pinThreadToNumaNode(int node);
+
+// Reserve and commit bytes of memory in large pages (2 MB, or 1 GB with huge where the OS has set them aside), which
+// bytes is rounded up to. large is false if the OS only gave normal pages. Returns nullptr if it gave nothing
+void* allocateLargePages(size_t& bytes, bool huge, bool& large);
+
+// Give memory of allocateLargePages back to the OS
+void freeLargePages(void* memory, size_t bytes);
+
+// Make the context of --egl on GPU device, and make it current. Returns false, and says why,
+// if this build has no EGL, or the device has no OpenGL context
+bool makeEglContext(int device);
+
+void destroyEglContext();
@@ -0,0 +1,205 @@
+/*
+Title: Advanced Ray Tracer
+File Name: Profiler.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One zone: what it was, and when it started and ended, in microseconds
+struct ProfileEvent
+{
+	const char* name;
+	double start;
+	double duration;
+};
+
+// The zones of one thread. Only that thread writes to it, so it needs no lock.
+// next counts every zone that was ever written, so next % PROFILE_RING_SIZE is where the next one goes
+struct ProfileRing
+{
+	int thread;
+	std::string name;
+	std::vector<ProfileEvent> events;
+	size_t next;
+};
+
+// Every ring that was made. A ring is owned here, and not by its thread,
+// so it is still here after the thread has finished (like the encoder threads)
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+
+// The ring of this thread, which is made the first time the thread records a zone
+static thread_local ProfileRing* threadRing = nullptr;
+
+static std::atomic<bool> profiling(false);
+static std::chrono::steady_clock::time_point profileStart;
+
+static ProfileRing* makeRing(int thread)
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+
+	ProfileRing* ring = new ProfileRing();
+	ring->thread = thread >= 0 ? thread : (int)rings.size();
+	ring->events.resize(PROFILE_RING_SIZE);
+	ring->next = 0;
+	rings.emplace_back(ring);
+	return ring;
+}
+
+static ProfileRing* getThreadRing()
+{
+	if (!threadRing)
+		threadRing = makeRing(-1);
+
+	return threadRing;
+}
+
+static void addEvent(ProfileRing* ring, const char* name, double start, double duration)
+{
+	ring->events[ring->next % PROFILE_RING_SIZE] = { name, start, duration };
+	ring->next++;
+}
+
+void startProfiling()
+{
+	profileStart = std::chrono::steady_clock::now();
+	profiling = true;
+}
+
+bool isProfiling()
+{
+	return profiling;
+}
+
+double profileNow()
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - profileStart).count();
+}
+
+void addProfileEvent(const char* name, int thread, double startUs, double durationUs)
+{
+	if (!profiling)
+		return;
+
+	// Only the thread that adds GPU events writes into the GPU row, so it needs no lock either
+	static ProfileRing* gpuRing = nullptr;
+
+	if (thread == PROFILE_GPU_THREAD)
+	{
+		if (!gpuRing)
+		{
+			gpuRing = makeRing(PROFILE_GPU_THREAD);
+			gpuRing->name = "GPU";
+		}
+
+		addEvent(gpuRing, name, startUs, durationUs);
+		return;
+	}
+
+	addEvent(getThreadRing(), name, startUs, durationUs);
+}
+
+void nameProfileThread(const char* name)
+{
+	getThreadRing()->name = name;
+}
+
+#ifdef CPU_PROFILING
+
+ProfileZone::ProfileZone(const char* zoneName)
+{
+	name = zoneName;
+	start = profiling ? profileNow() : -1.0;
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (start >= 0.0 && profiling)
+		addEvent(getThreadRing(), name, start, profileNow() - start);
+}
+
+#endif
+
+// Names can only be string literals, but a quote or a backslash would still break the JSON
+static void writeJSONString(FILE* file, const char* s)
+{
+	fputc('"', file);
+
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fputc('\\', file);
+
+		fputc(*s, file);
+	}
+
+	fputc('"', file);
+}
+
+bool writeProfileTrace(const char* fileName)
+{
+	profiling = false;
+
+	FILE* file = fopen(fileName, "w");
+
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(ringsMutex);
+
+	fprintf(file, "{\"traceEvents\": [\n");
+	bool first = true;
+
+	for (const std::unique_ptr<ProfileRing>& ring : rings)
+	{
+		// The name of the row ("M" is a metadata event)
+		std::string name = ring->name.empty() ? "thread " + std::to_string(ring->thread) : ring->name;
+		fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": ", first ? "" : ",\n", ring->thread);
+		writeJSONString(file, name.c_str());
+		fprintf(file, "}}");
+		first = false;
+
+		// the oldest zone that is still in the ring comes first
+		size_t count = ring->next < PROFILE_RING_SIZE ? ring->next : PROFILE_RING_SIZE;
+
+		for (size_t i = ring->next - count; i < ring->next; i++)
+		{
+			const ProfileEvent& e = ring->events[i % PROFILE_RING_SIZE];
+
+			// "X" is a complete event, with a start and a duration
+			fprintf(file, ",\n{\"name\": ");
+			writeJSONString(file, e.name);
+			fprintf(file, ", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", ring->thread, e.start, e.duration);
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
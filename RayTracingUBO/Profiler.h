@@ -0,0 +1,88 @@
+/*
+Title: Advanced Ray Tracer
+File Name: Profiler.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Small CPU profiling zones, for --cpu-trace in main.cpp. PROFILE_ZONE("name")
+at the start of a block times that block, from there to the end of the block.
+Every thread writes its zones into its own ring buffer, so the threads never
+wait for each other, and a thread that makes more zones than fit in its ring
+only keeps the newest ones. writeProfileTrace saves every ring as a Chrome
+trace_event JSON file, which chrome://tracing or https://ui.perfetto.dev can open.
+The GPU has no thread, but its passes can be added with addProfileEvent, and
+they show up as one more row in the trace.
+
+Without CPU_PROFILING, PROFILE_ZONE is nothing at all, so the zones cost nothing.
+With it, a zone that is not recorded (profiling was not started) only checks a bool.
+*/
+
+#pragma once
+
+// Comment this out to compile every zone out of the program
+#define CPU_PROFILING
+
+// How many zones every thread keeps
+#define PROFILE_RING_SIZE 65536
+
+// The row of the trace that addProfileEvent puts the GPU passes in
+#define PROFILE_GPU_THREAD 1000
+
+// Start recording zones. Zones before this are not recorded
+void startProfiling();
+
+// True between startProfiling and writeProfileTrace
+bool isProfiling();
+
+// Microseconds since startProfiling, which is the time in the trace
+double profileNow();
+
+// Record a zone that was timed some other way (like the GPU timestamps), on any thread row
+void addProfileEvent(const char* name, int thread, double startUs, double durationUs);
+
+// Name the row of the thread that calls this (like "encoder 2"), instead of its number
+void nameProfileThread(const char* name);
+
+// Write all of the zones to a trace file, and stop recording. The threads that record zones
+// should be done by then. Returns false if the file could not be written
+bool writeProfileTrace(const char* fileName);
+
+#ifdef CPU_PROFILING
+
+// Times the block that it is in. The name must be a string that lives forever, like a string literal,
+// because only the pointer is saved
+struct ProfileZone
+{
+	const char* name;
+	double start;
+
+	ProfileZone(const char* zoneName);
+	~ProfileZone();
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+
+#endif
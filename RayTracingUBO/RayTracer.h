@@ -0,0 +1,91 @@
+/*
+Title: Basic Ray Tracer
+File Name: RayTracer.h
+Copyright  2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The renderer as a library, for tools that render frames in their own
+process (a pipeline in Python, through raytracer.py, or a program in C or
+C++) instead of starting the program and reading the frames from disk.
+The Library configuration of the project builds the same sources as a DLL
+with RAYTRACER_LIBRARY, which leaves out main and exports these functions.
+
+The options of rtStart are the ones of the command line, so everything
+that the program can render, the library can. It is always headless, and
+its frames are not saved or streamed: every frame goes to the callback of
+rtSetFrameCallback instead. The pixels are BGR, with the bottom row first,
+outputWidth x outputHeight of them, like the raw frames. With the async
+readback (the default), they are the readback buffer itself, mapped, so
+nothing copies them on the way, and they are only valid until the callback
+returns. rtRenderFrame calls the callback before it returns.
+
+The renderer is the globals of main.cpp, so there is one in a process, and
+it is started once: rtStop is for the end of the process. The functions
+are called from the thread of rtStart, which has the OpenGL context.
+*/
+
+#pragma once
+
+#if defined(_WIN32) && defined(RAYTRACER_LIBRARY)
+#define RAYTRACER_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define RAYTRACER_API __declspec(dllimport)
+#else
+#define RAYTRACER_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called with the pixels of every frame that is rendered, and the user pointer of rtSetFrameCallback
+typedef void (*RtFrameCallback)(const unsigned char* pixels, int width, int height, int frame, void* user);
+
+// Start the renderer with options like the ones of the command line ("--output-size 640x360 --scene shot.json").
+// Returns 0 if an option is wrong, or there is no OpenGL context
+RAYTRACER_API int rtStart(const char* options);
+
+// Change options between frames, like a job of --serve can (--scene, --frames). Returns 0 for the others
+RAYTRACER_API int rtSetOptions(const char* options);
+
+// Before rtStart, the scene file that is loaded. After it, the file is read again, and the camera, the lights
+// and the places of the instances change from the next frame on, as when the file of --scene is changed
+RAYTRACER_API int rtLoadScene(const char* fileName);
+
+// The camera of the next frames, as 3 floats each, and the vertical field of view in degrees
+RAYTRACER_API void rtSetCamera(const float* position, const float* target, const float* up, float fov);
+
+// The function that gets the frames, or null to render them for nothing
+RAYTRACER_API void rtSetFrameCallback(RtFrameCallback callback, void* user);
+
+// Render frame (1 to the last frame of the animation, which sets the time) and hand it to the callback.
+// Returns 0 if there is no such frame
+RAYTRACER_API int rtRenderFrame(int frame);
+
+// The size of the pixels of the callback
+RAYTRACER_API int rtFrameWidth(void);
+RAYTRACER_API int rtFrameHeight(void);
+
+// Delete everything on the GPU, and stop the jobs
+RAYTRACER_API void rtStop(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,405 @@
+/*
+Title: Basic Ray Tracer
+File Name: RemotePreview.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RemotePreview.h"
+
+#include "Sockets.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "FreeImage.h"
+
+#include "Profiler.h"
+
+static SOCKET listenSocket = INVALID_SOCKET;
+static std::thread acceptThread;
+static std::thread encodeThread;
+static std::atomic<bool> running(false);
+static int jpegQuality = 80;
+
+// The newest frame, before and after it is encoded. Every frame has the next number,
+// and a connection that sent frame n waits for a JPEG with a number after n
+static std::mutex frameMutex;
+static std::condition_variable frameReady;
+static std::vector<unsigned char> framePixels;
+static int frameWidth = 0;
+static int frameHeight = 0;
+static int frameNumber = 0;
+static std::vector<unsigned char> jpeg;
+static int jpegNumber = 0;
+
+// The connections that are still open, so that stopRemotePreview can close them, and wait for their threads
+static std::mutex connectionMutex;
+static std::condition_variable connectionClosed;
+static std::vector<SOCKET> connections;
+static int connectionThreads = 0;
+
+static std::mutex inputMutex;
+static RemoteInput pendingInput;
+static bool hasInput = false;
+
+// The page that a browser gets. The keys go to /key, the arrow keys turn the camera, and + and - zoom
+static const char* previewPage =
+	"<!DOCTYPE html><html><head><title>Ray Tracer</title></head>"
+	"<body style=\"margin:0;background:#000\">"
+	"<img src=\"/stream\" style=\"width:100vw;height:100vh;object-fit:contain\">"
+	"<script>"
+	"document.onkeydown = function(e) {"
+	"  var turn = { ArrowLeft: '-5,0', ArrowRight: '5,0', ArrowUp: '0,5', ArrowDown: '0,-5' }[e.key];"
+	"  if (turn) fetch('/orbit?' + turn);"
+	"  else if (e.key == '+' || e.key == '=') fetch('/zoom?0.9');"
+	"  else if (e.key == '-') fetch('/zoom?1.1');"
+	"  else if (e.key.length == 1) fetch('/key?' + e.key.toUpperCase());"
+	"};"
+	"</script></body></html>";
+
+static bool sendAll(SOCKET s, const char* data, int size)
+{
+	while (size > 0)
+	{
+		int sent = send(s, data, size, 0);
+
+		if (sent <= 0)
+			return false;
+
+		data += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+static bool sendText(SOCKET s, const std::string& text)
+{
+	return sendAll(s, text.data(), (int)text.size());
+}
+
+// Encode every new frame into jpeg, on a thread of its own
+static void encodeFrames()
+{
+	nameProfileThread("remote preview");
+
+	std::vector<unsigned char> pixels;
+	int width = 0, height = 0, number = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(frameMutex);
+			frameReady.wait(lock, [&] { return !running || frameNumber != number; });
+
+			if (!running)
+				return;
+
+			// the pixels are swapped out, so the render can copy the next frame in while this one is encoded
+			pixels.swap(framePixels);
+			width = frameWidth;
+			height = frameHeight;
+			number = frameNumber;
+		}
+
+		PROFILE_ZONE("encode JPEG");
+
+		FIBITMAP* image = FreeImage_Allocate(width, height, 24, 0xFF0000, 0x00FF00, 0x0000FF);
+
+		// FreeImage keeps the bottom row first too, but its rows can be padded
+		for (int y = 0; y < height; y++)
+			memcpy(FreeImage_GetScanLine(image, y), pixels.data() + (size_t)3 * width * y, (size_t)3 * width);
+
+		FIMEMORY* memory = FreeImage_OpenMemory();
+		FreeImage_SaveToMemory(FIF_JPEG, image, memory, jpegQuality);
+
+		BYTE* bytes = nullptr;
+		DWORD size = 0;
+		FreeImage_AcquireMemory(memory, &bytes, &size);
+
+		{
+			std::lock_guard<std::mutex> lock(frameMutex);
+			jpeg.assign(bytes, bytes + size);
+			jpegNumber = number;
+		}
+
+		frameReady.notify_all();
+
+		FreeImage_CloseMemory(memory);
+		FreeImage_Unload(image);
+	}
+}
+
+// Send the JPEGs to a browser, one after the other, until it goes away
+static void streamFrames(SOCKET s)
+{
+	if (!sendText(s, "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=frame\r\nCache-Control: no-cache\r\n\r\n"))
+		return;
+
+	// no waiting for more bytes to fill a packet, a frame goes out as soon as it is written
+	int noDelay = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+	int sent = 0;
+	std::vector<unsigned char> frame;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(frameMutex);
+			frameReady.wait(lock, [&] { return !running || (jpegNumber != sent && !jpeg.empty()); });
+
+			if (!running)
+				return;
+
+			frame = jpeg;
+			sent = jpegNumber;
+		}
+
+		std::string header = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: " + std::to_string(frame.size()) + "\r\n\r\n";
+
+		if (!sendText(s, header) || !sendAll(s, (const char*)frame.data(), (int)frame.size()) || !sendText(s, "\r\n"))
+			return;
+	}
+}
+
+// Remember what a request for /key, /orbit, /zoom, or /camera asks for
+static void addInput(const std::string& path, const std::string& query)
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+
+	if (path == "/key" && !query.empty())
+	{
+		// the keys of the page are letters and digits, which are their own GLFW key codes
+		pendingInput.keys.push_back((unsigned char)query[0]);
+	}
+	else if (path == "/orbit")
+	{
+		float yaw = 0.0f, pitch = 0.0f;
+		sscanf(query.c_str(), "%f,%f", &yaw, &pitch);
+		pendingInput.yaw += yaw;
+		pendingInput.pitch += pitch;
+	}
+	else if (path == "/zoom")
+	{
+		float zoom = 1.0f;
+		sscanf(query.c_str(), "%f", &zoom);
+
+		if (zoom > 0.0f)
+			pendingInput.zoom *= zoom;
+	}
+	else if (path == "/camera")
+	{
+		glm::vec3 p, t;
+
+		if (sscanf(query.c_str(), "%f,%f,%f,%f,%f,%f", &p.x, &p.y, &p.z, &t.x, &t.y, &t.z) != 6)
+			return;
+
+		// a new place for the camera replaces the turns before it
+		pendingInput.hasCamera = true;
+		pendingInput.position = p;
+		pendingInput.target = t;
+		pendingInput.yaw = 0.0f;
+		pendingInput.pitch = 0.0f;
+		pendingInput.zoom = 1.0f;
+	}
+	else
+		return;
+
+	hasInput = true;
+}
+
+// Answer one request of a browser, and close the connection, unless it is the stream, which stays open
+static void serveConnection(SOCKET s)
+{
+	char request[2048];
+	int length = recv(s, request, sizeof(request) - 1, 0);
+
+	if (length > 0)
+	{
+		request[length] = 0;
+
+		// "GET /path?query HTTP/1.1", the rest of the request does not matter
+		char target[1024] = "";
+		sscanf(request, "GET %1023s", target);
+
+		std::string path = target;
+		std::string query;
+		size_t mark = path.find('?');
+
+		if (mark != std::string::npos)
+		{
+			query = path.substr(mark + 1);
+			path = path.substr(0, mark);
+		}
+
+		if (path == "/stream")
+			streamFrames(s);
+		else if (path == "/")
+		{
+			std::string page = previewPage;
+			sendText(s, "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " + std::to_string(page.size()) + "\r\n\r\n" + page);
+		}
+		else
+		{
+			addInput(path, query);
+			sendText(s, "HTTP/1.1 204 No Content\r\nAccess-Control-Allow-Origin: *\r\n\r\n");
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(connectionMutex);
+
+	// stopRemotePreview closes the ones that are still in the list
+	for (size_t i = 0; i < connections.size(); i++)
+	{
+		if (connections[i] == s)
+		{
+			connections.erase(connections.begin() + i);
+			closesocket(s);
+			break;
+		}
+	}
+
+	connectionThreads--;
+	connectionClosed.notify_all();
+}
+
+static void acceptConnections()
+{
+	nameProfileThread("remote preview server");
+
+	while (running)
+	{
+		SOCKET s = accept(listenSocket, nullptr, nullptr);
+
+		if (s == INVALID_SOCKET)
+			continue;
+
+		// Every request of a key is a connection of its own, so the threads are not kept
+		// to be joined, only counted, and stopRemotePreview waits until there are none
+		std::lock_guard<std::mutex> lock(connectionMutex);
+		connections.push_back(s);
+		connectionThreads++;
+		std::thread(serveConnection, s).detach();
+	}
+}
+
+bool startRemotePreview(int port, int quality)
+{
+	WSADATA data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+	{
+		std::cout << "could not start Winsock for --remote-preview" << std::endl;
+		return false;
+	}
+
+	listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((u_short)port);
+
+	if (listenSocket == INVALID_SOCKET || bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, SOMAXCONN) != 0)
+	{
+		std::cout << "could not listen on port " << port << " for --remote-preview" << std::endl;
+
+		if (listenSocket != INVALID_SOCKET)
+			closesocket(listenSocket);
+
+		listenSocket = INVALID_SOCKET;
+		WSACleanup();
+		return false;
+	}
+
+	jpegQuality = std::max(1, std::min(quality, 100));
+	running = true;
+	acceptThread = std::thread(acceptConnections);
+	encodeThread = std::thread(encodeFrames);
+
+	std::cout << "the frames are on http://localhost:" << port << "/ (or the name of this computer)" << std::endl;
+	return true;
+}
+
+void sendRemotePreviewFrame(const unsigned char* pixels, int width, int height)
+{
+	if (!running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(frameMutex);
+
+		// a frame that was not taken by the encoder yet is replaced
+		framePixels.assign(pixels, pixels + (size_t)3 * width * height);
+		frameWidth = width;
+		frameHeight = height;
+		frameNumber++;
+	}
+
+	frameReady.notify_all();
+}
+
+bool takeRemoteInput(RemoteInput& input)
+{
+	std::lock_guard<std::mutex> lock(inputMutex);
+
+	if (!hasInput)
+		return false;
+
+	input = pendingInput;
+	pendingInput = RemoteInput();
+	hasInput = false;
+	return true;
+}
+
+void stopRemotePreview()
+{
+	if (!running)
+		return;
+
+	running = false;
+	frameReady.notify_all();
+
+	// closing the socket makes accept return, and closing the connections makes their send and recv return
+	closesocket(listenSocket);
+	listenSocket = INVALID_SOCKET;
+	acceptThread.join();
+	encodeThread.join();
+
+	{
+		std::unique_lock<std::mutex> lock(connectionMutex);
+
+		for (SOCKET s : connections)
+			closesocket(s);
+
+		connections.clear();
+		connectionClosed.wait(lock, [] { return connectionThreads == 0; });
+	}
+
+	WSACleanup();
+}
@@ -0,0 +1,76 @@
+/*
+Title: Basic Ray Tracer
+File Name: RemotePreview.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Shows the frames on another computer, for --remote-preview <port>, while
+the GPU that renders them sits somewhere else. This is a small web server
+on the port: a browser that opens http://<computer>:<port>/ gets a page
+with the frames, which come as a stream of JPEGs (multipart MJPEG, which
+every browser shows in an img tag), and what is typed on that page comes
+back to the same server:
+
+  /stream               the frames, one JPEG after the other
+  /key?<k>              a key, like the keys of the window (1, 2, 3, P)
+  /orbit?<yaw>,<pitch>  turn the camera around its target, in degrees
+  /zoom?<factor>        move the camera closer to its target (< 1) or away
+  /camera?<x>,<y>,<z>,<tx>,<ty>,<tz>  put the camera at x y z, looking at tx ty tz
+
+A frame is encoded once, by a thread of its own, no matter how many
+browsers watch it. Only the newest frame is kept: a frame that comes
+before the one before it was encoded is dropped, and a browser that is
+slow gets the newest one when it is ready for another, so the frames
+never queue up behind a slow encoder or network, which would add to the
+latency. The render only copies the pixels, it never waits for a browser.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// What the browsers sent since it was last taken: keys (GLFW key codes), how much
+// to turn and zoom the camera, and where to put it, if hasCamera is true
+struct RemoteInput
+{
+	std::vector<int> keys;
+	float yaw = 0.0f;
+	float pitch = 0.0f;
+	float zoom = 1.0f;
+	bool hasCamera = false;
+	glm::vec3 position;
+	glm::vec3 target;
+};
+
+// Start the server on the port, with JPEGs of this quality (1 to 100).
+// Returns false, and says why, if it cannot listen on the port
+bool startRemotePreview(int port, int quality);
+
+// Hand a frame to the encoder: width x height pixels, 3 bytes each, blue, green, and red,
+// with the bottom row first, like saveFrame in main.cpp. The pixels are copied
+void sendRemotePreviewFrame(const unsigned char* pixels, int width, int height);
+
+// Take what the browsers sent since the last time. Returns false if they sent nothing
+bool takeRemoteInput(RemoteInput& input);
+
+// Close every connection, and stop the threads
+void stopRemotePreview();
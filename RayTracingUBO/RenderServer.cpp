@@ -0,0 +1,376 @@
+/*
+Title: Basic Ray Tracer
+File Name: RenderServer.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RenderServer.h"
+
+#include "Metrics.h"
+#include "Sockets.h"
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+static SOCKET serverSocket = INVALID_SOCKET;
+static std::thread acceptThread;
+
+// The jobs that came and were not taken yet, and the connections of every job that is not finished, by its number
+static std::mutex jobMutex;
+static std::condition_variable jobCame;
+static std::deque<std::pair<int, std::string>> newJobs;
+static std::map<int, SOCKET> jobSockets;
+static int lastJob = 0;
+static bool stopping = false;
+
+// The socket of --metrics-port, and the text that the render thread published last
+static SOCKET metricsSocket = INVALID_SOCKET;
+static std::thread metricsThread;
+static std::mutex metricsMutex;
+static std::string metricsText;
+
+// Send all of text, which send does not have to do at once
+static bool sendAll(SOCKET s, const std::string& text)
+{
+	size_t done = 0;
+
+	while (done < text.size())
+	{
+		int sent = send(s, text.data() + done, (int)(text.size() - done), 0);
+
+		if (sent <= 0)
+			return false;
+
+		done += sent;
+	}
+
+	return true;
+}
+
+// Read one line, without its \n (or \r\n). Returns false if the connection closed before the end of it
+static bool readLine(SOCKET s, std::string& line)
+{
+	line.clear();
+	char c;
+
+	while (recv(s, &c, 1, 0) == 1)
+	{
+		if (c == '\n')
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			return true;
+		}
+
+		line += c;
+	}
+
+	return !line.empty();
+}
+
+// The address of port on this computer
+static sockaddr_in localAddress(int port)
+{
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((u_short)port);
+	return address;
+}
+
+// Take the connections of the jobs, and read their options, until the socket is closed. The line of a job
+// is read here, which is quick for a client on this computer that sends it as soon as it connects
+static void acceptJobs()
+{
+	while (true)
+	{
+		SOCKET s = accept(serverSocket, nullptr, nullptr);
+
+		if (s == INVALID_SOCKET)
+			break;
+
+		// a client that went away before it sent a whole line sent no job
+		std::string options;
+
+		if (!readLine(s, options))
+		{
+			closesocket(s);
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			lastJob++;
+			jobSockets[lastJob] = s;
+			newJobs.push_back(std::make_pair(lastJob, options));
+		}
+
+		jobCame.notify_all();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+
+	jobCame.notify_all();
+}
+
+bool startRenderServer(int port)
+{
+	WSADATA data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+	{
+		std::cout << "could not start Winsock for --serve" << std::endl;
+		return false;
+	}
+
+	sockaddr_in address = localAddress(port);
+	serverSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (serverSocket == INVALID_SOCKET || bind(serverSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(serverSocket, SOMAXCONN) != 0)
+	{
+		std::cout << "could not listen on port " << port << " for --serve" << std::endl;
+
+		if (serverSocket != INVALID_SOCKET)
+			closesocket(serverSocket);
+
+		serverSocket = INVALID_SOCKET;
+		WSACleanup();
+		return false;
+	}
+
+	stopping = false;
+	acceptThread = std::thread(acceptJobs);
+
+	std::cout << "waiting for jobs on port " << port << std::endl;
+	return true;
+}
+
+bool takeRenderJob(int& job, std::string& options, bool wait)
+{
+	std::unique_lock<std::mutex> lock(jobMutex);
+
+	if (wait)
+		jobCame.wait(lock, [] { return stopping || !newJobs.empty(); });
+
+	if (newJobs.empty())
+		return false;
+
+	job = newJobs.front().first;
+	options = newJobs.front().second;
+	newJobs.pop_front();
+	return true;
+}
+
+void sendRenderJobLine(int job, const std::string& line)
+{
+	std::lock_guard<std::mutex> lock(jobMutex);
+	auto found = jobSockets.find(job);
+
+	if (found != jobSockets.end())
+		sendAll(found->second, line + "\n");
+}
+
+void finishRenderJob(int job, bool succeeded)
+{
+	std::lock_guard<std::mutex> lock(jobMutex);
+	auto found = jobSockets.find(job);
+
+	if (found == jobSockets.end())
+		return;
+
+	sendAll(found->second, succeeded ? "done\n" : "failed\n");
+	closesocket(found->second);
+	jobSockets.erase(found);
+}
+
+void stopRenderServer()
+{
+	if (serverSocket == INVALID_SOCKET)
+		return;
+
+	// closing the socket makes accept return
+	closesocket(serverSocket);
+	serverSocket = INVALID_SOCKET;
+	acceptThread.join();
+
+	// the jobs that were never taken, or never finished, are not rendered
+	std::lock_guard<std::mutex> lock(jobMutex);
+
+	for (auto& job : jobSockets)
+	{
+		sendAll(job.second, "failed\n");
+		closesocket(job.second);
+	}
+
+	jobSockets.clear();
+	newJobs.clear();
+	WSACleanup();
+}
+
+// Answer the scrapes, until the socket is closed. A scrape is one small answer, so it is answered on this thread
+static void serveMetrics()
+{
+	while (true)
+	{
+		SOCKET s = accept(metricsSocket, nullptr, nullptr);
+
+		if (s == INVALID_SOCKET)
+			break;
+
+		char request[2048];
+		int length = recv(s, request, sizeof(request) - 1, 0);
+
+		if (length > 0)
+		{
+			request[length] = 0;
+
+			// "GET /path HTTP/1.1", the rest of the request does not matter
+			char target[1024] = "";
+			sscanf(request, "GET %1023s", target);
+
+			if (std::string(target) == "/metrics")
+			{
+				std::string body;
+
+				{
+					std::lock_guard<std::mutex> lock(metricsMutex);
+					body = metricsText;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(jobMutex);
+					writeMetricHeader(body, "raytracer_jobs_waiting", "gauge", "Jobs that came and were not taken yet");
+					writeMetric(body, "raytracer_jobs_waiting", "", (double)newJobs.size());
+					writeMetricHeader(body, "raytracer_jobs_open", "gauge", "Jobs that were taken and are not finished");
+					// jobSockets has the waiting jobs too, from when they come
+					writeMetric(body, "raytracer_jobs_open", "", (double)(jobSockets.size() - newJobs.size()));
+				}
+
+				sendAll(s, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+					std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+			}
+			else
+			{
+				sendAll(s, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+			}
+		}
+
+		closesocket(s);
+	}
+}
+
+bool startMetricsServer(int port)
+{
+	WSADATA data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+	{
+		std::cout << "could not start Winsock for --metrics-port" << std::endl;
+		return false;
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((u_short)port);
+	metricsSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (metricsSocket == INVALID_SOCKET || bind(metricsSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(metricsSocket, SOMAXCONN) != 0)
+	{
+		std::cout << "could not listen on port " << port << " for --metrics-port" << std::endl;
+
+		if (metricsSocket != INVALID_SOCKET)
+			closesocket(metricsSocket);
+
+		metricsSocket = INVALID_SOCKET;
+		WSACleanup();
+		return false;
+	}
+
+	metricsThread = std::thread(serveMetrics);
+
+	std::cout << "the metrics are on http://localhost:" << port << "/metrics (or the name of this computer)" << std::endl;
+	return true;
+}
+
+void publishRenderMetrics(const std::string& text)
+{
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	metricsText = text;
+}
+
+void stopMetricsServer()
+{
+	if (metricsSocket == INVALID_SOCKET)
+		return;
+
+	// closing the socket makes accept return
+	closesocket(metricsSocket);
+	metricsSocket = INVALID_SOCKET;
+	metricsThread.join();
+	WSACleanup();
+}
+
+bool submitRenderJob(int port, const std::string& options)
+{
+	WSADATA data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		return false;
+
+	sockaddr_in address = localAddress(port);
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	bool done = false;
+
+	if (s == INVALID_SOCKET || connect(s, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		std::cout << "there is no server of --serve on port " << port << std::endl;
+	}
+	else if (sendAll(s, options + "\n"))
+	{
+		// the server can be busy with other jobs, so the first line can take a while
+		std::string line;
+
+		while (readLine(s, line))
+		{
+			if (line == "done" || line == "failed")
+			{
+				done = line == "done";
+				break;
+			}
+
+			std::cout << line << std::endl;
+		}
+	}
+
+	if (s != INVALID_SOCKET)
+		closesocket(s);
+
+	WSACleanup();
+	return done;
+}
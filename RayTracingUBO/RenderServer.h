@@ -0,0 +1,81 @@
+/*
+Title: Basic Ray Tracer
+File Name: RenderServer.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The jobs of --serve <port>, which keeps one render running between
+videos: the window and its context, the compiled programs, and the scene
+on the GPU stay there, and a job only renders its frames, so it does not
+pay for starting GLFW and GLEW, compiling the shaders, and loading and
+uploading the scene again. The server only listens on this computer
+(127.0.0.1), and a job is one line of options, the same as the ones of
+the command line:
+
+  --frames 1:100 --frames-folder shot2 --resume
+
+which --submit <port> sends for the options after it. The server sends
+back lines about the job, and then "done" or "failed", and closes the
+connection. A line of "quit" stops the server, once the jobs that came
+before it are done.
+
+The jobs come in on a thread of their own, so a job can come while
+others render, and they all render at the same time, in turns of a few
+frames each (see serveRenderJobs in main.cpp). A preview of a few frames
+is done after a few turns, instead of after every job that came before
+it, and the GPU always has the frames of a job to render, even while
+the frames of another one are being saved or encoded.
+
+With --metrics-port <port>, the server also answers GET /metrics over
+HTTP with the numbers of the render (see Metrics.h), which the render
+thread publishes after every turn, so a scrape never waits for a frame.
+Those are only numbers, so that port listens on every network, for a
+Prometheus server of the farm.
+*/
+
+#pragma once
+
+#include <string>
+
+// Listen for jobs on port, on this computer only. Returns false, and says why, if it cannot
+bool startRenderServer(int port);
+
+// Take the next job that came, with its number and its line of options. With wait, this waits for one,
+// and without, it returns false if none came. It returns false as well if the server is stopped
+bool takeRenderJob(int& job, std::string& options, bool wait);
+
+// Send a line about the job to whoever sent it
+void sendRenderJobLine(int job, const std::string& line);
+
+// Send "done" or "failed", and close the connection of the job
+void finishRenderJob(int job, bool succeeded);
+
+void stopRenderServer();
+
+// Answer GET /metrics on port, from any computer. Returns false, and says why, if it cannot listen
+bool startMetricsServer(int port);
+
+// The text of the metrics that the next scrapes get. The server adds how many jobs are waiting and open
+void publishRenderMetrics(const std::string& text);
+
+void stopMetricsServer();
+
+// Send the options to the server on port, print what it sends back, and return true if the job is done
+bool submitRenderJob(int port, const std::string& options);
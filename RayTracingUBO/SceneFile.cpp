@@ -0,0 +1,250 @@
+/*
+Title: Basic Ray Tracer
+File Name: SceneFile.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SceneFile.h"
+#include "Json.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+// An array of 3 numbers, or fallback if it is not one. A single number is the same on every axis
+static glm::vec3 vec3Or(const JsonValue& value, glm::vec3 fallback)
+{
+	if (value.type == JsonValue::NUMBER)
+		return glm::vec3((float)value.number);
+
+	if (value.type != JsonValue::ARRAY || value.size() != 3)
+		return fallback;
+
+	return glm::vec3((float)value[0].numberOr(fallback.x), (float)value[1].numberOr(fallback.y), (float)value[2].numberOr(fallback.z));
+}
+
+// The place of a model, instance, or key: translate * rotate * scale
+static void readPlace(const JsonValue& value, glm::vec3& position, glm::vec3& axis, float& degrees, glm::vec3& scale)
+{
+	position = vec3Or(value["position"], glm::vec3(0.0f));
+	axis = vec3Or(value["axis"], glm::vec3(0.0f, 1.0f, 0.0f));
+	degrees = (float)value["degrees"].numberOr(0.0);
+	scale = vec3Or(value["scale"], glm::vec3(1.0f));
+
+	if (glm::length(axis) == 0.0f)
+		axis = glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+static glm::mat4 placeMatrix(const JsonValue& value)
+{
+	glm::vec3 position, axis, scale;
+	float degrees;
+	readPlace(value, position, axis, degrees, scale);
+
+	glm::mat4 matrix = glm::translate(glm::mat4(), position);
+	matrix = glm::rotate(matrix, glm::radians(degrees), glm::normalize(axis));
+	return glm::scale(matrix, scale);
+}
+
+// The tracks of "animation", in the order of the file. The keys of a track are put in the order of their times
+static bool readTracks(const std::string& fileName, const JsonValue& tracks, AnimationTracks& animation)
+{
+	for (int t = 0; t < tracks.size(); t++)
+	{
+		const JsonValue& track = tracks[t];
+		int mesh = track["mesh"].intOr(-1);
+
+		if (mesh < 0)
+		{
+			std::cout << fileName << ": track " << t << " of the animation has no mesh" << std::endl;
+			return false;
+		}
+
+		const JsonValue& keys = track["keys"];
+		std::vector<int> order(keys.size());
+		for (int k = 0; k < keys.size(); k++)
+			order[k] = k;
+
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+			return keys[a]["time"].numberOr(0.0) < keys[b]["time"].numberOr(0.0);
+		});
+
+		addAnimationTrack(animation, mesh, (float)track["length"].numberOr(0.0));
+
+		for (int k : order)
+		{
+			const JsonValue& key = keys[k];
+			std::string easingName = key["easing"].type == JsonValue::STRING ? key["easing"].string : easingNames[EASE_LINEAR];
+
+			int easing = -1;
+			for (int e = 0; e < NUM_EASINGS; e++)
+			{
+				if (easingName == easingNames[e])
+					easing = e;
+			}
+
+			if (easing < 0)
+			{
+				std::cout << fileName << ": " << easingName << " is not an easing" << std::endl;
+				return false;
+			}
+
+			glm::vec3 position, axis, scale;
+			float degrees;
+			readPlace(key, position, axis, degrees, scale);
+			addAnimationKey(animation, (float)key["time"].numberOr(0.0), easing, position, axis, degrees, scale);
+		}
+	}
+
+	return true;
+}
+
+bool loadSceneFile(const std::string& fileName, glm::vec3 color, float reflectivity, SceneFile& scene)
+{
+	std::ifstream file(fileName, std::ios::binary);
+
+	if (!file)
+	{
+		std::cout << "could not open " << fileName << std::endl;
+		return false;
+	}
+
+	std::stringstream text;
+	text << file.rdbuf();
+	std::string json = text.str();
+
+	JsonValue root;
+	if (!parseJson(json.data(), json.size(), root) || root.type != JsonValue::OBJECT)
+	{
+		std::cout << fileName << " is not a scene file (it is not a JSON object)" << std::endl;
+		return false;
+	}
+
+	scene = SceneFile();
+
+	// the files it names are next to it
+	std::string folder = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+
+	const JsonValue& camera = root["camera"];
+	if (camera.type == JsonValue::OBJECT)
+	{
+		scene.hasCamera = true;
+		scene.cameraPos = vec3Or(camera["position"], scene.cameraPos);
+		scene.cameraTarget = vec3Or(camera["target"], scene.cameraTarget);
+		scene.cameraUp = vec3Or(camera["up"], scene.cameraUp);
+		scene.cameraFov = (float)camera["fov"].numberOr(scene.cameraFov);
+	}
+
+	const JsonValue& lights = root["lights"];
+	if (lights.type == JsonValue::ARRAY)
+	{
+		scene.hasLights = true;
+
+		for (int i = 0; i < lights.size(); i++)
+		{
+			light L;
+			L.pos = vec3Or(lights[i]["position"], glm::vec3(0.0f));
+			L.color = vec3Or(lights[i]["color"], glm::vec3(1.0f));
+			L.radius = (float)lights[i]["radius"].numberOr(1.0);
+			L.brightness = (float)lights[i]["brightness"].numberOr(1.0);
+			scene.lights.push_back(L);
+		}
+	}
+
+	const JsonValue& models = root["models"];
+	for (int i = 0; i < models.size(); i++)
+	{
+		SceneFileModel model;
+
+		if (models[i]["primitive"].type == JsonValue::STRING)
+		{
+			model.primitive = models[i]["primitive"].string;
+
+			if (model.primitive != "plane" && model.primitive != "box" && model.primitive != "sphere")
+			{
+				std::cout << fileName << ": model " << i << " is a " << model.primitive << ", which is not plane, box, or sphere" << std::endl;
+				return false;
+			}
+		}
+		else if (models[i]["file"].type != JsonValue::STRING)
+		{
+			std::cout << fileName << ": model " << i << " has no file" << std::endl;
+			return false;
+		}
+		else
+			model.file = folder + models[i]["file"].string;
+
+		model.color = vec3Or(models[i]["color"], color);
+		model.reflectivity = (float)models[i]["reflectivity"].numberOr(reflectivity);
+		model.matrix = placeMatrix(models[i]);
+		scene.models.push_back(model);
+	}
+
+	const JsonValue& gltf = root["gltf"];
+	for (int i = 0; i < gltf.size(); i++)
+	{
+		if (gltf[i].type == JsonValue::STRING)
+			scene.gltfFiles.push_back(folder + gltf[i].string);
+	}
+
+	const JsonValue& instances = root["instances"];
+	for (int i = 0; i < instances.size(); i++)
+	{
+		const JsonValue& value = instances[i];
+
+		SceneFileInstance instance;
+		instance.mesh = value["mesh"].intOr(-1);
+		instance.matrix = placeMatrix(value);
+		instance.ownMaterial = value.has("color") || value.has("reflectivity");
+		instance.color = vec3Or(value["color"], glm::vec3(1.0f));
+		instance.reflectivity = (float)value["reflectivity"].numberOr(0.0);
+		instance.grid = value["grid"].boolOr(false);
+
+		if (instance.mesh < 0)
+		{
+			std::cout << fileName << ": instance " << i << " has no mesh" << std::endl;
+			return false;
+		}
+
+		scene.instances.push_back(instance);
+	}
+
+	// the tracks are in the file, or in a file of their own
+	const JsonValue& animation = root["animation"];
+	if (animation.type == JsonValue::STRING)
+	{
+		scene.hasAnimation = true;
+
+		if (!loadAnimation(folder + animation.string, scene.animation))
+			return false;
+	}
+	else if (animation.type == JsonValue::ARRAY)
+	{
+		scene.hasAnimation = true;
+
+		if (!readTracks(fileName, animation, scene.animation))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,115 @@
+/*
+Title: Basic Ray Tracer
+File Name: SceneFile.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Reads the scene file of --scene <file>, which describes a scene in JSON
+(see Json.h) instead of in the code of main.cpp, so that a light or a
+path of the camera can change without building the program again:
+
+{
+  "camera": { "position": [0, 8, 8], "target": [0, 0.5, 0], "up": [0, 1, 0], "fov": 45 },
+  "lights": [ { "position": [0, 4, 2], "color": [1, 1, 1], "radius": 7, "brightness": 1 } ],
+  "models": [ { "file": "bunny.obj", "color": [1, 1, 1], "reflectivity": 0.3,
+                "position": [0, 0, 0], "axis": [0, 1, 0], "degrees": 0, "scale": 1 } ],
+  "gltf": [ "city.glb" ],
+  "instances": [ { "mesh": 2, "position": [3, 0, 0], "color": [0, 1, 0], "reflectivity": 0.5 } ],
+  "animation": [ { "mesh": 1, "length": 4, "keys": [
+                   { "time": 0, "easing": "smooth", "position": [0, 1, 0] },
+                   { "time": 2, "position": [0, 2, 0], "axis": [0, 1, 0], "degrees": 180 } ] } ]
+}
+
+Every part can be left out, and then the scene has what the tutorial
+and the options give it. The lights take the place of the lights of the
+tutorial (and of --lights). The models are OBJ or model files (see
+ObjLoader.h), each a mesh of its own, after the floor (mesh 0), the cube
+(mesh 1), and the meshes of --scene-triangles and --cube-instances, in
+the order of the file, and the files of "gltf" are read like --gltf.
+A model can be "primitive": "plane", "box", or "sphere" instead of a
+file, which is a square of 1 by 1 facing up, a cube of 1, or a sphere of
+1 across, around the origin, that --analytic can test in closed form. An instance is another copy
+of a mesh, moved by its own matrix after the matrix of that mesh, with
+its own color and reflectivity if it has them, and "grid": true puts it
+in the instance grid of --instance-grid. The animation is a list
+of tracks like the file of --animation (see Animation.h), or the name of
+such a file. Files are found next to the scene file.
+
+A place is a position, a rotation of degrees around an axis, and a scale
+(one number, or one for every axis), which make translate * rotate *
+scale, like the keys of the animation.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Animation.h"
+#include "../Assets/SceneStructs.h"
+
+// A model of the scene file: its file (or the name of its primitive), the color and reflectivity of its triangles, and where it is
+struct SceneFileModel
+{
+	std::string file;
+	std::string primitive;
+	glm::vec3 color;
+	float reflectivity;
+	glm::mat4 matrix;
+};
+
+// An instance of the scene file: mesh is moved by matrix after the matrix of the mesh,
+// with color and reflectivity instead of those of its triangles if ownMaterial is true
+struct SceneFileInstance
+{
+	int mesh;
+	glm::mat4 matrix;
+	bool ownMaterial;
+	glm::vec3 color;
+	float reflectivity;
+	bool grid;
+};
+
+// Everything a scene file has. The has* are false for the parts that it leaves out
+struct SceneFile
+{
+	bool hasCamera = false;
+	glm::vec3 cameraPos = glm::vec3(0.0f, 8.0f, 8.0f);
+	glm::vec3 cameraTarget = glm::vec3(0.0f, 0.5f, 0.0f);
+	glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+	float cameraFov = 45.0f;
+
+	bool hasLights = false;
+	std::vector<light> lights;
+
+	std::vector<SceneFileModel> models;
+	std::vector<std::string> gltfFiles;
+	std::vector<SceneFileInstance> instances;
+
+	bool hasAnimation = false;
+	AnimationTracks animation;
+};
+
+// Read a scene file. A model without a color or reflectivity gets color and reflectivity.
+// Returns false, and says why, if it could not be read
+bool loadSceneFile(const std::string& fileName, glm::vec3 color, float reflectivity, SceneFile& scene);
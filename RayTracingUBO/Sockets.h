@@ -0,0 +1,70 @@
+/*
+Title: Basic Ray Tracer
+File Name: Sockets.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The sockets of RemotePreview.cpp and RenderServer.cpp, which are the
+ones of Winsock on Windows. On Linux, the sockets are file descriptors,
+and these give them the names of Winsock, so the servers are the same
+code on both (see Platform.h for the rest of the operating system).
+*/
+
+#pragma once
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+typedef unsigned short u_short;
+
+#define INVALID_SOCKET (-1)
+#define MAKEWORD(low, high) ((low) | ((high) << 8))
+
+struct WSADATA
+{
+};
+
+// A client that goes away while it is sent something would end the program on Linux, instead of failing the send
+inline int WSAStartup(int, WSADATA*)
+{
+	signal(SIGPIPE, SIG_IGN);
+	return 0;
+}
+
+inline int WSACleanup()
+{
+	return 0;
+}
+
+// Closing a socket does not make accept or recv return on Linux, shutting it down does
+inline int closesocket(SOCKET s)
+{
+	shutdown(s, SHUT_RDWR);
+	return close(s);
+}
+#endif
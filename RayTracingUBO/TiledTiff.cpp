@@ -0,0 +1,199 @@
+/*
+Title: Basic Ray Tracer
+File Name: TiledTiff.cpp
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TiledTiff.h"
+
+// The tags of the directory, in the order that it has to list them in
+#define TIFF_IMAGE_WIDTH 256
+#define TIFF_IMAGE_LENGTH 257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_COMPRESSION 259
+#define TIFF_PHOTOMETRIC 262
+#define TIFF_SAMPLES_PER_PIXEL 277
+#define TIFF_PLANAR_CONFIGURATION 284
+#define TIFF_TILE_WIDTH 322
+#define TIFF_TILE_LENGTH 323
+#define TIFF_TILE_OFFSETS 324
+#define TIFF_TILE_BYTE_COUNTS 325
+
+// The types of the values of the tags
+#define TIFF_SHORT 3
+#define TIFF_LONG 4
+#define TIFF_LONG8 16
+
+// The offsets of a classic TIFF are 32 bits, so its file can only be a bit less than 4 GB
+#define TIFF_CLASSIC_LIMIT 0xF0000000ull
+
+// Add the little-endian bytes of value to bytes
+static void putBytes(std::vector<unsigned char>& bytes, uint64_t value, int size)
+{
+	for (int i = 0; i < size; i++)
+		bytes.push_back((unsigned char)(value >> (i * 8)));
+}
+
+// One entry of the directory. A value that fits in the entry (4 bytes, or 8 in a BigTIFF) is in it,
+// otherwise the entry has the offset of the values
+static void putEntry(const TiledTiff& tiff, std::vector<unsigned char>& bytes, int tag, int type, uint64_t count, uint64_t value)
+{
+	putBytes(bytes, tag, 2);
+	putBytes(bytes, type, 2);
+	putBytes(bytes, count, tiff.big ? 8 : 4);
+
+	// a short is in the first 2 bytes, and the rest are 0
+	if (type == TIFF_SHORT && count == 1)
+	{
+		putBytes(bytes, value, 2);
+		putBytes(bytes, 0, tiff.big ? 6 : 2);
+	}
+	else
+		putBytes(bytes, value, tiff.big ? 8 : 4);
+}
+
+static uint64_t tileBytes(const TiledTiff& tiff)
+{
+	return (uint64_t)tiff.tileSize * tiff.tileSize * 3;
+}
+
+bool openTiledTiff(TiledTiff& tiff, const std::string& fileName, int width, int height, int tileSize)
+{
+	tiff.width = width;
+	tiff.height = height;
+	tiff.tileSize = tileSize;
+	tiff.tilesX = (width + tileSize - 1) / tileSize;
+	tiff.tilesY = (height + tileSize - 1) / tileSize;
+	tiff.tileOffsets.assign((size_t)tiff.tilesX * tiff.tilesY, 0);
+	tiff.big = tileBytes(tiff) * tiff.tileOffsets.size() > TIFF_CLASSIC_LIMIT;
+
+	tiff.file = fopen(fileName.c_str(), "wb");
+
+	if (tiff.file == nullptr)
+		return false;
+
+	// The header, with the offset of the directory as 0 for now. A BigTIFF has 43 instead of 42,
+	// the size of its offsets, and a 64-bit offset
+	std::vector<unsigned char> header = { 'I', 'I' };
+
+	if (tiff.big)
+	{
+		putBytes(header, 43, 2);
+		putBytes(header, 8, 2);
+		putBytes(header, 0, 2);
+		putBytes(header, 0, 8);
+	}
+	else
+	{
+		putBytes(header, 42, 2);
+		putBytes(header, 0, 4);
+	}
+
+	tiff.end = header.size();
+	return fwrite(header.data(), 1, header.size(), tiff.file) == header.size();
+}
+
+bool writeTiffTile(TiledTiff& tiff, int tileX, int tileY, const unsigned char* rgb)
+{
+	size_t size = (size_t)tileBytes(tiff);
+
+	if (fwrite(rgb, 1, size, tiff.file) != size)
+		return false;
+
+	tiff.tileOffsets[(size_t)tileY * tiff.tilesX + tileX] = tiff.end;
+	tiff.end += size;
+	return true;
+}
+
+bool closeTiledTiff(TiledTiff& tiff)
+{
+	bool complete = true;
+
+	for (uint64_t offset : tiff.tileOffsets)
+		complete = complete && offset != 0;
+
+	// The values that do not fit in their entries go first: the bits of the 3 samples,
+	// the offsets of the tiles, and their sizes, which are all the same
+	int offsetSize = tiff.big ? 8 : 4;
+	std::vector<unsigned char> values;
+
+	uint64_t bitsAt = tiff.end;
+	putBytes(values, 8, 2);
+	putBytes(values, 8, 2);
+	putBytes(values, 8, 2);
+
+	uint64_t offsetsAt = tiff.end + values.size();
+	for (uint64_t offset : tiff.tileOffsets)
+		putBytes(values, offset, offsetSize);
+
+	uint64_t countsAt = tiff.end + values.size();
+	for (size_t i = 0; i < tiff.tileOffsets.size(); i++)
+		putBytes(values, tileBytes(tiff), offsetSize);
+
+	// a directory starts on an even byte
+	if (values.size() % 2 == 1)
+		values.push_back(0);
+
+	uint64_t directoryAt = tiff.end + values.size();
+	uint64_t tiles = tiff.tileOffsets.size();
+	int offsetType = tiff.big ? TIFF_LONG8 : TIFF_LONG;
+
+	// The bits fit in the entry of a BigTIFF. With one tile, so do its offset and its size
+	if (tiff.big)
+		bitsAt = 8 | 8 << 16 | (uint64_t)8 << 32;
+
+	if (tiles == 1)
+	{
+		offsetsAt = tiff.tileOffsets[0];
+		countsAt = tileBytes(tiff);
+	}
+
+	std::vector<unsigned char> directory;
+	putBytes(directory, 11, tiff.big ? 8 : 2);
+	putEntry(tiff, directory, TIFF_IMAGE_WIDTH, TIFF_LONG, 1, tiff.width);
+	putEntry(tiff, directory, TIFF_IMAGE_LENGTH, TIFF_LONG, 1, tiff.height);
+	putEntry(tiff, directory, TIFF_BITS_PER_SAMPLE, TIFF_SHORT, 3, bitsAt);
+	putEntry(tiff, directory, TIFF_COMPRESSION, TIFF_SHORT, 1, 1);
+	putEntry(tiff, directory, TIFF_PHOTOMETRIC, TIFF_SHORT, 1, 2);
+	putEntry(tiff, directory, TIFF_SAMPLES_PER_PIXEL, TIFF_SHORT, 1, 3);
+	putEntry(tiff, directory, TIFF_PLANAR_CONFIGURATION, TIFF_SHORT, 1, 1);
+	putEntry(tiff, directory, TIFF_TILE_WIDTH, TIFF_LONG, 1, tiff.tileSize);
+	putEntry(tiff, directory, TIFF_TILE_LENGTH, TIFF_LONG, 1, tiff.tileSize);
+	putEntry(tiff, directory, TIFF_TILE_OFFSETS, offsetType, tiles, offsetsAt);
+	putEntry(tiff, directory, TIFF_TILE_BYTE_COUNTS, offsetType, tiles, countsAt);
+
+	// there is no next directory
+	putBytes(directory, 0, offsetSize);
+
+	bool written = fwrite(values.data(), 1, values.size(), tiff.file) == values.size() &&
+		fwrite(directory.data(), 1, directory.size(), tiff.file) == directory.size();
+
+	// and now the header has the offset of the directory
+	std::vector<unsigned char> directoryOffset;
+	putBytes(directoryOffset, directoryAt, offsetSize);
+
+	written = written && fseek(tiff.file, tiff.big ? 8 : 4, SEEK_SET) == 0 &&
+		fwrite(directoryOffset.data(), 1, directoryOffset.size(), tiff.file) == directoryOffset.size();
+
+	written = fclose(tiff.file) == 0 && written;
+	tiff.file = nullptr;
+
+	return complete && written;
+}
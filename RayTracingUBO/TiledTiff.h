@@ -0,0 +1,67 @@
+/*
+Title: Basic Ray Tracer
+File Name: TiledTiff.h
+Copyright © 2019
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The file of --still, a TIFF that is written one tile at a time, so that a
+still of many more pixels than a framebuffer (or the memory of the GPU)
+can hold only ever has one tile in memory. Every tile is added to the
+end of the file as soon as it is rendered, in any order, and only where
+the tiles are is kept until the end, where the directory of the image
+(the IFD, with the offsets of all the tiles) is written after them.
+
+The tiles are 8-bit RGB, with the top row first, and not compressed, so
+a tile is tileSize * tileSize * 3 bytes on the disk, even at the right
+and the bottom of the image, where part of it is past the edge (TIFF
+tiles are all the same size). An image of more than 4 GB is a BigTIFF,
+which has 64-bit offsets, and which libtiff, GIMP, and Photoshop read.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A TIFF that is being written, from openTiledTiff to closeTiledTiff
+struct TiledTiff
+{
+	FILE* file = nullptr;
+	bool big = false;
+	int width = 0;
+	int height = 0;
+	int tileSize = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+	uint64_t end = 0;
+	std::vector<uint64_t> tileOffsets;
+};
+
+// Start a TIFF of width x height pixels, in tiles of tileSize, which has to be a multiple of 16. Returns false if the file cannot be made
+bool openTiledTiff(TiledTiff& tiff, const std::string& fileName, int width, int height, int tileSize);
+
+// Add tile (tileX, tileY), counting from the top left, with tileSize * tileSize RGB pixels, the top row first.
+// Returns false if the disk is full
+bool writeTiffTile(TiledTiff& tiff, int tileX, int tileY, const unsigned char* rgb);
+
+// Write the directory of the image, and close the file. Returns false if a tile is missing, or it could not be written
+bool closeTiledTiff(TiledTiff& tiff);
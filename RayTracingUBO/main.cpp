@@ -25,9 +25,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <tuple>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <limits>
+#include <chrono>
+#include <sys/stat.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
@@ -37,565 +55,17475 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "FreeImage.h"
 
-struct triangle {
-	glm::vec4 a;
-	glm::vec4 b;
-	glm::vec4 c;
-	glm::vec4 normal;
-	glm::vec4 color;
-};
+#include "BVH.h"
+#include "Profiler.h"
+#include "GpuMemory.h"
+#include "CpuRenderer.h"
+#include "JobSystem.h"
+#include "Animation.h"
+#include "ObjLoader.h"
+#include "GltfLoader.h"
+#include "MeshLod.h"
+#include "SceneFile.h"
+#include "Farm.h"
+#include "RemotePreview.h"
+#include "RenderServer.h"
+#include "Metrics.h"
+#include "Platform.h"
+#include "DiskWriter.h"
+#include "Mezzanine.h"
+#include "FrameRing.h"
+#include "FrameQueue.h"
+#include "GlDebug.h"
+#include "GpuCounters.h"
+#include "EmbreeBaseline.h"
+#include "BlueNoise.h"
+#include "FrameCapture.h"
+#include "ObjectStorage.h"
+#include "TiledTiff.h"
+#include "CpuArena.h"
+#include "RayTracer.h"
 
-struct Mesh
-{
-	int numTriangles;
-	int junk1;
-	int junk2;
-	int junk3;
-	triangle triangles[12];
-};
+// triangle and light are in the same file as the shaders use, so they always match
+#include "../Assets/SceneStructs.h"
+
+// One mesh, placed in the world by a matrix, for the two-level BVH.
+// Rays are moved into the space of the mesh with worldToObject (the inverse of the mesh matrix).
+// With --motion-blur, shutterOpen and shutterClose are the mesh matrix at both ends of the shutter (see Instance in RayTracing.glsl)
+struct Instance {
+	glm::mat4 worldToObject;
+	int blasRoot;
+	int meshIndex;
+	int firstTriangle;
+
+	// the color and reflectivity of the instance (packUnorm4x8), used instead of those of the triangles when boxMin.w is 1
+	GLuint packedMaterial;
+
+	// the box around the mesh before it is moved, which the compact triangles are stored in
+	glm::vec4 boxMin;
+	glm::vec4 boxSize;
+
+	// the BLAS roots of the coarser copies of the mesh (x and y), and their first triangles (z and w), see MeshLod.h
+	glm::ivec4 lodRoots;
+
+	// the shape of the mesh (PRIMITIVE_*) with --analytic, and PRIMITIVE_NONE for every mesh without it
+	int primitive;
+	int primitiveJunk1;
+	int primitiveJunk2;
+	int primitiveJunk3;
 
-struct light {
-	glm::vec4 pos;
-	glm::vec4 color;
-	float radius;
-	float brightness;
-	float junk1;
-	float junk2;
+	glm::mat4 shutterOpen;
+	glm::mat4 shutterClose;
 };
 
+// The scene, which loadScene makes before any buffer is made. Nothing in the shaders has a fixed size,
+// so every buffer below that depends on the scene is sized by loadScene, from these.
+// The triangles of every mesh are one after the other, and mesh m is triangles
+// sceneMeshOffsets[m] to sceneMeshOffsets[m + 1] - 1 (see makeMeshOffsets)
+std::vector<triangle> sceneTriangles;
+std::vector<GLint> sceneMeshOffsets;
+int numSceneMeshes = 0;
+
+// The triangles in the world, which Compute.glsl writes (see vertexBlock in RayTracing.glsl)
 GLuint compToFrag;
-int compToFragSize = sizeof(triangle) * 14;
+int compToFragSize = 0;
+
+// The record of every triangle for the ray test, which Compute.glsl also writes (see recordBlock in RayTracing.glsl)
+GLuint triangleRecordBuffer;
+int triangleRecordBufferSize = 0;
 
 GLuint lightToFrag;
-int lightToFragSize = sizeof(light) * 2;
+int lightToFragSize = 0;
 
-GLuint matrixBuffer;
-int matrixBufferSize = sizeof(glm::mat4x4) * 2;
+// The lights of the scene: the two lights that are always there, then numExtraLights
+// small lights, which can be added with --lights to test scenes with many lights.
+// This must match MAX_LIGHTS in RayTracing.glsl and LightCull.glsl
+#define MAX_LIGHTS 4096
+int numExtraLights = 0;
+std::vector<light> sceneLights;
 
-GLuint triangleBuffer;
-int triangleBufferSize = sizeof(Mesh) * 2;
+// The small buffers of the renderers that change size with the window or the scene (the light lists, the triangle
+// bins, the tile queue, and the material table) are ranges of this one buffer (see GpuArena in GpuMemory.h), and they
+// are bound to their bindings once, when they are made, instead of before every dispatch
+GpuArena renderArena;
 
-// This is your reference to your shader program.
-// This will be assigned with glCreateProgram().
-// This program will run on your GPU.
-GLuint draw_program;
-GLuint transform_program;
+// If this is true, LightCull.glsl makes a list of the lights that reach every 16x16 tile
+// of the screen, and the fragment shader only lights the point the eye sees with those
+#define LIGHT_TILE_SIZE 16
+#define LIGHT_MASK_WORDS (MAX_LIGHTS / 32)
+bool tiledLightCulling = true;
+bool benchmarkTiledLights = false;
+GpuRange tileLightRange;
+int tileLightBufferTiles = 0;
 
-// These are your references to your actual compiled shaders
-GLuint vertex_shader;
-GLuint fragment_shader;
-GLuint compute_shader;
+// The hashed grid of the lights, which is built every frame by buildLightGrid and saved in
+// lightToFrag after the lights, see lightBlock in RayTracing.glsl. Reflections, and the wavefront
+// renderer, look up the bucket of a point, instead of looping over every light.
+// LIGHT_HASH_SIZE must match RayTracing.glsl
+#define LIGHT_HASH_SIZE 4096
+bool lightGridEnabled = true;
+bool benchmarkLightGrid = false;
+float lightCellSize = 1.0f;
+std::vector<GLuint> lightBucketLast;
+std::vector<GLuint> lightBuckets;
+std::vector<GLuint> lightRefs;
 
-// These are your uniform variables.
-GLuint eye_loc;		// Specifies where cameraPos is in the GLSL shader
-// The rays are the four corner rays of the camera view. See: https://camo.githubusercontent.com/21a84a8b21d6a4bc98b9992e8eaeb7d7acb1185d/687474703a2f2f63646e2e6c776a676c2e6f72672f7475746f7269616c732f3134313230385f676c736c5f636f6d707574652f726179696e746572706f6c6174696f6e2e706e67
-GLuint ray00;
-GLuint ray01;
-GLuint ray10;
-GLuint ray11;
+// Every pixel reads the same lights, one after another, which is what the uniform cache is for, so when the lights of the
+// scene fit in a uniform block (GL_MAX_UNIFORM_BLOCK_SIZE, at least 16 KB, usually 64 KB), lightBlock reads them from
+// one (see LIGHT_UNIFORMS in RayTracing.glsl) and only the light grid, which every pixel reads a different part of, from
+// the storage buffer. pickLightPlacement picks it after the scene is loaded, and --lights-in-storage turns it off.
+// The uniform block is the start of the same buffer, bound to uniform buffer binding LIGHT_UNIFORM_BINDING
+bool lightUniforms = true;
+int lightUniformCount = 0;
 
-// A variable used to describe the position of the camera.
-glm::vec3 cameraPos;
+// With --shadow-cache, the fragment shader and the compute renderer keep what their shadow rays found in a hash
+// table in world space (see shadowCache in RayTracing.glsl), by light and by a cell of shadowCacheCell around the point,
+// and use it again in the next frames instead of tracing the ray. Every light has an epoch that is part of every
+// entry, and it only goes up (which makes all of its entries old) when the light moved, or when a mesh moved inside
+// its radius, because only those can change its shadows. The epochs are the first MAX_LIGHTS words of shadowCacheBuffer.
+// An entry has 15 bits of the epoch, so when one of them gets that high, every epoch starts at 1 again and the table is cleared
+#define SHADOW_CACHE_ENTRIES (1 << 22)
+#define SHADOW_EPOCH_MAX 32767
+bool useShadowCache = false;
+float shadowCacheCell = 0.02f;
+GLuint shadowCacheBuffer = 0;
+std::vector<GLuint> shadowEpochs;
+std::vector<light> shadowCacheLights;
+std::vector<glm::mat4x4> shadowCacheMatrices;
 
-// A reference to our window.
-GLFWwindow* window;
+// With --shadow-batch [k], the shadow rays of a point to up to k lights (SHADOW_BATCH_MAX) walk the BVH or the
+// two-level BVH together, with a mask of the rays that are still looking, so the nodes near the point are read once
+// for all of them (see occludedBatch in RayTracing.glsl). The rays and their results are the same as one at a time,
+// so the image is too. It is a #define of the draw program and the compute renderer. 0 is off
+#define SHADOW_BATCH_MAX 16
+int shadowBatch = 0;
+bool benchmarkShadowBatch = false;
 
-// Variables you will need to calculate FPS.
-int tempFrame = 0;
-int totalFrame = 0;
-double dtime = 0.0;
-double timebase = 0.0;
-double totalTime = 0.0;
-int fps = 0;
+// With --light-occluders [n], LightOccluders.glsl lists the triangles that touch the sphere of every light every frame,
+// before the draw, and the shadow rays of a light only test the triangles of its list (see occludedByLight in
+// RayTracing.glsl). Every list has room for n triangles, and the rays of a light with more walk the accel like before.
+// The lists are of the triangles that Compute.glsl moved into the world, so the two-level BVH does not use them. 0 is off
+#define LIGHT_OCCLUDERS_DEFAULT_SIZE 256
+int lightOccluders = 0;
+GLuint lightOccluderBuffer = 0;
 
-int width = 1280;
-int height = 720;
-int videoFPS = 60;
-int videoSeconds = 10;
-int maxFrames = videoFPS * videoSeconds;
+// With --irradiance-probes [n], the ambient light is not 0.1 of the color everywhere, but comes from a grid of
+// probes across the scene, n along its longest side (8), which IrradianceProbes.glsl traces irradianceRate of
+// (--irradiance-rate, 32) every frame, in turns, with IRRADIANCE_PROBE_RAYS rays each. Every time a probe is
+// traced, it keeps 1 - irradianceBlend of what it had, so the light of a moving scene follows it over a few turns
+#define IRRADIANCE_PROBE_RAYS 64
+int irradianceProbes = 0;
+int irradianceRate = 32;
+float irradianceBlend = 0.25f;
+GLuint irradianceBuffer = 0;
+glm::ivec3 irradianceCount;
+int irradianceNext = 0;
 
-// This function takes in variables that define the perspective view of the camera, then outputs the four corner rays of the camera's view.
-// It takes in a vec3 eye, which is the position of the camera.
-// It also takes vec3 center, the position the camera's view is centered on.
-// Then it will takes a vec3 up which is a vector that defines the upward direction. (So if you point it down, the camera view will be upside down.)
-// Then it takes a float defining the verticle field of view angle. It also takes a float defining the ratio of the screen (in this case, 800/600 pixels).
-// The last four parameters are actually just variables for this function to output data into. They should be pointers to pre-defined vec4 variables.
-// For a visual reference, see this image: https://camo.githubusercontent.com/21a84a8b21d6a4bc98b9992e8eaeb7d7acb1185d/687474703a2f2f63646e2e6c776a676c2e6f72672f7475746f7269616c732f3134313230385f676c736c5f636f6d707574652f726179696e746572706f6c6174696f6e2e706e67
-void calcCameraRays(glm::vec3 eye, glm::vec3 center, glm::vec3 up, float fov, float ratio)
-{
-	// Grab a ray from the camera position toward where the camera is to be centered on.
-	glm::vec3 centerRay = center - eye;
+// one matrix per mesh
+GLuint matrixBuffer;
+int matrixBufferSize = 0;
 
-	// w: Vector from center toward eye
-	// u: Vector pointing directly right relative to the camera.
-	// v: Vector pointing directly upward relative to the camera.
+// The matrices and the lights change every frame. Instead of giving their buffers new storage
+// with glBufferData every frame, they can be written into a buffer that stays mapped
+// (glBufferStorage with GL_MAP_PERSISTENT_BIT). The buffer has UPLOAD_RING_SLICES slices, one for
+// each frame that can be in flight, and every slice has a fence, so the CPU writes the next frame
+// into one slice while the GPU still reads the frames before it from the others.
+// This needs GL 4.4 or GL_ARB_buffer_storage. Without it, or with --no-persistent-uploads,
+// the buffers are uploaded with glBufferData like before
+#define UPLOAD_RING_SLICES 3
 
-	// Create a w vector which is the opposite of that ray.
-	glm::vec3 w = -centerRay;
+struct UploadRing
+{
+	GLuint buffer;
+	GLsizeiptr sliceSize;
+	char* mapped;
+	GLsync fences[UPLOAD_RING_SLICES];
+	int slice;
+};
 
-	// Get the rightward (relative to camera) pointing vector by crossing up with w.
-	glm::vec3 u = glm::cross(up, w);
+bool persistentUploads = true;
 
-	// Get the upward (relative to camera) pointing vector by crossing the rightward vector with your w vector.
-	glm::vec3 v = glm::cross(w, u);
+// If this is true, the program renders some frames with and without the rings (--bench-uploads)
+bool benchmarkUploads = false;
+UploadRing matrixRing = {};
 
-	// We create these two helper variables, as when we rotate the ray about it's relative Y axis (v), we will then need to rotate it about it's relative X axis (u).
-	// This means that u has to be rotated by v too, otherwise the rotation will not be accurate. When the ray is rotated about v, so then are it's relative axes.
-	glm::vec4 uRotateLeft = glm::vec4(u, 1.0f) * glm::rotate(glm::mat4(), glm::radians(-fov * ratio / 2.0f), v);
-	glm::vec4 uRotateRight = glm::vec4(u, 1.0f) * glm::rotate(glm::mat4(), glm::radians(fov * ratio / 2.0f), v);
+// With --precompute-frames, the matrices and lights of every frame of the video are made at the start, by jobs,
+// because without --realtime the time only depends on the frame. The matrices of all the frames are uploaded
+// once into frameMatrixBuffer, one slice of frameMatrixStride bytes (rounded up to the binding alignment) per
+// frame, and a frame binds its slice instead of uploading them. The lights of a frame are copied from
+// precomputedLights, and still uploaded every frame, because the light grid is built from them
+bool precomputeFrames = false;
+GLuint frameMatrixBuffer = 0;
+GLsizeiptr frameMatrixStride = 0;
+std::vector<glm::mat4x4> precomputedMatrices;
+std::vector<std::vector<light>> precomputedLights;
+UploadRing lightRing = {};
 
-	// Now we simply take the ray and rotate it in each direction to create our four corner rays.
-	glm::vec4 r00 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(-fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(fov / 2.0f), glm::vec3(uRotateLeft));
-	glm::vec4 r01 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(-fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(-fov / 2.0f), glm::vec3(uRotateLeft));
-	glm::vec4 r10 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(fov / 2.0f), glm::vec3(uRotateRight));
-	glm::vec4 r11 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(-fov / 2.0f), glm::vec3(uRotateRight));
+// How many times the CPU had to wait for the GPU to finish with a slice.
+// If this goes up every frame, the GPU is more than UPLOAD_RING_SLICES - 1 frames behind
+int uploadRingWaits = 0;
 
-	// Now set the uniform variables in the shader to match our camera variables (cameraPos = eye, then four corner rays)
-	glUniform3f(eye_loc, eye.x, eye.y, eye.z);
-	glUniform3f(ray00, r00.x, r00.y, r00.z);
-	glUniform3f(ray01, r01.x, r01.y, r01.z);
-	glUniform3f(ray10, r10.x, r10.y, r10.z);
-	glUniform3f(ray11, r11.x, r11.y, r11.z);
-}
+// sceneTriangles, before the matrices move them. Only the two-level BVH reads these,
+// the transform program reads the indexed meshes below.
+// With compactMeshes (--compact-meshes), they are stored as compactTriangles, 32 bytes instead of 48
+GLuint triangleBuffer;
+int triangleBufferSize = 0;
+bool compactMeshes = false;
 
-// This function runs every frame
-void renderScene()
-{
-	// Used for FPS
-	dtime = glfwGetTime();
-	totalTime = dtime;
+// With --async-upload, init does not upload the triangles of the meshes, their vertices, and their indices.
+// It gives their buffers storage that is cleared to zero, and a loader thread copies them in with an OpenGL
+// context of its own (a hidden window that shares the objects of the main one). The copies go through a staging
+// buffer that stays mapped, with ASYNC_UPLOAD_SLICES slices of ASYNC_UPLOAD_CHUNK bytes and a fence for every
+// slice, like the upload rings. After every chunk the loader makes a fence, and the next frame makes the GPU wait
+// for it (glWaitSync), so the CPU never waits. Until they are copied, the indices of a triangle are all zero, and
+// a triangle of triangleBuffer is all zero, so a ray never hits it, and the scene fills in as the meshes arrive.
+// The vertices are copied before the indices, so an index is never there before its vertex.
+// Only the frames of --realtime are rendered while this goes on. The benchmarks, and the frames of a video,
+// wait for the whole scene (see finishAsyncUpload), so the upload only overlaps the rest of the startup
+#define ASYNC_UPLOAD_SLICES 3
+#define ASYNC_UPLOAD_CHUNK (4 * 1024 * 1024)
 
-	// Every second, basically.
-	if (dtime - timebase > 1)
-	{
-		// Calculate the FPS and set the window title to display it.
-		fps = tempFrame / (int)(dtime - timebase);
-		timebase = dtime;
-		tempFrame = 0;
+struct AsyncUploadJob
+{
+	GLuint buffer;
+	GLintptr offset;
+	const void* data;
+	GLsizeiptr size;
+};
 
-		std::string s = 
-			"FPS: " + std::to_string(fps) + 
-			" Frame: " + std::to_string(totalFrame) + 
-			" / " + std::to_string(maxFrames);
+bool asyncUpload = false;
+GLFWwindow* loaderWindow = nullptr;
+std::thread loaderThread;
+std::vector<AsyncUploadJob> asyncUploadJobs;
+GLuint asyncStagingBuffer = 0;
+char* asyncStagingMapped = nullptr;
 
-		glfwSetWindowTitle(window, s.c_str());
-	}
+// the compact triangles are made in init, so they are kept here until the loader has copied them
+std::vector<compactTriangle> asyncCompactTriangles;
 
-	// set camera position
-	cameraPos = glm::vec3(
-		0.0f,
-		8.0f,
-		8.0f
-	);
+// The newest fence of the loader that no frame has waited for yet, and if it is the last one
+std::mutex asyncUploadMutex;
+GLsync asyncUploadFence = 0;
+bool asyncUploadDone = false;
 
-	// There are two different ways of animating. We can 
-	// animate with respect to the time elapsed in the program, or we can
-	// animate with respect to the time elapsed in the video. 
-	
-	// If we want to test our animations, without waiting for the full 
-	// video to render: lower the resolution, disable reflections, then we 
-	// can render a real-time animation with totalTimeElapsedInProgram. This 
-	// works, even if the computer renders less than 60 frames per second
+// for the line that finishAsyncUpload prints
+GLsizeiptr asyncUploadBytes = 0;
+double asyncUploadStart = 0.0;
+int asyncUploadFrames = 0;
 
-	// After we have finished testing our animations, we can enable all of
-	// our quality settings (reflections, resolution, etc), and then change
-	// the elapsed time to totalTimeElapsedInVideo, and then all animations
-	// should look correct in the final video.
+// A scene bigger than the memory of the GPU can keep only some of its meshes there, with --geometry-pool <MB>:
+// triangleBuffer is then a pool of that size, and the triangles of a mesh are copied into it when they are
+// needed, and out of it (forgotten) when the room is needed for another mesh. Every frame, the meshes are
+// sorted by how far their box in the world is from the camera, and the closest ones that fit in the pool
+// (and are closer than --stream-radius, if it is given) are wanted. A wanted mesh that is not in the pool
+// is copied in, at most --stream-budget triangles a frame, so a frame never waits for many of them at once,
+// and it is left out of the TLAS until it is in. The room for it is found first-fit in poolFreeRanges, and if
+// there is none, the meshes that are not wanted are forgotten, the one that was wanted the longest ago first.
+// Only the two-level BVH reads triangleBuffer, so the pool needs it, without the visibility buffer and the
+// tiled renderer (which read the triangles in the world)
+int geometryPoolMB = 0;
+int poolCapacity = 0;
+float streamRadius = 0.0f;
+int streamBudget = 1 << 20;
+std::vector<int> poolOffsets;
+std::vector<int> poolLastWanted;
+std::map<int, int> poolFreeRanges;
+std::vector<compactTriangle> poolCompactTriangles;
+long long streamedTriangles = 0;
+int streamedMeshes = 0;
+int streamEvictions = 0;
 
-	// Sometimes while prototyping, the real-time render will have a longer
-	// duration than the actual rendered video, keep that in mind while testing
+// With --sparse-pool, triangleBuffer is a sparse buffer (GL_ARB_sparse_buffer) with room for every mesh of the scene,
+// but no memory, and a mesh that comes into the pool goes to its own place (sceneMeshOffsets), after the pages under it
+// are committed. A mesh that is forgotten gives back the pages that no other mesh of the pool is on (poolPageUsers
+// counts them). So a mesh costs only its own pages, nothing is ever copied to make room, and the pool never has pieces
+// that are too small. --geometry-pool is then how many triangles can be committed (poolTriangles), not the size of the buffer
+bool sparsePool = false;
+GLsizeiptr sparsePageSize = 0;
+std::vector<int> poolPageUsers;
+int poolTriangles = 0;
 
-	float totalTimeElapsedInVideo = (float)totalFrame / videoFPS;
-	float totalTimeElapsedInProgram = (float)totalTime;
+// The meshes again, as indexed meshes (see makeIndexedMeshes). Compute.glsl moves every vertex
+// once, instead of every corner of every triangle, and then puts the triangles together.
+// worldVertexBuffer holds the vertices after they were moved
+std::vector<glm::vec4> sceneVertices;
+std::vector<indexedTriangle> sceneIndexedTriangles;
+std::vector<GLint> sceneVertexOffsets;
+GLuint sceneVertexBuffer;
+GLuint sceneIndexBuffer;
+GLuint worldVertexBuffer;
 
-	// choose which one you want here
-	float time = totalTimeElapsedInVideo;
+// Where the triangles of every mesh start, see makeMeshOffsets, and then where the vertices of every mesh start
+GLuint meshOffsetBuffer;
 
-	//=================================================================
+// The BVH has one leaf for every triangle. Nothing in the build needs
+// the number of triangles to be a power of two, so this can be anything.
+// It is the number of triangles in the scene
+int bvhNumTriangles = 0;
 
-	// start using transform program
-	glUseProgram(transform_program);
+// --early-split [area] cuts every triangle whose box has more than that part of the surface area of the box around the
+// scene (0.01 if it is left out) into 4, 16, or more pieces before the BVH is built, so a huge triangle like the floor
+// is many small leaves, instead of one leaf whose box overlaps every box above it. The pieces are triangles between
+// the middles of the sides (see pieceCorners in BuildBVH.glsl), so they move with their triangle, and the leaf of a
+// piece points at the whole triangle, which stays the way it is. splitPieceBuffer has (triangle, piece) for every
+// leaf (see makeSplitPieces), and bvhNumLeaves is how many leaves there are, which is bvhNumTriangles without it
+float earlySplitArea = 0.0f;
+std::vector<glm::uvec2> splitPieces;
+GLuint splitPieceBuffer = 0;
+int bvhNumLeaves = 0;
 
-	glm::mat4x4 test[2];
-	
-	// scale the floor
-	test[0] = glm::scale(glm::mat4(), glm::vec3((sin(time) + 6.0f)) / 3.0f);
+// A triangle is cut at most this many times (1024 pieces), and the pieces of all of them
+// add at most as many leaves as there are triangles, or this many if that is more
+#define EARLY_SPLIT_MAX_CUTS 5
+#define EARLY_SPLIT_MIN_EXTRA 4096
 
-	// move and rotate the cube
-	test[1] = glm::mat4();
-	test[1] = glm::translate(test[1], glm::vec3(2 * cos(time), 1.5, 2 * sin(time)));
-	test[1] = glm::rotate(test[1], -time, glm::vec3(0, 1, 0));
-	test[1] = glm::scale(test[1], glm::vec3((1 + sin(time)) / 2));
+// The nodes of the BVH, which are read by the fragment shader.
+// A tree with n leaves has n - 1 interior nodes
+GLuint bvhNodeBuffer;
+int bvhNodeBufferSize = 0;
 
-	glBindBuffer(GL_UNIFORM_BUFFER, matrixBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, matrixBufferSize, test, GL_DYNAMIC_DRAW); // static because CPU won't touch it
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+// Temporary data for building the BVH: the box around all
+// triangle centers (6 uints), and the cost of the tree (2 uints)
+GLuint bvhScratchBuffer;
+int bvhScratchBufferSize = sizeof(GLuint) * 8;
 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, triangleBuffer);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, matrixBuffer);
-	glDispatchCompute(14, 1, 1);
+// One (morton code, triangle index) pair per triangle, and a second
+// buffer of the same size, because the radix sort reads from one and writes to the other
+GLuint bvhKeyBuffer;
+GLuint bvhKeyTempBuffer;
+int bvhKeyBufferSize = 0;
 
-	//=================================================================
+// The parent of every node, and how many of its children have finished (2 ints per node)
+GLuint bvhLinkBuffer;
+int bvhLinkBufferSize = 0;
 
-	// start using draw program
-	glUseProgram(draw_program);
+// --bvh-restructure [rounds] makes the tree of every full build better with that many rounds of PASS_RESTRUCTURE (see
+// BuildBVH.glsl), which put the treelets of bvhTreeletSize leaves (--treelet-size) together again in the best way.
+// More rounds and bigger treelets make the build slower and the rays faster, so this trades one for the other.
+// The rounds need the cost of every node (2 ints per node), which only the build uses, so both sets of
+// --overlap-transform share it. --bench-restructure times the frames with 0 to 3 rounds, a full build every frame
+int bvhRestructureRounds = 0;
+int bvhTreeletSize = 7;
+GLuint bvhTreeletBuffer = 0;
+int bvhTreeletBufferSize = 0;
+bool benchmarkRestructure = false;
 
-	light lights[2];
+// RadixSort.glsl sorts blocks of 256 keys, and every block
+// has one count for each of the 16 possible digit values
+#define RADIX_BLOCK_SIZE 256
+#define RADIX_DIGITS 16
+GLuint radixHistogramBuffer;
+int radixHistogramBufferSize = 0;
 
-	// white light
-	lights[0].color = glm::vec4(1.0, 1.0, 1.0, 0.0);
-	lights[0].radius = 7;
-	lights[0].brightness = 1;
+// When meshes only move, rotate, and scale, the order of the triangles in the
+// tree is still good, and we only need to recalculate the boxes (refit). Every refit
+// makes the tree a little worse, so after the cost of the tree (see PASS_COST) grows more
+// than bvhRefitThreshold times the cost right after the last full build, we build it again
+bool bvhAllowRefit = true;
+float bvhRefitThreshold = 1.3f;
 
-	lights[0].pos = glm::vec4(
-		2 * sin(time),
-		4,
-		2 * cos(time),
-		0
-	);
+// The cost of the tree right after the last full build, and whether
+// the tree has been built at all, and if the last frame was a full build
+GLuint bvhBuildCost = 0;
+bool bvhBuilt = false;
+bool bvhLastWasBuild = false;
 
-	// red light
-	lights[1].color = glm::vec4(1.0, 0.0, 0.0, 0.0);
-	lights[1].radius = 2;
-	lights[1].brightness = 2;
+// With --fused-morton, on the frames where every mesh moved, the transform pass starts the build of the BVH before it
+// runs (see startBVHBuild). If it is a full build, Compute.glsl grows the box of the scene and writes the Morton keys
+// while it moves the triangles (see emitKeys), and buildSceneBVH starts at the sort, instead of reading every
+// triangle again in PASS_BOUNDS and again in PASS_MORTON. bvhBuildStarted says that the transform started the build,
+// and bvhKeysFused that it made the keys
+bool fusedMorton = false;
+bool bvhBuildStarted = false;
+bool bvhKeysFused = false;
 
-	lights[1].pos = glm::vec4(
-		4 * cos(time),
-		1,
-		4,
-		0
-	);
+// Which acceleration structure the rays use. This can be picked with --accel on the command line.
+// These must match the ACCEL_ defines in FragmentShader.glsl
+// ACCEL_BRUTE_FORCE: nothing is built, and every ray tests every triangle
+// ACCEL_MESH_BOXES:  the compute shader writes a box around every mesh while it moves the triangles,
+//                    and rays skip every mesh whose box they miss
+// ACCEL_GRID:        BuildGrid.glsl puts the moved triangles into a uniform grid every frame
+// ACCEL_BVH:         BuildBVH.glsl builds a BVH over the moved triangles every frame
+// ACCEL_TWO_LEVEL:   one BVH per mesh (BLAS), built once in init(), and one BVH over the meshes (TLAS),
+//                    rebuilt every frame in renderScene(). The compute shader does not need to move
+//                    any triangles, only the TLAS changes
+#define ACCEL_BRUTE_FORCE 0
+#define ACCEL_MESH_BOXES 1
+#define ACCEL_GRID 2
+#define ACCEL_BVH 3
+#define ACCEL_TWO_LEVEL 4
+#define NUM_ACCELS 5
 
-	glBindBuffer(GL_UNIFORM_BUFFER, lightToFrag); // 'lights' is a pointer
-	glBufferData(GL_UNIFORM_BUFFER, lightToFragSize, lights, GL_DYNAMIC_DRAW); // static because CPU won't touch it
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+int accelBackend = ACCEL_TWO_LEVEL;
 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lightToFrag);
+// With --analytic, the meshes that are a plane, a box, or a sphere (the floor, the cube, and the models of the scene file
+// that are a "primitive") are tested in closed form when the two-level BVH reaches one of their instances, instead of
+// walking the triangles of their BLAS (see intersectPrimitive in RayTracing.glsl). The shapes are in the TLAS with the
+// other meshes. They keep their triangles, for the other structures and renderers, and for their color. The shape fills
+// the box of its mesh, so the mesh has to be made for it (see addPrimitiveTriangles). These must match RayTracing.glsl
+#define PRIMITIVE_NONE 0
+#define PRIMITIVE_PLANE 1
+#define PRIMITIVE_BOX 2
+#define PRIMITIVE_SPHERE 3
+#define PRIMITIVE_SPHERE_STACKS 16
+#define PRIMITIVE_SPHERE_SLICES 32
+bool analyticPrimitives = false;
+bool benchmarkAnalytic = false;
+std::vector<int> meshPrimitives;
 
-	// Call the function we created to calculate the corner rays.
-	// We use the camera position, the focus position, and the up direction (just like glm::lookAt)
-	// We use Field of View, and aspect ratio (just like glm::perspective)
-	calcCameraRays(cameraPos, glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, (float)width / height);
+// The names used on the command line, in the same order as the defines
+const char* accelNames[NUM_ACCELS] = { "brute", "meshboxes", "grid", "bvh", "twolevel" };
 
-	// Draw an image on the screen
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+// How the reflections stop, see continuePath in RayTracing.glsl. A path of reflections
+// bounces at most maxBounces times, and stops when the reflectivity of the surfaces it bounced
+// off, multiplied together, is less than throughputEpsilon. With russianRoulette, paths below
+// rouletteThreshold are stopped at random instead. Both shaders have these at fixed locations
+#define PATH_UNIFORM_LOCATION 5
+int maxBounces = 2;
+float throughputEpsilon = 0.01f;
+bool russianRoulette = false;
+float rouletteThreshold = 0.1f;
 
-	// help us keep track of FPS
-	tempFrame++;
-	totalFrame++;
-}
+// The shading LOD of the reflections, see lodShadowsFrom in RayTracing.glsl. From bounce lodShadowsFrom on (the first
+// reflection is bounce 1) there are no shadow rays, from lodSpecularFrom on no specular, and from lodLightsFrom on
+// only the lodLightCount brightest lights. 0 is off. Every renderer has them at fixed locations too
+#define SHADING_LOD_LOCATION 13
+int lodShadowsFrom = 0;
+int lodSpecularFrom = 0;
+int lodLightsFrom = 0;
+int lodLightCount = 4;
 
-// This method reads the text from a file.
-// Realistically, we wouldn't want plain text shaders hardcoded in, we'd rather read them in from a separate file so that the shader code is separated.
-std::string readShader(std::string fileName)
-{
-	std::string shaderCode;
-	std::string line;
+// With --half-shading, the renderers work out the light of a point in 16-bit floats (see HALF_SHADING in RayTracing.glsl),
+// and keep the ray tests in 32 bits. It needs GL_AMD_gpu_shader_half_float or GL_NV_gpu_shader5, and --check-golden
+// tells if the frames still look the same
+bool halfShading = false;
 
-	// We choose ifstream and std::ios::in because we are opening the file for input into our program.
-	// If we were writing to the file, we would use ofstream and std::ios::out.
-	std::ifstream file(fileName, std::ios::binary);
+// With --material-table, the colors and reflectivities of the triangles are put into one table of sceneMaterials
+// (see material in SceneStructs.h), and every triangle only has the index of its material, which the renderers look up
+// when they shade a hit. The table is made when the scene is loaded, in materialRange of renderArena
+bool materialTable = false;
+std::vector<material> sceneMaterials;
+GpuRange materialRange;
 
-	// This checks to make sure that we didn't encounter any errors when getting the file.
-	if (!file.good())
-	{
-		std::cout << "Can't read file: " << fileName.data() << std::endl;
+// Light sampling, see lightSamples in RayTracing.glsl. A point with more than lightSamples lights only adds
+// lightSamples of them, picked at random by how much light they give it. 0 adds every light
+#define LIGHT_SAMPLES_LOCATION 17
+int lightSamples = 0;
 
-		// Return so we don't error out.
-		return "";
-	}
+// How the renderers make the random numbers of light sampling and Russian roulette (--sampler), see Sampling.glsl:
+// a hash (white noise), the blue noise tile of BlueNoise.h, or the scrambled Sobol sequence over the frames.
+// The tile is made the first time it is used, and is on texture unit 9. The CPU renderer only has the hash
+#define SAMPLER_LOCATION 19
+#define SAMPLER_WHITE 0
+#define SAMPLER_BLUE_NOISE 1
+#define SAMPLER_SOBOL 2
+#define NUM_SAMPLERS 3
+const char* samplerNames[NUM_SAMPLERS] = { "white", "blue", "sobol" };
+int samplerKind = SAMPLER_WHITE;
+GLuint blueNoiseTexture = 0;
 
-	// Get size of file
-	file.seekg(0, std::ios::end);					
-	shaderCode.resize((unsigned int)file.tellg());	
-	file.seekg(0, std::ios::beg);					
+// The geometry LOD of the reflections, see rayLod in RayTracing.glsl. From bounce lodGeometryFrom on, the rays walk
+// the coarser copies of the meshes (MeshLod.h), one copy coarser every bounce. 0 is off, and then no copies are made
+#define GEOMETRY_LOD_LOCATION 18
+int lodGeometryFrom = 0;
 
-	// Dump the file into our array
-	file.read(&shaderCode[0], shaderCode.size());
+// With --motion-blur [shutter], the shutter of a frame is open for that part of the time of a frame (0.5 by default,
+// a 180 degree shutter), and every path is at a random time in it (see rayTime in RayTracing.glsl). shutterMatrices
+// are the mesh matrices at the time the shutter closes, made by renderScene. Only the TLAS knows about the time:
+// the box of an instance that moves holds it at both ends, and the rays move into its mesh with its matrix at their
+// own time, so a blurred frame is one frame with one sample per pixel, not an average of many frames.
+// It needs the two-level BVH, since the other structures have the triangles in the world at one time
+#define MOTION_BLUR_LOCATION 20
+bool motionBlur = false;
+float motionShutter = 0.5f;
+std::vector<glm::mat4x4> shutterMatrices;
 
-	// close the file
-	file.close();
+// How many triangles a workgroup of the transform pass (Compute.glsl) does.
+// --bench-transform times a few sizes on a scene with transformBenchTriangles triangles
+int transformGroupSize = 64;
+bool benchmarkTransform = false;
+int transformBenchTriangles = 1000000;
 
-	return shaderCode;
-}
+// When this is true, the transform pass only moves the meshes whose matrix changed since the
+// last time it ran, and leaves the rest of compToFrag alone (see makeDirtyList).
+// transformedMatrices are the matrices that compToFrag was made with
+bool dirtyTracking = true;
+std::vector<glm::mat4x4> transformedMatrices;
+GLuint dirtyMeshBuffer;
 
-// This method will consolidate some of the shader code we've written to return a GLuint to the compiled shader.
-// It only requires the shader source code and the shader type.
-GLuint createShader(std::string sourceCode, GLenum shaderType)
+// With --overlap-transform, the transform pass (and the BVH build) of the next frame is sent right after the
+// draw of this one, into a second set of the buffers that it writes, so that the GPU can start on it while it
+// still traces this frame, instead of after the barrier at the start of the next one. The next frame swaps that
+// set in (see swapTransformSet) if it was moved by the same matrices. OpenGL has one queue, so the two only
+// overlap as far as the driver lets the first pass start before the draw is done.
+// Every set has its own BVH state, and its own transformedMatrices, so each one only moves what moved since it was last used
+struct TransformSet
 {
-	// glCreateShader, creates a shader given a type (such as GL_VERTEX_SHADER) and returns a GLuint reference to that shader.
-	GLuint shader = glCreateShader(shaderType);
-	const char *shader_code_ptr = sourceCode.c_str(); // We establish a pointer to our shader code string
-	const int shader_code_size = sourceCode.size();   // And we get the size of that string.
+	GLuint compToFrag = 0;
+	GLuint triangleRecordBuffer = 0;
+	GLuint worldVertexBuffer = 0;
+	GLuint meshBoxBuffer = 0;
+	GLuint bvhNodeBuffer = 0;
+	GLuint bvhScratchBuffer = 0;
+	GLuint bvhKeyBuffer = 0;
+	GLuint bvhLinkBuffer = 0;
+	GLuint bvhBuildCost = 0;
+	bool bvhBuilt = false;
+	bool bvhLastWasBuild = false;
+	std::vector<glm::mat4x4> transformedMatrices;
+};
 
-	// glShaderSource replaces the source code in a shader object
-	// It takes the reference to the shader (a GLuint), a count of the number of elements in the string array (in case you're passing in multiple strings), a pointer to the string array
-	// that contains your source code, and a size variable determining the length of the array.
-	glShaderSource(shader, 1, &shader_code_ptr, &shader_code_size);
-	glCompileShader(shader); // This just compiles the shader, given the source code.
+bool overlapTransform = false;
+TransformSet spareTransform;
+int overlappedFrames = 0;
 
-	GLint isCompiled = 0;
+// Which form of the triangles the ray tests read, see testTriangle in RayTracing.glsl.
+// The records are worked out once per frame by Compute.glsl, instead of in every ray test.
+// The two-level BVH tests the triangles of the meshes, so this does not change it
+#define TRIANGLE_FORMAT_VERTICES 0
+#define TRIANGLE_FORMAT_RECORDS 1
+#define TRIANGLE_FORMAT_LOCATION 10
 
-	// Check the compile status to see if the shader compiled correctly.
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+// numTriangles and numMeshes in RayTracing.glsl, also at fixed locations
+#define SCENE_SIZE_LOCATION 11
 
-	if (isCompiled == GL_FALSE)
-	{
-		char infolog[1024];
-		glGetShaderInfoLog(shader, 1024, NULL, infolog);
+// The ray tracing shaders are compiled for the scene that was loaded: the number of triangles, meshes,
+// and lights, maxBounces, and russianRoulette are #defines (see sceneShaderDefines) instead of uniforms.
+// None of those change after the scene is loaded. Every scene and setting makes other programs, and each
+// one is kept in the shader cache. --no-specialize makes them uniforms again, so that one program works for any scene
+bool specializeScene = true;
+int triangleFormat = TRIANGLE_FORMAT_RECORDS;
+bool benchmarkTriangleFormats = false;
+const char* triangleFormatNames[2] = { "vertices", "records" };
 
-		// Print the compile error.
-		std::cout << "The shader failed to compile with the error:" << std::endl << infolog << std::endl;
+// Which ray-triangle test the shaders are compiled with, see TriangleKernels.glsl.
+// These must match the TRIANGLE_KERNEL defines in that file
+#define TRIANGLE_KERNEL_MOLLER_TRUMBORE 0
+#define TRIANGLE_KERNEL_BALDWIN_WEBER 1
+#define TRIANGLE_KERNEL_WATERTIGHT 2
+#define NUM_TRIANGLE_KERNELS 3
+int triangleKernel = TRIANGLE_KERNEL_MOLLER_TRUMBORE;
+const char* triangleKernelNames[NUM_TRIANGLE_KERNELS] = { "moller-trumbore", "baldwin-weber", "watertight" };
 
-		// Provide the infolog in whatever manor you deem best.
-		// Exit with failure.
-		glDeleteShader(shader); // Don't leak the shader.
+// --bench-tri-kernels runs TriangleBench.glsl once for every test, and
+// every ray tests every triangle this many times
+bool benchmarkTriangleKernels = false;
+#define TRIANGLE_BENCH_REPEATS 16
 
-		// NOTE: I almost always put a break point here, so that instead of the program continuing with a deleted/failed shader, it stops and gives me a chance to look at what may
-		// have gone wrong. You can check the console output to see what the error was, and usually that will point you in the right direction.
-	}
+// How reflective the floor and the cube are. Surfaces with 0 do not trace any reflection rays
+float floorReflectivity = 0.5f;
+float cubeReflectivity = 0.5f;
 
-	return shader;
-}
+// To see how the renderers scale, loadScene can add copies of the cube to the scene, so that it has about
+// generatedTriangles more triangles (--scene-triangles 100 to 10000000). Every copy has a random place,
+// rotation, size (0.2 to 1), and color, in a square on the floor that is big enough that every point of it
+// is under sceneOverlap cubes on average, and the cubes are stacked that many high, so the rays go through
+// about that many cubes (--scene-overlap, the depth complexity). The copies never move, and every
+// GENERATED_CUBES_PER_MESH of them are one mesh in the world already, so that the TLAS has a sensible size.
+// --scene-lights adds generatedLightCount lights in the same square, with a random radius from 0.5 to 3.
+// The random numbers come from sceneSeed (--scene-seed), so the same options make the same scene everywhere
+#define GENERATED_CUBES_PER_MESH 64
+int generatedTriangles = 0;
+float sceneOverlap = 2.0f;
+int generatedLightCount = 0;
+unsigned int sceneSeed = 1;
+int generatedCubes = 0;
+std::vector<light> generatedLights;
 
-// Initialization code
-void init()
+// The models of --obj <file>, which loadScene adds as one mesh each, after the floor and the cube (see ObjLoader.h).
+// They stay where the file has them, unless --animation moves their meshes. A file that ends in .rtmodel
+// is a model that --convert-obj <file> <model> made from an OBJ once (with the color and reflectivity of
+// the options then), which is read with no parsing, so a big model does not hold up the first frame
+std::vector<std::string> objFiles;
+glm::vec3 objColor = glm::vec3(0.8f, 0.8f, 0.8f);
+float objReflectivity = 0.25f;
+std::string convertObjFile;
+std::string convertModelFile;
+
+// The scenes of --gltf <file> (see GltfLoader.h)
+std::vector<std::string> gltfFiles;
+
+// A mesh that is in the scene many times, like a glTF mesh that many nodes use, or the cubes of
+// --cube-instances <n>, is kept once: the first copy is a mesh with its matrix moved into its triangles,
+// and every other copy is an instance in this table, which the two-level BVH draws as one more leaf of the
+// TLAS with the BLAS of the mesh, so the triangles, the memory, and the upload grow with the meshes and not
+// with the copies (see placeMesh). An instance is drawn by the matrix of its mesh times its own matrix, so
+// it moves with --animation like the mesh does (see buildTLAS), and it can have a color and reflectivity
+// of its own. The other backends, the CPU renderer, the visibility buffer, and the tiled renderer only see
+// the triangles, so for them (and with --expand-instances) every copy is a mesh of its own instead
+struct SceneInstance
 {
-	glewExperimental = GL_TRUE;
-	// Initializes the glew library
-	glewInit();
+	int mesh;
+	glm::mat4x4 matrix;
+	bool ownMaterial;
+	glm::vec3 color;
+	float reflectivity;
 
-	// Read in the shader code from a file.
-	std::string vertShader = readShader("../Assets/VertexShader.glsl");
-	std::string fragShader = readShader("../Assets/FragmentShader.glsl");
-	std::string compShader = readShader("../Assets/Compute.glsl");
+	// in the instance grid instead of the TLAS, with --instance-grid
+	bool grid = false;
+};
 
-	// createShader consolidates all of the shader compilation code
-	vertex_shader = createShader(vertShader, GL_VERTEX_SHADER);
-	fragment_shader = createShader(fragShader, GL_FRAGMENT_SHADER);
-	compute_shader = createShader(compShader, GL_COMPUTE_SHADER);
+std::vector<SceneInstance> sceneInstances;
+bool expandInstances = false;
+int cubeInstances = 0;
 
-	// A shader is a program that runs on your GPU instead of your CPU. In this sense, OpenGL refers to your groups of shaders as "programs".
-	// Using glCreateProgram creates a shader program and returns a GLuint reference to it.
-	draw_program = glCreateProgram();
-	glAttachShader(draw_program, vertex_shader);		// This attaches our vertex shader to our program.
-	glAttachShader(draw_program, fragment_shader);	// This attaches our fragment shader to our program.
-	glLinkProgram(draw_program);					// Link the program
-	// End of shader and program creation
+// A glTF node with a skin is a mesh of its own, never an instance, and the joints of its skin move its vertices every
+// frame before its matrix does: Compute.glsl moves every vertex by the weighted sum of the matrices of its 4 joints
+// (see updateSkins). The matrix of the node is moved into the triangles like it is for every glTF mesh (see placeMesh),
+// so unbake, the inverse of that matrix, first moves a vertex back to where its skin expects it. corners and cornerSkins
+// are every corner of the mesh, where it is in sceneTriangles, and its skin, so that the vertices that makeIndexedMeshes
+// welds can find their skins. bindBounds is the box of the mesh when no joint moves it. With the two-level BVH,
+// the skinned triangles are written into triangleBuffer, in the space of the mesh, and its BLAS is refit (see skinBLAS)
+struct SkinnedMesh
+{
+	int mesh;
+	int skeleton;
+	int skin;
+	glm::mat4x4 unbake;
+	std::vector<glm::vec3> corners;
+	std::vector<GltfCornerSkin> cornerSkins;
+	AABB bindBounds;
+	int firstJoint;
+};
 
-	// Tell our code to use the program
-	glUseProgram(draw_program);
+std::vector<GltfSkeleton> gltfSkeletons;
+std::vector<SkinnedMesh> skinnedMeshes;
 
-	// This gets us a reference to the uniform variables in the vertex shader, which are called by the same name here as in the shader.
-	// We're using these variables to define the camera. The eye is the camera position, and teh rays are the four corner rays of what the camera sees.
-	// Only 2 parameters required: A reference to the shader program and the name of the uniform variable within the shader code.
-	eye_loc = glGetUniformLocation(draw_program, "eye");
-	ray00 = glGetUniformLocation(draw_program, "ray00");
-	ray01 = glGetUniformLocation(draw_program, "ray01");
-	ray10 = glGetUniformLocation(draw_program, "ray10");
-	ray11 = glGetUniformLocation(draw_program, "ray11");
-
-	transform_program = glCreateProgram();
-	glAttachShader(transform_program, compute_shader);
-	glLinkProgram(transform_program);					// Link the program
-	// End of shader and program creation
+// The tables of Compute.glsl: the first joint of every mesh (-1 for a mesh without a skin) and where the skins of its
+// vertices start, the skin of every vertex of the skinned meshes, and the matrices of the joints of every skin in this
+// frame. skinsMoved is true if the joints are not where they were in the frame before, which makes every skinned mesh
+// dirty (see transformScene)
+std::vector<glm::ivec4> meshSkins;
+std::vector<GltfCornerSkin> vertexSkins;
+std::vector<glm::mat4x4> skinJointMatrices;
+GLuint meshSkinBuffer;
+GLuint vertexSkinBuffer;
+GLuint jointMatrixBuffer;
+bool skinsMoved = false;
 
-	// Make a buffer for our particle data.
-	glGenBuffers(1, &compToFrag);
-	glBindBuffer(GL_UNIFORM_BUFFER, compToFrag);
-	glBufferData(GL_UNIFORM_BUFFER, compToFragSize, nullptr, GL_STATIC_DRAW); // static because CPU won't touch it
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+// The nodes of the BLAS of every skinned mesh, for PASS_REFIT of Compute.glsl: x is the node, and y is the first
+// triangle of its mesh. They are in levels, the deepest first, and skinRefitLevels is where every level starts,
+// and then the end of the list (see makeSkinRefitList)
+std::vector<glm::ivec4> skinRefitNodes;
+std::vector<int> skinRefitLevels;
+GLuint skinRefitBuffer = 0;
 
-	glGenBuffers(1, &matrixBuffer);
-	glBindBuffer(GL_UNIFORM_BUFFER, matrixBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, matrixBufferSize, nullptr, GL_DYNAMIC_DRAW); // static because CPU won't touch it
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+// With --incremental-tlas [room], buildTLAS keeps the TLAS of the frame before in tlasTree (see DynamicBVH in BVH.h),
+// and only puts in, takes out, or moves the leaves of the meshes and instances that changed, instead of building it
+// again. Then the scene file can add and take out instances while the program runs (see editSceneInstances), and an
+// instance that is added or taken out costs one leaf. It is for scenes where few instances move in a frame: a leaf
+// whose box moved out of its fat box is put in again, which costs more than the median split when all of them move.
+// tlasLeaves is the leaf of every mesh and instance (-1 if it is not in the tree), tlasLeafBoxes their boxes in the
+// world, and the buffers have room for instanceRoom more instances than the scene started with (instanceCapacity)
+#define INSTANCE_ROOM_DEFAULT 1024
+bool incrementalTLAS = false;
+int instanceRoom = INSTANCE_ROOM_DEFAULT;
+int instanceCapacity = 0;
+DynamicBVH tlasTree;
+std::vector<int> tlasLeaves;
+std::vector<AABB> tlasLeafBoxes;
+int tlasInserts = 0;
+int tlasRemoves = 0;
+int tlasMoves = 0;
+int tlasUpdates = 0;
+double tlasUpdateSeconds = 0.0;
 
-	Mesh meshes[2];
-	meshes[0].numTriangles = 2;
-	meshes[0].triangles[0].a = glm::vec4(-5.0, 0.0, 5.0, 1.0); 
-	meshes[0].triangles[0].b = glm::vec4(-5.0, 0.0, -5.0, 1.0);
-	meshes[0].triangles[0].c = glm::vec4(5.0, 0.0, -5.0, 1.0);
-	meshes[0].triangles[0].normal = glm::vec4(0.0, 1.0, 0.0, 1.0); 
-	meshes[0].triangles[0].color = glm::vec4(1.0, 1.0, 1.0, 1.0);
-
-	meshes[0].triangles[1].a = glm::vec4(-5.0, 0.0, 5.0, 1.0);
-	meshes[0].triangles[1].b = glm::vec4(5.0, 0.0, -5.0, 1.0);
-	meshes[0].triangles[1].c = glm::vec4(5.0, 0.0, 5.0, 1.0);
-	meshes[0].triangles[1].normal = glm::vec4(0.0, 1.0, 0.0, 1.0);
-	meshes[0].triangles[1].color = glm::vec4(1.0, 1.0, 1.0, 1.0);
-
-	meshes[1].numTriangles = 12;
-	meshes[1].triangles[0].a = glm::vec4(-0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[0].b = glm::vec4(0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[0].c = glm::vec4(-0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[0].normal = glm::vec4(0.0, 0.0, -1.0, 1.0);
-	meshes[1].triangles[0].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-		   
-	meshes[1].triangles[1].a = glm::vec4(0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[1].b = glm::vec4(0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[1].c = glm::vec4(-0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[1].normal = glm::vec4(0.0, 0.0, -1.0, 1.0);
-	meshes[1].triangles[1].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-		   
-	meshes[1].triangles[2].a = glm::vec4(-0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[2].b = glm::vec4(-0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[2].c = glm::vec4(0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[2].normal = glm::vec4(0.0, 0.0, 1.0, 1.0);
-	meshes[1].triangles[2].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-		   
-	meshes[1].triangles[3].a = glm::vec4(-0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[3].b = glm::vec4(0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[3].c = glm::vec4(0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[3].normal = glm::vec4(0.0, 0.0, 1.0, 1.0);
-	meshes[1].triangles[3].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-		   
-	meshes[1].triangles[4].a = glm::vec4(0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[4].b = glm::vec4(0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[4].c = glm::vec4(0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[4].normal = glm::vec4(1.0, 0.0, 0.0, 1.0);
-	meshes[1].triangles[4].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-		   
-	meshes[1].triangles[5].a = glm::vec4(0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[5].b = glm::vec4(0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[5].c = glm::vec4(0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[5].normal = glm::vec4(1.0, 0.0, 0.0, 1.0);
-	meshes[1].triangles[5].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-
-	meshes[1].triangles[6].a = glm::vec4(-0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[6].b = glm::vec4(-0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[6].c = glm::vec4(-0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[6].normal = glm::vec4(-1.0, 0.0, 0.0, 1.0);
-	meshes[1].triangles[6].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-
-	meshes[1].triangles[7].a = glm::vec4(-0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[7].b = glm::vec4(-0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[7].c = glm::vec4(-0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[7].normal = glm::vec4(-1.0, 0.0, 0.0, 1.0);
-	meshes[1].triangles[7].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-
-	meshes[1].triangles[8].a = glm::vec4(-0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[8].b = glm::vec4(-0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[8].c = glm::vec4(0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[8].normal = glm::vec4(0.0, 1.0, 0.0, 1.0);
-	meshes[1].triangles[8].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-
-	meshes[1].triangles[9].a = glm::vec4(-0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[9].b = glm::vec4(0.5, 0.5, -0.5, 1.0);
-	meshes[1].triangles[9].c = glm::vec4(0.5, 0.5, 0.5, 1.0);
-	meshes[1].triangles[9].normal = glm::vec4(0.0, 1.0, 0.0, 1.0);
-	meshes[1].triangles[9].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-
-	meshes[1].triangles[10].a = glm::vec4(-0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[10].b = glm::vec4(-0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[10].c = glm::vec4(0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[10].normal = glm::vec4(0.0, -1.0, 0.0, 1.0);
-	meshes[1].triangles[10].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
-
-	meshes[1].triangles[11].a = glm::vec4(-0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[11].b = glm::vec4(0.5, -0.5, -0.5, 1.0);
-	meshes[1].triangles[11].c = glm::vec4(0.5, -0.5, 0.5, 1.0);
-	meshes[1].triangles[11].normal = glm::vec4(0.0, -1.0, 0.0, 1.0);
-	meshes[1].triangles[11].color = glm::vec4(1.0, 0.5, 0.1, 1.0);
+// true if fileName is a model of --convert-obj and not an OBJ
+bool isModelFile(const std::string& fileName)
+{
+	const std::string extension = ".rtmodel";
+	return fileName.size() >= extension.size() && fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+}
 
+// --cost-view draws a heatmap of how much work the rays of every pixel were, instead of the image,
+// to find the places that make the slowest frames (like floors seen at a grazing angle, or many lights
+// over one spot). FragmentShader.glsl counts the triangle tests, node visits, and shadow rays of every
+// pixel, and costScale is the count that is drawn white. Only the fragment shader counts, so the
+// wavefront and compute renderers are turned off. These must match FragmentShader.glsl
+#define COST_VIEW_OFF 0
+#define COST_VIEW_TRIANGLES 1
+#define COST_VIEW_NODES 2
+#define COST_VIEW_SHADOWS 3
+#define COST_VIEW_ALL 4
+int costView = COST_VIEW_OFF;
+float costScale = 64.0f;
+const char* costViewNames[] = { "off", "triangles", "nodes", "shadows", "all" };
 
-	glGenBuffers(1, &triangleBuffer);
-	glBindBuffer(GL_UNIFORM_BUFFER, triangleBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, triangleBufferSize, meshes, GL_STATIC_DRAW); // static because CPU won't touch it
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+// If this is true, the triangles are rasterized into a visibility buffer first (an integer texture
+// with the index of the triangle that every pixel sees), and the fragment shader starts from that,
+// instead of tracing the camera rays. It only traces the shadows and reflections
+bool useVisibilityBuffer = false;
+bool benchmarkVisibility = false;
+GLuint visibilityFBO;
+GLuint visibilityTexture;
+GLuint visibilityDepth;
+int visibilityWidth = 0;
+int visibilityHeight = 0;
 
-	glGenBuffers(1, &lightToFrag);
-	glBindBuffer(GL_UNIFORM_BUFFER, lightToFrag);
-	glBufferData(GL_UNIFORM_BUFFER, lightToFrag, nullptr, GL_DYNAMIC_DRAW); // static because CPU won't touch it
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-}
+// With --reflection-scale 2 or 4, the fragment shader traces the reflections in an image that is that many times
+// smaller on each side first (4 or 16 times fewer reflection rays), and the normal pixels make their reflection from the
+// pixels of that image that are about as far away and face the same way (see upsampleReflection in FragmentShader.glsl).
+// reflectionTexture has the reflection and the distance of every pixel, and reflectionNormalTexture its normal
+int reflectionScale = 1;
+GLuint reflectionFBO;
+GLuint reflectionTexture;
+GLuint reflectionNormalTexture;
+int reflectionWidth = 0;
+int reflectionHeight = 0;
 
-void window_size_callback(GLFWwindow* window, int w, int h)
-{
-	width = w;
-	height = h;
-	glViewport(0, 0, width, height);
-}
+// With --shadow-scale 2 or 4, the fragment shader traces the shadow rays of the points that the eye sees for a grid
+// that is that many times coarser on each side first, into shadowSampleBuffer. A pixel then only traces the shadow
+// rays of the lights that the 4 samples around it do not agree on, or all of them if it is not on the surface of
+// those samples (see reducedShadow in FragmentShader.glsl). The size of the buffer depends on the number of lights
+int shadowScale = 1;
+GLuint shadowSampleBuffer = 0;
+size_t shadowSampleBytes = 0;
 
-int main(int argc, char **argv)
-{
-	// Initializes the GLFW library
-	glfwInit();
+// With --hit-buffer, the fragment shader finds the point that every pixel sees once, in a pass of its own, and writes
+// it into hitTexture (how far along the camera ray it is, and its normal, color, and reflectivity, 16 bytes per pixel).
+// The passes after it (the lighting, and the reflections of --reflection-scale) read it from there instead of
+// tracing the camera rays again. The hit is stored, not just the index of the triangle, because with the two-level BVH
+// the triangle is in a mesh and was moved by the matrix of its instance
+bool useHitBuffer = false;
+GLuint hitFBO;
+GLuint hitTexture;
+int hitWidth = 0;
+int hitHeight = 0;
 
-	// Creates a window given (width, height, title, monitorPtr, windowPtr).
-	// Don't worry about the last two, as they have to do with controlling which monitor to display on and having a reference to other windows. Leaving them as nullptr is fine.
-	window = glfwCreateWindow(width, height, "", nullptr, nullptr);
+// With --adaptive-aa [n], the pixels on an edge in the hit buffer, where the pixels next to them see another
+// surface, trace n more rays (4 by default, up to 8) and are the average of them (see edgePixel in FragmentShader.glsl)
+int adaptiveSamples = 0;
 
-	// This allows us to resize the window when we want to
-	glfwSetWindowSizeCallback(window, window_size_callback);
+// With --accumulate <n>, a frame where the camera, the matrices of the meshes, and the lights are all the same as
+// in the frame before is not rendered the same way again. The camera rays are moved by a part of a pixel instead
+// (cameraJitter, a different place every frame), and the image is averaged with the ones before it in a float image
+// (accumFBO), so a still scene gets antialiased. After n of those, nothing is traced at all, and the average is shown
+// again. This works with the fragment shader and the wavefront renderer, which draw their image with a quad
+int accumulateSamples = 0;
+int accumulatedSamples = 0;
+GLuint accumFBO;
+GLuint accumColor;
+int accumWidth = 0;
+int accumHeight = 0;
+std::vector<glm::mat4x4> accumMatrices;
+std::vector<light> accumLights;
+glm::vec3 accumCamera;
 
-	// Makes the OpenGL context current for the created window.
-	glfwMakeContextCurrent(window);
+// With --temporal [n], the fragment shader uses the color that a pixel had in the frame before again, when it sees the
+// same triangle there (see reprojectHistory in FragmentShader.glsl), and only traces the pixels that it cannot, and
+// every pixel once every n frames (4 by default). It needs the hit buffer, which has the triangle of every pixel.
+// The image and the hits of every frame are kept for the next one in temporalColor and temporalHit; there are two of
+// each, and frame f draws into [f % 2] and reads [1 - f % 2]. motionBuffer says how every mesh moved since then
+bool useTemporal = false;
+int temporalRefresh = 4;
+GLuint temporalFBO[2];
+GLuint temporalColor[2];
+GLuint temporalHit[2];
+int temporalWidth = 0;
+int temporalHeight = 0;
+int temporalIndex = 0;
+bool historyValid = false;
+GLuint motionBuffer;
 
-	// Sets the number of screen updates to wait before swapping the buffers.
-	glfwSwapInterval(1);
+// The camera and the matrices of the frame before, which the motion is from
+glm::mat4 prevViewProj;
+glm::vec3 prevEye;
+std::vector<glm::mat4x4> prevMatrices;
 
-	// Initializes most things needed before the main loop
-	init();
+// With --checkerboard, --temporal traces half of the pixels every frame, in a checkerboard that flips every frame,
+// and checkerboard_program fills in the pixels that could not use their color from the frame before
+bool useCheckerboard = false;
 
-	// Make the BYTE array, factor of 3 because it's RGB.
-	// This will hold each screenshot
-	unsigned char* pixels = new unsigned char[3 * width * height];
+// With --denoise [n], Denoise.glsl blurs the frame n times (3 by default, up to 5) before it is read back, but only
+// across the pixels that see the same surface, which it finds in the hit buffer (how far away every point is, its
+// normal, and its albedo). The passes draw into denoiseColor[0] and [1], one after the other, and the last one
+// draws on the screen. Half floats, because the light without the albedo can be brighter than 1
+int denoisePasses = 0;
+GLuint denoiseFBO[2];
+GLuint denoiseColor[2];
+int denoiseWidth = 0;
+int denoiseHeight = 0;
 
-	// Create a place for fileName
-	char* fileName = (char*)malloc(100);
+// How far the camera rays are moved this frame, in pixels, from -0.5 to 0.5
+glm::vec2 cameraJitter = glm::vec2(0.0f);
 
-	// This creates the folder, only if it does
-	// not already exist, called "exportedFrames"
-	CreateDirectoryA("exportedFrames", NULL);
+// --pause-at <seconds> stops the animation at that time of the video, and P stops it where it is
+// (and starts it again, at the time that the video is at then), so the scene can be still
+float pauseAt = -1.0f;
+bool animationPaused = false;
+float pausedTime = 0.0f;
 
-	// continue rendering until the desired
-	// number of frames are hit
+// The matrix that moves a point in the world to the pixel that the camera rays see it in,
+// made by calcCameraRays from the same corner rays as the fragment shader
+glm::mat4 cameraViewProj;
 
-	while (totalFrame != maxFrames)
-	{
-		// Call the render function.
-		renderScene();
+// If this is true, the image is rendered by TiledRender.glsl, a compute shader where every workgroup
+// is a tile of TILED_RENDER_GROUP_SIZE x TILED_RENDER_GROUP_SIZE pixels, and the threads of a tile share
+// the triangles that they load into shared memory. It writes into tiledRenderTexture with imageStore,
+// which is then copied to the screen. The wavefront renderer wins if both are turned on
+#define TILED_RENDER_GROUP_SIZE 8
+bool useTiledRender = false;
+bool benchmarkTiledRender = false;
+GLuint tiledRenderFBO;
+GLuint tiledRenderTexture;
+int tiledRenderWidth = 0;
+int tiledRenderHeight = 0;
 
-		// Swaps the back buffer to the front buffer
-		// Remember, you're rendering to the back buffer, then once rendering is complete, you're moving the back buffer to the front so it can be displayed.
-		glfwSwapBuffers(window);
+// With --foveated [radius] or --importance-map <file>, the tiles of TiledRender.glsl trace fewer of their pixels the
+// farther they are from foveaCenter (0 to 1 across and up, the middle of the image by default, see --fovea-center), or
+// the darker they are in the importance map (a grayscale image, where white traces every pixel). The pixels that
+// are not traced are filled in from the ones that are. Up to foveaRadius (as a part of the height of the image) from
+// the center, every pixel is traced, and from 3 times that on, 1 in 64
+bool variableRate = false;
+glm::vec2 foveaCenter = glm::vec2(0.5f);
+float foveaRadius = 0.2f;
+std::string importanceMapFile;
+GLuint importanceMapTexture = 0;
 
-		// Checks to see if any events are pending and then processes them.
-		glfwPollEvents();
+// With --persistent-threads [groups], TiledRender.glsl is started with only persistentGroups workgroups, and they
+// take the tiles from a queue in tileQueueRange until every tile is rendered (see persistent in TiledRender.glsl),
+// instead of one workgroup for every tile. OpenGL cannot tell how many workgroups the GPU runs at once, so the
+// default is enough for a big GPU, and a smaller one runs the rest after the first ones are done, like before
+#define PERSISTENT_DEFAULT_GROUPS 1024
+bool persistentThreads = false;
+int persistentGroups = PERSISTENT_DEFAULT_GROUPS;
+GpuRange tileQueueRange;
 
-		// get the image that was rendered
-		// We use BGR format, because BMP images use BGR
-		glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+// With --cost-order, the queue of --persistent-threads hands out the most expensive tiles first, by what they cost two
+// frames before (TiledRender.glsl counts the work of every tile, see costOrder there), so the slow tiles of reflections
+// and many lights are not the last ones left at the end of the frame. The frames take turns with the two ranges, and
+// the costs that are read back are from a frame that the GPU is done with, so reading them does not wait for it
+bool costOrder = false;
+GpuRange tileCostRanges[2];
+bool tileCostsCounted[2] = { false, false };
+int tileCostTiles = 0;
+int tileCostTurn = 0;
 
-		// make the name of the current file
-		sprintf(fileName, "exportedFrames/%d.png", totalFrame);
+// Which pixel of a tile every thread of TiledRender.glsl takes, and which tile every workgroup takes: in rows, or along
+// the Z curve, with the tiles in blocks of TILE_BLOCK_SIZE x TILE_BLOCK_SIZE (see pixelOrder in TiledRender.glsl).
+// These must match the defines in that file. --bench-pixel-order times both
+#define PIXEL_ORDER_ROWS 0
+#define PIXEL_ORDER_MORTON 1
+#define TILE_BLOCK_SIZE 8
+int pixelOrder = PIXEL_ORDER_ROWS;
+bool benchmarkPixelOrder = false;
+const char* pixelOrderNames[2] = { "rows", "morton" };
 
-		// Convert to FreeImage format & save to file
-		FIBITMAP* image = FreeImage_ConvertFromRawBits(pixels, width, height, 3 * width, 24, 0xFF0000, 0x00FF00, 0x0000FF, false);
-		FreeImage_Save(FIF_PNG, image, fileName, 0);
-		FreeImage_Unload(image);
-	}
+// With --bin-triangles [entries], TriangleBin.glsl puts every triangle into a list for every tile of the screen that it
+// covers, before TiledRender.glsl runs, and the eye rays of a tile only test the triangles of its list instead of all of
+// them. triangleBinRange has room for binEntries triangle indexes per tile on average, and a tile whose list does
+// not fit gets TRIANGLE_BIN_OVERFLOW and tests every triangle, like before
+#define TRIANGLE_BIN_OVERFLOW 0xFFFFFFFFu
+#define TRIANGLE_BIN_DEFAULT_ENTRIES 256
+bool binTriangles = false;
+int binEntries = TRIANGLE_BIN_DEFAULT_ENTRIES;
+GpuRange triangleBinRange;
+int triangleBinTiles = 0;
 
-	// After the program is over, cleanup your data!
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
-	glDeleteProgram(draw_program);
-	delete[] pixels;
+// With --tile-frustum, every workgroup of TiledRender.glsl walks the BVH of --accel bvh once for its tile, and culls
+// the nodes that are outside of the frustum of the tile, so its eye rays only test the triangles of the leaves that
+// the tile can see, instead of all of them (see tileFrustum in TiledRender.glsl)
+bool tileFrustum = false;
 
-	// Frees up GLFW memory
-	glfwTerminate();
-	
-	// make space for a command
-	char* command = (char*)malloc(1000);
+// --floor-texture <file> puts an image on the floor, repeated every floorTextureScale units (--floor-texture-scale),
+// in the draw program. Every mip is made on the CPU, and the driver compresses it to BC1 (S3TC DXT1, 4 bits
+// a texel) where it can, so a reflection that reads a small mip reads 8 times fewer bytes than RGBA8 (see
+// applyFloorTexture in RayTracing.glsl). With ARB_bindless_texture, the shader gets a resident handle
+// instead of a texture unit
+std::string floorTextureFile;
+float floorTextureScale = 2.0f;
+GLuint floorTexture = 0;
+GLuint64 floorTextureHandle = 0;
 
-	// build the command with proper FPS
-	sprintf(command, "ffmpeg -r %d -start_number 1 -i exportedFrames/%%d.png -q 0 test.avi", videoFPS);
+// --reflection-probes [n] puts n cube maps (4, up to 8) of probeSize texels a side (--probe-size) on a grid across the
+// scene, which the draw program renders from their centers with every bounce. A reflection of bounce probeBounce and
+// after (--probe-bounce, 2 by default, so only the first one is traced), or one that starts more than probeDistance
+// along its path (--probe-distance, 0 is off), reads the closest probe instead of being traced (see sampleProbe in
+// RayTracing.glsl). The probes are drawn again when the matrices, the lights, or the joints change, at most once every
+// probeRefreshFrames frames (--probe-refresh), so a scene that moves all the time reads probes a few frames old
+#define MAX_REFLECTION_PROBES 8
+int reflectionProbes = 0;
+int probeSize = 64;
+int probeBounce = 2;
+float probeDistance = 0.0f;
+int probeRefreshFrames = 8;
+GLuint probeTexture = 0;
+GLuint probeFBO = 0;
+glm::vec3 probeCenters[MAX_REFLECTION_PROBES];
+AABB probeBox;
+std::vector<glm::mat4x4> probeMatrices;
+std::vector<light> probeLights;
+int probeFrame = -1;
+int probeRefreshes = 0;
 
-	// give the command to build the video
-	system(command);
+// If this is true, the image is rendered by Wavefront.glsl (compute shaders with ray queues) instead of
+// FragmentShader.glsl. Both render the same image, so they can be compared with --bench-wavefront
+bool useWavefront = false;
+bool benchmarkWavefront = false;
+
+// The queues of the wavefront renderer. These are made (and made again if the window changes size)
+// by makeWavefrontBuffers. Every pixel has at most one ray in the hit queue, and one ray in each half of
+// the ray queue. The shadow queue has room for WAVE_SHADOW_RAYS_PER_PIXEL rays per pixel, and the
+// pixel colors are 4 uints per pixel. These sizes must match the structs in Wavefront.glsl
+#define WAVE_SHADOW_RAYS_PER_PIXEL 4
+#define WAVE_RAY_SIZE 32
+#define WAVE_HIT_SIZE 64
+#define WAVE_SHADOW_RAY_SIZE 48
+GLuint waveRayBuffer;
+GLuint waveHitBuffer;
+GLuint waveShadowBuffer;
+GLuint waveCountBuffer;
+GLuint wavePixelBuffer;
+int wavefrontPixels = 0;
+
+// If this is true, the reflection rays are sorted by direction and origin before they are traced,
+// so that rays next to each other in the queue walk through the same parts of the BVH.
+// The Morton codes of the origins are made inside this box, which holds the whole scene
+bool waveSortRays = false;
+bool benchmarkWaveSort = false;
+glm::vec3 waveSortBoundsMin = glm::vec3(-10.0f);
+glm::vec3 waveSortBoundsMax = glm::vec3(10.0f);
+GLuint waveSortKeyBuffer;
+GLuint waveSortTempBuffer;
+
+// If this is true, the threads of a subgroup walk the BVH together in EXTEND and SHADOW,
+// with one stack for the whole subgroup (see SubgroupTraversal.glsl). Only for --accel bvh
+bool waveSubgroupTraversal = false;
+bool benchmarkSubgroupTraversal = false;
+
+// If this is true, the rays that go on after EXTEND and SHADE find their places in the next queue with a prefix sum
+// over their workgroup, and one atomic for the whole workgroup, so they stay in order (see compactedSlot in Wavefront.glsl)
+bool waveCompactQueues = false;
+
+// If this is true, EXTEND, SHADE, and SHADOW only start as many workgroups as their queues need,
+// with glDispatchComputeIndirect and the commands that STAGE_ARGS writes on the GPU.
+// Otherwise every dispatch is big enough for the biggest the queue could be
+bool waveIndirectDispatch = true;
+bool benchmarkWaveIndirect = false;
+
+// When this is true, traceWavefront measures how long the GPU spends sorting the rays,
+// and how long it spends in EXTEND, and adds it to these (in nanoseconds)
+bool waveTimeStages = false;
+GLuint waveTimerQuery;
+GLuint64 waveSortTime = 0;
+GLuint64 waveExtendTime = 0;
+
+// With --timing-log <file>, every frame writes how long its passes took on the GPU to a file,
+// as CSV, or as JSON if the name ends with .json. The GPU writes a timestamp (glQueryCounter) at the start
+// of the frame, after the scene update (the transform and the acceleration structures), after the draw,
+// and after the readback. Timestamps are used instead of GL_TIME_ELAPSED because only one of those can
+// run at a time, and traceWavefront already uses one for its stages. A frame's timestamps are only read
+// FRAME_TIMER_SLICES frames later, when the GPU is long done with them, so reading them never waits.
+// The CPU times are the whole frame, the time that the render thread spent saving the frames,
+// and how much of the frame it only waited (for vsync, a readback fence, or room in the encoder queue).
+// The timers also run without --timing-log, for the report that printFrameReport prints at the end
+#define FRAME_TIMER_SLICES 3
+#define FRAME_TIMER_START 0
+#define FRAME_TIMER_SCENE 1
+#define FRAME_TIMER_DRAW 2
+#define FRAME_TIMER_READBACK 3
+#define FRAME_TIMER_MARKS 4
+
+struct FrameTimer
+{
+	GLuint queries[FRAME_TIMER_MARKS];
+	bool marked[FRAME_TIMER_MARKS];
+	int frame;
+	double cpuStart;
+	double cpuEnd;
+	double saveSeconds;
+	double waitSeconds;
+};
+
+std::string timingLogName = "";
+std::ofstream timingLog;
+bool timingLogJSON = false;
+int timedFrames = 0;
+int currentFrameTimer = -1;
+FrameTimer frameTimers[FRAME_TIMER_SLICES] = {};
+bool timingFrames = false;
+
+// With --gpu-counters [patterns], the hardware counters of the GPU whose names have one of the patterns in them
+// (see GpuCounters.h) are sampled for the transform and the draw of every frame, in the same ring as the frame
+// timers, and written to a CSV file next to the timing log (times.csv gets times.counters.csv), a line per pass
+#define GPU_COUNTER_DEFAULT_PATTERNS "occupancy,busy,hit,bandwidth,throughput,fetchsize,waves"
+bool gpuCounters = false;
+std::string gpuCounterPatterns = GPU_COUNTER_DEFAULT_PATTERNS;
+std::ofstream counterLog;
+
+// The times of every frame, in milliseconds, for the report at the end of the video. The array is made
+// big enough for every frame before the first one is rendered, so nothing is allocated while rendering.
+// The frame time that matters for a preview is the slowest ones, not the average, so the report prints
+// the 50th, 95th, and 99th percentile and the max of each part of the frame (--no-frame-report turns it off)
+struct FrameTimes
+{
+	double scene;
+	double draw;
+	double readback;
+	double gpu;
+	double cpu;
+	double save;
+	double wait;
+};
+
+bool frameReport = true;
+std::vector<FrameTimes> frameTimes;
+
+// With --latency, the time from a key of the window to when the frame that used it was shown (input to photon) is
+// measured, and printed as percentiles at the end. A key gets the time it came in (pendingInputTime keeps the oldest
+// one that no frame has used yet), the next frame that is rendered takes it (frameInputTime), and a GPU timestamp
+// after the glfwSwapBuffers of that frame is when it was shown. The timestamps are in a ring of LATENCY_SLICES
+// queries, which are read once the GPU is done with them, and the GPU counts from some other time than the CPU, so
+// the offset is found once, like gpuTraceOffset. With --ui-thread, the swap is the main thread's, and the time of
+// the input goes with the frame to it
+#define LATENCY_SLICES 8
+
+struct LatencyTracker
+{
+	GLuint queries[LATENCY_SLICES];
+	double inputTimes[LATENCY_SLICES];
+	bool pending[LATENCY_SLICES];
+	int next;
+	double offset;
+};
+
+bool latencyReport = false;
+double pendingInputTime = -1.0;
+double frameInputTime = -1.0;
+LatencyTracker latencyTracker = {};
+std::vector<double> latencyMs;
+
+// With --low-latency [frames], the CPU is only that many frames (1) ahead of the GPU: after a frame is presented, the
+// render thread waits for the fence of the frame that many before it, so the frames do not wait in the queue of the
+// driver, and an input is in the next frame that is shown. 0 waits for every frame
+#define LOW_LATENCY_MAX_FRAMES 4
+
+int lowLatencyFrames = -1;
+GLsync queuedFrameFences[LOW_LATENCY_MAX_FRAMES + 1] = {};
+int queuedFrames = 0;
+
+// With --cpu-trace <file>, the CPU zones of Profiler.h (the render, the swaps, the readbacks, and the encoding),
+// and the GPU passes of the frame timers, are saved as a Chrome trace file at the end.
+// The GPU timestamps count from some other time than the CPU, so gpuTraceOffset (microseconds)
+// is found once, by asking the GPU what time it is right now (GL_TIMESTAMP)
+std::string cpuTraceName = "";
+double gpuTraceOffset = 0.0;
+
+// --capture <file> writes what every frame of the video was made from into the file (see FrameCapture.h), and
+// --replay <file> [first-last] renders those frames again, headless, with nothing saved, and prints how long every
+// one took. A replay is always profiled: the frame report, --timing-log if it is given, and the CPU trace, which is
+// <file>.trace.json without --cpu-trace. Only the inputs of the frames are in the file, so the rest of the command
+// line (the scene, the renderer, the size) should be the one of the capture. While replaying, sceneAtTime gives
+// out the matrices and lights of replayFrame instead of making them
+std::string captureName = "";
+FrameCaptureWriter frameCapture;
+bool capturingFrames = false;
+std::string replayName = "";
+int replayFirst = 0;
+int replayLast = std::numeric_limits<int>::max();
+const CapturedFrame* replayFrame = nullptr;
+
+// --estimate [n] tells the farm how long the frames of --frames will take, without rendering them: it renders n frames
+// spread evenly over them, headless, with estimateScale of the width and height, and exits. Every frame is timed like
+// --bench, and then rendered again counting its rays. The scene passes take as long at any size, but the draw is
+// per pixel, so its GPU time (from the frame timers) is scaled back up to estimatePixels, the pixels of the render
+// size. The frames between two samples take the time between theirs, and all of them together are the estimate
+int estimateSamples = 0;
+float estimateScale = 0.5f;
+double estimatePixels = 0.0;
+
+// If this is true, main() renders the same frames with every acceleration structure,
+// and prints how long each one took, before it starts rendering the video. (--bench-accel)
+bool benchmarkAccels = false;
+
+// One box per mesh, written by Compute.glsl: min (3 uints), first triangle,
+// max (3 uints), number of triangles. See MeshBox in Compute.glsl
+GLuint meshBoxBuffer;
+int meshBoxBufferSize = 0;
+
+// The uniform grid has GRID_RES cells on each axis. This must match BuildGrid.glsl and FragmentShader.glsl.
+// gridBuffer holds the box of the scene (8 uints), where the list of every cell starts
+// (GRID_CELLS + 1 uints), and the number of triangles in every cell (GRID_CELLS uints).
+// Then come the lists of every cell. A triangle can be in every cell at most,
+// so loadScene makes room for GRID_CELLS references per triangle
+#define GRID_RES 8
+#define GRID_CELLS (GRID_RES * GRID_RES * GRID_RES)
+#define GRID_HEADER_SIZE (sizeof(GLuint) * (8 + GRID_CELLS + 1 + GRID_CELLS))
+GLuint gridBuffer;
+int gridBufferSize = 0;
+
+// With --instance-grid, the instances of the scene file with "grid" and the cubes of --cube-instances, swarms of small
+// instances that move, are left out of the TLAS, and BuildInstanceGrid.glsl puts them into a hashed uniform grid on the
+// GPU every frame instead, which the two-level BVH walks together with the TLAS. They are after the TLAS leaves in
+// instanceBuffer. instanceGridBuffer holds the instanceGrid header (see SceneStructs.h), the count and the start of
+// every bucket, and the lists, with room for 8 per instance, because a cell is as big as the biggest instance
+bool useInstanceGrid = false;
+GLuint instanceGridBuffer;
+int instanceGridBufferSize = 0;
+
+// how many times it was built, and the most instances it had
+int instanceGridBuilds = 0;
+int instanceGridMost = 0;
+
+// The TLAS nodes come first, then the BLAS nodes of every mesh.
+// A TLAS with one mesh per leaf has at most (2 * numSceneMeshes - 1) nodes
+int tlasMaxNodes = 0;
+GLuint twoLevelNodeBuffer;
+int twoLevelNodeBufferSize = 0;
+
+// One instance per mesh, in the order that the TLAS leaves need them
+GLuint instanceBuffer;
+int instanceBufferSize = 0;
+
+// The BLAS of every mesh, where its root is in twoLevelNodeBuffer,
+// and the box around the mesh before it is moved by its matrix
+std::vector<int> blasRoots;
+std::vector<AABB> meshBounds;
+
+// Every BLAS is also stored as a wide BVH (4 children per node, with small
+// quantized boxes, see collapseBVH4). blasNodeFormat picks which one the rays walk
+#define BVH_FORMAT_BINARY 0
+#define BVH_FORMAT_WIDE4 1
+int blasNodeFormat = BVH_FORMAT_BINARY;
+const char* bvhFormatNames[2] = { "binary", "wide4" };
+
+GLuint wideNodeBuffer;
+int wideNodeBufferSize = 0;
+std::vector<int> wideBlasRoots;
+
+// The coarser copies of every mesh for --lod-geometry. Copy l of mesh m is MESH_LODS * m + l,
+// and has a BLAS in both formats like the mesh. Its triangles are in lodTriangles, which go into
+// triangleBuffer after the triangles of the meshes. A mesh that is too small has the mesh itself as its copies
+std::vector<int> lodBlasRoots;
+std::vector<int> lodWideBlasRoots;
+std::vector<int> lodFirstTriangles;
+std::vector<triangle> lodTriangles;
+
+// If this is true, main() renders the same frames with both formats first, and prints
+// how long each one took, before it starts rendering the video
+bool benchmarkBVHFormats = false;
+int benchmarkFrames = 100;
+
+// --bvh-hot-layout [frames] renders the first frames of the video with the binary BLAS, and counts how many times the
+// rays visit every node of the two-level BVH (nodeVisits in RayTracing.glsl, after the ray counters). Then the nodes
+// of every BLAS are put in a new order (see layoutBVHByVisits in BVH.h), in treelets of BVH_HOT_TREELET_NODES nodes
+// (128 bytes, a cache line of most GPUs), with the most visited first. The BLAS never change, so the order that was
+// found is used for every frame after. --bench-hot-layout times the frames before and after
+#define BVH_HOT_TREELET_NODES 4
+int bvhHotLayoutFrames = 0;
+bool countingNodeVisits = false;
+bool benchmarkHotLayout = false;
+
+// --bench renders the first benchmarkFrames frames of the video headless, with nothing saved and no vsync,
+// prints the rays per second and the frame times, and exits. The frames are timed one at a time (with glFinish),
+// then rendered again with countingRays, where FragmentShader.glsl and TiledRender.glsl count their shadow and
+// reflection rays into rayCountBuffer. The counts are not taken while timing, so the atomics don't slow it down.
+// The wavefront renderer has no counters, so its rays are counted with the fragment shader, which traces the same ones
+bool benchmarkRender = false;
+bool countingRays = false;
+GLuint rayCountBuffer;
+
+// --bench-embree is --bench, and then the rays of the first frame, which the CPU renderer collects, are traced
+// by its BVH and by Embree (see EmbreeBaseline.h), so the three can be put side by side. benchmarkMrays is what
+// runRenderBenchmark measured on the GPU, in millions of primary, shadow, and reflection rays per second
+bool benchmarkEmbree = false;
+double benchmarkMrays[3] = {};
+
+// --ray-stats counts the rays of every frame of the video (see rayCounts in SceneStructs.h), to see if a change
+// really made less work, or only moved it somewhere else. Once a second the counts are copied into
+// rayStatsReadBuffer and set back to 0 on the GPU, and a fence is put after the copy. The copy is only read
+// once the fence has passed, so the CPU never waits for it, and then the counts per frame are printed
+bool rayStats = false;
+GLuint rayStatsReadBuffer;
+GLsync rayStatsFence = 0;
+int rayStatsFrames = 0;
+int rayStatsCopiedFrames = 0;
+double rayStatsTime = 0.0;
+
+// --save-golden <folder> renders goldenFrames of the video headless, and saves them in the folder as raw
+// frames (<frame>.bgr, like --frame-format raw), with how long every frame took in times.txt.
+// --check-golden <folder> renders the same frames and compares them with the saved ones. A frame fails if its
+// PSNR is below goldenPSNR (so small changes, like a different epsilon, are caught), or if it took more than
+// goldenSlowdown times as long as before. The program exits with 1 if any frame failed, so a script can run it.
+// Every frame is timed goldenRepeats times, and the median is used, so one slow frame does not fail it
+#define GOLDEN_OFF 0
+#define GOLDEN_SAVE 1
+#define GOLDEN_CHECK 2
+int goldenMode = GOLDEN_OFF;
+std::string goldenFolder = "";
+std::vector<int> goldenFrames = { 1, 150, 300, 450, 600 };
+float goldenPSNR = 40.0f;
+float goldenSlowdown = 1.25f;
+int goldenRepeats = 5;
+
+// --still <WxH> renders one frame (the first of --frames) as a still of any size, in tiles of stillTile pixels, which
+// are the output size of the render, so the still can be much bigger than a framebuffer or the memory of the GPU. A tile
+// is a window of the camera of the whole still (cameraWindow, which calcCameraRays cuts the corner rays to), and it goes
+// into stillFile, a tiled TIFF (see TiledTiff.h), as soon as it is read back, so only one tile is ever in memory
+int stillWidth = 0;
+int stillHeight = 0;
+int stillTile = 1024;
+std::string stillFile = "still.tif";
+
+// The part of the image that the camera rays are made for: the corners u0, v0, u1, v1, where 0, 0, 1, 1 is all of it,
+// and v goes up, like the rows of the framebuffer. It can go past 1, for the tiles at the edges of a still
+glm::vec4 cameraWindow = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+// --startup-times prints how long every step of init took (glewInit, reading, compiling, and linking every
+// shader, making the buffers, and building the BLAS), and how long it was from the start of the program until
+// the first frame. A link is only timed like this if the link status is asked for right away, which waits for
+// the driver to finish it. The programs of the renderers that may not be used (the wavefront renderer, the compute
+// renderer, and the visibility buffer) are not made in init, but the first time they are used (see makeWavefrontPrograms)
+bool printStartupTimes = false;
+
+// --memory-report prints how much GPU memory every category of buffers and images had at the end,
+// and the most it ever had (see GpuMemory.h), and how much memory the driver says is free
+bool memoryReport = false;
+
+// --gl-debug [ms] asks for a debug context, and prints the messages of the driver (like a buffer that it had to
+// make again, or a call that waited for the GPU) the first time each kind comes, and counts them per frame.
+// The calls that can make the CPU wait for the GPU are timed, and one that took longer than glStallMs is a
+// stall (see GlDebug.h). At the end, every kind of message and stall is printed with its counts
+#define GL_STALL_DEFAULT_MS 1.0
+bool glDebug = false;
+double glStallMs = GL_STALL_DEFAULT_MS;
+std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+
+// The BLAS of every mesh is saved in this folder, in a file named after the hash of the mesh.
+// If the meshes don't change, the next run reads the files instead of building the BLAS again.
+// Delete the folder to force every BLAS to be built again
+const char* bvhCacheFolder = "bvhCache";
+
+// Every linked program is saved in this folder (glGetProgramBinary), in a file named after the program and a hash
+// of its source code (with the #defines that addShaderDefines put in), and of the GPU and driver version. The next run
+// loads the file with glProgramBinary instead of compiling the shaders. If the driver does not take the binary
+// (a new driver can do that even with the same version string), the shaders are compiled like before, and the file
+// is saved again. --no-shader-cache always compiles. Change SHADER_CACHE_VERSION if the file itself changes
+const char* shaderCacheFolder = "shaderCache";
+bool useShaderCache = true;
+#define SHADER_CACHE_VERSION 1
+
+// --shared-cache <url> is a cache that every node of a farm shares, behind shaderCacheFolder and bvhCacheFolder: S3-compatible
+// object storage, or any HTTP server that takes GET and PUT (see ObjectStorage.h). A file that this node does not have yet
+// is looked for at url/folder/name before the program is compiled or the BLAS is built, and a file that this node had to
+// make is put there, so the cold start is paid once by the farm instead of once by every node. The names of the files
+// are the hashes of what is in them, and of the GPU and driver for the programs, so a node only finds the ones it can use.
+// Once the server can't be reached, or takes no file, it is left alone for the rest of the run
+std::string sharedCacheUrl = "";
+bool sharedCacheWorks = true;
+int sharedCacheFetched = 0;
+int sharedCacheStored = 0;
+
+// --autotune times the candidates of the choices that are fastest on one GPU and slower on another (the node format
+// of the BLAS, the form of the triangles, the ray-triangle test, the workgroup size of the transform pass, and the
+// size of the traversal stack) on the scene, and saves the fastest of each into a profile in this folder, in a file
+// named after a hash of the vendor and renderer strings. Every later run on that GPU loads its profile in init, before
+// the programs are compiled, unless --no-tune-profile. It only tunes if the GPU has no profile yet, or with --autotune
+// force (after a driver update, say). A choice that is on the command line is kept, and is not tuned or loaded.
+// The stack is the only choice that can be wrong instead of slow: a stack that is too small for the trees of a scene
+// loses nodes. So a size is only kept if the frames look the same as with BVH_STACK_SIZE_DEFAULT, and it is only
+// loaded for the scene and acceleration structure that it was tried on. Change TUNE_PROFILE_VERSION if the file changes
+const char* tuneCacheFolder = "tuneCache";
+#define TUNE_PROFILE_VERSION 1
+bool autotune = false;
+bool retune = false;
+bool useTuneProfile = true;
+bool tuneProfileLoaded = false;
+int tuneFrames = 30;
+std::set<std::string> choicesOnCommandLine;
+
+// The size of the stacks of the traversal in RayTracing.glsl, a #define (see specializeShader).
+// The default is enough for both levels of the two-level BVH on any scene
+#define BVH_STACK_SIZE_DEFAULT 64
+int bvhStackSize = BVH_STACK_SIZE_DEFAULT;
+int tunedStackSize = 0;
+uint64_t tunedStackScene = 0;
+int tunedStackAccel = -1;
+
+// --spirv loads the shaders that CompileSpirv.bat compiled ahead of time from this folder (glShaderBinary
+// and glSpecializeShader, from GL 4.6 or ARB_gl_spirv), so the driver does not have to parse their GLSL.
+// Only the shaders that main.cpp adds no #define to can be compiled ahead of time (see startSpirvProgram).
+// If a file is missing, or the driver can't take SPIR-V, the GLSL is compiled like before
+const char* spirvFolder = "../Assets/spirv";
+bool useSpirv = false;
+
+// One shader of a program: what kind it is, its code, and the name of its file
+struct ShaderStage
+{
+	GLenum type;
+	std::string source;
+	std::string fileName;
+};
+
+// A program that startProgram started, and finishProgram finishes
+struct PendingProgram
+{
+	std::string name;
+	GLuint program;
+	std::vector<GLuint> shaders;	// empty if the program was loaded from the cache
+	bool caching;
+	uint64_t hash;
+	std::string fileName;
+	double start;
+};
+
+// --hot-reload watches the files of draw_program and transform_program (the shaders, and the files they include).
+// When one of them is saved, both programs are compiled again while the old ones keep rendering, and the new ones
+// are swapped in once they link. If they do not compile, the errors are printed and the old programs stay.
+// With GL_KHR_parallel_shader_compile, the driver compiles on its own threads, and we only check every
+// frame if it is done, so the window never stops. Without it the compile waits, but nothing else is lost.
+// After a swap the frame times start over, so the new shaders can be compared with the old ones right away
+bool hotReload = false;
+std::map<std::string, time_t> watchedShaderFiles;	// every file, and when it was last changed
+std::set<std::string> shaderFilesRead;				// the files that readShaderFile has read
+double lastShaderCheck = 0.0;
+bool reloading = false;
+PendingProgram reloadDraw;
+PendingProgram reloadTransform;
+
+// This is your reference to your shader program.
+// This will be assigned with glCreateProgram().
+// This program will run on your GPU.
+GLuint draw_program;
+GLuint transform_program;
+GLuint bvh_program;
+GLuint radix_program;
+GLuint grid_program;
+GLuint instance_grid_program;
+GLuint wavefront_program;
+GLuint visibility_program;
+GLuint light_cull_program;
+GLuint resolve_program;
+GLuint tiled_render_program;
+GLuint triangle_bin_program;
+GLuint light_occluder_program = 0;
+GLuint irradiance_program = 0;
+GLuint checkerboard_program;
+GLuint denoise_program;
+
+// The camera is not a uniform of every program, it is a uniform block that they all share (see Camera.glsl):
+// the eye and the four corner rays of every view. See: https://camo.githubusercontent.com/21a84a8b21d6a4bc98b9992e8eaeb7d7acb1185d/687474703a2f2f63646e2e6c776a676c2e6f72672f7475746f7269616c732f3134313230385f676c736c5f636f6d707574652f726179696e746572706f6c6174696f6e2e706e67
+// --views renders numViews views in one pass of the fragment shader, in a grid on the image, for stereo, turntables,
+// and previews from more than one angle. The views turn around the center of the camera by viewAngle degrees
+// each (0 spreads them around the whole circle), and the scene, the transform, and the BVH are only done once for all of them
+GLuint cameraBuffer;
+int cameraBufferSize = 16 + sizeof(cameraView) * MAX_VIEWS;
+int numViews = 1;
+float viewAngle = 0.0f;
+
+// With --camera <model> [fov], the camera rays are not the mix of the four corner rays, but the ray of every pixel in
+// cameraRayTexture (see CameraRays.glsl), for a fisheye, the whole sphere of a 360 render (equirect), a cylinder
+// (panoramic), or a pinhole that is made the same way. The texture is only made again when the direction of the camera,
+// the fov, the render size, or the jitter of --accumulate changed (cameraRayKey), which is what the rays depend on.
+// cameraModelFov 0 is the fov of the camera for the pinhole, 180 degrees for the fisheye, and 360 for the panoramic
+int cameraModel = -1;
+float cameraModelFov = 0.0f;
+const char* cameraModelNames[] = { "pinhole", "fisheye", "equirect", "panoramic" };
+GLuint camera_rays_program = 0;
+GLuint cameraRayTexture = 0;
+int cameraRayWidth = 0;
+int cameraRayHeight = 0;
+std::vector<float> cameraRayKey;
+int cameraRayUpdates = 0;
+GLuint cameraRays_imageWidth_loc;
+GLuint cameraRays_imageHeight_loc;
+GLuint cameraRays_cameraModel_loc;
+GLuint cameraRays_fov_loc;
+GLuint cameraRays_forward_loc;
+GLuint cameraRays_right_loc;
+GLuint cameraRays_up_loc;
+GLuint cameraRays_jitter_loc;
+
+// These are your uniform variables.
+
+// Uniform variables of the BVH build shader
+GLuint transform_pass_loc;
+GLuint transform_numVertices_loc;
+GLuint transform_numTriangles_loc;
+GLuint transform_numMeshes_loc;
+GLuint transform_dirtyOnly_loc;
+GLuint transform_numDirty_loc;
+GLuint transform_numJobs_loc;
+GLuint transform_emitKeys_loc;
+GLuint transform_skinning_loc;
+GLuint transform_meshSpace_loc;
+GLuint transform_firstRefit_loc;
+
+GLuint bvh_pass_loc;
+GLuint bvh_numLeaves_loc;
+GLuint bvh_earlySplit_loc;
+GLuint bvh_treeletSize_loc;
+
+// Uniform variables of the radix sort shader
+GLuint radix_pass_loc;
+GLuint radix_numKeys_loc;
+GLuint radix_numBlocks_loc;
+GLuint radix_bitShift_loc;
+
+// Uniform variables of the grid build shader
+GLuint grid_pass_loc;
+GLuint grid_numTriangles_loc;
+GLuint instanceGrid_pass_loc;
+
+// Uniforms of the fragment shader that pick which acceleration structure the rays use
+GLuint accel_loc;
+GLuint wideBLAS_loc;
+
+// Uniforms of the fragment shader for the lights, and the light lists of the tiles
+GLuint numLights_loc;
+GLuint visibilityBuffer_loc;
+GLuint reflectionPass_loc;
+GLuint reducedReflections_loc;
+GLuint reflectionScale_loc;
+GLuint shadowPass_loc;
+GLuint reducedShadows_loc;
+GLuint shadowScale_loc;
+GLuint shadowGridSize_loc;
+GLuint shadowWords_loc;
+GLuint hitPass_loc;
+GLuint hitBuffer_loc;
+GLuint adaptiveSamples_loc;
+GLuint temporal_loc;
+GLuint historyValid_loc;
+GLuint temporalRefresh_loc;
+GLuint prevViewProj_loc;
+GLuint prevEye_loc;
+GLuint checkerboard_loc;
+
+// Uniforms of the visibility buffer program
+GLuint vis_viewProj_loc;
+GLuint vis_eye_loc;
+
+// Uniforms of the denoise program
+GLuint denoise_stepSize_loc;
+GLuint denoise_firstPass_loc;
+GLuint denoise_lastPass_loc;
+GLuint tiledLights_loc;
+GLuint countRays_loc;
+GLuint costView_loc;
+GLuint costScale_loc;
+GLuint tilesX_loc;
+GLuint floorTexture_loc;
+GLuint floorTextureScale_loc;
+GLuint pixelSpread_loc;
+GLuint probePass_loc;
+GLuint numProbes_loc;
+GLuint probeCenters_loc;
+GLuint probeBoxMin_loc;
+GLuint probeBoxMax_loc;
+GLuint probeBounce_loc;
+GLuint probeDistance_loc;
+GLuint probeSpread_loc;
+
+// Uniforms of LightCull.glsl. The camera uses the same locations as the fragment shader
+GLuint cull_numLights_loc;
+GLuint cull_imageWidth_loc;
+GLuint cull_imageHeight_loc;
+GLuint cull_tilesX_loc;
+
+// Uniform variables of the wavefront shaders. The camera uses the same locations as the fragment shader
+GLuint wave_stage_loc;
+GLuint wave_bounce_loc;
+GLuint wave_rayInOffset_loc;
+GLuint wave_rayOutOffset_loc;
+GLuint wave_imageWidth_loc;
+GLuint wave_imageHeight_loc;
+GLuint wave_accel_loc;
+GLuint wave_wideBLAS_loc;
+GLuint wave_sortRays_loc;
+GLuint wave_subgroupTraversal_loc;
+GLuint wave_compactQueues_loc;
+GLuint wave_numLights_loc;
+GLuint wave_sortBoundsMin_loc;
+GLuint wave_sortBoundsMax_loc;
+GLuint resolve_imageWidth_loc;
+
+// uniforms of the compute renderer, which are not at fixed locations
+GLuint tiled_accel_loc;
+GLuint tiled_wideBLAS_loc;
+GLuint tiled_numLights_loc;
+GLuint tiled_tiledLights_loc;
+GLuint tiled_countRays_loc;
+GLuint tiled_tilesX_loc;
+GLuint tiled_variableRate_loc;
+GLuint tiled_fillPass_loc;
+GLuint tiled_foveaCenter_loc;
+GLuint tiled_foveaRadius_loc;
+GLuint tiled_importanceMapped_loc;
+GLuint tiled_persistent_loc;
+GLuint tiled_costOrder_loc;
+GLuint tiled_binned_loc;
+GLuint tiled_tileFrustum_loc;
+GLuint tiled_pixelOrder_loc;
+
+// Uniforms of TriangleBin.glsl (--bin-triangles)
+GLuint bin_pass_loc;
+GLuint bin_numTriangles_loc;
+GLuint bin_viewProj_loc;
+GLuint bin_imageWidth_loc;
+GLuint bin_imageHeight_loc;
+GLuint bin_tilesX_loc;
+GLuint bin_tilesY_loc;
+GLuint bin_capacity_loc;
+
+// Uniforms of LightOccluders.glsl (--light-occluders)
+GLuint occluder_numTriangles_loc;
+GLuint occluder_numLights_loc;
+
+// Uniforms of IrradianceProbes.glsl (--irradiance-probes)
+GLuint irradiance_accel_loc;
+GLuint irradiance_wideBLAS_loc;
+GLuint irradiance_numLights_loc;
+GLuint irradiance_firstProbe_loc;
+GLuint irradiance_probeBlend_loc;
+
+// These must match the passes in BuildBVH.glsl
+#define BVH_PASS_BOUNDS 0
+#define BVH_PASS_MORTON 1
+#define BVH_PASS_HIERARCHY 2
+#define BVH_PASS_LEAVES 3
+#define BVH_PASS_PROPAGATE 4
+#define BVH_PASS_COST 5
+#define BVH_PASS_RESTRUCTURE 6
+
+// These must match the passes in BuildGrid.glsl
+#define GRID_PASS_BOUNDS 0
+#define GRID_PASS_COUNT 1
+#define GRID_PASS_SCAN 2
+#define GRID_PASS_FILL 3
+
+// These must match the passes in BuildInstanceGrid.glsl
+#define INSTANCE_GRID_PASS_BOUNDS 0
+#define INSTANCE_GRID_PASS_COUNT 1
+#define INSTANCE_GRID_PASS_SCAN 2
+#define INSTANCE_GRID_PASS_FILL 3
+
+// These must match the stages in Wavefront.glsl
+#define WAVE_STAGE_GENERATE 0
+#define WAVE_STAGE_EXTEND 1
+#define WAVE_STAGE_SHADE 2
+#define WAVE_STAGE_SHADOW 3
+#define WAVE_STAGE_SORT_KEYS 4
+#define WAVE_STAGE_ARGS 5
+
+// Where the DispatchIndirectCommands of EXTEND, SHADE, and SHADOW are in waveCountBuffer, after the 4 counts.
+// Each one has a uint that is not used at the end, so that they are uvec4s in Wavefront.glsl
+#define WAVE_ARGS_OFFSET(stage) (sizeof(GLuint) * (4 + 4 * (stage)))
+#define WAVE_ARGS_EXTEND 0
+#define WAVE_ARGS_SHADE 1
+#define WAVE_ARGS_SHADOW 2
+
+// These must match the passes in RadixSort.glsl
+#define RADIX_PASS_HISTOGRAM 0
+#define RADIX_PASS_SCAN 1
+#define RADIX_PASS_SCATTER 2
+
+// A variable used to describe the position of the camera.
+glm::vec3 cameraPos;
+
+// Where the camera is at the start of every frame, the point it looks at, which way is up, and how wide
+// it sees up and down, in degrees. These are the camera of the tutorial, unless the scene file has one
+glm::vec3 cameraStart = glm::vec3(0.0f, 8.0f, 8.0f);
+glm::vec3 cameraTarget = glm::vec3(0.0f, 0.5f, 0.0f);
+glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+float cameraFov = 45.0f;
+
+// A reference to our window.
+GLFWwindow* window;
+
+// With --headless, the frames go into outputFBO, a framebuffer of the output size that never changes
+// size, instead of into the window. The window stays hidden (OpenGL still needs it for the context),
+// nothing is swapped to the screen, and there is no vsync, so the frames come as fast as the GPU can make them.
+// Everything that draws "to the screen" binds screenFBO, which is outputFBO unless the render is scaled,
+// and outputFBO is 0 (the window) without --headless
+bool headless = false;
+
+// With --egl, the context is made with EGL on a GPU device (see Platform.h), on a render node without a display
+// server, instead of in the window of GLFW. It is headless, and with --gpu <i>, it is on device i
+bool useEgl = false;
+GLuint screenFBO = 0;
+GLuint screenColor = 0;
+GLuint outputFBO = 0;
+GLuint outputColor = 0;
+
+// With --ui-thread, the window that is shown is previewWindow, and its events are handled on the main thread (GLFW
+// only handles them there), while the frames are rendered on a thread of their own, in the context of window, which
+// is hidden like --headless. A drag or a resize of the window does not stop the render, and a slow frame does not
+// stop the window. The render thread copies every frame into one of the shared uiPreviewTextures and hands it over
+// with a fence (uiReadySlot), and the main thread draws the newest one into the window. There are three, so that
+// the render thread always has one that is neither shown nor waiting to be. The keys of the window and its title
+// go between the threads through uiMutex too
+#define UI_PREVIEW_SLOTS 3
+
+bool uiThread = false;
+GLFWwindow* previewWindow = nullptr;
+GLuint uiPreviewTextures[UI_PREVIEW_SLOTS] = {};
+GLuint uiPreviewFBOs[UI_PREVIEW_SLOTS] = {};
+std::mutex uiMutex;
+bool uiRendering = false;
+int uiShownSlot = -1;
+int uiReadySlot = -1;
+GLsync uiReadyFence = 0;
+
+// the time of the oldest input that the frame waiting to be shown used (see --latency), and of the oldest key
+// that the render thread did not press yet
+double uiReadyInputTime = -1.0;
+double uiInputTime = -1.0;
+
+// the fence after the main thread drew a slot, which the render thread waits for before it copies into it again
+GLsync uiShownFences[UI_PREVIEW_SLOTS] = {};
+std::vector<int> uiKeys;
+std::string uiTitle;
+bool uiTitleChanged = false;
+
+// With --cpu-render [threads], every frame is rendered on the CPU by CpuRenderer.cpp instead, for computers
+// without a GPU. There is no window and no OpenGL at all, the frames are rendered at the output size,
+// and they are saved the same way as the frames that are read back from the GPU (see saveFrame).
+// cpuThreads is how many threads trace the tiles, 0 is one for every core. The tiles are jobs,
+// so this is the render thread and the threads of the job system, which it sets (see jobThreads)
+bool cpuRender = false;
+int cpuThreads = 0;
+double cpuRenderSeconds = 0.0;
+
+// Everything the CPU renderer needs for one frame. prepareCpuFrame makes the matrices, lights, camera,
+// and path on the render thread, and a job builds the scene from them. There are two, so that the scene of
+// the next frame is built while the tiles of this one are traced
+struct CpuFrame
+{
+	CpuScene scene;
+	cameraView camera;
+	CpuPathSettings path;
+	JobHandle built;
+};
+
+CpuFrame cpuFrames[2];
+int currentCpuFrame = 0;
+
+// The kernel that tests a ray against a leaf of triangles on the CPU (see CpuKernels.h), -1 until it is
+// picked, which is the fastest one this CPU has, unless --cpu-kernel asks for another.
+// --bench-cpu-kernels tests camera rays against every leaf this many times, with a square of this many rays across
+int cpuKernel = -1;
+bool benchmarkCpuKernels = false;
+#define CPU_KERNEL_BENCH_SIZE 128
+#define CPU_KERNEL_BENCH_REPEATS 16
+
+// The tracks of --animation <file> (see Animation.h), which move the meshes instead of the motion of the tutorial
+// in sceneMatrices, if the file could be read. --bench-animation [n] times n random tracks with SSE and without
+std::string animationFile;
+AnimationTracks sceneAnimation;
+bool benchmarkAnimation = false;
+int animationBenchTracks = 10000;
+#define ANIMATION_BENCH_REPEATS 100
+
+// The scene file of --scene <file> (see SceneFile.h), which adds models, instances, and lights to the scene,
+// and can move the camera and the meshes, without changing the code. The file is watched while the program runs
+// (see updateSceneFile), and a change to the camera, the lights, the places of the models and instances, or the
+// animation is used from the next frame on: those only change the matrices and the lights, which are uploaded
+// every frame anyway, and the TLAS, which is built every frame. The triangles and the BLAS of the meshes are
+// only made at the start, so other models, or more or fewer instances, need a restart (the instances do not
+// with --incremental-tlas, see editSceneInstances).
+// sceneFileMeshes is the mesh of every model (-1 if it could not be read), and sceneFileInstances
+// is the instance of every instance in sceneInstances (-1 if it is not one, see loadScene)
+std::string sceneFileName;
+SceneFile sceneFile;
+time_t sceneFileTime = 0;
+double lastSceneFileCheck = 0.0;
+std::vector<int> sceneFileMeshes;
+std::vector<int> sceneFileInstances;
+
+// Where every mesh is before it moves, which is where the scene file put it, and nowhere for the other meshes
+std::vector<glm::mat4x4> meshPlacements;
+
+// With --hybrid [share], the CPU renderer traces a strip at the top of every frame while the GPU traces
+// the rows under it, and the strip is put into the frame before it is saved. hybridCpuRows is how many rows
+// the strip has. It starts at share (0.1) of the output, and after every frame it moves so that the CPU and
+// the GPU would take as long as each other (see balanceHybridRows).
+// hybridDrawRows is how many rows renderScene draws, 0 for all of them, which is what it is outside of a hybrid frame
+bool hybridRender = false;
+float hybridShare = 0.1f;
+int hybridCpuRows = 0;
+int hybridDrawRows = 0;
+GLuint hybridTimerQuery = 0;
+double hybridCpuSeconds = 0.0;
+double hybridShareSum = 0.0;
+int hybridFrames = 0;
+
+// Variables you will need to calculate FPS.
+int tempFrame = 0;
+int totalFrame = 0;
+double dtime = 0.0;
+double timebase = 0.0;
+double totalTime = 0.0;
+int fps = 0;
+
+// width and height are the size of the image that is rendered, so they are how many rays there are.
+// outputWidth and outputHeight are the size of the window and of the frames that are saved.
+// They are the same unless the render is scaled (--render-size WxH, or --render-scale 0.5 for a preview
+// with a quarter of the rays, and --output-size WxH). Then the image is rendered into screenFBO,
+// and presentFrame stretches it over the output with a linear filter on the GPU
+int width = 1280;
+int height = 720;
+int outputWidth = 1280;
+int outputHeight = 720;
+bool renderSizeGiven = false;
+float renderScale = 1.0f;
+
+// With --target-ms <ms>, the render size changes from frame to frame, so that the GPU takes about that long for a frame
+// (like 16.6 for 60 frames per second), and presentFrame stretches the image over the window. The GPU time of every frame
+// is measured with two timestamps, in a ring of FRAME_TIMER_SLICES timers, and read a few frames later, when it is
+// done (see updateDynamicResolution). The scale is never more than --render-scale (or the scale of the preset)
+float targetFrameMs = 0.0f;
+float dynamicScale = 1.0f;
+float dynamicScaleMax = 1.0f;
+#define DYNAMIC_SCALE_MIN 0.25f
+
+struct ResolutionTimer
+{
+	GLuint queries[2];
+	float scale;	// the scale that the frame was rendered at
+	bool pending;	// the frame was timed, and the time was not read yet
+};
+
+ResolutionTimer resolutionTimers[FRAME_TIMER_SLICES] = {};
+int currentResolutionTimer = -1;
+
+// A draw that keeps the GPU busy for more than 2 seconds makes Windows reset the driver (TDR), which an 8K frame with
+// deep reflections can do in one quad. With --slice-ms <ms>, the quad of the fragment shader is drawn in bands of
+// sliceRows rows instead, each one flushed as a submission of its own, so that none of them takes much more than ms.
+// There is a timestamp between the bands, in a ring of FRAME_TIMER_SLICES timers like the ones of --target-ms, and
+// when the times of a frame are read, the rows of a band become as many as SLICE_MARGIN of ms fits at the time per
+// row of its slowest band (the reflections are not spread evenly), so a frame that is slower than that one still fits
+#define SLICE_START_ROWS 32
+#define SLICE_MARGIN 0.5f
+float sliceBudgetMs = 0.0f;
+int sliceRows = SLICE_START_ROWS;
+
+struct SliceTimer
+{
+	std::vector<GLuint> queries;	// the timestamp before the first band, and after every band
+	std::vector<int> bandRows;		// the rows of every band
+	bool pending;					// the frame was timed, and the times were not read yet
+};
+
+SliceTimer sliceTimers[FRAME_TIMER_SLICES] = {};
+int currentSliceTimer = 0;
+
+// --realtime animates with the time since the program started instead of the time of the frame in the video,
+// for a preview that moves at the right speed, however fast it renders (see renderScene)
+bool realtimeAnimation = false;
+
+// Named quality presets (--preset draft, preview, or final), instead of changing the bounces and the render
+// size by hand for a quick preview. Every preset has its own draw program, because the bounces are compiled in
+// (see sceneShaderDefines), and init compiles all of them, so switching to another one (keys 1, 2, and 3 in the
+// window) does not wait for a compile. "final" has the bounces of --max-bounces. Without --preset, there
+// is only the one draw program, like before. The presets only change the fragment shader renderer
+#define QUALITY_PRESETS 3
+
+struct QualityPreset
+{
+	const char* name;
+	int maxBounces;		// -1 is the --max-bounces of the command line
+	float renderScale;	// times the output size
+};
+
+QualityPreset qualityPresets[QUALITY_PRESETS] = {
+	{ "draft", 0, 0.5f },
+	{ "preview", 1, 0.75f },
+	{ "final", -1, 1.0f } };
+
+int qualityPreset = -1;		// which one is used, -1 without --preset
+int finalMaxBounces = 2;	// the --max-bounces of "final"
+GLuint qualityPrograms[QUALITY_PRESETS] = {};
+
+int videoFPS = 60;
+int videoSeconds = 10;
+int maxFrames = videoFPS * videoSeconds;
+
+// glReadPixels into memory makes the CPU wait until the GPU has finished the frame, and then the GPU
+// waits while the CPU saves it. Instead, every frame is read into one of READBACK_RING_SLICES pixel
+// buffer objects, which the GPU copies into on its own, with a fence after the copy. A frame is only
+// mapped and saved READBACK_DELAY frames later, when the GPU is long done with it.
+// --sync-readback reads every frame right away, like before
+#define READBACK_RING_SLICES 3
+#define READBACK_DELAY (READBACK_RING_SLICES - 1)
+
+struct ReadbackSlot
+{
+	GLuint buffer;
+	GLsync fence;
+	int frame;
+};
+
+bool asyncReadback = true;
+bool benchmarkReadback = false;
+
+// --bench-export times every stage of saving a frame on its own, benchmarkFrames times each, before the video:
+// reading back a frame that is already rendered (glReadPixels and the ring), copying it into a FreeImage bitmap,
+// encoding it in memory in every format, and writing it with every way of writing files. The frames are made up
+// (a gradient with some noise, which compresses about like a render), so the encoders get the same pixels every time
+bool benchmarkExport = false;
+ReadbackSlot readbackRing[READBACK_RING_SLICES] = {};
+
+// With --yuv-readback, YuvConvert.glsl writes the planes of YUV 4:2:0 into the slot of the ring instead of glReadPixels
+// writing the BGR pixels, so a frame is 1.5 bytes a pixel instead of 3, and ffmpeg gets yuv420p, which it does not have
+// to convert on the CPU. It is only for the video that is streamed to ffmpeg. The slots are still big enough for BGR,
+// so the frames can go back to it when ffmpeg cannot be started and they are saved in exportedFrames instead
+bool yuvReadback = false;
+GLuint yuv_convert_program = 0;
+GLuint yuvFrameTexture = 0;
+GLuint yuv_imageWidth_loc;
+GLuint yuv_imageHeight_loc;
+
+// how many times the CPU still had to wait for a frame, when it mapped it
+int readbackWaits = 0;
+
+// One render can make more than the video. With --proxy <scale>, a smaller copy of every frame is streamed to an ffmpeg
+// of its own, into proxy_<video>, for reviews, and with --thumbnails <n>, every n-th frame is made THUMBNAIL_WIDTH
+// pixels wide and put next to the ones before it, THUMBNAILS_PER_STRIP to a strip, saved as thumbs_<first frame>.png.
+// They are made from the output on the GPU, before anything is read back. downsampleLevels halve the output until the
+// next half would be smaller than the smallest rendition (a linear blit to exactly half the size is the average of
+// 2x2 pixels, so nothing is skipped), and every rendition is blitted from the smallest level that is still as big.
+// Only the small images are read back, into a ring of their own like readbackRing, so a proxy of a quarter of the
+// size is 1/16 of the bytes of the frame
+#define THUMBNAIL_WIDTH 160
+#define THUMBNAILS_PER_STRIP 10
+#define RENDITION_PROXY 0
+#define RENDITION_THUMBNAIL 1
+#define NUM_RENDITIONS 2
+
+struct DownsampleLevel
+{
+	int width;
+	int height;
+	GLuint fbo;
+	GLuint color;
+};
+
+// A rendition is off while its fbo is 0. last is the one that was read back last, for the copies of --dedupe-frames
+struct Rendition
+{
+	int width;
+	int height;
+	GLuint fbo;
+	GLuint color;
+	ReadbackSlot ring[READBACK_RING_SLICES];
+	int next;
+	std::vector<unsigned char> last;
+};
+
+float proxyScale = 0.0f;
+int thumbnailEvery = 0;
+std::vector<DownsampleLevel> downsampleLevels;
+Rendition renditions[NUM_RENDITIONS] = {};
+FILE* proxyPipe = nullptr;
+int proxyFrames = 0;
+FIBITMAP* thumbnailStrip = nullptr;
+int thumbnailStripFirst = 0;
+int thumbnailCount = 0;
+int thumbnailStrips = 0;
+
+// For small scenes, the work of every frame around the render (the readback with its fence) takes a big part
+// of the frame. With --frame-batch <k> (headless), frames are rendered into the layers of batchTexture, an array
+// texture that is the color of outputFBO, one layer per frame, and when all k layers have a frame, they are read
+// back together with one glGetTexImage into the pixel pack buffer of a batch slot. There are two slots, so one
+// batch is saved while the next one renders. batchSlot is the slot that the layers are rendered for now
+struct BatchSlot
+{
+	GLuint buffer;
+	GLsync fence;
+	std::vector<int> frames;
+	int count;
+};
+
+int frameBatch = 1;
+GLuint batchTexture = 0;
+BatchSlot batchSlots[2] = {};
+int batchSlot = 0;
+
+// With the readback ring, a frame is read back and saved while the GPU renders the frames after it. The scene
+// update of a frame (its matrices and lights) is the third stage: a job makes the update of the next frame while
+// the GPU renders this one, so that renderScene only has to pick it up. pipelinedFrame is the totalFrame it is
+// for, at pipelinedTime, and if the frame turns out to have another time (the animation was paused), it is made
+// again. --realtime only knows its time when the frame starts, and --serial-update turns this off
+bool pipelineUpdates = true;
+int pipelinedFrame = -1;
+float pipelinedTime = 0.0f;
+std::vector<glm::mat4x4> pipelinedMatrices;
+std::vector<light> pipelinedLights;
+JobHandle pipelinedUpdate;
+int pipelinedHits = 0;
+
+// The work of the CPU is done by the job system (JobSystem.h), so the render thread only sends commands to the GPU.
+// jobThreads is how many threads it has, -1 picks one fewer than the CPU has cores, and 0 has none, so every job
+// is run by the render thread when it waits for it (--job-threads <n>, or --encoder-threads <n>, its old name)
+int jobThreads = -1;
+
+// With --numa, the threads of the job system are spread over the NUMA nodes of a server with more than one socket,
+// and kept there (see JobSystem.h). The tiles of the CPU renderer are handed out to the nodes in blocks, the threads
+// take the tiles of their own node first, and every node traces a copy of the scene in its own memory
+bool numaJobs = false;
+
+// Making a PNG takes longer than rendering the frame, so every frame is saved by a job.
+// The render thread copies the pixels into a FreeImage bitmap and adds the job, and whichever thread is free
+// runs it, so the files can be written out of order. When the video is streamed, the job writes the pixels into
+// the pipe instead, after the job of the frame before, so that ffmpeg gets them in order.
+// At most ENCODER_QUEUE_SIZE frames (each one is 2.7MB) wait to be saved. When there are that many, the render
+// thread runs jobs itself until the oldest one is saved, so the saving can never fall behind without limit.
+// With no job threads, every frame is saved on the render thread, like before
+#define ENCODER_QUEUE_SIZE 8
+
+std::deque<JobHandle> savingFrames;
+std::mutex encodeMutex;
+
+// how many times the render thread found ENCODER_QUEUE_SIZE frames still waiting
+int encodeQueueStalls = 0;
+
+// The copies of the frames that wait to be saved come from a pool, and go back into it once they are saved,
+// so they are only allocated until the pool has one for every frame that can wait. A frame is a FreeImage
+// bitmap of the output size, or its bytes for ffmpeg when the video is streamed, each made the first time it
+// is needed. framePoolAllocations counts them, and stops growing after the first few frames.
+// The jobs put the frames back from every thread at once, so the free frames are in a queue without a lock
+// (see FrameQueue.h). It has room for more frames than can wait, and a frame that finds it full is freed
+#define FRAME_POOL_SIZE 32
+
+struct PooledFrame
+{
+	FIBITMAP* image = nullptr;
+	std::vector<unsigned char> bytes;
+};
+
+MpmcQueue<PooledFrame*, FRAME_POOL_SIZE> freeFrames;
+int framePoolAllocations = 0;
+int framePoolFrames = 0;
+
+// With job threads, the frames for the pipe of ffmpeg go through pipeFrames to a thread of their own, which writes
+// them in the order that they were pushed, instead of a job for every frame that waits for the job of the frame
+// before. The render thread only waits when PIPE_QUEUE_SIZE frames are not written yet. pipeFramesPushed is only
+// changed by the render thread, and pipeFramesWritten only by the writer, so the pipe has every frame once they match.
+// Every frame has the pipe it goes to, because --serve swaps the pipes of its jobs
+#define PIPE_QUEUE_SIZE 8
+
+struct PipeFrame
+{
+	PooledFrame* pooled;
+	FILE* pipe;
+};
+
+SpscQueue<PipeFrame, PIPE_QUEUE_SIZE> pipeFrames;
+std::thread pipeWriter;
+size_t pipeFramesPushed = 0;
+std::atomic<size_t> pipeFramesWritten{ 0 };
+
+// The files in exportedFrames are only there until ffmpeg has made the video, so they do not need
+// to be small, they need to be fast. frameFormat picks how they are saved (--frame-format):
+// PNG with zlib level pngLevel (0 to 9, --png-level, FreeImage uses 6 by default, which is slow),
+// BMP, QOI (a simple format with about the size of a fast PNG that is much faster to make),
+// the raw BGR pixels, bottom row first, which is no work at all but the most bytes,
+// or the mezzanine frames of Mezzanine.h, which only keep what changed since the frame before.
+// At the end, the average number of bytes and the time to save a frame are printed
+#define FRAME_FORMAT_PNG 0
+#define FRAME_FORMAT_BMP 1
+#define FRAME_FORMAT_QOI 2
+#define FRAME_FORMAT_RAW 3
+#define FRAME_FORMAT_MEZZANINE 4
+
+const char* frameFormatNames[] = { "png", "bmp", "qoi", "bgr", "mzf" };
+int frameFormat = FRAME_FORMAT_PNG;
+int pngLevel = 6;
+
+// Every mezzanineKeyframes-th mezzanine frame (--mezzanine-keyframes) is a keyframe, and so is any frame
+// whose frame before was not saved by this run (the first one, and the ones after --resume or --dedupe-frames skipped some).
+// mezzanineLast holds the pixels of mezzanineLastFrame, which the next frame is the delta to, until that frame is saved too
+int mezzanineKeyframes = 30;
+std::shared_ptr<PooledFrame> mezzanineLast;
+int mezzanineLastFrame = -1;
+
+// With --disk-writer [n], the raw and QOI frames are written by the asynchronous writer of DiskWriter.h, with up to
+// n files in flight, past the page cache unless --disk-writer-cached. The jobs that encode the frames only fill its
+// buffers, and a frame is added to the saved frames once the writer has it on the disk
+bool useDiskWriter = false;
+int diskWritesInFlight = 16;
+bool diskWriterDirect = true;
+DiskWriter diskWriter;
+
+// added to by every job that saves a frame, under encodeMutex
+long long savedFrameBytes = 0;
+double savedFrameSeconds = 0.0;
+int savedFrames = 0;
+
+// When a frame has been saved completely, its number is added to exportedFrames/frames.txt.
+// If the program stops before the video is done, --resume reads that list and only renders
+// the frames that are not in it. The animations only depend on totalFrame (see renderScene),
+// so those frames are the same as they would have been. A file without its line in the
+// list was not finished, and is saved again. Resuming needs --export-png and the same --frame-format
+bool resumeFrames = false;
+std::ofstream frameManifest;
+
+// Every frame only depends on totalFrame, so the video can be split between processes, GPUs, and computers.
+// --frames first:last[:step] renders only the frames from firstFrame to lastFrame (counting from 1, like the
+// files), every frameStep-th one. A streamed shard becomes test_<first>_<last>.avi, and --merge <files...>
+// puts those together into test.avi with ffmpeg's concat demuxer, without encoding them again.
+// Shards with a step (or saved as frames) are copied into one exportedFrames folder, where --merge-frames
+// makes test.avi from them
+int firstFrame = 1;
+int lastFrame = -1;
+int frameStep = 1;
+std::vector<std::string> mergeShards;
+bool mergeFrames = false;
+
+// A computer with more than one GPU renders the frames round-robin with --gpus <n>: it starts n copies of
+// itself, and copy i renders every n-th frame, starting at frame i, in a headless context on GPU i (--gpu <i>).
+// Every copy has its own context, and so its own scene buffers, like the shards above. The frames are saved in
+// exportedFrames, where their numbers put them back in order, and the video is made once every copy is done.
+// A context on one GPU needs WGL_NV_gpu_affinity (NVIDIA Quadro); without it, every copy renders on the GPU
+// that the driver picks, which still works, only not faster
+int gpuCount = 0;
+int renderGpu = -1;
+
+// The frames are saved in framesFolder, with the list of saved frames and the segments.
+// --frames-folder <dir> puts them somewhere else than exportedFrames, like the folder of a render farm
+std::string framesFolder = "exportedFrames";
+
+// A render farm of many machines, which share one folder (see Farm.h). The coordinator, --farm <folder> [frames],
+// cuts the video into chunks of farmChunkSize frames, and hands them out to the workers as they ask for them. The chunk
+// of a worker that has not written a heartbeat for farmTimeout seconds is handed out again, and every segment is
+// encoded as soon as its frames are there. A worker, --farm-worker <folder>, takes a chunk and renders it with a copy
+// of itself, with its own command line and --frames for the chunk, like the copies of --gpus, and takes the next chunk
+// when the copy is done. So every worker needs the options of the scene, and can render on its GPU or with --cpu-render
+std::string farmFolder;
+std::string farmWorkerFolder;
+int farmChunkSize = 24;
+float farmTimeout = 30.0f;
+
+// With --remote-preview <port>, the frames are watched in a browser on another computer (see RemotePreview.h),
+// as JPEGs of remotePreviewQuality, instead of in the window, which is hidden like --headless.
+// The keys and the camera come back from the browser, and are used before the next frame
+int remotePreviewPort = 0;
+int remotePreviewQuality = 80;
+
+// With --serve <port>, the program stays running after init, and renders the jobs that --submit <port> sends it
+// (see RenderServer.h), so the context, the programs, and the scene are only made once for all of them.
+// A job only has the options of its frames (jobOptions), the others are the ones the server started with.
+// The jobs take turns of serveSliceFrames frames (--serve-slice), so many small ones render side by side.
+// Every job that renders has its own output (an ffmpeg, or the saving of its frames), so only serveMaxJobs
+// of them render at once (--serve-jobs), and the others wait for their turn
+int servePort = 0;
+int serveSliceFrames = 8;
+int serveMaxJobs = 4;
+int submitPort = 0;
+std::string submitOptions;
+const char* jobOptions[] = { "--frames", "--frames-folder", "--resume", "--export-png", "--scene" };
+
+// With --metrics-port <port>, a Prometheus server can scrape the numbers of --serve at /metrics (see Metrics.h).
+// The times of the stages of every frame go into histograms: render (scene and draw on the GPU), readback, encode
+// (what the render thread spends handing the frame to the saving jobs), and write (what a job spends saving it,
+// which is added under encodeMutex). The text is made after every turn, so a scrape does not wait for the GPU
+int metricsPort = 0;
+MetricHistogram renderHistogram;
+MetricHistogram readbackHistogram;
+MetricHistogram encodeHistogram;
+MetricHistogram writeHistogram;
+double metricRays = 0.0;
+int programCacheHits = 0;
+int programCacheMisses = 0;
+int blasCacheHits = 0;
+int blasCacheMisses = 0;
+
+// When the frames are saved, ffmpeg would only start making the video after the last one.
+// Instead, the video is cut into segments of segmentFrames frames, and as soon as every frame of a segment
+// is saved, a thread runs ffmpeg to make exportedFrames/segment_<n>.avi from them, while the rest are
+// still rendering. At the end the segments are joined into test.avi with the concat demuxer, which does
+// not encode them again, so only the last segment is left to wait for.
+// --segment-frames <n>, 0 makes the whole video at the end, like before
+int segmentFrames = 120;
+std::vector<int> segmentFramesSaved;
+std::vector<bool> segmentStarted;
+std::vector<std::thread> segmentEncoders;
+
+// Saving every frame as a PNG, and then having ffmpeg load them all again, does the work twice
+// and writes gigabytes to the disk. Instead, ffmpeg is started before the first frame, reading
+// raw BGR pixels from its standard input, and every frame is written into that pipe when it is
+// read back, so the video is done when the last frame is. The frames have to arrive in order,
+// which they do, because they are read back in order.
+// --export-png saves the frames in exportedFrames and makes the video from them at the end, like before
+bool streamVideo = true;
+FILE* videoPipe = nullptr;
+
+// With --shm-encoder [slots], the streamed frames do not go into the pipe from this process: ffmpeg is started by
+// a copy of this program with --encode-shm, and every frame is copied once, from the mapped pixel buffer of the
+// readback into a slot of a ring in shared memory that the copy reads (see FrameRing.h). The render thread
+// never waits for the pipe then, only for a free slot, when the encoder is a whole ring of frames behind
+#define FRAME_RING_DEFAULT_SLOTS 4
+bool shmEncoder = false;
+int frameRingSlots = FRAME_RING_DEFAULT_SLOTS;
+FrameRing frameRing;
+std::string encodeShmName;
+
+// With --upload <url>, the streamed video is not a file on this computer: ffmpeg writes it as Matroska (which needs
+// no seeking back to the start) to its standard output, into a copy of this program with --upload-stdin, which uploads
+// it to S3-compatible object storage in parts of uploadPartMB as they fill (see ObjectStorage.h)
+std::string uploadUrl;
+bool uploadFromStdin = false;
+int uploadPartMB = 8;
+
+// With --dedupe-frames, a frame that is made from the same inputs as the frame before it (the hash of the matrices,
+// the lights, the camera, the render size, and the changes to the scene file, see frameInputHash) is not rendered
+// or encoded. Its file is a hard link to the file of that frame, or when the video is streamed, the same bytes are
+// written to ffmpeg again. The time is not in the hash, only what it moves, so a hold of the animation is a run of
+// copies. Neither is the seed of the frame, so the noise of Russian roulette holds still too, like the rest of it
+bool dedupeFrames = false;
+uint64_t lastFrameHash = 0;
+int lastUniqueFrame = -1;
+bool lastUniqueSaved = false;
+std::vector<unsigned char> lastStreamedPixels;
+int duplicateFrames = 0;
+int sceneFileChanges = 0;
+
+// With --dirty-rects, the fragment shader only traces the tiles of the screen that can look different than in the
+// frame before, and the other pixels stay what they were, since the headless framebuffer keeps them. What can change
+// is found on the CPU (see findDirtyRects): the boxes of the meshes that moved, where they were and where they are now,
+// and the spheres of the lights that changed or that a moved mesh is inside of (their light and shadows do not reach
+// further). A reflection can show any of it anywhere on a mirror, so the meshes that reflect are traced too when
+// something changed. When the camera, the render size, or the scene file changed, the whole frame is traced
+#define DIRTY_TILE_SIZE 32
+bool dirtyRects = false;
+bool dirtyRectsValid = false;
+std::vector<glm::mat4x4> dirtyRectMatrices;
+std::vector<light> dirtyRectLights;
+glm::vec3 dirtyRectCamera[3];
+float dirtyRectFov = 0.0f;
+int dirtyRectWidth = 0;
+int dirtyRectHeight = 0;
+int dirtyRectSceneChanges = 0;
+std::vector<bool> reflectiveMeshes;
+double dirtyPixelsTraced = 0.0;
+double dirtyPixelsTotal = 0.0;
+
+// With --region x,y,w,h, the fragment shader only traces that rectangle of the frame (in the pixels of the output,
+// from its top left corner), with the camera rays of the whole frame, so a part of a shot that was rendered before can
+// be rendered again for the time of its pixels. The frames are saved, and the pixels outside of the rectangle are the
+// ones of the file of the frame that is already there (see compositeRegion), which is read into regionFrame
+int regionX = 0;
+int regionY = 0;
+int regionWidth = 0;
+int regionHeight = 0;
+std::vector<unsigned char> regionFrame;
+int regionMissingFrames = 0;
+
+// At big sizes the software encoder in ffmpeg is the slowest part. With --hw-encode, ffmpeg
+// encodes with the video encoder on the GPU instead (NVENC on NVIDIA, AMF on AMD, Quick Sync on Intel).
+// The first one of hardwareEncoders that works on this computer is used, and if none of them do,
+// ffmpeg picks its usual software encoder. --video-encoder <name> gives ffmpeg an encoder by name.
+// The frames still come through pixels: handing the texture to the encoder directly would need the
+// vendor SDKs (the NVENC and AMF headers and their GL interop), which this project does not have
+bool hardwareEncode = false;
+std::string videoEncoder = "";
+const char* hardwareEncoders[] = { "h264_nvenc", "h264_amf", "h264_qsv" };
+
+// This function takes in variables that define the perspective view of the camera, then outputs the four corner rays of the camera's view.
+// It takes in a vec3 eye, which is the position of the camera.
+// It also takes vec3 center, the position the camera's view is centered on.
+// Then it will takes a vec3 up which is a vector that defines the upward direction. (So if you point it down, the camera view will be upside down.)
+// Then it takes a float defining the verticle field of view angle. It also takes a float defining the ratio of the screen (in this case, 800/600 pixels).
+// The last four parameters are actually just variables for this function to output data into. They should be pointers to pre-defined vec4 variables.
+// For a visual reference, see this image: https://camo.githubusercontent.com/21a84a8b21d6a4bc98b9992e8eaeb7d7acb1185d/687474703a2f2f63646e2e6c776a676c2e6f72672f7475746f7269616c732f3134313230385f676c736c5f636f6d707574652f726179696e746572706f6c6174696f6e2e706e67
+cameraView makeCameraView(glm::vec3 eye, glm::vec3 center, glm::vec3 up, float fov, float ratio)
+{
+	// Grab a ray from the camera position toward where the camera is to be centered on.
+	glm::vec3 centerRay = center - eye;
+
+	// w: Vector from center toward eye
+	// u: Vector pointing directly right relative to the camera.
+	// v: Vector pointing directly upward relative to the camera.
+
+	// Create a w vector which is the opposite of that ray.
+	glm::vec3 w = -centerRay;
+
+	// Get the rightward (relative to camera) pointing vector by crossing up with w.
+	glm::vec3 u = glm::cross(up, w);
+
+	// Get the upward (relative to camera) pointing vector by crossing the rightward vector with your w vector.
+	glm::vec3 v = glm::cross(w, u);
+
+	// We create these two helper variables, as when we rotate the ray about it's relative Y axis (v), we will then need to rotate it about it's relative X axis (u).
+	// This means that u has to be rotated by v too, otherwise the rotation will not be accurate. When the ray is rotated about v, so then are it's relative axes.
+	glm::vec4 uRotateLeft = glm::vec4(u, 1.0f) * glm::rotate(glm::mat4(), glm::radians(-fov * ratio / 2.0f), v);
+	glm::vec4 uRotateRight = glm::vec4(u, 1.0f) * glm::rotate(glm::mat4(), glm::radians(fov * ratio / 2.0f), v);
+
+	// Now we simply take the ray and rotate it in each direction to create our four corner rays.
+	glm::vec4 r00 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(-fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(fov / 2.0f), glm::vec3(uRotateLeft));
+	glm::vec4 r01 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(-fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(-fov / 2.0f), glm::vec3(uRotateLeft));
+	glm::vec4 r10 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(fov / 2.0f), glm::vec3(uRotateRight));
+	glm::vec4 r11 = glm::vec4(centerRay, 1.0f) * glm::rotate(glm::mat4(), glm::radians(fov * ratio / 2.0f), v) * glm::rotate(glm::mat4(), glm::radians(-fov / 2.0f), glm::vec3(uRotateRight));
+
+	// The view is the camera position, then the four corner rays
+	cameraView view = {};
+	view.eye = eye;
+	view.ray00 = glm::vec3(r00);
+	view.ray01 = glm::vec3(r01);
+	view.ray10 = glm::vec3(r10);
+	view.ray11 = glm::vec3(r11);
+	return view;
+}
+
+// Make the rays of --camera for the camera that looks from eye to center, with CameraRays.glsl, if they changed.
+// The texture is on texture unit CAMERA_RAY_UNIT, and the program that was in use is in use again after
+void updateCameraRays(glm::vec3 eye, glm::vec3 center, glm::vec3 up, float fov)
+{
+	glm::vec3 forward = glm::normalize(center - eye);
+	glm::vec3 right = glm::normalize(glm::cross(forward, up));
+	glm::vec3 cameraUp = glm::cross(right, forward);
+
+	float modelFov = cameraModelFov;
+	if (modelFov <= 0.0f)
+		modelFov = cameraModel == CAMERA_PINHOLE ? fov : cameraModel == CAMERA_FISHEYE ? 180.0f : 360.0f;
+
+	// the rays only depend on where the camera looks, not on where it is
+	std::vector<float> key = { forward.x, forward.y, forward.z, cameraUp.x, cameraUp.y, cameraUp.z, modelFov,
+		cameraJitter.x, cameraJitter.y, (float)width, (float)height };
+
+	if (key == cameraRayKey)
+		return;
+
+	cameraRayKey = key;
+
+	if (cameraRayWidth != width || cameraRayHeight != height)
+	{
+		if (cameraRayTexture)
+		{
+			forgetGpuImage(GL_TEXTURE, cameraRayTexture);
+			glDeleteTextures(1, &cameraRayTexture);
+		}
+
+		// a direction needs more than a half float, a pixel of a 4K equirect is less than 0.002 radians across
+		glGenTextures(1, &cameraRayTexture);
+		glActiveTexture(GL_TEXTURE0 + CAMERA_RAY_UNIT);
+		glBindTexture(GL_TEXTURE_2D, cameraRayTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+		trackGpuImage(GL_TEXTURE, cameraRayTexture, (size_t)16 * width * height, GPU_MEMORY_IMAGES);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// the left and right sides of the equirect are the same direction
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, cameraModel == CAMERA_EQUIRECT ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glActiveTexture(GL_TEXTURE0);
+
+		cameraRayWidth = width;
+		cameraRayHeight = height;
+	}
+
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	glUseProgram(camera_rays_program);
+	glUniform1i(cameraRays_imageWidth_loc, width);
+	glUniform1i(cameraRays_imageHeight_loc, height);
+	glUniform1i(cameraRays_cameraModel_loc, cameraModel);
+	glUniform1f(cameraRays_fov_loc, glm::radians(modelFov));
+	glUniform3fv(cameraRays_forward_loc, 1, &forward[0]);
+	glUniform3fv(cameraRays_right_loc, 1, &right[0]);
+	glUniform3fv(cameraRays_up_loc, 1, &cameraUp[0]);
+	glUniform2fv(cameraRays_jitter_loc, 1, &cameraJitter[0]);
+
+	glBindImageTexture(0, cameraRayTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+
+	// the shaders that trace from the camera fetch the rays from the texture
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glUseProgram(program);
+	cameraRayUpdates++;
+}
+
+// Write the camera block for this frame, with every view of --views. View 0 is the camera itself,
+// and it is also the view that the rasterizer uses, so cameraViewProj is made for it
+void calcCameraRays(glm::vec3 eye, glm::vec3 center, glm::vec3 up, float fov, float ratio)
+{
+	// the camera of a tile of --still is the one of the whole still, which has its shape
+	if (stillWidth > 0)
+		ratio = (float)stillWidth / stillHeight;
+
+	// The views are in a grid, as close to square as it can be, and each one has a cell of the image
+	int columns = (int)ceil(sqrt((double)numViews));
+	int rows = (numViews + columns - 1) / columns;
+	float viewRatio = ratio * rows / columns;
+	float angle = viewAngle != 0.0f ? viewAngle : 360.0f / numViews;
+
+	std::vector<cameraView> views(numViews);
+	views[0] = makeCameraView(eye, center, up, fov, viewRatio);
+
+	for (int v = 1; v < numViews; v++)
+	{
+		glm::vec4 turned = glm::rotate(glm::mat4(), glm::radians(angle * v), up) * glm::vec4(eye - center, 0.0f);
+		views[v] = makeCameraView(center + glm::vec3(turned), center, up, fov, viewRatio);
+	}
+
+	// A tile of --still has the corner rays of its window of the whole still. The rays end on a rectangle,
+	// so the rays in between are the same mix of the corners as in the fragment shader
+	if (cameraWindow != glm::vec4(0.0f, 0.0f, 1.0f, 1.0f))
+	{
+		for (cameraView& view : views)
+		{
+			auto rayAt = [&view](float u, float v) {
+				return glm::mix(glm::mix(view.ray00, view.ray01, v), glm::mix(view.ray10, view.ray11, v), u);
+			};
+
+			cameraView window = view;
+			window.ray00 = rayAt(cameraWindow.x, cameraWindow.y);
+			window.ray01 = rayAt(cameraWindow.x, cameraWindow.w);
+			window.ray10 = rayAt(cameraWindow.z, cameraWindow.y);
+			window.ray11 = rayAt(cameraWindow.z, cameraWindow.w);
+			view = window;
+		}
+	}
+
+	// With --accumulate, every view moves by cameraJitter. A pixel is columns / width of the rays across a
+	// view, and rows / height of them up, because every view has its own cell of the image
+	if (cameraJitter != glm::vec2(0.0f))
+	{
+		for (cameraView& view : views)
+		{
+			glm::vec3 shift = (view.ray10 - view.ray00) * (cameraJitter.x * columns / width) +
+				(view.ray01 - view.ray00) * (cameraJitter.y * rows / height);
+
+			view.ray00 += shift;
+			view.ray01 += shift;
+			view.ray10 += shift;
+			view.ray11 += shift;
+		}
+	}
+
+	// the rays of --camera are read from their texture, the corner rays stay for the rasterizer
+	glm::ivec4 viewGrid(columns, rows, numViews, cameraModel >= 0 ? 1 : 0);
+
+	if (cameraModel >= 0)
+		updateCameraRays(eye, center, up, fov);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(viewGrid), &viewGrid);
+	glBufferSubData(GL_UNIFORM_BUFFER, 16, sizeof(cameraView) * numViews, views.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffer);
+
+	glm::vec3 r00 = views[0].ray00;
+	glm::vec3 r01 = views[0].ray01;
+	glm::vec3 r10 = views[0].ray10;
+
+	// The four corner rays end on a rectangle, so the ray through any point (u, v) of the screen is
+	// r00 + u * (r10 - r00) + v * (r01 - r00). For a point in the world, we solve for (u, v), and for
+	// how far along that ray the point is (s), with the inverse of those three vectors.
+	// That is exactly what a projection matrix does, with s as w, so the rasterizer can use it
+	glm::mat3 rays = glm::mat3(r10 - r00, r01 - r00, r00);
+	glm::mat3 toRays = glm::inverse(rays);
+
+	glm::mat4 view = glm::mat4(toRays);
+	view[3] = glm::vec4(-(toRays * eye), 1.0f);
+
+	// x = 2u - 1 and y = 2v - 1 after dividing by s, and the depth goes from near to far
+	float nearS = 0.01f;
+	float farS = 1000.0f;
+	glm::mat4 proj = glm::mat4(0.0f);
+	proj[0][0] = 2.0f;
+	proj[1][1] = 2.0f;
+	proj[2][0] = -1.0f;
+	proj[2][1] = -1.0f;
+	proj[2][2] = (farS + nearS) / (farS - nearS);
+	proj[2][3] = 1.0f;
+	proj[3][2] = -2.0f * farS * nearS / (farS - nearS);
+
+	cameraViewProj = proj * view;
+}
+
+// Set the uniforms that decide when a path of reflections stops, the triangle format, and the size of the scene,
+// for the program that is being used. They are at the same locations in every program that includes RayTracing.glsl
+// With specializeScene, some of them are constants in the shaders, and those locations have no uniform
+// Make the blue noise tile of --sampler blue, the first time, and put it on texture unit 9
+void bindBlueNoise()
+{
+	if (!blueNoiseTexture)
+	{
+		double start = platformTime();
+		std::vector<unsigned short> ranks = makeBlueNoise(BLUE_NOISE_SIZE);
+
+		glGenTextures(1, &blueNoiseTexture);
+		glBindTexture(GL_TEXTURE_2D, blueNoiseTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, ranks.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		trackGpuImage(GL_TEXTURE, blueNoiseTexture, ranks.size() * sizeof(unsigned short), GPU_MEMORY_IMAGES);
+
+		// the shaders read it with texelFetch, an integer texture cannot be filtered
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		std::cout << "made the blue noise tile in " << (platformTime() - start) * 1000.0 << " ms" << std::endl;
+	}
+
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, blueNoiseTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void setPathUniforms()
+{
+	glUniform1f(PATH_UNIFORM_LOCATION + 1, throughputEpsilon);
+	glUniform1f(PATH_UNIFORM_LOCATION + 3, rouletteThreshold);
+	glUniform1ui(PATH_UNIFORM_LOCATION + 4, (GLuint)totalFrame);
+	glUniform1i(SHADING_LOD_LOCATION + 0, lodShadowsFrom);
+	glUniform1i(SHADING_LOD_LOCATION + 1, lodSpecularFrom);
+	glUniform1i(SHADING_LOD_LOCATION + 2, lodLightsFrom);
+	glUniform1i(SHADING_LOD_LOCATION + 3, lodLightCount);
+	glUniform1i(LIGHT_SAMPLES_LOCATION, lightSamples);
+	glUniform1i(GEOMETRY_LOD_LOCATION, lodGeometryFrom);
+	glUniform1i(SAMPLER_LOCATION, samplerKind);
+	glUniform1i(MOTION_BLUR_LOCATION, motionBlur);
+
+	if (samplerKind == SAMPLER_BLUE_NOISE)
+		bindBlueNoise();
+
+	// not part of the path, but these are also at fixed locations in every program
+	glUniform1i(TRIANGLE_FORMAT_LOCATION, triangleFormat);
+
+	if (!specializeScene)
+	{
+		glUniform1i(PATH_UNIFORM_LOCATION + 0, maxBounces);
+		glUniform1i(PATH_UNIFORM_LOCATION + 2, russianRoulette);
+		glUniform1i(SCENE_SIZE_LOCATION + 0, bvhNumTriangles);
+		glUniform1i(SCENE_SIZE_LOCATION + 1, numSceneMeshes);
+	}
+}
+
+// Writes from shaders (storage buffers, atomics, and image stores) are not seen by later commands
+// until a glMemoryBarrier says how those commands will read them. Instead of every pass putting
+// a barrier with every bit after itself, every pass says which of these it wrote, and before
+// a pass runs it says which of them it reads and how. Then a barrier is only issued when something
+// it reads was written since the last barrier with those bits, and only with those bits.
+// Reading something that the CPU wrote (the matrix and light rings, glBufferData) never needs a barrier.
+// Barriers inside one build (between the passes of BuildBVH.glsl, for example) are still glMemoryBarrier calls
+enum GpuResource
+{
+	RES_TRIANGLES,		// compToFrag, written by Compute.glsl
+	RES_MESH_BOXES,		// meshBoxBuffer, written by Compute.glsl
+	RES_BVH,			// bvhNodeBuffer, written by BuildBVH.glsl
+	RES_BVH_SCRATCH,	// bvhScratchBuffer, the box and the cost of the BVH, written by BuildBVH.glsl
+	RES_GRID,			// gridBuffer, written by BuildGrid.glsl
+	RES_INSTANCE_GRID,	// instanceGridBuffer, written by BuildInstanceGrid.glsl with --instance-grid
+	RES_TILE_LIGHTS,	// tileLightRange, written by LightCull.glsl
+	RES_TILED_IMAGE,	// tiledRenderTexture, written by TiledRender.glsl
+	RES_TILE_QUEUE,		// tileQueueRange and tileCostRanges, added to by TiledRender.glsl with --persistent-threads
+	RES_TRIANGLE_BINS,	// triangleBinRange, written by TriangleBin.glsl with --bin-triangles
+	RES_WAVE_COUNTS,	// waveCountBuffer, added to by the stages of Wavefront.glsl
+	RES_RAY_COUNTS,		// rayCountBuffer, added to by the renderers while countingRays is true
+	RES_SHADOW_CACHE,	// shadowCacheBuffer, written by the renderers with --shadow-cache
+	RES_SHADOW_SAMPLES,	// shadowSampleBuffer, written by the shadow pass of --shadow-scale
+	RES_LIGHT_OCCLUDERS,	// lightOccluderBuffer, written by LightOccluders.glsl with --light-occluders
+	RES_SKINNED_BLAS,	// the skinned meshes in triangleBuffer and their BLAS, and worldVertexBuffer, written by skinBLAS
+	RES_IRRADIANCE,		// irradianceBuffer, written by IrradianceProbes.glsl with --irradiance-probes
+	NUM_GPU_RESOURCES
+};
+
+// For every resource, the barrier bits that are still needed since a shader last wrote it.
+// At the start nothing was written, so nothing is needed
+GLbitfield gpuUnsyncedBits[NUM_GPU_RESOURCES] = {};
+
+// Print every barrier that is issued in the first frame (--trace-barriers)
+bool traceBarriers = false;
+int gpuBarrierCount = 0;
+
+struct GpuRead
+{
+	GpuResource resource;
+	GLbitfield how;
+};
+
+// A pass has written these resources with shader writes
+void gpuWrote(std::initializer_list<GpuResource> resources)
+{
+	for (GpuResource r : resources)
+		gpuUnsyncedBits[r] = GL_ALL_BARRIER_BITS;
+}
+
+// The next pass reads these resources, each in the way of its barrier bits:
+// GL_SHADER_STORAGE_BARRIER_BIT for a storage buffer in a shader, GL_BUFFER_UPDATE_BARRIER_BIT for
+// glBufferSubData and glGetBufferSubData, GL_FRAMEBUFFER_BARRIER_BIT for a blit, and so on.
+// Everything that needs a barrier gets one barrier together
+void gpuRead(const char* pass, std::initializer_list<GpuRead> reads)
+{
+	GLbitfield bits = 0;
+
+	for (const GpuRead& read : reads)
+		bits |= gpuUnsyncedBits[read.resource] & read.how;
+
+	if (bits == 0)
+		return;
+
+	glMemoryBarrier(bits);
+	gpuBarrierCount++;
+
+	// the barrier is for every write before it, not only the writes of these resources
+	for (int r = 0; r < NUM_GPU_RESOURCES; r++)
+		gpuUnsyncedBits[r] &= ~bits;
+
+	if (traceBarriers)
+		std::cout << "barrier before " << pass << ": 0x" << std::hex << bits << std::dec << std::endl;
+}
+
+// Run the transform program of Compute.glsl, which was compiled with groupSize triangles per workgroup,
+// with enough workgroups for every triangle. A dispatch can only have 65535 workgroups in x,
+// so if it needs more than that, it gets rows of them in y
+void dispatchTransform(int numTriangles, int groupSize)
+{
+	int groups = (numTriangles + groupSize - 1) / groupSize;
+	int groupsX = std::min(groups, 65535);
+	int groupsY = (groups + groupsX - 1) / groupsX;
+
+	glDispatchCompute(groupsX, groupsY, 1);
+}
+
+// The first triangle of every mesh, which is how many triangles all the meshes before it have
+// (an exclusive prefix sum), and then the number of all the triangles, so mesh m has
+// offsets[m + 1] - offsets[m] triangles. Compute.glsl does a binary search of this to find the mesh of a triangle,
+// instead of walking the meshes one at a time, which gets slow when there are thousands of them
+std::vector<GLint> makeMeshOffsets(const std::vector<int>& meshTriangleCounts)
+{
+	std::vector<GLint> offsets(meshTriangleCounts.size() + 1);
+	GLint sum = 0;
+
+	for (size_t m = 0; m < meshTriangleCounts.size(); m++)
+	{
+		offsets[m] = sum;
+		sum += meshTriangleCounts[m];
+	}
+
+	offsets[meshTriangleCounts.size()] = sum;
+
+	return offsets;
+}
+
+// These must match Compute.glsl
+#define TRANSFORM_PASS_VERTICES 0
+#define TRANSFORM_PASS_TRIANGLES 1
+#define TRANSFORM_PASS_REFIT 2
+
+// The hash of the bits of a corner, for welding them
+struct CornerHash
+{
+	size_t operator()(const std::tuple<unsigned int, unsigned int, unsigned int>& key) const
+	{
+		return std::get<0>(key) * 73856093u ^ std::get<1>(key) * 19349663u ^ std::get<2>(key) * 83492791u;
+	}
+};
+
+// Weld the triangles of every mesh into an indexed mesh. Every corner that is in exactly the same place
+// as a corner of another triangle of the same mesh becomes one vertex, so the 36 corners of the cube are 8 vertices.
+// Corners of different meshes are never welded, because the meshes have different matrices.
+// The vertex numbers of the triangles count from the first vertex of the scene, and vertexOffsets says
+// where the vertices of every mesh start, with the number of all the vertices at the end, like makeMeshOffsets
+void makeIndexedMeshes(const std::vector<triangle>& triangles, const std::vector<GLint>& meshOffsets,
+	std::vector<glm::vec4>& vertices, std::vector<indexedTriangle>& indexed, std::vector<GLint>& vertexOffsets)
+{
+	int numMeshes = (int)meshOffsets.size() - 1;
+
+	vertices.clear();
+	indexed.resize(triangles.size());
+	vertexOffsets.resize(numMeshes + 1);
+
+	for (int m = 0; m < numMeshes; m++)
+	{
+		vertexOffsets[m] = (GLint)vertices.size();
+
+		// where every corner of this mesh already is in vertices. A hash of the bits of the corner, which is
+		// much faster than a sorted map for the meshes of --obj, with millions of corners. -0 and 0 are the same
+		// place, so 0 is added to every number first, which makes -0 into 0
+		std::unordered_map<std::tuple<unsigned int, unsigned int, unsigned int>, GLuint, CornerHash> welded;
+		welded.reserve(meshOffsets[m + 1] - meshOffsets[m]);
+
+		auto weld = [&](glm::vec3 p)
+		{
+			p += glm::vec3(0.0f);
+			unsigned int bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			auto key = std::make_tuple(bits[0], bits[1], bits[2]);
+			auto found = welded.find(key);
+
+			if (found != welded.end())
+				return found->second;
+
+			GLuint index = (GLuint)vertices.size();
+			vertices.push_back(glm::vec4(p, 1.0f));
+			welded[key] = index;
+			return index;
+		};
+
+		for (int i = meshOffsets[m]; i < meshOffsets[m + 1]; i++)
+		{
+			indexed[i].a = weld(triangles[i].a);
+			indexed[i].b = weld(triangles[i].b);
+			indexed[i].c = weld(triangles[i].c);
+			indexed[i].packedNormal = triangles[i].packedNormal;
+			indexed[i].packedRedGreen = triangles[i].packedRedGreen;
+			indexed[i].packedBlueReflectivity = triangles[i].packedBlueReflectivity;
+		}
+	}
+
+	vertexOffsets[numMeshes] = (GLint)vertices.size();
+}
+
+// Run both passes of Compute.glsl, with the buffers it needs already bound.
+// passLoc and numJobsLoc are the locations of "pass" and "numJobs" in the program.
+// numVertices and numTriangles are how many threads each pass needs, which are only the
+// vertices and triangles of the dirty meshes when "dirtyOnly" is set.
+// The second pass reads the vertices that the first one wrote
+void runTransformPasses(GLint passLoc, GLint numJobsLoc, int numVertices, int numTriangles, int groupSize)
+{
+	glUniform1i(passLoc, TRANSFORM_PASS_VERTICES);
+	glUniform1i(numJobsLoc, numVertices);
+	dispatchTransform(numVertices, groupSize);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(passLoc, TRANSFORM_PASS_TRIANGLES);
+	glUniform1i(numJobsLoc, numTriangles);
+	dispatchTransform(numTriangles, groupSize);
+}
+
+// Make the list of the meshes that moved, for dirtyMeshes in Compute.glsl. Every entry is the mesh,
+// then how many vertices and triangles the dirty meshes before it have, so that the threads of a pass
+// are packed together with no gaps for the meshes that did not move. The last entry has the totals.
+// triangleOffsets and vertexOffsets are the tables from makeMeshOffsets and makeIndexedMeshes
+std::vector<glm::ivec4> makeDirtyList(const std::vector<bool>& dirty,
+	const std::vector<GLint>& triangleOffsets, const std::vector<GLint>& vertexOffsets)
+{
+	std::vector<glm::ivec4> list;
+	int vertexJobs = 0;
+	int triangleJobs = 0;
+
+	for (int m = 0; m < (int)dirty.size(); m++)
+	{
+		if (!dirty[m])
+			continue;
+
+		list.push_back(glm::ivec4(m, vertexJobs, triangleJobs, 0));
+		vertexJobs += vertexOffsets[m + 1] - vertexOffsets[m];
+		triangleJobs += triangleOffsets[m + 1] - triangleOffsets[m];
+	}
+
+	list.push_back(glm::ivec4(-1, vertexJobs, triangleJobs, 0));
+	return list;
+}
+
+// True if mesh m is moved by a skin
+bool isSkinnedMesh(int m)
+{
+	for (const SkinnedMesh& skinned : skinnedMeshes)
+	{
+		if (skinned.mesh == m)
+			return true;
+	}
+
+	return false;
+}
+
+// The matrices of the joints of every skin at time, one skin after the other, the way Compute.glsl gets them:
+// the joint, times its inverse bind matrix, times the unbake matrix of the mesh
+void poseSkins(float time, std::vector<glm::mat4x4>& matrices)
+{
+	std::vector<glm::mat4> joints;
+	matrices.clear();
+
+	for (const SkinnedMesh& skinned : skinnedMeshes)
+	{
+		poseGltfSkin(gltfSkeletons[skinned.skeleton], skinned.skin, time, joints);
+
+		for (const glm::mat4& joint : joints)
+			matrices.push_back(joint * skinned.unbake);
+	}
+}
+
+// Make the tables of the skinned meshes for Compute.glsl, after makeIndexedMeshes welded their vertices. A vertex
+// gets the skin of the corners that were welded into it, found by the same bits that they were welded by
+void makeSkinTables()
+{
+	meshSkins.assign(numSceneMeshes, glm::ivec4(-1, 0, 0, 0));
+	vertexSkins.clear();
+	int numJoints = 0;
+
+	for (SkinnedMesh& skinned : skinnedMeshes)
+	{
+		int m = skinned.mesh;
+		int skinJoints = (int)gltfSkeletons[skinned.skeleton].skins[skinned.skin].joints.size();
+
+		skinned.firstJoint = numJoints;
+		meshSkins[m] = glm::ivec4(numJoints, (int)vertexSkins.size(), 0, 0);
+		numJoints += skinJoints;
+
+		std::unordered_map<std::tuple<unsigned int, unsigned int, unsigned int>, GltfCornerSkin, CornerHash> skins;
+		for (size_t c = 0; c < skinned.corners.size(); c++)
+		{
+			glm::vec3 p = skinned.corners[c] + glm::vec3(0.0f);
+			unsigned int bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			skins.insert({ std::make_tuple(bits[0], bits[1], bits[2]), skinned.cornerSkins[c] });
+		}
+
+		skinned.bindBounds = emptyAABB();
+
+		for (int v = sceneVertexOffsets[m]; v < sceneVertexOffsets[m + 1]; v++)
+		{
+			glm::vec3 p(sceneVertices[v]);
+			unsigned int bits[3];
+			memcpy(bits, &p, sizeof(bits));
+
+			GltfCornerSkin skin = skins[std::make_tuple(bits[0], bits[1], bits[2])];
+
+			// a joint that the skin does not have does not move the vertex
+			for (int k = 0; k < 4; k++)
+			{
+				if (skin.joints[k] < 0 || skin.joints[k] >= skinJoints)
+				{
+					skin.joints[k] = 0;
+					skin.weights[k] = 0.0f;
+				}
+			}
+
+			vertexSkins.push_back(skin);
+			growAABB(skinned.bindBounds, p);
+		}
+	}
+
+	glGenBuffers(1, &meshSkinBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshSkinBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, meshSkinBuffer, sizeof(glm::ivec4) * meshSkins.size(), meshSkins.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+
+	glGenBuffers(1, &vertexSkinBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexSkinBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, vertexSkinBuffer, sizeof(GltfCornerSkin) * vertexSkins.size(), vertexSkins.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+
+	// the joints are uploaded by the first frame (see updateSkins)
+	glGenBuffers(1, &jointMatrixBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, jointMatrixBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, jointMatrixBuffer, sizeof(glm::mat4x4) * numJoints, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	skinJointMatrices.clear();
+	std::cout << skinnedMeshes.size() << " skinned meshes, with " << vertexSkins.size() << " vertices and " << numJoints << " joints" << std::endl;
+}
+
+// Put the nodes of the BLAS of every skinned mesh in levels for PASS_REFIT of Compute.glsl, the deepest level first,
+// from nodes, which are the nodes of twoLevelNodeBuffer. init makes it after the BLAS are built, and --bvh-hot-layout
+// again after it moved their nodes
+void makeSkinRefitList(const std::vector<BVHNode>& nodes)
+{
+	std::vector<std::vector<glm::ivec4>> levels;
+
+	for (const SkinnedMesh& skinned : skinnedMeshes)
+	{
+		std::vector<std::pair<int, int>> stack(1, std::make_pair(blasRoots[skinned.mesh], 0));
+
+		while (!stack.empty())
+		{
+			int node = stack.back().first;
+			int depth = stack.back().second;
+			stack.pop_back();
+
+			if (depth >= (int)levels.size())
+				levels.resize(depth + 1);
+
+			levels[depth].push_back(glm::ivec4(node, sceneMeshOffsets[skinned.mesh], 0, 0));
+
+			if (nodes[node].left >= 0)
+			{
+				stack.push_back(std::make_pair(nodes[node].left, depth + 1));
+				stack.push_back(std::make_pair(nodes[node].right, depth + 1));
+			}
+		}
+	}
+
+	skinRefitNodes.clear();
+	skinRefitLevels.clear();
+
+	for (int l = (int)levels.size() - 1; l >= 0; l--)
+	{
+		skinRefitLevels.push_back((int)skinRefitNodes.size());
+		skinRefitNodes.insert(skinRefitNodes.end(), levels[l].begin(), levels[l].end());
+	}
+
+	skinRefitLevels.push_back((int)skinRefitNodes.size());
+
+	if (skinRefitBuffer == 0)
+		glGenBuffers(1, &skinRefitBuffer);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, skinRefitBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, skinRefitBuffer, sizeof(glm::ivec4) * skinRefitNodes.size(), skinRefitNodes.data(), GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Move the skinned meshes of the two-level BVH by their joints, in the space of their mesh, into triangleBuffer, and give
+// every node of their BLAS the box around its new triangles, one level at a time from the leaves up (PASS_REFIT).
+// The tree stays the one that was built for the bind pose, so a pose that is far from it makes the boxes overlap more,
+// but it costs one pass over the vertices and triangles of the skinned meshes and a small dispatch per level, instead
+// of uploading the triangles and building the BLAS again on the CPU
+void skinBLAS()
+{
+	PROFILE_ZONE("skinBLAS");
+
+	std::vector<bool> dirty(numSceneMeshes, false);
+	for (const SkinnedMesh& skinned : skinnedMeshes)
+		dirty[skinned.mesh] = true;
+
+	std::vector<glm::ivec4> dirtyList = makeDirtyList(dirty, sceneMeshOffsets, sceneVertexOffsets);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dirtyMeshBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, dirtyMeshBuffer, sizeof(glm::ivec4) * dirtyList.size(), dirtyList.data(), GL_STREAM_DRAW, GPU_MEMORY_UPLOAD);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(transform_program);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, triangleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sceneVertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, sceneIndexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, worldVertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, meshOffsetBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, dirtyMeshBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 32, meshSkinBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 33, vertexSkinBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 34, jointMatrixBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, twoLevelNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 35, skinRefitBuffer);
+	glUniform1i(transform_numVertices_loc, (int)sceneVertices.size());
+	glUniform1i(transform_numTriangles_loc, bvhNumTriangles);
+	glUniform1i(transform_numMeshes_loc, numSceneMeshes);
+	glUniform1i(transform_emitKeys_loc, 0);
+	glUniform1i(transform_skinning_loc, 1);
+	glUniform1i(transform_meshSpace_loc, 1);
+	glUniform1i(transform_dirtyOnly_loc, 1);
+	glUniform1i(transform_numDirty_loc, (int)dirtyList.size() - 1);
+
+	runTransformPasses(transform_pass_loc, transform_numJobs_loc, dirtyList.back().y, dirtyList.back().z, transformGroupSize);
+
+	// every level reads the boxes that the level before it wrote
+	glUniform1i(transform_pass_loc, TRANSFORM_PASS_REFIT);
+
+	for (size_t l = 0; l + 1 < skinRefitLevels.size(); l++)
+	{
+		int count = skinRefitLevels[l + 1] - skinRefitLevels[l];
+
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUniform1i(transform_firstRefit_loc, skinRefitLevels[l]);
+		glUniform1i(transform_numJobs_loc, count);
+		dispatchTransform(count, transformGroupSize);
+	}
+
+	glUniform1i(transform_meshSpace_loc, 0);
+	gpuWrote({ RES_SKINNED_BLAS });
+}
+
+// Pose the skins for the frame at time, and upload their joints if they moved. The box of every skinned mesh is the
+// box of its bind pose moved by every joint of its skin, which holds every place that a weighted sum of them can move
+// a vertex to, so the TLAS can be built around it before the GPU moved anything. With the two-level BVH, skinBLAS
+// then moves the triangles of the BLAS
+void updateSkins(float time)
+{
+	PROFILE_ZONE("updateSkins");
+
+	std::vector<glm::mat4x4> matrices;
+	poseSkins(time, matrices);
+
+	for (const SkinnedMesh& skinned : skinnedMeshes)
+	{
+		int numJoints = (int)gltfSkeletons[skinned.skeleton].skins[skinned.skin].joints.size();
+		AABB bounds = emptyAABB();
+
+		for (int j = 0; j < numJoints; j++)
+			growAABB(bounds, transformAABB(skinned.bindBounds, matrices[skinned.firstJoint + j]));
+
+		meshBounds[skinned.mesh] = bounds;
+	}
+
+	skinsMoved = matrices != skinJointMatrices;
+	if (!skinsMoved)
+		return;
+
+	skinJointMatrices = matrices;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, jointMatrixBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::mat4x4) * matrices.size(), matrices.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (accelBackend == ACCEL_TWO_LEVEL)
+		skinBLAS();
+}
+
+// This sorts the (key, value) pairs in keyBuffer by key, with RadixSort.glsl.
+// The keys are 32 bits, and every digit is 4 bits, so this is 8 rounds of
+// histogram, scan, and scatter. Each round moves the pairs from one buffer to the other,
+// and 8 is an even number, so the sorted pairs end up back in keyBuffer.
+// tempBuffer must be as big as keyBuffer
+void radixSortKeys(GLuint keyBuffer, GLuint tempBuffer, int numKeys)
+{
+	glUseProgram(radix_program);
+
+	int numBlocks = (numKeys + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+
+	// The histogram starts out big enough for the triangles. The wavefront
+	// renderer sorts one key per pixel, so it needs a bigger one
+	int histogramSize = (int)sizeof(GLuint) * RADIX_DIGITS * numBlocks;
+
+	if (histogramSize > radixHistogramBufferSize)
+	{
+		radixHistogramBufferSize = histogramSize;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, radixHistogramBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, radixHistogramBuffer, radixHistogramBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	glUniform1i(radix_numKeys_loc, numKeys);
+	glUniform1i(radix_numBlocks_loc, numBlocks);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, radixHistogramBuffer);
+
+	GLuint keysIn = keyBuffer;
+	GLuint keysOut = tempBuffer;
+
+	for (int bitShift = 0; bitShift < 32; bitShift += 4)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, keysIn);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, keysOut);
+		glUniform1i(radix_bitShift_loc, bitShift);
+
+		// count the digits in every block
+		glUniform1i(radix_pass_loc, RADIX_PASS_HISTOGRAM);
+		glDispatchCompute(numBlocks, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// turn the counts into places in the output,
+		// which only takes one workgroup
+		glUniform1i(radix_pass_loc, RADIX_PASS_SCAN);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// move every pair to its place
+		glUniform1i(radix_pass_loc, RADIX_PASS_SCATTER);
+		glDispatchCompute(numBlocks, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		std::swap(keysIn, keysOut);
+	}
+}
+
+// Decide if the BVH can be refit from last frame, or has to be built again, and empty its scratch for the build.
+// Returns true for a full build. buildSceneBVH does this first, unless the transform of --fused-morton already did
+bool startBVHBuild()
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhScratchBuffer);
+
+	// Decide if we can refit the tree from last frame, or if we need to build it again.
+	// The cost of last frame's tree was finished long ago (the frame was already read back with
+	// glReadPixels), so reading these 4 bytes does not make us wait for the GPU
+	bool fullBuild = !bvhAllowRefit || !bvhBuilt;
+
+	// the cost was written by the last build, and the box is emptied with glBufferSubData
+	gpuRead("BVH readback", { { RES_BVH_SCRATCH, GL_BUFFER_UPDATE_BARRIER_BIT } });
+
+	if (bvhBuilt)
+	{
+		GLuint lastCost = 0;
+		{
+			GL_STALL_ZONE("glGetBufferSubData (BVH cost)");
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 6, sizeof(GLuint), &lastCost);
+		}
+
+		// right after a full build, this is the best the tree will be
+		if (bvhLastWasBuild)
+			bvhBuildCost = lastCost;
+
+		if (lastCost > bvhBuildCost * bvhRefitThreshold)
+			fullBuild = true;
+	}
+
+	// Reset the box around the triangle centers, so that the atomicMin and atomicMax in
+	// BuildBVH.glsl start from an empty box. 0xFFFFFFFF is the biggest possible min, and 0 is the smallest possible max.
+	// The cost starts at zero
+	GLuint emptyBounds[8] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0, 0, 0, 0, 0 };
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyBounds), emptyBounds);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	return fullBuild;
+}
+
+// This builds the BVH over the triangles in compToFrag, after the transform program has written them.
+// Every pass of BuildBVH.glsl depends on the pass before it, so there is a memory barrier between each of them,
+// which makes sure that the writes of one dispatch are visible to the next dispatch.
+void buildSceneBVH()
+{
+	bool fullBuild = bvhBuildStarted ? bvhKeysFused : startBVHBuild();
+
+	glUseProgram(bvh_program);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bvhNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bvhScratchBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bvhKeyBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, bvhLinkBuffer);
+
+	if (earlySplitArea > 0.0f)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 39, splitPieceBuffer);
+
+	glUniform1i(bvh_numLeaves_loc, bvhNumLeaves);
+	glUniform1i(bvh_earlySplit_loc, earlySplitArea > 0.0f);
+
+	// BuildBVH.glsl has 64 threads per workgroup,
+	// and we need one thread per leaf
+	int numGroups = (bvhNumLeaves + 63) / 64;
+
+	// The transform program must finish writing
+	// compToFrag (and with --fused-morton, the keys) before we read the triangles
+	gpuRead("BVH build", { { RES_TRIANGLES, GL_SHADER_STORAGE_BARRIER_BIT }, { RES_BVH_SCRATCH, GL_SHADER_STORAGE_BARRIER_BIT } });
+
+	// A refit skips everything up to the leaves, and
+	// keeps the sorted order from the last full build
+	if (fullBuild)
+	{
+		// the transform of --fused-morton already did these two
+		if (!bvhKeysFused)
+		{
+			// find the box around all triangle centers
+			glUniform1i(bvh_pass_loc, BVH_PASS_BOUNDS);
+			glDispatchCompute(numGroups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			// give every triangle a morton code
+			glUniform1i(bvh_pass_loc, BVH_PASS_MORTON);
+			glDispatchCompute(numGroups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+
+		// Sort the triangles by morton code, with a radix sort. That uses its own
+		// program and binding 8, so we switch back and bind the keys again after
+		radixSortKeys(bvhKeyBuffer, bvhKeyTempBuffer, bvhNumLeaves);
+
+		glUseProgram(bvh_program);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bvhKeyBuffer);
+
+		// every interior node finds its two children,
+		// all at the same time, in one dispatch
+		glUniform1i(bvh_pass_loc, BVH_PASS_HIERARCHY);
+		glDispatchCompute(numGroups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// every sorted triangle becomes a leaf, which gets
+	// a new box from where the triangle is now
+	glUniform1i(bvh_pass_loc, BVH_PASS_LEAVES);
+	glDispatchCompute(numGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Every leaf walks up to the root and makes the boxes of the interior nodes.
+	// This is only one dispatch, no matter how deep the tree is
+	glUniform1i(bvh_pass_loc, BVH_PASS_PROPAGATE);
+	glDispatchCompute(numGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// --bvh-restructure makes the treelets of a new tree better. A refit keeps
+	// the tree of the last full build, so it keeps what the rounds did too
+	if (fullBuild && bvhRestructureRounds > 0)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 36, bvhTreeletBuffer);
+		glUniform1i(bvh_treeletSize_loc, bvhTreeletSize);
+
+		for (int round = 0; round < bvhRestructureRounds; round++)
+		{
+			// PASS_LEAVES writes the same leaves again, and empties the visits for the walk
+			glUniform1i(bvh_pass_loc, BVH_PASS_LEAVES);
+			glDispatchCompute(numGroups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			glUniform1i(bvh_pass_loc, BVH_PASS_RESTRUCTURE);
+			glDispatchCompute(numGroups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+	}
+
+	// measure the cost of the tree, which is read at the start of next frame
+	glUniform1i(bvh_pass_loc, BVH_PASS_COST);
+	glDispatchCompute((2 * bvhNumLeaves - 1 + 63) / 64, 1, 1);
+
+	// the renderer waits for the nodes when it reads them
+	gpuWrote({ RES_BVH, RES_BVH_SCRATCH });
+
+	bvhBuilt = true;
+	bvhLastWasBuild = fullBuild;
+	bvhBuildStarted = false;
+	bvhKeysFused = false;
+}
+
+// This builds the uniform grid over the triangles in compToFrag, after the transform program has written them.
+// Like buildSceneBVH, every pass depends on the pass before it, so there is a memory barrier between them
+void buildSceneGrid()
+{
+	glUseProgram(grid_program);
+
+	// Empty the box of the scene, and set the count of every cell to zero.
+	// The lists after them are written again by PASS_FILL, so they are left alone
+	std::vector<GLuint> emptyGrid(GRID_HEADER_SIZE / sizeof(GLuint), 0);
+	emptyGrid[0] = emptyGrid[1] = emptyGrid[2] = 0xFFFFFFFF;
+
+	// the last frame's grid must be written before it is emptied
+	gpuRead("grid clear", { { RES_GRID, GL_BUFFER_UPDATE_BARRIER_BIT } });
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GRID_HEADER_SIZE, emptyGrid.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, gridBuffer);
+
+	glUniform1i(grid_numTriangles_loc, bvhNumTriangles);
+
+	// one thread per triangle, 64 threads per workgroup
+	int numGroups = (bvhNumTriangles + 63) / 64;
+
+	// The transform program must finish writing
+	// compToFrag before we read the triangles
+	gpuRead("grid build", { { RES_TRIANGLES, GL_SHADER_STORAGE_BARRIER_BIT } });
+
+	glUniform1i(grid_pass_loc, GRID_PASS_BOUNDS);
+	glDispatchCompute(numGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(grid_pass_loc, GRID_PASS_COUNT);
+	glDispatchCompute(numGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// the scan only takes one workgroup
+	glUniform1i(grid_pass_loc, GRID_PASS_SCAN);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(grid_pass_loc, GRID_PASS_FILL);
+	glDispatchCompute(numGroups, 1, 1);
+
+	gpuWrote({ RES_GRID });
+}
+
+// Build the instance grid of --instance-grid over instances first to first + count - 1 of instanceBuffer, which buildTLAS
+// has just written. The buckets are the power of two that is at least twice the instances, so most lists are short
+void buildInstanceGrid(int first, int count)
+{
+	int buckets = 64;
+	while (buckets < 2 * count)
+		buckets *= 2;
+
+	// the header, with an empty box, and the counts of the buckets at zero. The rest is written by the passes
+	std::vector<GLuint> header(sizeof(instanceGrid) / sizeof(GLuint) + buckets, 0);
+	instanceGrid* grid = (instanceGrid*)header.data();
+	grid->boxMin[0] = grid->boxMin[1] = grid->boxMin[2] = 0xFFFFFFFF;
+	grid->firstInstance = first;
+	grid->count = count;
+	grid->buckets = buckets;
+
+	// a grid with no instances is only its header, which the rays skip
+	size_t bytes = count > 0 ? sizeof(GLuint) * header.size() : sizeof(instanceGrid);
+
+	gpuRead("instance grid clear", { { RES_INSTANCE_GRID, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceGridBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, header.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (count == 0)
+		return;
+
+	glUseProgram(instance_grid_program);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_GRID_BINDING, instanceGridBuffer);
+
+	// one thread per instance, 64 threads per workgroup
+	int numGroups = (count + 63) / 64;
+
+	glUniform1i(instanceGrid_pass_loc, INSTANCE_GRID_PASS_BOUNDS);
+	glDispatchCompute(numGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(instanceGrid_pass_loc, INSTANCE_GRID_PASS_COUNT);
+	glDispatchCompute(numGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// the scan only takes one workgroup
+	glUniform1i(instanceGrid_pass_loc, INSTANCE_GRID_PASS_SCAN);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(instanceGrid_pass_loc, INSTANCE_GRID_PASS_FILL);
+	glDispatchCompute(numGroups, 1, 1);
+
+	gpuWrote({ RES_INSTANCE_GRID });
+
+	instanceGridBuilds++;
+	instanceGridMost = std::max(instanceGridMost, count);
+}
+
+// Find count triangles of room in the pool, first-fit. Returns -1 if there is no range that big
+int takePoolRange(int count)
+{
+	for (auto range = poolFreeRanges.begin(); range != poolFreeRanges.end(); ++range)
+	{
+		if (range->second < count)
+			continue;
+
+		int start = range->first;
+		int left = range->second - count;
+		poolFreeRanges.erase(range);
+
+		if (left > 0)
+			poolFreeRanges[start + count] = left;
+
+		return start;
+	}
+
+	return -1;
+}
+
+// Give back the room of a mesh, joined with the free ranges right before and after it
+void freePoolRange(int start, int count)
+{
+	auto next = poolFreeRanges.lower_bound(start);
+
+	if (next != poolFreeRanges.end() && next->first == start + count)
+	{
+		count += next->second;
+		next = poolFreeRanges.erase(next);
+	}
+
+	if (next != poolFreeRanges.begin())
+	{
+		auto before = std::prev(next);
+
+		if (before->first + before->second == start)
+		{
+			before->second += count;
+			return;
+		}
+	}
+
+	poolFreeRanges[start] = count;
+}
+
+// The pages of triangleBuffer that mesh m is on, with --sparse-pool
+void poolMeshPages(int m, int& firstPage, int& lastPage)
+{
+	GLsizeiptr stride = compactMeshes ? sizeof(compactTriangle) : sizeof(triangle);
+	firstPage = (int)(stride * sceneMeshOffsets[m] / sparsePageSize);
+	lastPage = (int)((stride * sceneMeshOffsets[m + 1] - 1) / sparsePageSize);
+}
+
+// Commit the pages of mesh m with --sparse-pool, if the pool has room for its triangles, and return where it starts,
+// which is where it is in the scene. Returns -1 if there is no room. triangleBuffer must be bound to GL_SHADER_STORAGE_BUFFER
+int commitPoolMesh(int m)
+{
+	int count = sceneMeshOffsets[m + 1] - sceneMeshOffsets[m];
+
+	if (poolTriangles + count > poolCapacity)
+		return -1;
+
+	int firstPage, lastPage;
+	poolMeshPages(m, firstPage, lastPage);
+
+	for (int p = firstPage; p <= lastPage; p++)
+	{
+		if (poolPageUsers[p]++ == 0)
+			gpuBufferCommit(GL_SHADER_STORAGE_BUFFER, triangleBuffer, p * sparsePageSize, sparsePageSize, true);
+	}
+
+	poolTriangles += count;
+	return sceneMeshOffsets[m];
+}
+
+// Give back the pages of mesh m that no other mesh of the pool is on, with --sparse-pool
+void releasePoolMesh(int m)
+{
+	int firstPage, lastPage;
+	poolMeshPages(m, firstPage, lastPage);
+
+	for (int p = firstPage; p <= lastPage; p++)
+	{
+		if (--poolPageUsers[p] == 0)
+			gpuBufferCommit(GL_SHADER_STORAGE_BUFFER, triangleBuffer, p * sparsePageSize, sparsePageSize, false);
+	}
+
+	poolTriangles -= sceneMeshOffsets[m + 1] - sceneMeshOffsets[m];
+}
+
+// Pick the meshes that are wanted this frame (see geometryPoolMB), and copy the ones that are not in the pool
+// into it. leafBounds are the boxes of the leaves of the TLAS in the world, and leafMeshes their meshes
+void streamMeshes(const std::vector<AABB>& leafBounds, const std::vector<int>& leafMeshes)
+{
+	PROFILE_ZONE("streamMeshes");
+
+	// a mesh is as close as the closest of its instances
+	std::vector<float> distances(numSceneMeshes, std::numeric_limits<float>::max());
+
+	for (size_t i = 0; i < leafBounds.size(); i++)
+	{
+		glm::vec3 closest = glm::clamp(cameraPos, leafBounds[i].min, leafBounds[i].max);
+		distances[leafMeshes[i]] = std::min(distances[leafMeshes[i]], glm::length(closest - cameraPos));
+	}
+
+	std::vector<int> byDistance(numSceneMeshes);
+	for (int m = 0; m < numSceneMeshes; m++)
+		byDistance[m] = m;
+
+	std::sort(byDistance.begin(), byDistance.end(), [&](int a, int b) { return distances[a] < distances[b]; });
+
+	// the closest meshes that fit in the pool all together
+	std::vector<int> wanted;
+	int wantedTriangles = 0;
+
+	for (int m : byDistance)
+	{
+		int count = sceneMeshOffsets[m + 1] - sceneMeshOffsets[m];
+
+		if (streamRadius > 0.0f && distances[m] > streamRadius)
+			break;
+
+		if (wantedTriangles + count > poolCapacity)
+			continue;
+
+		wantedTriangles += count;
+		poolLastWanted[m] = totalFrame;
+		wanted.push_back(m);
+	}
+
+	GLsizeiptr stride = compactMeshes ? sizeof(compactTriangle) : sizeof(triangle);
+	int budget = streamBudget;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleBuffer);
+
+	for (int m : wanted)
+	{
+		int count = sceneMeshOffsets[m + 1] - sceneMeshOffsets[m];
+
+		// a mesh bigger than the budget still comes in, as the first of its frame
+		if (poolOffsets[m] >= 0 || (count > budget && budget < streamBudget))
+			continue;
+
+		int start = sparsePool ? commitPoolMesh(m) : takePoolRange(count);
+
+		// make room by forgetting the meshes that are not wanted, the one that was wanted the longest ago first
+		while (start < 0)
+		{
+			int oldest = -1;
+			for (int r = 0; r < numSceneMeshes; r++)
+			{
+				if (poolOffsets[r] >= 0 && poolLastWanted[r] != totalFrame && (oldest < 0 || poolLastWanted[r] < poolLastWanted[oldest]))
+					oldest = r;
+			}
+
+			if (oldest < 0)
+				break;
+
+			if (sparsePool)
+				releasePoolMesh(oldest);
+			else
+				freePoolRange(poolOffsets[oldest], sceneMeshOffsets[oldest + 1] - sceneMeshOffsets[oldest]);
+
+			poolOffsets[oldest] = -1;
+			streamEvictions++;
+
+			start = sparsePool ? commitPoolMesh(m) : takePoolRange(count);
+		}
+
+		// the free room is in pieces that are all too small, so this mesh waits for a frame that forgets more
+		if (start < 0)
+			continue;
+
+		const void* source = compactMeshes ? (const void*)&poolCompactTriangles[sceneMeshOffsets[m]] : (const void*)&sceneTriangles[sceneMeshOffsets[m]];
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, stride * start, stride * count, source);
+
+		poolOffsets[m] = start;
+		budget -= count;
+		streamedTriangles += count;
+		streamedMeshes++;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Bring tlasTree up to date with the leaves of this frame (--incremental-tlas), and write it for the shaders.
+// numSources is every mesh and instance, and leaf i of buildTLAS is source leafSources[i], with its box in worldBounds.
+// The sources that are not leaves this frame are taken out of the tree. order is like the order of buildBVH
+void updateTLASTree(int numSources, const std::vector<int>& leafSources, const std::vector<AABB>& worldBounds,
+	std::vector<BVHNode>& nodes, std::vector<int>& order)
+{
+	double start = platformTime();
+
+	// the leaf of buildTLAS of every source, -1 for the ones that are left out
+	std::vector<int> leafOf(numSources, -1);
+	for (int i = 0; i < (int)leafSources.size(); i++)
+		leafOf[leafSources[i]] = i;
+
+	if ((int)tlasLeaves.size() < numSources)
+	{
+		tlasLeaves.resize(numSources, -1);
+		tlasLeafBoxes.resize(numSources);
+	}
+
+	for (int s = 0; s < (int)tlasLeaves.size(); s++)
+	{
+		int i = s < numSources ? leafOf[s] : -1;
+
+		if (i < 0)
+		{
+			if (tlasLeaves[s] >= 0)
+			{
+				removeDynamicLeaf(tlasTree, tlasLeaves[s]);
+				tlasLeaves[s] = -1;
+				tlasRemoves++;
+			}
+
+			continue;
+		}
+
+		tlasLeafBoxes[s] = worldBounds[i];
+
+		if (tlasLeaves[s] < 0)
+		{
+			tlasLeaves[s] = insertDynamicLeaf(tlasTree, worldBounds[i], s);
+			tlasInserts++;
+		}
+		else if (moveDynamicLeaf(tlasTree, tlasLeaves[s], worldBounds[i]))
+		{
+			tlasMoves++;
+		}
+	}
+
+	flattenDynamicBVH(tlasTree, tlasLeafBoxes, nodes, order);
+
+	// the tree has the sources, and buildTLAS wants its own leaves
+	for (int& o : order)
+		o = leafOf[o];
+
+	tlasUpdates++;
+	tlasUpdateSeconds += platformTime() - start;
+}
+
+// The instance of a mesh, placed by open (and close, at the end of the shutter of --motion-blur), for source, which is a
+// mesh, or an instance after numMeshes
+Instance makeInstance(int mesh, const glm::mat4x4& open, const glm::mat4x4& close, int source, int numMeshes)
+{
+	Instance instance = {};
+	instance.worldToObject = glm::inverse(open);
+	instance.blasRoot = (blasNodeFormat == BVH_FORMAT_WIDE4) ? wideBlasRoots[mesh] : blasRoots[mesh];
+	instance.meshIndex = mesh;
+	instance.firstTriangle = geometryPoolMB > 0 ? poolOffsets[mesh] : sceneMeshOffsets[mesh];
+	instance.boxMin = glm::vec4(meshBounds[mesh].min, 0.0f);
+	instance.boxSize = glm::vec4(meshBounds[mesh].max - meshBounds[mesh].min, 0.0f);
+	instance.shutterOpen = open;
+	instance.shutterClose = close;
+
+	if (instance.shutterClose != instance.shutterOpen)
+		instance.boxSize.w = 1.0f;
+
+	const std::vector<int>& lodRoots = (blasNodeFormat == BVH_FORMAT_WIDE4) ? lodWideBlasRoots : lodBlasRoots;
+	instance.lodRoots = glm::ivec4(lodRoots[MESH_LODS * mesh], lodRoots[MESH_LODS * mesh + 1],
+		lodFirstTriangles[MESH_LODS * mesh], lodFirstTriangles[MESH_LODS * mesh + 1]);
+	instance.primitive = analyticPrimitives ? meshPrimitives[mesh] : PRIMITIVE_NONE;
+
+	if (source >= numMeshes && sceneInstances[source - numMeshes].ownMaterial)
+	{
+		const SceneInstance& place = sceneInstances[source - numMeshes];
+		instance.packedMaterial = glm::packUnorm4x8(glm::vec4(place.color, place.reflectivity));
+		instance.boxMin.w = 1.0f;
+	}
+
+	return instance;
+}
+
+// This builds the TLAS for the two-level BVH, on the CPU. There is one
+// leaf per mesh, and one per instance of --gltf after those, so this only
+// costs as much as the number of meshes and instances, no matter how many
+// triangles are in each mesh. With --incremental-tlas, the tree of the frame before is changed instead.
+// The instances of --instance-grid are not leaves, they go into the instance grid on the GPU
+void buildTLAS(glm::mat4x4* matrices, int numMeshes)
+{
+	int numSources = numMeshes + (int)sceneInstances.size();
+
+	// the matrices when the shutter of --motion-blur closes, which are the same ones without it
+	const glm::mat4x4* closeMatrices = motionBlur && (int)shutterMatrices.size() == numMeshes ? shutterMatrices.data() : matrices;
+
+	// the mesh of every leaf, where it is in the world (and where it is at the end of the shutter), and which mesh or instance it is
+	std::vector<int> leafMeshes;
+	std::vector<glm::mat4x4> leafMatrices;
+	std::vector<glm::mat4x4> leafCloseMatrices;
+	std::vector<int> leafSources;
+
+	// the same for the instances of --instance-grid, which are not leaves
+	std::vector<int> gridMeshes;
+	std::vector<glm::mat4x4> gridMatrices;
+	std::vector<glm::mat4x4> gridCloseMatrices;
+	std::vector<int> gridSources;
+
+	for (int i = 0; i < numSources; i++)
+	{
+		int mesh = i < numMeshes ? i : sceneInstances[i - numMeshes].mesh;
+
+		// the place of an instance that the scene file took out
+		if (mesh < 0)
+			continue;
+
+		bool inGrid = useInstanceGrid && i >= numMeshes && sceneInstances[i - numMeshes].grid;
+
+		(inGrid ? gridSources : leafSources).push_back(i);
+		(inGrid ? gridMeshes : leafMeshes).push_back(mesh);
+		(inGrid ? gridMatrices : leafMatrices).push_back(i < numMeshes ? matrices[i] : matrices[mesh] * sceneInstances[i - numMeshes].matrix);
+		(inGrid ? gridCloseMatrices : leafCloseMatrices).push_back(i < numMeshes ? closeMatrices[i] : closeMatrices[mesh] * sceneInstances[i - numMeshes].matrix);
+	}
+
+	int numInstances = (int)leafSources.size();
+
+	// The box around each mesh, after it is moved into the world. A mesh that moves in the shutter is
+	// somewhere on the line between where it is at both ends, so the box around both holds all of it
+	std::vector<AABB> worldBounds(numInstances);
+	for (int i = 0; i < numInstances; i++)
+	{
+		worldBounds[i] = transformAABB(meshBounds[leafMeshes[i]], leafMatrices[i]);
+
+		if (leafCloseMatrices[i] != leafMatrices[i])
+			growAABB(worldBounds[i], transformAABB(meshBounds[leafMeshes[i]], leafCloseMatrices[i]));
+	}
+
+	// with the pool, the leaves of the meshes that are not in it yet are left out
+	if (geometryPoolMB > 0)
+	{
+		streamMeshes(worldBounds, leafMeshes);
+
+		int kept = 0;
+		for (int i = 0; i < numInstances; i++)
+		{
+			if (poolOffsets[leafMeshes[i]] < 0)
+				continue;
+
+			leafMeshes[kept] = leafMeshes[i];
+			leafMatrices[kept] = leafMatrices[i];
+			leafCloseMatrices[kept] = leafCloseMatrices[i];
+			leafSources[kept] = leafSources[i];
+			worldBounds[kept] = worldBounds[i];
+			kept++;
+		}
+
+		numInstances = kept;
+		worldBounds.resize(kept);
+	}
+
+	std::vector<BVHNode> tlasNodes;
+	std::vector<int> order;
+
+	if (incrementalTLAS)
+		updateTLASTree(numSources, leafSources, worldBounds, tlasNodes, order);
+	else
+		buildBVH(worldBounds, 1, tlasNodes, order);
+
+	// Put the instances in the order of the TLAS leaves,
+	// so that the leaf "left = ~i" points at instance i.
+	// The instances of the grid come after them, in any order
+	int numGrid = (int)gridSources.size();
+	std::vector<Instance> instances(numInstances + numGrid);
+	for (int i = 0; i < numInstances; i++)
+		instances[i] = makeInstance(leafMeshes[order[i]], leafMatrices[order[i]], leafCloseMatrices[order[i]], leafSources[order[i]], numMeshes);
+
+	for (int i = 0; i < numGrid; i++)
+		instances[numInstances + i] = makeInstance(gridMeshes[i], gridMatrices[i], gridCloseMatrices[i], gridSources[i], numMeshes);
+
+	// only the TLAS part of the node buffer changes, the BLAS part was uploaded in init()
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, twoLevelNodeBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(BVHNode) * tlasNodes.size(), tlasNodes.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Instance) * instances.size(), instances.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (useInstanceGrid)
+		buildInstanceGrid(numInstances, numGrid);
+}
+
+// Make the epochs of --shadow-cache for the lights and matrices of this frame: a light that moved, or that has a mesh
+// that moved inside its radius (where the mesh was, or where it is now), gets a new epoch. Only something inside the
+// radius can be between the light and a point that it lights. This runs every frame, after makeSceneLights
+void updateShadowCache(const std::vector<glm::mat4x4>& matrices)
+{
+	int numLights = std::min((int)sceneLights.size(), MAX_LIGHTS);
+	bool clear = false;
+
+	if (!shadowCacheBuffer)
+	{
+		glGenBuffers(1, &shadowCacheBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowCacheBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, shadowCacheBuffer, sizeof(GLuint) * (MAX_LIGHTS + SHADOW_CACHE_ENTRIES), nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_RENDER);
+		shadowEpochs.assign(MAX_LIGHTS, 1);
+		clear = true;
+	}
+
+	// the meshes that moved, where they were and where they are now
+	std::vector<AABB> movedBoxes;
+
+	if (shadowCacheMatrices.size() == matrices.size())
+	{
+		for (int m = 0; m < numSceneMeshes; m++)
+		{
+			if (matrices[m] != shadowCacheMatrices[m])
+			{
+				movedBoxes.push_back(transformAABB(meshBounds[m], shadowCacheMatrices[m]));
+				movedBoxes.push_back(transformAABB(meshBounds[m], matrices[m]));
+			}
+		}
+	}
+
+	for (int j = 0; j < numLights; j++)
+	{
+		const light& L = sceneLights[j];
+		bool changed = j >= (int)shadowCacheLights.size() || shadowCacheMatrices.size() != matrices.size() ||
+			L.pos != shadowCacheLights[j].pos || L.radius != shadowCacheLights[j].radius;
+
+		for (size_t b = 0; b < movedBoxes.size() && !changed; b++)
+		{
+			// the closest point of the box to the light
+			glm::vec3 closest = glm::clamp(L.pos, movedBoxes[b].min, movedBoxes[b].max);
+			changed = glm::distance(closest, L.pos) <= L.radius;
+		}
+
+		if (changed)
+			shadowEpochs[j]++;
+
+		if (shadowEpochs[j] > SHADOW_EPOCH_MAX)
+			clear = true;
+	}
+
+	if (clear)
+	{
+		shadowEpochs.assign(MAX_LIGHTS, 1);
+
+		GLuint zero = 0;
+		gpuRead("shadow cache clear", { { RES_SHADOW_CACHE, GL_BUFFER_UPDATE_BARRIER_BIT } });
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowCacheBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	}
+
+	gpuRead("shadow epochs", { { RES_SHADOW_CACHE, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowCacheBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * MAX_LIGHTS, shadowEpochs.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, shadowCacheBuffer);
+
+	shadowCacheLights = sceneLights;
+	shadowCacheMatrices = matrices;
+}
+
+// Mark the tiles of --dirty-rects that the box covers on the screen, with a pixel more on every side for the rays
+// that only graze it. False if part of the box is behind the camera, where it has no rectangle on the screen
+bool markDirtyTiles(const AABB& box, int tilesX, int tilesY, std::vector<bool>& tiles)
+{
+	glm::vec2 low(std::numeric_limits<float>::max());
+	glm::vec2 high(-std::numeric_limits<float>::max());
+
+	for (int c = 0; c < 8; c++)
+	{
+		glm::vec3 corner((c & 1) ? box.max.x : box.min.x, (c & 2) ? box.max.y : box.min.y, (c & 4) ? box.max.z : box.min.z);
+		glm::vec4 clip = cameraViewProj * glm::vec4(corner, 1.0f);
+
+		if (clip.w <= 0.0f)
+			return false;
+
+		glm::vec2 pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2(width, height);
+		low = glm::min(low, pixel);
+		high = glm::max(high, pixel);
+	}
+
+	// off the screen
+	if (high.x < 0.0f || high.y < 0.0f || low.x > width || low.y > height)
+		return true;
+
+	low = glm::max(low - 1.0f, glm::vec2(0.0f));
+	high = glm::min(high + 1.0f, glm::vec2(width - 1, height - 1));
+
+	for (int y = (int)low.y / DIRTY_TILE_SIZE; y <= (int)high.y / DIRTY_TILE_SIZE && y < tilesY; y++)
+		for (int x = (int)low.x / DIRTY_TILE_SIZE; x <= (int)high.x / DIRTY_TILE_SIZE && x < tilesX; x++)
+			tiles[y * tilesX + x] = true;
+
+	return true;
+}
+
+// Find the rectangles of the screen that --dirty-rects traces this frame, from the matrices and lights of this frame
+// and the ones of the frame before. calcCameraRays must already have made cameraViewProj. False when the whole frame
+// is traced: the first one, when the camera, the render size, or the scene file changed, or when most of it changed
+// anyway. rects are x, y, width, height in pixels, and are empty when nothing changed at all
+bool findDirtyRects(const std::vector<glm::mat4x4>& matrices, std::vector<glm::ivec4>& rects)
+{
+	rects.clear();
+
+	bool full = !dirtyRectsValid || numViews != 1 || width != dirtyRectWidth || height != dirtyRectHeight ||
+		cameraPos != dirtyRectCamera[0] || cameraTarget != dirtyRectCamera[1] || cameraUp != dirtyRectCamera[2] ||
+		cameraFov != dirtyRectFov || sceneFileChanges != dirtyRectSceneChanges ||
+		matrices.size() != dirtyRectMatrices.size() || sceneLights.size() != dirtyRectLights.size();
+
+	// the scene file can change the meshes, and what they reflect
+	if (sceneFileChanges != dirtyRectSceneChanges)
+		reflectiveMeshes.clear();
+
+	std::vector<glm::mat4x4> lastMatrices;
+	std::vector<light> lastLights;
+	lastMatrices.swap(dirtyRectMatrices);
+	lastLights.swap(dirtyRectLights);
+
+	dirtyRectsValid = true;
+	dirtyRectMatrices = matrices;
+	dirtyRectLights = sceneLights;
+	dirtyRectCamera[0] = cameraPos;
+	dirtyRectCamera[1] = cameraTarget;
+	dirtyRectCamera[2] = cameraUp;
+	dirtyRectFov = cameraFov;
+	dirtyRectWidth = width;
+	dirtyRectHeight = height;
+	dirtyRectSceneChanges = sceneFileChanges;
+
+	if (full)
+		return false;
+
+	if ((int)reflectiveMeshes.size() != numSceneMeshes)
+	{
+		reflectiveMeshes.assign(numSceneMeshes, false);
+
+		for (int m = 0; m < numSceneMeshes; m++)
+			for (int i = sceneMeshOffsets[m]; i < sceneMeshOffsets[m + 1] && !reflectiveMeshes[m]; i++)
+				reflectiveMeshes[m] = materialTable ? sceneMaterials[sceneTriangles[i].packedRedGreen].reflectivity > 0.0f :
+					glm::unpackHalf2x16(sceneTriangles[i].packedBlueReflectivity).y > 0.0f;
+	}
+
+	// the meshes that moved, where they were and where they are now
+	std::vector<AABB> movedBoxes;
+
+	for (int m = 0; m < numSceneMeshes; m++)
+	{
+		if (matrices[m] != lastMatrices[m])
+		{
+			movedBoxes.push_back(transformAABB(meshBounds[m], lastMatrices[m]));
+			movedBoxes.push_back(transformAABB(meshBounds[m], matrices[m]));
+		}
+	}
+
+	// and the spheres of the lights that changed, or that have a mesh that moved inside them (like updateShadowCache)
+	std::vector<AABB> boxes = movedBoxes;
+
+	for (size_t j = 0; j < sceneLights.size(); j++)
+	{
+		const light& L = sceneLights[j];
+		const light& last = lastLights[j];
+		bool changed = L.pos != last.pos || L.radius != last.radius || L.color != last.color || L.brightness != last.brightness;
+
+		for (size_t b = 0; b < movedBoxes.size() && !changed; b++)
+		{
+			glm::vec3 closest = glm::clamp(L.pos, movedBoxes[b].min, movedBoxes[b].max);
+			changed = glm::distance(closest, L.pos) <= L.radius;
+		}
+
+		if (changed)
+		{
+			boxes.push_back({ L.pos - glm::vec3(L.radius), L.pos + glm::vec3(L.radius) });
+			boxes.push_back({ last.pos - glm::vec3(last.radius), last.pos + glm::vec3(last.radius) });
+		}
+	}
+
+	// a mirror can show any of it
+	if (!boxes.empty() && maxBounces > 0)
+	{
+		for (int m = 0; m < numSceneMeshes; m++)
+			if (reflectiveMeshes[m])
+				boxes.push_back(transformAABB(meshBounds[m], matrices[m]));
+	}
+
+	int tilesX = (width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	int tilesY = (height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	std::vector<bool> tiles(tilesX * tilesY, false);
+
+	for (const AABB& box : boxes)
+		if (!markDirtyTiles(box, tilesX, tilesY, tiles))
+			return false;
+
+	// when most of the tiles changed, one quad is cheaper than many rectangles
+	int numTiles = (int)std::count(tiles.begin(), tiles.end(), true);
+	if (numTiles * 4 > tilesX * tilesY * 3)
+		return false;
+
+	// Every run of tiles in a row is a rectangle, which grows down over the same run in the rows after it.
+	// open has the rectangles that the row before ended with
+	std::vector<int> open;
+
+	for (int y = 0; y < tilesY; y++)
+	{
+		std::vector<int> row;
+
+		for (int x = 0; x < tilesX;)
+		{
+			if (!tiles[y * tilesX + x])
+			{
+				x++;
+				continue;
+			}
+
+			int end = x;
+			while (end < tilesX && tiles[y * tilesX + end])
+				end++;
+
+			glm::ivec4 run(x * DIRTY_TILE_SIZE, y * DIRTY_TILE_SIZE, (end - x) * DIRTY_TILE_SIZE, DIRTY_TILE_SIZE);
+			int same = -1;
+
+			for (int r : open)
+				if (rects[r].x == run.x && rects[r].z == run.z)
+					same = r;
+
+			if (same >= 0)
+			{
+				rects[same].w += DIRTY_TILE_SIZE;
+				row.push_back(same);
+			}
+			else
+			{
+				row.push_back((int)rects.size());
+				rects.push_back(run);
+			}
+
+			x = end;
+		}
+
+		open.swap(row);
+	}
+
+	return true;
+}
+
+// This function runs every frame
+// Fill lights with the lights of this frame. The first two lights are the lights
+// of the tutorial, and move around the scene. The extra lights (--lights) are small,
+// and sit still in a spiral around the cubes. time is the same time that moves the cubes
+void makeLights(float time, std::vector<light>& lights)
+{
+	// the lights of the scene file take the place of the lights of the tutorial and of --lights
+	if (sceneFile.hasLights)
+	{
+		lights = sceneFile.lights;
+		lights.insert(lights.end(), generatedLights.begin(), generatedLights.end());
+		lights.resize(std::min((int)lights.size(), MAX_LIGHTS));
+		return;
+	}
+
+	lights.resize(2 + numExtraLights);
+
+	// the lights of --scene-lights never move
+	lights.insert(lights.end(), generatedLights.begin(), generatedLights.end());
+
+	// white light
+	lights[0].color = glm::vec3(1.0, 1.0, 1.0);
+	lights[0].radius = 7;
+	lights[0].brightness = 1;
+
+	lights[0].pos = glm::vec3(
+		2 * sin(time),
+		4,
+		2 * cos(time)
+	);
+
+	// red light
+	lights[1].color = glm::vec3(1.0, 0.0, 0.0);
+	lights[1].radius = 2;
+	lights[1].brightness = 2;
+
+	lights[1].pos = glm::vec3(
+		4 * cos(time),
+		1,
+		4
+	);
+
+	for (int i = 0; i < numExtraLights; i++)
+	{
+		light& L = lights[2 + i];
+
+		// every light is a little further out on the spiral, and 137.5 degrees around from the one before
+		float angle = i * 2.39996f;
+		float distance = 1.0f + 5.0f * sqrt((i + 0.5f) / numExtraLights);
+
+		L.pos = glm::vec3(distance * cos(angle), 0.25f + 0.5f * (i % 4), distance * sin(angle));
+		L.color = glm::vec3(i % 3 == 0, i % 3 == 1, i % 3 == 2);
+		L.radius = 1;
+		L.brightness = 1;
+	}
+}
+
+// Fill sceneLights with the lights at this time
+void makeSceneLights(float time)
+{
+	makeLights(time, sceneLights);
+}
+
+// Which bucket of the light grid a cell is in. This must be the same hash as lightBucketOf in RayTracing.glsl
+GLuint lightBucketOf(glm::ivec3 cell)
+{
+	glm::uvec3 u = glm::uvec3(cell);
+	return ((u.x * 73856093u) ^ (u.y * 19349663u) ^ (u.z * 83492791u)) & (LIGHT_HASH_SIZE - 1);
+}
+
+// Call visit(bucket) once for every cell that the sphere of a light touches
+template<typename Visit>
+void forEachLightCell(const light& L, Visit visit)
+{
+	// a little bigger than the light, so that a point right on the edge of a cell
+	// is never missed because of rounding
+	float radius = L.radius + 0.001f;
+	glm::vec3 center = glm::vec3(L.pos);
+
+	glm::ivec3 lo = glm::ivec3(glm::floor((center - radius) / lightCellSize));
+	glm::ivec3 hi = glm::ivec3(glm::floor((center + radius) / lightCellSize));
+
+	for (int z = lo.z; z <= hi.z; z++)
+		for (int y = lo.y; y <= hi.y; y++)
+			for (int x = lo.x; x <= hi.x; x++)
+			{
+				// skip the corners of the box that the sphere does not touch
+				glm::vec3 cellMin = glm::vec3(x, y, z) * lightCellSize;
+				glm::vec3 closest = glm::clamp(center, cellMin, cellMin + lightCellSize);
+				glm::vec3 d = closest - center;
+
+				if (glm::dot(d, d) <= radius * radius)
+					visit(lightBucketOf(glm::ivec3(x, y, z)));
+			}
+}
+
+// Build the hashed light grid of sceneLights, with a counting sort, just like BuildGrid.glsl
+// does for the triangles: count the lights in every bucket, add up the counts to find where
+// every list starts, then fill in the lists. Two cells of the same light can land in the
+// same bucket, so every bucket remembers the last light that was put in it, and a light is
+// only put in a bucket once. The lights are added in order, so every list is in order
+void buildLightGrid()
+{
+	int n = (int)sceneLights.size();
+
+	lightBucketLast.assign(LIGHT_HASH_SIZE, ~0u);
+	lightBuckets.assign(LIGHT_HASH_SIZE * 2, 0);
+
+	for (int j = 0; j < n; j++)
+	{
+		forEachLightCell(sceneLights[j], [&](GLuint bucket) {
+			if (lightBucketLast[bucket] != (GLuint)j)
+			{
+				lightBucketLast[bucket] = j;
+				lightBuckets[bucket * 2 + 1]++;
+			}
+		});
+	}
+
+	GLuint total = 0;
+	for (int b = 0; b < LIGHT_HASH_SIZE; b++)
+	{
+		lightBuckets[b * 2] = total;
+		total += lightBuckets[b * 2 + 1];
+		lightBuckets[b * 2 + 1] = 0;
+	}
+
+	lightRefs.resize(std::max(total, 1u));
+	lightBucketLast.assign(LIGHT_HASH_SIZE, ~0u);
+
+	for (int j = 0; j < n; j++)
+	{
+		forEachLightCell(sceneLights[j], [&](GLuint bucket) {
+			if (lightBucketLast[bucket] != (GLuint)j)
+			{
+				lightBucketLast[bucket] = j;
+				lightRefs[lightBuckets[bucket * 2] + lightBuckets[bucket * 2 + 1]++] = j;
+			}
+		});
+	}
+}
+
+// Wait until the GPU has passed a fence, and return true if it had not yet.
+// glClientWaitSync can give up before the fence is done, so it is called again until it is
+bool waitForFence(GLsync fence)
+{
+	GLenum result = glClientWaitSync(fence, 0, 0);
+
+	if (result != GL_TIMEOUT_EXPIRED)
+		return false;
+
+	GL_STALL_ZONE("glClientWaitSync");
+
+	// flush once, so that the fence itself reaches the GPU
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+
+	do
+	{
+		result = glClientWaitSync(fence, flags, 1000000000);
+		flags = 0;
+	} while (result == GL_TIMEOUT_EXPIRED);
+
+	return true;
+}
+
+// Wait until the GPU is done with a slice of a ring
+void waitForUploadSlice(UploadRing& ring, int slice)
+{
+	if (ring.fences[slice] == 0)
+		return;
+
+	if (waitForFence(ring.fences[slice]))
+		uploadRingWaits++;
+
+	glDeleteSync(ring.fences[slice]);
+	ring.fences[slice] = 0;
+}
+
+// Give a ring slices that can hold size bytes each. The offset of a slice has to be
+// a multiple of the binding alignment, so the slice size is rounded up to it.
+// A ring that is already there is thrown away, after the GPU is done with all of it
+void makeUploadRing(UploadRing& ring, GLsizeiptr size)
+{
+	if (ring.buffer != 0)
+	{
+		for (int i = 0; i < UPLOAD_RING_SLICES; i++)
+			waitForUploadSlice(ring, i);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ring.buffer);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		gpuDeleteBuffers(1, &ring.buffer);
+	}
+
+	// the slices of the lights are bound as a uniform block too (see lightUniforms)
+	GLint alignment = 256;
+	GLint uniformAlignment = 256;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	alignment = std::max(alignment, uniformAlignment);
+
+	ring.sliceSize = (size + alignment - 1) / alignment * alignment;
+	ring.slice = 0;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &ring.buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ring.buffer);
+	gpuBufferStorage(GL_SHADER_STORAGE_BUFFER, ring.buffer, ring.sliceSize * UPLOAD_RING_SLICES, nullptr, flags, GPU_MEMORY_UPLOAD);
+	ring.mapped = (char*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, ring.sliceSize * UPLOAD_RING_SLICES, flags);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Move to the next slice of a ring, and return where the CPU can write size bytes into it.
+// If the data got too big for the slices (more lights in the light grid), the ring gets bigger
+char* beginUpload(UploadRing& ring, GLsizeiptr size)
+{
+	if (size > ring.sliceSize)
+		makeUploadRing(ring, size * 2);
+	else
+		ring.slice = (ring.slice + 1) % UPLOAD_RING_SLICES;
+
+	waitForUploadSlice(ring, ring.slice);
+
+	return ring.mapped + ring.slice * ring.sliceSize;
+}
+
+// Bind the slice that was written last to a storage buffer binding
+void bindUpload(UploadRing& ring, GLuint binding, GLsizeiptr size)
+{
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, ring.buffer, ring.slice * ring.sliceSize, size);
+}
+
+// Bind the start of the slice that was written last to a uniform buffer binding
+void bindUniformUpload(UploadRing& ring, GLuint binding, GLsizeiptr size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring.buffer, ring.slice * ring.sliceSize, size);
+}
+
+// After every command that reads the slice was sent, a fence says when the GPU is done with it.
+// The mapping is coherent, so the CPU writes do not need to be flushed
+void endUpload(UploadRing& ring)
+{
+	if (ring.buffer == 0)
+		return;
+
+	// a frame that did not write the ring (the two-level BVH skips the transform)
+	// still reads nothing from it after this, so the newer fence replaces the old one
+	if (ring.fences[ring.slice] != 0)
+		glDeleteSync(ring.fences[ring.slice]);
+
+	ring.fences[ring.slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Make the hidden window of the loader thread of --async-upload, which shares the objects of window, and the staging
+// buffer that the loader copies through. It is made here, and not by the loader, because GLFW only makes windows on
+// the main thread. Returns false if there is no persistent mapping or no second context, and then init uploads as before
+bool makeAsyncLoader()
+{
+	if (!GLEW_ARB_buffer_storage)
+		return false;
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	loaderWindow = glfwCreateWindow(1, 1, "", nullptr, window);
+
+	if (loaderWindow == nullptr)
+		return false;
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = (GLsizeiptr)ASYNC_UPLOAD_CHUNK * ASYNC_UPLOAD_SLICES;
+
+	glGenBuffers(1, &asyncStagingBuffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, asyncStagingBuffer);
+	gpuBufferStorage(GL_COPY_READ_BUFFER, asyncStagingBuffer, size, nullptr, flags, GPU_MEMORY_UPLOAD);
+	asyncStagingMapped = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return true;
+}
+
+// Fill part of a scene buffer that was just given storage, and is bound to target. With --async-upload, it is
+// cleared to zero, and the loader thread copies data into it later, so data has to stay where it is until then
+void uploadSceneData(GLenum target, GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	if (!asyncUpload)
+	{
+		glBufferSubData(target, offset, size, data);
+		return;
+	}
+
+	GLuint zero = 0;
+	glClearBufferSubData(target, GL_R32UI, offset, size, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	asyncUploadJobs.push_back({ buffer, offset, data, size });
+}
+
+// Hand the loader's newest fence to the frames. Fences of one context signal in order,
+// so a fence that no frame has waited for yet is replaced by the newer one
+void publishAsyncUpload(bool done)
+{
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// another context can only wait for a fence once it has been sent to the GPU
+	glFlush();
+
+	std::lock_guard<std::mutex> lock(asyncUploadMutex);
+
+	if (asyncUploadFence != 0)
+		glDeleteSync(asyncUploadFence);
+
+	asyncUploadFence = fence;
+	asyncUploadDone = done;
+}
+
+// The loader thread of --async-upload. It copies the jobs in order, one chunk at a time
+// into the next slice of the staging buffer, and from there into the scene buffer
+void runAsyncUpload()
+{
+	nameProfileThread("loader");
+	glfwMakeContextCurrent(loaderWindow);
+
+	GLsync sliceFences[ASYNC_UPLOAD_SLICES] = {};
+	int slice = 0;
+
+	glBindBuffer(GL_COPY_READ_BUFFER, asyncStagingBuffer);
+
+	for (const AsyncUploadJob& job : asyncUploadJobs)
+	{
+		PROFILE_ZONE("async upload");
+		glBindBuffer(GL_COPY_WRITE_BUFFER, job.buffer);
+
+		for (GLsizeiptr done = 0; done < job.size; done += ASYNC_UPLOAD_CHUNK)
+		{
+			GLsizeiptr size = std::min((GLsizeiptr)ASYNC_UPLOAD_CHUNK, job.size - done);
+
+			// the GPU may still be copying the chunk before last out of this slice
+			if (sliceFences[slice] != 0)
+			{
+				glClientWaitSync(sliceFences[slice], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				glDeleteSync(sliceFences[slice]);
+			}
+
+			memcpy(asyncStagingMapped + (GLsizeiptr)slice * ASYNC_UPLOAD_CHUNK, (const char*)job.data + done, size);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)slice * ASYNC_UPLOAD_CHUNK, job.offset + done, size);
+			sliceFences[slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			slice = (slice + 1) % ASYNC_UPLOAD_SLICES;
+
+			publishAsyncUpload(false);
+		}
+	}
+
+	// the staging buffer is unmapped by the main thread, after the GPU is done with every slice
+	for (int i = 0; i < ASYNC_UPLOAD_SLICES; i++)
+	{
+		if (sliceFences[i] != 0)
+		{
+			glClientWaitSync(sliceFences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(sliceFences[i]);
+		}
+	}
+
+	publishAsyncUpload(true);
+	glfwMakeContextCurrent(nullptr);
+}
+
+// Start the loader thread, after init has queued every job
+void startAsyncUpload()
+{
+	asyncUploadBytes = 0;
+
+	for (const AsyncUploadJob& job : asyncUploadJobs)
+		asyncUploadBytes += job.size;
+
+	asyncUploadStart = platformTime();
+	asyncUploadFrames = 0;
+
+	// the clears of the buffers have to be sent before the loader copies into them
+	glFlush();
+
+	loaderThread = std::thread(runAsyncUpload);
+}
+
+// The meshes have new triangles, so every mesh is moved again in the transform pass,
+// and what the frames before kept of the scene is old
+void forgetUploadedScene()
+{
+	transformedMatrices.clear();
+	spareTransform.transformedMatrices.clear();
+	shadowCacheMatrices.clear();
+	accumulatedSamples = 0;
+}
+
+// Make the GPU wait until the loader is done with everything (the CPU does not wait for the GPU),
+// and let the loader go. Nothing happens if there is no loader, or it is already done
+void finishAsyncUpload()
+{
+	if (!loaderThread.joinable())
+		return;
+
+	loaderThread.join();
+
+	// the last fence, if no frame has waited for it yet
+	if (asyncUploadFence != 0)
+	{
+		glWaitSync(asyncUploadFence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(asyncUploadFence);
+		asyncUploadFence = 0;
+	}
+
+	forgetUploadedScene();
+
+	glfwDestroyWindow(loaderWindow);
+	loaderWindow = nullptr;
+
+	glBindBuffer(GL_COPY_READ_BUFFER, asyncStagingBuffer);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	gpuDeleteBuffers(1, &asyncStagingBuffer);
+	asyncStagingBuffer = 0;
+
+	asyncUploadJobs.clear();
+	std::vector<compactTriangle>().swap(asyncCompactTriangles);
+
+	std::cout << "the loader uploaded " << asyncUploadBytes / (1024 * 1024) << " MB of the scene in "
+		<< (platformTime() - asyncUploadStart) * 1000.0 << " ms, while " << asyncUploadFrames << " frames were rendered" << std::endl;
+}
+
+// Called before every frame of --async-upload. If the loader copied more since the frame before,
+// the GPU waits for it before this frame reads the scene
+void updateAsyncUpload()
+{
+	if (!loaderThread.joinable())
+		return;
+
+	GLsync fence;
+	bool done;
+
+	{
+		std::lock_guard<std::mutex> lock(asyncUploadMutex);
+		fence = asyncUploadFence;
+		done = asyncUploadDone;
+		asyncUploadFence = 0;
+	}
+
+	asyncUploadFrames++;
+
+	if (fence == 0)
+		return;
+
+	glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+	glDeleteSync(fence);
+
+	forgetUploadedScene();
+
+	if (done)
+		finishAsyncUpload();
+}
+
+// Put the lights, and the light grid, into lightToFrag. See lightBlock in RayTracing.glsl:
+// MAX_LIGHTS lights, then the cell size and if the grid was built, then the buckets, then the lists
+void uploadLights()
+{
+	int lightsSize = sizeof(light) * MAX_LIGHTS;
+	int headerSize = sizeof(GLuint) * 4;
+	int bucketsSize = sizeof(GLuint) * 2 * LIGHT_HASH_SIZE;
+
+	if (lightGridEnabled)
+		buildLightGrid();
+	else
+		lightRefs.resize(1);
+
+	lightToFragSize = lightsSize + headerSize + bucketsSize + (int)(sizeof(GLuint) * lightRefs.size());
+
+	struct { float cellSize; int built; int junk1; int junk2; } header = { lightCellSize, lightGridEnabled, 0, 0 };
+
+	if (persistentUploads)
+	{
+		// the same layout, written straight into the mapped ring. The slice can still
+		// hold the lights of an older frame, so the unused lights are cleared
+		char* dst = beginUpload(lightRing, lightToFragSize);
+
+		memset(dst, 0, lightsSize);
+		memcpy(dst, sceneLights.data(), sizeof(light) * sceneLights.size());
+		memcpy(dst + lightsSize, &header, headerSize);
+
+		if (lightGridEnabled)
+		{
+			memcpy(dst + lightsSize + headerSize, lightBuckets.data(), bucketsSize);
+			memcpy(dst + lightsSize + headerSize + bucketsSize, lightRefs.data(), sizeof(GLuint) * lightRefs.size());
+		}
+
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, lightToFrag);
+	gpuBufferData(GL_UNIFORM_BUFFER, lightToFrag, lightToFragSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(light) * sceneLights.size(), sceneLights.data());
+	glBufferSubData(GL_UNIFORM_BUFFER, lightsSize, headerSize, &header);
+
+	if (lightGridEnabled)
+	{
+		glBufferSubData(GL_UNIFORM_BUFFER, lightsSize + headerSize, bucketsSize, lightBuckets.data());
+		glBufferSubData(GL_UNIFORM_BUFFER, lightsSize + headerSize + bucketsSize, sizeof(GLuint) * lightRefs.size(), lightRefs.data());
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Pick where lightBlock reads the lights from (see lightUniforms). The uniform block has as many lights as fit
+// in GL_MAX_UNIFORM_BLOCK_SIZE, so every frame of the scene fits, as long as the scene does when it is loaded.
+// The lights of a scene file take the place of the two lights and --lights, like in makeLights
+void pickLightPlacement()
+{
+	GLint maxBlockSize = 16384;
+	glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+
+	int lights = sceneFile.hasLights ? (int)sceneFile.lights.size() : 2 + numExtraLights;
+	lights = std::min(lights + (int)generatedLights.size(), MAX_LIGHTS);
+
+	lightUniformCount = std::min(maxBlockSize / (int)sizeof(light), MAX_LIGHTS);
+
+	if (lights > lightUniformCount)
+		lightUniforms = false;
+}
+
+// Make the light lists big enough for every tile of the window
+void makeTileLightBuffer(int tiles)
+{
+	if (tiles <= tileLightBufferTiles)
+		return;
+
+	gpuArenaFree(renderArena, tileLightRange);
+	tileLightBufferTiles = tiles;
+
+	tileLightRange = gpuArenaAlloc(renderArena, (GLsizeiptr)sizeof(GLuint) * LIGHT_MASK_WORDS * tiles);
+	gpuArenaBind(renderArena, 21, tileLightRange);
+}
+
+// Make the list of lights for every tile of the screen, with one workgroup per tile.
+// The lights, and the camera of the light cull program, must already be set
+void cullTileLights()
+{
+	int tilesX = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	int tilesY = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+	makeTileLightBuffer(tilesX * tilesY);
+
+	glUniform1i(cull_numLights_loc, (int)sceneLights.size());
+	glUniform1i(cull_imageWidth_loc, width);
+	glUniform1i(cull_imageHeight_loc, height);
+	glUniform1i(cull_tilesX_loc, tilesX);
+
+	glDispatchCompute(tilesX, tilesY, 1);
+
+	// the renderer reads the lists
+	gpuWrote({ RES_TILE_LIGHTS });
+}
+
+// Make the visibility buffer the same size as the window. This only does
+// something the first time, and when the window changes size
+void makeVisibilityBuffer()
+{
+	if (visibilityWidth == width && visibilityHeight == height)
+		return;
+
+	if (visibilityWidth > 0)
+	{
+		glDeleteFramebuffers(1, &visibilityFBO);
+		forgetGpuImage(GL_TEXTURE, visibilityTexture);
+		forgetGpuImage(GL_RENDERBUFFER, visibilityDepth);
+		glDeleteTextures(1, &visibilityTexture);
+		glDeleteRenderbuffers(1, &visibilityDepth);
+	}
+
+	visibilityWidth = width;
+	visibilityHeight = height;
+
+	// one 32 bit int per pixel, the index of the triangle
+	glGenTextures(1, &visibilityTexture);
+	glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, width, height, 0, GL_RED_INTEGER, GL_INT, nullptr);
+	trackGpuImage(GL_TEXTURE, visibilityTexture, (size_t)4 * width * height, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &visibilityDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, visibilityDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	// 24 bit depth is kept in 32 bits by every GPU we know of
+	trackGpuImage(GL_RENDERBUFFER, visibilityDepth, (size_t)4 * width * height, GPU_MEMORY_IMAGES);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &visibilityFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, visibilityFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibilityTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, visibilityDepth);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Make the small image of --reflection-scale, for the size of the window. This only does
+// something the first time, and when the window changes size
+void makeReflectionBuffer()
+{
+	int w = (width + reflectionScale - 1) / reflectionScale;
+	int h = (height + reflectionScale - 1) / reflectionScale;
+
+	if (reflectionWidth == w && reflectionHeight == h)
+		return;
+
+	if (reflectionWidth > 0)
+	{
+		glDeleteFramebuffers(1, &reflectionFBO);
+		forgetGpuImage(GL_TEXTURE, reflectionTexture);
+		forgetGpuImage(GL_TEXTURE, reflectionNormalTexture);
+		glDeleteTextures(1, &reflectionTexture);
+		glDeleteTextures(1, &reflectionNormalTexture);
+	}
+
+	reflectionWidth = w;
+	reflectionHeight = h;
+
+	// four half floats per pixel in both, the reflection and the distance, and the normal
+	GLuint* textures[2] = { &reflectionTexture, &reflectionNormalTexture };
+
+	for (GLuint* texture : textures)
+	{
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_2D, *texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+		trackGpuImage(GL_TEXTURE, *texture, (size_t)8 * w * h, GPU_MEMORY_IMAGES);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &reflectionFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, reflectionFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reflectionTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, reflectionNormalTexture, 0);
+
+	GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Make the hit buffer of --hit-buffer the same size as the window. This only does
+// something the first time, and when the window changes size
+void makeHitBuffer()
+{
+	if (hitWidth == width && hitHeight == height)
+		return;
+
+	if (hitWidth > 0)
+	{
+		glDeleteFramebuffers(1, &hitFBO);
+		forgetGpuImage(GL_TEXTURE, hitTexture);
+		glDeleteTextures(1, &hitTexture);
+	}
+
+	hitWidth = width;
+	hitHeight = height;
+
+	// four 32 bit uints per pixel, see packedHit in FragmentShader.glsl
+	glGenTextures(1, &hitTexture);
+	glBindTexture(GL_TEXTURE_2D, hitTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+	trackGpuImage(GL_TEXTURE, hitTexture, (size_t)16 * width * height, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// The hit is output 2 of the fragment shader, and the color and the normal of the reflections are not written
+	glGenFramebuffers(1, &hitFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, hitFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hitTexture, 0);
+
+	GLenum drawBuffers[3] = { GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(3, drawBuffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Put some #define lines into a shader, before it is compiled.
+// They go on the line after #version, because nothing can come before #version.
+// The line numbers in compile errors are that many more than in the file after that line
+std::string addShaderDefines(std::string sourceCode, std::string defines)
+{
+	size_t version = sourceCode.find("#version");
+
+	if (version == std::string::npos)
+		return sourceCode;
+
+	size_t lineEnd = sourceCode.find('\n', version);
+
+	if (lineEnd == std::string::npos)
+		return sourceCode;
+
+	return sourceCode.insert(lineEnd + 1, defines);
+}
+
+// Pick the ray-triangle test of TriangleKernels.glsl that a shader is compiled with, and the size of its traversal stack
+std::string specializeShader(std::string sourceCode, int kernel)
+{
+	return addShaderDefines(sourceCode, "#define TRIANGLE_KERNEL " + std::to_string(kernel) + "\n"
+		"#define BVH_STACK_SIZE " + std::to_string(bvhStackSize) + "\n");
+}
+
+// The #defines that compile a shader that includes RayTracing.glsl for the scene that was loaded
+// (see specializeScene). The lights of the scene are the two moving ones, --lights, and --scene-lights
+std::string sceneShaderDefines()
+{
+	if (!specializeScene)
+		return "";
+
+	int lights = 2 + numExtraLights + (int)generatedLights.size();
+
+	return "#define SCENE_SPECIALIZED\n"
+		"#define SCENE_TRIANGLES " + std::to_string(bvhNumTriangles) + "\n"
+		"#define SCENE_MESHES " + std::to_string(numSceneMeshes) + "\n"
+		"#define SCENE_LIGHTS " + std::to_string(lights) + "\n"
+		"#define SCENE_MAX_BOUNCES " + std::to_string(maxBounces) + "\n"
+		"#define SCENE_RUSSIAN_ROULETTE " + (russianRoulette ? "true" : "false") + "\n";
+}
+
+// The #defines of --shadow-cache, for the renderers that have it (the draw program and the compute renderer)
+std::string shadowCacheDefines()
+{
+	if (!useShadowCache)
+		return "";
+
+	return "#define SHADOW_CACHE\n"
+		"#define SHADOW_CACHE_CELL " + std::to_string(shadowCacheCell) + "\n";
+}
+
+// The #define of --shadow-batch, for the same renderers as the shadow cache
+std::string shadowBatchDefines()
+{
+	return shadowBatch > 0 ? "#define SHADOW_BATCH " + std::to_string(shadowBatch) + "\n" : "";
+}
+
+// The #defines of --light-occluders, for the same renderers, and for LightOccluders.glsl itself
+std::string lightOccluderDefines()
+{
+	if (lightOccluders <= 0)
+		return "";
+
+	return "#define LIGHT_OCCLUDERS\n"
+		"#define OCCLUDER_LIST_SIZE " + std::to_string(lightOccluders) + "\n";
+}
+
+// The #defines of --irradiance-probes, for every renderer that shades with RayTracing.glsl, and for IrradianceProbes.glsl itself
+std::string irradianceProbeDefines()
+{
+	return irradianceProbes > 0 ? "#define IRRADIANCE_PROBES\n" : "";
+}
+
+// The #defines of the lights in a uniform block (see pickLightPlacement), for every renderer that shades with RayTracing.glsl
+std::string lightPlacementDefines()
+{
+	if (!lightUniforms)
+		return "";
+
+	return "#define LIGHT_UNIFORMS " + std::to_string(lightUniformCount) + "\n";
+}
+
+// The #define of the node counters of --bvh-hot-layout, only while they count, for the draw program
+std::string nodeVisitDefines()
+{
+	return countingNodeVisits ? "#define COUNT_NODE_VISITS\n" : "";
+}
+
+// The #define of --analytic, for every renderer that walks the two-level BVH with RayTracing.glsl
+std::string analyticDefines()
+{
+	return analyticPrimitives ? "#define ANALYTIC_PRIMITIVES\n" : "";
+}
+
+// The #define of --instance-grid, for every renderer that walks the two-level BVH with RayTracing.glsl
+std::string instanceGridDefines()
+{
+	return useInstanceGrid ? "#define INSTANCE_GRID\n" : "";
+}
+
+// The #define of --material-table, for every renderer that shades with RayTracing.glsl
+std::string materialTableDefines()
+{
+	return materialTable ? "#define MATERIAL_TABLE\n" : "";
+}
+
+// The #defines of --half-shading, for every renderer that shades with RayTracing.glsl. A GPU without 16-bit floats
+// in GLSL shades in 32 bits, like without it
+std::string halfShadingDefines()
+{
+	if (!halfShading)
+		return "";
+
+	if (GLEW_AMD_gpu_shader_half_float)
+		return "#extension GL_AMD_gpu_shader_half_float : require\n#define HALF_SHADING\n";
+
+	if (GLEW_NV_gpu_shader5)
+		return "#extension GL_NV_gpu_shader5 : require\n#define HALF_SHADING\n";
+
+	std::cout << "--half-shading needs GL_AMD_gpu_shader_half_float or GL_NV_gpu_shader5, the shading stays in 32 bits" << std::endl;
+	halfShading = false;
+	return "";
+}
+
+// Load the image of --floor-texture, the first time, with all of its mips. If it cannot be read, the floor keeps its color
+void loadFloorTexture()
+{
+	if (floorTexture || floorTextureFile.empty())
+		return;
+
+	FREE_IMAGE_FORMAT format = FreeImage_GetFileType(floorTextureFile.c_str(), 0);
+	FIBITMAP* image = format == FIF_UNKNOWN ? nullptr : FreeImage_Load(format, floorTextureFile.c_str(), 0);
+
+	if (!image)
+	{
+		std::cout << "Can't read the floor texture " << floorTextureFile << std::endl;
+		floorTextureFile.clear();
+		return;
+	}
+
+	FIBITMAP* mip = FreeImage_ConvertTo32Bits(image);
+	FreeImage_Unload(image);
+
+	// BC1 has no alpha, which the floor does not need
+	GLenum internalFormat = GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+	size_t bytes = 0;
+
+	glGenTextures(1, &floorTexture);
+	glBindTexture(GL_TEXTURE_2D, floorTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// every mip is half of the one before, down to 1 x 1, with a box filter
+	for (int level = 0; mip != nullptr; level++)
+	{
+		int mipWidth = FreeImage_GetWidth(mip);
+		int mipHeight = FreeImage_GetHeight(mip);
+
+		glTexImage2D(GL_TEXTURE_2D, level, internalFormat, mipWidth, mipHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, FreeImage_GetBits(mip));
+		bytes += internalFormat == GL_RGBA8 ? (size_t)4 * mipWidth * mipHeight : (size_t)8 * ((mipWidth + 3) / 4) * ((mipHeight + 3) / 4);
+
+		FIBITMAP* next = (mipWidth > 1 || mipHeight > 1) ?
+			FreeImage_Rescale(mip, std::max(mipWidth / 2, 1), std::max(mipHeight / 2, 1), FILTER_BOX) : nullptr;
+		FreeImage_Unload(mip);
+		mip = next;
+	}
+
+	trackGpuImage(GL_TEXTURE, floorTexture, bytes, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// a handle cannot change the texture any more, so it is made after the parameters
+	if (GLEW_ARB_bindless_texture)
+	{
+		floorTextureHandle = glGetTextureHandleARB(floorTexture);
+		glMakeTextureHandleResidentARB(floorTextureHandle);
+	}
+}
+
+// The #defines of --floor-texture, for the draw program, which loads the texture the first time
+std::string floorTextureDefines()
+{
+	loadFloorTexture();
+
+	if (!floorTexture)
+		return "";
+
+	if (floorTextureHandle)
+		return "#extension GL_ARB_bindless_texture : require\n#define BINDLESS_TEXTURES\n#define FLOOR_TEXTURE\n";
+
+	return "#define FLOOR_TEXTURE\n";
+}
+
+// The #defines of --reflection-probes, for the draw program
+std::string reflectionProbeDefines()
+{
+	return reflectionProbes > 0 ? "#define REFLECTION_PROBES\n" : "";
+}
+
+// FragmentShader.glsl with every #define that the options put in. init and --hot-reload both use this
+std::string specializeDrawShader(std::string fragShader)
+{
+	// every shader that tests rays against triangles
+	fragShader = specializeShader(fragShader, triangleKernel);
+
+	// the ray tracers are compiled for the scene that loadScene made
+	fragShader = addShaderDefines(fragShader, sceneShaderDefines());
+
+	// every shader that reads the triangles of the meshes for the two-level BVH
+	// (the wavefront and compute renderers add it themselves, see makeWavefrontPrograms)
+	if (compactMeshes)
+		fragShader = addShaderDefines(fragShader, "#define COMPACT_MESHES\n");
+
+	fragShader = addShaderDefines(fragShader, shadowCacheDefines());
+	fragShader = addShaderDefines(fragShader, shadowBatchDefines());
+	fragShader = addShaderDefines(fragShader, lightOccluderDefines());
+	fragShader = addShaderDefines(fragShader, floorTextureDefines());
+	fragShader = addShaderDefines(fragShader, reflectionProbeDefines());
+	fragShader = addShaderDefines(fragShader, irradianceProbeDefines());
+	fragShader = addShaderDefines(fragShader, halfShadingDefines());
+	fragShader = addShaderDefines(fragShader, materialTableDefines());
+	fragShader = addShaderDefines(fragShader, analyticDefines());
+	fragShader = addShaderDefines(fragShader, instanceGridDefines());
+	fragShader = addShaderDefines(fragShader, lightPlacementDefines());
+	fragShader = addShaderDefines(fragShader, nodeVisitDefines());
+
+	return fragShader;
+}
+
+// Compute.glsl with every #define that the options put in
+std::string specializeTransformShader(std::string compShader)
+{
+	// the records for the ray-triangle tests
+	compShader = specializeShader(compShader, triangleKernel);
+
+	// the transform pass does transformGroupSize triangles per workgroup
+	return addShaderDefines(compShader, "#define TRANSFORM_GROUP_SIZE " + std::to_string(transformGroupSize) + "\n");
+}
+
+// The bounces of a quality preset
+int presetMaxBounces(int preset)
+{
+	return qualityPresets[preset].maxBounces < 0 ? finalMaxBounces : qualityPresets[preset].maxBounces;
+}
+
+// Seconds since the program started, for --startup-times
+double startupSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - programStart).count();
+}
+
+// Print how long a step of the startup took, if --startup-times is on
+void reportStartupTime(const std::string& step, double start)
+{
+	if (printStartupTimes)
+		std::cout << "startup: " << step << ": " << (startupSeconds() - start) * 1000.0 << " ms" << std::endl;
+}
+
+// This method reads the text from a file.
+// Realistically, we wouldn't want plain text shaders hardcoded in, we'd rather read them in from a separate file so that the shader code is separated.
+std::string readShaderFile(std::string fileName)
+{
+	std::string shaderCode;
+	std::string line;
+
+	// so that --hot-reload knows which files to watch
+	shaderFilesRead.insert(fileName);
+
+	// We choose ifstream and std::ios::in because we are opening the file for input into our program.
+	// If we were writing to the file, we would use ofstream and std::ios::out.
+	std::ifstream file(fileName, std::ios::binary);
+
+	// This checks to make sure that we didn't encounter any errors when getting the file.
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName.data() << std::endl;
+
+		// Return so we don't error out.
+		return "";
+	}
+
+	// Get size of file
+	file.seekg(0, std::ios::end);					
+	shaderCode.resize((unsigned int)file.tellg());	
+	file.seekg(0, std::ios::beg);					
+
+	// Dump the file into our array
+	file.read(&shaderCode[0], shaderCode.size());
+
+	// close the file
+	file.close();
+
+	// GLSL does not have #include, so we do it ourselves. Every line that starts with
+	// #include "name" is replaced by the file with that name, in the same folder as this file.
+	// That lets FragmentShader.glsl and Wavefront.glsl share RayTracing.glsl
+	std::string folder = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+	size_t include = shaderCode.find("#include \"");
+
+	while (include != std::string::npos)
+	{
+		size_t nameStart = include + 10;
+		size_t nameEnd = shaderCode.find('"', nameStart);
+
+		// only at the start of a line, so that comments can talk about #include
+		if ((include > 0 && shaderCode[include - 1] != '\n') || nameEnd == std::string::npos)
+		{
+			include = shaderCode.find("#include \"", nameStart);
+			continue;
+		}
+
+		std::string included = readShaderFile(folder + shaderCode.substr(nameStart, nameEnd - nameStart));
+
+		shaderCode.replace(include, nameEnd + 1 - include, included);
+		include = shaderCode.find("#include \"", include + included.size());
+	}
+
+	return shaderCode;
+}
+
+// Read a shader and the files that it includes, timed as one step
+std::string readShader(std::string fileName)
+{
+	double start = startupSeconds();
+	std::string shaderCode = readShaderFile(fileName);
+	reportStartupTime("read " + fileName.substr(fileName.find_last_of("/\\") + 1), start);
+	return shaderCode;
+}
+
+// Start compiling a shader, without waiting for it. A driver with GL_KHR_parallel_shader_compile
+// compiles it on its own threads, and asking for GL_COMPILE_STATUS is what waits for it
+GLuint startShader(const std::string& sourceCode, GLenum shaderType)
+{
+	// glCreateShader, creates a shader given a type (such as GL_VERTEX_SHADER) and returns a GLuint reference to that shader.
+	GLuint shader = glCreateShader(shaderType);
+	const char *shader_code_ptr = sourceCode.c_str(); // We establish a pointer to our shader code string
+	const int shader_code_size = sourceCode.size();   // And we get the size of that string.
+
+	// glShaderSource replaces the source code in a shader object
+	// It takes the reference to the shader (a GLuint), a count of the number of elements in the string array (in case you're passing in multiple strings), a pointer to the string array
+	// that contains your source code, and a size variable determining the length of the array.
+	glShaderSource(shader, 1, &shader_code_ptr, &shader_code_size);
+	glCompileShader(shader); // This just compiles the shader, given the source code.
+
+	return shader;
+}
+
+// True if the shader compiled. If it did not, the error is printed
+bool shaderCompiled(GLuint shader)
+{
+	GLint isCompiled = 0;
+
+	// Check the compile status to see if the shader compiled correctly.
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+
+	if (isCompiled == GL_FALSE)
+	{
+		char infolog[1024];
+		glGetShaderInfoLog(shader, 1024, NULL, infolog);
+
+		// Print the compile error.
+		std::cout << "The shader failed to compile with the error:" << std::endl << infolog << std::endl;
+
+		// NOTE: I almost always put a break point here, so that instead of the program continuing with a deleted/failed shader, it stops and gives me a chance to look at what may
+		// have gone wrong. You can check the console output to see what the error was, and usually that will point you in the right direction.
+		return false;
+	}
+
+	return true;
+}
+
+// This method will consolidate some of the shader code we've written to return a GLuint to the compiled shader.
+// It only requires the shader source code and the shader type. If it has a name, --startup-times prints how long it took
+GLuint createShader(std::string sourceCode, GLenum shaderType, std::string name = "")
+{
+	double start = startupSeconds();
+
+	GLuint shader = startShader(sourceCode, shaderType);
+
+	if (!shaderCompiled(shader))
+	{
+		// Provide the infolog in whatever manor you deem best.
+		// Exit with failure.
+		glDeleteShader(shader); // Don't leak the shader.
+	}
+
+	if (!name.empty())
+		reportStartupTime("compile " + name, start);
+
+	return shader;
+}
+
+// FNV-1a, 64 bits, like hashBVHInput in BVH.cpp
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+uint64_t hashString(uint64_t hash, const char* text)
+{
+	return hashBytes(hash, text, strlen(text) + 1);
+}
+
+// The hash of everything that changes the binary of a program: the code of its shaders,
+// and which GPU and driver compiled them
+uint64_t hashProgram(const std::vector<ShaderStage>& stages)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	int version = SHADER_CACHE_VERSION;
+	hash = hashBytes(hash, &version, sizeof(version));
+	hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+	hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+
+	for (const ShaderStage& stage : stages)
+	{
+		hash = hashBytes(hash, &stage.type, sizeof(stage.type));
+		hash = hashString(hash, stage.source.c_str());
+	}
+
+	return hash;
+}
+
+// True if the driver can save programs, and can load at least one kind of binary
+bool canCachePrograms()
+{
+	if (!useShaderCache || !GLEW_ARB_get_program_binary)
+		return false;
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// The file in tuneCacheFolder with the profile of this GPU
+std::string tuneProfileName()
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	int version = TUNE_PROFILE_VERSION;
+	hash = hashBytes(hash, &version, sizeof(version));
+	hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+
+	char hashText[32];
+	snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)hash);
+	return std::string(tuneCacheFolder) + "/" + hashText + ".txt";
+}
+
+// The index of name in names, or -1
+int findChoiceName(const std::string& name, const char* const* names, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (name == names[i])
+			return i;
+	}
+
+	return -1;
+}
+
+// Read the profile of this GPU, and use every choice in it that is not on the command line. The stack size is only
+// kept in tunedStackSize here, because the scene it is for is not loaded yet. False if this GPU has no profile
+bool loadTuneProfile()
+{
+	std::ifstream file(tuneProfileName());
+
+	if (!file)
+		return false;
+
+	std::string key;
+	int version = 0;
+
+	if (!(file >> key >> version) || key != "version" || version != TUNE_PROFILE_VERSION)
+		return false;
+
+	while (file >> key)
+	{
+		std::string value;
+		file >> value;
+
+		// the choices of the command line win
+		if (choicesOnCommandLine.count(key))
+		{
+			std::getline(file, value);
+			continue;
+		}
+
+		if (key == "blas-format" && findChoiceName(value, bvhFormatNames, 2) >= 0)
+		{
+			blasNodeFormat = findChoiceName(value, bvhFormatNames, 2);
+		}
+		else if (key == "tri-format" && findChoiceName(value, triangleFormatNames, 2) >= 0)
+		{
+			triangleFormat = findChoiceName(value, triangleFormatNames, 2);
+		}
+		else if (key == "tri-kernel" && findChoiceName(value, triangleKernelNames, NUM_TRIANGLE_KERNELS) >= 0)
+		{
+			triangleKernel = findChoiceName(value, triangleKernelNames, NUM_TRIANGLE_KERNELS);
+		}
+		else if (key == "transform-group-size")
+		{
+			transformGroupSize = std::min(std::max(1, atoi(value.c_str())), 1024);
+		}
+		else if (key == "bvh-stack")
+		{
+			std::string accel;
+			file >> std::hex >> tunedStackScene >> std::dec >> accel;
+			tunedStackSize = atoi(value.c_str());
+			tunedStackAccel = findChoiceName(accel, accelNames, NUM_ACCELS);
+		}
+
+		// anything else on the line is for another version
+		std::getline(file, value);
+	}
+
+	return true;
+}
+
+// Write the choices that are used now as the profile of this GPU
+void saveTuneProfile()
+{
+	makeFolder(tuneCacheFolder);
+	std::ofstream file(tuneProfileName());
+
+	if (!file)
+	{
+		std::cout << "could not write " << tuneProfileName() << std::endl;
+		return;
+	}
+
+	// the renderer is only there for whoever opens the file
+	file << "# " << glGetString(GL_VENDOR) << " " << glGetString(GL_RENDERER) << "\n";
+	file << "version " << TUNE_PROFILE_VERSION << "\n";
+	file << "blas-format " << bvhFormatNames[blasNodeFormat] << "\n";
+	file << "tri-format " << triangleFormatNames[triangleFormat] << "\n";
+	file << "tri-kernel " << triangleKernelNames[triangleKernel] << "\n";
+	file << "transform-group-size " << transformGroupSize << "\n";
+
+	if (tunedStackSize > 0)
+	{
+		char hashText[32];
+		snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)tunedStackScene);
+		file << "bvh-stack " << tunedStackSize << " " << hashText << " " << accelNames[tunedStackAccel] << "\n";
+	}
+
+	std::cout << "saved the profile of this GPU in " << tuneProfileName() << std::endl;
+}
+
+// Copy a file of a cache (like shaderCache/name) from --shared-cache, if this node does not have it yet
+void fetchSharedCacheFile(const std::string& fileName)
+{
+	if (sharedCacheUrl.empty() || !sharedCacheWorks || std::ifstream(fileName, std::ios::binary))
+		return;
+
+	std::string data;
+	int status = getObject(sharedCacheUrl + "/" + fileName, data);
+
+	if (status == 0)
+	{
+		std::cout << "--shared-cache: " << sharedCacheUrl << " could not be read, this node makes its own files" << std::endl;
+		sharedCacheWorks = false;
+	}
+
+	if (status != 200)
+		return;
+
+	// if the file can't be written, the program or BLAS is made here like without the cache
+	std::ofstream file(fileName, std::ios::binary);
+	file.write(data.data(), data.size());
+
+	if (file)
+		sharedCacheFetched++;
+}
+
+// Put a file that this node just made into --shared-cache, for the other nodes
+void storeSharedCacheFile(const std::string& fileName)
+{
+	if (sharedCacheUrl.empty() || !sharedCacheWorks)
+		return;
+
+	std::ifstream file(fileName, std::ios::binary);
+
+	if (!file)
+		return;
+
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	if (putObject(sharedCacheUrl + "/" + fileName, data))
+		sharedCacheStored++;
+	else
+		sharedCacheWorks = false;
+}
+
+// Load the program from shaderCacheFolder. The file is: the hash, the binary format, the length of the binary,
+// then the binary. The hash is also inside of the file, in case the file was renamed. Returns false if there was
+// no file, or the driver did not take it, and then the program has to be linked from the shaders
+bool loadCachedProgram(GLuint program, const std::string& fileName, uint64_t hash)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+
+	if (!file)
+		return false;
+
+	uint64_t fileHash = 0;
+	GLenum format = 0;
+	GLint length = 0;
+
+	bool ok = fread(&fileHash, sizeof(fileHash), 1, file) == 1 &&
+		fread(&format, sizeof(format), 1, file) == 1 &&
+		fread(&length, sizeof(length), 1, file) == 1 &&
+		fileHash == hash && length > 0;
+
+	std::vector<char> binary;
+
+	if (ok)
+	{
+		binary.resize(length);
+		ok = fread(binary.data(), 1, length, file) == (size_t)length;
+	}
+
+	fclose(file);
+
+	if (!ok)
+		return false;
+
+	glProgramBinary(program, format, binary.data(), length);
+
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+// Save a linked program into shaderCacheFolder, for loadCachedProgram.
+// If the file can't be written, the program still works, it just won't be saved
+void saveCachedProgram(GLuint program, const std::string& fileName, uint64_t hash)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	FILE* file = fopen(fileName.c_str(), "wb");
+
+	if (!file)
+		return;
+
+	fwrite(&hash, sizeof(hash), 1, file);
+	fwrite(&format, sizeof(format), 1, file);
+	fwrite(&length, sizeof(length), 1, file);
+	fwrite(binary.data(), 1, length, file);
+	fclose(file);
+}
+
+// Make a program out of shaders. A shader is a program that runs on your GPU instead of your CPU.
+// In this sense, OpenGL refers to your groups of shaders as "programs".
+// If the program is in shaderCacheFolder, it is loaded from there, and the shaders are not compiled at all.
+// Otherwise every shader is compiled, they are linked together, and finishProgram saves the program there.
+// Nothing here waits for the driver, so init starts every program first, loads the scene while they
+// compile (on the threads of GL_KHR_parallel_shader_compile), and only then waits for them (see finishProgram)
+PendingProgram startProgram(const std::string& name, const std::vector<ShaderStage>& stages)
+{
+	PendingProgram pending;
+	pending.name = name;
+	pending.start = startupSeconds();
+
+	// Using glCreateProgram creates a shader program and returns a GLuint reference to it.
+	pending.program = glCreateProgram();
+	pending.caching = canCachePrograms();
+	pending.hash = 0;
+
+	if (pending.caching)
+	{
+		pending.hash = hashProgram(stages);
+
+		char hashText[32];
+		snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)pending.hash);
+
+		// the name can have spaces in it
+		std::string fileNamePart = name;
+		std::replace(fileNamePart.begin(), fileNamePart.end(), ' ', '_');
+		pending.fileName = std::string(shaderCacheFolder) + "/" + fileNamePart + "-" + hashText + ".bin";
+
+		// another node of the farm may have compiled it already
+		fetchSharedCacheFile(pending.fileName);
+
+		if (loadCachedProgram(pending.program, pending.fileName, pending.hash))
+		{
+			programCacheHits++;
+			reportStartupTime("load " + name + " from " + shaderCacheFolder, pending.start);
+			return pending;
+		}
+
+		programCacheMisses++;
+
+		// The binary tells the driver that the program will be saved, before it is linked
+		glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	for (const ShaderStage& stage : stages)
+	{
+		GLuint shader = startShader(stage.source, stage.type);
+		glAttachShader(pending.program, shader);	// This attaches our shader to our program.
+		pending.shaders.push_back(shader);
+	}
+
+	glLinkProgram(pending.program);
+	return pending;
+}
+
+// True once the driver is done with the program, so that finishProgram will not wait.
+// Without GL_KHR_parallel_shader_compile we can't ask, so it is always true
+bool programReady(const PendingProgram& pending)
+{
+	if (pending.shaders.empty() || !GLEW_KHR_parallel_shader_compile)
+		return true;
+
+	GLint done = GL_FALSE;
+	glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+// Wait for a program that startProgram started. The errors of its shaders and of the link are printed,
+// and the shaders are deleted, because the program keeps its own copy of what it needs.
+// --startup-times prints how long it took from startProgram, which is the slowest part of
+// the compile when the driver compiles the programs at the same time
+GLuint finishProgram(PendingProgram& pending)
+{
+	if (pending.shaders.empty())
+		return pending.program;
+
+	bool compiled = true;
+
+	for (GLuint shader : pending.shaders)
+		compiled = shaderCompiled(shader) && compiled;
+
+	GLint linked = 0;
+	glGetProgramiv(pending.program, GL_LINK_STATUS, &linked);
+
+	// the link of a program with a broken shader only says that the shader is broken
+	if (compiled && linked == GL_FALSE)
+	{
+		char infolog[1024];
+		glGetProgramInfoLog(pending.program, 1024, NULL, infolog);
+		std::cout << "The program failed to link with the error:" << std::endl << infolog << std::endl;
+	}
+
+	reportStartupTime("compile and link " + pending.name, pending.start);
+
+	for (GLuint shader : pending.shaders)
+	{
+		glDetachShader(pending.program, shader);
+		glDeleteShader(shader);
+	}
+
+	pending.shaders.clear();
+
+	if (pending.caching && linked == GL_TRUE)
+	{
+		saveCachedProgram(pending.program, pending.fileName, pending.hash);
+		storeSharedCacheFile(pending.fileName);
+	}
+
+	return pending.program;
+}
+
+// Make a program and wait for it, for the programs that are needed right away
+GLuint makeProgram(const std::string& name, const std::vector<ShaderStage>& stages)
+{
+	PendingProgram pending = startProgram(name, stages);
+	return finishProgram(pending);
+}
+
+// Start a program out of one shader that CompileSpirv.bat compiled to SPIR-V. The constants are the
+// specialization constants of the shader, in the order of their constant_id, which take the place of the
+// #defines that must match main.cpp. The program is not saved in shaderCacheFolder, because SPIR-V
+// is quick to load anyway. If there is no SPIR-V, or the driver did not take it, the GLSL is compiled instead
+PendingProgram startSpirvProgram(const std::string& name, GLenum type, const std::string& fileName, const std::vector<GLuint>& constants = {})
+{
+	if (useSpirv && GLEW_ARB_gl_spirv)
+	{
+		double start = startupSeconds();
+		std::ifstream file(std::string(spirvFolder) + "/" + fileName + ".spv", std::ios::binary);
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		if (!binary.empty())
+		{
+			GLuint shader = glCreateShader(type);
+			glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, binary.data(), (GLsizei)binary.size());
+
+			// constant i is constant_id i
+			std::vector<GLuint> ids;
+			for (GLuint i = 0; i < (GLuint)constants.size(); i++)
+				ids.push_back(i);
+
+			// This is when the driver compiles the SPIR-V, and it is done when this returns
+			glSpecializeShaderARB(shader, "main", (GLuint)constants.size(), ids.data(), constants.data());
+
+			if (shaderCompiled(shader))
+			{
+				PendingProgram pending;
+				pending.name = name;
+				pending.start = start;
+				pending.program = glCreateProgram();
+				pending.caching = false;
+				pending.hash = 0;
+
+				glAttachShader(pending.program, shader);
+				glLinkProgram(pending.program);
+				pending.shaders.push_back(shader);
+				return pending;
+			}
+
+			std::cout << "the SPIR-V of " << fileName << " did not work, the GLSL is compiled instead" << std::endl;
+			glDeleteShader(shader);
+		}
+	}
+
+	return startProgram(name, { { type, readShader("../Assets/" + fileName), fileName } });
+}
+
+// Start the draw program of every quality preset. They only differ in the bounces
+// that sceneShaderDefines puts in, so maxBounces is changed while each one is made
+std::vector<PendingProgram> startQualityPrograms(const std::string& vertShader, const std::string& fragSource)
+{
+	std::vector<PendingProgram> pending;
+	int bounces = maxBounces;
+
+	for (int p = 0; p < QUALITY_PRESETS; p++)
+	{
+		maxBounces = presetMaxBounces(p);
+		pending.push_back(startProgram(std::string("draw ") + qualityPresets[p].name, {
+			{ GL_VERTEX_SHADER, vertShader, "VertexShader.glsl" },
+			{ GL_FRAGMENT_SHADER, specializeDrawShader(fragSource), "FragmentShader.glsl" } }));
+	}
+
+	maxBounces = bounces;
+	return pending;
+}
+
+// True if a program linked, without printing anything
+bool programLinked(GLuint program)
+{
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+// The programs of the renderers that are not always used are made the first time they are used,
+// so a run that does not use them does not wait for them to compile. These read their shaders
+// and get the uniform locations, like init does for the other programs
+
+// Wavefront.glsl and the program that puts its colors on the screen (--wavefront)
+void makeWavefrontPrograms()
+{
+	if (wavefront_program)
+		return;
+
+	std::string wavefrontShader = specializeShader(readShader("../Assets/Wavefront.glsl"), triangleKernel);
+	wavefrontShader = addShaderDefines(wavefrontShader, sceneShaderDefines());
+	std::string resolveShader = readShader("../Assets/WavefrontResolve.glsl");
+
+	// every shader that reads the triangles of the meshes for the two-level BVH
+	if (compactMeshes)
+		wavefrontShader = addShaderDefines(wavefrontShader, "#define COMPACT_MESHES\n");
+
+	wavefrontShader = addShaderDefines(wavefrontShader, halfShadingDefines());
+	wavefrontShader = addShaderDefines(wavefrontShader, materialTableDefines());
+	wavefrontShader = addShaderDefines(wavefrontShader, analyticDefines());
+	wavefrontShader = addShaderDefines(wavefrontShader, instanceGridDefines());
+	wavefrontShader = addShaderDefines(wavefrontShader, lightPlacementDefines());
+	wavefrontShader = addShaderDefines(wavefrontShader, irradianceProbeDefines());
+
+	// the two compile at the same time, if the driver can
+	PendingProgram wavefront = startProgram("wavefront", { { GL_COMPUTE_SHADER, wavefrontShader, "Wavefront.glsl" } });
+
+	// The resolve program draws the same quad as the draw program, so it uses the same vertex shader
+	PendingProgram resolve = startProgram("resolve", {
+		{ GL_VERTEX_SHADER, readShader("../Assets/VertexShader.glsl"), "VertexShader.glsl" },
+		{ GL_FRAGMENT_SHADER, resolveShader, "WavefrontResolve.glsl" } });
+
+	wavefront_program = finishProgram(wavefront);
+	resolve_program = finishProgram(resolve);
+
+	wave_stage_loc = glGetUniformLocation(wavefront_program, "stage");
+	wave_bounce_loc = glGetUniformLocation(wavefront_program, "bounce");
+	wave_rayInOffset_loc = glGetUniformLocation(wavefront_program, "rayInOffset");
+	wave_rayOutOffset_loc = glGetUniformLocation(wavefront_program, "rayOutOffset");
+	wave_imageWidth_loc = glGetUniformLocation(wavefront_program, "imageWidth");
+	wave_imageHeight_loc = glGetUniformLocation(wavefront_program, "imageHeight");
+	wave_accel_loc = glGetUniformLocation(wavefront_program, "accel");
+	wave_wideBLAS_loc = glGetUniformLocation(wavefront_program, "wideBLAS");
+	wave_sortRays_loc = glGetUniformLocation(wavefront_program, "sortRays");
+	wave_subgroupTraversal_loc = glGetUniformLocation(wavefront_program, "subgroupTraversal");
+	wave_compactQueues_loc = glGetUniformLocation(wavefront_program, "compactQueues");
+	wave_numLights_loc = glGetUniformLocation(wavefront_program, "numLights");
+	wave_sortBoundsMin_loc = glGetUniformLocation(wavefront_program, "sortBoundsMin");
+	wave_sortBoundsMax_loc = glGetUniformLocation(wavefront_program, "sortBoundsMax");
+
+	resolve_imageWidth_loc = glGetUniformLocation(resolve_program, "imageWidth");
+}
+
+// TiledRender.glsl (--tiled-render)
+void makeTiledRenderProgram()
+{
+	if (tiled_render_program)
+		return;
+
+	std::string tiledRenderShader = specializeShader(readShader("../Assets/TiledRender.glsl"), triangleKernel);
+	tiledRenderShader = addShaderDefines(tiledRenderShader, sceneShaderDefines());
+
+	if (compactMeshes)
+		tiledRenderShader = addShaderDefines(tiledRenderShader, "#define COMPACT_MESHES\n");
+
+	tiledRenderShader = addShaderDefines(tiledRenderShader, shadowCacheDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, shadowBatchDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, lightOccluderDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, halfShadingDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, materialTableDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, analyticDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, instanceGridDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, lightPlacementDefines());
+	tiledRenderShader = addShaderDefines(tiledRenderShader, irradianceProbeDefines());
+
+	tiled_render_program = makeProgram("tiled render", { { GL_COMPUTE_SHADER, tiledRenderShader, "TiledRender.glsl" } });
+
+	tiled_accel_loc = glGetUniformLocation(tiled_render_program, "accel");
+	tiled_wideBLAS_loc = glGetUniformLocation(tiled_render_program, "wideBLAS");
+	tiled_numLights_loc = glGetUniformLocation(tiled_render_program, "numLights");
+	tiled_tiledLights_loc = glGetUniformLocation(tiled_render_program, "tiledLights");
+	tiled_countRays_loc = glGetUniformLocation(tiled_render_program, "countRays");
+	tiled_tilesX_loc = glGetUniformLocation(tiled_render_program, "tilesX");
+	tiled_variableRate_loc = glGetUniformLocation(tiled_render_program, "variableRate");
+	tiled_fillPass_loc = glGetUniformLocation(tiled_render_program, "fillPass");
+	tiled_foveaCenter_loc = glGetUniformLocation(tiled_render_program, "foveaCenter");
+	tiled_foveaRadius_loc = glGetUniformLocation(tiled_render_program, "foveaRadius");
+	tiled_importanceMapped_loc = glGetUniformLocation(tiled_render_program, "importanceMapped");
+	tiled_persistent_loc = glGetUniformLocation(tiled_render_program, "persistent");
+	tiled_costOrder_loc = glGetUniformLocation(tiled_render_program, "costOrder");
+	tiled_binned_loc = glGetUniformLocation(tiled_render_program, "binned");
+	tiled_tileFrustum_loc = glGetUniformLocation(tiled_render_program, "tileFrustum");
+	tiled_pixelOrder_loc = glGetUniformLocation(tiled_render_program, "pixelOrder");
+
+	if (binTriangles)
+	{
+		triangle_bin_program = makeProgram("triangle bin", { { GL_COMPUTE_SHADER, readShader("../Assets/TriangleBin.glsl"), "TriangleBin.glsl" } });
+
+		bin_pass_loc = glGetUniformLocation(triangle_bin_program, "pass");
+		bin_numTriangles_loc = glGetUniformLocation(triangle_bin_program, "numTriangles");
+		bin_viewProj_loc = glGetUniformLocation(triangle_bin_program, "viewProj");
+		bin_imageWidth_loc = glGetUniformLocation(triangle_bin_program, "imageWidth");
+		bin_imageHeight_loc = glGetUniformLocation(triangle_bin_program, "imageHeight");
+		bin_tilesX_loc = glGetUniformLocation(triangle_bin_program, "tilesX");
+		bin_tilesY_loc = glGetUniformLocation(triangle_bin_program, "tilesY");
+		bin_capacity_loc = glGetUniformLocation(triangle_bin_program, "capacity");
+	}
+}
+
+// The program that rasterizes the triangles into the visibility buffer (--visibility-buffer)
+void makeVisibilityProgram()
+{
+	if (visibility_program)
+		return;
+
+	visibility_program = makeProgram("visibility", {
+		{ GL_VERTEX_SHADER, readShader("../Assets/VisibilityVertex.glsl"), "VisibilityVertex.glsl" },
+		{ GL_FRAGMENT_SHADER, readShader("../Assets/VisibilityFragment.glsl"), "VisibilityFragment.glsl" } });
+
+	vis_viewProj_loc = glGetUniformLocation(visibility_program, "viewProj");
+	vis_eye_loc = glGetUniformLocation(visibility_program, "eye");
+}
+
+// The program that fills in the holes of --checkerboard. It draws the same quad as the draw program,
+// so it uses the same vertex shader
+void makeCheckerboardProgram()
+{
+	if (checkerboard_program)
+		return;
+
+	checkerboard_program = makeProgram("checkerboard", {
+		{ GL_VERTEX_SHADER, readShader("../Assets/VertexShader.glsl"), "VertexShader.glsl" },
+		{ GL_FRAGMENT_SHADER, readShader("../Assets/CheckerboardResolve.glsl"), "CheckerboardResolve.glsl" } });
+}
+
+// The program of --denoise, which also draws the same quad as the draw program
+void makeDenoiseProgram()
+{
+	if (denoise_program)
+		return;
+
+	denoise_program = makeProgram("denoise", {
+		{ GL_VERTEX_SHADER, readShader("../Assets/VertexShader.glsl"), "VertexShader.glsl" },
+		{ GL_FRAGMENT_SHADER, readShader("../Assets/Denoise.glsl"), "Denoise.glsl" } });
+
+	denoise_stepSize_loc = glGetUniformLocation(denoise_program, "stepSize");
+	denoise_firstPass_loc = glGetUniformLocation(denoise_program, "firstPass");
+	denoise_lastPass_loc = glGetUniformLocation(denoise_program, "lastPass");
+}
+
+// The program of --camera, which writes the ray of every pixel (see updateCameraRays)
+void makeCameraRayProgram()
+{
+	if (camera_rays_program)
+		return;
+
+	camera_rays_program = makeProgram("camera rays", { { GL_COMPUTE_SHADER, readShader("../Assets/CameraRays.glsl"), "CameraRays.glsl" } });
+
+	cameraRays_imageWidth_loc = glGetUniformLocation(camera_rays_program, "imageWidth");
+	cameraRays_imageHeight_loc = glGetUniformLocation(camera_rays_program, "imageHeight");
+	cameraRays_cameraModel_loc = glGetUniformLocation(camera_rays_program, "cameraModel");
+	cameraRays_fov_loc = glGetUniformLocation(camera_rays_program, "fov");
+	cameraRays_forward_loc = glGetUniformLocation(camera_rays_program, "forward");
+	cameraRays_right_loc = glGetUniformLocation(camera_rays_program, "right");
+	cameraRays_up_loc = glGetUniformLocation(camera_rays_program, "up");
+	cameraRays_jitter_loc = glGetUniformLocation(camera_rays_program, "jitter");
+}
+
+// Rasterize the triangles in compToFrag into the visibility buffer.
+// calcCameraRays must already have made cameraViewProj for this frame
+void drawVisibilityBuffer()
+{
+	makeVisibilityBuffer();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, visibilityFBO);
+
+	// -1 means that no triangle is in the pixel
+	GLint noTriangle[4] = { -1, 0, 0, 0 };
+	glClearBufferiv(GL_COLOR, 0, noTriangle);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	makeVisibilityProgram();
+	glUseProgram(visibility_program);
+	gpuRead("visibility buffer", { { RES_TRIANGLES, GL_SHADER_STORAGE_BARRIER_BIT } });
+	glUniformMatrix4fv(vis_viewProj_loc, 1, GL_FALSE, &cameraViewProj[0][0]);
+	glUniform3f(vis_eye_loc, cameraPos.x, cameraPos.y, cameraPos.z);
+
+	// 3 vertices per triangle, the vertex shader reads them from compToFrag
+	glDrawArrays(GL_TRIANGLES, 0, 3 * bvhNumTriangles);
+
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+
+	// the fragment shader reads the triangles from texture unit 0
+	glUseProgram(draw_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+}
+
+// Find the point that every pixel sees, and write it into the hit buffer, with the draw program, which must be in
+// use and have its uniforms and the camera for this frame. After this, the draw program reads the points from there
+void drawHitBuffer()
+{
+	makeHitBuffer();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, hitFBO);
+
+	glUniform1i(hitPass_loc, 1);
+	glUniform1i(hitBuffer_loc, 0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+
+	// the fragment shader reads the hits from texture unit 3
+	glUniform1i(hitPass_loc, 0);
+	glUniform1i(hitBuffer_loc, 1);
+	glUniform1i(adaptiveSamples_loc, adaptiveSamples);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, hitTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Trace the reflections into the small image of --reflection-scale, with the draw program, which must be in use
+// and have its uniforms and the camera for this frame. After this, the draw program makes its reflections from that image
+void drawReducedReflections()
+{
+	makeReflectionBuffer();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, reflectionFBO);
+	glViewport(0, 0, reflectionWidth, reflectionHeight);
+
+	glUniform1i(reflectionPass_loc, 1);
+	glUniform1i(reducedReflections_loc, 0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+	glViewport(0, 0, width, height);
+
+	// the fragment shader reads the small image from texture units 1 and 2
+	glUniform1i(reflectionPass_loc, 0);
+	glUniform1i(reducedReflections_loc, 1);
+	glUniform1i(reflectionScale_loc, reflectionScale);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, reflectionTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, reflectionNormalTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Make the cube maps of --reflection-probes, with every mip, and the framebuffer that draws into one face at a time
+void makeReflectionProbes()
+{
+	if (probeTexture)
+		return;
+
+	int levels = 1;
+	while ((probeSize >> levels) > 0)
+		levels++;
+
+	// four half floats per texel, and a third more for the mips
+	glGenTextures(1, &probeTexture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, probeTexture);
+	glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, levels, GL_RGBA16F, probeSize, probeSize, 6 * reflectionProbes);
+	trackGpuImage(GL_TEXTURE, probeTexture, (size_t)8 * probeSize * probeSize * 6 * reflectionProbes * 4 / 3, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+	// the small mips are read across the edges of the faces
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	glGenFramebuffers(1, &probeFBO);
+}
+
+// The direction of a corner of face f of a cube map (+X, -X, +Y, -Y, +Z, -Z), where sc and tc are -1 or 1 and
+// the texel row 0 is tc = -1, the way GL reads a cube map
+glm::vec3 probeFaceDirection(int f, float sc, float tc)
+{
+	switch (f)
+	{
+	case 0: return glm::vec3(1.0f, -tc, -sc);
+	case 1: return glm::vec3(-1.0f, -tc, sc);
+	case 2: return glm::vec3(sc, 1.0f, tc);
+	case 3: return glm::vec3(sc, -1.0f, -tc);
+	case 4: return glm::vec3(sc, -tc, 1.0f);
+	default: return glm::vec3(-sc, -tc, -1.0f);
+	}
+}
+
+// Give the draw program, which must be in use, the probes of --reflection-probes, and draw them again if the scene has
+// changed and it has been probeRefreshFrames frames since the last time. Returns true if they were drawn, which
+// wrote the camera block, so the caller has to write the camera of the frame again
+bool updateReflectionProbes(const std::vector<glm::mat4x4>& matrices)
+{
+	makeReflectionProbes();
+
+	bool changed = probeFrame < 0 || matrices != probeMatrices || skinsMoved || probeLights.size() != sceneLights.size() ||
+		memcmp(probeLights.data(), sceneLights.data(), sizeof(light) * sceneLights.size()) != 0;
+	bool due = probeFrame < 0 || totalFrame < probeFrame || totalFrame - probeFrame >= probeRefreshFrames;
+	bool refresh = changed && due;
+
+	// the probes are on a grid across the middle of the box around the moved meshes
+	if (refresh)
+	{
+		probeBox = emptyAABB();
+
+		for (size_t m = 0; m < meshBounds.size() && m < matrices.size(); m++)
+			growAABB(probeBox, transformAABB(meshBounds[m], matrices[m]));
+
+		int columns = (int)ceil(sqrt((double)reflectionProbes));
+		int rows = (reflectionProbes + columns - 1) / columns;
+		glm::vec3 size = probeBox.max - probeBox.min;
+
+		for (int k = 0; k < reflectionProbes; k++)
+		{
+			float x = (k % columns + 0.5f) / columns;
+			float z = (k / columns + 0.5f) / rows;
+			probeCenters[k] = probeBox.min + size * glm::vec3(x, 0.5f, z);
+		}
+	}
+
+	glUniform1i(numProbes_loc, reflectionProbes);
+	glUniform3fv(probeCenters_loc, reflectionProbes, &probeCenters[0].x);
+	glUniform3fv(probeBoxMin_loc, 1, &probeBox.min.x);
+	glUniform3fv(probeBoxMax_loc, 1, &probeBox.max.x);
+	glUniform1i(probeBounce_loc, probeBounce);
+	glUniform1f(probeDistance_loc, probeDistance);
+	glUniform1f(probeSpread_loc, glm::radians(cameraFov) / (stillHeight > 0 ? stillHeight : height));
+
+	if (!refresh)
+		return false;
+
+	probeMatrices = matrices;
+	probeLights = sceneLights;
+	probeFrame = totalFrame;
+	probeRefreshes++;
+
+	// the faces are drawn with the probes unbound, because a texture that is read and drawn into is undefined
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, probeFBO);
+	glViewport(0, 0, probeSize, probeSize);
+	glUniform1i(probePass_loc, 1);
+
+	// one view, from the center of the probe through a face
+	glm::ivec4 viewGrid(1, 1, 1, 0);
+	glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(viewGrid), &viewGrid);
+
+	for (int k = 0; k < reflectionProbes; k++)
+	{
+		for (int f = 0; f < 6; f++)
+		{
+			cameraView view = {};
+			view.eye = probeCenters[k];
+			view.ray00 = probeFaceDirection(f, -1.0f, -1.0f);
+			view.ray01 = probeFaceDirection(f, -1.0f, 1.0f);
+			view.ray10 = probeFaceDirection(f, 1.0f, -1.0f);
+			view.ray11 = probeFaceDirection(f, 1.0f, 1.0f);
+			glBufferSubData(GL_UNIFORM_BUFFER, 16, sizeof(cameraView), &view);
+
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, probeTexture, 0, 6 * k + f);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glUniform1i(probePass_loc, 0);
+
+	// the mips are what the wide ray cones of the far reflections read
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, probeTexture);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP_ARRAY);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+	glViewport(0, 0, width, height);
+
+	// the fragment shader reads the probes from texture unit 10
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, probeTexture);
+	glActiveTexture(GL_TEXTURE0);
+	return true;
+}
+
+// Trace the shadow rays of the coarse grid of --shadow-scale, with the draw program, which must be in use and have
+// its uniforms and the camera for this frame. The pass only writes shadowSampleBuffer, so it draws into a corner of the
+// screen with the colors masked off, and the frame draws over it. After this, the pixels of the draw program read the grid
+void drawReducedShadows()
+{
+	int gridWidth = (width + shadowScale - 1) / shadowScale;
+	int gridHeight = (height + shadowScale - 1) / shadowScale;
+	int words = ((int)sceneLights.size() + 31) / 32;
+	size_t bytes = sizeof(GLuint) * gridWidth * gridHeight * (4 + 2 * words);
+
+	if (!shadowSampleBuffer)
+		glGenBuffers(1, &shadowSampleBuffer);
+
+	// only made bigger, when the window or the number of lights grows
+	if (bytes > shadowSampleBytes)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowSampleBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, shadowSampleBuffer, bytes, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_RENDER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		shadowSampleBytes = bytes;
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 31, shadowSampleBuffer);
+	glUniform2i(shadowGridSize_loc, gridWidth, gridHeight);
+	glUniform1i(shadowWords_loc, words);
+	glUniform1i(shadowScale_loc, shadowScale);
+
+	glViewport(0, 0, gridWidth, gridHeight);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glUniform1i(shadowPass_loc, 1);
+	glUniform1i(reducedShadows_loc, 0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glViewport(0, 0, width, height);
+	glUniform1i(shadowPass_loc, 0);
+	glUniform1i(reducedShadows_loc, 1);
+
+	gpuWrote({ RES_SHADOW_SAMPLES });
+	gpuRead("reduced shadows", { { RES_SHADOW_SAMPLES, GL_SHADER_STORAGE_BARRIER_BIT } });
+}
+
+// Make the float image of --accumulate, the same size as the window. This only does something the first time,
+// and when the window changes size, and then the average starts again, because its pixels are not the same anymore
+void makeAccumulationBuffer()
+{
+	if (accumWidth == width && accumHeight == height)
+		return;
+
+	if (accumWidth > 0)
+	{
+		glDeleteFramebuffers(1, &accumFBO);
+		forgetGpuImage(GL_RENDERBUFFER, accumColor);
+		glDeleteRenderbuffers(1, &accumColor);
+	}
+
+	accumWidth = width;
+	accumHeight = height;
+	accumulatedSamples = 0;
+
+	// 32 bit floats, so that the average of hundreds of samples does not lose the last ones
+	glGenRenderbuffers(1, &accumColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, accumColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA32F, width, height);
+	trackGpuImage(GL_RENDERBUFFER, accumColor, (size_t)16 * width * height, GPU_MEMORY_IMAGES);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &accumFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, accumColor);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// True if the camera, the matrices, and the lights of this frame are the same as when the average of --accumulate
+// was started, and remember them if they are not
+bool sameAccumulationScene(const std::vector<glm::mat4x4>& matrices)
+{
+	bool same = accumMatrices == matrices && accumCamera == cameraPos &&
+		accumLights.size() == sceneLights.size() &&
+		memcmp(accumLights.data(), sceneLights.data(), sizeof(light) * sceneLights.size()) == 0;
+
+	accumMatrices = matrices;
+	accumLights = sceneLights;
+	accumCamera = cameraPos;
+	return same;
+}
+
+// Where the camera rays are for sample i of the average. The first sample is the pixel center, like a frame without
+// --accumulate, and the rest are the Halton sequence in bases 2 and 3, which covers the pixel evenly with any number of them
+glm::vec2 accumulationJitter(int i)
+{
+	if (i == 0)
+		return glm::vec2(0.0f);
+
+	glm::vec2 jitter;
+	int bases[2] = { 2, 3 };
+
+	for (int k = 0; k < 2; k++)
+	{
+		float f = 1.0f;
+		float r = 0.0f;
+
+		for (int n = i; n > 0; n /= bases[k])
+		{
+			f /= bases[k];
+			r += f * (n % bases[k]);
+		}
+
+		jitter[k] = r - 0.5f;
+	}
+
+	return jitter;
+}
+
+// Show the average of --accumulate on the screen
+void presentAccumulation()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, accumFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Draw the quad of this frame into the average of --accumulate, and show the average.
+// Sample n is 1 / n of the average, with blending, and the ones before it are the rest
+void accumulateFrame()
+{
+	makeAccumulationBuffer();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+	accumulatedSamples++;
+
+	if (accumulatedSamples > 1)
+	{
+		glEnable(GL_BLEND);
+		glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / accumulatedSamples);
+		glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	}
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glDisable(GL_BLEND);
+
+	presentAccumulation();
+}
+
+// Make the two images and hit textures of --temporal, the same size as the window. This only does something the
+// first time, and when the window changes size, and then there is no frame before to use
+void makeTemporalBuffers()
+{
+	if (temporalWidth == width && temporalHeight == height)
+		return;
+
+	if (temporalWidth > 0)
+	{
+		glDeleteFramebuffers(2, temporalFBO);
+
+		for (int i = 0; i < 2; i++)
+		{
+			forgetGpuImage(GL_TEXTURE, temporalColor[i]);
+			forgetGpuImage(GL_TEXTURE, temporalHit[i]);
+		}
+
+		glDeleteTextures(2, temporalColor);
+		glDeleteTextures(2, temporalHit);
+	}
+	else
+	{
+		glGenBuffers(1, &motionBuffer);
+	}
+
+	temporalWidth = width;
+	temporalHeight = height;
+	historyValid = false;
+
+	glGenTextures(2, temporalColor);
+	glGenTextures(2, temporalHit);
+	glGenFramebuffers(2, temporalFBO);
+
+	for (int i = 0; i < 2; i++)
+	{
+		// the same 8 bits per color as the screen
+		glBindTexture(GL_TEXTURE_2D, temporalColor[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		trackGpuImage(GL_TEXTURE, temporalColor[i], (size_t)4 * width * height, GPU_MEMORY_IMAGES);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		// how far along the ray the point is, and its triangle, see historyHit in FragmentShader.glsl
+		glBindTexture(GL_TEXTURE_2D, temporalHit[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, width, height, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+		trackGpuImage(GL_TEXTURE, temporalHit[i], (size_t)8 * width * height, GPU_MEMORY_IMAGES);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		// The color is output 0 of the fragment shader, and the hit is output 3
+		glBindFramebuffer(GL_FRAMEBUFFER, temporalFBO[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, temporalColor[i], 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, temporalHit[i], 0);
+
+		GLenum drawBuffers[4] = { GL_COLOR_ATTACHMENT0, GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(4, drawBuffers);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Give the draw program what --temporal needs from the frame before: how every mesh moved since then (from the matrices
+// of this frame), the camera of then, and its image and hits. The draw program must be in use
+void setTemporalHistory(const std::vector<glm::mat4x4>& matrices)
+{
+	makeTemporalBuffers();
+
+	// the meshes did not move if there are no matrices from before
+	if (prevMatrices.size() != matrices.size())
+		prevMatrices = matrices;
+
+	std::vector<meshMotion> motions(numSceneMeshes);
+
+	for (int m = 0; m < numSceneMeshes; m++)
+	{
+		motions[m] = {};
+		motions[m].motion = prevMatrices[m] * glm::inverse(matrices[m]);
+		motions[m].first = sceneMeshOffsets[m];
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, motionBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, motionBuffer, sizeof(meshMotion) * motions.size(), motions.data(), GL_STREAM_DRAW, GPU_MEMORY_UPLOAD);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 28, motionBuffer);
+
+	glUniform1i(temporal_loc, 1);
+	glUniform1i(historyValid_loc, historyValid);
+	glUniform1i(temporalRefresh_loc, temporalRefresh);
+	glUniform1i(checkerboard_loc, useCheckerboard);
+	glUniformMatrix4fv(prevViewProj_loc, 1, GL_FALSE, &prevViewProj[0][0]);
+	glUniform3f(prevEye_loc, prevEye.x, prevEye.y, prevEye.z);
+
+	// the fragment shader reads the frame before from texture units 4 and 5
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, temporalColor[1 - temporalIndex]);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, temporalHit[1 - temporalIndex]);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Draw the quad of this frame into the image of --temporal, and copy it to the screen.
+// With --checkerboard, the holes are filled in on the way to the screen, but not in the image that the next frame reads,
+// so that it does not use a color that was not traced again.
+// This frame is the frame before of the next one, which reads the other image
+void drawTemporalFrame(const std::vector<glm::mat4x4>& matrices)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, temporalFBO[temporalIndex]);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	if (useCheckerboard)
+	{
+		makeCheckerboardProgram();
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+		glUseProgram(checkerboard_program);
+
+		// CheckerboardResolve.glsl reads the image from texture unit 6, and the hits from the hit buffer in unit 3
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_2D, temporalColor[temporalIndex]);
+		glActiveTexture(GL_TEXTURE0);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glUseProgram(draw_program);
+	}
+	else
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, temporalFBO[temporalIndex]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+	}
+
+	prevViewProj = cameraViewProj;
+	prevEye = cameraPos;
+	prevMatrices = matrices;
+	historyValid = true;
+	temporalIndex = 1 - temporalIndex;
+}
+
+// Make the two images of --denoise, the same size as the window. This only does something the first time,
+// and when the window changes size
+void makeDenoiseBuffers()
+{
+	if (denoiseWidth == width && denoiseHeight == height)
+		return;
+
+	if (denoiseWidth > 0)
+	{
+		glDeleteFramebuffers(2, denoiseFBO);
+
+		for (int i = 0; i < 2; i++)
+			forgetGpuImage(GL_TEXTURE, denoiseColor[i]);
+
+		glDeleteTextures(2, denoiseColor);
+	}
+
+	denoiseWidth = width;
+	denoiseHeight = height;
+
+	glGenTextures(2, denoiseColor);
+	glGenFramebuffers(2, denoiseFBO);
+
+	for (int i = 0; i < 2; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, denoiseColor[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+		trackGpuImage(GL_TEXTURE, denoiseColor[i], (size_t)8 * width * height, GPU_MEMORY_IMAGES);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, denoiseFBO[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, denoiseColor[i], 0);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Blur the frame on the screen with the passes of Denoise.glsl. The hit buffer must already have the points
+// of this frame. Pass i looks at pixels 2^i apart, and every pass reads the image of the pass before
+void denoiseFrame()
+{
+	makeDenoiseBuffers();
+	makeDenoiseProgram();
+
+	// the first pass reads the frame, which is copied out of the screen, because it draws there last
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, screenFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, denoiseFBO[0]);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	glUseProgram(denoise_program);
+
+	// Denoise.glsl reads the image from texture unit 6, and the hits from the hit buffer in unit 3
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, hitTexture);
+
+	for (int i = 0; i < denoisePasses; i++)
+	{
+		bool last = i == denoisePasses - 1;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, last ? screenFBO : denoiseFBO[(i + 1) % 2]);
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_2D, denoiseColor[i % 2]);
+
+		glUniform1i(denoise_stepSize_loc, 1 << i);
+		glUniform1i(denoise_firstPass_loc, i == 0);
+		glUniform1i(denoise_lastPass_loc, last);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glUseProgram(draw_program);
+}
+
+// Make the image that TiledRender.glsl writes into, and a framebuffer to copy it to the screen from.
+// This only does something the first time, and when the window changes size
+void makeTiledRenderTexture()
+{
+	if (tiledRenderWidth == width && tiledRenderHeight == height)
+		return;
+
+	if (tiledRenderWidth > 0)
+	{
+		glDeleteFramebuffers(1, &tiledRenderFBO);
+		forgetGpuImage(GL_TEXTURE, tiledRenderTexture);
+		glDeleteTextures(1, &tiledRenderTexture);
+	}
+
+	tiledRenderWidth = width;
+	tiledRenderHeight = height;
+
+	// Full floats, so that the colors are rounded to 8 bits by the copy to the screen,
+	// the same way as the colors that the fragment shader writes
+	glGenTextures(1, &tiledRenderTexture);
+	glBindTexture(GL_TEXTURE_2D, tiledRenderTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+	trackGpuImage(GL_TEXTURE, tiledRenderTexture, (size_t)16 * width * height, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &tiledRenderFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, tiledRenderFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tiledRenderTexture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Load the importance map of --importance-map, the first time, as a grayscale texture. Row 0 of a FreeImage bitmap
+// is the bottom row, like in a texture. If it cannot be read, the tiles use the distance from foveaCenter instead
+void loadImportanceMap()
+{
+	if (importanceMapTexture || importanceMapFile.empty())
+		return;
+
+	FREE_IMAGE_FORMAT format = FreeImage_GetFileType(importanceMapFile.c_str(), 0);
+	FIBITMAP* image = format == FIF_UNKNOWN ? nullptr : FreeImage_Load(format, importanceMapFile.c_str(), 0);
+
+	if (!image)
+	{
+		std::cout << "Can't read the importance map " << importanceMapFile << ", the tiles use the distance from the center instead" << std::endl;
+		importanceMapFile.clear();
+		return;
+	}
+
+	FIBITMAP* gray = FreeImage_ConvertToGreyscale(image);
+	FreeImage_Unload(image);
+
+	int mapWidth = FreeImage_GetWidth(gray);
+	int mapHeight = FreeImage_GetHeight(gray);
+
+	// the rows of the bitmap are padded to 4 bytes
+	glGenTextures(1, &importanceMapTexture);
+	glBindTexture(GL_TEXTURE_2D, importanceMapTexture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, FreeImage_GetPitch(gray));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, mapWidth, mapHeight, 0, GL_RED, GL_UNSIGNED_BYTE, FreeImage_GetBits(gray));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	trackGpuImage(GL_TEXTURE, importanceMapTexture, (size_t)mapWidth * mapHeight, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	FreeImage_Unload(gray);
+}
+
+// Make the occluder lists of --light-occluders with LightOccluders.glsl, from the triangles that Compute.glsl moved
+// into the world this frame, and the lights of uploadLights. The draw program is in use again after
+void buildLightOccluders()
+{
+	if (!light_occluder_program)
+	{
+		std::string shader = addShaderDefines(readShader("../Assets/LightOccluders.glsl"), lightOccluderDefines());
+		light_occluder_program = makeProgram("light occluders", { { GL_COMPUTE_SHADER, shader, "LightOccluders.glsl" } });
+
+		occluder_numTriangles_loc = glGetUniformLocation(light_occluder_program, "numTriangles");
+		occluder_numLights_loc = glGetUniformLocation(light_occluder_program, "numLights");
+
+		// a count for every light, and then the lists
+		glGenBuffers(1, &lightOccluderBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightOccluderBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, lightOccluderBuffer, sizeof(GLuint) * MAX_LIGHTS * (1 + (GLsizeiptr)lightOccluders), nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_RENDER);
+	}
+
+	// the counts start at 0, the lists are written before they are read
+	GLuint zero = 0;
+	gpuRead("light occluder clear", { { RES_LIGHT_OCCLUDERS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightOccluderBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint) * MAX_LIGHTS, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// binding 10 is also the keys of the radix sort of the BVH, which is done before this
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, lightOccluderBuffer);
+
+	glUseProgram(light_occluder_program);
+	glUniform1i(occluder_numTriangles_loc, bvhNumTriangles);
+	glUniform1i(occluder_numLights_loc, std::min((int)sceneLights.size(), MAX_LIGHTS));
+
+	gpuRead("light occluders", { { RES_TRIANGLES, GL_SHADER_STORAGE_BARRIER_BIT } });
+	glDispatchCompute((bvhNumTriangles + 63) / 64, 1, 1);
+	gpuWrote({ RES_LIGHT_OCCLUDERS });
+
+	glUseProgram(draw_program);
+}
+
+// Trace the next irradianceRate probes of --irradiance-probes with IrradianceProbes.glsl, in the scene of this frame.
+// The first time, this makes the grid across the box around the meshes where they are now. The draw program is in use again after
+void updateIrradianceProbes(const std::vector<glm::mat4x4>& matrices)
+{
+	if (!irradiance_program)
+	{
+		std::string shader = specializeShader(readShader("../Assets/IrradianceProbes.glsl"), triangleKernel);
+		shader = addShaderDefines(shader, sceneShaderDefines());
+
+		if (compactMeshes)
+			shader = addShaderDefines(shader, "#define COMPACT_MESHES\n");
+
+		shader = addShaderDefines(shader, halfShadingDefines());
+		shader = addShaderDefines(shader, materialTableDefines());
+		shader = addShaderDefines(shader, analyticDefines());
+		shader = addShaderDefines(shader, instanceGridDefines());
+		shader = addShaderDefines(shader, lightPlacementDefines());
+		shader = addShaderDefines(shader, irradianceProbeDefines());
+		irradiance_program = makeProgram("irradiance probes", { { GL_COMPUTE_SHADER, shader, "IrradianceProbes.glsl" } });
+
+		irradiance_accel_loc = glGetUniformLocation(irradiance_program, "accel");
+		irradiance_wideBLAS_loc = glGetUniformLocation(irradiance_program, "wideBLAS");
+		irradiance_numLights_loc = glGetUniformLocation(irradiance_program, "numLights");
+		irradiance_firstProbe_loc = glGetUniformLocation(irradiance_program, "firstProbe");
+		irradiance_probeBlend_loc = glGetUniformLocation(irradiance_program, "probeBlend");
+	}
+
+	if (!irradianceBuffer)
+	{
+		AABB box = emptyAABB();
+
+		for (size_t m = 0; m < meshBounds.size() && m < matrices.size(); m++)
+			growAABB(box, transformAABB(meshBounds[m], matrices[m]));
+
+		// a little bigger, so that no side is flat
+		glm::vec3 margin = (box.max - box.min) * 0.01f + 0.01f;
+		box.min -= margin;
+		box.max += margin;
+
+		// n probes along the longest side, and as many on the others as keeps the cells close to cubes
+		glm::vec3 size = box.max - box.min;
+		float longest = std::max(size.x, std::max(size.y, size.z));
+
+		for (int a = 0; a < 3; a++)
+			irradianceCount[a] = glm::clamp((int)ceil(irradianceProbes * size[a] / longest), 2, irradianceProbes);
+
+		irradianceGrid grid = {};
+		grid.boxMin = box.min;
+		grid.boxMax = box.max;
+		grid.countX = irradianceCount.x;
+		grid.countY = irradianceCount.y;
+		grid.countZ = irradianceCount.z;
+
+		// the grid, and then every probe with 0 in w, which is not traced yet
+		int total = irradianceCount.x * irradianceCount.y * irradianceCount.z;
+		std::vector<unsigned char> data(sizeof(irradianceGrid) + sizeof(glm::vec4) * 6 * (size_t)total, 0);
+		memcpy(data.data(), &grid, sizeof(grid));
+
+		glGenBuffers(1, &irradianceBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, irradianceBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, irradianceBuffer, data.size(), data.data(), GL_DYNAMIC_DRAW, GPU_MEMORY_RENDER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		std::cout << "--irradiance-probes: " << irradianceCount.x << " x " << irradianceCount.y << " x " << irradianceCount.z << " probes" << std::endl;
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IRRADIANCE_BINDING, irradianceBuffer);
+
+	int total = irradianceCount.x * irradianceCount.y * irradianceCount.z;
+	int count = std::min(irradianceRate, total);
+
+	glUseProgram(irradiance_program);
+	glUniform1i(irradiance_accel_loc, accelBackend);
+	glUniform1i(irradiance_wideBLAS_loc, blasNodeFormat == BVH_FORMAT_WIDE4);
+	glUniform1i(irradiance_numLights_loc, (int)sceneLights.size());
+	glUniform1i(irradiance_firstProbe_loc, irradianceNext);
+	glUniform1f(irradiance_probeBlend_loc, irradianceBlend);
+	setPathUniforms();
+
+	glDispatchCompute(count, 1, 1);
+	gpuWrote({ RES_IRRADIANCE });
+	irradianceNext = (irradianceNext + count) % total;
+
+	glUseProgram(draw_program);
+}
+
+// Make the lists of the triangles of every tile with TriangleBin.glsl, for the eye rays of TiledRender.glsl.
+// calcCameraRays must already have made cameraViewProj for this frame. The tiled render program is in use again after
+void binTileTriangles(int tilesX, int tilesY)
+{
+	int tiles = tilesX * tilesY;
+
+	// 2 uints for every tile, then the lists
+	if (tiles > triangleBinTiles)
+	{
+		gpuArenaFree(renderArena, triangleBinRange);
+		triangleBinTiles = tiles;
+
+		triangleBinRange = gpuArenaAlloc(renderArena, (GLsizeiptr)sizeof(GLuint) * tiles * (2 + binEntries));
+		gpuArenaBind(renderArena, 30, triangleBinRange);
+	}
+
+	// the counts start at 0, the rest is written before it is read
+	GLuint zero = 0;
+	gpuRead("triangle bin clear", { { RES_TRIANGLE_BINS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderArena.buffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, triangleBinRange.offset, (GLsizeiptr)sizeof(GLuint) * tiles * 2, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(triangle_bin_program);
+	glUniform1i(bin_numTriangles_loc, bvhNumTriangles);
+	glUniformMatrix4fv(bin_viewProj_loc, 1, GL_FALSE, &cameraViewProj[0][0]);
+	glUniform1i(bin_imageWidth_loc, width);
+	glUniform1i(bin_imageHeight_loc, height);
+	glUniform1i(bin_tilesX_loc, tilesX);
+	glUniform1i(bin_tilesY_loc, tilesY);
+	glUniform1ui(bin_capacity_loc, (GLuint)(triangleBinTiles * binEntries));
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+
+	gpuRead("triangle bin", { { RES_TRIANGLES, GL_SHADER_STORAGE_BARRIER_BIT } });
+	int groups = (bvhNumTriangles + 63) / 64;
+
+	glUniform1i(bin_pass_loc, 0);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(bin_pass_loc, 1);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(bin_pass_loc, 2);
+	glDispatchCompute(groups, 1, 1);
+
+	gpuWrote({ RES_TRIANGLE_BINS });
+
+	glUseProgram(tiled_render_program);
+}
+
+// The queue of --cost-order for this frame, of tiles tiles: the tiles sorted by what they cost when this range was used
+// last, the most first (in rows until they were counted), and the costs of this frame at 0. Returns the range, bound
+GpuRange& orderTilesByCost(int tiles)
+{
+	// a new render size has other tiles
+	if (tiles != tileCostTiles)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			gpuArenaFree(renderArena, tileCostRanges[i]);
+			tileCostRanges[i] = gpuArenaAlloc(renderArena, (GLsizeiptr)sizeof(GLuint) * (1 + 2 * tiles));
+			tileCostsCounted[i] = false;
+		}
+
+		tileCostTiles = tiles;
+	}
+
+	tileCostTurn = 1 - tileCostTurn;
+	GpuRange& range = tileCostRanges[tileCostTurn];
+
+	// the start of the queue, and then the order
+	std::vector<GLuint> queue(1 + tiles);
+	std::vector<GLuint> costs(tiles);
+
+	for (int i = 0; i < tiles; i++)
+		queue[1 + i] = i;
+
+	gpuRead("tile costs", { { RES_TILE_QUEUE, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderArena.buffer);
+
+	if (tileCostsCounted[tileCostTurn])
+	{
+		{
+			GL_STALL_ZONE("glGetBufferSubData (tile costs)");
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, range.offset + sizeof(GLuint) * (1 + tiles), sizeof(GLuint) * tiles, costs.data());
+		}
+
+		// the tiles that cost the same stay in rows
+		std::stable_sort(queue.begin() + 1, queue.end(), [&costs](GLuint a, GLuint b) { return costs[a] > costs[b]; });
+	}
+
+	GLuint zero = 0;
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, range.offset, sizeof(GLuint) * queue.size(), queue.data());
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, range.offset + sizeof(GLuint) * (1 + tiles), sizeof(GLuint) * tiles,
+		GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	gpuArenaBind(renderArena, 15, range);
+	tileCostsCounted[tileCostTurn] = true;
+	return range;
+}
+
+// Render the image with TiledRender.glsl, one workgroup per tile, and copy it to the screen.
+// The camera and the path uniforms must already be set, with tiled_render_program in use.
+// With variableRate, a second dispatch fills in the pixels that the tiles did not trace.
+// With --persistent-threads, persistentGroups workgroups take the tiles from the queue instead, and with --cost-order,
+// the most expensive tiles first.
+// With --bin-triangles, the eye rays of a tile only test the triangles that binTileTriangles found for it
+void traceTiles()
+{
+	makeTiledRenderTexture();
+
+	glBindImageTexture(0, tiledRenderTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	if (variableRate)
+	{
+		loadImportanceMap();
+		glUniform1i(tiled_variableRate_loc, 1);
+		glUniform2f(tiled_foveaCenter_loc, foveaCenter.x, foveaCenter.y);
+		glUniform1f(tiled_foveaRadius_loc, foveaRadius);
+		glUniform1i(tiled_importanceMapped_loc, importanceMapTexture != 0);
+
+		// TiledRender.glsl reads the importance map from texture unit 7
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, importanceMapTexture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	int groupsX = (width + TILED_RENDER_GROUP_SIZE - 1) / TILED_RENDER_GROUP_SIZE;
+	int groupsY = (height + TILED_RENDER_GROUP_SIZE - 1) / TILED_RENDER_GROUP_SIZE;
+
+	if (binTriangles)
+	{
+		binTileTriangles(groupsX, groupsY);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+		gpuRead("binned tiles", { { RES_TRIANGLE_BINS, GL_SHADER_STORAGE_BARRIER_BIT } });
+	}
+
+	glUniform1i(tiled_binned_loc, binTriangles);
+	glUniform1i(tiled_tileFrustum_loc, tileFrustum);
+	glUniform1i(tiled_pixelOrder_loc, pixelOrder);
+
+	// Along the Z curve, the tiles are in whole blocks, and a row of workgroups is a row of blocks.
+	// The fill pass of variableRate still has one workgroup per tile
+	int traceGroupsX = groupsX;
+	int traceGroupsY = groupsY;
+
+	if (pixelOrder == PIXEL_ORDER_MORTON)
+	{
+		traceGroupsX = (groupsX + TILE_BLOCK_SIZE - 1) / TILE_BLOCK_SIZE * TILE_BLOCK_SIZE * TILE_BLOCK_SIZE;
+		traceGroupsY = (groupsY + TILE_BLOCK_SIZE - 1) / TILE_BLOCK_SIZE;
+	}
+
+	if (persistentThreads && costOrder)
+	{
+		orderTilesByCost(traceGroupsX * traceGroupsY);
+	}
+	else if (persistentThreads)
+	{
+		// the queue starts at the first tile again
+		if (tileQueueRange.size == 0)
+			tileQueueRange = gpuArenaAlloc(renderArena, sizeof(GLuint));
+
+		// (--bench-tiled-render can have bound the ranges of --cost-order)
+		gpuArenaBind(renderArena, 15, tileQueueRange);
+
+		GLuint firstTile = 0;
+		gpuRead("tile queue clear", { { RES_TILE_QUEUE, GL_BUFFER_UPDATE_BARRIER_BIT } });
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderArena.buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, tileQueueRange.offset, sizeof(GLuint), &firstTile);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	if (persistentThreads)
+	{
+		// never more workgroups than tiles, the others would only find the queue empty
+		glUniform1i(tiled_persistent_loc, 1);
+		glUniform1i(tiled_costOrder_loc, costOrder);
+		glDispatchCompute(std::min(persistentGroups, traceGroupsX * traceGroupsY), 1, 1);
+		glUniform1i(tiled_persistent_loc, 0);
+		glUniform1i(tiled_costOrder_loc, 0);
+		gpuWrote({ RES_TILED_IMAGE, RES_TILE_QUEUE });
+	}
+	else
+	{
+		glDispatchCompute(traceGroupsX, traceGroupsY, 1);
+		gpuWrote({ RES_TILED_IMAGE });
+	}
+
+	if (variableRate)
+	{
+		gpuRead("tile fill", { { RES_TILED_IMAGE, GL_SHADER_IMAGE_ACCESS_BARRIER_BIT } });
+		glUniform1i(tiled_fillPass_loc, 1);
+		glDispatchCompute(groupsX, groupsY, 1);
+		glUniform1i(tiled_fillPass_loc, 0);
+		gpuWrote({ RES_TILED_IMAGE });
+	}
+
+	// the copy reads the image through the framebuffer, not through imageLoad
+	gpuRead("blit", { { RES_TILED_IMAGE, GL_FRAMEBUFFER_BARRIER_BIT } });
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, tiledRenderFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Make the queues of the wavefront renderer big enough for the whole window.
+// This only does something the first time, and when the window gets bigger
+void makeWavefrontBuffers()
+{
+	int pixels = width * height;
+
+	if (pixels <= wavefrontPixels)
+		return;
+
+	if (wavefrontPixels > 0)
+	{
+		gpuDeleteBuffers(1, &waveRayBuffer);
+		gpuDeleteBuffers(1, &waveHitBuffer);
+		gpuDeleteBuffers(1, &waveShadowBuffer);
+		gpuDeleteBuffers(1, &wavePixelBuffer);
+		gpuDeleteBuffers(1, &waveSortKeyBuffer);
+		gpuDeleteBuffers(1, &waveSortTempBuffer);
+	}
+	else
+	{
+		glGenBuffers(1, &waveCountBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveCountBuffer);
+		// the 4 counts, and then 3 DispatchIndirectCommands, see WAVE_ARGS_OFFSET
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, waveCountBuffer, WAVE_ARGS_OFFSET(3), nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_RENDER);
+	}
+
+	wavefrontPixels = pixels;
+
+	// The GPU is the only one that touches these
+	glGenBuffers(1, &waveRayBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveRayBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, waveRayBuffer, (GLsizeiptr)WAVE_RAY_SIZE * 2 * pixels, nullptr, GL_STATIC_DRAW, GPU_MEMORY_RENDER);
+
+	glGenBuffers(1, &waveHitBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveHitBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, waveHitBuffer, (GLsizeiptr)WAVE_HIT_SIZE * pixels, nullptr, GL_STATIC_DRAW, GPU_MEMORY_RENDER);
+
+	glGenBuffers(1, &waveShadowBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveShadowBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, waveShadowBuffer, (GLsizeiptr)WAVE_SHADOW_RAY_SIZE * WAVE_SHADOW_RAYS_PER_PIXEL * pixels, nullptr, GL_STATIC_DRAW, GPU_MEMORY_RENDER);
+
+	glGenBuffers(1, &wavePixelBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, wavePixelBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, wavePixelBuffer, (GLsizeiptr)sizeof(GLuint) * 4 * pixels, nullptr, GL_STATIC_DRAW, GPU_MEMORY_RENDER);
+
+	// one key and ray index for every ray in half of the ray queue
+	glGenBuffers(1, &waveSortKeyBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveSortKeyBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, waveSortKeyBuffer, (GLsizeiptr)sizeof(GLuint) * 2 * pixels, nullptr, GL_STATIC_DRAW, GPU_MEMORY_RENDER);
+
+	glGenBuffers(1, &waveSortTempBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveSortTempBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, waveSortTempBuffer, (GLsizeiptr)sizeof(GLuint) * 2 * pixels, nullptr, GL_STATIC_DRAW, GPU_MEMORY_RENDER);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Set one of the queue counts in waveCountBuffer. 0 and 1 are the halves of the
+// ray queue, 2 is the hit queue, and 3 is the shadow queue
+void setWaveCount(int queue, GLuint count)
+{
+	gpuRead("wave count", { { RES_WAVE_COUNTS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, waveCountBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * queue, sizeof(GLuint), &count);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Start one of EXTEND, SHADE, or SHADOW. With waveIndirectDispatch, STAGE_ARGS first works out
+// on the GPU how many workgroups the stage needs (args is one of WAVE_ARGS_EXTEND, SHADE, or SHADOW),
+// and the command waits for it with GL_COMMAND_BARRIER_BIT. Otherwise the stage gets maxGroups,
+// which is enough for the biggest the queue could be, and the extra threads stop right away
+void dispatchWaveStage(int stage, int args, int maxGroups)
+{
+	if (!waveIndirectDispatch)
+	{
+		glUniform1i(wave_stage_loc, stage);
+		glDispatchCompute(maxGroups, 1, 1);
+		return;
+	}
+
+	glUniform1i(wave_stage_loc, WAVE_STAGE_ARGS);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUniform1i(wave_stage_loc, stage);
+	glDispatchComputeIndirect((GLintptr)WAVE_ARGS_OFFSET(args));
+}
+
+// Run every stage of Wavefront.glsl. The scene, the acceleration structure, and the
+// camera must already be set up, exactly like they are for the fragment shader.
+// We don't know how many rays are in each queue without waiting for the GPU,
+// so the GPU sizes the dispatches itself (see dispatchWaveStage)
+void traceWavefront()
+{
+	int pixels = width * height;
+	int pixelGroups = (pixels + 63) / 64;
+	int shadowGroups = (pixels * WAVE_SHADOW_RAYS_PER_PIXEL + 63) / 64;
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, waveRayBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, waveHitBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, waveShadowBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, waveCountBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, wavePixelBuffer);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, waveCountBuffer);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, waveSortKeyBuffer);
+
+	glUniform1i(wave_imageWidth_loc, width);
+	glUniform1i(wave_imageHeight_loc, height);
+	glUniform1i(wave_sortRays_loc, GL_FALSE);
+	glUniform1i(wave_subgroupTraversal_loc, waveSubgroupTraversal);
+	glUniform1i(wave_compactQueues_loc, waveCompactQueues);
+	glUniform3fv(wave_sortBoundsMin_loc, 1, &waveSortBoundsMin[0]);
+	glUniform3fv(wave_sortBoundsMax_loc, 1, &waveSortBoundsMax[0]);
+
+	// every pixel gets an eye ray, in the first half of the ray queue
+	setWaveCount(0, pixels);
+	glUniform1i(wave_stage_loc, WAVE_STAGE_GENERATE);
+	glUniform1i(wave_rayOutOffset_loc, 0);
+	glDispatchCompute(pixelGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	for (int bounce = 0; bounce <= maxBounces; bounce++)
+	{
+		// read rays from one half of the ray queue, and write reflections to the other half
+		glUniform1i(wave_bounce_loc, bounce);
+		glUniform1i(wave_rayInOffset_loc, (bounce % 2) * pixels);
+		glUniform1i(wave_rayOutOffset_loc, ((bounce + 1) % 2) * pixels);
+
+		// every queue that this bounce writes to starts empty
+		setWaveCount((bounce + 1) % 2, 0);
+		setWaveCount(2, 0);
+		setWaveCount(3, 0);
+
+		// The eye rays are already in a good order, so only the reflections are sorted
+		bool sortThisBounce = waveSortRays && bounce > 0;
+
+		if (sortThisBounce)
+		{
+			if (waveTimeStages)
+				glBeginQuery(GL_TIME_ELAPSED, waveTimerQuery);
+
+			glUniform1i(wave_stage_loc, WAVE_STAGE_SORT_KEYS);
+			glDispatchCompute(pixelGroups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			// The sort swaps the two key buffers an even number of times,
+			// so the sorted keys end up back in waveSortKeyBuffer
+			radixSortKeys(waveSortKeyBuffer, waveSortTempBuffer, pixels);
+
+			glUseProgram(wavefront_program);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, waveSortKeyBuffer);
+
+			if (waveTimeStages)
+			{
+				glEndQuery(GL_TIME_ELAPSED);
+
+				GLuint64 ns = 0;
+				{
+					GL_STALL_ZONE("glGetQueryObjectui64v (wave sort)");
+					glGetQueryObjectui64v(waveTimerQuery, GL_QUERY_RESULT, &ns);
+				}
+				waveSortTime += ns;
+			}
+		}
+
+		if (waveTimeStages)
+			glBeginQuery(GL_TIME_ELAPSED, waveTimerQuery);
+
+		glUniform1i(wave_sortRays_loc, sortThisBounce);
+		dispatchWaveStage(WAVE_STAGE_EXTEND, WAVE_ARGS_EXTEND, pixelGroups);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUniform1i(wave_sortRays_loc, GL_FALSE);
+
+		if (waveTimeStages)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 ns = 0;
+			{
+				GL_STALL_ZONE("glGetQueryObjectui64v (wave extend)");
+				glGetQueryObjectui64v(waveTimerQuery, GL_QUERY_RESULT, &ns);
+			}
+			waveExtendTime += ns;
+		}
+
+		dispatchWaveStage(WAVE_STAGE_SHADE, WAVE_ARGS_SHADE, pixelGroups);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		dispatchWaveStage(WAVE_STAGE_SHADOW, WAVE_ARGS_SHADOW, shadowGroups);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// The stages add rays to the queues with atomics on the counts, and the
+		// barriers above are only for the shaders, so setting a count waits for them
+		gpuWrote({ RES_WAVE_COUNTS });
+	}
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+// Open the timing log (if there is one), make room for the times of this many frames,
+// and make the queries of every frame timer
+void startTimingLog(int frames)
+{
+	if (!timingLogName.empty())
+	{
+		timingLog.open(timingLogName);
+		timingLogJSON = timingLogName.size() >= 5 && timingLogName.compare(timingLogName.size() - 5, 5, ".json") == 0;
+
+		if (timingLogJSON)
+			timingLog << "[" << std::endl;
+		else
+			timingLog << "frame,scene_ms,draw_ms,readback_ms,gpu_ms,cpu_ms,save_ms,wait_ms" << std::endl;
+	}
+
+	if (gpuCounters && startGpuCounters(gpuCounterPatterns, FRAME_TIMER_SLICES))
+	{
+		counterLog.open(timingLogName.substr(0, timingLogName.find_last_of('.')) + ".counters.csv");
+		counterLog << "frame,pass";
+
+		for (const std::string& name : gpuCounterNames())
+			counterLog << "," << name;
+
+		counterLog << std::endl;
+	}
+	else
+	{
+		gpuCounters = false;
+	}
+
+	frameTimes.clear();
+	frameTimes.reserve(frames);
+	timingFrames = true;
+
+	if (isProfiling())
+	{
+		GLint64 gpuNow;
+		GL_STALL_ZONE("glGetInteger64v (GL_TIMESTAMP)");
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuTraceOffset = profileNow() - gpuNow / 1000.0;
+	}
+
+	for (int i = 0; i < FRAME_TIMER_SLICES; i++)
+	{
+		glGenQueries(FRAME_TIMER_MARKS, frameTimers[i].queries);
+		frameTimers[i].frame = -1;
+	}
+}
+
+// The milliseconds between two timestamps of a frame, -1 if one of them was not written
+double frameTimerMs(FrameTimer& timer, GLuint64* times, int from, int to)
+{
+	if (!timer.marked[from] || !timer.marked[to])
+		return -1.0;
+
+	return (double)(times[to] - times[from]) / 1000000.0;
+}
+
+// Write the line of a frame that is done, keep its times for the report, and free its timer
+void finishFrameTimer(FrameTimer& timer)
+{
+	if (timer.frame < 0)
+		return;
+
+	GLuint64 times[FRAME_TIMER_MARKS] = {};
+
+	{
+		GL_STALL_ZONE("glGetQueryObjectui64v (frame timer)");
+
+		for (int i = 0; i < FRAME_TIMER_MARKS; i++)
+		{
+			if (timer.marked[i])
+				glGetQueryObjectui64v(timer.queries[i], GL_QUERY_RESULT, &times[i]);
+		}
+	}
+
+	// the readback is the last timestamp, but not every frame has one
+	int last = timer.marked[FRAME_TIMER_READBACK] ? FRAME_TIMER_READBACK : FRAME_TIMER_DRAW;
+
+	double scene = frameTimerMs(timer, times, FRAME_TIMER_START, FRAME_TIMER_SCENE);
+	double draw = frameTimerMs(timer, times, FRAME_TIMER_SCENE, FRAME_TIMER_DRAW);
+	double readback = frameTimerMs(timer, times, FRAME_TIMER_DRAW, FRAME_TIMER_READBACK);
+	double gpu = frameTimerMs(timer, times, FRAME_TIMER_START, last);
+	double cpu = (timer.cpuEnd - timer.cpuStart) * 1000.0;
+	double saveTime = timer.saveSeconds * 1000.0;
+	double waitTime = timer.waitSeconds * 1000.0;
+
+	if (timingLogJSON)
+	{
+		timingLog << (timedFrames > 0 ? ",\n" : "") << "{\"frame\": " << timer.frame << ", \"scene_ms\": " << scene
+			<< ", \"draw_ms\": " << draw << ", \"readback_ms\": " << readback << ", \"gpu_ms\": " << gpu
+			<< ", \"cpu_ms\": " << cpu << ", \"save_ms\": " << saveTime << ", \"wait_ms\": " << waitTime << "}";
+	}
+	else if (timingLog.is_open())
+	{
+		timingLog << timer.frame << "," << scene << "," << draw << "," << readback << "," << gpu << "," << cpu << "," << saveTime << "," << waitTime << std::endl;
+	}
+
+	// the server renders for as long as it runs, so its frames are only in the histograms of --metrics-port
+	if (servePort > 0)
+	{
+		if (scene >= 0.0 && draw >= 0.0)
+			observeMetric(renderHistogram, scene + draw);
+
+		if (readback >= 0.0)
+			observeMetric(readbackHistogram, readback);
+
+		observeMetric(encodeHistogram, saveTime);
+	}
+	else
+	{
+		frameTimes.push_back({ scene, draw, readback, gpu, cpu, saveTime, waitTime });
+	}
+
+	// the GPU passes go into the trace too, in their own row
+	if (isProfiling())
+	{
+		const char* passes[] = { "scene (gpu)", "draw (gpu)", "readback (gpu)" };
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (timer.marked[i] && timer.marked[i + 1])
+				addProfileEvent(passes[i], PROFILE_GPU_THREAD, times[i] / 1000.0 + gpuTraceOffset, (times[i + 1] - times[i]) / 1000.0);
+		}
+	}
+
+	// the counters of its passes, which are in the slot of the same number
+	if (gpuCounters)
+	{
+		std::vector<double> values;
+
+		for (int pass = 0; pass < GPU_COUNTER_PASSES; pass++)
+		{
+			if (!readGpuCounters((int)(&timer - frameTimers), pass, values))
+				continue;
+
+			counterLog << timer.frame << "," << gpuCounterPassNames[pass];
+
+			for (double value : values)
+				counterLog << "," << value;
+
+			counterLog << std::endl;
+		}
+	}
+
+	timedFrames++;
+	timer.frame = -1;
+}
+
+// Write a timestamp into the timer of the frame that is being rendered
+void markFrameTimer(int mark)
+{
+	if (currentFrameTimer < 0)
+		return;
+
+	FrameTimer& timer = frameTimers[currentFrameTimer];
+	glQueryCounter(timer.queries[mark], GL_TIMESTAMP);
+	timer.marked[mark] = true;
+
+	// The counters sample the passes between the marks, the transform until the scene is done, and the draw after it
+	if (gpuCounters)
+	{
+		if (mark == FRAME_TIMER_START)
+			beginGpuCounters(currentFrameTimer, GPU_COUNTER_TRANSFORM);
+		else if (mark == FRAME_TIMER_SCENE)
+			beginGpuCounters(currentFrameTimer, GPU_COUNTER_DRAW);
+		else
+			endGpuCounters();
+	}
+}
+
+// Add time that the render thread spent saving frames to the frame that is being rendered
+void addFrameSaveTime(double seconds)
+{
+	if (currentFrameTimer >= 0)
+		frameTimers[currentFrameTimer].saveSeconds += seconds;
+}
+
+// Add time that the render thread spent waiting to the frame that is being rendered.
+// If it waited while it was saving a frame, that time is not saving time
+void addFrameWaitTime(double seconds, bool whileSaving)
+{
+	if (currentFrameTimer < 0)
+		return;
+
+	frameTimers[currentFrameTimer].waitSeconds += seconds;
+
+	if (whileSaving)
+		frameTimers[currentFrameTimer].saveSeconds -= seconds;
+}
+
+// Start timing a frame, in the next timer of the ring. The frame that used it before is written out first
+void beginFrameTimer()
+{
+	if (!timingFrames)
+		return;
+
+	double now = platformTime();
+
+	// the frame before this one ends now
+	if (currentFrameTimer >= 0)
+		frameTimers[currentFrameTimer].cpuEnd = now;
+
+	currentFrameTimer = (currentFrameTimer + 1) % FRAME_TIMER_SLICES;
+	FrameTimer& timer = frameTimers[currentFrameTimer];
+
+	finishFrameTimer(timer);
+
+	timer.frame = totalFrame + 1;
+	timer.cpuStart = now;
+	timer.saveSeconds = 0.0;
+	timer.waitSeconds = 0.0;
+
+	for (int i = 0; i < FRAME_TIMER_MARKS; i++)
+		timer.marked[i] = false;
+
+	markFrameTimer(FRAME_TIMER_START);
+}
+
+// Change the rows of the bands of --slice-ms, from the times of the bands of the oldest frame in the ring of timers,
+// if the GPU is done with it. A band that took too long makes them smaller at once, but they only grow to twice as
+// many rows at a time, so a frame that suddenly gets slower is still not in one big band
+void updateSliceRows()
+{
+	SliceTimer& timer = sliceTimers[currentSliceTimer];
+
+	if (!timer.pending)
+		return;
+
+	GLint available = 0;
+	glGetQueryObjectiv(timer.queries[timer.bandRows.size()], GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if (!available)
+		return;
+
+	timer.pending = false;
+	double slowestRowMs = 0.0;
+	GLuint64 before = 0;
+	glGetQueryObjectui64v(timer.queries[0], GL_QUERY_RESULT, &before);
+
+	for (size_t b = 0; b < timer.bandRows.size(); b++)
+	{
+		GLuint64 after = 0;
+		glGetQueryObjectui64v(timer.queries[b + 1], GL_QUERY_RESULT, &after);
+		slowestRowMs = std::max(slowestRowMs, (double)(after - before) / 1000000.0 / timer.bandRows[b]);
+		before = after;
+	}
+
+	int fits = slowestRowMs > 0.0 ? (int)(sliceBudgetMs * SLICE_MARGIN / slowestRowMs) : height;
+	sliceRows = glm::clamp(std::min(fits, sliceRows * 2), 1, std::max(height, 1));
+}
+
+// Draw the quad of the fragment shader over rows 0 to rows - 1 in the bands of --slice-ms, with a timestamp
+// after every band for updateSliceRows. glFlush sends every band to the GPU as a submission of its own
+void drawQuadInSlices(int rows)
+{
+	updateSliceRows();
+
+	SliceTimer& timer = sliceTimers[currentSliceTimer];
+	currentSliceTimer = (currentSliceTimer + 1) % FRAME_TIMER_SLICES;
+
+	int bands = (rows + sliceRows - 1) / sliceRows;
+	int made = (int)timer.queries.size();
+
+	if (made < bands + 1)
+	{
+		timer.queries.resize(bands + 1);
+		glGenQueries(bands + 1 - made, &timer.queries[made]);
+	}
+
+	timer.bandRows.clear();
+	glEnable(GL_SCISSOR_TEST);
+	glQueryCounter(timer.queries[0], GL_TIMESTAMP);
+
+	for (int b = 0; b < bands; b++)
+	{
+		int first = b * sliceRows;
+		int count = std::min(sliceRows, rows - first);
+
+		glScissor(0, first, width, count);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glQueryCounter(timer.queries[b + 1], GL_TIMESTAMP);
+		glFlush();
+
+		timer.bandRows.push_back(count);
+	}
+
+	glDisable(GL_SCISSOR_TEST);
+	timer.pending = true;
+}
+
+// Write the first timestamp of the frame into the next timer of --target-ms
+void startResolutionTimer()
+{
+	if (targetFrameMs <= 0.0f)
+		return;
+
+	currentResolutionTimer = (currentResolutionTimer + 1) % FRAME_TIMER_SLICES;
+	ResolutionTimer& timer = resolutionTimers[currentResolutionTimer];
+
+	if (timer.queries[0] == 0)
+		glGenQueries(2, timer.queries);
+
+	timer.scale = dynamicScale;
+	timer.pending = false;
+	glQueryCounter(timer.queries[0], GL_TIMESTAMP);
+}
+
+// Write the last timestamp of the frame, after everything it sent to the GPU
+void endResolutionTimer()
+{
+	if (currentResolutionTimer < 0)
+		return;
+
+	glQueryCounter(resolutionTimers[currentResolutionTimer].queries[1], GL_TIMESTAMP);
+	resolutionTimers[currentResolutionTimer].pending = true;
+}
+
+// The p-th percentile of some times that are sorted from fastest to slowest (the nearest rank)
+double percentile(const std::vector<double>& sorted, int p)
+{
+	return sorted[std::max(0, ((int)sorted.size() * p + 99) / 100 - 1)];
+}
+
+// Print the percentiles of every part of the frames in frameTimes, and a histogram of the whole frames.
+// The GPU parts are left out of frames where they were not measured (they are -1 then).
+// The encode time is the time that the render thread spent saving frames, which does not have the waits in it
+void printFrameReport()
+{
+	if (frameTimes.empty())
+		return;
+
+	const char* names[] = { "frame (cpu)", "gpu", "  render", "    scene", "    draw", "  readback", "encode", "wait" };
+	std::vector<double> columns[8];
+
+	for (const FrameTimes& t : frameTimes)
+	{
+		double values[8] = { t.cpu, t.gpu, t.scene >= 0.0 && t.draw >= 0.0 ? t.scene + t.draw : -1.0,
+			t.scene, t.draw, t.readback, t.save, t.wait };
+
+		for (int c = 0; c < 8; c++)
+		{
+			if (values[c] >= 0.0)
+				columns[c].push_back(values[c]);
+		}
+	}
+
+	char line[256];
+	std::cout << "times of " << frameTimes.size() << " frames, in ms:" << std::endl;
+	sprintf(line, "%-12s %9s %9s %9s %9s %9s", "", "average", "p50", "p95", "p99", "max");
+	std::cout << line << std::endl;
+
+	for (int c = 0; c < 8; c++)
+	{
+		std::vector<double>& times = columns[c];
+
+		if (times.empty())
+			continue;
+
+		double sum = 0.0;
+		for (double t : times)
+			sum += t;
+
+		std::sort(times.begin(), times.end());
+		sprintf(line, "%-12s %9.2f %9.2f %9.2f %9.2f %9.2f", names[c], sum / times.size(),
+			percentile(times, 50), percentile(times, 95), percentile(times, 99), times.back());
+		std::cout << line << std::endl;
+	}
+
+	// The histogram of the whole frames, in 10 bars from the fastest frame to the slowest.
+	// The longest bar is 40 characters, and a bar with any frames in it is at least one
+	const std::vector<double>& cpu = columns[0];
+	double low = cpu.front();
+	double binSize = std::max((cpu.back() - low) / 10.0, 0.001);
+	int bins[10] = {};
+	int most = 0;
+
+	for (double t : cpu)
+	{
+		int b = std::min(9, (int)((t - low) / binSize));
+		bins[b]++;
+		most = std::max(most, bins[b]);
+	}
+
+	for (int b = 0; b < 10; b++)
+	{
+		int bar = bins[b] == 0 ? 0 : std::max(1, bins[b] * 40 / most);
+		sprintf(line, "%9.2f - %9.2f ms %6d ", low + b * binSize, low + (b + 1) * binSize, bins[b]);
+		std::cout << line << std::string(bar, '#') << std::endl;
+	}
+}
+
+// Start the timestamps of --latency, in the context that swaps the window
+void startLatencyTracker(LatencyTracker& tracker)
+{
+	glGenQueries(LATENCY_SLICES, tracker.queries);
+
+	for (int i = 0; i < LATENCY_SLICES; i++)
+		tracker.pending[i] = false;
+
+	tracker.next = 0;
+
+	GLint64 gpuNow;
+	GL_STALL_ZONE("glGetInteger64v (GL_TIMESTAMP)");
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	tracker.offset = platformTime() - gpuNow / 1000000000.0;
+}
+
+// Add the latency of the input of a timestamp to latencyMs (which waits for the GPU if it did not write it yet)
+void readLatencyMark(LatencyTracker& tracker, int slot)
+{
+	GLuint64 shown = 0;
+	glGetQueryObjectui64v(tracker.queries[slot], GL_QUERY_RESULT, &shown);
+	latencyMs.push_back((shown / 1000000000.0 + tracker.offset - tracker.inputTimes[slot]) * 1000.0);
+	tracker.pending[slot] = false;
+}
+
+// Read the timestamps that the GPU wrote, or all of them
+void collectLatency(LatencyTracker& tracker, bool wait)
+{
+	for (int i = 0; i < LATENCY_SLICES; i++)
+	{
+		if (!tracker.pending[i])
+			continue;
+
+		GLint available = 1;
+
+		if (!wait)
+			glGetQueryObjectiv(tracker.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available)
+			readLatencyMark(tracker, i);
+	}
+}
+
+// Write the timestamp of a frame that used an input from inputTime, right after its swap, and read the ones before
+void markPhoton(LatencyTracker& tracker, double inputTime)
+{
+	if (inputTime >= 0.0)
+	{
+		int slot = tracker.next;
+		tracker.next = (slot + 1) % LATENCY_SLICES;
+
+		// only if the GPU is that many inputs behind
+		if (tracker.pending[slot])
+			readLatencyMark(tracker, slot);
+
+		glQueryCounter(tracker.queries[slot], GL_TIMESTAMP);
+		tracker.inputTimes[slot] = inputTime;
+		tracker.pending[slot] = true;
+	}
+
+	collectLatency(tracker, false);
+}
+
+// Read the last timestamps of --latency, and delete the queries
+void stopLatencyTracker(LatencyTracker& tracker)
+{
+	collectLatency(tracker, true);
+	glDeleteQueries(LATENCY_SLICES, tracker.queries);
+}
+
+// An input came in at time. The next frame that is rendered uses it, and every input before it that no frame used yet
+void noteInput(double time)
+{
+	if (latencyReport && (pendingInputTime < 0.0 || time < pendingInputTime))
+		pendingInputTime = time;
+}
+
+// Print the percentiles of the input to photon times of --latency
+void printLatencyReport()
+{
+	if (latencyMs.empty())
+	{
+		std::cout << "--latency had no keys to measure" << std::endl;
+		return;
+	}
+
+	std::vector<double> times = latencyMs;
+	std::sort(times.begin(), times.end());
+
+	double sum = 0.0;
+	for (double t : times)
+		sum += t;
+
+	char line[256];
+	std::cout << "input to photon of " << times.size() << " inputs, in ms:" << std::endl;
+	sprintf(line, "%-12s %9s %9s %9s %9s %9s", "", "average", "p50", "p95", "p99", "max");
+	std::cout << line << std::endl;
+	sprintf(line, "%-12s %9.2f %9.2f %9.2f %9.2f %9.2f", "latency", sum / times.size(),
+		percentile(times, 50), percentile(times, 95), percentile(times, 99), times.back());
+	std::cout << line << std::endl;
+}
+
+// With --low-latency, after a frame was presented, wait until the GPU is done with the frame lowLatencyFrames before it
+void limitQueuedFrames()
+{
+	if (lowLatencyFrames < 0)
+		return;
+
+	int slots = lowLatencyFrames + 1;
+	queuedFrameFences[queuedFrames % slots] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	queuedFrames++;
+
+	GLsync oldest = queuedFrameFences[queuedFrames % slots];
+
+	if (oldest == 0)
+		return;
+
+	double start = platformTime();
+
+	{
+		PROFILE_ZONE("wait for queued frames");
+		glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	}
+
+	glDeleteSync(oldest);
+	queuedFrameFences[queuedFrames % slots] = 0;
+	addFrameWaitTime(platformTime() - start, false);
+}
+
+// Stop --latency (unless the main thread of --ui-thread swaps) and --low-latency, after the frames
+void finishLatency()
+{
+	for (GLsync& fence : queuedFrameFences)
+	{
+		if (fence != 0)
+			glDeleteSync(fence);
+
+		fence = 0;
+	}
+
+	queuedFrames = 0;
+
+	if (latencyReport && !uiThread)
+		stopLatencyTracker(latencyTracker);
+}
+
+// Write out the frames that are still in the ring, oldest first, close the log, and print the report
+void finishTimingLog()
+{
+	if (!timingFrames)
+		return;
+
+	if (currentFrameTimer >= 0)
+		frameTimers[currentFrameTimer].cpuEnd = platformTime();
+
+	if (gpuCounters)
+		endGpuCounters();
+
+	for (int i = 1; i <= FRAME_TIMER_SLICES; i++)
+		finishFrameTimer(frameTimers[(currentFrameTimer + i) % FRAME_TIMER_SLICES]);
+
+	if (gpuCounters)
+	{
+		stopGpuCounters();
+		counterLog.close();
+	}
+
+	for (int i = 0; i < FRAME_TIMER_SLICES; i++)
+		glDeleteQueries(FRAME_TIMER_MARKS, frameTimers[i].queries);
+
+	timingFrames = false;
+	currentFrameTimer = -1;
+
+	if (timingLog.is_open())
+	{
+		if (timingLogJSON)
+			timingLog << std::endl << "]" << std::endl;
+
+		timingLog.close();
+
+		std::cout << "wrote the times of " << timedFrames << " frames to " << timingLogName << std::endl;
+	}
+
+	if (frameReport)
+		printFrameReport();
+}
+
+// The time of the animation in the frame that is rendered now. Both renderScene and renderCpuScene use this
+float sceneTime()
+{
+	// There are two different ways of animating. We can 
+	// animate with respect to the time elapsed in the program, or we can
+	// animate with respect to the time elapsed in the video. 
+	
+	// If we want to test our animations, without waiting for the full 
+	// video to render: lower the resolution, disable reflections, then we 
+	// can render a real-time animation with totalTimeElapsedInProgram. This 
+	// works, even if the computer renders less than 60 frames per second
+
+	// After we have finished testing our animations, we can enable all of
+	// our quality settings (reflections, resolution, etc), and then change
+	// the elapsed time to totalTimeElapsedInVideo, and then all animations
+	// should look correct in the final video.
+
+	// Sometimes while prototyping, the real-time render will have a longer
+	// duration than the actual rendered video, keep that in mind while testing
+
+	float totalTimeElapsedInVideo = (float)totalFrame / videoFPS;
+	float totalTimeElapsedInProgram = (float)totalTime;
+
+	// choose which one you want here (--realtime picks the time in the program)
+	float time = realtimeAnimation ? totalTimeElapsedInProgram : totalTimeElapsedInVideo;
+
+	// --pause-at and P stop the animation
+	if (pauseAt >= 0.0f)
+		time = std::min(time, pauseAt);
+
+	if (animationPaused)
+		time = pausedTime;
+	else
+		pausedTime = time;
+
+	return time;
+}
+
+// One matrix per mesh at this time. Only the floor and the cube of the tutorial move,
+// any other mesh stays where it is (see meshPlacements). With --animation, the tracks of the file move the meshes instead
+std::vector<glm::mat4x4> sceneMatrices(float time)
+{
+	std::vector<glm::mat4x4> test = meshPlacements;
+	test.resize(numSceneMeshes, glm::mat4());
+
+	if (!sceneAnimation.mesh.empty())
+	{
+		evaluateAnimation(sceneAnimation, time, test.data(), numSceneMeshes);
+		return test;
+	}
+	
+	// scale the floor
+	test[0] = glm::scale(glm::mat4(), glm::vec3((sin(time) + 6.0f)) / 3.0f);
+
+	// move and rotate the cube
+	test[1] = glm::mat4();
+	test[1] = glm::translate(test[1], glm::vec3(2 * cos(time), 1.5, 2 * sin(time)));
+	test[1] = glm::rotate(test[1], -time, glm::vec3(0, 1, 0));
+	test[1] = glm::scale(test[1], glm::vec3((1 + sin(time)) / 2));
+
+	return test;
+}
+
+// The hash of the scene that --capture writes, so --replay can tell if it has another one: the triangles,
+// and where every mesh starts
+uint64_t sceneCaptureHash()
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, sceneTriangles.data(), sizeof(triangle) * sceneTriangles.size());
+	return hashBytes(hash, sceneMeshOffsets.data(), sizeof(GLint) * sceneMeshOffsets.size());
+}
+
+// The matrices of this time, and the lights in sceneLights, for sceneAtTime
+int makeSceneAtTime(float time, std::vector<glm::mat4x4>& matrices)
+{
+	int frame = totalFrame;
+
+	if (pipelinedFrame == frame && pipelinedTime == time)
+	{
+		waitJob(pipelinedUpdate);
+		matrices = pipelinedMatrices;
+		sceneLights = pipelinedLights;
+		pipelinedHits++;
+		return -1;
+	}
+
+	if (realtimeAnimation || frame >= (int)precomputedLights.size() || time != (float)frame / videoFPS)
+	{
+		matrices = sceneMatrices(time);
+		makeSceneLights(time);
+		return -1;
+	}
+
+	matrices.assign(precomputedMatrices.begin() + frame * numSceneMeshes, precomputedMatrices.begin() + (frame + 1) * numSceneMeshes);
+	sceneLights = precomputedLights[frame];
+	return frame;
+}
+
+// The matrices of this time, and the lights in sceneLights. Returns the frame of the precomputed ones it used
+// (see --precompute-frames), or -1 if they were made now, because the time is not the time of the frame in the video.
+// With --capture, they are written to the capture with the camera, which cameraPos already is
+int sceneAtTime(float time, std::vector<glm::mat4x4>& matrices)
+{
+	// the camera of a replayed frame was set by runFrameReplay
+	if (replayFrame)
+	{
+		matrices = replayFrame->matrices;
+		sceneLights = replayFrame->lights;
+		return -1;
+	}
+
+	int precomputed = makeSceneAtTime(time, matrices);
+
+	if (capturingFrames)
+		writeCapturedFrame(frameCapture, { totalFrame + 1, time, cameraPos, cameraTarget, cameraUp, cameraFov, matrices, sceneLights });
+
+	return precomputed;
+}
+
+// Start the job that makes the matrices and lights of the frame of totalFrame nextFrame (see pipelineUpdates),
+// after the one before it is done, since they share pipelinedMatrices and pipelinedLights
+void startPipelinedUpdate(int nextFrame)
+{
+	if (!pipelineUpdates || realtimeAnimation || nextFrame < (int)precomputedLights.size())
+		return;
+
+	if (pipelinedUpdate)
+		waitJob(pipelinedUpdate);
+
+	// the time that sceneTime will give that frame, without changing pausedTime
+	int savedFrame = totalFrame;
+	float savedPausedTime = pausedTime;
+	totalFrame = nextFrame;
+	float time = sceneTime();
+	totalFrame = savedFrame;
+	pausedTime = savedPausedTime;
+
+	pipelinedFrame = nextFrame;
+	pipelinedTime = time;
+
+	pipelinedUpdate = addJob("scene update", [time]() {
+		pipelinedMatrices = sceneMatrices(time);
+		makeLights(time, pipelinedLights);
+	});
+}
+
+// The time a file was last changed, or 0 if it is not there
+time_t fileChangeTime(const std::string& fileName)
+{
+	struct stat info;
+	return stat(fileName.c_str(), &info) == 0 ? info.st_mtime : 0;
+}
+
+// The camera of the scene file, if it has one
+void useSceneFileCamera()
+{
+	if (!sceneFile.hasCamera)
+		return;
+
+	cameraStart = sceneFile.cameraPos;
+	cameraTarget = sceneFile.cameraTarget;
+	cameraUp = sceneFile.cameraUp;
+	cameraFov = sceneFile.cameraFov;
+}
+
+bool canDrawInstances();
+
+// true if two instances of the scene file are the same, so one can keep the place of the other
+bool sameSceneInstance(const SceneFileInstance& a, const SceneFileInstance& b)
+{
+	return a.mesh == b.mesh && a.matrix == b.matrix && a.ownMaterial == b.ownMaterial &&
+		a.color == b.color && a.reflectivity == b.reflectivity && a.grid == b.grid;
+}
+
+uint64_t hashSceneInstance(const SceneFileInstance& instance)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, &instance.mesh, sizeof(instance.mesh));
+	hash = hashBytes(hash, &instance.matrix, sizeof(instance.matrix));
+	hash = hashBytes(hash, &instance.color, sizeof(instance.color));
+	return hashBytes(hash, &instance.reflectivity, sizeof(instance.reflectivity));
+}
+
+// Make the instances of the scene file the ones of next while the program runs (--incremental-tlas). An instance
+// that is the same as one before keeps its place in sceneInstances, and with it its leaf of the TLAS. The places of
+// the ones that are gone are left empty (mesh -1, which buildTLAS leaves out) for the new ones, which go there or
+// at the end, as long as the buffers have room for them (instanceCapacity)
+void editSceneInstances(const std::vector<SceneFileInstance>& next)
+{
+	std::unordered_multimap<uint64_t, int> before;
+
+	for (size_t i = 0; i < sceneFile.instances.size(); i++)
+	{
+		if (sceneFileInstances[i] >= 0)
+			before.emplace(hashSceneInstance(sceneFile.instances[i]), (int)i);
+	}
+
+	std::vector<int> places(next.size(), -1);
+	std::vector<bool> kept(sceneFile.instances.size(), false);
+
+	for (size_t i = 0; i < next.size(); i++)
+	{
+		auto same = before.equal_range(hashSceneInstance(next[i]));
+
+		for (auto it = same.first; it != same.second; ++it)
+		{
+			if (kept[it->second] || !sameSceneInstance(sceneFile.instances[it->second], next[i]))
+				continue;
+
+			kept[it->second] = true;
+			places[i] = sceneFileInstances[it->second];
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < sceneFile.instances.size(); i++)
+	{
+		if (sceneFileInstances[i] >= 0 && !kept[i])
+			sceneInstances[sceneFileInstances[i]].mesh = -1;
+	}
+
+	// the empty places, from this change and the ones before it
+	std::vector<int> empty;
+	for (int i = (int)sceneInstances.size() - 1; i >= 0; i--)
+	{
+		if (sceneInstances[i].mesh < 0)
+			empty.push_back(i);
+	}
+
+	int leftOut = 0;
+
+	for (size_t i = 0; i < next.size(); i++)
+	{
+		if (places[i] >= 0)
+			continue;
+
+		if (next[i].mesh < 0 || next[i].mesh >= numSceneMeshes)
+		{
+			leftOut++;
+			continue;
+		}
+
+		if (!empty.empty())
+		{
+			places[i] = empty.back();
+			empty.pop_back();
+		}
+		else if (numSceneMeshes + (int)sceneInstances.size() < instanceCapacity)
+		{
+			places[i] = (int)sceneInstances.size();
+			sceneInstances.push_back(SceneInstance());
+		}
+		else
+		{
+			leftOut++;
+			continue;
+		}
+
+		SceneInstance& place = sceneInstances[places[i]];
+		place.mesh = next[i].mesh;
+		place.matrix = next[i].matrix;
+		place.ownMaterial = next[i].ownMaterial;
+		place.color = next[i].color;
+		place.reflectivity = next[i].reflectivity;
+		place.grid = next[i].grid;
+	}
+
+	sceneFileInstances = places;
+
+	if (leftOut > 0)
+	{
+		std::cout << leftOut << " instances of " << sceneFileName << " are left out, because their mesh is not in the scene, or there is no room for "
+			<< "more than " << instanceRoom << " instances more than at the start (see --incremental-tlas)" << std::endl;
+	}
+}
+
+// Called once per frame with --scene. The file is only looked at twice a second, and when it has changed,
+// only what changed is used from the next frame on. The camera, the lights, the places of the models and
+// instances, and the animation only change what is made every frame anyway (the matrices, the lights, and the
+// TLAS), so the triangles and the BLAS of the meshes stay on the GPU. Other models, or more or fewer instances,
+// would need them made again, so those changes wait for a restart. With --incremental-tlas, instances of the
+// meshes that are there can come and go, because they only change the TLAS
+void updateSceneFile()
+{
+	double now = platformTime();
+
+	if (now - lastSceneFileCheck < 0.5)
+		return;
+
+	lastSceneFileCheck = now;
+
+	time_t changed = fileChangeTime(sceneFileName);
+
+	if (changed == 0 || changed == sceneFileTime)
+		return;
+
+	sceneFileTime = changed;
+
+	SceneFile next;
+
+	if (!loadSceneFile(sceneFileName, objColor, objReflectivity, next))
+	{
+		std::cout << "the scene is not changed until " << sceneFileName << " can be read" << std::endl;
+		return;
+	}
+
+	bool sameModels = next.gltfFiles == sceneFile.gltfFiles && next.models.size() == sceneFile.models.size();
+
+	for (size_t i = 0; sameModels && i < next.models.size(); i++)
+	{
+		sameModels = next.models[i].file == sceneFile.models[i].file && next.models[i].primitive == sceneFile.models[i].primitive &&
+			next.models[i].color == sceneFile.models[i].color &&
+			next.models[i].reflectivity == sceneFile.models[i].reflectivity;
+	}
+
+	bool sameMeshes = sameModels && next.instances.size() == sceneFile.instances.size();
+
+	for (size_t i = 0; sameMeshes && i < next.instances.size(); i++)
+		sameMeshes = next.instances[i].mesh == sceneFile.instances[i].mesh;
+
+	// the job of the next frame reads the lights and the places, and made them from the old file
+	if (pipelinedUpdate)
+		waitJob(pipelinedUpdate);
+
+	pipelinedFrame = -1;
+
+	std::string changes;
+	bool moved = false;
+
+	if (next.hasCamera != sceneFile.hasCamera || next.cameraPos != sceneFile.cameraPos || next.cameraTarget != sceneFile.cameraTarget ||
+		next.cameraUp != sceneFile.cameraUp || next.cameraFov != sceneFile.cameraFov)
+	{
+		sceneFile.hasCamera = next.hasCamera;
+		sceneFile.cameraPos = next.cameraPos;
+		sceneFile.cameraTarget = next.cameraTarget;
+		sceneFile.cameraUp = next.cameraUp;
+		sceneFile.cameraFov = next.cameraFov;
+		useSceneFileCamera();
+		changes += " the camera";
+	}
+
+	if (next.hasLights != sceneFile.hasLights || next.lights.size() != sceneFile.lights.size() ||
+		memcmp(next.lights.data(), sceneFile.lights.data(), sizeof(light) * next.lights.size()) != 0)
+	{
+		sceneFile.hasLights = next.hasLights;
+		sceneFile.lights = next.lights;
+		changes += " the lights";
+		moved = true;
+	}
+
+	if (sameMeshes)
+	{
+		bool placed = false;
+
+		for (size_t i = 0; i < next.models.size(); i++)
+		{
+			if (next.models[i].matrix == sceneFile.models[i].matrix)
+				continue;
+
+			sceneFile.models[i].matrix = next.models[i].matrix;
+			placed = true;
+
+			if (sceneFileMeshes[i] >= 0)
+				meshPlacements[sceneFileMeshes[i]] = next.models[i].matrix;
+		}
+
+		// the instances that are copies of their mesh cannot move
+		for (size_t i = 0; i < next.instances.size(); i++)
+		{
+			const SceneFileInstance& instance = next.instances[i];
+			SceneFileInstance& before = sceneFile.instances[i];
+
+			if (instance.matrix == before.matrix && instance.ownMaterial == before.ownMaterial &&
+				instance.color == before.color && instance.reflectivity == before.reflectivity && instance.grid == before.grid)
+				continue;
+
+			before = instance;
+			placed = true;
+
+			if (sceneFileInstances[i] >= 0)
+			{
+				SceneInstance& place = sceneInstances[sceneFileInstances[i]];
+				place.matrix = instance.matrix;
+				place.ownMaterial = instance.ownMaterial;
+				place.color = instance.color;
+				place.reflectivity = instance.reflectivity;
+				place.grid = instance.grid;
+			}
+		}
+
+		if (placed)
+		{
+			changes += " the places";
+			moved = true;
+		}
+	}
+	else if (sameModels && incrementalTLAS && canDrawInstances())
+	{
+		editSceneInstances(next.instances);
+		sceneFile.instances = next.instances;
+		sameMeshes = true;
+		changes += " the instances";
+		moved = true;
+	}
+
+	if (next.hasAnimation != sceneFile.hasAnimation || !sameAnimation(next.animation, sceneFile.animation))
+	{
+		sceneFile.hasAnimation = next.hasAnimation;
+		sceneFile.animation = next.animation;
+
+		// without tracks in the scene file, the meshes move the way they did without it
+		sceneAnimation = AnimationTracks();
+		if (sceneFile.hasAnimation)
+			sceneAnimation = sceneFile.animation;
+		else if (!animationFile.empty())
+			loadAnimation(animationFile, sceneAnimation);
+
+		changes += " the animation";
+		moved = true;
+	}
+
+	// The frames of --precompute-frames have the old lights and matrices, so the frames are made as they are
+	// rendered from now on. The shadow cache does not know about the instances, so it starts again
+	if (moved)
+	{
+		precomputedMatrices.clear();
+		precomputedLights.clear();
+		shadowCacheMatrices.clear();
+	}
+
+	// a new camera is not always a new cameraPos, which is all that --accumulate looks at,
+	// and the instances that changed are not in the hash of --dedupe-frames
+	if (!changes.empty())
+	{
+		accumulatedSamples = 0;
+		sceneFileChanges++;
+	}
+
+	if (!sameMeshes)
+		std::cout << sceneFileName << " has other models or instances, which are only made again after a restart" << std::endl;
+
+	std::cout << sceneFileName << " changed:" << (changes.empty() ? " nothing that can change while the program runs" : changes) << std::endl;
+}
+
+// Make the matrices and lights of every frame of the video (--precompute-frames), with a job for each frame,
+// and upload the matrices into frameMatrixBuffer. The CPU renderer has no GPU, so it only keeps them
+void precomputeFrameScenes()
+{
+	PROFILE_ZONE("precomputeFrameScenes");
+
+	double start = platformTime();
+
+	precomputedMatrices.assign((size_t)maxFrames * numSceneMeshes, glm::mat4());
+	precomputedLights.assign(maxFrames, std::vector<light>());
+
+	parallelJobs("precompute frame", maxFrames, [](int frame) {
+		float time = (float)frame / videoFPS;
+		std::vector<glm::mat4x4> matrices = sceneMatrices(time);
+		std::copy(matrices.begin(), matrices.end(), precomputedMatrices.begin() + (size_t)frame * numSceneMeshes);
+		makeLights(time, precomputedLights[frame]);
+	});
+
+	if (!cpuRender)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		frameMatrixStride = (matrixBufferSize + alignment - 1) / alignment * alignment;
+
+		// every slice is copied into its place, so the buffer is made once with all of them
+		std::vector<char> slices(frameMatrixStride * maxFrames);
+
+		for (int frame = 0; frame < maxFrames; frame++)
+			memcpy(&slices[frameMatrixStride * frame], &precomputedMatrices[(size_t)frame * numSceneMeshes], matrixBufferSize);
+
+		glGenBuffers(1, &frameMatrixBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, frameMatrixBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, frameMatrixBuffer, slices.size(), slices.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	std::cout << "precomputed " << maxFrames << " frames in " << (platformTime() - start) * 1000.0 << " ms, "
+		<< frameMatrixStride * maxFrames / (1024.0 * 1024.0) << " MB of matrices on the GPU" << std::endl;
+}
+
+// Move the triangles of every mesh that moved by the matrices (see renderScene), into compToFrag and the buffers next to it,
+// and build the acceleration structure over them. precomputed is the frame of the matrices in frameMatrixBuffer, or -1
+void transformScene(const std::vector<glm::mat4x4>& test, int precomputed)
+{
+	bool useTiles = useTiledRender && !useWavefront;
+	bool useVisibility = useVisibilityBuffer && !useWavefront && !useTiles;
+
+	// Which meshes moved since compToFrag was made. If none of them did, compToFrag is already right
+	std::vector<bool> dirty(numSceneMeshes, true);
+	int numDirty = numSceneMeshes;
+
+	if (dirtyTracking && (int)transformedMatrices.size() == numSceneMeshes)
+	{
+		numDirty = 0;
+
+		for (int m = 0; m < numSceneMeshes; m++)
+		{
+			dirty[m] = test[m] != transformedMatrices[m] || (skinsMoved && meshSkins[m].x >= 0);
+			numDirty += dirty[m] ? 1 : 0;
+		}
+	}
+
+	if ((accelBackend != ACCEL_TWO_LEVEL || useVisibility || useTiles) && numDirty > 0)
+	{
+		glUseProgram(transform_program);
+
+		if (precomputed >= 0)
+		{
+			// the slice of this frame is already on the GPU
+		}
+		else if (persistentUploads)
+		{
+			memcpy(beginUpload(matrixRing, matrixBufferSize), test.data(), matrixBufferSize);
+		}
+		else
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, matrixBuffer);
+			gpuBufferData(GL_UNIFORM_BUFFER, matrixBuffer, matrixBufferSize, test.data(), GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE); // static because CPU won't touch it
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+
+		// Empty the box of every mesh, so that the atomicMin and atomicMax in Compute.glsl
+		// start from nothing. 0xFFFFFFFF is the biggest possible min, and 0 is the smallest possible max
+		// Only the boxes of the meshes that moved are emptied, one glBufferSubData for every run of them
+		std::vector<GLuint> emptyBoxes(numSceneMeshes * 8, 0);
+		for (int m = 0; m < numSceneMeshes; m++)
+			emptyBoxes[m * 8 + 0] = emptyBoxes[m * 8 + 1] = emptyBoxes[m * 8 + 2] = 0xFFFFFFFF;
+
+		gpuRead("mesh box clear", { { RES_MESH_BOXES, GL_BUFFER_UPDATE_BARRIER_BIT } });
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBoxBuffer);
+
+		for (int m = 0; m < numSceneMeshes;)
+		{
+			int end = m;
+			while (end < numSceneMeshes && dirty[end])
+				end++;
+
+			if (end > m)
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 8 * m, sizeof(GLuint) * 8 * (end - m), &emptyBoxes[m * 8]);
+
+			m = end + 1;
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, triangleRecordBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sceneVertexBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, sceneIndexBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, worldVertexBuffer);
+		if (precomputed >= 0)
+			glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, frameMatrixBuffer, frameMatrixStride * precomputed, matrixBufferSize);
+		else if (persistentUploads)
+			bindUpload(matrixRing, 2, matrixBufferSize);
+		else
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, matrixBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, meshBoxBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, meshOffsetBuffer);
+		glUniform1i(transform_numVertices_loc, (int)sceneVertices.size());
+		glUniform1i(transform_numTriangles_loc, bvhNumTriangles);
+		glUniform1i(transform_numMeshes_loc, numSceneMeshes);
+		glUniform1i(transform_skinning_loc, !skinnedMeshes.empty());
+		glUniform1i(transform_meshSpace_loc, 0);
+
+		// skinBLAS wrote the same vertices a moment ago
+		if (!skinnedMeshes.empty())
+		{
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 32, meshSkinBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 33, vertexSkinBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 34, jointMatrixBuffer);
+			gpuRead("transform", { { RES_SKINNED_BLAS, GL_SHADER_STORAGE_BARRIER_BIT } });
+		}
+
+		// The keys are only made when every triangle is moved, and the BVH is built again. A refit keeps
+		// the sorted keys of the last build, so they must not be written over
+		if (fusedMorton && accelBackend == ACCEL_BVH && numDirty == numSceneMeshes)
+		{
+			bvhBuildStarted = true;
+			bvhKeysFused = startBVHBuild();
+
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bvhScratchBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bvhKeyBuffer);
+		}
+
+		glUniform1i(transform_emitKeys_loc, bvhKeysFused);
+
+		if (numDirty == numSceneMeshes)
+		{
+			glUniform1i(transform_dirtyOnly_loc, 0);
+			runTransformPasses(transform_pass_loc, transform_numJobs_loc, (int)sceneVertices.size(), bvhNumTriangles, transformGroupSize);
+		}
+		else
+		{
+			std::vector<glm::ivec4> dirtyList = makeDirtyList(dirty, sceneMeshOffsets, sceneVertexOffsets);
+
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, dirtyMeshBuffer);
+			gpuBufferData(GL_SHADER_STORAGE_BUFFER, dirtyMeshBuffer, sizeof(glm::ivec4) * dirtyList.size(), dirtyList.data(), GL_STREAM_DRAW, GPU_MEMORY_UPLOAD);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, dirtyMeshBuffer);
+
+			glUniform1i(transform_dirtyOnly_loc, 1);
+			glUniform1i(transform_numDirty_loc, numDirty);
+			runTransformPasses(transform_pass_loc, transform_numJobs_loc, dirtyList.back().y, dirtyList.back().z, transformGroupSize);
+		}
+
+		gpuWrote({ RES_TRIANGLES, RES_MESH_BOXES });
+		transformedMatrices = test;
+
+		if (bvhKeysFused)
+			gpuWrote({ RES_BVH_SCRATCH });
+
+		// build the acceleration structure over the triangles that were just transformed.
+		// Brute force and the mesh boxes only need the transform to be finished,
+		// which the renderer waits for when it reads them
+		if (accelBackend == ACCEL_BVH)
+			buildSceneBVH();
+		else if (accelBackend == ACCEL_GRID)
+			buildSceneGrid();
+	}
+}
+
+// Swap the buffers that the transform writes, and what is known of them, with the ones of the other set
+void swapTransformSet(TransformSet& set)
+{
+	std::swap(compToFrag, set.compToFrag);
+	std::swap(triangleRecordBuffer, set.triangleRecordBuffer);
+	std::swap(worldVertexBuffer, set.worldVertexBuffer);
+	std::swap(meshBoxBuffer, set.meshBoxBuffer);
+	std::swap(bvhNodeBuffer, set.bvhNodeBuffer);
+	std::swap(bvhScratchBuffer, set.bvhScratchBuffer);
+	std::swap(bvhKeyBuffer, set.bvhKeyBuffer);
+	std::swap(bvhLinkBuffer, set.bvhLinkBuffer);
+	std::swap(bvhBuildCost, set.bvhBuildCost);
+	std::swap(bvhBuilt, set.bvhBuilt);
+	std::swap(bvhLastWasBuild, set.bvhLastWasBuild);
+	transformedMatrices.swap(set.transformedMatrices);
+}
+
+// Make the second set of the buffers, the same sizes as the ones made in init
+void makeTransformSet(TransformSet& set)
+{
+	auto makeBuffer = [](GLuint& buffer, GLsizeiptr size, GLenum usage, int category) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffer, size, nullptr, usage, category);
+	};
+
+	makeBuffer(set.compToFrag, compToFragSize, GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+	makeBuffer(set.triangleRecordBuffer, triangleRecordBufferSize, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	makeBuffer(set.worldVertexBuffer, sizeof(glm::vec4) * sceneVertices.size(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+	makeBuffer(set.meshBoxBuffer, meshBoxBufferSize, GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+	makeBuffer(set.bvhNodeBuffer, bvhNodeBufferSize, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	makeBuffer(set.bvhScratchBuffer, bvhScratchBufferSize, GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+	makeBuffer(set.bvhKeyBuffer, bvhKeyBufferSize, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	makeBuffer(set.bvhLinkBuffer, bvhLinkBufferSize, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Send the transform of the frame of totalFrame nextFrame into the spare set, after the draw of this frame
+// (see --overlap-transform). Its matrices are the ones that sceneAtTime will give it, which with --pipeline-updates
+// waits for the job that was just started
+void transformNextFrame(int nextFrame)
+{
+	// what this frame left behind is put back after
+	int savedFrame = totalFrame;
+	float savedPausedTime = pausedTime;
+	int savedHits = pipelinedHits;
+	std::vector<light> savedLights = sceneLights;
+	totalFrame = nextFrame;
+
+	std::vector<glm::mat4x4> matrices;
+	int precomputed = sceneAtTime(sceneTime(), matrices);
+
+	totalFrame = savedFrame;
+	pausedTime = savedPausedTime;
+	pipelinedHits = savedHits;
+	sceneLights = savedLights;
+
+	swapTransformSet(spareTransform);
+	transformScene(matrices, precomputed);
+	swapTransformSet(spareTransform);
+
+	// the slice of the matrices is read by the passes that were just sent
+	if (persistentUploads)
+		endUpload(matrixRing);
+}
+
+// The title of the window of --ui-thread, which the main thread sets the next time it wakes up
+void setUiTitle(const char* title)
+{
+	std::lock_guard<std::mutex> lock(uiMutex);
+	uiTitle = title;
+	uiTitleChanged = true;
+}
+
+void renderScene()
+{
+	PROFILE_ZONE("renderScene");
+
+	// the messages of the driver from now on come in this frame
+	setGlDebugFrame(totalFrame);
+
+	// Used for FPS
+	dtime = platformTime();
+	totalTime = dtime;
+
+	// Every second, basically.
+	if (dtime - timebase > 1)
+	{
+		// Calculate the FPS and set the window title to display it.
+		// (the time is not rounded down first, or 1.9 seconds would count as 1)
+		fps = (int)(tempFrame / (dtime - timebase));
+		timebase = dtime;
+		tempFrame = 0;
+
+		// (into a buffer on the stack, so that the frame does not allocate)
+		char title[200];
+		int length = sprintf(title, "FPS: %d Frame: %d / %d", fps, totalFrame, maxFrames);
+
+		// and the render size that --target-ms picked
+		if (targetFrameMs > 0.0f)
+			sprintf(title + length, " Render: %dx%d", width, height);
+
+		// the context of --egl has no window, and the window of --ui-thread is the main thread's
+		if (uiThread)
+			setUiTitle(title);
+		else if (window != nullptr)
+			glfwSetWindowTitle(window, title);
+	}
+
+	beginFrameTimer();
+	startResolutionTimer();
+
+	// set camera position
+	cameraPos = cameraStart;
+
+	float time = sceneTime();
+
+	//=================================================================
+
+	// start using transform program
+	glUseProgram(transform_program);
+
+	std::vector<glm::mat4x4> test;
+	int precomputed = sceneAtTime(time, test);
+
+	// the joints of the skinned meshes, and their boxes, which the TLAS is built around
+	if (!skinnedMeshes.empty())
+		updateSkins(time);
+
+	// The compute renderer copies its image to the screen itself, so it does not add to the average
+	bool accumulating = accumulateSamples > 0 && !(useTiledRender && !useWavefront);
+
+	if (accumulating)
+	{
+		if (!sameAccumulationScene(test) || skinsMoved)
+			accumulatedSamples = 0;
+
+		// the average has every sample it needs, so the frame would only be the same again
+		if (accumulatedSamples >= accumulateSamples && accumWidth == width && accumHeight == height)
+		{
+			markFrameTimer(FRAME_TIMER_SCENE);
+			presentAccumulation();
+			markFrameTimer(FRAME_TIMER_DRAW);
+			endResolutionTimer();
+
+			tempFrame++;
+			totalFrame++;
+			return;
+		}
+
+		cameraJitter = accumulationJitter(accumulatedSamples);
+	}
+
+	if (accelBackend == ACCEL_TWO_LEVEL)
+	{
+		// where the meshes are when the shutter closes
+		if (motionBlur)
+			shutterMatrices = sceneMatrices(time + motionShutter / videoFPS);
+
+		// The triangles stay where they are, only the TLAS is rebuilt
+		buildTLAS(test.data(), numSceneMeshes);
+	}
+
+	// The visibility buffer rasterizes the triangles in the world, and the compute renderer
+	// loads them into shared memory, so they are needed even when the two-level BVH does not use them
+	bool useTiles = useTiledRender && !useWavefront;
+	bool useVisibility = useVisibilityBuffer && !useWavefront && !useTiles;
+
+	// the triangles of this frame were already moved after the draw of the frame before (see --overlap-transform)
+	if (overlapTransform && transformedMatrices != test && spareTransform.transformedMatrices == test)
+	{
+		swapTransformSet(spareTransform);
+		overlappedFrames++;
+	}
+	else
+		transformScene(test, precomputed);
+
+	markFrameTimer(FRAME_TIMER_SCENE);
+
+	// Everything that the renderers read from the passes before them
+	auto sceneReads = {
+		GpuRead{ RES_TRIANGLES, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_MESH_BOXES, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_BVH, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_GRID, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_INSTANCE_GRID, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_TILE_LIGHTS, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_SHADOW_CACHE, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_LIGHT_OCCLUDERS, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_SKINNED_BLAS, GL_SHADER_STORAGE_BARRIER_BIT },
+		GpuRead{ RES_IRRADIANCE, GL_SHADER_STORAGE_BARRIER_BIT } };
+
+	if (useShadowCache)
+		updateShadowCache(test);
+
+	//=================================================================
+
+	// start using draw program
+	glUseProgram(draw_program);
+
+	uploadLights();
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, triangleRecordBuffer);
+	if (persistentUploads)
+		bindUpload(lightRing, 1, lightToFragSize);
+	else
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lightToFrag);
+	if (lightUniforms && persistentUploads)
+		bindUniformUpload(lightRing, LIGHT_UNIFORM_BINDING, sizeof(light) * lightUniformCount);
+	else if (lightUniforms)
+		glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_UNIFORM_BINDING, lightToFrag, 0, sizeof(light) * lightUniformCount);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bvhNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, triangleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, twoLevelNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, wideNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, meshBoxBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, gridBuffer);
+
+	if (useInstanceGrid)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_GRID_BINDING, instanceGridBuffer);
+
+	// the lights have to be in their buffer first, and the wavefront renderer has no lists
+	if (lightOccluders > 0 && !useWavefront)
+		buildLightOccluders();
+
+	// a few of the probes see the scene of this frame, before the renderers read them
+	if (irradianceProbes > 0)
+	{
+		gpuRead("irradiance probes", sceneReads);
+		updateIrradianceProbes(test);
+	}
+
+	// With --dirty-rects, the quad is only drawn in these rectangles (see findDirtyRects)
+	std::vector<glm::ivec4> dirtyRectList;
+	bool traceDirtyOnly = false;
+
+	if (useWavefront)
+	{
+		makeWavefrontBuffers();
+		makeWavefrontPrograms();
+
+		glUseProgram(wavefront_program);
+		glUniform1i(wave_accel_loc, accelBackend);
+		glUniform1i(wave_wideBLAS_loc, blasNodeFormat == BVH_FORMAT_WIDE4);
+		glUniform1i(wave_numLights_loc, (int)sceneLights.size());
+
+		// the camera block is the same for every program
+		calcCameraRays(cameraPos, cameraTarget, cameraUp, cameraFov, (float)width / height);
+		setPathUniforms();
+
+		gpuRead("wavefront", sceneReads);
+		traceWavefront();
+
+		// Now draw the quad with the program that adds up the colors of every pixel.
+		// It reads what the compute shaders wrote, so it has to wait for them
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUseProgram(resolve_program);
+		glUniform1i(resolve_imageWidth_loc, width);
+	}
+	else
+	{
+		if (tiledLightCulling)
+		{
+			// the light cull program needs the same camera as the fragment shader
+			glUseProgram(light_cull_program);
+			calcCameraRays(cameraPos, cameraTarget, cameraUp, cameraFov, (float)width / height);
+			cullTileLights();
+			glUseProgram(draw_program);
+		}
+
+		if (useTiles)
+		{
+			makeTiledRenderProgram();
+			glUseProgram(tiled_render_program);
+			glUniform1i(tiled_accel_loc, accelBackend);
+			glUniform1i(tiled_wideBLAS_loc, blasNodeFormat == BVH_FORMAT_WIDE4);
+			glUniform1i(tiled_numLights_loc, (int)sceneLights.size());
+			glUniform1i(tiled_tiledLights_loc, tiledLightCulling);
+			glUniform1i(tiled_countRays_loc, countingRays);
+			glUniform1i(tiled_tilesX_loc, (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE);
+
+			// the same camera block as the draw program
+			calcCameraRays(cameraPos, cameraTarget, cameraUp, cameraFov, (float)width / height);
+			setPathUniforms();
+
+			gpuRead("tiled render", sceneReads);
+			traceTiles();
+		}
+		else
+		{
+			glUniform1i(accel_loc, accelBackend);
+			glUniform1i(wideBLAS_loc, blasNodeFormat == BVH_FORMAT_WIDE4);
+			glUniform1i(numLights_loc, (int)sceneLights.size());
+			glUniform1i(tiledLights_loc, tiledLightCulling);
+			glUniform1i(countRays_loc, countingRays);
+			glUniform1i(costView_loc, costView);
+			glUniform1f(costScale_loc, costScale);
+			glUniform1i(tilesX_loc, (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE);
+			glUniform1i(visibilityBuffer_loc, useVisibility);
+
+			// the ray cones of the floor texture open by the angle of a pixel (the field of view is 45 degrees)
+			if (floorTexture)
+			{
+				glUniform1f(floorTextureScale_loc, floorTextureScale);
+				glUniform1f(pixelSpread_loc, glm::radians(cameraFov) / (stillHeight > 0 ? stillHeight : height));
+
+				if (floorTextureHandle)
+					glUniformHandleui64ARB(floorTexture_loc, floorTextureHandle);
+				else
+				{
+					glActiveTexture(GL_TEXTURE6);
+					glBindTexture(GL_TEXTURE_2D, floorTexture);
+					glActiveTexture(GL_TEXTURE0);
+				}
+			}
+
+			// Call the function we created to calculate the corner rays.
+			// We use the camera position, the focus position, and the up direction (just like glm::lookAt)
+			// We use Field of View, and aspect ratio (just like glm::perspective)
+			calcCameraRays(cameraPos, cameraTarget, cameraUp, cameraFov, (float)width / height);
+			setPathUniforms();
+
+			// the probes have cameras of their own, so the one of the frame is written again after them
+			if (reflectionProbes > 0)
+			{
+				gpuRead("reflection probes", sceneReads);
+
+				if (updateReflectionProbes(test))
+					calcCameraRays(cameraPos, cameraTarget, cameraUp, cameraFov, (float)width / height);
+			}
+
+			// which needs the camera of this frame
+			if (dirtyRects)
+				traceDirtyOnly = findDirtyRects(test, dirtyRectList);
+
+			if (useVisibility)
+				drawVisibilityBuffer();
+
+			if (useHitBuffer)
+				drawHitBuffer();
+
+			if (useTemporal)
+				setTemporalHistory(test);
+
+			if (reflectionScale > 1)
+				drawReducedReflections();
+
+			gpuRead("fragment shader", sceneReads);
+
+			// the grid reads the scene too, and the pixels read the grid
+			if (shadowScale > 1)
+				drawReducedShadows();
+		}
+	}
+
+	// Draw an image on the screen.
+	// The compute renderer already copied its image to the screen, so it has no quad to draw
+	// With --accumulate, the quad goes into the average instead
+	if (accumulating)
+		accumulateFrame();
+	else if (useTemporal)
+		drawTemporalFrame(test);
+	else if (!useTiles && regionWidth > 0)
+	{
+		// the region is in the pixels of the output from the top, and the framebuffer is the render size from the bottom
+		float scaleX = (float)width / outputWidth;
+		float scaleY = (float)height / outputHeight;
+		int left = (int)(regionX * scaleX);
+		int right = (int)std::ceil((regionX + regionWidth) * scaleX);
+		int bottom = (int)((outputHeight - regionY - regionHeight) * scaleY);
+		int top = (int)std::ceil((outputHeight - regionY) * scaleY);
+
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(left, bottom, right - left, top - bottom);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glDisable(GL_SCISSOR_TEST);
+	}
+	else if (!useTiles && traceDirtyOnly)
+	{
+		// the pixels outside of the rectangles are still the ones of the frame before
+		glEnable(GL_SCISSOR_TEST);
+
+		for (const glm::ivec4& rect : dirtyRectList)
+		{
+			glScissor(rect.x, rect.y, rect.z, rect.w);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			dirtyPixelsTraced += (double)std::min(rect.z, width - rect.x) * std::min(rect.w, height - rect.y);
+		}
+
+		glDisable(GL_SCISSOR_TEST);
+		dirtyPixelsTotal += (double)width * height;
+	}
+	else if (!useTiles && sliceBudgetMs > 0.0f)
+	{
+		// the bands only go as far as the strip of the CPU, in a hybrid frame
+		drawQuadInSlices(hybridDrawRows > 0 ? hybridDrawRows : height);
+
+		if (dirtyRects)
+		{
+			dirtyPixelsTraced += (double)width * height;
+			dirtyPixelsTotal += (double)width * height;
+		}
+	}
+	else if (!useTiles)
+	{
+		// a hybrid frame only draws the rows under the strip of the CPU
+		if (hybridDrawRows > 0)
+		{
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(0, 0, width, hybridDrawRows);
+		}
+
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		glDisable(GL_SCISSOR_TEST);
+
+		if (dirtyRects)
+		{
+			dirtyPixelsTraced += (double)width * height;
+			dirtyPixelsTotal += (double)width * height;
+		}
+	}
+
+	if (denoisePasses > 0 && !accumulating)
+		denoiseFrame();
+
+	if (countingRays)
+		gpuWrote({ RES_RAY_COUNTS });
+
+	if (useShadowCache)
+		gpuWrote({ RES_SHADOW_CACHE });
+
+	markFrameTimer(FRAME_TIMER_DRAW);
+
+	// every command that reads this frame's matrices and lights was sent
+	if (persistentUploads)
+	{
+		endUpload(matrixRing);
+		endUpload(lightRing);
+	}
+
+	// only the first frame is traced, the others are the same
+	if (traceBarriers)
+	{
+		std::cout << gpuBarrierCount << " barriers from the pass dependencies in the first frame" << std::endl;
+		traceBarriers = false;
+	}
+
+	endResolutionTimer();
+
+	// help us keep track of FPS
+	tempFrame++;
+	totalFrame++;
+}
+
+// Start the CPU frame of totalFrame, at the time in totalTime: the matrices, lights, camera, and path uniforms
+// are the same as the ones renderScene makes, and a job builds the scene from them
+void prepareCpuFrame(CpuFrame& frame)
+{
+	cameraPos = cameraStart;
+
+	float time = sceneTime();
+	std::vector<glm::mat4x4> matrices;
+	sceneAtTime(time, matrices);
+	std::vector<light> lights = sceneLights;
+
+	frame.camera = makeCameraView(cameraPos, cameraTarget, cameraUp, cameraFov, (float)outputWidth / outputHeight);
+
+	// the same as setPathUniforms
+	frame.path.maxBounces = maxBounces;
+	frame.path.throughputEpsilon = throughputEpsilon;
+	frame.path.russianRoulette = russianRoulette;
+	frame.path.rouletteThreshold = rouletteThreshold;
+	frame.path.frameSeed = (unsigned int)totalFrame;
+	frame.path.lodShadowsFrom = lodShadowsFrom;
+	frame.path.lodSpecularFrom = lodSpecularFrom;
+
+	CpuScene* scene = &frame.scene;
+	int kernel = cpuKernel;
+
+	frame.built = addJob("build cpu scene", [scene, matrices, lights, kernel]() {
+		buildCpuScene(sceneTriangles, sceneMeshOffsets, matrices, lights, *scene);
+		scene->kernel = kernel;
+	});
+}
+
+// Trace rows firstRow to lastRow - 1 of a CPU frame into pixels, once its scene is built. pixels then have the same
+// bytes as what glReadPixels gives for the other renderers
+void traceCpuFrame(CpuFrame& frame, unsigned char* pixels, int firstRow, int lastRow)
+{
+	waitJob(frame.built);
+	frame.built = nullptr;
+
+	renderCpuFrame(frame.scene, frame.camera, frame.path, outputWidth, outputHeight, firstRow, lastRow, pixels);
+}
+
+// Render the frame of totalFrame on the CPU (--cpu-render), all of it, into pixels.
+// Unless the next frame was already started (see the frame loop in main), it is started here
+void renderCpuScene(unsigned char* pixels)
+{
+	PROFILE_ZONE("renderCpuScene");
+
+	CpuFrame& frame = cpuFrames[currentCpuFrame];
+
+	if (!frame.built)
+	{
+		totalTime = platformTime();
+		prepareCpuFrame(frame);
+	}
+
+	traceCpuFrame(frame, pixels, 0, outputHeight);
+
+	totalFrame++;
+}
+
+// Render a frame with --hybrid: the commands of the GPU for the rows under the strip are sent first,
+// and while the GPU runs them, the CPU traces the strip into pixels. The rows of the GPU are read
+// into the rest of pixels later (see readBackFrame), so the frame is whole before it is saved
+void renderHybridScene(unsigned char* pixels)
+{
+	PROFILE_ZONE("renderHybridScene");
+
+	hybridDrawRows = outputHeight - hybridCpuRows;
+
+	// the scene of the CPU is built by a job while this thread sends the commands of the GPU.
+	// The time of the video only depends on totalFrame, so both have the same scene
+	totalTime = platformTime();
+	prepareCpuFrame(cpuFrames[0]);
+
+	glBeginQuery(GL_TIME_ELAPSED, hybridTimerQuery);
+	renderScene();
+	glEndQuery(GL_TIME_ELAPSED);
+
+	hybridDrawRows = 0;
+
+	// the GPU starts on the commands now, instead of when something waits for it
+	glFlush();
+
+	double start = platformTime();
+	traceCpuFrame(cpuFrames[0], pixels, outputHeight - hybridCpuRows, outputHeight);
+	hybridCpuSeconds = platformTime() - start;
+}
+
+// After a hybrid frame was read back, move the line between the strip of the CPU and the rows of the GPU so that
+// both would have taken as long as each other. The rows that each did in a second is how fast it is, and the CPU
+// gets its part of the rows. The fixed costs of each (the transform and the BVH) are in their times too, so where it
+// settles is where both take the same time. It only moves halfway each frame, so that one slow frame does not throw
+// it far off, and each side keeps at least one row, so that both can still be timed
+void balanceHybridRows()
+{
+	GLuint64 gpuNanoseconds = 0;
+	{
+		GL_STALL_ZONE("glGetQueryObjectui64v (hybrid)");
+		glGetQueryObjectui64v(hybridTimerQuery, GL_QUERY_RESULT, &gpuNanoseconds);
+	}
+
+	double gpuSeconds = gpuNanoseconds / 1000000000.0;
+	int gpuRows = outputHeight - hybridCpuRows;
+
+	hybridShareSum += (double)hybridCpuRows / outputHeight;
+	hybridFrames++;
+
+	if (gpuSeconds <= 0.0 || hybridCpuSeconds <= 0.0)
+		return;
+
+	double cpuSpeed = hybridCpuRows / hybridCpuSeconds;
+	double gpuSpeed = gpuRows / gpuSeconds;
+	double target = outputHeight * cpuSpeed / (cpuSpeed + gpuSpeed);
+
+	int rows = (int)((hybridCpuRows + target) * 0.5 + 0.5);
+	hybridCpuRows = std::min(std::max(rows, 1), outputHeight - 1);
+}
+
+// Initialization code
+// Make the triangles of the scene, and work out how big every buffer that depends on the scene has to be.
+// This is the only place that knows how many triangles and meshes there are, everything after it
+// (the buffers, the BLAS of every mesh, and the shaders) works with any number of them
+// A random number from 0 to 1. std::uniform_real_distribution is not the same on every compiler,
+// and mt19937 is, so the scene is the same everywhere
+float sceneRandom(std::mt19937& rng)
+{
+	return (rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+// true if the renderer can draw the instances of sceneInstances, and not only the triangles
+bool canDrawInstances()
+{
+	return !expandInstances && accelBackend == ACCEL_TWO_LEVEL && !cpuRender && !hybridRender &&
+		!useVisibilityBuffer && !useTiledRender;
+}
+
+// true if the skinned meshes of --gltf can be moved by their joints (see SkinnedMesh). The CPU renderers have
+// no transform pass, and with --compact-meshes, --geometry-pool, or --async-upload, triangleBuffer is not
+// a plain copy of the triangles that the two-level BVH can write the moved meshes into
+bool canSkinMeshes()
+{
+	return !cpuRender && !hybridRender && !compactMeshes && geometryPoolMB == 0 && !asyncUpload;
+}
+
+// Put a copy of triangles (in the space of their mesh) into the scene, moved by place.matrix, with the color
+// and reflectivity of place if it has its own. mesh is the mesh of the first copy, -1 until there is one:
+// the first copy becomes a new mesh with the matrix moved into its triangles (baked is that matrix), and
+// every other copy is an instance of it, if the renderer can draw them, or a mesh of its own if not
+void placeMesh(const std::vector<triangle>& triangles, SceneInstance place, int& mesh, glm::mat4x4& baked,
+	std::vector<int>& meshTriangleCounts)
+{
+	if (mesh >= 0 && canDrawInstances())
+	{
+		place.mesh = mesh;
+		place.matrix = place.matrix * glm::inverse(baked);
+		sceneInstances.push_back(place);
+		return;
+	}
+
+	if (mesh < 0)
+	{
+		mesh = (int)meshTriangleCounts.size();
+		baked = place.matrix;
+	}
+
+	// normals are moved by the inverse-transpose, since a matrix can scale one axis more than another
+	glm::mat3 turn = glm::transpose(glm::inverse(glm::mat3(place.matrix)));
+
+	for (const triangle& t : triangles)
+	{
+		triangle moved = t;
+		moved.a = glm::vec3(place.matrix * glm::vec4(t.a, 1.0f));
+		moved.b = glm::vec3(place.matrix * glm::vec4(t.b, 1.0f));
+		moved.c = glm::vec3(place.matrix * glm::vec4(t.c, 1.0f));
+		moved.packedNormal = glm::packSnorm2x16(octEncode(glm::normalize(turn * triangleNormal(t))));
+
+		if (place.ownMaterial)
+		{
+			moved.packedRedGreen = glm::packHalf2x16(glm::vec2(place.color.r, place.color.g));
+			moved.packedBlueReflectivity = glm::packHalf2x16(glm::vec2(place.color.b, place.reflectivity));
+		}
+
+		sceneTriangles.push_back(moved);
+	}
+
+	meshTriangleCounts.push_back((int)triangles.size());
+}
+
+// A random place, rotation, size (0.2 to 1), and color for a copy of the cube, in a square of side * side
+void randomCube(std::mt19937& rng, float side, glm::mat4& matrix, glm::vec3& color)
+{
+	float size = 0.2f + 0.8f * sceneRandom(rng);
+	glm::vec3 position = glm::vec3(
+		(sceneRandom(rng) - 0.5f) * side,
+		size * 0.5f + sceneRandom(rng) * sceneOverlap * 0.6f,
+		(sceneRandom(rng) - 0.5f) * side);
+	glm::vec3 axis = glm::normalize(glm::vec3(sceneRandom(rng), sceneRandom(rng), sceneRandom(rng)) + glm::vec3(0.01f));
+	float angle = sceneRandom(rng) * 6.2831853f;
+	color = glm::vec3(sceneRandom(rng), sceneRandom(rng), sceneRandom(rng));
+
+	matrix = glm::translate(glm::mat4(), position);
+	matrix = glm::rotate(matrix, angle, axis);
+	matrix = glm::scale(matrix, glm::vec3(size));
+}
+
+// Add the copies of the cube for --scene-triangles, and the lights for --scene-lights (see generatedTriangles).
+// cube is the 12 triangles of the cube, and the counts of the new meshes go into meshTriangleCounts
+void generateScene(const std::vector<triangle>& cube, std::vector<int>& meshTriangleCounts)
+{
+	std::mt19937 rng(sceneSeed);
+
+	generatedCubes = (generatedTriangles + 11) / 12;
+
+	// The average cube covers about 0.6 x 0.6 of the floor, so this many of them cover
+	// a square of side * side sceneOverlap times. The tutorial cube is in the middle
+	float side = std::max(10.0f, sqrtf((generatedCubes + cubeInstances) * 0.36f / sceneOverlap));
+
+	for (int first = 0; first < generatedCubes; first += GENERATED_CUBES_PER_MESH)
+	{
+		int count = std::min(GENERATED_CUBES_PER_MESH, generatedCubes - first);
+
+		for (int c = 0; c < count; c++)
+		{
+			glm::mat4 matrix;
+			glm::vec3 color;
+			randomCube(rng, side, matrix, color);
+
+			// the matrix has the same scale on every axis, so it turns the normals the same way as the points
+			// (makeTriangle makes them one unit long again)
+			glm::mat3 turn = glm::mat3(matrix);
+
+			for (const triangle& t : cube)
+			{
+				sceneTriangles.push_back(makeTriangle(
+					glm::vec3(matrix * glm::vec4(t.a, 1.0f)),
+					glm::vec3(matrix * glm::vec4(t.b, 1.0f)),
+					glm::vec3(matrix * glm::vec4(t.c, 1.0f)),
+					turn * triangleNormal(t), color, cubeReflectivity));
+			}
+		}
+
+		meshTriangleCounts.push_back(12 * count);
+	}
+
+	generatedLights.clear();
+
+	// with the lights of --lights, there can still only be MAX_LIGHTS
+	int lightCount = std::min(generatedLightCount, MAX_LIGHTS - 2 - numExtraLights);
+
+	for (int i = 0; i < lightCount; i++)
+	{
+		light L;
+		L.pos = glm::vec3((sceneRandom(rng) - 0.5f) * side, 0.5f + sceneRandom(rng) * (1.0f + sceneOverlap * 0.6f), (sceneRandom(rng) - 0.5f) * side);
+		L.radius = 0.5f + 2.5f * sceneRandom(rng);
+		L.color = glm::vec3(sceneRandom(rng), sceneRandom(rng), sceneRandom(rng));
+		L.brightness = 1;
+		generatedLights.push_back(L);
+	}
+
+	// the cubes of --cube-instances are one mesh, and the rest are instances of it with their own colors
+	int instancedCube = -1;
+	glm::mat4x4 baked;
+
+	for (int c = 0; c < cubeInstances; c++)
+	{
+		SceneInstance place;
+		place.ownMaterial = true;
+		place.reflectivity = cubeReflectivity;
+		place.grid = true;
+		randomCube(rng, side, place.matrix, place.color);
+		placeMesh(cube, place, instancedCube, baked, meshTriangleCounts);
+	}
+}
+
+// Put every color and reflectivity of sceneTriangles into sceneMaterials once, and make the triangles point at them
+// (--material-table). Two triangles have the same material when their packed color and reflectivity are the same
+void makeMaterialTable()
+{
+	sceneMaterials.clear();
+	std::map<std::pair<GLuint, GLuint>, GLuint> found;
+
+	for (triangle& t : sceneTriangles)
+	{
+		std::pair<GLuint, GLuint> key(t.packedRedGreen, t.packedBlueReflectivity);
+		auto it = found.find(key);
+
+		if (it == found.end())
+		{
+			glm::vec2 redGreen = glm::unpackHalf2x16(t.packedRedGreen);
+			glm::vec2 blueReflectivity = glm::unpackHalf2x16(t.packedBlueReflectivity);
+
+			material m;
+			m.color = glm::vec3(redGreen, blueReflectivity.x);
+			m.reflectivity = blueReflectivity.y;
+
+			it = found.emplace(key, (GLuint)sceneMaterials.size()).first;
+			sceneMaterials.push_back(m);
+		}
+
+		t.packedRedGreen = it->second;
+		t.packedBlueReflectivity = 0;
+	}
+
+	// the renderers only read it, so it stays bound
+	gpuArenaFree(renderArena, materialRange);
+	materialRange = gpuArenaAlloc(renderArena, sizeof(material) * sceneMaterials.size());
+	gpuArenaBind(renderArena, MATERIAL_BINDING, materialRange);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, renderArena.buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, materialRange.offset, sizeof(material) * sceneMaterials.size(), sceneMaterials.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	std::cout << "the " << sceneTriangles.size() << " triangles have " << sceneMaterials.size() << " materials" << std::endl;
+}
+
+// Add the triangles of a mesh that is a primitive of --analytic to sceneTriangles, around the origin: a square of 1 by 1
+// facing up, a cube of 1, or a sphere of 1 across. The box of the mesh is the box of the shape, which is what
+// intersectPrimitive in RayTracing.glsl tests. The sphere has PRIMITIVE_SPHERE_SLICES around (a multiple of 4,
+// so that it touches the sides of its box), and every triangle has the normal of its middle
+void addPrimitiveTriangles(int primitive, glm::vec3 color, float reflectivity)
+{
+	if (primitive == PRIMITIVE_PLANE)
+	{
+		sceneTriangles.push_back(makeTriangle(glm::vec3(-0.5, 0.0, 0.5), glm::vec3(-0.5, 0.0, -0.5), glm::vec3(0.5, 0.0, -0.5),
+			glm::vec3(0.0, 1.0, 0.0), color, reflectivity));
+		sceneTriangles.push_back(makeTriangle(glm::vec3(-0.5, 0.0, 0.5), glm::vec3(0.5, 0.0, -0.5), glm::vec3(0.5, 0.0, 0.5),
+			glm::vec3(0.0, 1.0, 0.0), color, reflectivity));
+		return;
+	}
+
+	if (primitive == PRIMITIVE_BOX)
+	{
+		// every side is two triangles, from its normal and two axes along it
+		for (int axis = 0; axis < 3; axis++)
+		{
+			for (float side : { -1.0f, 1.0f })
+			{
+				glm::vec3 normal(0.0f);
+				normal[axis] = side;
+				glm::vec3 u(0.0f), v(0.0f);
+				u[(axis + 1) % 3] = 0.5f;
+				v[(axis + 2) % 3] = 0.5f * side;
+
+				glm::vec3 center = normal * 0.5f;
+				sceneTriangles.push_back(makeTriangle(center - u - v, center + u - v, center + u + v, normal, color, reflectivity));
+				sceneTriangles.push_back(makeTriangle(center - u - v, center + u + v, center - u + v, normal, color, reflectivity));
+			}
+		}
+
+		return;
+	}
+
+	auto spherePoint = [](int stack, int slice) {
+		float theta = glm::pi<float>() * stack / PRIMITIVE_SPHERE_STACKS;
+		float phi = glm::two_pi<float>() * slice / PRIMITIVE_SPHERE_SLICES;
+		return 0.5f * glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+	};
+
+	for (int stack = 0; stack < PRIMITIVE_SPHERE_STACKS; stack++)
+	{
+		for (int slice = 0; slice < PRIMITIVE_SPHERE_SLICES; slice++)
+		{
+			glm::vec3 a = spherePoint(stack, slice);
+			glm::vec3 b = spherePoint(stack, slice + 1);
+			glm::vec3 c = spherePoint(stack + 1, slice);
+			glm::vec3 d = spherePoint(stack + 1, slice + 1);
+
+			// the stacks at the poles are one triangle per slice
+			if (stack > 0)
+				sceneTriangles.push_back(makeTriangle(a, b, d, a + b + d, color, reflectivity));
+
+			if (stack < PRIMITIVE_SPHERE_STACKS - 1)
+				sceneTriangles.push_back(makeTriangle(a, d, c, a + d + c, color, reflectivity));
+		}
+	}
+}
+
+// The pieces of --early-split, one for every leaf of the BVH. A triangle is cut until the box of a piece has at most
+// earlySplitArea of the surface area of the box around the scene, and every cut halves the sides of the box, so the
+// area of a piece is about a quarter of the one before. The pieces are decided once, from where the triangles are
+// when the scene is loaded. If they would add more leaves than EARLY_SPLIT_MIN_EXTRA or the number of triangles,
+// the triangles that were cut the most are cut one time less until they fit
+std::vector<glm::uvec2> makeSplitPieces(const std::vector<triangle>& triangles)
+{
+	auto boxArea = [](const AABB& box) {
+		glm::vec3 size = glm::max(box.max - box.min, glm::vec3(0.0f));
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	};
+
+	AABB sceneBox = emptyAABB();
+	std::vector<float> areas(triangles.size());
+
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		AABB box = emptyAABB();
+		growAABB(box, triangles[t].a);
+		growAABB(box, triangles[t].b);
+		growAABB(box, triangles[t].c);
+		growAABB(sceneBox, box);
+		areas[t] = boxArea(box);
+	}
+
+	float limit = earlySplitArea * boxArea(sceneBox);
+	std::vector<int> cuts(triangles.size(), 0);
+
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		for (float area = areas[t]; area > limit && cuts[t] < EARLY_SPLIT_MAX_CUTS; area *= 0.25f)
+			cuts[t]++;
+	}
+
+	auto countPieces = [&](int most) {
+		size_t count = 0;
+		for (int c : cuts)
+			count += (size_t)1 << (2 * std::min(c, most));
+		return count;
+	};
+
+	size_t room = triangles.size() + std::max(triangles.size(), (size_t)EARLY_SPLIT_MIN_EXTRA);
+	int most = EARLY_SPLIT_MAX_CUTS;
+	while (most > 0 && countPieces(most) > room)
+		most--;
+
+	// every path of 2 bits per cut is one piece
+	std::vector<glm::uvec2> pieces;
+	pieces.reserve(countPieces(most));
+
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		int c = std::min(cuts[t], most);
+
+		for (GLuint path = 0; path < (1u << (2 * c)); path++)
+			pieces.push_back(glm::uvec2((GLuint)t, (GLuint)c | (path << 4)));
+	}
+
+	return pieces;
+}
+
+void loadScene()
+{
+	// makeTriangle packs the normal, color, and reflectivity (see SceneStructs.h)
+	glm::vec3 floorColor = glm::vec3(1.0, 1.0, 1.0);
+	glm::vec3 cubeColor = glm::vec3(1.0, 0.5, 0.1);
+
+	std::vector<int> meshTriangleCounts;
+
+	// the floor is a plane and the cube is a box for --analytic, and every mesh after them is not a shape, unless it says so
+	meshPrimitives = { PRIMITIVE_PLANE, PRIMITIVE_BOX };
+
+	// the floor
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-5.0, 0.0, 5.0), glm::vec3(-5.0, 0.0, -5.0), glm::vec3(5.0, 0.0, -5.0),
+		glm::vec3(0.0, 1.0, 0.0), floorColor, floorReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-5.0, 0.0, 5.0), glm::vec3(5.0, 0.0, -5.0), glm::vec3(5.0, 0.0, 5.0),
+		glm::vec3(0.0, 1.0, 0.0), floorColor, floorReflectivity));
+
+	meshTriangleCounts.push_back(2);
+
+	// the cube
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, -0.5), glm::vec3(0.5, -0.5, -0.5), glm::vec3(-0.5, 0.5, -0.5),
+		glm::vec3(0.0, 0.0, -1.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(0.5, -0.5, -0.5), glm::vec3(0.5, 0.5, -0.5), glm::vec3(-0.5, 0.5, -0.5),
+		glm::vec3(0.0, 0.0, -1.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, 0.5), glm::vec3(-0.5, 0.5, 0.5), glm::vec3(0.5, 0.5, 0.5),
+		glm::vec3(0.0, 0.0, 1.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, 0.5), glm::vec3(0.5, 0.5, 0.5), glm::vec3(0.5, -0.5, 0.5),
+		glm::vec3(0.0, 0.0, 1.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(0.5, -0.5, 0.5), glm::vec3(0.5, 0.5, 0.5), glm::vec3(0.5, 0.5, -0.5),
+		glm::vec3(1.0, 0.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(0.5, -0.5, 0.5), glm::vec3(0.5, 0.5, -0.5), glm::vec3(0.5, -0.5, -0.5),
+		glm::vec3(1.0, 0.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, -0.5), glm::vec3(-0.5, 0.5, -0.5), glm::vec3(-0.5, 0.5, 0.5),
+		glm::vec3(-1.0, 0.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, -0.5), glm::vec3(-0.5, 0.5, 0.5), glm::vec3(-0.5, -0.5, 0.5),
+		glm::vec3(-1.0, 0.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, 0.5, 0.5), glm::vec3(-0.5, 0.5, -0.5), glm::vec3(0.5, 0.5, -0.5),
+		glm::vec3(0.0, 1.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, 0.5, 0.5), glm::vec3(0.5, 0.5, -0.5), glm::vec3(0.5, 0.5, 0.5),
+		glm::vec3(0.0, 1.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, 0.5), glm::vec3(-0.5, -0.5, -0.5), glm::vec3(0.5, -0.5, -0.5),
+		glm::vec3(0.0, -1.0, 0.0), cubeColor, cubeReflectivity));
+
+	sceneTriangles.push_back(makeTriangle(
+		glm::vec3(-0.5, -0.5, 0.5), glm::vec3(0.5, -0.5, -0.5), glm::vec3(0.5, -0.5, 0.5),
+		glm::vec3(0.0, -1.0, 0.0), cubeColor, cubeReflectivity));
+	meshTriangleCounts.push_back(12);
+
+	if (generatedTriangles > 0 || generatedLightCount > 0 || cubeInstances > 0)
+	{
+		std::vector<triangle> cube(sceneTriangles.end() - 12, sceneTriangles.end());
+		generateScene(cube, meshTriangleCounts);
+	}
+
+	// every model of the scene file is a mesh of its own too, in the place the file gives it
+	std::vector<glm::mat4x4> placements(meshTriangleCounts.size(), glm::mat4());
+	sceneFileMeshes.assign(sceneFile.models.size(), -1);
+
+	for (size_t i = 0; i < sceneFile.models.size(); i++)
+	{
+		const SceneFileModel& model = sceneFile.models[i];
+		size_t before = sceneTriangles.size();
+
+		if (!model.primitive.empty())
+		{
+			int primitive = model.primitive == "plane" ? PRIMITIVE_PLANE : model.primitive == "box" ? PRIMITIVE_BOX : PRIMITIVE_SPHERE;
+			addPrimitiveTriangles(primitive, model.color, model.reflectivity);
+
+			meshPrimitives.resize(meshTriangleCounts.size(), PRIMITIVE_NONE);
+			meshPrimitives.push_back(primitive);
+			sceneFileMeshes[i] = (int)meshTriangleCounts.size();
+			meshTriangleCounts.push_back((int)(sceneTriangles.size() - before));
+			placements.push_back(model.matrix);
+			continue;
+		}
+
+		bool loaded = isModelFile(model.file) ? loadModel(model.file, sceneTriangles) :
+			loadObj(model.file, model.color, model.reflectivity, sceneTriangles);
+
+		if (!loaded || sceneTriangles.size() == before)
+			continue;
+
+		sceneFileMeshes[i] = (int)meshTriangleCounts.size();
+		meshTriangleCounts.push_back((int)(sceneTriangles.size() - before));
+		placements.push_back(model.matrix);
+		std::cout << "loaded " << sceneTriangles.size() - before << " triangles from " << model.file << std::endl;
+	}
+
+	// every model of --obj is a mesh of its own, and one that cannot be read is left out
+	for (const std::string& fileName : objFiles)
+	{
+		double start = startupSeconds();
+		size_t before = sceneTriangles.size();
+
+		bool loaded = isModelFile(fileName) ? loadModel(fileName, sceneTriangles) :
+			loadObj(fileName, objColor, objReflectivity, sceneTriangles);
+
+		if (!loaded || sceneTriangles.size() == before)
+			continue;
+
+		meshTriangleCounts.push_back((int)(sceneTriangles.size() - before));
+		std::cout << "loaded " << sceneTriangles.size() - before << " triangles from " << fileName << " in "
+			<< (startupSeconds() - start) * 1000.0 << " ms" << std::endl;
+	}
+
+	// every glTF mesh that a node uses is a mesh of its own, in the place of its first node,
+	// and the other nodes are instances of it where the renderer can draw them. A node with a skin is always
+	// a mesh of its own, which its joints move (see SkinnedMesh)
+	int bindPoseSkins = 0;
+
+	for (const std::string& fileName : gltfFiles)
+	{
+		double start = startupSeconds();
+		std::vector<GltfMesh> meshes;
+		std::vector<GltfInstance> nodes;
+		GltfSkeleton skeleton;
+
+		if (!loadGltf(fileName, objColor, objReflectivity, meshes, nodes, &skeleton))
+			continue;
+
+		// the mesh of the scene that every glTF mesh became, and the matrix that is in its triangles
+		std::vector<int> sceneMesh(meshes.size(), -1);
+		std::vector<glm::mat4x4> bakedMatrix(meshes.size());
+		size_t before = sceneTriangles.size();
+		size_t instancesBefore = sceneInstances.size();
+
+		for (const GltfInstance& node : nodes)
+		{
+			if (meshes[node.mesh].triangles.empty())
+				continue;
+
+			SceneInstance place = {};
+			place.matrix = node.matrix;
+
+			bool skinned = node.skin >= 0 && !meshes[node.mesh].cornerSkins.empty() && !skeleton.skins[node.skin].joints.empty();
+
+			if (skinned && !canSkinMeshes())
+				bindPoseSkins++;
+
+			if (!skinned || !canSkinMeshes())
+			{
+				placeMesh(meshes[node.mesh].triangles, place, sceneMesh[node.mesh], bakedMatrix[node.mesh], meshTriangleCounts);
+				continue;
+			}
+
+			SkinnedMesh skin;
+			glm::mat4x4 baked;
+			size_t first = sceneTriangles.size();
+			skin.mesh = -1;
+			placeMesh(meshes[node.mesh].triangles, place, skin.mesh, baked, meshTriangleCounts);
+
+			skin.skeleton = (int)gltfSkeletons.size();
+			skin.skin = node.skin;
+			skin.unbake = glm::inverse(baked);
+			skin.cornerSkins = meshes[node.mesh].cornerSkins;
+
+			for (size_t t = first; t < sceneTriangles.size(); t++)
+			{
+				skin.corners.push_back(sceneTriangles[t].a);
+				skin.corners.push_back(sceneTriangles[t].b);
+				skin.corners.push_back(sceneTriangles[t].c);
+			}
+
+			skinnedMeshes.push_back(skin);
+		}
+
+		// the skins of this file point at its skeleton
+		if (!skinnedMeshes.empty() && skinnedMeshes.back().skeleton == (int)gltfSkeletons.size())
+			gltfSkeletons.push_back(skeleton);
+
+		std::cout << "loaded " << sceneTriangles.size() - before << " triangles and " << sceneInstances.size() - instancesBefore
+			<< " instances from " << fileName << " in " << (startupSeconds() - start) * 1000.0 << " ms" << std::endl;
+	}
+
+	if (bindPoseSkins > 0)
+		std::cout << bindPoseSkins << " skinned meshes stay in their bind pose, because the CPU renderers, --compact-meshes, "
+			"--geometry-pool, and --async-upload cannot move them" << std::endl;
+
+	// The instances of the scene file can be of any mesh that is in the scene by now. Where the renderer
+	// cannot draw instances, they are copies of the triangles, in the place their mesh starts at
+	placements.resize(meshTriangleCounts.size(), glm::mat4());
+	sceneFileInstances.assign(sceneFile.instances.size(), -1);
+
+	for (size_t i = 0; i < sceneFile.instances.size(); i++)
+	{
+		const SceneFileInstance& instance = sceneFile.instances[i];
+
+		if (instance.mesh >= (int)meshTriangleCounts.size())
+		{
+			std::cout << "the scene has no mesh " << instance.mesh << ", so instance " << i << " of the scene file is left out" << std::endl;
+			continue;
+		}
+
+		SceneInstance place;
+		place.mesh = instance.mesh;
+		place.matrix = instance.matrix;
+		place.ownMaterial = instance.ownMaterial;
+		place.color = instance.color;
+		place.reflectivity = instance.reflectivity;
+		place.grid = instance.grid;
+
+		if (canDrawInstances())
+		{
+			sceneFileInstances[i] = (int)sceneInstances.size();
+			sceneInstances.push_back(place);
+			continue;
+		}
+
+		int first = 0;
+		for (int m = 0; m < instance.mesh; m++)
+			first += meshTriangleCounts[m];
+
+		std::vector<triangle> triangles(sceneTriangles.begin() + first, sceneTriangles.begin() + first + meshTriangleCounts[instance.mesh]);
+		int copy = -1;
+		glm::mat4x4 baked;
+		place.matrix = placements[instance.mesh] * instance.matrix;
+		placeMesh(triangles, place, copy, baked, meshTriangleCounts);
+		placements.push_back(glm::mat4());
+	}
+
+	meshPlacements = placements;
+
+	sceneMeshOffsets = makeMeshOffsets(meshTriangleCounts);
+	numSceneMeshes = (int)meshTriangleCounts.size();
+	meshPrimitives.resize(numSceneMeshes, PRIMITIVE_NONE);
+	bvhNumTriangles = (int)sceneTriangles.size();
+	bvhNumLeaves = bvhNumTriangles;
+
+	if (earlySplitArea > 0.0f)
+	{
+		splitPieces = makeSplitPieces(sceneTriangles);
+		bvhNumLeaves = (int)splitPieces.size();
+		std::cout << "--early-split cut the " << bvhNumTriangles << " triangles into " << bvhNumLeaves << " leaves of the BVH" << std::endl;
+	}
+
+	if (materialTable)
+		makeMaterialTable();
+
+	// every buffer that depends on the size of the scene. The ones of the BVH have one entry for every leaf
+	int n = bvhNumTriangles;
+	int leaves = bvhNumLeaves;
+	compToFragSize = sizeof(triangle) * n;
+	triangleRecordBufferSize = sizeof(glm::vec4) * 3 * n;
+	triangleBufferSize = sizeof(triangle) * n;
+	matrixBufferSize = sizeof(glm::mat4x4) * numSceneMeshes;
+	meshBoxBufferSize = sizeof(GLuint) * 8 * numSceneMeshes;
+	bvhNodeBufferSize = sizeof(BVHNode) * (2 * leaves - 1);
+	bvhKeyBufferSize = sizeof(GLuint) * 2 * leaves;
+	bvhLinkBufferSize = sizeof(GLint) * 2 * (2 * leaves - 1);
+	bvhTreeletBufferSize = sizeof(GLint) * 2 * (2 * leaves - 1);
+	radixHistogramBufferSize = sizeof(GLuint) * RADIX_DIGITS * ((leaves + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE);
+	// A triangle can be in every cell, but the copies of --scene-triangles are smaller than a cell
+	// (the scene is at least 10 across, so a cell is at least 1.25, and a cube is at most 1.73 corner to corner,
+	// which is at most 2 cells on every axis), so they are in at most 8. The triangles of a model of --obj are
+	// counted the same way, because a model is made of many small triangles, and room for every one of
+	// them in every cell would be gigabytes. BuildGrid.glsl leaves out the references that do not fit
+	int objTriangles = n - sceneMeshOffsets[2 + (generatedCubes + GENERATED_CUBES_PER_MESH - 1) / GENERATED_CUBES_PER_MESH];
+	size_t gridRefs = (size_t)(n - 12 * generatedCubes - objTriangles) * GRID_CELLS + (size_t)(12 * generatedCubes + objTriangles) * 8;
+	gridBufferSize = (int)(GRID_HEADER_SIZE + sizeof(GLuint) * gridRefs);
+	instanceCapacity = numSceneMeshes + (int)sceneInstances.size() + (incrementalTLAS ? instanceRoom : 0);
+	tlasMaxNodes = 2 * instanceCapacity - 1;
+	instanceBufferSize = sizeof(Instance) * instanceCapacity;
+
+	blasRoots.resize(numSceneMeshes);
+	wideBlasRoots.resize(numSceneMeshes);
+	meshBounds.resize(numSceneMeshes);
+	lodBlasRoots.resize(MESH_LODS * numSceneMeshes);
+	lodWideBlasRoots.resize(MESH_LODS * numSceneMeshes);
+	lodFirstTriangles.resize(MESH_LODS * numSceneMeshes);
+}
+
+// Get the uniform locations of draw_program. init and --hot-reload both use this
+void getDrawUniforms()
+{
+	// This gets us a reference to the uniform variables in the vertex shader, which are called by the same name here as in the shader.
+	// The camera is not one of them, it is in the camera block (see calcCameraRays).
+	// Only 2 parameters required: A reference to the shader program and the name of the uniform variable within the shader code.
+	accel_loc = glGetUniformLocation(draw_program, "accel");
+	wideBLAS_loc = glGetUniformLocation(draw_program, "wideBLAS");
+	numLights_loc = glGetUniformLocation(draw_program, "numLights");
+	visibilityBuffer_loc = glGetUniformLocation(draw_program, "visibilityBuffer");
+	tiledLights_loc = glGetUniformLocation(draw_program, "tiledLights");
+	countRays_loc = glGetUniformLocation(draw_program, "countRays");
+	costView_loc = glGetUniformLocation(draw_program, "costView");
+	costScale_loc = glGetUniformLocation(draw_program, "costScale");
+	tilesX_loc = glGetUniformLocation(draw_program, "tilesX");
+	reflectionPass_loc = glGetUniformLocation(draw_program, "reflectionPass");
+	reducedReflections_loc = glGetUniformLocation(draw_program, "reducedReflections");
+	reflectionScale_loc = glGetUniformLocation(draw_program, "reflectionScale");
+	shadowPass_loc = glGetUniformLocation(draw_program, "shadowPass");
+	reducedShadows_loc = glGetUniformLocation(draw_program, "reducedShadows");
+	shadowScale_loc = glGetUniformLocation(draw_program, "shadowScale");
+	shadowGridSize_loc = glGetUniformLocation(draw_program, "shadowGridSize");
+	shadowWords_loc = glGetUniformLocation(draw_program, "shadowWords");
+	hitPass_loc = glGetUniformLocation(draw_program, "hitPass");
+	hitBuffer_loc = glGetUniformLocation(draw_program, "hitBuffer");
+	adaptiveSamples_loc = glGetUniformLocation(draw_program, "adaptiveSamples");
+	temporal_loc = glGetUniformLocation(draw_program, "temporal");
+	historyValid_loc = glGetUniformLocation(draw_program, "historyValid");
+	temporalRefresh_loc = glGetUniformLocation(draw_program, "temporalRefresh");
+	prevViewProj_loc = glGetUniformLocation(draw_program, "prevViewProj");
+	prevEye_loc = glGetUniformLocation(draw_program, "prevEye");
+	checkerboard_loc = glGetUniformLocation(draw_program, "checkerboard");
+	floorTexture_loc = glGetUniformLocation(draw_program, "floorTexture");
+	floorTextureScale_loc = glGetUniformLocation(draw_program, "floorTextureScale");
+	pixelSpread_loc = glGetUniformLocation(draw_program, "pixelSpread");
+	probePass_loc = glGetUniformLocation(draw_program, "probePass");
+	numProbes_loc = glGetUniformLocation(draw_program, "numProbes");
+	probeCenters_loc = glGetUniformLocation(draw_program, "probeCenters");
+	probeBoxMin_loc = glGetUniformLocation(draw_program, "probeBoxMin");
+	probeBoxMax_loc = glGetUniformLocation(draw_program, "probeBoxMax");
+	probeBounce_loc = glGetUniformLocation(draw_program, "probeBounce");
+	probeDistance_loc = glGetUniformLocation(draw_program, "probeDistance");
+	probeSpread_loc = glGetUniformLocation(draw_program, "probeSpread");
+}
+
+// Get the uniform locations of transform_program
+void getTransformUniforms()
+{
+	transform_pass_loc = glGetUniformLocation(transform_program, "pass");
+	transform_numVertices_loc = glGetUniformLocation(transform_program, "numVertices");
+	transform_numTriangles_loc = glGetUniformLocation(transform_program, "numTriangles");
+	transform_numMeshes_loc = glGetUniformLocation(transform_program, "numMeshes");
+	transform_dirtyOnly_loc = glGetUniformLocation(transform_program, "dirtyOnly");
+	transform_numDirty_loc = glGetUniformLocation(transform_program, "numDirty");
+	transform_numJobs_loc = glGetUniformLocation(transform_program, "numJobs");
+	transform_emitKeys_loc = glGetUniformLocation(transform_program, "emitKeys");
+	transform_skinning_loc = glGetUniformLocation(transform_program, "skinning");
+	transform_meshSpace_loc = glGetUniformLocation(transform_program, "meshSpace");
+	transform_firstRefit_loc = glGetUniformLocation(transform_program, "firstRefit");
+}
+
+// Remember when every file that readShaderFile read since shaderFilesRead was emptied was last changed
+void watchShaderFiles()
+{
+	watchedShaderFiles.clear();
+
+	for (const std::string& fileName : shaderFilesRead)
+	{
+		struct stat info;
+		watchedShaderFiles[fileName] = stat(fileName.c_str(), &info) == 0 ? info.st_mtime : 0;
+	}
+}
+
+// True if a watched file was changed since watchShaderFiles
+bool shaderFilesChanged()
+{
+	for (const auto& file : watchedShaderFiles)
+	{
+		struct stat info;
+
+		if (stat(file.first.c_str(), &info) == 0 && info.st_mtime != file.second)
+			return true;
+	}
+
+	return false;
+}
+
+// Use new draw and transform programs instead of the ones that are used now, which are deleted
+void swapDrawPrograms(GLuint newDraw, GLuint newTransform)
+{
+	glDeleteProgram(draw_program);
+	glDeleteProgram(transform_program);
+	draw_program = newDraw;
+	transform_program = newTransform;
+
+	// only the preset that is used gets the new shaders
+	if (qualityPreset >= 0)
+		qualityPrograms[qualityPreset] = newDraw;
+
+	getDrawUniforms();
+	getTransformUniforms();
+}
+
+// Compile the draw and transform programs again for the #defines that the globals make now (--autotune changes them),
+// wait for them, and swap them in. If they don't link, the old ones are kept, and this returns false
+bool rebuildDrawPrograms()
+{
+	std::string vertShader = readShaderFile("../Assets/VertexShader.glsl");
+	std::string fragShader = specializeDrawShader(readShaderFile("../Assets/FragmentShader.glsl"));
+	std::string compShader = specializeTransformShader(readShaderFile("../Assets/Compute.glsl"));
+
+	PendingProgram draw = startProgram("draw", {
+		{ GL_VERTEX_SHADER, vertShader, "VertexShader.glsl" },
+		{ GL_FRAGMENT_SHADER, fragShader, "FragmentShader.glsl" } });
+	PendingProgram transform = startProgram("transform", { { GL_COMPUTE_SHADER, compShader, "Compute.glsl" } });
+
+	GLuint newDraw = finishProgram(draw);
+	GLuint newTransform = finishProgram(transform);
+
+	if (!programLinked(newDraw) || !programLinked(newTransform))
+	{
+		glDeleteProgram(newDraw);
+		glDeleteProgram(newTransform);
+		return false;
+	}
+
+	swapDrawPrograms(newDraw, newTransform);
+	return true;
+}
+
+// Read the files again, and start compiling and linking the new programs. The driver may do that on its own threads
+void startShaderReload()
+{
+	shaderFilesRead.clear();
+	std::string vertShader = readShaderFile("../Assets/VertexShader.glsl");
+	std::string fragShader = specializeDrawShader(readShaderFile("../Assets/FragmentShader.glsl"));
+	std::string compShader = specializeTransformShader(readShaderFile("../Assets/Compute.glsl"));
+
+	// a file that is included now, and was not before, is watched from now on too
+	watchShaderFiles();
+
+	// startProgram does not wait, so the old programs keep rendering
+	reloadDraw = startProgram("draw", {
+		{ GL_VERTEX_SHADER, vertShader, "VertexShader.glsl" },
+		{ GL_FRAGMENT_SHADER, fragShader, "FragmentShader.glsl" } });
+	reloadTransform = startProgram("transform", { { GL_COMPUTE_SHADER, compShader, "Compute.glsl" } });
+	reloading = true;
+
+	std::cout << "shaders changed, compiling them again" << std::endl;
+}
+
+// Swap in the new programs if they are done and they work, and forget them if they don't
+void finishShaderReload()
+{
+	if (!programReady(reloadDraw) || !programReady(reloadTransform))
+		return;
+
+	// finishProgram prints the errors
+	GLuint newDraw = finishProgram(reloadDraw);
+	GLuint newTransform = finishProgram(reloadTransform);
+	reloading = false;
+
+	if (!programLinked(newDraw) || !programLinked(newTransform))
+	{
+		std::cout << "the old shaders are still used" << std::endl;
+		glDeleteProgram(newDraw);
+		glDeleteProgram(newTransform);
+		return;
+	}
+
+	swapDrawPrograms(newDraw, newTransform);
+
+	// The times so far were the old shaders. Print them, and start over for the new ones
+	if (timingFrames && frameReport)
+	{
+		std::cout << "with the old shaders:" << std::endl;
+		printFrameReport();
+	}
+
+	frameTimes.clear();
+	tempFrame = 0;
+	timebase = platformTime();
+
+	// the new shaders can make another image, so the average of --accumulate starts again,
+	// and --temporal does not use the frame before
+	accumulatedSamples = 0;
+	historyValid = false;
+
+	std::cout << "the new shaders are used now" << std::endl;
+}
+
+// Called once per frame with --hot-reload. The files are only looked at twice a second
+void updateShaderReload()
+{
+	if (reloading)
+	{
+		finishShaderReload();
+		return;
+	}
+
+	double now = platformTime();
+
+	if (now - lastShaderCheck < 0.5)
+		return;
+
+	lastShaderCheck = now;
+
+	if (shaderFilesChanged())
+		startShaderReload();
+}
+
+// Build the BLAS of count triangles of a mesh, put its nodes after the ones in nodes and wideNodes, and give back
+// the root in nodes (and the root in wideNodes in wideRoot), and the box around the triangles. The triangles are
+// put in the order of the BLAS leaves, which count from the first of them (see firstTriangle in Instance).
+// Since each BLAS is only built once, we use the slower SAH builder that makes a better tree,
+// and keep it on the disk so that it is only built once ever, not once per run
+int buildMeshBLAS(triangle* meshTriangles, int count, std::vector<BVHNode>& nodes, std::vector<WideBVHNode>& wideNodes, int& wideRoot, AABB& bounds)
+{
+	std::vector<AABB> triangleBounds(count);
+	for (int i = 0; i < count; i++)
+	{
+		triangleBounds[i] = emptyAABB();
+		growAABB(triangleBounds[i], meshTriangles[i].a);
+		growAABB(triangleBounds[i], meshTriangles[i].b);
+		growAABB(triangleBounds[i], meshTriangles[i].c);
+	}
+
+	// the file that buildBVHCached looks for, which --shared-cache can have from another node
+	std::string cacheFile;
+
+	if (!sharedCacheUrl.empty())
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "/%016llx.bvh", (unsigned long long)hashBVHInput(triangleBounds, 2));
+		cacheFile = bvhCacheFolder + std::string(name);
+		fetchSharedCacheFile(cacheFile);
+	}
+
+	std::vector<BVHNode> blasNodes;
+	std::vector<int> order;
+
+	if (buildBVHCached(triangleBounds, 2, bvhCacheFolder, blasNodes, order))
+	{
+		blasCacheHits++;
+	}
+	else
+	{
+		blasCacheMisses++;
+
+		if (!cacheFile.empty())
+			storeSharedCacheFile(cacheFile);
+	}
+
+	// The wide BLAS points at the same triangles,
+	// so it is made before the children are moved by base
+	std::vector<WideBVHNode> wideBlas;
+	collapseBVH4(blasNodes, wideBlas);
+
+	int wideBase = (int)wideNodes.size();
+	for (WideBVHNode& node : wideBlas)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			if (node.child[c] >= 0)
+				node.child[c] += wideBase;
+		}
+	}
+
+	wideRoot = wideBase;
+	wideNodes.insert(wideNodes.end(), wideBlas.begin(), wideBlas.end());
+
+	std::vector<triangle> sorted(count);
+	for (int i = 0; i < count; i++)
+		sorted[i] = meshTriangles[order[i]];
+	for (int i = 0; i < count; i++)
+		meshTriangles[i] = sorted[i];
+
+	// The children of interior nodes need to point to where
+	// the nodes will be in the big buffer. Leaves point to triangles, which don't move
+	int base = (int)nodes.size();
+	for (BVHNode& node : blasNodes)
+	{
+		if (node.left >= 0)
+		{
+			node.left += base;
+			node.right += base;
+		}
+	}
+
+	bounds.min = blasNodes[0].min;
+	bounds.max = blasNodes[0].max;
+	nodes.insert(nodes.end(), blasNodes.begin(), blasNodes.end());
+	return base;
+}
+
+void init()
+{
+	PROFILE_ZONE("init");
+
+	double start = startupSeconds();
+	glewExperimental = GL_TRUE;
+	// Initializes the glew library
+	glewInit();
+	reportStartupTime("glewInit", start);
+
+	// before anything is made, so that the messages of the loading are there too
+	if (glDebug && !startGlDebug(glStallMs))
+	{
+		std::cout << "--gl-debug needs KHR_debug or OpenGL 4.3" << std::endl;
+		glDebug = false;
+	}
+
+	// The upload rings are made the first time something is written into them
+	if (!GLEW_ARB_buffer_storage)
+		persistentUploads = false;
+
+	// the loader thread of --async-upload needs it too, and a context of its own
+	if (asyncUpload && !makeAsyncLoader())
+	{
+		std::cout << "--async-upload needs GL_ARB_buffer_storage and a second context, the scene is uploaded before the first frame" << std::endl;
+		asyncUpload = false;
+	}
+
+	// The driver can compile on as many threads as it wants. The shaders are compiled while the scene is
+	// loaded and uploaded below, and init only waits for them at the end, so the startup takes about as long
+	// as the slowest program, not all of them one after another (see startProgram)
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
+	// the compiled programs are kept here (see makeProgram)
+	if (canCachePrograms())
+		makeFolder(shaderCacheFolder);
+
+	// the choices of --autotune for this GPU, before anything that they change is compiled
+	if (useTuneProfile)
+		tuneProfileLoaded = loadTuneProfile();
+
+	// The programs that build the acceleration structures and cull the lights don't depend on the scene,
+	// so they start compiling before it is loaded. These are also the ones that --spirv can load
+	PendingProgram bvh = startSpirvProgram("bvh", GL_COMPUTE_SHADER, "BuildBVH.glsl");
+	PendingProgram radix = startSpirvProgram("radix sort", GL_COMPUTE_SHADER, "RadixSort.glsl");
+	PendingProgram grid = startSpirvProgram("grid", GL_COMPUTE_SHADER, "BuildGrid.glsl");
+	PendingProgram lightCull = startSpirvProgram("light cull", GL_COMPUTE_SHADER, "LightCull.glsl", { MAX_LIGHTS, LIGHT_TILE_SIZE });
+
+	// Read in the shader code from a file.
+	// The files of the draw and transform programs are watched by --hot-reload
+	shaderFilesRead.clear();
+	std::string vertShader = readShader("../Assets/VertexShader.glsl");
+	std::string compShader = specializeTransformShader(readShader("../Assets/Compute.glsl"));
+
+	PendingProgram transform = startProgram("transform", { { GL_COMPUTE_SHADER, compShader, "Compute.glsl" } });
+
+	start = startupSeconds();
+	loadScene();
+	reportStartupTime("load the scene", start);
+
+	// the skins only refit the binary BLAS, and only move the buffers of one transform set
+	if (!skinnedMeshes.empty() && overlapTransform)
+	{
+		std::cout << "--overlap-transform is off, because the scene has skinned meshes" << std::endl;
+		overlapTransform = false;
+	}
+
+	if (!skinnedMeshes.empty())
+		blasNodeFormat = BVH_FORMAT_BINARY;
+
+	// a tuned stack is only safe on the scene and structure it was tried on
+	if (tunedStackSize > 0 && !choicesOnCommandLine.count("bvh-stack") &&
+		tunedStackAccel == accelBackend && tunedStackScene == sceneCaptureHash())
+		bvhStackSize = tunedStackSize;
+
+	// the lights of the scene are known now
+	pickLightPlacement();
+
+	// The ray tracer is compiled for the scene, so it can only start now
+	std::string fragSource = readShader("../Assets/FragmentShader.glsl");
+	watchShaderFiles();
+
+	// startProgram compiles the shaders and links them together, or loads the program from the cache.
+	// With --preset, there is one draw program for every preset
+	PendingProgram draw;
+	std::vector<PendingProgram> quality;
+
+	if (qualityPreset >= 0)
+	{
+		quality = startQualityPrograms(vertShader, fragSource);
+	}
+	else
+	{
+		draw = startProgram("draw", {
+			{ GL_VERTEX_SHADER, vertShader, "VertexShader.glsl" },
+			{ GL_FRAGMENT_SHADER, specializeDrawShader(fragSource), "FragmentShader.glsl" } });
+	}
+
+	glGenQueries(1, &waveTimerQuery);
+	glGenQueries(1, &hybridTimerQuery);
+
+	// the camera block, which calcCameraRays writes every frame
+	glGenBuffers(1, &cameraBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+	gpuBufferData(GL_UNIFORM_BUFFER, cameraBuffer, cameraBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// and the rays of --camera, which it makes when the camera turns
+	if (cameraModel >= 0)
+		makeCameraRayProgram();
+
+	// Make a buffer for our particle data.
+	start = startupSeconds();
+	glGenBuffers(1, &compToFrag);
+	glBindBuffer(GL_UNIFORM_BUFFER, compToFrag);
+	gpuBufferData(GL_UNIFORM_BUFFER, compToFrag, compToFragSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_SCENE); // static because CPU won't touch it
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glGenBuffers(1, &triangleRecordBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleRecordBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, triangleRecordBuffer, triangleRecordBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The BVH is written by the GPU every frame, so the CPU never touches it
+	glGenBuffers(1, &bvhNodeBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhNodeBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, bvhNodeBuffer, bvhNodeBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The pieces of --early-split never change, so they are only sent once
+	if (earlySplitArea > 0.0f)
+	{
+		glGenBuffers(1, &splitPieceBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, splitPieceBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, splitPieceBuffer, sizeof(glm::uvec2) * splitPieces.size(), splitPieces.data(), GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// The CPU only resets the first 24 bytes of this every frame
+	glGenBuffers(1, &bvhScratchBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhScratchBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, bvhScratchBuffer, bvhScratchBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The keys, links, and histogram are only ever touched by the GPU
+	glGenBuffers(1, &bvhKeyBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhKeyBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, bvhKeyBuffer, bvhKeyBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+
+	glGenBuffers(1, &bvhKeyTempBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhKeyTempBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, bvhKeyTempBuffer, bvhKeyBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+
+	glGenBuffers(1, &bvhLinkBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhLinkBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, bvhLinkBuffer, bvhLinkBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+
+	if (bvhRestructureRounds > 0 || benchmarkRestructure)
+	{
+		glGenBuffers(1, &bvhTreeletBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhTreeletBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, bvhTreeletBuffer, bvhTreeletBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	}
+
+	glGenBuffers(1, &radixHistogramBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, radixHistogramBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, radixHistogramBuffer, radixHistogramBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The CPU empties the boxes every frame, and the compute shader fills them
+	glGenBuffers(1, &meshBoxBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBoxBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, meshBoxBuffer, meshBoxBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The CPU empties the grid every frame, and BuildGrid.glsl fills it
+	glGenBuffers(1, &gridBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, gridBuffer, gridBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(1, &matrixBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, matrixBuffer);
+	gpuBufferData(GL_UNIFORM_BUFFER, matrixBuffer, matrixBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE); // static because CPU won't touch it
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Build the BLAS of each mesh. This only happens once, because the triangles of a mesh never
+	// move inside of the mesh, only the matrix of the mesh changes. Every BLAS goes after the TLAS nodes
+	reportStartupTime("make the buffers", start);
+	start = startupSeconds();
+	makeFolder(bvhCacheFolder);
+
+	std::vector<BVHNode> twoLevelNodes(tlasMaxNodes);
+	std::vector<WideBVHNode> wideNodes;
+	for (int m = 0; m < numSceneMeshes; m++)
+	{
+		// the triangles of this mesh in sceneTriangles
+		triangle* meshTriangles = &sceneTriangles[sceneMeshOffsets[m]];
+		int count = sceneMeshOffsets[m + 1] - sceneMeshOffsets[m];
+
+		blasRoots[m] = buildMeshBLAS(meshTriangles, count, twoLevelNodes, wideNodes, wideBlasRoots[m], meshBounds[m]);
+	}
+
+	reportStartupTime("build the BLAS of every mesh", start);
+	start = startupSeconds();
+
+	// The coarser copies of the meshes for --lod-geometry, which are made from the mesh, not from the copy before them.
+	// Without it (or for a mesh that is too small), the copies are the mesh, so the instances always have them
+	std::vector<compactTriangle> lodCompactTriangles;
+	lodTriangles.clear();
+
+	for (int m = 0; m < numSceneMeshes; m++)
+	{
+		triangle* meshTriangles = &sceneTriangles[sceneMeshOffsets[m]];
+		int count = sceneMeshOffsets[m + 1] - sceneMeshOffsets[m];
+
+		for (int l = 0; l < MESH_LODS; l++)
+		{
+			int lod = MESH_LODS * m + l;
+			lodBlasRoots[lod] = (l == 0) ? blasRoots[m] : lodBlasRoots[lod - 1];
+			lodWideBlasRoots[lod] = (l == 0) ? wideBlasRoots[m] : lodWideBlasRoots[lod - 1];
+			lodFirstTriangles[lod] = (l == 0) ? sceneMeshOffsets[m] : lodFirstTriangles[lod - 1];
+
+			std::vector<triangle> copy;
+			// only the BLAS of a skinned mesh itself is refit, so it has no copies
+			if (lodGeometryFrom == 0 || count < LOD_MIN_TRIANGLES || isSkinnedMesh(m) || !simplifyMesh(meshTriangles, count, count >> (l + 1), copy))
+				continue;
+
+			int first = (int)lodTriangles.size();
+			lodTriangles.insert(lodTriangles.end(), copy.begin(), copy.end());
+
+			// a copy is inside the box of its mesh, so the box of its BLAS is not needed
+			AABB copyBounds;
+			lodBlasRoots[lod] = buildMeshBLAS(&lodTriangles[first], (int)copy.size(), twoLevelNodes, wideNodes, lodWideBlasRoots[lod], copyBounds);
+			lodFirstTriangles[lod] = bvhNumTriangles + first;
+
+			for (int i = first; compactMeshes && i < (int)lodTriangles.size(); i++)
+				lodCompactTriangles.push_back(makeCompactTriangle(lodTriangles[i], meshBounds[m].min, meshBounds[m].max - meshBounds[m].min, materialTable));
+		}
+	}
+
+	if (lodGeometryFrom > 0)
+	{
+		std::cout << "the coarser copies of the meshes have " << lodTriangles.size() << " triangles, the meshes have " << bvhNumTriangles << std::endl;
+		reportStartupTime("make the LODs of the meshes", start);
+		start = startupSeconds();
+	}
+
+	twoLevelNodeBufferSize = (int)(sizeof(BVHNode) * twoLevelNodes.size());
+
+	glGenBuffers(1, &twoLevelNodeBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, twoLevelNodeBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, twoLevelNodeBuffer, twoLevelNodeBufferSize, twoLevelNodes.data(), GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (!skinnedMeshes.empty())
+		makeSkinRefitList(twoLevelNodes);
+
+	wideNodeBufferSize = (int)(sizeof(WideBVHNode) * wideNodes.size());
+
+	glGenBuffers(1, &wideNodeBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, wideNodeBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, wideNodeBuffer, wideNodeBufferSize, wideNodes.data(), GL_STATIC_DRAW, GPU_MEMORY_ACCEL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, instanceBuffer, instanceBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Room for every instance in the instance grid, with the most buckets that buildInstanceGrid can pick for them.
+	// The renderers read its header even when no instance is in it, so it is empty until buildTLAS
+	if (useInstanceGrid)
+	{
+		instance_grid_program = makeProgram("instance grid", { { GL_COMPUTE_SHADER, readShader("../Assets/BuildInstanceGrid.glsl"), "BuildInstanceGrid.glsl" } });
+		instanceGrid_pass_loc = glGetUniformLocation(instance_grid_program, "pass");
+
+		int buckets = 64;
+		while (buckets < 2 * instanceCapacity)
+			buckets *= 2;
+
+		instanceGridBufferSize = (int)(sizeof(instanceGrid) + sizeof(GLuint) * (2 * buckets + 1 + 8 * (size_t)instanceCapacity));
+		instanceGrid empty = {};
+
+		glGenBuffers(1, &instanceGridBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceGridBuffer);
+		gpuBufferData(GL_SHADER_STORAGE_BUFFER, instanceGridBuffer, instanceGridBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_ACCEL);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(empty), &empty);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// The compact triangles are stored in the box of their mesh, which
+	// is the box of the root of its BLAS, so they are made after the BLAS
+	std::vector<compactTriangle> compactTriangles;
+
+	if (compactMeshes)
+	{
+		for (int m = 0; m < numSceneMeshes; m++)
+		{
+			for (int i = sceneMeshOffsets[m]; i < sceneMeshOffsets[m + 1]; i++)
+				compactTriangles.push_back(makeCompactTriangle(sceneTriangles[i], meshBounds[m].min, meshBounds[m].max - meshBounds[m].min, materialTable));
+		}
+
+		compactTriangles.insert(compactTriangles.end(), lodCompactTriangles.begin(), lodCompactTriangles.end());
+		triangleBufferSize = (int)(sizeof(compactTriangle) * compactTriangles.size());
+	}
+
+	glGenBuffers(1, &triangleBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, triangleBuffer);
+
+	if (geometryPoolMB > 0)
+	{
+		// the pool starts empty, and buildTLAS copies the meshes in when they are wanted
+		GLsizeiptr stride = compactMeshes ? sizeof(compactTriangle) : sizeof(triangle);
+		poolCapacity = (int)std::min((GLsizeiptr)geometryPoolMB * 1024 * 1024 / stride, (GLsizeiptr)std::max(bvhNumTriangles, 1));
+		triangleBufferSize = (int)(stride * poolCapacity);
+
+		if (sparsePool && !GLEW_ARB_sparse_buffer)
+		{
+			std::cout << "this driver has no GL_ARB_sparse_buffer, so the geometry pool is not sparse" << std::endl;
+			sparsePool = false;
+		}
+
+		if (sparsePool)
+		{
+			// addresses for every mesh, in whole pages, and no memory yet
+			GLint pageSize = 65536;
+			glGetIntegerv(GL_SPARSE_BUFFER_PAGE_SIZE_ARB, &pageSize);
+			sparsePageSize = pageSize;
+
+			GLsizeiptr pages = (stride * std::max(bvhNumTriangles, 1) + sparsePageSize - 1) / sparsePageSize;
+			triangleBufferSize = (int)(pages * sparsePageSize);
+			gpuSparseBufferStorage(GL_UNIFORM_BUFFER, triangleBuffer, triangleBufferSize, GL_DYNAMIC_STORAGE_BIT, GPU_MEMORY_SCENE);
+
+			poolPageUsers.assign((size_t)pages, 0);
+			poolTriangles = 0;
+		}
+		else
+			gpuBufferData(GL_UNIFORM_BUFFER, triangleBuffer, triangleBufferSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE);
+
+		poolOffsets.assign(numSceneMeshes, -1);
+		poolLastWanted.assign(numSceneMeshes, -1);
+		poolFreeRanges.clear();
+		poolFreeRanges[0] = poolCapacity;
+		poolCompactTriangles.swap(compactTriangles);
+	}
+	else if (!compactMeshes && !lodTriangles.empty())
+	{
+		// the copies of --lod-geometry go after the meshes
+		GLsizeiptr meshBytes = sizeof(triangle) * sceneTriangles.size();
+		triangleBufferSize = (int)(meshBytes + sizeof(triangle) * lodTriangles.size());
+		gpuBufferData(GL_UNIFORM_BUFFER, triangleBuffer, triangleBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+		uploadSceneData(GL_UNIFORM_BUFFER, triangleBuffer, 0, meshBytes, sceneTriangles.data());
+		uploadSceneData(GL_UNIFORM_BUFFER, triangleBuffer, meshBytes, sizeof(triangle) * lodTriangles.size(), lodTriangles.data());
+	}
+	else if (asyncUpload)
+	{
+		// the loader reads the compact triangles after init has returned
+		asyncCompactTriangles.swap(compactTriangles);
+		gpuBufferData(GL_UNIFORM_BUFFER, triangleBuffer, triangleBufferSize, nullptr, GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+		uploadSceneData(GL_UNIFORM_BUFFER, triangleBuffer, 0, triangleBufferSize, compactMeshes ? (void*)asyncCompactTriangles.data() : (void*)sceneTriangles.data());
+	}
+	else
+		gpuBufferData(GL_UNIFORM_BUFFER, triangleBuffer, triangleBufferSize, compactMeshes ? (void*)compactTriangles.data() : (void*)sceneTriangles.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE); // static because CPU won't touch it
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// The indexed meshes are made after the BLAS put the triangles in order,
+	// so triangle i of the indexed meshes is still triangle i of sceneTriangles
+	makeIndexedMeshes(sceneTriangles, sceneMeshOffsets, sceneVertices, sceneIndexedTriangles, sceneVertexOffsets);
+
+	glGenBuffers(1, &sceneVertexBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneVertexBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, sceneVertexBuffer, sizeof(glm::vec4) * sceneVertices.size(), asyncUpload ? nullptr : sceneVertices.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+
+	// with --async-upload, the vertices are queued before the indices, so that they are copied first
+	if (asyncUpload)
+		uploadSceneData(GL_SHADER_STORAGE_BUFFER, sceneVertexBuffer, 0, sizeof(glm::vec4) * sceneVertices.size(), sceneVertices.data());
+
+	glGenBuffers(1, &sceneIndexBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneIndexBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, sceneIndexBuffer, sizeof(indexedTriangle) * sceneIndexedTriangles.size(), asyncUpload ? nullptr : sceneIndexedTriangles.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+
+	if (asyncUpload)
+		uploadSceneData(GL_SHADER_STORAGE_BUFFER, sceneIndexBuffer, 0, sizeof(indexedTriangle) * sceneIndexedTriangles.size(), sceneIndexedTriangles.data());
+
+	// the list is made again every frame that only some meshes move in
+	glGenBuffers(1, &dirtyMeshBuffer);
+
+	// only the GPU touches the moved vertices
+	glGenBuffers(1, &worldVertexBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, worldVertexBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, worldVertexBuffer, sizeof(glm::vec4) * sceneVertices.size(), nullptr, GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+
+	// the second set of everything that the transform writes
+	if (overlapTransform)
+		makeTransformSet(spareTransform);
+
+	std::vector<GLint> offsetTables = sceneMeshOffsets;
+	offsetTables.insert(offsetTables.end(), sceneVertexOffsets.begin(), sceneVertexOffsets.end());
+
+	glGenBuffers(1, &meshOffsetBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshOffsetBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, meshOffsetBuffer, sizeof(GLint) * offsetTables.size(), offsetTables.data(), GL_STATIC_DRAW, GPU_MEMORY_SCENE);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (!skinnedMeshes.empty())
+		makeSkinTables();
+
+	glGenBuffers(1, &lightToFrag);
+	glBindBuffer(GL_UNIFORM_BUFFER, lightToFrag);
+	gpuBufferData(GL_UNIFORM_BUFFER, lightToFrag, lightToFragSize, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_SCENE); // static because CPU won't touch it
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// the loader copies the scene in while the programs below are finished
+	if (asyncUpload)
+		startAsyncUpload();
+
+	reportStartupTime("upload the scene", start);
+
+	// Now wait for the programs, which compiled while everything above was done
+	start = startupSeconds();
+
+	if (qualityPreset >= 0)
+	{
+		for (int p = 0; p < QUALITY_PRESETS; p++)
+			qualityPrograms[p] = finishProgram(quality[p]);
+
+		draw_program = qualityPrograms[qualityPreset];
+	}
+	else
+	{
+		draw_program = finishProgram(draw);
+	}
+
+	// Tell our code to use the program
+	glUseProgram(draw_program);
+
+	// the uniform locations, which --hot-reload asks for again when it swaps the programs in
+	getDrawUniforms();
+
+	transform_program = finishProgram(transform);
+	getTransformUniforms();
+	// End of shader and program creation
+
+	bvh_program = finishProgram(bvh);
+
+	// The build shader has one uniform to pick the pass, and a few that describe the size of the tree
+	bvh_pass_loc = glGetUniformLocation(bvh_program, "pass");
+	bvh_numLeaves_loc = glGetUniformLocation(bvh_program, "numLeaves");
+	bvh_earlySplit_loc = glGetUniformLocation(bvh_program, "earlySplit");
+	bvh_treeletSize_loc = glGetUniformLocation(bvh_program, "treeletSize");
+
+	radix_program = finishProgram(radix);
+
+	radix_pass_loc = glGetUniformLocation(radix_program, "pass");
+	radix_numKeys_loc = glGetUniformLocation(radix_program, "numKeys");
+	radix_numBlocks_loc = glGetUniformLocation(radix_program, "numBlocks");
+	radix_bitShift_loc = glGetUniformLocation(radix_program, "bitShift");
+
+	grid_program = finishProgram(grid);
+
+	grid_pass_loc = glGetUniformLocation(grid_program, "pass");
+	grid_numTriangles_loc = glGetUniformLocation(grid_program, "numTriangles");
+
+	light_cull_program = finishProgram(lightCull);
+
+	cull_numLights_loc = glGetUniformLocation(light_cull_program, "numLights");
+	cull_imageWidth_loc = glGetUniformLocation(light_cull_program, "imageWidth");
+	cull_imageHeight_loc = glGetUniformLocation(light_cull_program, "imageHeight");
+	cull_tilesX_loc = glGetUniformLocation(light_cull_program, "tilesX");
+	reportStartupTime("wait for the programs", start);
+
+	if (!sharedCacheUrl.empty())
+		std::cout << "--shared-cache: " << sharedCacheFetched << " files came from the cache, and " << sharedCacheStored << " were put into it" << std::endl;
+}
+
+// Make a framebuffer with one color renderbuffer.
+// The color is 8 bits per channel, like the window, so the frames are the same
+void makeColorFramebuffer(int w, int h, GLuint& fbo, GLuint& color)
+{
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+	trackGpuImage(GL_RENDERBUFFER, color, (size_t)4 * w * h, GPU_MEMORY_IMAGES);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// True if the image is rendered at another size than it is saved
+bool renderIsScaled()
+{
+	return width != outputWidth || height != outputHeight;
+}
+
+// Make the array texture of --frame-batch, with a layer for every frame of a batch, and outputFBO with layer 0
+void makeBatchFramebuffer()
+{
+	glGenTextures(1, &batchTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, batchTexture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, outputWidth, outputHeight, frameBatch);
+	trackGpuImage(GL_TEXTURE, batchTexture, (size_t)4 * outputWidth * outputHeight * frameBatch, GPU_MEMORY_IMAGES);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &outputFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, batchTexture, 0, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Make the textures that --ui-thread copies the frames into for the window, and the framebuffers that copy into them
+void makeUiPreviewTextures()
+{
+	glGenTextures(UI_PREVIEW_SLOTS, uiPreviewTextures);
+	glGenFramebuffers(UI_PREVIEW_SLOTS, uiPreviewFBOs);
+
+	for (int i = 0; i < UI_PREVIEW_SLOTS; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, uiPreviewTextures[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, outputWidth, outputHeight);
+		trackGpuImage(GL_TEXTURE, uiPreviewTextures[i], (size_t)4 * outputWidth * outputHeight, GPU_MEMORY_IMAGES);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, uiPreviewFBOs[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, uiPreviewTextures[i], 0);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// Make the framebuffer that --headless renders into, and the one for a scaled render,
+// and draw into screenFBO from now on
+void makeScreenFramebuffers()
+{
+	if (headless && frameBatch > 1)
+		makeBatchFramebuffer();
+	else if (headless)
+		makeColorFramebuffer(outputWidth, outputHeight, outputFBO, outputColor);
+
+	if (renderIsScaled())
+		makeColorFramebuffer(width, height, screenFBO, screenColor);
+	else
+		screenFBO = outputFBO;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+	glViewport(0, 0, width, height);
+}
+
+// Stretch the rendered image over the output. The blit filters it on the GPU, and leaves
+// the output as the framebuffer that glReadPixels reads, and screenFBO as the one that is drawn to
+void scaleToOutput()
+{
+	if (!renderIsScaled())
+		return;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, screenFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, outputWidth, outputHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+}
+
+// Copy the frame that was just rendered into a free slot of --ui-thread, and hand it to the main thread to show.
+// The output stays the framebuffer that is read, as after scaleToOutput
+void handOffUiFrame()
+{
+	PROFILE_ZONE("hand off frame");
+	int slot = 0;
+	GLsync shown = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+
+		while (slot == uiShownSlot || slot == uiReadySlot)
+			slot++;
+
+		shown = uiShownFences[slot];
+		uiShownFences[slot] = 0;
+	}
+
+	// the main thread may still be drawing it into the window
+	if (shown != 0)
+	{
+		glWaitSync(shown, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(shown);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, uiPreviewFBOs[slot]);
+	glBlitFramebuffer(0, 0, outputWidth, outputHeight, 0, 0, outputWidth, outputHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// another context can only wait for a fence once it has been sent to the GPU
+	glFlush();
+
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+
+		// the frame before was never shown, this one takes its place, and the input that it used is in this one too
+		if (uiReadyFence != 0)
+			glDeleteSync(uiReadyFence);
+
+		if (uiReadySlot < 0 || uiReadyInputTime < 0.0 || (frameInputTime >= 0.0 && frameInputTime < uiReadyInputTime))
+			uiReadyInputTime = frameInputTime;
+
+		uiReadySlot = slot;
+		uiReadyFence = fence;
+	}
+
+	// wakes the main thread up from glfwWaitEvents
+	glfwPostEmptyEvent();
+}
+
+// Show the frame that was just rendered (scaled to the output size), which --headless never does,
+// unless the main thread of --ui-thread shows it
+void presentFrame()
+{
+	scaleToOutput();
+
+	if (!headless)
+	{
+		PROFILE_ZONE("glfwSwapBuffers");
+		glfwSwapBuffers(window);
+	}
+	else if (uiThread)
+	{
+		handOffUiFrame();
+	}
+}
+
+void window_size_callback(GLFWwindow* window, int w, int h)
+{
+	width = w;
+	height = h;
+	glViewport(0, 0, width, height);
+}
+
+// Render at another size from now on. screenFBO is made again for the new size (or is the output, if the
+// render is not scaled anymore), and the buffers of the renderers grow by themselves when they are used
+void resizeRender(int w, int h)
+{
+	if (screenFBO != outputFBO)
+	{
+		glDeleteFramebuffers(1, &screenFBO);
+		forgetGpuImage(GL_RENDERBUFFER, screenColor);
+		glDeleteRenderbuffers(1, &screenColor);
+	}
+
+	width = w;
+	height = h;
+
+	if (renderIsScaled())
+		makeColorFramebuffer(width, height, screenFBO, screenColor);
+	else
+		screenFBO = outputFBO;
+
+	// the frame that was just shown is still read from the output, like after scaleToOutput
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+	glViewport(0, 0, width, height);
+}
+
+// Change the render size of --target-ms for the next frame, from the GPU time of the oldest frame in the ring of timers,
+// if the GPU is done with it (otherwise the size stays, and the time is read after the next frame). The GPU time of a
+// frame is about the number of pixels, which is the square of the scale, so the scale moves by the square root of how
+// far off the time was, and only half of the way, so one slow frame does not make it jump around
+void updateDynamicResolution()
+{
+	if (targetFrameMs <= 0.0f || currentResolutionTimer < 0)
+		return;
+
+	ResolutionTimer& timer = resolutionTimers[(currentResolutionTimer + 1) % FRAME_TIMER_SLICES];
+
+	if (!timer.pending)
+		return;
+
+	GLint available = 0;
+	glGetQueryObjectiv(timer.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if (!available)
+		return;
+
+	GLuint64 start = 0;
+	GLuint64 end = 0;
+	glGetQueryObjectui64v(timer.queries[0], GL_QUERY_RESULT, &start);
+	glGetQueryObjectui64v(timer.queries[1], GL_QUERY_RESULT, &end);
+	timer.pending = false;
+
+	double ms = std::max((double)(end - start) / 1000000.0, 0.01);
+	float ideal = timer.scale * (float)sqrt(targetFrameMs / ms);
+	dynamicScale = glm::clamp(dynamicScale + (ideal - dynamicScale) * 0.5f, DYNAMIC_SCALE_MIN, dynamicScaleMax);
+
+	// The width is a multiple of 16, so that a small change in the time does not make the buffers of every
+	// renderer again every frame. At the largest scale, it is that size exactly
+	int w = std::max(16, (int)(outputWidth * dynamicScale) / 16 * 16);
+
+	if (dynamicScale >= dynamicScaleMax)
+		w = std::max(1, (int)(outputWidth * dynamicScaleMax));
+
+	int h = std::max(1, (int)((double)outputHeight * w / outputWidth + 0.5));
+
+	if (w != width || h != height)
+		resizeRender(w, h);
+}
+
+// Switch to another quality preset. Its draw program was compiled in init, so this only changes
+// which program is used, the bounces, and the render size (unless --render-size gave one)
+void setQualityPreset(int preset)
+{
+	if (qualityPreset < 0 || preset == qualityPreset)
+		return;
+
+	qualityPreset = preset;
+	maxBounces = presetMaxBounces(preset);
+	accumulatedSamples = 0;
+	historyValid = false;
+	draw_program = qualityPrograms[preset];
+	getDrawUniforms();
+
+	if (!renderSizeGiven)
+	{
+		resizeRender(std::max(1, (int)(outputWidth * qualityPresets[preset].renderScale)),
+			std::max(1, (int)(outputHeight * qualityPresets[preset].renderScale)));
+
+		// --target-ms starts again from the size of the preset, which is also as large as it goes
+		dynamicScale = qualityPresets[preset].renderScale;
+		dynamicScaleMax = dynamicScale;
+	}
+
+	std::cout << "quality: " << qualityPresets[preset].name << ", " << width << "x" << height << ", "
+		<< maxBounces << " bounces" << std::endl;
+}
+
+// With --preset, keys 1, 2, and 3 switch to draft, preview, and final. P stops and starts the animation
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action == GLFW_PRESS && key >= GLFW_KEY_1 && key < GLFW_KEY_1 + QUALITY_PRESETS)
+		setQualityPreset(key - GLFW_KEY_1);
+
+	if (action == GLFW_PRESS && key == GLFW_KEY_P)
+		animationPaused = !animationPaused;
+
+	if (action == GLFW_PRESS)
+		noteInput(platformTime());
+}
+
+// The keys of the window of --ui-thread, on the main thread. They are pressed on the render thread (see applyUiInput),
+// since the presets change the programs and the framebuffers
+void ui_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action != GLFW_PRESS)
+		return;
+
+	std::lock_guard<std::mutex> lock(uiMutex);
+	uiKeys.push_back(key);
+
+	if (uiInputTime < 0.0)
+		uiInputTime = platformTime();
+}
+
+// Press the keys of the window of --ui-thread on the render thread, where the frames without it poll the events
+void applyUiInput()
+{
+	std::vector<int> keys;
+
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+		keys.swap(uiKeys);
+
+		// the key came in on the main thread, before it is pressed here
+		if (uiInputTime >= 0.0)
+			noteInput(uiInputTime);
+
+		uiInputTime = -1.0;
+	}
+
+	for (int key : keys)
+		key_callback(window, key, 0, GLFW_PRESS, 0);
+}
+
+// Use what the browsers of --remote-preview sent: their keys are pressed like the keys of the window,
+// and the camera turns around its target, or moves to where they put it
+void applyRemoteInput()
+{
+	RemoteInput input;
+
+	if (!takeRemoteInput(input))
+		return;
+
+	for (int key : input.keys)
+		key_callback(window, key, 0, GLFW_PRESS, 0);
+
+	if (input.hasCamera)
+	{
+		cameraStart = input.position;
+		cameraTarget = input.target;
+	}
+
+	glm::vec3 offset = cameraStart - cameraTarget;
+	offset = glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians(-input.yaw), cameraUp) * glm::vec4(offset, 0.0f));
+
+	// turning up or down stops before the camera looks straight along up, where it has no right side
+	glm::vec3 side = glm::normalize(glm::cross(offset, cameraUp));
+	glm::vec3 turned = glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians(input.pitch), side) * glm::vec4(offset, 0.0f));
+
+	if (fabs(glm::dot(glm::normalize(turned), glm::normalize(cameraUp))) < 0.99f)
+		offset = turned;
+
+	cameraStart = cameraTarget + offset * input.zoom;
+
+	// --accumulate only looks at cameraPos, which is only made from cameraStart when the frame starts
+	accumulatedSamples = 0;
+}
+
+// Render the same frames that the video starts with, and return the average time of a frame in milliseconds.
+// glFinish waits until the GPU is done, so the time includes all of the ray tracing,
+// not just the time to send the commands
+double timeFrames(int frames)
+{
+	totalFrame = 0;
+
+	// the first few frames are slower, while the driver gets ready
+	for (int i = 0; i < 5; i++)
+		renderScene();
+	glFinish();
+
+	double start = platformTime();
+	for (int i = 0; i < frames; i++)
+		renderScene();
+	glFinish();
+	double seconds = platformTime() - start;
+
+	totalFrame = 0;
+	tempFrame = 0;
+
+	return seconds * 1000.0 / frames;
+}
+
+// Render the same frames with the binary BLAS and with the wide BLAS,
+// and print the average time of a frame for each
+void runBVHFormatBenchmark()
+{
+	int savedFormat = blasNodeFormat;
+	int savedAccel = accelBackend;
+	const char* names[2] = { "binary (32 byte nodes)", "wide4 (64 byte nodes)" };
+	int bytes[2] = { twoLevelNodeBufferSize - (int)sizeof(BVHNode) * tlasMaxNodes, wideNodeBufferSize };
+
+	// only the two-level BVH has a BLAS
+	accelBackend = ACCEL_TWO_LEVEL;
+
+	// the wide BLAS of a skinned mesh is not refit, so it is not timed
+	int lastFormat = skinnedMeshes.empty() ? BVH_FORMAT_WIDE4 : BVH_FORMAT_BINARY;
+
+	for (int format = BVH_FORMAT_BINARY; format <= lastFormat; format++)
+	{
+		blasNodeFormat = format;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << "BLAS " << names[format] << ": " << ms
+			<< " ms per frame, " << bytes[format] << " bytes of BLAS nodes" << std::endl;
+	}
+
+	blasNodeFormat = savedFormat;
+	accelBackend = savedAccel;
+}
+
+// Count the visits of every node of the two-level BVH over the first frames of the video, with the fragment shader
+// and the binary BLAS, and put the nodes of every BLAS in the order of layoutBVHByVisits (see --bvh-hot-layout).
+// The nodes of the BLAS of the copies of --lod-geometry are after the ones of their mesh, so every BLAS goes
+// from its root to the next root. The TLAS is built again every frame, and keeps its order
+void layoutBLASByVisits(int frames)
+{
+	int numNodes = twoLevelNodeBufferSize / (int)sizeof(BVHNode);
+
+	countingNodeVisits = true;
+
+	if (!rebuildDrawPrograms())
+	{
+		std::cout << "--bvh-hot-layout: the counters do not compile" << std::endl;
+		countingNodeVisits = false;
+		return;
+	}
+
+	GLuint zero = 0;
+	glGenBuffers(1, &rayCountBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, rayCountBuffer, sizeof(rayCounts) + sizeof(GLuint) * numNodes, nullptr, GL_DYNAMIC_READ, GPU_MEMORY_BENCH);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, rayCountBuffer);
+
+	bool savedWavefront = useWavefront;
+	bool savedTiles = useTiledRender;
+	int savedFormat = blasNodeFormat;
+	useWavefront = false;
+	useTiledRender = false;
+	blasNodeFormat = BVH_FORMAT_BINARY;
+	countingRays = true;
+
+	for (int i = 0; i < frames; i++)
+	{
+		totalFrame = i;
+		renderScene();
+	}
+
+	std::vector<uint32_t> visits(numNodes);
+	gpuRead("node visit readback", { { RES_RAY_COUNTS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+	{
+		GL_STALL_ZONE("glGetBufferSubData (node visits)");
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(rayCounts), sizeof(GLuint) * numNodes, visits.data());
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	gpuDeleteBuffers(1, &rayCountBuffer);
+
+	countingRays = false;
+	countingNodeVisits = false;
+	useWavefront = savedWavefront;
+	useTiledRender = savedTiles;
+	blasNodeFormat = savedFormat;
+	totalFrame = 0;
+	tempFrame = 0;
+
+	if (!rebuildDrawPrograms())
+		std::cout << "the draw program did not compile again" << std::endl;
+
+	std::vector<BVHNode> nodes(numNodes);
+	gpuRead("BLAS readback", { { RES_SKINNED_BLAS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, twoLevelNodeBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, twoLevelNodeBufferSize, nodes.data());
+
+	std::vector<int> roots = blasRoots;
+	roots.insert(roots.end(), lodBlasRoots.begin(), lodBlasRoots.end());
+	std::sort(roots.begin(), roots.end());
+	roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+	for (size_t r = 0; r < roots.size(); r++)
+	{
+		int end = (r + 1 < roots.size()) ? roots[r + 1] : numNodes;
+		layoutBVHByVisits(nodes, roots[r], end - roots[r], visits, BVH_HOT_TREELET_NODES);
+	}
+
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(BVHNode) * tlasMaxNodes, sizeof(BVHNode) * (numNodes - tlasMaxNodes), &nodes[tlasMaxNodes]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// the nodes of the skinned BLAS moved too
+	if (!skinnedMeshes.empty())
+		makeSkinRefitList(nodes);
+
+	int visited = (int)std::count_if(visits.begin() + tlasMaxNodes, visits.end(), [](uint32_t v) { return v > 0; });
+	std::cout << "--bvh-hot-layout: " << visited << " of " << numNodes - tlasMaxNodes << " BLAS nodes were visited in "
+		<< frames << " frames, and are now first in their BLAS" << std::endl;
+}
+
+// Time the frames with the BLAS in the order of the builder, and in the order of --bvh-hot-layout
+void runHotLayoutBenchmark()
+{
+	if (accelBackend != ACCEL_TWO_LEVEL)
+	{
+		std::cout << "--bench-hot-layout needs --accel twolevel" << std::endl;
+		return;
+	}
+
+	double before = timeFrames(benchmarkFrames);
+	layoutBLASByVisits(bvhHotLayoutFrames > 0 ? bvhHotLayoutFrames : 16);
+	double after = timeFrames(benchmarkFrames);
+
+	std::cout << "BLAS in the order of the builder: " << before << " ms per frame" << std::endl;
+	std::cout << "BLAS in the order of the visits: " << after << " ms per frame" << std::endl;
+}
+
+// Render the same frames with 0 to 3 rounds of --bvh-restructure, and print the average time of a frame for each.
+// Refits are turned off, so every frame pays for the rounds, like a scene where everything moves
+void runRestructureBenchmark()
+{
+	if (accelBackend != ACCEL_BVH)
+	{
+		std::cout << "--bench-restructure needs --accel bvh" << std::endl;
+		return;
+	}
+
+	int savedRounds = bvhRestructureRounds;
+	bool savedRefit = bvhAllowRefit;
+	bvhAllowRefit = false;
+
+	for (int rounds = 0; rounds <= 3; rounds++)
+	{
+		bvhRestructureRounds = rounds;
+		std::cout << rounds << " rounds of treelets of " << bvhTreeletSize << " leaves: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+	}
+
+	bvhRestructureRounds = savedRounds;
+	bvhAllowRefit = savedRefit;
+}
+
+// Render the same frames with every acceleration structure, and print the average time of a frame
+// for each. The time includes building the structure, because all of them except the BLAS are built every frame
+void runAccelBenchmark()
+{
+	int savedAccel = accelBackend;
+
+	for (int a = 0; a < NUM_ACCELS; a++)
+	{
+		accelBackend = a;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << "accel " << accelNames[a] << ": " << ms << " ms per frame" << std::endl;
+	}
+
+	accelBackend = savedAccel;
+}
+
+// Render the same frames with the fragment shader and with the wavefront renderer,
+// and print the average time of a frame for each
+void runWavefrontBenchmark()
+{
+	bool savedWavefront = useWavefront;
+
+	useWavefront = false;
+	std::cout << "fragment shader: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+
+	useWavefront = true;
+	std::cout << "wavefront: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+
+	useWavefront = savedWavefront;
+}
+
+// Render the same frames with the fragment shader and with the compute renderer in TiledRender.glsl,
+// with a workgroup for every tile and with the persistent threads, and print the average time of a frame for each
+void runTiledRenderBenchmark()
+{
+	bool savedTiledRender = useTiledRender;
+
+	useTiledRender = false;
+	std::cout << "fragment shader: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+
+	useTiledRender = true;
+	bool savedPersistent = persistentThreads;
+	persistentThreads = false;
+	std::cout << "compute tiles: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+
+	persistentThreads = true;
+	std::cout << "persistent threads: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+
+	bool savedCostOrder = costOrder;
+	costOrder = true;
+	std::cout << "persistent threads, most expensive tiles first: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+	costOrder = savedCostOrder;
+	persistentThreads = savedPersistent;
+
+	// the frustums of the tiles need the BVH
+	if (accelBackend == ACCEL_BVH)
+	{
+		bool savedFrustum = tileFrustum;
+		tileFrustum = true;
+		std::cout << "tile frustums: " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+		tileFrustum = savedFrustum;
+	}
+
+	useTiledRender = savedTiledRender;
+}
+
+// Render the same frames with the compute renderer with the pixels and tiles in rows, and along the Z curve,
+// and print the average time of a frame for each. --persistent-threads and the rest of the options are kept
+void runPixelOrderBenchmark()
+{
+	bool savedTiledRender = useTiledRender;
+	int savedOrder = pixelOrder;
+
+	useTiledRender = true;
+
+	for (int order = PIXEL_ORDER_ROWS; order <= PIXEL_ORDER_MORTON; order++)
+	{
+		pixelOrder = order;
+		std::cout << "pixels in " << pixelOrderNames[order] << ": " << timeFrames(benchmarkFrames) << " ms per frame" << std::endl;
+	}
+
+	pixelOrder = savedOrder;
+	useTiledRender = savedTiledRender;
+}
+
+// Render the same frames with the shadow rays one at a time, and in batches of 4, 8, and 16 (--bench-shadow-batch).
+// The draw program is compiled again for each, and the fastest one is printed
+void runShadowBatchBenchmark()
+{
+	int savedBatch = shadowBatch;
+	int best = 0;
+	double bestMs = -1.0;
+
+	for (int batch : { 0, 4, 8, 16 })
+	{
+		shadowBatch = batch;
+
+		if (!rebuildDrawPrograms())
+		{
+			std::cout << "shadow batch " << batch << ": does not compile" << std::endl;
+			continue;
+		}
+
+		double ms = timeFrames(benchmarkFrames);
+		std::cout << "shadow batch " << batch << ": " << ms << " ms per frame" << std::endl;
+
+		if (bestMs < 0.0 || ms < bestMs)
+		{
+			best = batch;
+			bestMs = ms;
+		}
+	}
+
+	std::cout << "fastest: --shadow-batch " << best << std::endl;
+
+	shadowBatch = savedBatch;
+
+	if (!rebuildDrawPrograms())
+		std::cout << "the draw program did not compile again" << std::endl;
+}
+
+// Time the frames of --accel twolevel with the floor, the cube, and the primitives of the scene file as triangles,
+// and as the shapes of --analytic. The TLAS is built again every frame, so the next frame has the shapes or not
+void runAnalyticBenchmark()
+{
+	if (accelBackend != ACCEL_TWO_LEVEL)
+	{
+		std::cout << "--bench-analytic needs --accel twolevel" << std::endl;
+		return;
+	}
+
+	bool saved = analyticPrimitives;
+
+	for (bool analytic : { false, true })
+	{
+		analyticPrimitives = analytic;
+
+		if (!rebuildDrawPrograms())
+		{
+			std::cout << (analytic ? "analytic" : "triangles") << ": does not compile" << std::endl;
+			continue;
+		}
+
+		double ms = timeFrames(benchmarkFrames);
+		std::cout << (analytic ? "analytic" : "triangles") << ": " << ms << " ms per frame" << std::endl;
+	}
+
+	analyticPrimitives = saved;
+
+	if (!rebuildDrawPrograms())
+		std::cout << "the draw program did not compile again" << std::endl;
+}
+
+// Run TriangleBench.glsl once for every ray-triangle test in TriangleKernels.glsl, and print how many
+// tests per second each one does. It is compiled again for every test, and only its dispatch is timed
+// (with glFinish, like timeFrames), so the time is only the time of the tests, not of anything else in the frame
+void runTriangleKernelBenchmark()
+{
+	int savedAccel = accelBackend;
+
+	// One frame with the brute force loop, so that compToFrag has the triangles in world space.
+	// The two-level BVH leaves them in the meshes
+	accelBackend = ACCEL_BRUTE_FORCE;
+	totalFrame = 0;
+	renderScene();
+	glFinish();
+	accelBackend = savedAccel;
+
+	GLuint benchBuffer;
+	glGenBuffers(1, &benchBuffer);
+
+	std::string source = readShader("../Assets/TriangleBench.glsl");
+	int pixels = width * height;
+
+	for (int k = 0; k < NUM_TRIANGLE_KERNELS; k++)
+	{
+		// the records are in shared memory, which needs to know how many triangles there are
+		std::string defines = "#define NUM_TRIANGLES " + std::to_string(bvhNumTriangles) + "\n";
+		GLuint shader = createShader(addShaderDefines(specializeShader(source, k), defines), GL_COMPUTE_SHADER);
+		GLuint program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glUseProgram(program);
+
+		glUniform1i(glGetUniformLocation(program, "imageWidth"), width);
+		glUniform1i(glGetUniformLocation(program, "imageHeight"), height);
+		glUniform1i(glGetUniformLocation(program, "repeats"), TRIANGLE_BENCH_REPEATS);
+		calcCameraRays(cameraPos, cameraTarget, cameraUp, cameraFov, (float)width / height);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, benchBuffer);
+
+		// once to warm up, and once to measure
+		double seconds = 0.0;
+		GLuint hits = 0;
+
+		for (int run = 0; run < 2; run++)
+		{
+			GLuint zero = 0;
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, benchBuffer);
+			gpuBufferData(GL_SHADER_STORAGE_BUFFER, benchBuffer, sizeof(GLuint), &zero, GL_DYNAMIC_READ, GPU_MEMORY_BENCH);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+			glFinish();
+			double start = platformTime();
+			glDispatchCompute((pixels + 63) / 64, 1, 1);
+			glFinish();
+			seconds = platformTime() - start;
+		}
+
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, benchBuffer);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &hits);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		double tests = (double)pixels * bvhNumTriangles * TRIANGLE_BENCH_REPEATS;
+
+		std::cout << "kernel " << triangleKernelNames[k] << ": " << tests / seconds / 1000000.0
+			<< " million tests per second, " << hits << " hits" << std::endl;
+
+		glDeleteProgram(program);
+		glDeleteShader(shader);
+	}
+
+	gpuDeleteBuffers(1, &benchBuffer);
+
+	totalFrame = 0;
+	tempFrame = 0;
+}
+
+// Test camera rays against every block of triangles of the CPU renderer (CpuKernels.h) with every kernel
+// that this CPU can run, and print how many ray-triangle tests per second each one does. Like
+// runTriangleKernelBenchmark, every ray tests every triangle, without the BVH, so only the kernel is timed.
+// The blocks are the leaves of the BVH of the first frame, so they are as full as they are when rendering
+void runCpuKernelBenchmark()
+{
+	totalFrame = 0;
+	cameraPos = cameraStart;
+
+	float time = sceneTime();
+	makeSceneLights(time);
+
+	CpuScene cpuScene;
+	buildCpuScene(sceneTriangles, sceneMeshOffsets, sceneMatrices(time), sceneLights, cpuScene);
+
+	cameraView camera = makeCameraView(cameraPos, cameraTarget, cameraUp, cameraFov, (float)outputWidth / outputHeight);
+
+	std::vector<glm::vec3> rays;
+
+	for (int y = 0; y < CPU_KERNEL_BENCH_SIZE; y++)
+	{
+		for (int x = 0; x < CPU_KERNEL_BENCH_SIZE; x++)
+		{
+			glm::vec2 pos((x + 0.5f) / CPU_KERNEL_BENCH_SIZE, (y + 0.5f) / CPU_KERNEL_BENCH_SIZE);
+			rays.push_back(glm::normalize(glm::mix(
+				glm::mix(camera.ray00, camera.ray01, pos.y),
+				glm::mix(camera.ray10, camera.ray11, pos.y), pos.x)));
+		}
+	}
+
+	int numTriangles = (int)cpuScene.surfaces.size();
+	int numBlocks = (int)cpuScene.blocks.size();
+
+	std::cout << numTriangles << " triangles in " << numBlocks << " blocks, "
+		<< 100.0 * numTriangles / (numBlocks * CPU_BLOCK_WIDTH) << "% of the lanes used" << std::endl;
+
+	for (int k = 0; k < NUM_CPU_KERNELS; k++)
+	{
+		if (!cpuKernelSupported(k))
+		{
+			std::cout << "kernel " << cpuKernelNames[k] << ": not supported by this CPU" << std::endl;
+			continue;
+		}
+
+		CpuBlockKernel kernel = cpuBlockKernels[k];
+
+		// once to warm up, and once to measure
+		double seconds = 0.0;
+		int hits = 0;
+
+		for (int run = 0; run < 2; run++)
+		{
+			hits = 0;
+			double start = platformTime();
+
+			for (int repeat = 0; repeat < CPU_KERNEL_BENCH_REPEATS; repeat++)
+			{
+				for (const glm::vec3& dir : rays)
+				{
+					for (const CpuTriangleBlock& block : cpuScene.blocks)
+					{
+						float tmax = 100.0f;
+
+						if (kernel(block, cameraPos, dir, tmax, false) >= 0)
+							hits++;
+					}
+				}
+			}
+
+			seconds = platformTime() - start;
+		}
+
+		double tests = (double)rays.size() * numTriangles * CPU_KERNEL_BENCH_REPEATS;
+
+		// every kernel finds the same hits, so they all print the same count
+		std::cout << "kernel " << cpuKernelNames[k] << ": " << tests / seconds / 1000000.0
+			<< " million tests per second, " << hits << " hits" << std::endl;
+	}
+
+	totalFrame = 0;
+}
+
+// Make the matrices of animationBenchTracks random tracks, with 4 keys each and every easing, a few times with
+// evaluateAnimation (SSE) and with evaluateAnimationScalar, and print how long each one takes and how far apart
+// their matrices are. Every track moves its own mesh, like a scene with that many meshes
+void runAnimationBenchmark()
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> number(-1.0f, 1.0f);
+
+	AnimationTracks tracks;
+
+	for (int i = 0; i < animationBenchTracks; i++)
+	{
+		addAnimationTrack(tracks, i, (i % 2) ? 4.0f : 0.0f);
+
+		for (int k = 0; k < 4; k++)
+		{
+			glm::vec3 axis(number(random), number(random), number(random));
+
+			if (glm::length(axis) == 0.0f)
+				axis = glm::vec3(0.0f, 1.0f, 0.0f);
+
+			addAnimationKey(tracks, (float)k, (i + k) % NUM_EASINGS,
+				glm::vec3(number(random), number(random), number(random)) * 10.0f,
+				axis, number(random) * 360.0f, glm::vec3(number(random), number(random), number(random)) + 2.0f);
+		}
+	}
+
+	std::vector<glm::mat4> simd(animationBenchTracks);
+	std::vector<glm::mat4> scalar(animationBenchTracks);
+	double seconds[2] = {};
+	float difference = 0.0f;
+
+	// once to warm up, and once to measure
+	for (int run = 0; run < 2; run++)
+	{
+		for (int way = 0; way < 2; way++)
+		{
+			double start = platformTime();
+
+			for (int repeat = 0; repeat < ANIMATION_BENCH_REPEATS; repeat++)
+			{
+				float time = repeat * 0.05f - 0.5f;
+
+				if (way == 0)
+					evaluateAnimation(tracks, time, simd.data(), animationBenchTracks);
+				else
+					evaluateAnimationScalar(tracks, time, scalar.data(), animationBenchTracks);
+			}
+
+			seconds[way] = platformTime() - start;
+		}
+	}
+
+	// both have the matrices of the last time
+	for (int i = 0; i < animationBenchTracks; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			for (int r = 0; r < 4; r++)
+				difference = std::max(difference, std::abs(simd[i][c][r] - scalar[i][c][r]));
+		}
+	}
+
+	std::cout << animationBenchTracks << " tracks: SSE " << seconds[0] * 1000.0 / ANIMATION_BENCH_REPEATS
+		<< " ms, scalar " << seconds[1] * 1000.0 / ANIMATION_BENCH_REPEATS << " ms per time ("
+		<< seconds[1] / seconds[0] << "x), largest difference " << difference << std::endl;
+}
+
+// Time the transform pass alone, on a scene of transformBenchTriangles triangles, with a few workgroup sizes.
+// The scene is a grid of cubes, which are copies of the cube mesh, each with its own matrix.
+// Every cube is welded into 8 vertices, like the real scene (see makeIndexedMeshes).
+// Compute.glsl is compiled again for each size
+void runTransformBenchmark()
+{
+	int numTriangles = transformBenchTriangles;
+	int numMeshes = (numTriangles + 11) / 12;
+
+	// the cube of the real scene, to copy
+	const triangle* cube = &sceneTriangles[sceneMeshOffsets[1]];
+
+	std::vector<triangle> triangles(numTriangles);
+	std::vector<int> meshTriangleCounts(numMeshes, 12);
+	std::vector<glm::mat4x4> matrices(numMeshes);
+	std::vector<GLuint> emptyBoxes(numMeshes * 8, 0);
+
+	for (int i = 0; i < numTriangles; i++)
+		triangles[i] = cube[i % 12];
+
+	// the last cube only has the triangles that are left
+	meshTriangleCounts[numMeshes - 1] = numTriangles - 12 * (numMeshes - 1);
+
+	int side = (int)ceil(sqrt((double)numMeshes));
+
+	for (int m = 0; m < numMeshes; m++)
+	{
+		matrices[m] = glm::translate(glm::mat4(), glm::vec3(2.0f * (m % side), 0.0f, 2.0f * (m / side)));
+		matrices[m] = glm::rotate(matrices[m], 0.1f * m, glm::vec3(0, 1, 0));
+
+		// 0xFFFFFFFF is the biggest possible min, and 0 is the smallest possible max
+		emptyBoxes[m * 8 + 0] = emptyBoxes[m * 8 + 1] = emptyBoxes[m * 8 + 2] = 0xFFFFFFFF;
+	}
+
+	std::vector<GLint> meshOffsets = makeMeshOffsets(meshTriangleCounts);
+
+	std::vector<glm::vec4> vertices;
+	std::vector<indexedTriangle> indexed;
+	std::vector<GLint> vertexOffsets;
+	makeIndexedMeshes(triangles, meshOffsets, vertices, indexed, vertexOffsets);
+	int numVertices = (int)vertices.size();
+
+	meshOffsets.insert(meshOffsets.end(), vertexOffsets.begin(), vertexOffsets.end());
+
+	GLuint buffers[8];
+	glGenBuffers(8, buffers);
+
+	// the triangles, and their records (see compToFragSize and triangleRecordBufferSize)
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[0], sizeof(triangle) * (size_t)numTriangles, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[5]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[5], sizeof(glm::vec4) * 3 * (size_t)numTriangles, nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[1], sizeof(glm::vec4) * vertices.size(), vertices.data(), GL_STATIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[6]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[6], sizeof(indexedTriangle) * indexed.size(), indexed.data(), GL_STATIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[7]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[7], sizeof(glm::vec4) * vertices.size(), nullptr, GL_DYNAMIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[2], sizeof(glm::mat4x4) * numMeshes, matrices.data(), GL_STATIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[3]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[3], sizeof(GLuint) * emptyBoxes.size(), emptyBoxes.data(), GL_DYNAMIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[4]);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, buffers[4], sizeof(GLint) * meshOffsets.size(), meshOffsets.data(), GL_STATIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[2]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, buffers[3]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, buffers[4]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, buffers[5]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, buffers[6]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, buffers[7]);
+
+	std::string source = specializeShader(readShader("../Assets/Compute.glsl"), triangleKernel);
+
+	// 1 is the size that Compute.glsl used to have
+	int groupSizes[4] = { 1, 64, 128, 256 };
+
+	for (int g = 0; g < 4; g++)
+	{
+		std::string defines = "#define TRANSFORM_GROUP_SIZE " + std::to_string(groupSizes[g]) + "\n";
+
+		GLuint shader = createShader(addShaderDefines(source, defines), GL_COMPUTE_SHADER);
+		GLuint program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "numVertices"), numVertices);
+		glUniform1i(glGetUniformLocation(program, "numTriangles"), numTriangles);
+		glUniform1i(glGetUniformLocation(program, "numMeshes"), numMeshes);
+		GLint passLoc = glGetUniformLocation(program, "pass");
+		GLint numJobsLoc = glGetUniformLocation(program, "numJobs");
+
+		// once to warm up, then the average of a few
+		runTransformPasses(passLoc, numJobsLoc, numVertices, numTriangles, groupSizes[g]);
+		glFinish();
+
+		int runs = 5;
+		double start = platformTime();
+
+		for (int run = 0; run < runs; run++)
+			runTransformPasses(passLoc, numJobsLoc, numVertices, numTriangles, groupSizes[g]);
+
+		glFinish();
+		double ms = (platformTime() - start) * 1000.0 / runs;
+
+		std::cout << "transform, " << groupSizes[g] << " triangles per workgroup: " << ms
+			<< " ms for " << numTriangles << " triangles (" << numVertices << " vertices instead of "
+			<< 3 * numTriangles << " corners) in " << numMeshes << " meshes" << std::endl;
+
+		glDeleteProgram(program);
+		glDeleteShader(shader);
+	}
+
+	// The same scene, when only one mesh in 16 moved, with the transform program of the renderer
+	std::vector<bool> dirty(numMeshes, false);
+	for (int m = 0; m < numMeshes; m += 16)
+		dirty[m] = true;
+
+	std::vector<glm::ivec4> dirtyList = makeDirtyList(dirty, meshOffsets, vertexOffsets);
+	int numDirty = (int)dirtyList.size() - 1;
+
+	GLuint dirtyBuffer;
+	glGenBuffers(1, &dirtyBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dirtyBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, dirtyBuffer, sizeof(glm::ivec4) * dirtyList.size(), dirtyList.data(), GL_STATIC_DRAW, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, dirtyBuffer);
+
+	glUseProgram(transform_program);
+	glUniform1i(transform_numVertices_loc, numVertices);
+	glUniform1i(transform_numTriangles_loc, numTriangles);
+	glUniform1i(transform_numMeshes_loc, numMeshes);
+	glUniform1i(transform_dirtyOnly_loc, 1);
+	glUniform1i(transform_numDirty_loc, numDirty);
+	glUniform1i(transform_skinning_loc, 0);
+	glUniform1i(transform_meshSpace_loc, 0);
+
+	runTransformPasses(transform_pass_loc, transform_numJobs_loc, dirtyList.back().y, dirtyList.back().z, transformGroupSize);
+	glFinish();
+
+	int runs = 5;
+	double start = platformTime();
+
+	for (int run = 0; run < runs; run++)
+		runTransformPasses(transform_pass_loc, transform_numJobs_loc, dirtyList.back().y, dirtyList.back().z, transformGroupSize);
+
+	glFinish();
+	double ms = (platformTime() - start) * 1000.0 / runs;
+
+	std::cout << "transform, only " << numDirty << " of " << numMeshes << " meshes moved: " << ms
+		<< " ms for " << dirtyList.back().z << " triangles" << std::endl;
+
+	glUniform1i(transform_dirtyOnly_loc, 0);
+	gpuDeleteBuffers(1, &dirtyBuffer);
+	gpuDeleteBuffers(8, buffers);
+}
+
+// Render the same frames with both forms of the triangles, and print the average time of a frame for each.
+// The two-level BVH does not use them, so this uses the brute force loop, unless --accel picked something else
+void runTriangleFormatBenchmark()
+{
+	int savedFormat = triangleFormat;
+	int savedAccel = accelBackend;
+
+	if (accelBackend == ACCEL_TWO_LEVEL)
+		accelBackend = ACCEL_BRUTE_FORCE;
+
+	for (int format = TRIANGLE_FORMAT_VERTICES; format <= TRIANGLE_FORMAT_RECORDS; format++)
+	{
+		triangleFormat = format;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << "triangles as " << triangleFormatNames[format] << " (" << accelNames[accelBackend] << "): "
+			<< ms << " ms per frame" << std::endl;
+	}
+
+	triangleFormat = savedFormat;
+	accelBackend = savedAccel;
+}
+
+// The frames that --autotune compares the stacks with: the first, middle, and last frame of the video,
+// since the trees of the scene change as it moves. Returns a hash of all of their pixels
+uint64_t hashTuneFrames()
+{
+	int rowBytes = (3 * outputWidth + 3) & ~3;
+	std::vector<unsigned char> pixels((size_t)rowBytes * outputHeight);
+	uint64_t hash = 14695981039346656037ull;
+
+	for (int frame : { 0, maxFrames / 2, maxFrames - 1 })
+	{
+		totalFrame = std::max(frame, 0);
+		renderScene();
+		presentFrame();
+		glFinish();
+
+		glReadPixels(0, 0, outputWidth, outputHeight, GL_BGR, GL_UNSIGNED_BYTE, pixels.data());
+		hash = hashBytes(hash, pixels.data(), pixels.size());
+	}
+
+	totalFrame = 0;
+	tempFrame = 0;
+
+	return hash;
+}
+
+// Time the same frames with setting at every one of values, print the time of each, and leave setting at the fastest.
+// With compiled, setting is a #define, and the draw and transform programs are compiled again for every value.
+// With sameImage, a value is only kept if its frames look the same as the ones of the first value
+void tuneChoice(const char* key, int& setting, const std::vector<int>& values, const char* const* names, bool compiled, bool sameImage)
+{
+	int best = setting;
+	double bestMs = -1.0;
+	uint64_t reference = 0;
+
+	for (size_t v = 0; v < values.size(); v++)
+	{
+		setting = values[v];
+		std::string name = names ? names[setting] : std::to_string(setting);
+
+		if (compiled && !rebuildDrawPrograms())
+		{
+			std::cout << key << " " << name << ": does not compile" << std::endl;
+			continue;
+		}
+
+		if (sameImage)
+		{
+			uint64_t hash = hashTuneFrames();
+
+			if (v == 0)
+			{
+				reference = hash;
+			}
+			else if (hash != reference)
+			{
+				std::cout << key << " " << name << ": the frames are not the same, skipped" << std::endl;
+				continue;
+			}
+		}
+
+		double ms = timeFrames(tuneFrames);
+		std::cout << key << " " << name << ": " << ms << " ms per frame" << std::endl;
+
+		if (bestMs < 0.0 || ms < bestMs)
+		{
+			bestMs = ms;
+			best = setting;
+		}
+	}
+
+	setting = best;
+}
+
+// --autotune: time every choice on the scene, one after another, keep the fastest of each, and save them as the
+// profile of this GPU. Only the fragment shader renderer is timed, since the choices are all in the draw program
+// and the transform pass. The other renderers compile their programs the first time they are used, so they get the
+// winners too. A choice that is on the command line is not tuned
+void runAutotune()
+{
+	std::cout << "tuning for " << glGetString(GL_RENDERER) << std::endl;
+
+	bool savedWavefront = useWavefront;
+	bool savedTiledRender = useTiledRender;
+	bool savedVisibility = useVisibilityBuffer;
+	int savedAccel = accelBackend;
+	int savedKernel = triangleKernel;
+	int savedGroupSize = transformGroupSize;
+	int savedStackSize = bvhStackSize;
+
+	useWavefront = false;
+	useTiledRender = false;
+	useVisibilityBuffer = false;
+
+	// only the two-level BVH has a BLAS, and the skinned meshes only refit the binary one
+	if (!choicesOnCommandLine.count("blas-format") && skinnedMeshes.empty())
+	{
+		accelBackend = ACCEL_TWO_LEVEL;
+		tuneChoice("blas-format", blasNodeFormat, { BVH_FORMAT_BINARY, BVH_FORMAT_WIDE4 }, bvhFormatNames, false, false);
+	}
+
+	// and it is the only one that does not read the form of the triangles
+	if (!choicesOnCommandLine.count("tri-format"))
+	{
+		accelBackend = (savedAccel == ACCEL_TWO_LEVEL) ? ACCEL_BVH : savedAccel;
+		tuneChoice("tri-format", triangleFormat, { TRIANGLE_FORMAT_VERTICES, TRIANGLE_FORMAT_RECORDS }, triangleFormatNames, false, false);
+	}
+
+	// the ones that are compiled in are timed with the structure of the run
+	accelBackend = savedAccel;
+
+	if (!choicesOnCommandLine.count("tri-kernel"))
+	{
+		tuneChoice("tri-kernel", triangleKernel, { TRIANGLE_KERNEL_MOLLER_TRUMBORE, TRIANGLE_KERNEL_BALDWIN_WEBER,
+			TRIANGLE_KERNEL_WATERTIGHT }, triangleKernelNames, true, false);
+	}
+
+	if (!choicesOnCommandLine.count("transform-group-size"))
+		tuneChoice("transform-group-size", transformGroupSize, { 32, 64, 128, 256 }, nullptr, true, false);
+
+	// Only the BVH and the two-level BVH have a stack. The default size is the first, so it is the image
+	// that the smaller ones must make
+	tunedStackSize = 0;
+
+	if (!choicesOnCommandLine.count("bvh-stack") && (accelBackend == ACCEL_BVH || accelBackend == ACCEL_TWO_LEVEL))
+	{
+		tuneChoice("bvh-stack", bvhStackSize, { BVH_STACK_SIZE_DEFAULT, 48, 32 }, nullptr, true, true);
+		tunedStackSize = bvhStackSize;
+		tunedStackScene = sceneCaptureHash();
+		tunedStackAccel = accelBackend;
+	}
+
+	// the winners of the ones that are compiled in are compiled once more
+	if ((triangleKernel != savedKernel || transformGroupSize != savedGroupSize || bvhStackSize != savedStackSize) &&
+		!rebuildDrawPrograms())
+		std::cout << "the tuned shaders did not compile" << std::endl;
+
+	useWavefront = savedWavefront;
+	useTiledRender = savedTiledRender;
+	useVisibilityBuffer = savedVisibility;
+
+	saveTuneProfile();
+
+	totalFrame = 0;
+	tempFrame = 0;
+}
+
+// Render the same frames with camera rays and with the visibility buffer,
+// and print the average time of a frame for each
+void runVisibilityBenchmark()
+{
+	bool savedVisibility = useVisibilityBuffer;
+
+	for (int visibility = 0; visibility <= 1; visibility++)
+	{
+		useVisibilityBuffer = visibility == 1;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << (useVisibilityBuffer ? "visibility buffer: " : "camera rays: ") << ms << " ms per frame" << std::endl;
+	}
+
+	useVisibilityBuffer = savedVisibility;
+}
+
+// Render the same frames with and without the light lists of the tiles,
+// and print the average time of a frame for each
+void runTiledLightBenchmark()
+{
+	bool savedTiled = tiledLightCulling;
+
+	for (int tiled = 0; tiled <= 1; tiled++)
+	{
+		tiledLightCulling = tiled == 1;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << (tiledLightCulling ? "tiled lights: " : "every light: ") << ms
+			<< " ms per frame, " << 2 + numExtraLights << " lights" << std::endl;
+	}
+
+	tiledLightCulling = savedTiled;
+}
+
+// Render the same frames with and without the light grid, and print the average time of a frame for each
+void runLightGridBenchmark()
+{
+	bool savedGrid = lightGridEnabled;
+
+	for (int grid = 0; grid <= 1; grid++)
+	{
+		lightGridEnabled = grid == 1;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << (lightGridEnabled ? "light grid: " : "no light grid: ") << ms
+			<< " ms per frame, " << 2 + numExtraLights << " lights" << std::endl;
+	}
+
+	lightGridEnabled = savedGrid;
+}
+
+// Render the same frames with glBufferData uploads and with the mapped rings, and print
+// the average time of a frame, and how often the CPU had to wait for a slice of a ring
+void runUploadBenchmark()
+{
+	bool savedPersistent = persistentUploads;
+
+	for (int ring = 0; ring <= 1; ring++)
+	{
+		// without GL_ARB_buffer_storage there are no rings to time
+		if (ring == 1 && !GLEW_ARB_buffer_storage)
+			break;
+
+		persistentUploads = ring == 1;
+		uploadRingWaits = 0;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << (persistentUploads ? "mapped rings: " : "glBufferData: ") << ms << " ms per frame";
+
+		if (persistentUploads)
+			std::cout << ", waited for a slice " << uploadRingWaits << " times";
+
+		std::cout << std::endl;
+	}
+
+	persistentUploads = savedPersistent;
+}
+
+// Render the same frames with the wavefront renderer, without and with sorting the reflection rays.
+// Besides the whole frame, this prints how long the GPU spent in EXTEND, and how long the sort took,
+// so we can see if the faster traversal is worth the cost of the sort
+void runWaveSortBenchmark()
+{
+	bool savedWavefront = useWavefront;
+	bool savedSort = waveSortRays;
+
+	useWavefront = true;
+	waveTimeStages = true;
+
+	for (int sort = 0; sort <= 1; sort++)
+	{
+		waveSortRays = sort == 1;
+
+		// timeFrames renders 5 frames to warm up, which are measured too
+		waveSortTime = 0;
+		waveExtendTime = 0;
+		double ms = timeFrames(benchmarkFrames);
+		double frames = benchmarkFrames + 5.0;
+
+		std::cout << (waveSortRays ? "sorted rays: " : "unsorted rays: ") << ms << " ms per frame, "
+			<< waveExtendTime / frames / 1000000.0 << " ms in extend, "
+			<< waveSortTime / frames / 1000000.0 << " ms sorting" << std::endl;
+	}
+
+	waveTimeStages = false;
+	useWavefront = savedWavefront;
+	waveSortRays = savedSort;
+}
+
+// Render the same frames with the wavefront renderer and the BVH, with every thread walking the BVH
+// on its own, and with the threads of a subgroup walking it together. Print the average time
+// of a frame, and the time in EXTEND, for each
+void runSubgroupTraversalBenchmark()
+{
+	bool savedWavefront = useWavefront;
+	bool savedSubgroup = waveSubgroupTraversal;
+	int savedAccel = accelBackend;
+
+	useWavefront = true;
+	accelBackend = ACCEL_BVH;
+	waveTimeStages = true;
+
+	for (int subgroup = 0; subgroup <= 1; subgroup++)
+	{
+		waveSubgroupTraversal = subgroup == 1;
+
+		waveSortTime = 0;
+		waveExtendTime = 0;
+		double ms = timeFrames(benchmarkFrames);
+		double frames = benchmarkFrames + 5.0;
+
+		std::cout << (waveSubgroupTraversal ? "subgroup stack: " : "stack per thread: ") << ms << " ms per frame, "
+			<< waveExtendTime / frames / 1000000.0 << " ms in extend" << std::endl;
+	}
+
+	waveTimeStages = false;
+	useWavefront = savedWavefront;
+	waveSubgroupTraversal = savedSubgroup;
+	accelBackend = savedAccel;
+}
+
+// Render the same frames with the wavefront renderer, with the dispatches sized on the GPU and with
+// every dispatch as big as the biggest queue, and print the average time of a frame for each
+void runWaveIndirectBenchmark()
+{
+	bool savedWavefront = useWavefront;
+	bool savedIndirect = waveIndirectDispatch;
+
+	useWavefront = true;
+
+	for (int indirect = 0; indirect <= 1; indirect++)
+	{
+		waveIndirectDispatch = indirect == 1;
+		double ms = timeFrames(benchmarkFrames);
+
+		std::cout << (waveIndirectDispatch ? "indirect dispatch: " : "full dispatch: ") << ms << " ms per frame" << std::endl;
+	}
+
+	useWavefront = savedWavefront;
+	waveIndirectDispatch = savedIndirect;
+}
+
+// Encode a bitmap as a QOI file (https://qoiformat.org), top row first, in RGB, into bytes.
+// Every pixel becomes the shortest of: more of the same pixel as before, a pixel from the table of 64 that
+// were seen recently, a small difference from the pixel before, or the whole pixel
+void encodeQOI(FIBITMAP* image, std::vector<unsigned char>& bytes)
+{
+	const unsigned char* bits = FreeImage_GetBits(image);
+	int pitch = FreeImage_GetPitch(image);
+
+	bytes.clear();
+	bytes.reserve((size_t)4 * outputWidth * outputHeight);
+
+	auto put32 = [&bytes](unsigned int v)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			bytes.push_back((unsigned char)(v >> shift));
+	};
+
+	// the header: "qoif", the size, 3 channels, and sRGB
+	bytes.insert(bytes.end(), { 'q', 'o', 'i', 'f' });
+	put32(outputWidth);
+	put32(outputHeight);
+	bytes.push_back(3);
+	bytes.push_back(0);
+
+	// The table is RGBA and starts as transparent black, like the one of a decoder, so an opaque black
+	// pixel is not found in it until it was put there (the pixels themselves always have alpha 255)
+	unsigned char seen[64][4] = {};
+	unsigned char previous[3] = { 0, 0, 0 };
+	int run = 0;
+
+	for (int y = outputHeight - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < outputWidth; x++)
+		{
+			// FreeImage has the bottom row first, in BGR
+			const unsigned char* bgr = bits + y * pitch + x * 3;
+			unsigned char pixel[3] = { bgr[2], bgr[1], bgr[0] };
+			bool last = y == 0 && x == outputWidth - 1;
+
+			if (pixel[0] == previous[0] && pixel[1] == previous[1] && pixel[2] == previous[2])
+			{
+				run++;
+
+				if (run == 62 || last)
+				{
+					bytes.push_back((unsigned char)(0xC0 | (run - 1)));
+					run = 0;
+				}
+
+				continue;
+			}
+
+			if (run > 0)
+			{
+				bytes.push_back((unsigned char)(0xC0 | (run - 1)));
+				run = 0;
+			}
+
+			// alpha is always 255
+			int hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + 255 * 11) % 64;
+
+			if (seen[hash][0] == pixel[0] && seen[hash][1] == pixel[1] && seen[hash][2] == pixel[2] && seen[hash][3] == 255)
+			{
+				bytes.push_back((unsigned char)hash);
+			}
+			else
+			{
+				memcpy(seen[hash], pixel, 3);
+				seen[hash][3] = 255;
+
+				// the differences wrap around, like the bytes do
+				int dr = (signed char)(pixel[0] - previous[0]);
+				int dg = (signed char)(pixel[1] - previous[1]);
+				int db = (signed char)(pixel[2] - previous[2]);
+				int drg = dr - dg;
+				int dbg = db - dg;
+
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				{
+					bytes.push_back((unsigned char)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+				}
+				else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+				{
+					bytes.push_back((unsigned char)(0x80 | (dg + 32)));
+					bytes.push_back((unsigned char)((drg + 8) << 4 | (dbg + 8)));
+				}
+				else
+				{
+					bytes.insert(bytes.end(), { 0xFE, pixel[0], pixel[1], pixel[2] });
+				}
+			}
+
+			memcpy(previous, pixel, 3);
+		}
+	}
+
+	// the end of the file
+	bytes.insert(bytes.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+}
+
+// Write a bitmap as a QOI file
+void writeQOI(FIBITMAP* image, const char* fileName)
+{
+	std::vector<unsigned char> bytes;
+	encodeQOI(image, bytes);
+
+	std::ofstream file(fileName, std::ios::binary);
+	file.write((const char*)bytes.data(), bytes.size());
+}
+
+// Write the pixels of a bitmap just as they are, BGR with the bottom row first
+void writeRawFrame(FIBITMAP* image, const char* fileName)
+{
+	const unsigned char* bits = FreeImage_GetBits(image);
+	int pitch = FreeImage_GetPitch(image);
+
+	std::ofstream file(fileName, std::ios::binary);
+
+	for (int y = 0; y < outputHeight; y++)
+		file.write((const char*)bits + y * pitch, 3 * outputWidth);
+}
+
+// How many frames are in a segment, the last one can be shorter
+int segmentLength(int segment)
+{
+	return std::min(segmentFrames, maxFrames - segment * segmentFrames);
+}
+
+void encodeFrameRange(int first, int count, const std::string& output);
+
+// Make exportedFrames/segment_<n>.avi on a thread of its own. encodeMutex must be locked while the jobs that save frames run.
+// It is a thread and not a job, because it only waits for ffmpeg
+void startSegmentEncoder(int segment)
+{
+	segmentStarted[segment] = true;
+
+	std::string output = framesFolder + "/segment_" + std::to_string(segment) + ".avi";
+	int first = 1 + segment * segmentFrames;
+	int count = segmentLength(segment);
+
+	segmentEncoders.push_back(std::thread([first, count, output]
+	{
+		nameProfileThread("segment encoder");
+		PROFILE_ZONE("encode segment");
+		encodeFrameRange(first, count, output);
+	}));
+}
+
+// The bytes of a frame that is read back: BGR, or the planes of YUV 4:2:0 with --yuv-readback
+size_t readbackFrameBytes()
+{
+	size_t pixels = (size_t)outputWidth * outputHeight;
+	return yuvReadback ? pixels * 3 / 2 : pixels * 3;
+}
+
+// Copy a frame into the next slot of the frame ring of --shm-encoder, and give it to the encoder
+void writeRingFrame(const unsigned char* pixels, size_t bytes)
+{
+	PROFILE_ZONE("copy into frame ring");
+
+	unsigned char* slot = beginRingFrame(frameRing);
+
+	if (slot == nullptr)
+	{
+		std::cout << "the encoder of the frame ring has ended, the frames after it are lost" << std::endl;
+		return;
+	}
+
+	memcpy(slot, pixels, bytes);
+	endRingFrame(frameRing);
+}
+
+// Take a frame from the pool, with a bitmap, or bytes when streamed is true, that can hold the output
+PooledFrame* takePooledFrame(bool streamed)
+{
+	PooledFrame* pooled = nullptr;
+	framePoolFrames++;
+
+	if (!tryPopQueue(freeFrames, pooled))
+	{
+		pooled = new PooledFrame();
+		framePoolAllocations++;
+	}
+
+	if (streamed && pooled->bytes.empty())
+	{
+		pooled->bytes.resize(readbackFrameBytes());
+		framePoolAllocations++;
+	}
+
+	if (!streamed && pooled->image == nullptr)
+	{
+		pooled->image = FreeImage_Allocate(outputWidth, outputHeight, 24, 0xFF0000, 0x00FF00, 0x0000FF);
+		framePoolAllocations++;
+	}
+
+	return pooled;
+}
+
+// Free a frame of the pool
+void deletePooledFrame(PooledFrame* pooled)
+{
+	if (pooled->image != nullptr)
+		FreeImage_Unload(pooled->image);
+
+	delete pooled;
+}
+
+// Put a frame back into the pool, once it is saved. Any thread can do it
+void returnPooledFrame(PooledFrame* pooled)
+{
+	if (!tryPushQueue(freeFrames, pooled))
+		deletePooledFrame(pooled);
+}
+
+// Free every frame of the pool, after the last one is saved
+void freeFramePool()
+{
+	PooledFrame* pooled;
+
+	while (tryPopQueue(freeFrames, pooled))
+		deletePooledFrame(pooled);
+}
+
+// The thread that writes the frames of pipeFrames into their pipes, until the queue is closed
+void runPipeWriter()
+{
+	PipeFrame frame;
+
+	while (popQueue(pipeFrames, frame))
+	{
+		{
+			PROFILE_ZONE("write to ffmpeg");
+			fwrite(frame.pooled->bytes.data(), 1, frame.pooled->bytes.size(), frame.pipe);
+		}
+
+		returnPooledFrame(frame.pooled);
+		pipeFramesWritten.fetch_add(1, std::memory_order_release);
+	}
+}
+
+// Hand a frame of the pool to the writer of the pipe, which is started the first time. Waits while the queue is full
+void pushPipeFrame(PooledFrame* pooled)
+{
+	if (!pipeWriter.joinable())
+		pipeWriter = std::thread(runPipeWriter);
+
+	PipeFrame frame = { pooled, videoPipe };
+
+	if (!tryPushQueue(pipeFrames, frame))
+	{
+		double start = platformTime();
+		pushQueue(pipeFrames, frame);
+		addFrameWaitTime(platformTime() - start, true);
+	}
+
+	pipeFramesPushed++;
+}
+
+// Wait until the writer of the pipe has written every frame that was pushed
+void finishPipeFrames()
+{
+	for (int tries = 0; pipeFramesWritten.load(std::memory_order_acquire) != pipeFramesPushed; tries++)
+		frameQueueBackoff(tries);
+}
+
+// End the writer of the pipe, once it has written the frames that are left
+void stopPipeWriter()
+{
+	if (!pipeWriter.joinable())
+		return;
+
+	closeQueue(pipeFrames);
+	pipeWriter.join();
+}
+
+// exportedFrames/<frame>.<format>
+std::string frameFileName(int frame)
+{
+	return framesFolder + "/" + std::to_string(frame) + "." + frameFormatNames[frameFormat];
+}
+
+// Add a frame that is saved to the list of saved frames, and to its segment
+void addSavedFrame(int frame)
+{
+	std::lock_guard<std::mutex> lock(encodeMutex);
+
+	// flush, so that the line is there even if the program dies right after this
+	frameManifest << frame << std::endl;
+
+	// the segment can be encoded once it has all of its frames
+	if (!segmentFramesSaved.empty())
+	{
+		int segment = (frame - 1) / segmentFrames;
+		segmentFramesSaved[segment]++;
+
+		if (segmentFramesSaved[segment] == segmentLength(segment))
+			startSegmentEncoder(segment);
+	}
+}
+
+// Save a mezzanine frame: the delta of pixels to the frame before, or a keyframe when reference is null.
+// Both are the packed bytes of a frame of the pool, which go back into the pool once no frame needs them
+void encodeMezzanineFrame(std::shared_ptr<PooledFrame> pixels, std::shared_ptr<PooledFrame> reference, int frame)
+{
+	double start = platformTime();
+	std::vector<unsigned char> file;
+
+	{
+		PROFILE_ZONE("encode mezzanine");
+		encodeMezzanine(pixels->bytes.data(), reference ? reference->bytes.data() : nullptr, frame - 1,
+			outputWidth, outputHeight, frame, file);
+	}
+
+	pixels.reset();
+	reference.reset();
+	size_t bytes = file.size();
+
+	if (diskWriter.running)
+	{
+		DiskWrite* write = beginDiskWrite(diskWriter, bytes);
+		memcpy(write->data, file.data(), bytes);
+		double seconds = platformTime() - start;
+
+		endDiskWrite(diskWriter, write, frameFileName(frame), bytes, [frame, bytes, seconds](bool written) {
+			if (!written)
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(encodeMutex);
+				savedFrameBytes += bytes;
+				savedFrameSeconds += seconds;
+				observeMetric(writeHistogram, seconds * 1000.0);
+				savedFrames++;
+			}
+
+			addSavedFrame(frame);
+		});
+
+		return;
+	}
+
+	std::ofstream out(frameFileName(frame), std::ios::binary);
+	out.write((const char*)file.data(), bytes);
+	out.close();
+
+	double seconds = platformTime() - start;
+
+	{
+		std::lock_guard<std::mutex> lock(encodeMutex);
+		savedFrameBytes += bytes;
+		savedFrameSeconds += seconds;
+		observeMetric(writeHistogram, seconds * 1000.0);
+		savedFrames++;
+	}
+
+	addSavedFrame(frame);
+}
+
+// Encode a raw or QOI frame of the pool into a buffer of diskWriter, and put the frame back into the pool.
+// It is added to the saved frames by the thread of the writer, once the file is written
+void writeFrameToDisk(PooledFrame* pooled, int frame)
+{
+	double start = platformTime();
+	DiskWrite* write;
+	size_t bytes;
+
+	{
+		PROFILE_ZONE("encode for the disk writer");
+
+		if (frameFormat == FRAME_FORMAT_QOI)
+		{
+			// the size is only known once it is encoded
+			std::vector<unsigned char> encoded;
+			encodeQOI(pooled->image, encoded);
+			bytes = encoded.size();
+			write = beginDiskWrite(diskWriter, bytes);
+			memcpy(write->data, encoded.data(), bytes);
+		}
+		else
+		{
+			const unsigned char* bits = FreeImage_GetBits(pooled->image);
+			int pitch = FreeImage_GetPitch(pooled->image);
+			size_t rowBytes = (size_t)3 * outputWidth;
+			bytes = rowBytes * outputHeight;
+			write = beginDiskWrite(diskWriter, bytes);
+
+			for (int y = 0; y < outputHeight; y++)
+				memcpy(write->data + y * rowBytes, bits + y * pitch, rowBytes);
+		}
+	}
+
+	// the time waiting for a free buffer is in it, which is the time that the disk held the encoding back
+	double seconds = platformTime() - start;
+	returnPooledFrame(pooled);
+
+	endDiskWrite(diskWriter, write, frameFileName(frame), bytes, [frame, bytes, seconds](bool written) {
+		// a frame that is not in the list is saved again by --resume
+		if (!written)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(encodeMutex);
+			savedFrameBytes += bytes;
+			savedFrameSeconds += seconds;
+			observeMetric(writeHistogram, seconds * 1000.0);
+			savedFrames++;
+		}
+
+		addSavedFrame(frame);
+	});
+}
+
+// Save the bitmap of a frame of the pool as exportedFrames/<frame>.<format>, and put it back into the pool
+void encodeFrame(PooledFrame* pooled, int frame)
+{
+	if (diskWriter.running)
+	{
+		writeFrameToDisk(pooled, frame);
+		return;
+	}
+
+	FIBITMAP* image = pooled->image;
+	std::string fileName = frameFileName(frame);
+
+	double start = platformTime();
+
+	{
+		PROFILE_ZONE("FreeImage_Save");
+
+		if (frameFormat == FRAME_FORMAT_PNG)
+			FreeImage_Save(FIF_PNG, image, fileName.c_str(), pngLevel == 0 ? PNG_Z_NO_COMPRESSION : pngLevel);
+		else if (frameFormat == FRAME_FORMAT_BMP)
+			FreeImage_Save(FIF_BMP, image, fileName.c_str(), BMP_DEFAULT);
+		else if (frameFormat == FRAME_FORMAT_QOI)
+			writeQOI(image, fileName.c_str());
+		else
+			writeRawFrame(image, fileName.c_str());
+	}
+
+	double seconds = platformTime() - start;
+	returnPooledFrame(pooled);
+
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	long long bytes = file ? (long long)file.tellg() : 0;
+
+	{
+		std::lock_guard<std::mutex> lock(encodeMutex);
+		savedFrameBytes += bytes;
+		savedFrameSeconds += seconds;
+		observeMetric(writeHistogram, seconds * 1000.0);
+		savedFrames++;
+	}
+
+	addSavedFrame(frame);
+}
+
+// Read exportedFrames/frames.txt, and return which frames, from 1 to maxFrames, are saved.
+// The frames can be in any order, because the jobs finish them in any order
+std::vector<bool> readFrameManifest()
+{
+	std::vector<bool> saved(maxFrames + 1, false);
+	std::ifstream manifest(framesFolder + "/frames.txt");
+	int frame;
+
+	while (manifest >> frame)
+	{
+		if (frame >= 1 && frame <= maxFrames)
+			saved[frame] = true;
+	}
+
+	return saved;
+}
+
+// Wait for every frame that is still being saved
+void finishSavingFrames()
+{
+	for (const JobHandle& job : savingFrames)
+		waitJob(job);
+
+	savingFrames.clear();
+	finishPipeFrames();
+
+	// the jobs are done once the files are in the writer, not once they are written
+	flushDiskWriter(diskWriter);
+
+	// the next mezzanine frame is a keyframe, and the pixels go back into the pool
+	mezzanineLast.reset();
+	mezzanineLastFrame = -1;
+}
+
+// Add the job that saves a frame. If ENCODER_QUEUE_SIZE frames are already waiting, the oldest one is saved first
+void addSavingJob(JobHandle job)
+{
+	while (!savingFrames.empty() && jobDone(savingFrames.front()))
+		savingFrames.pop_front();
+
+	if (savingFrames.size() >= ENCODER_QUEUE_SIZE)
+	{
+		encodeQueueStalls++;
+
+		double start = platformTime();
+		waitJob(savingFrames.front());
+		savingFrames.pop_front();
+		addFrameWaitTime(platformTime() - start, true);
+	}
+
+	savingFrames.push_back(job);
+}
+
+// The function that gets the frames of the library (see RayTracer.h) instead of the output, and its user pointer
+RtFrameCallback libraryFrameCallback = nullptr;
+void* libraryFrameUser = nullptr;
+bool libraryStarted = false;
+
+// Read the file of a frame that was saved before into regionFrame, and put the rows of --region from pixels over it.
+// Returns regionFrame, or pixels if there is no file of that frame at the output size to go over
+const unsigned char* compositeRegion(const unsigned char* pixels, int frame)
+{
+	size_t frameBytes = (size_t)3 * outputWidth * outputHeight;
+	std::string fileName = frameFileName(frame);
+	bool found = false;
+
+	regionFrame.resize(frameBytes);
+
+	if (frameFormat == FRAME_FORMAT_RAW)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		found = file.read((char*)regionFrame.data(), frameBytes) && file.peek() == EOF;
+	}
+	else
+	{
+		FREE_IMAGE_FORMAT format = FreeImage_GetFileType(fileName.c_str(), 0);
+		FIBITMAP* image = format == FIF_UNKNOWN ? nullptr : FreeImage_Load(format, fileName.c_str(), 0);
+
+		if (image && (int)FreeImage_GetWidth(image) == outputWidth && (int)FreeImage_GetHeight(image) == outputHeight)
+		{
+			FIBITMAP* bgr = FreeImage_ConvertTo24Bits(image);
+
+			// FreeImage has the bottom row first too, but its rows can be longer
+			for (int y = 0; y < outputHeight; y++)
+				memcpy(&regionFrame[(size_t)y * 3 * outputWidth], FreeImage_GetScanLine(bgr, y), 3 * outputWidth);
+
+			FreeImage_Unload(bgr);
+			found = true;
+		}
+
+		if (image)
+			FreeImage_Unload(image);
+	}
+
+	if (!found)
+	{
+		if (regionMissingFrames++ == 0)
+			std::cout << "there is no " << fileName << " at " << outputWidth << "x" << outputHeight << " for --region to go over, so it is saved with only the region" << std::endl;
+
+		return pixels;
+	}
+
+	// the rows of the region, which are counted from the top
+	for (int y = outputHeight - regionY - regionHeight; y < outputHeight - regionY; y++)
+	{
+		size_t offset = ((size_t)y * outputWidth + regionX) * 3;
+		memcpy(&regionFrame[offset], pixels + offset, (size_t)3 * regionWidth);
+	}
+
+	return regionFrame.data();
+}
+
+// Save the pixels of one frame as exportedFrames/<frame>.png.
+// They are in BGR order, with the bottom row first, which is what glReadPixels gives.
+// They are copied into a frame of the pool (a bitmap, or the bytes that the job writes to ffmpeg),
+// so pixels can be used again as soon as this returns.
+// When the video is streamed, the pixels go to ffmpeg instead, or the planes of YUV 4:2:0 with --yuv-readback.
+// The library hands them to its callback as they are, which can be the mapped readback buffer
+void saveFrame(const unsigned char* pixels, int frame)
+{
+	if (libraryStarted)
+	{
+		if (libraryFrameCallback)
+			libraryFrameCallback(pixels, outputWidth, outputHeight, frame, libraryFrameUser);
+
+		return;
+	}
+
+	// the pixels outside of --region are the ones that were saved before
+	if (regionWidth > 0)
+		pixels = compositeRegion(pixels, frame);
+
+	size_t frameBytes = readbackFrameBytes();
+
+	// the encoder of the preview copies the pixels, and never waits for the browsers
+	if (remotePreviewPort > 0)
+		sendRemotePreviewFrame(pixels, outputWidth, outputHeight);
+
+	// the slots of the ring are in order, so the frame needs no job, or a copy of its own
+	if (frameRing.header)
+	{
+		if (dedupeFrames)
+			lastStreamedPixels.assign(pixels, pixels + frameBytes);
+
+		writeRingFrame(pixels, frameBytes);
+		return;
+	}
+
+	if (videoPipe)
+	{
+		// the frame that the copies of --dedupe-frames write again
+		if (dedupeFrames)
+			lastStreamedPixels.assign(pixels, pixels + frameBytes);
+
+		if (jobThreadCount() == 0)
+		{
+			PROFILE_ZONE("write to ffmpeg");
+			fwrite(pixels, 1, frameBytes, videoPipe);
+			return;
+		}
+
+		PooledFrame* copy = takePooledFrame(true);
+		memcpy(copy->bytes.data(), pixels, frameBytes);
+		pushPipeFrame(copy);
+		return;
+	}
+
+	// The mezzanine frames keep the packed pixels, which the next frame needs as its reference.
+	// The job of a frame only reads the pixels of the frame before, so the jobs do not wait for each other
+	if (frameFormat == FRAME_FORMAT_MEZZANINE)
+	{
+		std::shared_ptr<PooledFrame> copy(takePooledFrame(true), returnPooledFrame);
+		memcpy(copy->bytes.data(), pixels, (size_t)3 * outputWidth * outputHeight);
+
+		bool keyframe = frame != mezzanineLastFrame + 1 || (frame - 1) % mezzanineKeyframes == 0;
+		std::shared_ptr<PooledFrame> reference = keyframe ? nullptr : mezzanineLast;
+		mezzanineLast = copy;
+		mezzanineLastFrame = frame;
+
+		if (jobThreadCount() == 0)
+		{
+			encodeMezzanineFrame(copy, reference, frame);
+			return;
+		}
+
+		addSavingJob(addJob("encode mezzanine", [copy, reference, frame]() { encodeMezzanineFrame(copy, reference, frame); }));
+		return;
+	}
+
+	// Copy into a bitmap of the pool. FreeImage also has the bottom row first, but its rows can be longer
+	PooledFrame* pooled = takePooledFrame(false);
+
+	{
+		PROFILE_ZONE("copy into bitmap");
+
+		for (int y = 0; y < outputHeight; y++)
+			memcpy(FreeImage_GetScanLine(pooled->image, y), pixels + (size_t)y * 3 * outputWidth, 3 * outputWidth);
+	}
+
+	if (jobThreadCount() == 0)
+	{
+		encodeFrame(pooled, frame);
+		return;
+	}
+
+	addSavingJob(addJob("encode frame", [pooled, frame]() { encodeFrame(pooled, frame); }));
+}
+
+// Make the program of --yuv-readback, and the texture that the frame is copied into for it
+void makeYuvConvert()
+{
+	yuv_convert_program = makeProgram("yuv convert", { { GL_COMPUTE_SHADER, readShader("../Assets/YuvConvert.glsl"), "YuvConvert.glsl" } });
+
+	yuv_imageWidth_loc = glGetUniformLocation(yuv_convert_program, "imageWidth");
+	yuv_imageHeight_loc = glGetUniformLocation(yuv_convert_program, "imageHeight");
+
+	glGenTextures(1, &yuvFrameTexture);
+	glBindTexture(GL_TEXTURE_2D, yuvFrameTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, outputWidth, outputHeight);
+	trackGpuImage(GL_TEXTURE, yuvFrameTexture, (size_t)4 * outputWidth * outputHeight, GPU_MEMORY_IMAGES);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Write the planes of the frame that was just rendered into buffer, with YuvConvert.glsl. The frame is copied out
+// of the read framebuffer first, which is a renderbuffer or the window, so that the shader can read it as a texture
+void convertFrameToYuv(GLuint buffer)
+{
+	PROFILE_ZONE("yuv convert");
+
+	// YuvConvert.glsl reads the frame from texture unit 8
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, yuvFrameTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, outputWidth, outputHeight);
+
+	glUseProgram(yuv_convert_program);
+	glUniform1i(glGetUniformLocation(yuv_convert_program, "frameTexture"), 8);
+	glUniform1i(yuv_imageWidth_loc, outputWidth);
+	glUniform1i(yuv_imageHeight_loc, outputHeight);
+
+	// every thread writes 8 x 2 pixels
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+	glDispatchCompute((outputWidth / 8 + 7) / 8, (outputHeight / 2 + 7) / 8, 1);
+
+	// the map of the slot reads what the shader wrote
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compToFrag);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Make the pixel buffers of the readback ring, big enough for one frame each
+void makeReadbackRing()
+{
+	if (yuvReadback)
+		makeYuvConvert();
+
+	for (int i = 0; i < READBACK_RING_SLICES; i++)
+	{
+		glGenBuffers(1, &readbackRing[i].buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackRing[i].buffer);
+		gpuBufferData(GL_PIXEL_PACK_BUFFER, readbackRing[i].buffer, (GLsizeiptr)3 * outputWidth * outputHeight, nullptr, GL_STREAM_READ, GPU_MEMORY_READBACK);
+		readbackRing[i].fence = 0;
+		readbackRing[i].frame = -1;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// the batches, which hold all of their frames
+	if (frameBatch > 1)
+	{
+		for (BatchSlot& slot : batchSlots)
+		{
+			glGenBuffers(1, &slot.buffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			gpuBufferData(GL_PIXEL_PACK_BUFFER, slot.buffer, (GLsizeiptr)3 * outputWidth * outputHeight * frameBatch, nullptr, GL_STREAM_READ, GPU_MEMORY_READBACK);
+			slot.fence = 0;
+			slot.frames.assign(frameBatch, -1);
+			slot.count = 0;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+// Render the next frame into this layer of batchTexture. outputFBO is the framebuffer that is read,
+// and the one that is drawn to unless the render is scaled, so it is bound again as it was
+void attachBatchLayer(int layer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, batchTexture, 0, layer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+}
+
+// Wait for the readback of a batch, map it, and save its frames, in order
+void finishBatch(BatchSlot& slot, bool save)
+{
+	if (slot.count == 0)
+		return;
+
+	PROFILE_ZONE("map batch");
+	double start = platformTime();
+
+	if (waitForFence(slot.fence))
+		readbackWaits++;
+
+	addFrameWaitTime(platformTime() - start, true);
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	size_t frameBytes = (size_t)3 * outputWidth * outputHeight;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const unsigned char* pixels;
+	{
+		GL_STALL_ZONE("glMapBufferRange (batch)");
+		pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)(frameBytes * frameBatch), GL_MAP_READ_BIT);
+	}
+
+	if (save)
+	{
+		for (int i = 0; i < slot.count; i++)
+			saveFrame(pixels + frameBytes * i, slot.frames[i]);
+	}
+
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.count = 0;
+}
+
+// Read back every layer of the batch that was rendered, in one transfer, save the batch before it,
+// and start the next batch in layer 0. Layers after the frames of a short batch are read, but not saved
+void submitBatch(bool save)
+{
+	PROFILE_ZONE("glGetTexImage");
+
+	BatchSlot& slot = batchSlots[batchSlot];
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, batchTexture);
+	glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_BGR, GL_UNSIGNED_BYTE, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// the commands after the copy only write the layers after it has read them
+	batchSlot = 1 - batchSlot;
+	finishBatch(batchSlots[batchSlot], save);
+	attachBatchLayer(0);
+}
+
+// Add the frame that was just rendered into its layer to the batch, and read the batch back when it is full
+void readBackBatchFrame(int frame, bool save)
+{
+	BatchSlot& slot = batchSlots[batchSlot];
+	slot.frames[slot.count++] = frame;
+
+	if (slot.count == frameBatch)
+		submitBatch(save);
+	else
+		attachBatchLayer(slot.count);
+}
+
+// True for the frames of --thumbnails that go into the strips
+bool isThumbnailFrame(int frame)
+{
+	return thumbnailEvery > 0 && (frame - firstFrame) % thumbnailEvery == 0;
+}
+
+// Save the strip of thumbnails, full or not (the rest of it is black), and start a new one with the next thumbnail
+void saveThumbnailStrip()
+{
+	if (!thumbnailStrip)
+		return;
+
+	PROFILE_ZONE("save thumbnails");
+
+	std::string fileName = "thumbs_" + std::to_string(thumbnailStripFirst) + ".png";
+	if (!FreeImage_Save(FIF_PNG, thumbnailStrip, fileName.c_str(), PNG_DEFAULT))
+		std::cout << "could not save " << fileName << std::endl;
+
+	FreeImage_Unload(thumbnailStrip);
+	thumbnailStrip = nullptr;
+	thumbnailStrips++;
+}
+
+// Put the thumbnail of a frame after the ones before it in the strip. Both have the bottom row first
+void addThumbnail(const unsigned char* pixels, int frame)
+{
+	const Rendition& thumbnail = renditions[RENDITION_THUMBNAIL];
+
+	if (!thumbnailStrip)
+	{
+		thumbnailStrip = FreeImage_Allocate(thumbnail.width * THUMBNAILS_PER_STRIP, thumbnail.height, 24, 0xFF0000, 0x00FF00, 0x0000FF);
+		thumbnailStripFirst = frame;
+		thumbnailCount = 0;
+	}
+
+	for (int y = 0; y < thumbnail.height; y++)
+		memcpy(FreeImage_GetScanLine(thumbnailStrip, y) + 3 * thumbnail.width * thumbnailCount, pixels + 3 * thumbnail.width * y, 3 * thumbnail.width);
+
+	if (++thumbnailCount == THUMBNAILS_PER_STRIP)
+		saveThumbnailStrip();
+}
+
+// Wait for the readback of a rendition into a slot, map it, and write it to the proxy or the strip
+void finishRendition(int r, ReadbackSlot& slot)
+{
+	if (slot.frame < 0)
+		return;
+
+	PROFILE_ZONE("map rendition");
+	double start = platformTime();
+
+	if (waitForFence(slot.fence))
+		readbackWaits++;
+
+	addFrameWaitTime(platformTime() - start, true);
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	Rendition& rendition = renditions[r];
+	size_t bytes = (size_t)3 * rendition.width * rendition.height;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const unsigned char* pixels;
+	{
+		GL_STALL_ZONE("glMapBufferRange (rendition)");
+		pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+	}
+
+	if (r == RENDITION_PROXY)
+	{
+		fwrite(pixels, 1, bytes, proxyPipe);
+		proxyFrames++;
+	}
+	else if (isThumbnailFrame(slot.frame))
+	{
+		addThumbnail(pixels, slot.frame);
+	}
+
+	if (dedupeFrames)
+		rendition.last.assign(pixels, pixels + bytes);
+
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.frame = -1;
+}
+
+// Write out the renditions that are still in their rings, oldest first
+void finishAllRenditions()
+{
+	for (int r = 0; r < NUM_RENDITIONS; r++)
+	{
+		if (!renditions[r].fbo)
+			continue;
+
+		for (int i = 0; i < READBACK_RING_SLICES; i++)
+			finishRendition(r, renditions[r].ring[(renditions[r].next + i) % READBACK_RING_SLICES]);
+	}
+}
+
+// Make the renditions of the frame that was just rendered from the output, and start reading them back.
+// A slot is written out before it is used again, which is READBACK_RING_SLICES frames later.
+// With --dedupe-frames, every frame gets a thumbnail, since a copy of it can be one of the frames of the strips
+void readBackRenditions(int frame)
+{
+	bool wanted[NUM_RENDITIONS] = {
+		renditions[RENDITION_PROXY].fbo != 0,
+		renditions[RENDITION_THUMBNAIL].fbo != 0 && (isThumbnailFrame(frame) || dedupeFrames)
+	};
+
+	if (!wanted[RENDITION_PROXY] && !wanted[RENDITION_THUMBNAIL])
+		return;
+
+	PROFILE_ZONE("renditions");
+
+	// the bigger one first, on the way down the levels
+	int order[NUM_RENDITIONS] = { RENDITION_PROXY, RENDITION_THUMBNAIL };
+	if (renditions[RENDITION_THUMBNAIL].width > renditions[RENDITION_PROXY].width)
+		std::swap(order[0], order[1]);
+
+	int level = 0;
+	int w = outputWidth;
+	int h = outputHeight;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+
+	for (int r : order)
+	{
+		if (!wanted[r])
+			continue;
+
+		Rendition& rendition = renditions[r];
+
+		for (; level < (int)downsampleLevels.size() && downsampleLevels[level].width >= rendition.width; level++)
+		{
+			const DownsampleLevel& next = downsampleLevels[level];
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, next.fbo);
+			glBlitFramebuffer(0, 0, w, h, 0, 0, next.width, next.height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, next.fbo);
+			w = next.width;
+			h = next.height;
+		}
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, rendition.fbo);
+		glBlitFramebuffer(0, 0, w, h, 0, 0, rendition.width, rendition.height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+
+	// the rows of a small rendition are not a multiple of 4 bytes
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	for (int r = 0; r < NUM_RENDITIONS; r++)
+	{
+		if (!wanted[r])
+			continue;
+
+		Rendition& rendition = renditions[r];
+		ReadbackSlot& slot = rendition.ring[rendition.next];
+		finishRendition(r, slot);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, rendition.fbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glReadPixels(0, 0, rendition.width, rendition.height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.frame = frame;
+		rendition.next = (rendition.next + 1) % READBACK_RING_SLICES;
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	// the output is read back next, and the next frame draws into screenFBO
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+}
+
+// The renditions of a frame of --dedupe-frames that is a copy of the one before: that one's again
+void duplicateRenditions(int frame)
+{
+	const Rendition& proxy = renditions[RENDITION_PROXY];
+	const Rendition& thumbnail = renditions[RENDITION_THUMBNAIL];
+
+	if (proxy.fbo && !proxy.last.empty())
+	{
+		fwrite(proxy.last.data(), 1, proxy.last.size(), proxyPipe);
+		proxyFrames++;
+	}
+
+	if (thumbnail.fbo && !thumbnail.last.empty() && isThumbnailFrame(frame))
+		addThumbnail(thumbnail.last.data(), frame);
+}
+
+// Start copying the frame that was just rendered into a slot. With a pixel pack buffer bound,
+// glReadPixels writes into the buffer instead of into memory, so it does not wait for the GPU
+void startReadback(ReadbackSlot& slot, int frame)
+{
+	PROFILE_ZONE("glReadPixels");
+
+	if (yuvReadback)
+	{
+		convertFrameToYuv(slot.buffer);
+	}
+	else
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+		// We use BGR format, because BMP images use BGR
+		glReadPixels(0, 0, outputWidth, outputHeight, GL_BGR, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame;
+}
+
+// Wait for the copy into a slot to finish (it should be long done), then map it and save the frame.
+// If save is false, the frame is only mapped, for --bench-readback
+void finishReadback(ReadbackSlot& slot, bool save)
+{
+	if (slot.frame < 0)
+		return;
+
+	PROFILE_ZONE("map readback");
+	double start = platformTime();
+
+	if (waitForFence(slot.fence))
+		readbackWaits++;
+
+	addFrameWaitTime(platformTime() - start, true);
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const unsigned char* pixels;
+	{
+		GL_STALL_ZONE("glMapBufferRange (readback)");
+		pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)readbackFrameBytes(), GL_MAP_READ_BIT);
+	}
+
+	if (save)
+		saveFrame(pixels, slot.frame);
+
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.frame = -1;
+}
+
+// Read back the frame that was just rendered. With asyncReadback, it goes into the ring, and the frame
+// from READBACK_DELAY frames ago is saved. Otherwise it is read into pixels and saved now.
+// frameIndex counts the frames that were read back, which picks the slot
+void readBackFrame(unsigned char* pixels, int frame, int frameIndex, bool save)
+{
+	if (save)
+		readBackRenditions(frame);
+
+	if (frameBatch > 1 && asyncReadback)
+	{
+		readBackBatchFrame(frame, save);
+		markFrameTimer(FRAME_TIMER_READBACK);
+		return;
+	}
+
+	if (!asyncReadback)
+	{
+		// get the image that was rendered
+		// We use BGR format, because BMP images use BGR
+		{
+			PROFILE_ZONE("glReadPixels");
+			GL_STALL_ZONE("glReadPixels");
+
+			// with --hybrid, the CPU already put its strip into the rows above these
+			int gpuRows = hybridRender ? outputHeight - hybridCpuRows : outputHeight;
+			glReadPixels(0, 0, outputWidth, gpuRows, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+		}
+
+		markFrameTimer(FRAME_TIMER_READBACK);
+
+		double start = platformTime();
+
+		if (save)
+			saveFrame(pixels, frame);
+
+		addFrameSaveTime(platformTime() - start);
+		return;
+	}
+
+	// A slot is only used again READBACK_RING_SLICES frames later, and it was saved READBACK_DELAY frames later,
+	// so it is always free by now
+	startReadback(readbackRing[frameIndex % READBACK_RING_SLICES], frame);
+	markFrameTimer(FRAME_TIMER_READBACK);
+
+	double start = platformTime();
+
+	if (frameIndex >= READBACK_DELAY)
+		finishReadback(readbackRing[(frameIndex - READBACK_DELAY) % READBACK_RING_SLICES], save);
+
+	addFrameSaveTime(platformTime() - start);
+}
+
+// Save the frames that are still in the ring, oldest first
+void finishAllReadbacks(int frameIndex, bool save)
+{
+	// the batch that is not full yet, after the one before it
+	if (frameBatch > 1 && asyncReadback)
+	{
+		if (batchSlots[batchSlot].count > 0)
+			submitBatch(save);
+
+		finishBatch(batchSlots[1 - batchSlot], save);
+		return;
+	}
+
+	for (int i = READBACK_DELAY; i > 0; i--)
+	{
+		if (frameIndex - i >= 0)
+			finishReadback(readbackRing[(frameIndex - i) % READBACK_RING_SLICES], save);
+	}
+}
+
+// The hash of everything that the frame of totalFrame is made from, for --dedupe-frames: the matrices and the lights
+// at its time, the camera, the render size, and the changes to the scene file. They are the precomputed ones if there
+// are any, and otherwise they are made here, which is a small part of the work of a frame
+uint64_t frameInputHash()
+{
+	// sceneTime can stop the animation at --pause-at, which the frame does again when it is rendered
+	float savedPausedTime = pausedTime;
+	float time = sceneTime();
+	pausedTime = savedPausedTime;
+
+	std::vector<glm::mat4x4> matrices;
+	std::vector<light> lights;
+	int frame = totalFrame;
+
+	if (frame < (int)precomputedLights.size() && time == (float)frame / videoFPS)
+	{
+		matrices.assign(precomputedMatrices.begin() + (size_t)frame * numSceneMeshes, precomputedMatrices.begin() + (size_t)(frame + 1) * numSceneMeshes);
+		lights = precomputedLights[frame];
+	}
+	else
+	{
+		matrices = sceneMatrices(time);
+		makeLights(time, lights);
+	}
+
+	glm::vec3 camera[3] = { cameraStart, cameraTarget, cameraUp };
+	int sizes[3] = { width, height, sceneFileChanges };
+
+	// with --motion-blur, a frame is also made from where the meshes are when the shutter closes
+	if (motionBlur)
+	{
+		std::vector<glm::mat4x4> close = sceneMatrices(time + motionShutter / videoFPS);
+		matrices.insert(matrices.end(), close.begin(), close.end());
+	}
+
+	// and the joints of the skinned meshes at its time
+	std::vector<glm::mat4x4> joints;
+	poseSkins(time, joints);
+
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, matrices.data(), sizeof(glm::mat4x4) * matrices.size());
+	hash = hashBytes(hash, joints.data(), sizeof(glm::mat4x4) * joints.size());
+	hash = hashBytes(hash, lights.data(), sizeof(light) * lights.size());
+	hash = hashBytes(hash, camera, sizeof(camera));
+	hash = hashBytes(hash, &cameraFov, sizeof(cameraFov));
+	return hashBytes(hash, sizes, sizeof(sizes));
+}
+
+// Save frame as a copy of lastUniqueFrame, without rendering or encoding it. The first copy of a hold waits for
+// that frame to be read back and saved (frameIndex is the readback after it), and the ones after it wait for nothing
+void saveDuplicateFrame(int frame, int frameIndex)
+{
+	PROFILE_ZONE("duplicate frame");
+
+	if (!lastUniqueSaved)
+	{
+		if (asyncReadback)
+			finishAllReadbacks(frameIndex, true);
+
+		finishAllRenditions();
+		finishSavingFrames();
+		lastUniqueSaved = true;
+	}
+
+	duplicateFrames++;
+	duplicateRenditions(frame);
+
+	if (frameRing.header)
+	{
+		writeRingFrame(lastStreamedPixels.data(), lastStreamedPixels.size());
+		return;
+	}
+
+	// the jobs wrote every frame before this one, and the next one is written after it
+	if (videoPipe)
+	{
+		fwrite(lastStreamedPixels.data(), 1, lastStreamedPixels.size(), videoPipe);
+		return;
+	}
+
+	if (!linkFile(frameFileName(lastUniqueFrame), frameFileName(frame)))
+	{
+		std::cout << "could not save frame " << frame << " as a copy of frame " << lastUniqueFrame << std::endl;
+		return;
+	}
+
+	addSavedFrame(frame);
+}
+
+// Render and read back the same frames with the readback ring and with glReadPixels into memory,
+// without saving them, and print the average time of a frame for each
+void runReadbackBenchmark()
+{
+	bool savedAsync = asyncReadback;
+	unsigned char* pixels = new unsigned char[3 * outputWidth * outputHeight];
+
+	for (int async = 0; async <= 1; async++)
+	{
+		asyncReadback = async == 1;
+		readbackWaits = 0;
+		totalFrame = 0;
+
+		glFinish();
+		double start = platformTime();
+
+		for (int i = 0; i < benchmarkFrames; i++)
+		{
+			renderScene();
+			presentFrame();
+			readBackFrame(pixels, totalFrame, i, false);
+		}
+
+		finishAllReadbacks(benchmarkFrames, false);
+		double ms = (platformTime() - start) * 1000.0 / benchmarkFrames;
+
+		std::cout << (asyncReadback ? "readback ring: " : "glReadPixels: ") << ms << " ms per frame";
+		if (asyncReadback)
+			std::cout << ", waited for " << readbackWaits << " frames";
+		std::cout << std::endl;
+	}
+
+	totalFrame = 0;
+	tempFrame = 0;
+	asyncReadback = savedAsync;
+	delete[] pixels;
+}
+
+// Print the time of a stage of --bench-export, per frame and as MB/s of the BGR frames it had.
+// outputBytes is what the stage made of them, 0 if it makes nothing new
+void printExportStage(const char* stage, double seconds, int frames, size_t outputBytes)
+{
+	double frameBytes = 3.0 * outputWidth * outputHeight;
+
+	std::cout << stage << ": " << seconds * 1000.0 / frames << " ms per frame, " << frames / seconds << " frames/s, "
+		<< frameBytes * frames / seconds / (1024.0 * 1024.0) << " MB/s";
+
+	if (outputBytes > 0)
+		std::cout << ", " << outputBytes / frames / 1024 << " KB per frame (" << 100.0 * outputBytes / (frameBytes * frames) << "%)";
+
+	std::cout << std::endl;
+}
+
+// Time the stages of --bench-export at the output size, one at a time
+void runExportBenchmark()
+{
+	size_t frameBytes = (size_t)3 * outputWidth * outputHeight;
+	std::vector<unsigned char> pixels(frameBytes);
+
+	uint32_t noise = 12345;
+	for (int y = 0; y < outputHeight; y++)
+	{
+		for (int x = 0; x < outputWidth; x++)
+		{
+			noise = noise * 1664525u + 1013904223u;
+			unsigned char* pixel = &pixels[((size_t)y * outputWidth + x) * 3];
+			pixel[0] = (unsigned char)(x * 255 / outputWidth);
+			pixel[1] = (unsigned char)(y * 255 / outputHeight);
+			pixel[2] = (unsigned char)(128 + (noise >> 28));
+		}
+	}
+
+	std::cout << "the export stages at " << outputWidth << "x" << outputHeight << ", " << benchmarkFrames << " frames each" << std::endl;
+
+	// The readback of a frame that is rendered once, so only the copy is timed
+	if (!cpuRender)
+	{
+		bool savedAsync = asyncReadback;
+		std::vector<unsigned char> readback(frameBytes);
+
+		totalFrame = 0;
+		renderScene();
+		presentFrame();
+
+		for (int async = 0; async <= 1; async++)
+		{
+			asyncReadback = async == 1;
+			glFinish();
+			double start = platformTime();
+
+			for (int i = 0; i < benchmarkFrames; i++)
+				readBackFrame(readback.data(), 1, i, false);
+
+			finishAllReadbacks(benchmarkFrames, false);
+			printExportStage(asyncReadback ? "readback ring" : "glReadPixels", platformTime() - start, benchmarkFrames, 0);
+		}
+
+		asyncReadback = savedAsync;
+	}
+
+	// the copy of saveFrame, into a bitmap whose rows can be longer
+	FIBITMAP* image = FreeImage_Allocate(outputWidth, outputHeight, 24, 0xFF0000, 0x00FF00, 0x0000FF);
+
+	{
+		double start = platformTime();
+
+		for (int i = 0; i < benchmarkFrames; i++)
+		{
+			for (int y = 0; y < outputHeight; y++)
+				memcpy(FreeImage_GetScanLine(image, y), pixels.data() + (size_t)y * 3 * outputWidth, 3 * outputWidth);
+		}
+
+		printExportStage("copy into bitmap", platformTime() - start, benchmarkFrames, 0);
+	}
+
+	// Every format, into memory, so the disk is not in the times. The last file of each is kept for the writers
+	std::vector<unsigned char> file;
+
+	for (int format = FRAME_FORMAT_PNG; format <= FRAME_FORMAT_MEZZANINE; format++)
+	{
+		size_t outputBytes = 0;
+		double start = platformTime();
+
+		for (int i = 0; i < benchmarkFrames; i++)
+		{
+			if (format == FRAME_FORMAT_PNG || format == FRAME_FORMAT_BMP)
+			{
+				FIMEMORY* memory = FreeImage_OpenMemory();
+
+				if (format == FRAME_FORMAT_PNG)
+					FreeImage_SaveToMemory(FIF_PNG, image, memory, pngLevel == 0 ? PNG_Z_NO_COMPRESSION : pngLevel);
+				else
+					FreeImage_SaveToMemory(FIF_BMP, image, memory, BMP_DEFAULT);
+
+				outputBytes += FreeImage_TellMemory(memory);
+				FreeImage_CloseMemory(memory);
+			}
+			else if (format == FRAME_FORMAT_QOI)
+			{
+				encodeQOI(image, file);
+				outputBytes += file.size();
+			}
+			else if (format == FRAME_FORMAT_RAW)
+			{
+				file.assign(pixels.begin(), pixels.end());
+				outputBytes += file.size();
+			}
+			else
+			{
+				// a keyframe, and then deltas against the same pixels, which is what a still camera gets
+				bool keyframe = i % mezzanineKeyframes == 0;
+				encodeMezzanine(pixels.data(), keyframe ? nullptr : pixels.data(), i, outputWidth, outputHeight, i + 1, file);
+				outputBytes += file.size();
+			}
+		}
+
+		std::string stage = std::string("encode ") + frameFormatNames[format];
+		printExportStage(stage.c_str(), platformTime() - start, benchmarkFrames, outputBytes);
+	}
+
+	FreeImage_Unload(image);
+
+	// The raw frames written with std::ofstream, and with the disk writer past the page cache and through it,
+	// into the folder of the frames, which is on the disk that the video would be saved on
+	file.assign(pixels.begin(), pixels.end());
+	makeFolder(framesFolder);
+
+	for (int writer = 0; writer <= 2; writer++)
+	{
+		DiskWriter disk;
+		const char* method = "std::ofstream";
+
+		if (writer > 0 && !startDiskWriter(disk, diskWritesInFlight, writer == 1))
+			continue;
+
+		double start = platformTime();
+
+		for (int i = 0; i < benchmarkFrames; i++)
+		{
+			std::string fileName = framesFolder + "/bench_export_" + std::to_string(i) + ".bgr";
+
+			if (writer == 0)
+			{
+				std::ofstream out(fileName, std::ios::binary);
+				out.write((const char*)file.data(), file.size());
+				continue;
+			}
+
+			DiskWrite* write = beginDiskWrite(disk, file.size());
+			memcpy(write->data, file.data(), file.size());
+			endDiskWrite(disk, write, fileName, file.size(), [](bool) {});
+		}
+
+		if (writer > 0)
+		{
+			flushDiskWriter(disk);
+			method = disk.method;
+		}
+
+		double seconds = platformTime() - start;
+
+		if (writer > 0)
+			stopDiskWriter(disk);
+
+		std::string stage = std::string("write with ") + method + (writer == 1 ? " (direct)" : writer == 2 ? " (cached)" : "");
+		printExportStage(stage.c_str(), seconds, benchmarkFrames, 0);
+
+		for (int i = 0; i < benchmarkFrames; i++)
+			std::remove((framesFolder + "/bench_export_" + std::to_string(i) + ".bgr").c_str());
+	}
+
+	totalFrame = 0;
+	tempFrame = 0;
+}
+
+// Ask ffmpeg to encode one small frame with an encoder, and return true if it could.
+// An encoder can be built into ffmpeg and still not work, when the computer does not have that GPU
+bool videoEncoderWorks(const char* encoder)
+{
+	char command[1000];
+	sprintf(command, "ffmpeg -hide_banner -loglevel error -f lavfi -i color=black:s=256x256 -frames:v 1 -c:v %s -f null -", encoder);
+	return runQuietCommand(command);
+}
+
+// Pick the first hardware encoder that works, if --hw-encode asked for one
+void pickVideoEncoder()
+{
+	if (!hardwareEncode || !videoEncoder.empty())
+		return;
+
+	for (const char* encoder : hardwareEncoders)
+	{
+		if (videoEncoderWorks(encoder))
+		{
+			videoEncoder = encoder;
+			std::cout << "encoding the video with " << encoder << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "there is no hardware video encoder, encoding the video on the CPU" << std::endl;
+}
+
+// The part of an ffmpeg command that picks the encoder, nothing if ffmpeg should pick
+std::string videoEncoderOption()
+{
+	return videoEncoder.empty() ? "" : "-c:v " + videoEncoder + " ";
+}
+
+// True if name can go between the quotes of a command for system() or openPipe. A " would end the quotes,
+// and the rest of the name would be more of the command, so those names are not used at all
+bool quotableInCommand(const std::string& name)
+{
+	return name.find_first_of("\"\r\n") == std::string::npos;
+}
+
+// True if --frames renders every frame of the video, one after the other
+bool renderingAllFrames()
+{
+	return firstFrame == 1 && lastFrame == maxFrames && frameStep == 1;
+}
+
+// test.avi, or test_<first>_<last>.avi for a shard
+std::string videoFileName()
+{
+	if (renderingAllFrames())
+		return "test.avi";
+
+	return "test_" + std::to_string(firstFrame) + "_" + std::to_string(lastFrame) + ".avi";
+}
+
+// Make the downsample levels and the renditions of --proxy and --thumbnails for the output size,
+// and start the ffmpeg of the proxy. Without it, the proxy is off
+void startRenditions()
+{
+	if (proxyScale <= 0.0f && thumbnailEvery <= 0)
+		return;
+
+	// most encoders need an even size
+	int sizes[NUM_RENDITIONS][2] = {};
+	if (proxyScale > 0.0f)
+	{
+		sizes[RENDITION_PROXY][0] = std::max(2, (int)(outputWidth * proxyScale) & ~1);
+		sizes[RENDITION_PROXY][1] = std::max(2, (int)(outputHeight * proxyScale) & ~1);
+	}
+
+	if (thumbnailEvery > 0)
+	{
+		sizes[RENDITION_THUMBNAIL][0] = std::min(THUMBNAIL_WIDTH, outputWidth);
+		sizes[RENDITION_THUMBNAIL][1] = std::max(1, outputHeight * sizes[RENDITION_THUMBNAIL][0] / outputWidth);
+	}
+
+	if (proxyScale > 0.0f)
+	{
+		char command[1000];
+		sprintf(command, "ffmpeg -y -f rawvideo -pix_fmt bgr24 -s %dx%d -r %d -i - -vf vflip %s-q 0 proxy_%s",
+			sizes[RENDITION_PROXY][0], sizes[RENDITION_PROXY][1], videoFPS, videoEncoderOption().c_str(), videoFileName().c_str());
+
+		proxyPipe = openPipe(command, true);
+
+		if (!proxyPipe)
+		{
+			std::cout << "could not start ffmpeg for the proxy" << std::endl;
+			sizes[RENDITION_PROXY][0] = 0;
+		}
+	}
+
+	int smallest = std::numeric_limits<int>::max();
+	for (int r = 0; r < NUM_RENDITIONS; r++)
+	{
+		Rendition& rendition = renditions[r];
+		rendition.width = sizes[r][0];
+		rendition.height = sizes[r][1];
+		rendition.next = 0;
+		rendition.last.clear();
+
+		if (rendition.width == 0)
+			continue;
+
+		smallest = std::min(smallest, rendition.width);
+		makeColorFramebuffer(rendition.width, rendition.height, rendition.fbo, rendition.color);
+
+		for (ReadbackSlot& slot : rendition.ring)
+		{
+			glGenBuffers(1, &slot.buffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			gpuBufferData(GL_PIXEL_PACK_BUFFER, slot.buffer, (GLsizeiptr)3 * rendition.width * rendition.height, nullptr, GL_STREAM_READ, GPU_MEMORY_READBACK);
+			slot.fence = 0;
+			slot.frame = -1;
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	downsampleLevels.clear();
+	for (int w = outputWidth / 2, h = outputHeight / 2; w >= smallest && h > 0; w /= 2, h /= 2)
+	{
+		DownsampleLevel level = { w, h, 0, 0 };
+		makeColorFramebuffer(w, h, level.fbo, level.color);
+		downsampleLevels.push_back(level);
+	}
+
+	// makeColorFramebuffer left no framebuffer bound
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFBO);
+
+	proxyFrames = 0;
+	thumbnailStrips = 0;
+}
+
+// Write out the renditions that are left, close the proxy (ffmpeg finishes it then), and free the levels
+void finishRenditions()
+{
+	finishAllRenditions();
+	saveThumbnailStrip();
+
+	if (proxyPipe)
+	{
+		closePipe(proxyPipe);
+		proxyPipe = nullptr;
+
+		std::cout << "made the proxy proxy_" << videoFileName() << " of " << proxyFrames << " frames at "
+			<< renditions[RENDITION_PROXY].width << "x" << renditions[RENDITION_PROXY].height << std::endl;
+	}
+
+	if (thumbnailStrips > 0)
+		std::cout << "saved " << thumbnailStrips << " strips of thumbnails" << std::endl;
+
+	for (Rendition& rendition : renditions)
+	{
+		if (!rendition.fbo)
+			continue;
+
+		for (ReadbackSlot& slot : rendition.ring)
+			gpuDeleteBuffers(1, &slot.buffer);
+
+		glDeleteFramebuffers(1, &rendition.fbo);
+		forgetGpuImage(GL_RENDERBUFFER, rendition.color);
+		glDeleteRenderbuffers(1, &rendition.color);
+		rendition.fbo = 0;
+	}
+
+	for (DownsampleLevel& level : downsampleLevels)
+	{
+		glDeleteFramebuffers(1, &level.fbo);
+		forgetGpuImage(GL_RENDERBUFFER, level.color);
+		glDeleteRenderbuffers(1, &level.color);
+	}
+
+	downsampleLevels.clear();
+}
+
+// Make a video from count frames in exportedFrames, starting at first
+void encodeFrameRange(int first, int count, const std::string& output)
+{
+	// the folder and the output come from the command line, and from the jobs of --serve
+	if (!quotableInCommand(framesFolder) || !quotableInCommand(output))
+	{
+		std::cout << "Could not make " << output << " from " << framesFolder << ", a \" cannot be in the name of a folder or a video" << std::endl;
+		return;
+	}
+
+	// ffmpeg can't read the mezzanine frames, so they are decoded here and piped to it as raw video
+	if (frameFormat == FRAME_FORMAT_MEZZANINE)
+	{
+		std::string command = "ffmpeg -y -f rawvideo -pix_fmt bgr24 -s " + std::to_string(outputWidth) + "x" + std::to_string(outputHeight) +
+			" -r " + std::to_string(videoFPS) + " -i - -vf vflip " + videoEncoderOption() + "-q 0 \"" + output + "\"";
+
+		FILE* pipe = openPipe(command, true);
+
+		if (!pipe)
+		{
+			std::cout << "Could not start ffmpeg for " << output << std::endl;
+			return;
+		}
+
+		MezzanineReader reader;
+		reader.folder = framesFolder;
+
+		for (int frame = first; frame < first + count; frame++)
+		{
+			if (!readMezzanineFrame(reader, frame))
+			{
+				std::cout << "Could not read mezzanine frame " << frame << std::endl;
+				break;
+			}
+
+			fwrite(reader.pixels.data(), 1, reader.pixels.size(), pipe);
+		}
+
+		closePipe(pipe);
+
+		if (reader.decoded > 0)
+			std::cout << "decoded " << reader.decoded << " mezzanine frames for " << output << ": "
+				<< reader.seconds * 1000.0 / reader.decoded << " ms per frame" << std::endl;
+
+		return;
+	}
+
+	// build the command with proper FPS
+	// ffmpeg knows the size of every format but the raw one
+	std::string rawInput;
+	if (frameFormat == FRAME_FORMAT_RAW)
+		rawInput = "-f image2 -c:v rawvideo -pix_fmt bgr24 -s " + std::to_string(outputWidth) + "x" + std::to_string(outputHeight) + " ";
+
+	std::string command = "ffmpeg -y -r " + std::to_string(videoFPS) + " -start_number " + std::to_string(first) + " " + rawInput +
+		"-i \"" + framesFolder + "/%d." + frameFormatNames[frameFormat] + "\" -frames:v " + std::to_string(count) + " " +
+		(frameFormat == FRAME_FORMAT_RAW ? "-vf vflip " : "") + videoEncoderOption() + "-q 0 \"" + output + "\"";
+
+	// give the command to build the video
+	system(command.c_str());
+}
+
+// Make test.avi from the frames in exportedFrames
+void encodeSavedFrames()
+{
+	encodeFrameRange(1, maxFrames, "test.avi");
+}
+
+// Get ready to encode the video in segments, once the frames of each one are saved
+void startSegments()
+{
+	int segments = (maxFrames + segmentFrames - 1) / segmentFrames;
+	segmentFramesSaved.assign(segments, 0);
+	segmentStarted.assign(segments, false);
+}
+
+// Encode the segments that are not done yet (with --resume, some of their frames were saved before),
+// wait for all of them, and join them into test.avi without encoding them again
+void finishSegments()
+{
+	for (int i = 0; i < (int)segmentStarted.size(); i++)
+	{
+		if (!segmentStarted[i])
+			startSegmentEncoder(i);
+	}
+
+	for (std::thread& encoder : segmentEncoders)
+		encoder.join();
+
+	segmentEncoders.clear();
+
+	// the names in the list are from the folder that the list is in
+	std::ofstream list(framesFolder + "/segments.txt");
+	for (int i = 0; i < (int)segmentStarted.size(); i++)
+		list << "file 'segment_" << i << ".avi'" << std::endl;
+	list.close();
+
+	std::string command = "ffmpeg -y -f concat -safe 0 -i \"" + framesFolder + "/segments.txt\" -c copy test.avi";
+	system(command.c_str());
+}
+
+// Put the shards from --merge together into test.avi, in the order they were given.
+// ffmpeg's concat demuxer reads a list of files, and -c copy keeps the encoded frames as they are
+void mergeShardVideos()
+{
+	std::ofstream list("shards.txt");
+	for (const std::string& shard : mergeShards)
+		list << "file '" << shard << "'" << std::endl;
+	list.close();
+
+	system("ffmpeg -y -f concat -safe 0 -i shards.txt -c copy test.avi");
+}
+
+// Put the context of the render on GPU gpu, with WGL_NV_gpu_affinity. A context with GPU affinity has no window
+// to draw into, which is why --gpu is headless. The context of the window must be current, for wglGetProcAddress.
+// Returns false, and the window's context stays current, if the driver does not have the extension or that GPU.
+// On Linux, a render on one GPU is the EGL device of --egl instead
+bool useAffinityGpu(int gpu)
+{
+#ifdef _WIN32
+	DECLARE_HANDLE(GpuHandle);
+	typedef BOOL(WINAPI* EnumGpus)(UINT index, GpuHandle* gpu);
+	typedef HDC(WINAPI* CreateAffinityDC)(const GpuHandle* gpuList);
+
+	EnumGpus enumGpus = (EnumGpus)wglGetProcAddress("wglEnumGpusNV");
+	CreateAffinityDC createAffinityDC = (CreateAffinityDC)wglGetProcAddress("wglCreateAffinityDCNV");
+
+	// the list of GPUs ends with a null handle
+	GpuHandle gpus[2] = {};
+
+	if (enumGpus == nullptr || createAffinityDC == nullptr || !enumGpus(gpu, &gpus[0]))
+		return false;
+
+	HDC dc = createAffinityDC(gpus);
+
+	if (dc == nullptr)
+		return false;
+
+	// the frames go into framebuffers, so the pixel format only has to make a context
+	PIXELFORMATDESCRIPTOR format = {};
+	format.nSize = sizeof(format);
+	format.nVersion = 1;
+	format.dwFlags = PFD_SUPPORT_OPENGL;
+	format.iPixelType = PFD_TYPE_RGBA;
+	format.cColorBits = 24;
+
+	HGLRC context = nullptr;
+
+	if (SetPixelFormat(dc, ChoosePixelFormat(dc, &format), &format))
+		context = wglCreateContext(dc);
+
+	if (context == nullptr || !wglMakeCurrent(dc, context))
+		return false;
+
+	return true;
+#else
+	(void)gpu;
+	return false;
+#endif
+}
+
+// This program, in quotes, with the command line that it was started with, but without option and the one value after it
+std::string commandLineWithout(int argc, char** argv, const std::string& option)
+{
+	std::string commandLine = "\"" + programPath() + "\"";
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == option)
+		{
+			i++;
+			continue;
+		}
+
+		commandLine += arg.find(' ') == std::string::npos ? " " + arg : " \"" + arg + "\"";
+	}
+
+	return commandLine;
+}
+
+// Render the frames with gpuCount copies of this program, one on every GPU (see --gpus), wait for them,
+// and make the video from the frames they saved. Every copy gets the same command line, with --gpu,
+// and --frames for its share, and --resume, so that they all add to the one list of saved frames
+void renderOnGpus(int argc, char** argv)
+{
+	makeFolder(framesFolder);
+
+	// the list of saved frames starts empty, unless this is resuming too
+	if (!resumeFrames)
+		std::ofstream(framesFolder + "/frames.txt", std::ios::trunc);
+
+	std::string commandLine = commandLineWithout(argc, argv, "--gpus");
+	std::vector<ChildProcess> copies;
+
+	for (int gpu = 0; gpu < gpuCount; gpu++)
+	{
+		int first = firstFrame + gpu * frameStep;
+
+		if (first > lastFrame)
+			break;
+
+		// later options win, so these replace any that were given
+		char share[200];
+		sprintf(share, " --gpu %d --frames %d:%d:%d --resume", gpu, first, lastFrame, frameStep * gpuCount);
+
+		ChildProcess process;
+
+		if (!startProcess(commandLine + share, process))
+		{
+			std::cout << "could not start the copy for GPU " << gpu << std::endl;
+			continue;
+		}
+
+		copies.push_back(process);
+	}
+
+	for (ChildProcess& process : copies)
+	{
+		int exitCode;
+		waitProcess(process, -1, exitCode);
+	}
+
+	// only the whole video can be made from them, a shard is put together later like any other
+	if (renderingAllFrames())
+		encodeSavedFrames();
+}
+
+// The coordinator of a render farm (--farm): hand out the chunks, hand out again the chunks of the workers that
+// stopped, and encode the segments of the video as their frames come in. It renders nothing itself
+void runFarmCoordinator()
+{
+	framesFolder = farmFolder;
+	makeFolder(framesFolder);
+
+	// the copies of the workers add to the one list of saved frames, like the copies of --gpus
+	if (!resumeFrames)
+		std::ofstream(framesFolder + "/frames.txt", std::ios::trunc);
+
+	FarmPlan plan = makeFarmPlan(firstFrame, lastFrame, farmChunkSize);
+
+	if (!startFarm(farmFolder, plan, resumeFrames))
+	{
+		std::cout << "could not write the plan of the farm into " << farmFolder << std::endl;
+		return;
+	}
+
+	std::cout << "the farm in " << farmFolder << " has " << plan.chunks << " chunks of " << plan.chunkFrames
+		<< " frames, start the workers with --farm-worker " << farmFolder << std::endl;
+
+	pickVideoEncoder();
+
+	bool segmented = segmentFrames > 0 && renderingAllFrames();
+
+	if (segmented)
+		startSegments();
+
+	std::vector<bool> chunkDone(plan.chunks, false);
+	std::vector<bool> frameDone(maxFrames + 1, false);
+	std::map<std::string, int> workerChunks;
+	FarmWatch watch;
+	int done = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	while (done < plan.chunks)
+	{
+		double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		for (int chunk : reissueStaleFarmChunks(farmFolder, plan, watch, now, farmTimeout))
+			std::cout << "chunk " << chunk << " had no heartbeat for " << farmTimeout << " s, it is handed out again" << std::endl;
+
+		for (int chunk = 0; chunk < plan.chunks; chunk++)
+		{
+			if (chunkDone[chunk])
+				continue;
+
+			std::string worker = farmChunkWorker(farmFolder, chunk);
+
+			if (worker.empty())
+				continue;
+
+			int first, last;
+			farmChunkFrames(plan, chunk, first, last);
+
+			for (int f = first; f <= last; f++)
+				frameDone[f] = true;
+
+			chunkDone[chunk] = true;
+			workerChunks[worker]++;
+			done++;
+
+			std::cout << "frames " << first << " to " << last << " were rendered by " << worker
+				<< " (" << done << " of " << plan.chunks << " chunks)" << std::endl;
+		}
+
+		// a segment is encoded as soon as it has all of its frames, while the farm renders the rest
+		for (int segment = 0; segmented && segment < (int)segmentStarted.size(); segment++)
+		{
+			if (segmentStarted[segment])
+				continue;
+
+			int first = 1 + segment * segmentFrames;
+			bool ready = true;
+
+			for (int f = first; f < first + segmentLength(segment) && ready; f++)
+				ready = frameDone[f];
+
+			if (ready)
+				startSegmentEncoder(segment);
+		}
+
+		if (done < plan.chunks)
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+
+	// a faster worker took more chunks
+	for (const auto& worker : workerChunks)
+		std::cout << worker.first << " rendered " << worker.second << " chunks" << std::endl;
+
+	if (segmented)
+		finishSegments();
+	else if (renderingAllFrames())
+		encodeSavedFrames();
+}
+
+// A worker of a render farm (--farm-worker): take a chunk, render it with a copy of this program while writing
+// heartbeats into the claim, and take the next one, until every chunk is done. Returns false if something failed
+bool runFarmWorker(int argc, char** argv)
+{
+	FarmPlan plan;
+
+	if (!readFarmPlan(farmWorkerFolder, plan))
+	{
+		std::cout << "there is no farm in " << farmWorkerFolder << ", start its coordinator with --farm first" << std::endl;
+		return false;
+	}
+
+	// the process makes the name different for two workers on one computer, like one for every GPU
+	std::string worker = computerName() + "_" + std::to_string(processId());
+
+	std::string commandLine = commandLineWithout(argc, argv, "--farm-worker");
+	int rendered = 0;
+
+	while (true)
+	{
+		int chunk;
+
+		if (!claimFarmChunk(farmWorkerFolder, plan, worker, chunk))
+		{
+			// Every chunk is done or claimed. The claim of a worker that stops is handed out again, so this waits for those
+			bool allDone = true;
+
+			for (int c = 0; c < plan.chunks && allDone; c++)
+				allDone = !farmChunkWorker(farmWorkerFolder, c).empty();
+
+			if (allDone)
+				break;
+
+			std::this_thread::sleep_for(std::chrono::seconds(FARM_HEARTBEAT_SECONDS));
+			continue;
+		}
+
+		int first, last;
+		farmChunkFrames(plan, chunk, first, last);
+
+		// Later options win, so these replace any that were given. The copy saves the frames in the folder of the farm,
+		// and adds them to its list of saved frames, which also skips the frames that a worker that stopped had saved
+		char share[100];
+		sprintf(share, " --frames %d:%d --resume --frames-folder ", first, last);
+
+		ChildProcess process;
+
+		if (!startProcess(commandLine + share + "\"" + farmWorkerFolder + "\"", process))
+		{
+			std::cout << "could not start the copy for frames " << first << " to " << last << std::endl;
+			releaseFarmChunk(farmWorkerFolder, chunk);
+			return false;
+		}
+
+		int beat = 0;
+		int exitCode = 1;
+
+		while (!waitProcess(process, FARM_HEARTBEAT_SECONDS * 1000, exitCode))
+			beatFarmClaim(farmWorkerFolder, chunk, worker, ++beat);
+
+		// another worker can do it, and this one probably fails the next chunk the same way
+		if (exitCode != 0)
+		{
+			std::cout << "the copy for frames " << first << " to " << last << " failed, the chunk is given back" << std::endl;
+			releaseFarmChunk(farmWorkerFolder, chunk);
+			return false;
+		}
+
+		finishFarmChunk(farmWorkerFolder, chunk, worker);
+		rendered++;
+
+		std::cout << worker << " rendered frames " << first << " to " << last << std::endl;
+	}
+
+	std::cout << "the farm is done, " << worker << " rendered " << rendered << " of its " << plan.chunks << " chunks" << std::endl;
+	return true;
+}
+
+// Start ffmpeg, reading the frames from a pipe. glReadPixels gives the bottom row first,
+// so ffmpeg flips them, except for the planes of --yuv-readback, which are flipped on the GPU.
+// With --shm-encoder, the copy of this program that reads the frame ring starts it instead.
+// Returns false if ffmpeg could not be started
+bool startVideoStream()
+{
+	char command[1000];
+	sprintf(command, "ffmpeg -y -f rawvideo -pix_fmt %s -s %dx%d -r %d -i - %s%s-q 0 %s", yuvReadback ? "yuv420p" : "bgr24",
+		outputWidth, outputHeight, videoFPS, yuvReadback ? "" : "-vf vflip ", videoEncoderOption().c_str(),
+		uploadUrl.empty() ? videoFileName().c_str() : "-f matroska -");
+
+	// the video goes from ffmpeg into the copy that uploads it (see --upload)
+	std::string upload;
+	if (!uploadUrl.empty())
+		upload = " | \"" + programPath() + "\" --upload-stdin \"" + uploadUrl + "\" --upload-part-mb " + std::to_string(uploadPartMB);
+
+	if (shmEncoder)
+		return startFrameRing(frameRing, frameRingSlots, readbackFrameBytes(), command + upload);
+
+	videoPipe = openPipe(command + upload, true);
+	return videoPipe != nullptr;
+}
+
+// Close the pipe, which tells ffmpeg there are no more frames, and wait for it to finish the video
+void stopVideoStream()
+{
+	// the encoder writes the frames that are left in the ring first
+	stopFrameRing(frameRing);
+
+	if (!videoPipe)
+		return;
+
+	finishPipeFrames();
+	closePipe(videoPipe);
+	videoPipe = nullptr;
+}
+
+// Render the frames of --bench, print the rays per second and the frame times
+void runRenderBenchmark()
+{
+	// the first few frames are slower, while the driver gets ready
+	totalFrame = 0;
+	if (!cpuRender)
+	{
+		for (int i = 0; i < 3; i++)
+			renderScene();
+		glFinish();
+	}
+
+	std::vector<double> frameMs;
+	double seconds = 0.0;
+
+	for (int i = 0; i < benchmarkFrames; i++)
+	{
+		totalFrame = i;
+
+		double start = platformTime();
+		renderScene();
+		glFinish();
+		double frame = platformTime() - start;
+
+		frameMs.push_back(frame * 1000.0);
+		seconds += frame;
+	}
+
+	// The same frames again, counting the rays
+	bool savedWavefront = useWavefront;
+	useWavefront = false;
+	countingRays = true;
+
+	rayCounts counts = {};
+	glGenBuffers(1, &rayCountBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, rayCountBuffer, sizeof(counts), &counts, GL_DYNAMIC_READ, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, rayCountBuffer);
+
+	for (int i = 0; i < benchmarkFrames; i++)
+	{
+		totalFrame = i;
+		renderScene();
+	}
+
+	gpuRead("ray count readback", { { RES_RAY_COUNTS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+	{
+		GL_STALL_ZONE("glGetBufferSubData (ray counts)");
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), &counts);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	gpuDeleteBuffers(1, &rayCountBuffer);
+
+	countingRays = false;
+	useWavefront = savedWavefront;
+
+	// every pixel has one primary ray
+	double primary = (double)width * height * benchmarkFrames;
+	double shadow = counts.shadowRays;
+	double reflection = counts.reflectionRays;
+
+	std::cout << benchmarkFrames << " frames at " << width << "x" << height << std::endl;
+	std::cout << "primary rays: " << primary / seconds / 1000000.0 << " Mrays/s" << std::endl;
+	std::cout << "shadow rays: " << shadow / seconds / 1000000.0 << " Mrays/s (" << shadow / benchmarkFrames << " per frame)" << std::endl;
+	std::cout << "reflection rays: " << reflection / seconds / 1000000.0 << " Mrays/s (" << reflection / benchmarkFrames << " per frame)" << std::endl;
+	std::cout << "all rays: " << (primary + shadow + reflection) / seconds / 1000000.0 << " Mrays/s" << std::endl;
+
+	benchmarkMrays[0] = primary / seconds / 1000000.0;
+	benchmarkMrays[1] = shadow / seconds / 1000000.0;
+	benchmarkMrays[2] = reflection / seconds / 1000000.0;
+
+	std::sort(frameMs.begin(), frameMs.end());
+	int n = (int)frameMs.size();
+
+	std::cout << "frame ms: min " << frameMs[0]
+		<< ", average " << seconds * 1000.0 / n
+		<< ", median " << frameMs[n / 2]
+		<< ", 95% " << percentile(frameMs, 95)
+		<< ", max " << frameMs[n - 1] << std::endl;
+
+	totalFrame = 0;
+	tempFrame = 0;
+}
+
+// Render the frames of --estimate, and print the scene, the time and the rays of every sample, and how long the frames
+// of --frames will take, and a chunk of them on the farm. Returns false if the frames could not be estimated
+bool runRenderEstimate()
+{
+	if (cpuRender || hybridRender)
+	{
+		std::cout << "--estimate needs a GPU renderer, without --cpu-render or --hybrid" << std::endl;
+		return false;
+	}
+
+	int frames = (lastFrame - firstFrame) / frameStep + 1;
+	int samples = std::min(estimateSamples, frames);
+
+	// the first and the last frame, and the others evenly between them
+	std::vector<int> sampleFrames(samples);
+	for (int i = 0; i < samples; i++)
+		sampleFrames[i] = firstFrame + (samples > 1 ? (int)((double)i * (frames - 1) / (samples - 1) + 0.5) : 0) * frameStep;
+
+	double pixelScale = estimatePixels / ((double)width * height);
+
+	std::cout << "estimating " << frames << " frames from " << samples << " of them at " << width << "x" << height
+		<< " (" << 100.0 / pixelScale << "% of the pixels)" << std::endl;
+	std::cout << "the scene has " << sceneTriangles.size() << " triangles in " << numSceneMeshes << " meshes, "
+		<< sceneLights.size() << " lights, and " << maxBounces << " bounces" << std::endl;
+
+	// the first few frames are slower, while the driver gets ready
+	totalFrame = 0;
+	for (int i = 0; i < 3; i++)
+		renderScene();
+	glFinish();
+
+	// The frame timers split the GPU time into the scene and the draw
+	std::vector<double> wallMs;
+	startTimingLog(samples);
+
+	for (int frame : sampleFrames)
+	{
+		// The frame that is saved as n is rendered when totalFrame is n - 1
+		totalFrame = frame - 1;
+
+		double start = platformTime();
+		renderScene();
+		glFinish();
+		wallMs.push_back((platformTime() - start) * 1000.0);
+	}
+
+	finishTimingLog();
+
+	// The same frames again, counting the rays, with the fragment shader like --bench
+	bool savedWavefront = useWavefront;
+	useWavefront = false;
+	countingRays = true;
+
+	glGenBuffers(1, &rayCountBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, rayCountBuffer, sizeof(rayCounts), nullptr, GL_DYNAMIC_READ, GPU_MEMORY_BENCH);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, rayCountBuffer);
+
+	std::vector<double> sampleRays(samples);
+
+	for (int i = 0; i < samples; i++)
+	{
+		rayCounts counts = {};
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), &counts);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		totalFrame = sampleFrames[i] - 1;
+		renderScene();
+
+		gpuRead("ray count readback", { { RES_RAY_COUNTS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+		{
+			GL_STALL_ZONE("glGetBufferSubData (ray counts)");
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), &counts);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		// every pixel has one primary ray, and the others are per pixel too
+		sampleRays[i] = ((double)width * height + counts.shadowRays + counts.reflectionRays) * pixelScale;
+	}
+
+	gpuDeleteBuffers(1, &rayCountBuffer);
+	countingRays = false;
+	useWavefront = savedWavefront;
+
+	// A frame at the render size is the frame that was timed, with the draw scaled up to its pixels.
+	// A draw that the timers did not see is scaled with the whole frame
+	std::vector<double> sampleMs(samples);
+
+	for (int i = 0; i < samples; i++)
+	{
+		double draw = i < (int)frameTimes.size() ? frameTimes[i].draw : -1.0;
+		sampleMs[i] = draw >= 0.0 ? wallMs[i] + draw * (pixelScale - 1.0) : wallMs[i] * pixelScale;
+
+		std::cout << "frame " << sampleFrames[i] << ": " << wallMs[i] << " ms, " << sampleMs[i] << " ms at the render size, "
+			<< sampleRays[i] / 1000000.0 << " Mrays (" << sampleRays[i] / sampleMs[i] / 1000.0 << " Mrays/s)" << std::endl;
+	}
+
+	// every frame of --frames takes the time between the two samples around it
+	std::vector<double> estimateMs(frames);
+	int next = 0;
+
+	for (int f = 0; f < frames; f++)
+	{
+		int frame = firstFrame + f * frameStep;
+
+		while (next + 1 < samples && sampleFrames[next + 1] <= frame)
+			next++;
+
+		if (next + 1 >= samples || sampleFrames[next] == frame)
+		{
+			estimateMs[f] = sampleMs[next];
+			continue;
+		}
+
+		double t = (double)(frame - sampleFrames[next]) / (sampleFrames[next + 1] - sampleFrames[next]);
+		estimateMs[f] = sampleMs[next] + (sampleMs[next + 1] - sampleMs[next]) * t;
+	}
+
+	double seconds = 0.0;
+	for (double ms : estimateMs)
+		seconds += ms / 1000.0;
+
+	// the chunk that takes longest is the one the farm waits for at the end
+	double chunkSeconds = 0.0;
+
+	for (int f = 0; f < frames; f += farmChunkSize)
+	{
+		double chunk = 0.0;
+		for (int c = f; c < std::min(frames, f + farmChunkSize); c++)
+			chunk += estimateMs[c] / 1000.0;
+
+		chunkSeconds = std::max(chunkSeconds, chunk);
+	}
+
+	std::cout << "estimate: " << seconds << " s for " << frames << " frames (" << seconds * 1000.0 / frames
+		<< " ms per frame), the longest chunk of " << farmChunkSize << " frames takes " << chunkSeconds << " s" << std::endl;
+	std::cout << "saving or encoding the frames is not in the estimate" << std::endl;
+
+	totalFrame = 0;
+	return true;
+}
+
+// Render the frames of --replay that are in replayFirst to replayLast from the inputs in the capture, print how long
+// every one took (with glFinish, like --bench), and the frame report. Returns false if the capture could not be replayed
+bool runFrameReplay()
+{
+	if (cpuRender || hybridRender)
+	{
+		std::cout << "--replay needs a GPU renderer, without --cpu-render or --hybrid" << std::endl;
+		return false;
+	}
+
+	FrameCaptureHeader header;
+	std::vector<CapturedFrame> frames;
+
+	// a render that was stopped leaves the last record half written, and the frames before it can still be replayed
+	if (!readFrameCapture(replayName.c_str(), header, frames))
+	{
+		if (frames.empty())
+		{
+			std::cout << "could not read the capture " << replayName << std::endl;
+			return false;
+		}
+
+		std::cout << replayName << " ends in the middle of a frame, after " << frames.size() << " frames" << std::endl;
+	}
+
+	if (header.meshes != numSceneMeshes)
+	{
+		std::cout << replayName << " has " << header.meshes << " meshes, and the scene has " << numSceneMeshes << std::endl;
+		return false;
+	}
+
+	if (header.sceneHash != sceneCaptureHash())
+		std::cout << "the scene is not the one " << replayName << " was captured with" << std::endl;
+
+	if (header.width != width || header.height != height)
+		std::cout << replayName << " was captured at " << header.width << "x" << header.height << ", and is replayed at " << width << "x" << height << std::endl;
+
+	std::vector<const CapturedFrame*> range;
+	for (const CapturedFrame& frame : frames)
+	{
+		if (frame.frame >= replayFirst && frame.frame <= replayLast)
+			range.push_back(&frame);
+	}
+
+	if (range.empty())
+	{
+		std::cout << replayName << " has none of the frames " << replayFirst << " to " << replayLast << std::endl;
+		return false;
+	}
+
+	// the first few frames are slower, while the driver gets ready
+	for (int i = 0; i < 3 + (int)range.size(); i++)
+	{
+		if (i == 3)
+			startTimingLog((int)range.size());
+
+		const CapturedFrame* frame = range[std::max(i - 3, 0)];
+		replayFrame = frame;
+		cameraStart = frame->cameraPos;
+		cameraTarget = frame->cameraTarget;
+		cameraUp = frame->cameraUp;
+		cameraFov = frame->cameraFov;
+		totalFrame = frame->frame - 1;
+
+		double start = platformTime();
+		{
+			PROFILE_ZONE("replay frame");
+			renderScene();
+			glFinish();
+		}
+
+		if (i >= 3)
+			std::cout << "frame " << frame->frame << ": " << (platformTime() - start) * 1000.0 << " ms" << std::endl;
+	}
+
+	finishTimingLog();
+
+	replayFrame = nullptr;
+	totalFrame = 0;
+	tempFrame = 0;
+	return true;
+}
+
+// Time the primary, shadow, and reflection rays of the first frame with the BVH of the CPU renderer and with
+// Embree, and print them next to the rays per second of the GPU (--bench-embree). The rays are the ones that
+// the CPU renderer traces for the frame, so both get the same ones, with the same hits
+void runEmbreeBenchmark()
+{
+	totalFrame = 0;
+	cameraPos = cameraStart;
+
+	float time = sceneTime();
+	makeSceneLights(time);
+
+	CpuScene cpuScene;
+	buildCpuScene(sceneTriangles, sceneMeshOffsets, sceneMatrices(time), sceneLights, cpuScene);
+	cpuScene.kernel = cpuKernel;
+
+	cameraView camera = makeCameraView(cameraPos, cameraTarget, cameraUp, cameraFov, (float)outputWidth / outputHeight);
+
+	// the same as prepareCpuFrame
+	CpuPathSettings path;
+	path.maxBounces = maxBounces;
+	path.throughputEpsilon = throughputEpsilon;
+	path.russianRoulette = russianRoulette;
+	path.rouletteThreshold = rouletteThreshold;
+	path.frameSeed = 0;
+	path.lodShadowsFrom = lodShadowsFrom;
+	path.lodSpecularFrom = lodSpecularFrom;
+
+	CpuRaySets rays;
+	collectCpuRays(cpuScene, camera, path, outputWidth, outputHeight, rays);
+
+	double start = platformTime();
+	EmbreeBaseline* baseline = makeEmbreeBaseline(cpuScene);
+	double buildMs = (platformTime() - start) * 1000.0;
+
+	const char* setNames[3] = { "primary", "shadow", "reflection" };
+	const std::vector<CpuRay>* sets[3] = { &rays.primary, &rays.shadow, &rays.reflection };
+
+	std::cout << "rays of frame 0 at " << outputWidth << "x" << outputHeight << ", " << cpuScene.surfaces.size() << " triangles";
+
+	if (baseline)
+		std::cout << " (Embree built it in " << buildMs << " ms)";
+
+	std::cout << std::endl;
+
+	for (int s = 0; s < 3; s++)
+	{
+		const std::vector<CpuRay>& set = *sets[s];
+		bool anyHit = s == 1;
+
+		// once to warm up, and once to measure
+		double cpuSeconds = 0.0;
+		double embreeSeconds = 0.0;
+		int cpuHits = 0;
+		int embreeHits = 0;
+
+		for (int run = 0; run < 2; run++)
+		{
+			start = platformTime();
+			cpuHits = traceCpuRays(cpuScene, set, anyHit);
+			cpuSeconds = platformTime() - start;
+
+			if (!baseline)
+				continue;
+
+			start = platformTime();
+			embreeHits = traceEmbreeRays(baseline, set, anyHit);
+			embreeSeconds = platformTime() - start;
+		}
+
+		double count = (double)set.size();
+
+		std::cout << setNames[s] << " rays (" << set.size() << "): GPU " << benchmarkMrays[s]
+			<< ", CPU BVH " << (cpuSeconds > 0.0 ? count / cpuSeconds / 1000000.0 : 0.0) << " (" << cpuHits << " hits)";
+
+		if (baseline)
+			std::cout << ", Embree " << (embreeSeconds > 0.0 ? count / embreeSeconds / 1000000.0 : 0.0) << " (" << embreeHits << " hits)";
+
+		std::cout << " Mrays/s" << std::endl;
+	}
+
+	freeEmbreeBaseline(baseline);
+
+	totalFrame = 0;
+	tempFrame = 0;
+}
+
+// Print the counts of some frames, as the rays per frame
+void printRayStats(const rayCounts& counts, int frames)
+{
+	if (frames == 0)
+		return;
+
+	double shadows = counts.shadowRays;
+
+	std::cout << "rays per frame (" << frames << " frames): primary " << counts.primaryRays / frames
+		<< ", shadow " << counts.shadowRays / frames
+		<< " (" << (shadows > 0.0 ? 100.0 * counts.occludedShadows / shadows : 0.0) << "% blocked)"
+		<< ", reflection " << counts.reflectionRays / frames << " (by bounce:";
+
+	for (int b = 0; b < RAY_STATS_BOUNCES; b++)
+		std::cout << " " << counts.reflectionRaysPerBounce[b] / frames;
+
+	std::cout << "), shadow by bounce:";
+
+	for (int b = 0; b < RAY_STATS_BOUNCES; b++)
+		std::cout << " " << counts.shadowRaysPerBounce[b] / frames;
+
+	std::cout << ", lights out of range " << counts.lightsCulled / frames
+		<< ", shadow cache hits " << counts.shadowCacheHits / frames
+		<< ", shadows from the grid " << counts.shadowsUpsampled / frames << std::endl;
+}
+
+// Make the counters of --ray-stats, and start counting
+void startRayStats()
+{
+	rayCounts zero = {};
+
+	glGenBuffers(1, &rayCountBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCountBuffer);
+	gpuBufferData(GL_SHADER_STORAGE_BUFFER, rayCountBuffer, sizeof(zero), &zero, GL_DYNAMIC_COPY, GPU_MEMORY_RENDER);
+
+	glGenBuffers(1, &rayStatsReadBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, rayStatsReadBuffer);
+	gpuBufferData(GL_COPY_WRITE_BUFFER, rayStatsReadBuffer, sizeof(zero), nullptr, GL_STREAM_READ, GPU_MEMORY_RENDER);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, rayCountBuffer);
+
+	countingRays = true;
+	rayStatsTime = platformTime();
+}
+
+// Print the copy of the counts, if the GPU has made it. With wait, this waits for it
+void readRayStats(bool wait)
+{
+	if (!rayStatsFence)
+		return;
+
+	if (wait)
+		waitForFence(rayStatsFence);
+	else if (glClientWaitSync(rayStatsFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		return;
+
+	glDeleteSync(rayStatsFence);
+	rayStatsFence = 0;
+
+	rayCounts counts;
+	glBindBuffer(GL_COPY_READ_BUFFER, rayStatsReadBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), &counts);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	metricRays += (double)counts.primaryRays + counts.shadowRays + counts.reflectionRays;
+	printRayStats(counts, rayStatsCopiedFrames);
+}
+
+// Copy the counts of the frames since the last copy, and start counting from 0 again
+void copyRayStats()
+{
+	rayCounts zero = {};
+
+	gpuRead("ray stats copy", { { RES_RAY_COUNTS, GL_BUFFER_UPDATE_BARRIER_BIT } });
+
+	glBindBuffer(GL_COPY_READ_BUFFER, rayCountBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, rayStatsReadBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(zero));
+	glBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(zero), &zero);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	rayStatsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	rayStatsCopiedFrames = rayStatsFrames;
+	rayStatsFrames = 0;
+}
+
+// Called after every frame: print the copy from before if it is ready, and make a new one every second
+void updateRayStats()
+{
+	rayStatsFrames++;
+	readRayStats(false);
+
+	double now = platformTime();
+
+	if (!rayStatsFence && now - rayStatsTime >= 1.0)
+	{
+		copyRayStats();
+		rayStatsTime = now;
+	}
+}
+
+// Print the counts that are left at the end of the video, and delete the counters
+void finishRayStats()
+{
+	readRayStats(true);
+
+	if (rayStatsFrames > 0)
+	{
+		copyRayStats();
+		readRayStats(true);
+	}
+
+	countingRays = false;
+	gpuDeleteBuffers(1, &rayCountBuffer);
+	gpuDeleteBuffers(1, &rayStatsReadBuffer);
+}
+
+// The PSNR of two frames in decibels, which is higher the closer they are (the same frames are infinite)
+double framePSNR(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+	double squares = 0.0;
+
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		double d = (double)a[i] - b[i];
+		squares += d * d;
+	}
+
+	if (squares == 0.0)
+		return std::numeric_limits<double>::infinity();
+
+	return 10.0 * log10(255.0 * 255.0 / (squares / a.size()));
+}
+
+// Render goldenFrames, and save them in goldenFolder or compare them with it (see goldenMode).
+// Returns false if a frame is missing, or looks different, or got too slow
+bool runGoldenFrames()
+{
+	size_t frameBytes = (size_t)3 * outputWidth * outputHeight;
+	std::vector<unsigned char> pixels(frameBytes);
+
+	// the times that were saved with the frames
+	std::map<int, double> savedMs;
+
+	if (goldenMode == GOLDEN_SAVE)
+	{
+		makeFolder(goldenFolder);
+	}
+	else
+	{
+		std::ifstream times(goldenFolder + "/times.txt");
+		int frame;
+		double ms;
+
+		while (times >> frame >> ms)
+			savedMs[frame] = ms;
+	}
+
+	std::ofstream times;
+	if (goldenMode == GOLDEN_SAVE)
+		times.open(goldenFolder + "/times.txt");
+
+	// the first few frames are slower, while the driver gets ready
+	totalFrame = 0;
+	if (!cpuRender)
+	{
+		for (int i = 0; i < 3; i++)
+			renderScene();
+		glFinish();
+	}
+
+	bool passed = true;
+
+	for (int frame : goldenFrames)
+	{
+		if (frame < 1 || frame > maxFrames)
+		{
+			std::cout << "frame " << frame << " is not in the video" << std::endl;
+			continue;
+		}
+
+		std::vector<double> frameMs;
+
+		for (int r = 0; r < goldenRepeats; r++)
+		{
+			// The frame that is saved as n is rendered when totalFrame is n - 1
+			totalFrame = frame - 1;
+
+			double start = platformTime();
+
+			// the CPU renderer writes the frame into pixels itself
+			if (cpuRender)
+			{
+				renderCpuScene(pixels.data());
+			}
+			else if (hybridRender)
+			{
+				renderHybridScene(pixels.data());
+				presentFrame();
+				glFinish();
+			}
+			else
+			{
+				renderScene();
+				presentFrame();
+				glFinish();
+			}
+
+			frameMs.push_back((platformTime() - start) * 1000.0);
+		}
+
+		std::sort(frameMs.begin(), frameMs.end());
+		double ms = frameMs[frameMs.size() / 2];
+
+		if (!cpuRender)
+			glReadPixels(0, 0, outputWidth, hybridRender ? outputHeight - hybridCpuRows : outputHeight, GL_BGR, GL_UNSIGNED_BYTE, pixels.data());
+
+		std::string fileName = goldenFolder + "/" + std::to_string(frame) + ".bgr";
+
+		if (goldenMode == GOLDEN_SAVE)
+		{
+			std::ofstream file(fileName, std::ios::binary);
+			file.write((const char*)pixels.data(), frameBytes);
+			times << frame << " " << ms << std::endl;
+
+			std::cout << "frame " << frame << ": saved, " << ms << " ms" << std::endl;
+			continue;
+		}
+
+		std::vector<unsigned char> golden(frameBytes);
+		std::ifstream file(fileName, std::ios::binary);
+
+		if (!file.read((char*)golden.data(), frameBytes))
+		{
+			std::cout << "frame " << frame << ": FAILED, " << fileName << " is missing or is not " << outputWidth << "x" << outputHeight << std::endl;
+			passed = false;
+			continue;
+		}
+
+		double psnr = framePSNR(pixels, golden);
+		bool looksRight = psnr >= goldenPSNR;
+		// The golden frames of the GPU are the reference for the CPU renderer, which is not as fast, so only how it looks counts
+		bool fastEnough = cpuRender || savedMs.count(frame) == 0 || ms <= savedMs[frame] * goldenSlowdown;
+
+		std::cout << "frame " << frame << ": " << (looksRight && fastEnough ? "passed" : "FAILED")
+			<< ", PSNR " << psnr << " dB, " << ms << " ms";
+
+		if (savedMs.count(frame))
+			std::cout << " (was " << savedMs[frame] << " ms)";
+
+		std::cout << std::endl;
+
+		passed = passed && looksRight && fastEnough;
+	}
+
+	if (goldenMode == GOLDEN_CHECK)
+		std::cout << (passed ? "every golden frame passed" : "some golden frames FAILED") << std::endl;
+
+	totalFrame = 0;
+	tempFrame = 0;
+
+	return passed;
+}
+
+// Render the still of --still, one tile after the other, and write every tile into stillFile as soon as it is read back.
+// The tiles are the output, which is stillTile pixels across, and the camera is the one of the whole still, with the
+// shape of the still, cut to the window of the tile. Returns false if the file could not be written
+bool renderStill()
+{
+	TiledTiff tiff;
+
+	if (!openTiledTiff(tiff, stillFile, stillWidth, stillHeight, stillTile))
+	{
+		std::cout << "could not write " << stillFile << std::endl;
+		return false;
+	}
+
+	size_t rowBytes = (size_t)3 * stillTile;
+	std::vector<unsigned char> pixels(rowBytes * stillTile);
+	std::vector<unsigned char> flipped(rowBytes * stillTile);
+	double start = platformTime();
+	bool written = true;
+
+	for (int ty = 0; ty < tiff.tilesY && written; ty++)
+	{
+		for (int tx = 0; tx < tiff.tilesX && written; tx++)
+		{
+			// the rows of the TIFF go down from the top, and v goes up from the bottom
+			cameraWindow = glm::vec4(
+				(float)(tx * stillTile) / stillWidth,
+				1.0f - (float)((ty + 1) * stillTile) / stillHeight,
+				(float)((tx + 1) * stillTile) / stillWidth,
+				1.0f - (float)(ty * stillTile) / stillHeight);
+
+			totalFrame = firstFrame - 1;
+			renderScene();
+			presentFrame();
+			glReadPixels(0, 0, stillTile, stillTile, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+			// glReadPixels gives the bottom row first
+			for (int row = 0; row < stillTile; row++)
+				memcpy(&flipped[row * rowBytes], &pixels[(stillTile - 1 - row) * rowBytes], rowBytes);
+
+			written = writeTiffTile(tiff, tx, ty, flipped.data());
+		}
+
+		std::cout << "rendered row " << ty + 1 << " of " << tiff.tilesY << " of tiles" << std::endl;
+	}
+
+	cameraWindow = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	written = closeTiledTiff(tiff) && written;
+
+	if (written)
+	{
+		std::cout << "wrote " << stillFile << ", " << stillWidth << "x" << stillHeight << " in " << tiff.tilesX * tiff.tilesY
+			<< " tiles, in " << platformTime() - start << " seconds" << std::endl;
+	}
+	else
+		std::cout << "could not write all of " << stillFile << ", the disk can be full" << std::endl;
+
+	return written;
+}
+
+// Read the command line. Every option is optional:
+// --accel <name>     pick the acceleration structure (brute, meshboxes, grid, bvh, twolevel)
+// --bench            render benchmarkFrames frames headless without saving them, print the rays per second, and exit
+// --bench-accel      time every acceleration structure before rendering the video
+// --bench-embree     --bench, and then the rays of the first frame on the BVH of the CPU renderer and on Embree
+// --bench-frames <n> how many frames each benchmark renders
+// --ray-stats        count the primary, shadow, and reflection rays of every frame, and print them every second
+// --startup-times    print how long every step of the startup took, and how long it was until the first frame
+// --hot-reload       compile the draw and transform shaders again when their files are saved, while it renders
+// --no-specialize    keep the size of the scene, the lights, and the bounces as uniforms, instead of compiling them in
+// --no-shader-cache  always compile the shaders, instead of loading the programs from shaderCache
+// --shared-cache <url> look for the files of shaderCache and bvhCache at http://host:port/bucket/prefix before making them, and put the new ones there
+// --autotune [force] time the choices that differ between GPUs on the scene and save the fastest for this GPU in tuneCache,
+//                    if it has no profile yet (or always, with force). Later runs load the profile of their GPU
+// --tune-frames <n>  how many frames --autotune times every candidate with (30)
+// --no-tune-profile  do not load the profile of this GPU
+// --bvh-stack <n>    the size of the traversal stacks of the BVH and the two-level BVH (64)
+// --spirv            load the shaders that CompileSpirv.bat compiled to SPIR-V, where there are any
+// --memory-report    print the GPU memory of every kind of buffer at the end, its peak, and how much the driver has free
+// --save-golden <folder>  render the golden frames headless, save them and their times in the folder, and exit
+// --check-golden <folder> render the golden frames and compare them with the folder, exit with 1 if any failed
+// --still <WxH>     render the first frame of --frames as one still of that size, in tiles, into still.tif, and exit
+// --still-tile <n>   the size of the tiles of --still, which are rendered one at a time (1024)
+// --still-file <name> the tiled TIFF of --still (still.tif)
+// --golden-frames <a,b,...> which frames of the video are golden (1,150,300,450,600)
+// --golden-psnr <db> the lowest PSNR that a golden frame can have (40)
+// --golden-slowdown <x> how many times slower than when it was saved a golden frame can be (1.25)
+// --wavefront        render with Wavefront.glsl instead of FragmentShader.glsl
+// --bench-wavefront  time the fragment shader and the wavefront renderer before rendering the video
+// --wave-sort        sort the reflection rays of the wavefront renderer before tracing them
+// --bench-wave-sort  time the wavefront renderer with and without sorting the rays
+// --wave-compact     put the rays that go on into the next queue of the wavefront renderer with a prefix sum, in order
+// --subgroup-traversal  the threads of a subgroup walk the BVH together in the wavefront renderer
+// --bench-subgroup-traversal  time the wavefront renderer with and without it
+// --no-indirect-dispatch  make every dispatch of the wavefront renderer as big as the biggest queue
+// --bench-indirect   time the wavefront renderer with and without indirect dispatches
+// --tiled-render render with the compute shader in TiledRender.glsl instead of the fragment shader
+// --foveated [r]    with the compute renderer, trace fewer pixels in the tiles farther than r (0.2 of the height) from the center
+// --fovea-center <x> <y> the center of --foveated, 0 to 1 across and up (0.5 0.5)
+// --importance-map <file> like --foveated, but how much of every tile is traced is how bright it is in this grayscale image
+// --floor-texture <file> put an image on the floor, with mips that the ray cones of the pixels pick from
+// --floor-texture-scale <s> the floor texture repeats every s units (2)
+// --reflection-probes [n] read the far reflections from n cube maps (4, up to 8) that are drawn again when the scene changes
+// --probe-size <n>  the probes are n texels on a side (64)
+// --probe-bounce <b> the reflections of bounce b and after read a probe (2, so only the first is traced, 0 is off)
+// --probe-distance <d> the reflections that start more than d along the path from the eye read a probe too (0 is off)
+// --probe-refresh <frames> draw the probes again at most once every this many frames (8)
+// --bench-tiled-render time the fragment shader and the compute renderer
+// --persistent-threads [n] start only n (1024) workgroups of --tiled-render, which take the tiles from a queue until all are done
+// --cost-order       --persistent-threads, with the tiles that cost the most two frames before taken first
+// --bin-triangles [n] list the triangles that every tile of --tiled-render can see (room for n = 256 per tile), so its eye rays test fewer
+// --tile-frustum     cull the BVH of --accel bvh with the frustum of every tile of --tiled-render, once for all of its eye rays
+// --pixel-order <rows|morton> the order that the threads of --tiled-render take the pixels of a tile and the tiles in (rows)
+// --bench-pixel-order time --tiled-render with both orders
+// --bench-shadow-batch time the shadow rays one at a time, and in batches of 4, 8, and 16
+// --analytic         test the floor, the cube, and the primitives of the scene file in closed form in --accel twolevel
+// --bench-analytic   time --accel twolevel with the shapes as triangles, and with --analytic
+// --bvh-hot-layout [n]  count the visits of the BLAS nodes over n frames (16), and put the most visited together
+// --bench-hot-layout  time --accel twolevel before and after --bvh-hot-layout
+// --transform-group-size <n> how many triangles a workgroup of the transform pass does (64 by default)
+// --fused-morton     the transform pass also makes the box of the scene and the Morton keys of --accel bvh
+// --early-split [area] cut the triangles of --accel bvh whose box is more than area (0.01) of the scene box into pieces
+// --bvh-restructure [n] make every full build of --accel bvh better with n rounds (1) of treelet restructuring
+// --treelet-size <n> how many leaves the treelets of --bvh-restructure have, 3 to 7 (7)
+// --bench-restructure time --accel bvh with 0 to 3 rounds of --bvh-restructure, with a full build every frame
+// --bench-transform [triangles] time the transform pass with a few workgroup sizes (1000000 triangles by default)
+// --tri-format <vertices|records> which form of the triangles the ray tests read (records by default)
+// --tri-kernel <moller-trumbore|baldwin-weber|watertight> which ray-triangle test the shaders are compiled with
+// --bench-tri-kernels print how many ray-triangle tests per second every test does
+// --bench-tri-format time both forms of the triangles
+// --cost-view <c>   draw a heatmap of the work of every pixel: triangles, nodes, shadows, or all
+// --cost-scale <n>  the count that the heatmap draws white (64)
+// --visibility      rasterize the triangles the eye sees, instead of tracing camera rays
+// --bench-visibility time the camera rays and the visibility buffer
+// --temporal [n]    use the colors of the frame before again where the pixels see the same triangle, and trace every pixel every n frames (4)
+// --checkerboard    trace half of the pixels every frame, like --temporal 2, and fill in the rest from the pixels next to them
+// --hit-buffer      find the point that every pixel sees in a pass of its own, which the passes after it read
+// --denoise [n]     blur the noise of the frame n times (3, up to 5), only across pixels that see the same surface in the hit buffer
+// --adaptive-aa [n] trace n more rays (4, up to 8) in the pixels on the edges that the hit buffer finds
+// --reflection-scale <2|4> trace the reflections in an image 2 or 4 times smaller on each side, and upsample them
+// --shadow-scale <2|4> trace the shadow rays on a grid 2 or 4 times coarser first, and only where it disagrees for every pixel
+// --max-bounces <n> how many times a reflection can bounce (2 by default)
+// --shadow-batch [k] trace the shadow rays of a point to up to k (8) lights through the BVH together, sharing the nodes
+// --light-occluders [n] list the triangles inside the radius of every light (up to n, 256), and test only those for its shadow rays
+// --irradiance-probes [n] the ambient light comes from a grid of probes, n along the longest side of the scene (8)
+// --irradiance-rate <k> how many of the probes are traced again every frame (32)
+// --shadow-cache [cell] keep the shadow rays of the lights and meshes that did not move for the next frames, in cells of this size (0.02)
+// --lod-shadows <b> trace no shadow rays from reflection bounce b on (1 is the first reflection)
+// --lod-specular <b> leave out the specular highlight from reflection bounce b on
+// --lod-lights <b> [k] only add the k (4, up to 8) brightest lights of a point from reflection bounce b on
+// --lod-geometry <b> walk coarser copies of the meshes from reflection bounce b on, a coarser one every bounce (--accel twolevel)
+// --light-samples <n> only add n (up to 8) lights of a point, picked at random by how much light they give it
+// --sampler <name>   the random numbers of the light samples and Russian roulette (white, blue, or sobol)
+// --motion-blur [s]  blur what moves while the shutter is open, for s (0.5) of a frame, with one time per path (--accel twolevel)
+// --half-shading    work out the light of a point in 16-bit floats, if the GPU has them in GLSL (the ray tests stay 32-bit)
+// --material-table  store every color and reflectivity once in a table, and only the index of its material in every triangle
+// --accumulate [n]  average up to n (256 by default) jittered samples of a still scene, instead of rendering it again
+// --pause-at <s>    stop the animation at s seconds into the video (P stops and starts it too)
+// --bounce-epsilon <e> stop a path of reflections when it adds less than this to the pixel
+// --roulette [t]    stop paths that add less than t (0.1 by default) at random, with Russian roulette
+// --reflectivity <floor> <cube> how reflective the floor and the cube are, from 0 to 1
+// --lights <n>       add n small lights to the scene (up to 4094)
+// --scene-triangles <n> add about n triangles to the scene, in random copies of the cube
+// --scene-overlap <k> how many of those cubes are over every point of the floor, on average (2)
+// --scene-lights <n> add n lights with random radii among the copies
+// --scene-seed <n>   the random numbers of the generated scene (1)
+// --obj <file>       add the model of an OBJ file (or a .rtmodel) to the scene as a mesh of its own (more than once for more models)
+// --convert-obj <file> <model> turn an OBJ file into a .rtmodel, which --obj reads without parsing, and exit
+// --gltf <file>      add the meshes of the nodes of a glTF 2.0 file (.gltf or .glb), with the nodes that share a mesh as instances
+// --incremental-tlas [n] change the TLAS of the frame before instead of building it again, with room for n (1024) more instances
+// --expand-instances give every node of --gltf (and cube of --cube-instances) a copy of its mesh, instead of an instance of it
+// --cube-instances <n> add n copies of the cube in random places, with random colors, as instances of one mesh
+// --instance-grid    put the cubes of --cube-instances and the instances of the scene file with "grid" into a hashed grid
+//                    that the GPU builds every frame, instead of the TLAS
+// --obj-color <r g b> the color of the models of --obj (0.8 0.8 0.8)
+// --obj-reflectivity <r> how reflective the models of --obj are (0.25)
+// --scene <file>     read the camera, lights, models, instances, and animation from a JSON scene file (see SceneFile.h), and watch it for changes
+// --no-tiled-lights  light every pixel with every light, instead of the lights of its tile
+// --bench-tiled-lights time the fragment shader with and without the light lists of the tiles
+// --no-light-grid    light reflections with every light, instead of the lights in the light grid
+// --lights-in-storage  read the lights from the storage buffer, even when they fit in a uniform block
+// --bench-light-grid time the renderer with and without the light grid
+// --compact-meshes  store the triangles of the meshes in 32 bytes instead of 48, for the two-level BVH
+// --geometry-pool <MB> keep only the closest meshes that fit in a pool of MB on the GPU, and copy them in when they are needed
+// --stream-radius <r> with --geometry-pool, only want the meshes closer to the camera than r
+// --stream-budget <n> with --geometry-pool, copy at most n triangles into the pool in a frame (1048576)
+// --sparse-pool      with --geometry-pool, put every mesh in its own place in a sparse buffer, and commit only its pages
+// --no-dirty-tracking move every mesh in the transform pass every frame, not only the meshes that moved
+// --no-persistent-uploads give the matrices and lights new storage every frame, instead of writing them into mapped rings
+// --bench-uploads    time the renderer with and without the mapped rings
+// --async-upload     copy the meshes to the GPU on a loader thread, and with --realtime render while they arrive
+// --output-size <WxH>  the size of the window and of the saved frames (1280x720)
+// --render-size <WxH>  the size of the image that is rendered, which is scaled to the output size (the output size)
+// --render-scale <s>   render at s times the output size, like 0.5 for a quick preview
+// --target-ms <ms>   change the render size every frame, so that the GPU takes about ms for a frame (at most the render scale)
+// --slice-ms <ms>    draw the frame in bands of rows that each take about ms on the GPU, so a huge frame does not reset the driver
+// --realtime        animate with the time since the program started, instead of the time of the frame in the video
+// --dedupe-frames    do not render or encode a frame that has the same matrices, lights, and camera as the one before, copy it
+// --region <x,y,w,h> only trace that rectangle of the frames (from the top left), and save it over the frames that are there
+// --dirty-rects      with --headless, only trace the tiles that the meshes and lights that moved can change, keep the rest of the frame before
+// --precompute-frames make the matrices and lights of every frame at the start, and upload all the matrices once
+// --overlap-transform move the triangles of the next frame right after the draw of this one, into a second set of buffers
+// --serial-update    make the matrices and lights of a frame when it starts, not in a job while the frame before renders
+// --camera <model> [fov] the projection of the camera, with a ray per pixel: pinhole, fisheye (180), equirect, or panoramic (360)
+// --views <n>        render n views (up to 16) in a grid on the image in one pass, turned around the center of the camera
+// --view-angle <deg> the angle between two views of --views, like 4 for stereo (0 spreads them around the circle)
+// --preset <name>    draft, preview, or final: the bounces and the render scale, switched with keys 1, 2, and 3
+// --headless         render into a framebuffer of a fixed size in a hidden window, without swapping or vsync
+// --ui-thread        render headless on a thread of its own, and show the frames in a window that the main thread keeps responsive
+// --latency          measure the time from a key of the window to the swap of the frame that used it, and print its percentiles at the end
+// --low-latency [n]  let the CPU be only n frames (1) ahead of the GPU, so the frames do not wait in the queue of the driver (0 to 4)
+// --remote-preview <port> show the frames in a browser at http://<this computer>:<port>/ instead of the window, with its keys and camera
+// --preview-quality <q> the JPEG quality of --remote-preview, 1 to 100 (80)
+// --cpu-render [n]  render every frame on the CPU with n threads (one for every core), without a GPU or a window
+// --hybrid [share]  the CPU renders a strip at the top of every frame while the GPU renders the rest, starting with share (0.1) of the rows
+// --large-pages [1g] put the scene of --cpu-render in 2 MB pages (or 1 GB pages, on Linux where they were set aside)
+// --numa            spread the threads of the job system over the NUMA nodes, with a copy of the scene of --cpu-render on each
+// --cpu-kernel <scalar|avx> which ray-triangle test the CPU renderer uses (the fastest one the CPU has)
+// --bench-cpu-kernels print how many ray-triangle tests per second every test of the CPU renderer does
+// --animation <file> move the meshes with the keyframe tracks of the file (see Animation.h) instead of the tutorial motion
+// --bench-animation [n] time making the matrices of n random animation tracks (10000) with SSE and without
+// --frames <first:last[:step]> only render the frames from first to last (counting from 1), every step-th one
+// --merge <files...> put the videos of shards together into test.avi without encoding them again (the rest of the command line are the files)
+// --merge-frames     make test.avi from the frames in exportedFrames, without rendering anything
+// --gpus <n>        render every n-th frame on each of n GPUs, with a copy of the program for each one, and make the video
+// --gpu <i>          render headless on GPU i (WGL_NV_gpu_affinity), which is what the copies of --gpus do
+// --egl              render headless with an EGL context on a GPU device, without a window or display server (on device i with --gpu)
+// --farm <folder> [n] hand out chunks of n frames (24) to the workers of a render farm that share the folder, and make the video
+// --farm-worker <folder> render the chunks of the farm in the folder with the other options, one after the other, until it is done
+// --farm-timeout <s> hand out the chunk of a worker again when it has not written a heartbeat for s seconds (30)
+// --frames-folder <dir> save the frames in dir instead of exportedFrames
+// --serve <port>     stay running after init, and render the jobs that --submit sends to the port, taking turns
+// --serve-slice <n>  the frames of a turn of a job of --serve (8)
+// --serve-jobs <n>   how many jobs of --serve render at once, the others wait (4)
+// --metrics-port <port> answer GET /metrics with the numbers of --serve, for Prometheus
+// --submit <port> <options...> send a job to the server of --serve: the rest of the command line (--frames, --frames-folder,
+//                    --resume, --export-png, --scene), or quit to stop the server
+// --segment-frames <n> encode the saved frames in segments of n while rendering, 0 encodes them all at the end
+// --cpu-trace <file>  save the CPU zones and GPU passes as a Chrome trace (chrome://tracing or ui.perfetto.dev)
+// --capture <file>   write the matrices, lights, and camera of every frame of the video into a file
+// --replay <file> [a-b] render frames a to b (all) of a capture again headless, with the frame report and a CPU trace, and exit
+// --estimate [n]     render n frames (8) of --frames with fewer pixels, print how long all of them will take, and exit
+// --estimate-scale <s> the width and height of --estimate, as a part of the render size (0.5)
+// --gl-debug [ms]    print the warnings of the driver, and the calls that made the CPU wait longer than ms (1) for the GPU
+// --no-frame-report do not print the percentiles and histogram of the frame times at the end
+// --timing-log <file> write the GPU time of every pass of every frame to a file, CSV, or JSON if it ends with .json
+// --gpu-counters [p] with --timing-log, sample the AMD or Intel hardware counters with one of the names p (a,b,c) of the transform and draw
+// --resume           keep the frames that are already in exportedFrames, and render from the first one that is missing
+// --export-png       save every frame in exportedFrames, and make the video from them at the end, instead of streaming it to ffmpeg
+// --proxy <scale>    also make proxy_<video> at this size (0.25), downsampled on the GPU from the same frames
+// --thumbnails <n>   also save every n-th frame, 160 pixels wide, in strips of 10 (thumbs_<frame>.png)
+// --upload <url>     stream the video to S3-compatible object storage (http://host:port/bucket/key) instead of test.avi
+// --shm-encoder [n]  hand the streamed frames to ffmpeg through a ring of n (4) frames in shared memory, from a copy of this program
+// --upload-part-mb <n> the size of the parts of --upload, which are in memory while they upload (8, at least 5)
+// --hw-encode        encode the video on the GPU (NVENC, AMF, or Quick Sync), if this computer has one of them
+// --video-encoder <name> the ffmpeg encoder for the video, like libx264 or h264_nvenc
+// --frame-format <f> how --export-png saves the frames: png, bmp, qoi, raw, or mzf (the lossless deltas of Mezzanine.h)
+// --mezzanine-keyframes <n> with --frame-format mzf, make every n-th frame (30) a keyframe
+// --disk-writer [n]  write the qoi, raw, and mzf frames with asynchronous I/O (io_uring, or overlapped on Windows), n (16) files at once
+// --disk-writer-cached  write the files of --disk-writer through the page cache
+// --png-level <n>    the zlib level of the PNG frames, 0 (none) to 9 (smallest)
+// --job-threads <n> how many threads the job system has, which save the frames, build the BVHs, and run the CPU renderer.
+//                   0 runs all of it on the render thread (--encoder-threads <n> is the same)
+// --sync-readback    read every frame back with glReadPixels right away, instead of through the ring of pixel buffers
+// --frame-batch <k>  render k frames into the layers of an array texture, and read them back with one transfer (headless)
+// --yuv-readback     convert the streamed frames to YUV 4:2:0 on the GPU, which halves the bytes that are read back
+// --bench-readback   time rendering and reading back frames with and without the ring
+// --bench-export     time reading back, copying, encoding in every format, and writing frames, each on its own
+// --trace-barriers   print every memory barrier of the first frame, and what it was for
+// Returns false if an option is not one of these, or has no value, or the value of --accel is not a name.
+// The other options are still read
+bool parseCommandLine(int argc, char** argv)
+{
+	bool allKnown = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--accel" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			bool known = false;
+
+			for (int a = 0; a < NUM_ACCELS; a++)
+			{
+				if (name == accelNames[a])
+				{
+					accelBackend = a;
+					known = true;
+				}
+			}
+
+			if (!known)
+			{
+				std::cout << "Unknown acceleration structure: " << name << std::endl;
+				allKnown = false;
+			}
+		}
+		else if (arg == "--bench-accel")
+		{
+			benchmarkAccels = true;
+		}
+		else if (arg == "--wavefront")
+		{
+			useWavefront = true;
+		}
+		else if (arg == "--bench-wavefront")
+		{
+			benchmarkWavefront = true;
+		}
+		else if (arg == "--tiled-render")
+		{
+			useTiledRender = true;
+		}
+		else if (arg == "--foveated")
+		{
+			variableRate = true;
+			useTiledRender = true;
+
+			// the radius is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				foveaRadius = std::max(0.01f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--fovea-center" && i + 2 < argc)
+		{
+			foveaCenter.x = (float)atof(argv[++i]);
+			foveaCenter.y = (float)atof(argv[++i]);
+		}
+		else if (arg == "--floor-texture" && i + 1 < argc)
+		{
+			floorTextureFile = argv[++i];
+		}
+		else if (arg == "--floor-texture-scale" && i + 1 < argc)
+		{
+			floorTextureScale = std::max(0.01f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--reflection-probes")
+		{
+			reflectionProbes = 4;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				reflectionProbes = glm::clamp(atoi(argv[++i]), 1, MAX_REFLECTION_PROBES);
+		}
+		else if (arg == "--probe-size" && i + 1 < argc)
+		{
+			probeSize = glm::clamp(atoi(argv[++i]), 8, 1024);
+		}
+		else if (arg == "--probe-bounce" && i + 1 < argc)
+		{
+			probeBounce = std::max(atoi(argv[++i]), 0);
+		}
+		else if (arg == "--probe-distance" && i + 1 < argc)
+		{
+			probeDistance = std::max((float)atof(argv[++i]), 0.0f);
+		}
+		else if (arg == "--probe-refresh" && i + 1 < argc)
+		{
+			probeRefreshFrames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--importance-map" && i + 1 < argc)
+		{
+			importanceMapFile = argv[++i];
+			variableRate = true;
+			useTiledRender = true;
+		}
+		else if (arg == "--persistent-threads")
+		{
+			persistentThreads = true;
+			useTiledRender = true;
+
+			// the number of workgroups is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				persistentGroups = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--cost-order")
+		{
+			costOrder = true;
+			persistentThreads = true;
+			useTiledRender = true;
+		}
+		else if (arg == "--tile-frustum")
+		{
+			tileFrustum = true;
+			useTiledRender = true;
+		}
+		else if (arg == "--pixel-order" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			useTiledRender = true;
+
+			if (name == pixelOrderNames[PIXEL_ORDER_MORTON])
+				pixelOrder = PIXEL_ORDER_MORTON;
+			else if (name != pixelOrderNames[PIXEL_ORDER_ROWS])
+				std::cout << "Unknown pixel order: " << name << std::endl;
+		}
+		else if (arg == "--bench-pixel-order")
+		{
+			benchmarkPixelOrder = true;
+		}
+		else if (arg == "--bin-triangles")
+		{
+			binTriangles = true;
+			useTiledRender = true;
+
+			// the room for the lists is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				binEntries = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--bench-tiled-render")
+		{
+			benchmarkTiledRender = true;
+		}
+		else if (arg == "--fused-morton")
+		{
+			fusedMorton = true;
+		}
+		else if (arg == "--early-split")
+		{
+			earlySplitArea = 0.01f;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				earlySplitArea = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--bvh-restructure")
+		{
+			bvhRestructureRounds = 1;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				bvhRestructureRounds = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--treelet-size" && i + 1 < argc)
+		{
+			// the sets of the leaves of a treelet are bits of an int, and BuildBVH.glsl has room for 7
+			bvhTreeletSize = std::min(std::max(3, atoi(argv[++i])), 7);
+		}
+		else if (arg == "--bench-restructure")
+		{
+			benchmarkRestructure = true;
+		}
+		else if (arg == "--transform-group-size" && i + 1 < argc)
+		{
+			// the smallest maximum that OpenGL allows is 1024
+			transformGroupSize = std::min(std::max(1, atoi(argv[++i])), 1024);
+			choicesOnCommandLine.insert("transform-group-size");
+		}
+		else if (arg == "--bench-transform")
+		{
+			benchmarkTransform = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				transformBenchTriangles = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--tri-format" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+
+			for (int f = 0; f < 2; f++)
+			{
+				if (name == triangleFormatNames[f])
+					triangleFormat = f;
+			}
+
+			choicesOnCommandLine.insert("tri-format");
+		}
+		else if (arg == "--bench-tri-format")
+		{
+			benchmarkTriangleFormats = true;
+		}
+		else if (arg == "--tri-kernel" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+
+			for (int k = 0; k < NUM_TRIANGLE_KERNELS; k++)
+			{
+				if (name == triangleKernelNames[k])
+					triangleKernel = k;
+			}
+
+			choicesOnCommandLine.insert("tri-kernel");
+		}
+		else if (arg == "--bench-tri-kernels")
+		{
+			benchmarkTriangleKernels = true;
+		}
+		else if (arg == "--cost-view" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			bool known = false;
+
+			for (int c = 0; c <= COST_VIEW_ALL; c++)
+			{
+				if (name == costViewNames[c])
+				{
+					costView = c;
+					known = true;
+				}
+			}
+
+			if (!known)
+				std::cout << "Unknown cost view: " << name << std::endl;
+		}
+		else if (arg == "--cost-scale" && i + 1 < argc)
+		{
+			costScale = std::max(1.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--visibility")
+		{
+			useVisibilityBuffer = true;
+		}
+		else if (arg == "--bench-visibility")
+		{
+			benchmarkVisibility = true;
+		}
+		else if (arg == "--hit-buffer")
+		{
+			useHitBuffer = true;
+		}
+		else if (arg == "--denoise")
+		{
+			denoisePasses = 3;
+
+			// the number of passes is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				denoisePasses = glm::clamp(atoi(argv[++i]), 1, 5);
+		}
+		else if (arg == "--adaptive-aa")
+		{
+			adaptiveSamples = 4;
+
+			// the number of rays is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				adaptiveSamples = glm::clamp(atoi(argv[++i]), 1, 8);
+		}
+		else if (arg == "--temporal")
+		{
+			useTemporal = true;
+
+			// the number of frames is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				temporalRefresh = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--checkerboard")
+		{
+			useCheckerboard = true;
+			useTemporal = true;
+		}
+		else if (arg == "--reflection-scale" && i + 1 < argc)
+		{
+			reflectionScale = glm::clamp(atoi(argv[++i]), 1, 4);
+		}
+		else if (arg == "--shadow-scale" && i + 1 < argc)
+		{
+			shadowScale = glm::clamp(atoi(argv[++i]), 1, 4);
+		}
+		else if (arg == "--accumulate")
+		{
+			accumulateSamples = 256;
+
+			// the number of samples is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				accumulateSamples = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--pause-at" && i + 1 < argc)
+		{
+			pauseAt = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--shadow-cache")
+		{
+			useShadowCache = true;
+
+			// the size of the cells is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				shadowCacheCell = std::max(0.001f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--shadow-batch")
+		{
+			shadowBatch = 8;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				shadowBatch = glm::clamp(atoi(argv[++i]), 0, SHADOW_BATCH_MAX);
+		}
+		else if (arg == "--bench-shadow-batch")
+		{
+			benchmarkShadowBatch = true;
+		}
+		else if (arg == "--analytic")
+		{
+			analyticPrimitives = true;
+		}
+		else if (arg == "--bench-analytic")
+		{
+			benchmarkAnalytic = true;
+		}
+		else if (arg == "--bvh-hot-layout")
+		{
+			bvhHotLayoutFrames = 16;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				bvhHotLayoutFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--bench-hot-layout")
+		{
+			benchmarkHotLayout = true;
+		}
+		else if (arg == "--irradiance-probes")
+		{
+			irradianceProbes = 8;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				irradianceProbes = glm::clamp(atoi(argv[++i]), 2, 64);
+		}
+		else if (arg == "--irradiance-rate" && i + 1 < argc)
+		{
+			irradianceRate = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--light-occluders")
+		{
+			lightOccluders = LIGHT_OCCLUDERS_DEFAULT_SIZE;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				lightOccluders = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--lod-shadows" && i + 1 < argc)
+		{
+			lodShadowsFrom = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--lod-specular" && i + 1 < argc)
+		{
+			lodSpecularFrom = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--lod-lights" && i + 1 < argc)
+		{
+			lodLightsFrom = std::max(0, atoi(argv[++i]));
+
+			// the number of lights is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				lodLightCount = glm::clamp(atoi(argv[++i]), 1, 8);
+		}
+		else if (arg == "--lod-geometry" && i + 1 < argc)
+		{
+			lodGeometryFrom = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--light-samples" && i + 1 < argc)
+		{
+			lightSamples = glm::clamp(atoi(argv[++i]), 0, 8);
+		}
+		else if (arg == "--sampler" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			bool known = false;
+
+			for (int s = 0; s < NUM_SAMPLERS; s++)
+			{
+				if (name == samplerNames[s])
+				{
+					samplerKind = s;
+					known = true;
+				}
+			}
+
+			if (!known)
+				std::cout << "Unknown sampler: " << name << std::endl;
+		}
+		else if (arg == "--motion-blur")
+		{
+			motionBlur = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				motionShutter = std::min(std::max((float)atof(argv[++i]), 0.0f), 1.0f);
+		}
+		else if (arg == "--half-shading")
+		{
+			halfShading = true;
+		}
+		else if (arg == "--material-table")
+		{
+			materialTable = true;
+		}
+		else if (arg == "--max-bounces" && i + 1 < argc)
+		{
+			maxBounces = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--bounce-epsilon" && i + 1 < argc)
+		{
+			throughputEpsilon = (float)atof(argv[++i]);
+		}
+		else if (arg == "--roulette")
+		{
+			russianRoulette = true;
+
+			// the threshold is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				rouletteThreshold = (float)atof(argv[++i]);
+		}
+		else if (arg == "--reflectivity" && i + 2 < argc)
+		{
+			floorReflectivity = (float)atof(argv[++i]);
+			cubeReflectivity = (float)atof(argv[++i]);
+		}
+		else if (arg == "--scene-triangles" && i + 1 < argc)
+		{
+			generatedTriangles = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--scene-overlap" && i + 1 < argc)
+		{
+			sceneOverlap = std::max(0.01f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--scene-lights" && i + 1 < argc)
+		{
+			generatedLightCount = std::max(0, std::min(atoi(argv[++i]), MAX_LIGHTS - 2));
+		}
+		else if (arg == "--obj" && i + 1 < argc)
+		{
+			objFiles.push_back(argv[++i]);
+		}
+		else if (arg == "--convert-obj" && i + 2 < argc)
+		{
+			convertObjFile = argv[++i];
+			convertModelFile = argv[++i];
+		}
+		else if (arg == "--gltf" && i + 1 < argc)
+		{
+			gltfFiles.push_back(argv[++i]);
+		}
+		else if (arg == "--incremental-tlas")
+		{
+			incrementalTLAS = true;
+
+			// the room for more instances is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				instanceRoom = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--instance-grid")
+		{
+			useInstanceGrid = true;
+		}
+		else if (arg == "--expand-instances")
+		{
+			expandInstances = true;
+		}
+		else if (arg == "--cube-instances" && i + 1 < argc)
+		{
+			cubeInstances = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--obj-color" && i + 3 < argc)
+		{
+			objColor.r = (float)atof(argv[++i]);
+			objColor.g = (float)atof(argv[++i]);
+			objColor.b = (float)atof(argv[++i]);
+		}
+		else if (arg == "--obj-reflectivity" && i + 1 < argc)
+		{
+			objReflectivity = std::min(std::max((float)atof(argv[++i]), 0.0f), 1.0f);
+		}
+		else if (arg == "--scene-seed" && i + 1 < argc)
+		{
+			sceneSeed = (unsigned int)atoi(argv[++i]);
+		}
+		else if (arg == "--lights" && i + 1 < argc)
+		{
+			numExtraLights = std::max(0, std::min(atoi(argv[++i]), MAX_LIGHTS - 2));
+		}
+		else if (arg == "--no-tiled-lights")
+		{
+			tiledLightCulling = false;
+		}
+		else if (arg == "--bench-tiled-lights")
+		{
+			benchmarkTiledLights = true;
+		}
+		else if (arg == "--lights-in-storage")
+		{
+			lightUniforms = false;
+		}
+		else if (arg == "--no-light-grid")
+		{
+			lightGridEnabled = false;
+		}
+		else if (arg == "--compact-meshes")
+		{
+			compactMeshes = true;
+		}
+		else if (arg == "--geometry-pool" && i + 1 < argc)
+		{
+			geometryPoolMB = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--sparse-pool")
+		{
+			sparsePool = true;
+		}
+		else if (arg == "--stream-radius" && i + 1 < argc)
+		{
+			streamRadius = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--stream-budget" && i + 1 < argc)
+		{
+			streamBudget = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--no-dirty-tracking")
+		{
+			dirtyTracking = false;
+		}
+		else if (arg == "--no-persistent-uploads")
+		{
+			persistentUploads = false;
+		}
+		else if (arg == "--async-upload")
+		{
+			asyncUpload = true;
+		}
+		else if (arg == "--output-size" && i + 1 < argc)
+		{
+			sscanf(argv[++i], "%dx%d", &outputWidth, &outputHeight);
+			outputWidth = std::max(1, outputWidth);
+			outputHeight = std::max(1, outputHeight);
+		}
+		else if (arg == "--render-size" && i + 1 < argc)
+		{
+			sscanf(argv[++i], "%dx%d", &width, &height);
+			width = std::max(1, width);
+			height = std::max(1, height);
+			renderSizeGiven = true;
+		}
+		else if (arg == "--render-scale" && i + 1 < argc)
+		{
+			renderScale = std::max(0.01f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--target-ms" && i + 1 < argc)
+		{
+			targetFrameMs = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--slice-ms" && i + 1 < argc)
+		{
+			sliceBudgetMs = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--realtime")
+		{
+			realtimeAnimation = true;
+		}
+		else if (arg == "--overlap-transform")
+		{
+			overlapTransform = true;
+		}
+		else if (arg == "--dedupe-frames")
+		{
+			dedupeFrames = true;
+		}
+		else if (arg == "--proxy" && i + 1 < argc)
+		{
+			proxyScale = std::min(std::max((float)atof(argv[++i]), 0.0f), 1.0f);
+		}
+		else if (arg == "--thumbnails" && i + 1 < argc)
+		{
+			thumbnailEvery = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--dirty-rects")
+		{
+			dirtyRects = true;
+		}
+		else if (arg == "--region" && i + 1 < argc)
+		{
+			// the region goes over the saved frames, so they are saved too
+			if (sscanf(argv[++i], "%d,%d,%d,%d", &regionX, &regionY, &regionWidth, &regionHeight) == 4)
+				streamVideo = false;
+			else
+				regionWidth = 0;
+		}
+		else if (arg == "--precompute-frames")
+		{
+			precomputeFrames = true;
+		}
+		else if (arg == "--serial-update")
+		{
+			pipelineUpdates = false;
+		}
+		else if (arg == "--camera" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			cameraModel = -1;
+
+			for (int m = 0; m < 4; m++)
+			{
+				if (name == cameraModelNames[m])
+					cameraModel = m;
+			}
+
+			if (cameraModel < 0)
+				std::cout << "--camera is pinhole, fisheye, equirect, or panoramic, not " << name << std::endl;
+
+			// the angle of the model, in degrees
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				cameraModelFov = std::max(1.0f, std::min(360.0f, (float)atof(argv[++i])));
+		}
+		else if (arg == "--views" && i + 1 < argc)
+		{
+			numViews = std::min(std::max(1, atoi(argv[++i])), MAX_VIEWS);
+		}
+		else if (arg == "--view-angle" && i + 1 < argc)
+		{
+			viewAngle = (float)atof(argv[++i]);
+		}
+		else if (arg == "--preset" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+
+			for (int p = 0; p < QUALITY_PRESETS; p++)
+			{
+				if (name == qualityPresets[p].name)
+					qualityPreset = p;
+			}
+
+			if (qualityPreset < 0)
+				std::cout << "Unknown preset: " << name << std::endl;
+		}
+		else if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--ui-thread")
+		{
+			uiThread = true;
+		}
+		else if (arg == "--latency")
+		{
+			latencyReport = true;
+		}
+		else if (arg == "--low-latency")
+		{
+			lowLatencyFrames = 1;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				lowLatencyFrames = std::max(0, std::min(atoi(argv[++i]), LOW_LATENCY_MAX_FRAMES));
+		}
+		else if (arg == "--remote-preview" && i + 1 < argc)
+		{
+			// the browser takes the place of the window
+			remotePreviewPort = std::max(0, atoi(argv[++i]));
+			headless = remotePreviewPort > 0 || headless;
+		}
+		else if (arg == "--preview-quality" && i + 1 < argc)
+		{
+			remotePreviewQuality = std::max(1, std::min(atoi(argv[++i]), 100));
+		}
+		else if (arg == "--cpu-render")
+		{
+			cpuRender = true;
+
+			// the number of threads is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				cpuThreads = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--hybrid")
+		{
+			hybridRender = true;
+
+			// the share of the CPU at the start is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				hybridShare = std::min(std::max((float)atof(argv[++i]), 0.0f), 1.0f);
+		}
+		else if (arg == "--cpu-kernel" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+
+			for (int k = 0; k < NUM_CPU_KERNELS; k++)
+			{
+				if (name == cpuKernelNames[k])
+					cpuKernel = k;
+			}
+		}
+		else if (arg == "--bench-cpu-kernels")
+		{
+			benchmarkCpuKernels = true;
+		}
+		else if (arg == "--animation" && i + 1 < argc)
+		{
+			animationFile = argv[++i];
+		}
+		else if (arg == "--scene" && i + 1 < argc)
+		{
+			sceneFileName = argv[++i];
+		}
+		else if (arg == "--bench-animation")
+		{
+			benchmarkAnimation = true;
+
+			// the number of tracks is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				animationBenchTracks = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			// last and step are optional, "100" is the same as "100:100"
+			int first = 1, last = -1, step = 1;
+			int count = sscanf(argv[++i], "%d:%d:%d", &first, &last, &step);
+
+			firstFrame = std::max(1, first);
+			lastFrame = count >= 2 ? last : first;
+			frameStep = std::max(1, step);
+
+			// with a step, the shards of a video are not one after the other, so they cannot be streamed
+			if (frameStep > 1)
+				streamVideo = false;
+		}
+		else if (arg == "--merge")
+		{
+			while (i + 1 < argc)
+				mergeShards.push_back(argv[++i]);
+		}
+		else if (arg == "--merge-frames")
+		{
+			mergeFrames = true;
+		}
+		else if (arg == "--gpus" && i + 1 < argc)
+		{
+			gpuCount = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--frames-folder" && i + 1 < argc)
+		{
+			framesFolder = argv[++i];
+		}
+		else if (arg == "--farm" && i + 1 < argc)
+		{
+			farmFolder = argv[++i];
+
+			// the frames of a chunk are optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				farmChunkSize = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--farm-worker" && i + 1 < argc)
+		{
+			farmWorkerFolder = argv[++i];
+		}
+		else if (arg == "--farm-timeout" && i + 1 < argc)
+		{
+			farmTimeout = std::max(1.0f, (float)atof(argv[++i]));
+		}
+		else if (arg == "--serve" && i + 1 < argc)
+		{
+			// the frames are for the jobs, there is nobody to show them to
+			servePort = std::max(0, atoi(argv[++i]));
+			headless = servePort > 0 || headless;
+		}
+		else if (arg == "--serve-slice" && i + 1 < argc)
+		{
+			serveSliceFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--serve-jobs" && i + 1 < argc)
+		{
+			serveMaxJobs = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--metrics-port" && i + 1 < argc)
+		{
+			metricsPort = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--submit" && i + 1 < argc)
+		{
+			submitPort = std::max(0, atoi(argv[++i]));
+
+			// the rest of the command line is the job, with the options that have spaces in quotes again
+			while (i + 1 < argc)
+			{
+				std::string option = argv[++i];
+
+				if (!submitOptions.empty())
+					submitOptions += " ";
+
+				submitOptions += option.find(' ') == std::string::npos ? option : "\"" + option + "\"";
+			}
+		}
+		else if (arg == "--egl")
+		{
+			useEgl = true;
+			headless = true;
+		}
+		else if (arg == "--gpu" && i + 1 < argc)
+		{
+			// a context on one GPU has no window
+			renderGpu = std::max(0, atoi(argv[++i]));
+			headless = true;
+		}
+		else if (arg == "--segment-frames" && i + 1 < argc)
+		{
+			segmentFrames = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--cpu-trace" && i + 1 < argc)
+		{
+			cpuTraceName = argv[++i];
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+		{
+			captureName = argv[++i];
+		}
+		else if (arg == "--estimate")
+		{
+			estimateSamples = 8;
+			headless = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				estimateSamples = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--estimate-scale" && i + 1 < argc)
+		{
+			estimateScale = std::min(1.0f, std::max(0.05f, (float)atof(argv[++i])));
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			replayName = argv[++i];
+			headless = true;
+
+			// one frame, or a range of them
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				if (sscanf(argv[++i], "%d-%d", &replayFirst, &replayLast) == 1)
+					replayLast = replayFirst;
+			}
+		}
+		else if (arg == "--gl-debug")
+		{
+			glDebug = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				glStallMs = std::max(0.0, atof(argv[++i]));
+		}
+		else if (arg == "--no-frame-report")
+		{
+			frameReport = false;
+		}
+		else if (arg == "--timing-log" && i + 1 < argc)
+		{
+			timingLogName = argv[++i];
+		}
+		else if (arg == "--gpu-counters")
+		{
+			gpuCounters = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				gpuCounterPatterns = argv[++i];
+		}
+		else if (arg == "--resume")
+		{
+			// the frames of a streamed video are gone when it stops, so only saved frames can resume
+			resumeFrames = true;
+			streamVideo = false;
+		}
+		else if (arg == "--export-png")
+		{
+			streamVideo = false;
+		}
+		else if (arg == "--upload" && i + 1 < argc)
+		{
+			uploadUrl = argv[++i];
+		}
+		else if (arg == "--upload-stdin" && i + 1 < argc)
+		{
+			uploadUrl = argv[++i];
+			uploadFromStdin = true;
+		}
+		else if (arg == "--shm-encoder")
+		{
+			shmEncoder = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				frameRingSlots = std::max(2, atoi(argv[++i]));
+		}
+		else if (arg == "--encode-shm" && i + 1 < argc)
+		{
+			encodeShmName = argv[++i];
+		}
+		else if (arg == "--upload-part-mb" && i + 1 < argc)
+		{
+			uploadPartMB = std::max(MIN_UPLOAD_PART_BYTES >> 20, atoi(argv[++i]));
+		}
+		else if (arg == "--hw-encode")
+		{
+			hardwareEncode = true;
+		}
+		else if (arg == "--video-encoder" && i + 1 < argc)
+		{
+			videoEncoder = argv[++i];
+		}
+		else if (arg == "--frame-format" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+
+			if (name == "png")
+				frameFormat = FRAME_FORMAT_PNG;
+			else if (name == "bmp")
+				frameFormat = FRAME_FORMAT_BMP;
+			else if (name == "qoi")
+				frameFormat = FRAME_FORMAT_QOI;
+			else if (name == "raw")
+				frameFormat = FRAME_FORMAT_RAW;
+			else if (name == "mzf")
+				frameFormat = FRAME_FORMAT_MEZZANINE;
+			else
+				std::cout << "Unknown frame format: " << name << std::endl;
+		}
+		else if (arg == "--mezzanine-keyframes" && i + 1 < argc)
+		{
+			mezzanineKeyframes = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--png-level" && i + 1 < argc)
+		{
+			pngLevel = glm::clamp(atoi(argv[++i]), 0, 9);
+		}
+		else if (arg == "--disk-writer")
+		{
+			useDiskWriter = true;
+
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				diskWritesInFlight = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--disk-writer-cached")
+		{
+			diskWriterDirect = false;
+		}
+		else if ((arg == "--job-threads" || arg == "--encoder-threads") && i + 1 < argc)
+		{
+			jobThreads = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--numa")
+		{
+			numaJobs = true;
+		}
+		else if (arg == "--large-pages")
+		{
+			cpuSceneArena.enabled = true;
+
+			// the size of the pages is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				cpuSceneArena.huge = std::string(argv[++i]) == "1g";
+		}
+		else if (arg == "--sync-readback")
+		{
+			asyncReadback = false;
+		}
+		else if (arg == "--frame-batch" && i + 1 < argc)
+		{
+			frameBatch = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--yuv-readback")
+		{
+			yuvReadback = true;
+		}
+		else if (arg == "--bench-readback")
+		{
+			benchmarkReadback = true;
+		}
+		else if (arg == "--bench-export")
+		{
+			benchmarkExport = true;
+		}
+		else if (arg == "--trace-barriers")
+		{
+			traceBarriers = true;
+		}
+		else if (arg == "--bench")
+		{
+			benchmarkRender = true;
+			headless = true;
+		}
+		else if (arg == "--bench-embree")
+		{
+			benchmarkRender = true;
+			benchmarkEmbree = true;
+			headless = true;
+		}
+		else if (arg == "--bench-uploads")
+		{
+			benchmarkUploads = true;
+		}
+		else if (arg == "--bench-light-grid")
+		{
+			benchmarkLightGrid = true;
+		}
+		else if (arg == "--wave-sort")
+		{
+			waveSortRays = true;
+		}
+		else if (arg == "--bench-wave-sort")
+		{
+			benchmarkWaveSort = true;
+		}
+		else if (arg == "--wave-compact")
+		{
+			waveCompactQueues = true;
+		}
+		else if (arg == "--subgroup-traversal")
+		{
+			waveSubgroupTraversal = true;
+		}
+		else if (arg == "--bench-subgroup-traversal")
+		{
+			benchmarkSubgroupTraversal = true;
+		}
+		else if (arg == "--no-indirect-dispatch")
+		{
+			waveIndirectDispatch = false;
+		}
+		else if (arg == "--bench-indirect")
+		{
+			benchmarkWaveIndirect = true;
+		}
+		else if (arg == "--ray-stats")
+		{
+			rayStats = true;
+		}
+		else if (arg == "--startup-times")
+		{
+			printStartupTimes = true;
+		}
+		else if (arg == "--hot-reload")
+		{
+			hotReload = true;
+		}
+		else if (arg == "--no-specialize")
+		{
+			specializeScene = false;
+		}
+		else if (arg == "--no-shader-cache")
+		{
+			useShaderCache = false;
+		}
+		else if (arg == "--shared-cache" && i + 1 < argc)
+		{
+			sharedCacheUrl = argv[++i];
+
+			// the names of the files go after it
+			while (!sharedCacheUrl.empty() && sharedCacheUrl.back() == '/')
+				sharedCacheUrl.pop_back();
+		}
+		else if (arg == "--autotune")
+		{
+			autotune = true;
+
+			if (i + 1 < argc && std::string(argv[i + 1]) == "force")
+			{
+				retune = true;
+				i++;
+			}
+		}
+		else if (arg == "--tune-frames" && i + 1 < argc)
+		{
+			tuneFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--no-tune-profile")
+		{
+			useTuneProfile = false;
+		}
+		else if (arg == "--bvh-stack" && i + 1 < argc)
+		{
+			// a stack smaller than the deepest tree loses nodes
+			bvhStackSize = std::min(std::max(8, atoi(argv[++i])), 256);
+			choicesOnCommandLine.insert("bvh-stack");
+		}
+		else if (arg == "--spirv")
+		{
+			useSpirv = true;
+		}
+		else if (arg == "--memory-report")
+		{
+			memoryReport = true;
+		}
+		else if (arg == "--bench-frames" && i + 1 < argc)
+		{
+			benchmarkFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if ((arg == "--save-golden" || arg == "--check-golden") && i + 1 < argc)
+		{
+			goldenMode = arg == "--save-golden" ? GOLDEN_SAVE : GOLDEN_CHECK;
+			goldenFolder = argv[++i];
+			headless = true;
+		}
+		else if (arg == "--still" && i + 1 < argc)
+		{
+			sscanf(argv[++i], "%dx%d", &stillWidth, &stillHeight);
+			stillWidth = std::max(1, stillWidth);
+			stillHeight = std::max(1, stillHeight);
+			headless = true;
+		}
+		else if (arg == "--still-tile" && i + 1 < argc)
+		{
+			// a tile of a TIFF is a multiple of 16 across
+			stillTile = std::max(16, atoi(argv[++i]) / 16 * 16);
+		}
+		else if (arg == "--still-file" && i + 1 < argc)
+		{
+			stillFile = argv[++i];
+		}
+		else if (arg == "--golden-frames" && i + 1 < argc)
+		{
+			goldenFrames.clear();
+
+			// the numbers are read one after the other, each one after a comma
+			const char* list = argv[++i];
+			int frame, length;
+
+			while (sscanf(list, "%d%n", &frame, &length) == 1)
+			{
+				goldenFrames.push_back(frame);
+				list += length;
+
+				if (*list != ',')
+					break;
+
+				list++;
+			}
+		}
+		else if (arg == "--golden-psnr" && i + 1 < argc)
+		{
+			goldenPSNR = (float)atof(argv[++i]);
+		}
+		else if (arg == "--golden-slowdown" && i + 1 < argc)
+		{
+			goldenSlowdown = (float)atof(argv[++i]);
+		}
+		else
+		{
+			// the options with a value get here too when the value is missing
+			std::cout << "Unknown option, or an option without its value: " << arg << std::endl;
+			allKnown = false;
+		}
+	}
+
+	return allKnown;
+}
+
+// Start the output of the frames of --frames: ffmpeg for the video, or the folder and the list of saved frames
+void startFrameOutput()
+{
+	// The frames go straight to ffmpeg, or if it cannot be started, into exportedFrames like with --export-png
+	if (streamVideo && !startVideoStream())
+	{
+		std::cout << "could not start ffmpeg, saving the frames in exportedFrames instead" << std::endl;
+		streamVideo = false;
+		yuvReadback = false;
+	}
+
+	if (!streamVideo)
+	{
+		// This creates the folder, only if it does
+		// not already exist, called "exportedFrames" (or framesFolder)
+		makeFolder(framesFolder);
+
+		// the writer is kept for every job of --serve
+		if (useDiskWriter && !diskWriter.running && !startDiskWriter(diskWriter, diskWritesInFlight, diskWriterDirect))
+			std::cout << "could not start the disk writer, the frames are written by the jobs that encode them" << std::endl;
+
+		// the saved frames from before are only kept when resuming
+		frameManifest.open(framesFolder + "/frames.txt", resumeFrames ? std::ios::app : std::ios::trunc);
+
+		// a shard does not make a video (see --merge-frames), so it has no segments
+		if (segmentFrames > 0 && renderingAllFrames())
+			startSegments();
+
+	}
+}
+
+// Finish the output of the frames, once they are all saved, and make the video
+void finishFrameOutput()
+{
+	// the video is done once ffmpeg has the last frame
+	stopVideoStream();
+
+	// the next job of --serve has a list in its own folder
+	frameManifest.close();
+
+	// A shard only has some of the frames, so the video is made after they are all together (see --merge-frames)
+	if (!segmentFramesSaved.empty())
+	{
+		finishSegments();
+
+		// the next job of --serve starts segments of its own
+		segmentFramesSaved.clear();
+		segmentStarted.clear();
+	}
+	else if (!streamVideo && renderingAllFrames())
+		encodeSavedFrames();
+}
+
+// Render the frames from nextFrame on, every frameStep-th one up to lastFrame, without the ones in savedBefore,
+// but only count of them, and move nextFrame on to the one after the last. Returns how many were rendered.
+// The last ones can still be in the readback ring, and being saved (see finishAllReadbacks and finishSavingFrames)
+int renderFrameRange(unsigned char* pixels, int& nextFrame, int count, const std::vector<bool>& savedBefore)
+{
+	// the number of every frame in the readback ring, counting from the first one of the range
+	int framesRead = 0;
+	int frame = nextFrame;
+
+	// the frame before can be of another job of --serve, in another folder, and its pixels are of that job
+	lastUniqueFrame = -1;
+	dirtyRectsValid = false;
+
+	for (; frame <= lastFrame && framesRead < count; frame += frameStep)
+	{
+		if (savedBefore[frame])
+			continue;
+
+		// the keys and the camera from the browsers of --remote-preview
+		if (remotePreviewPort > 0)
+			applyRemoteInput();
+
+		// The frame that is saved as n is rendered when totalFrame is n - 1
+		// (renderScene adds one after it renders), so every frame can be the first
+		totalFrame = frame - 1;
+
+		// the CPU renderer has nothing to present or read back, its frame is already in pixels
+		if (cpuRender)
+		{
+			double start = platformTime();
+			CpuFrame& current = cpuFrames[currentCpuFrame];
+
+			if (!current.built)
+			{
+				totalTime = platformTime();
+				prepareCpuFrame(current);
+			}
+
+			// The scene of the next frame is built by a job while the tiles of this one are traced,
+			// and this frame is saved by a job while the next one is traced
+			int next = frame + frameStep;
+			while (next <= lastFrame && savedBefore[next])
+				next += frameStep;
+
+			if (next <= lastFrame && framesRead + 1 < count)
+			{
+				totalFrame = next - 1;
+				totalTime = platformTime();
+				prepareCpuFrame(cpuFrames[1 - currentCpuFrame]);
+				totalFrame = frame - 1;
+			}
+
+			renderCpuScene(pixels);
+			currentCpuFrame = 1 - currentCpuFrame;
+			cpuRenderSeconds += platformTime() - start;
+
+			saveFrame(pixels, frame);
+			framesRead++;
+			continue;
+		}
+
+		// a frame that is made from the same inputs as the one before it is a copy of it (see --dedupe-frames)
+		if (dedupeFrames)
+		{
+			uint64_t hash = frameInputHash();
+
+			if (lastUniqueFrame >= 0 && hash == lastFrameHash)
+			{
+				saveDuplicateFrame(frame, framesRead);
+				continue;
+			}
+
+			lastFrameHash = hash;
+			lastUniqueFrame = frame;
+			lastUniqueSaved = false;
+		}
+
+		// the meshes that the loader copied in since the frame before
+		updateAsyncUpload();
+
+		// the keys since the frame before are in this frame (see --latency)
+		frameInputTime = pendingInputTime;
+		pendingInputTime = -1.0;
+
+		// Call the render function.
+		if (hybridRender)
+			renderHybridScene(pixels);
+		else
+			renderScene();
+
+		// the GPU has the commands of this frame, so the CPU makes the scene of the next one while it renders
+		// and while the frames before are read back and saved. renderScene moved totalFrame on to this one
+		int next = frame + frameStep;
+		while (next <= lastFrame && savedBefore[next])
+			next += frameStep;
+
+		if (next <= lastFrame && framesRead + 1 < count)
+			startPipelinedUpdate(next - 1);
+
+		// and the GPU can move the triangles of the next frame while it traces this one
+		if (overlapTransform && next <= lastFrame && framesRead + 1 < count)
+			transformNextFrame(next - 1);
+
+		// Swaps the back buffer to the front buffer
+		// Remember, you're rendering to the back buffer, then once rendering is complete, you're moving the back buffer to the front so it can be displayed.
+		// (unless it is --headless, see presentFrame). Waiting for vsync is counted as waiting
+		double presentStart = platformTime();
+		presentFrame();
+		addFrameWaitTime(platformTime() - presentStart, false);
+
+		// the main thread of --ui-thread swaps, and marks the frames it shows
+		if (latencyReport && !uiThread)
+			markPhoton(latencyTracker, frameInputTime);
+
+		limitQueuedFrames();
+
+		// Checks to see if any events are pending and then processes them.
+		// (--egl has no window, and never started GLFW, and the main thread has the events of --ui-thread)
+		if (uiThread)
+			applyUiInput();
+		else if (!useEgl)
+			glfwPollEvents();
+
+		if (hotReload)
+			updateShaderReload();
+
+		if (!sceneFileName.empty())
+			updateSceneFile();
+
+		// the render size of the next frame, after this one was shown and is read from the output
+		updateDynamicResolution();
+
+		// get the image that was rendered, and save it (or an older one, see readBackFrame)
+		readBackFrame(pixels, totalFrame, framesRead, true);
+		framesRead++;
+
+		if (hybridRender)
+			balanceHybridRows();
+
+		if (framesRead == 1)
+			reportStartupTime("everything until the first frame", 0.0);
+
+		if (rayStats)
+			updateRayStats();
+	}
+
+	nextFrame = frame;
+	return framesRead;
+}
+
+// Draw the newest frame of the render thread of --ui-thread into the window, or the one that is shown again
+// (after a resize, say). It is stretched over the window, which does not change the size of the render
+void showUiFrame(GLuint readFBO)
+{
+	int slot = -1;
+	GLsync ready = 0;
+	double inputTime = -1.0;
+
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+
+		if (uiReadySlot >= 0)
+		{
+			uiShownSlot = uiReadySlot;
+			ready = uiReadyFence;
+			inputTime = uiReadyInputTime;
+			uiReadySlot = -1;
+			uiReadyFence = 0;
+			uiReadyInputTime = -1.0;
+		}
+
+		slot = uiShownSlot;
+	}
+
+	if (slot < 0)
+		return;
+
+	// the GPU waits for the copy of the render thread, the main thread does not
+	if (ready != 0)
+	{
+		glWaitSync(ready, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(ready);
+	}
+
+	int w = 0;
+	int h = 0;
+	glfwGetFramebufferSize(previewWindow, &w, &h);
+
+	// (attached again every time, so that this context sees what the other one drew into the texture)
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, uiPreviewTextures[slot], 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, outputWidth, outputHeight, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	GLsync drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+
+		if (uiShownFences[slot] != 0)
+			glDeleteSync(uiShownFences[slot]);
+
+		uiShownFences[slot] = drawn;
+	}
+
+	glfwSwapBuffers(previewWindow);
+
+	if (latencyReport)
+		markPhoton(latencyTracker, inputTime);
+}
+
+// The main thread of --ui-thread while the frames are rendered: it handles the events of the window, and shows
+// the frames that the render thread hands over, until the render thread is done
+void runUiLoop()
+{
+	// the loading before was on this thread too
+	nameProfileThread("ui");
+	glfwMakeContextCurrent(previewWindow);
+	glfwSwapInterval(1);
+
+	GLuint readFBO = 0;
+	glGenFramebuffers(1, &readFBO);
+
+	if (latencyReport)
+		startLatencyTracker(latencyTracker);
+
+	while (true)
+	{
+		// until there is an event, or a frame (see handOffUiFrame)
+		glfwWaitEvents();
+
+		bool rendering = false;
+		std::string title;
+
+		{
+			std::lock_guard<std::mutex> lock(uiMutex);
+			rendering = uiRendering;
+
+			if (uiTitleChanged)
+				title.swap(uiTitle);
+
+			uiTitleChanged = false;
+		}
+
+		if (!title.empty())
+			glfwSetWindowTitle(previewWindow, title.c_str());
+
+		if (!rendering)
+			break;
+
+		showUiFrame(readFBO);
+	}
+
+	if (latencyReport)
+		stopLatencyTracker(latencyTracker);
+
+	glDeleteFramebuffers(1, &readFBO);
+	glfwMakeContextCurrent(nullptr);
+}
+
+// Start writing the frames of the video into the file of --capture
+void startFrameCapture()
+{
+	if (captureName.empty())
+		return;
+
+	FrameCaptureHeader header = { FRAME_CAPTURE_MAGIC, FRAME_CAPTURE_VERSION, sceneCaptureHash(), numSceneMeshes, width, height, (float)videoFPS };
+
+	if (openFrameCapture(frameCapture, captureName.c_str(), header))
+		capturingFrames = true;
+	else
+		std::cout << "could not make the capture " << captureName << std::endl;
+}
+
+void finishFrameCapture()
+{
+	if (!capturingFrames)
+		return;
+
+	closeFrameCapture(frameCapture);
+	capturingFrames = false;
+
+	std::cout << "captured the inputs of " << frameCapture.frames << " frames in " << captureName << " ("
+		<< frameCapture.bytes / std::max(frameCapture.frames, 1) << " bytes per frame)" << std::endl;
+}
+
+// Render the frames of --frames, save them or stream them to ffmpeg, and make the video.
+// Returns how many frames were rendered
+int renderFrames(unsigned char* pixels)
+{
+	startFrameOutput();
+	startFrameCapture();
+	startRenditions();
+
+	// the frames that were saved before, which --resume does not render again
+	std::vector<bool> savedBefore(maxFrames + 1, false);
+
+	if (resumeFrames)
+		savedBefore = readFrameManifest();
+
+	// only the frames of the video are timed, not the benchmarks
+	if (!cpuRender && (!timingLogName.empty() || frameReport || isProfiling()))
+		startTimingLog((lastFrame - firstFrame) / frameStep + 1);
+
+	if (rayStats)
+		startRayStats();
+
+	if (latencyReport && !uiThread)
+		startLatencyTracker(latencyTracker);
+
+	int frame = firstFrame;
+	int framesRead = renderFrameRange(pixels, frame, std::numeric_limits<int>::max(), savedBefore);
+
+	if (rayStats)
+		finishRayStats();
+
+	finishFrameCapture();
+
+	// the last frames are still in the readback ring
+	if (asyncReadback)
+		finishAllReadbacks(framesRead, true);
+
+	finishRenditions();
+	finishTimingLog();
+
+	if (!cpuRender)
+		finishLatency();
+
+	// and the jobs may still be saving some, which ffmpeg needs
+	finishSavingFrames();
+
+	finishFrameOutput();
+	return framesRead;
+}
+
+// renderFrames on a thread of its own with --ui-thread, while the main thread runs the window. The context
+// of window goes to the render thread, and comes back when it is done
+int renderFramesBehindUi(unsigned char* pixels)
+{
+	int framesRead = 0;
+	uiRendering = true;
+	glfwMakeContextCurrent(nullptr);
+
+	std::thread render([pixels, &framesRead]
+	{
+		nameProfileThread("render");
+		glfwMakeContextCurrent(window);
+		framesRead = renderFrames(pixels);
+		glfwMakeContextCurrent(nullptr);
+
+		{
+			std::lock_guard<std::mutex> lock(uiMutex);
+			uiRendering = false;
+		}
+
+		glfwPostEmptyEvent();
+	});
+
+	runUiLoop();
+	render.join();
+
+	glfwMakeContextCurrent(window);
+	return framesRead;
+}
+
+// Split a line of options like a command line, with quotes around the options that have spaces
+std::vector<std::string> splitOptions(const std::string& line)
+{
+	std::vector<std::string> args;
+	std::string arg;
+	bool quoted = false;
+	bool hasArg = false;
+
+	for (char c : line)
+	{
+		if (c == '"')
+		{
+			quoted = !quoted;
+			hasArg = true;
+		}
+		else if (c == ' ' && !quoted)
+		{
+			if (hasArg)
+				args.push_back(arg);
+
+			arg.clear();
+			hasArg = false;
+		}
+		else
+		{
+			arg += c;
+			hasArg = true;
+		}
+	}
+
+	if (hasArg)
+		args.push_back(arg);
+
+	return args;
+}
+
+// Read the line of options of a job of --serve (see splitOptions).
+// Returns false, and says why in error, if it has an option that only the server has
+bool parseJobOptions(const std::string& line, std::string& error)
+{
+	std::vector<std::string> args = splitOptions(line);
+	args.insert(args.begin(), "job");
+
+	// the values of the options do not start with -
+	for (size_t i = 1; i < args.size(); i++)
+	{
+		if (args[i][0] == '-' && std::find(std::begin(jobOptions), std::end(jobOptions), args[i]) == std::end(jobOptions))
+		{
+			error = args[i] + " is an option of the server, which a job cannot change";
+			return false;
+		}
+
+		// the folder goes into the commands of ffmpeg (see encodeFrameRange)
+		if (args[i] == "--frames-folder" && i + 1 < args.size() && !quotableInCommand(args[i + 1]))
+		{
+			error = "the --frames-folder of a job cannot have a \" in it";
+			return false;
+		}
+	}
+
+	std::vector<char*> argv;
+	for (std::string& a : args)
+		argv.push_back(&a[0]);
+
+	if (!parseCommandLine((int)argv.size(), argv.data()))
+	{
+		error = "the options of the job are not all known, or one has no value";
+		return false;
+	}
+
+	return true;
+}
+
+// A job of --serve that is being rendered, with its frames and their output. Its values are swapped with
+// the globals while its frames render (see swapServerJob), so that renderFrameRange and saveFrame use them
+struct ServerJob
+{
+	int id = 0;
+	std::string options;
+	double start = 0.0;
+
+	int firstFrame = 1;
+	int lastFrame = -1;
+	int frameStep = 1;
+	std::string framesFolder;
+	bool streamVideo = false;
+	bool resumeFrames = false;
+	FILE* videoPipe = nullptr;
+	std::ofstream frameManifest;
+
+	// the frame to render next, and the frames that --resume does not render again
+	int nextFrame = 1;
+	std::vector<bool> savedBefore;
+	int rendered = 0;
+};
+
+// Swap the frames and the output of the job with the globals, which puts them in, or back into the job
+void swapServerJob(ServerJob& job)
+{
+	std::swap(firstFrame, job.firstFrame);
+	std::swap(lastFrame, job.lastFrame);
+	std::swap(frameStep, job.frameStep);
+	std::swap(framesFolder, job.framesFolder);
+	std::swap(streamVideo, job.streamVideo);
+	std::swap(videoPipe, job.videoPipe);
+	frameManifest.swap(job.frameManifest);
+}
+
+// Read the options of a job that came to the server, which start from the ones of the server's command line, and start
+// its output. Returns false, and the job is finished, if it has an option that it cannot change. A job with --scene changes
+// the scene of every job, like a change to the file would, and only what updateSceneFile can change on the GPU changes
+bool startServerJob(ServerJob& job, const ServerJob& server)
+{
+	firstFrame = server.firstFrame;
+	lastFrame = server.lastFrame;
+	frameStep = server.frameStep;
+	framesFolder = server.framesFolder;
+	streamVideo = server.streamVideo;
+	resumeFrames = server.resumeFrames;
+
+	std::string sceneBefore = sceneFileName;
+	std::string error;
+
+	if (!parseJobOptions(job.options, error))
+	{
+		// the frames are the server's again for the next job, and so is the scene
+		sceneFileName = sceneBefore;
+		sendRenderJobLine(job.id, error);
+		finishRenderJob(job.id, false);
+		return false;
+	}
+
+	if (lastFrame < 0 || lastFrame > maxFrames)
+		lastFrame = maxFrames;
+
+	// the scene of the job is read now, instead of when the file is looked at again
+	if (sceneFileName != sceneBefore)
+	{
+		sceneFileTime = 0;
+		lastSceneFileCheck = -1.0;
+		updateSceneFile();
+	}
+
+	std::cout << "job " << job.id << ": " << job.options << std::endl;
+
+	startFrameOutput();
+
+	job.start = platformTime();
+	job.nextFrame = firstFrame;
+	job.savedBefore.assign(maxFrames + 1, false);
+	job.rendered = 0;
+
+	if (resumeFrames)
+		job.savedBefore = readFrameManifest();
+
+	// the job keeps its frames and output, and the globals get what it had, which the next job replaces
+	swapServerJob(job);
+	return true;
+}
+
+// Make the text of --metrics-port from what the server did so far, and give it to the metrics server.
+// framesRead are the frames of every job, and jobsRendering the jobs that take turns now
+void publishServerMetrics(int framesRead, int jobsRendering)
+{
+	std::string text;
+
+	writeMetricHeader(text, "raytracer_frames_total", "counter", "Frames rendered by every job");
+	writeMetric(text, "raytracer_frames_total", "", framesRead);
+
+	// the jobs add to the write histogram while this reads it
+	MetricHistogram written;
+
+	{
+		std::lock_guard<std::mutex> lock(encodeMutex);
+		written = writeHistogram;
+	}
+
+	writeMetricHeader(text, "raytracer_stage_milliseconds", "histogram", "The time of a frame in each stage");
+	writeMetricHistogram(text, "raytracer_stage_milliseconds", "stage=\"render\"", renderHistogram);
+	writeMetricHistogram(text, "raytracer_stage_milliseconds", "stage=\"readback\"", readbackHistogram);
+	writeMetricHistogram(text, "raytracer_stage_milliseconds", "stage=\"encode\"", encodeHistogram);
+	writeMetricHistogram(text, "raytracer_stage_milliseconds", "stage=\"write\"", written);
+
+	// only --ray-stats counts the rays
+	if (rayStats)
+	{
+		writeMetricHeader(text, "raytracer_rays_total", "counter", "Primary, shadow, and reflection rays traced");
+		writeMetric(text, "raytracer_rays_total", "", metricRays);
+	}
+
+	writeMetricHeader(text, "raytracer_jobs_rendering", "gauge", "Jobs that take turns rendering");
+	writeMetric(text, "raytracer_jobs_rendering", "", jobsRendering);
+	writeMetricHeader(text, "raytracer_save_queue", "gauge", "Frames that the saving jobs have not finished");
+	writeMetric(text, "raytracer_save_queue", "", (double)savingFrames.size());
+	writeMetricHeader(text, "raytracer_pipe_queue", "gauge", "Frames that the writer of the ffmpeg pipe has not taken yet");
+	writeMetric(text, "raytracer_pipe_queue", "", (double)queueDepth(pipeFrames));
+	writeMetricHeader(text, "raytracer_pipe_queue_max", "gauge", "The most frames that the queue of the ffmpeg pipe held");
+	writeMetric(text, "raytracer_pipe_queue_max", "", (double)pipeFrames.stats.maxDepth.load());
+	writeMetricHeader(text, "raytracer_pipe_queue_full_total", "counter", "Times that the render thread waited for room in the queue of the ffmpeg pipe");
+	writeMetric(text, "raytracer_pipe_queue_full_total", "", pipeFrames.stats.fullWaits.load());
+	writeMetricHeader(text, "raytracer_frame_pool_free", "gauge", "Copies of frames in the pool that no frame is using");
+	writeMetric(text, "raytracer_frame_pool_free", "", (double)queueDepth(freeFrames));
+
+	writeMetricHeader(text, "raytracer_gpu_memory_bytes", "gauge", "GPU memory by what it is used for");
+
+	for (int c = 0; c < GPU_MEMORY_CATEGORIES; c++)
+		writeMetric(text, "raytracer_gpu_memory_bytes", std::string("category=\"") + gpuMemoryCategoryName(c) + "\"", (double)gpuMemoryBytes(c));
+
+	writeMetricHeader(text, "raytracer_cache_hits_total", "counter", "Program binaries and BLAS files that were found in the cache");
+	writeMetric(text, "raytracer_cache_hits_total", "cache=\"program\"", programCacheHits);
+	writeMetric(text, "raytracer_cache_hits_total", "cache=\"blas\"", blasCacheHits);
+	writeMetricHeader(text, "raytracer_cache_misses_total", "counter", "Program binaries and BLAS files that had to be made");
+	writeMetric(text, "raytracer_cache_misses_total", "cache=\"program\"", programCacheMisses);
+	writeMetric(text, "raytracer_cache_misses_total", "cache=\"blas\"", blasCacheMisses);
+
+	if (!sharedCacheUrl.empty())
+	{
+		writeMetricHeader(text, "raytracer_shared_cache_files_total", "counter", "Files that came from or went to --shared-cache");
+		writeMetric(text, "raytracer_shared_cache_files_total", "direction=\"fetched\"", sharedCacheFetched);
+		writeMetric(text, "raytracer_shared_cache_files_total", "direction=\"stored\"", sharedCacheStored);
+	}
+
+	publishRenderMetrics(text);
+}
+
+// Render the jobs of --serve until one of them says quit, and the ones that came before it are done. The jobs take
+// turns, of serveSliceFrames frames each, so a short preview does not wait for a long video that came before it.
+// The frames of a turn are all read back and saved before the next turn, whose frames go somewhere else.
+// Returns the frames rendered
+int serveRenderJobs(unsigned char* pixels)
+{
+	// what every job starts from, which are the globals for now
+	ServerJob server;
+	server.firstFrame = firstFrame;
+	server.lastFrame = lastFrame;
+	server.frameStep = frameStep;
+	server.framesFolder = framesFolder;
+	server.streamVideo = streamVideo;
+	server.resumeFrames = resumeFrames;
+
+	// the segment encoders read the folder of the frames when they start, which can be the one of
+	// another job by then, so the video of a job is made when its frames are done
+	segmentFrames = 0;
+
+	std::deque<ServerJob> jobs;
+	bool quitting = false;
+	int framesRead = 0;
+
+	// the histograms of --metrics-port are made from the frame timers, and the rays from --ray-stats
+	if (metricsPort > 0)
+	{
+		if (!cpuRender)
+			startTimingLog(0);
+
+		publishServerMetrics(0, 0);
+	}
+
+	if (rayStats)
+		startRayStats();
+
+	while (!jobs.empty() || !quitting)
+	{
+		// the jobs that came since the last turn, and when nothing renders, the next one to come.
+		// The jobs after serveMaxJobs wait until one is done
+		int id;
+		std::string options;
+
+		while (!quitting && (int)jobs.size() < serveMaxJobs && takeRenderJob(id, options, jobs.empty()))
+		{
+			if (options == "quit")
+			{
+				finishRenderJob(id, true);
+				quitting = true;
+				continue;
+			}
+
+			ServerJob job;
+			job.id = id;
+			job.options = options;
+
+			if (startServerJob(job, server))
+				jobs.push_back(std::move(job));
+		}
+
+		// the server was told to quit, or its socket is closed
+		if (jobs.empty())
+			break;
+
+		ServerJob& turn = jobs.front();
+		swapServerJob(turn);
+
+		int rendered = renderFrameRange(pixels, turn.nextFrame, serveSliceFrames, turn.savedBefore);
+		turn.rendered += rendered;
+		framesRead += rendered;
+
+		if (asyncReadback)
+			finishAllReadbacks(rendered, true);
+
+		finishSavingFrames();
+
+		if (metricsPort > 0)
+			publishServerMetrics(framesRead, (int)jobs.size());
+
+		if (turn.nextFrame <= lastFrame)
+		{
+			swapServerJob(turn);
+			jobs.push_back(std::move(turn));
+			jobs.pop_front();
+			continue;
+		}
+
+		finishFrameOutput();
+
+		char line[200];
+		sprintf(line, "rendered %d frames into %s in %.1f s", turn.rendered, framesFolder.c_str(), platformTime() - turn.start);
+		sendRenderJobLine(turn.id, line);
+		finishRenderJob(turn.id, true);
+
+		swapServerJob(turn);
+		jobs.pop_front();
+	}
+
+	if (rayStats)
+		finishRayStats();
+
+	finishTimingLog();
+	return framesRead;
+}
+
+// Save the trace of --cpu-trace, once every thread that records zones is done
+void writeCpuTrace()
+{
+	if (!isProfiling())
+		return;
+
+	if (writeProfileTrace(cpuTraceName.c_str()))
+		std::cout << "wrote the CPU trace to " << cpuTraceName << std::endl;
+	else
+		std::cout << "could not write " << cpuTraceName << std::endl;
+}
+
+// Check the options against each other, after the command line (or the program that has the renderer as
+// a library) set them, and turn off the ones that cannot be used together. Also reads the scene file.
+// Returns false if the render cannot start at all
+bool resolveOptions()
+{
+	// The frames of --ui-thread are rendered headless, and only the window of the main thread shows them
+	if (uiThread && (headless || cpuRender || useEgl))
+	{
+		std::cout << "--ui-thread needs a window, without --headless (or what renders headless), --cpu-render, or --egl" << std::endl;
+		uiThread = false;
+	}
+	else if (uiThread)
+	{
+		headless = true;
+	}
+
+	// only the window shows the frames, so only it has an input to photon, and a queue of frames to wait in
+	if ((latencyReport || lowLatencyFrames >= 0) && (cpuRender || (headless && !uiThread)))
+	{
+		std::cout << "--latency and --low-latency need the window, without --headless (or what renders headless) or --cpu-render" << std::endl;
+		latencyReport = false;
+		lowLatencyFrames = -1;
+	}
+
+	// The tiles of a still are the output. The renderers that keep something of the frame before would keep
+	// it from the tile before, and the CPU renderer and --views do not have a window of the camera
+	if (stillWidth > 0)
+	{
+		outputWidth = stillTile;
+		outputHeight = stillTile;
+
+		if (cpuRender || hybridRender || useTemporal || accumulateSamples > 0 || dirtyRects || numViews > 1)
+		{
+			std::cout << "--still needs the GPU, without --hybrid, --temporal, --accumulate, --dirty-rects, or --views" << std::endl;
+			return false;
+		}
+	}
+
+	// A preset picks the bounces and the render scale. "final" keeps the bounces of --max-bounces
+	if (qualityPreset >= 0)
+	{
+		finalMaxBounces = maxBounces;
+		maxBounces = presetMaxBounces(qualityPreset);
+		renderScale = qualityPresets[qualityPreset].renderScale;
+
+		// every preset is a draw program, so the other renderers are not used
+		useWavefront = false;
+		useTiledRender = false;
+	}
+
+	// Without --render-size, the render is the output size times --render-scale
+	if (!renderSizeGiven)
+	{
+		width = std::max(1, (int)(outputWidth * renderScale));
+		height = std::max(1, (int)(outputHeight * renderScale));
+	}
+
+	// --estimate times its frames with fewer pixels, and scales the draw back up to the render size,
+	// which does not change while it renders
+	if (estimateSamples > 0)
+	{
+		estimatePixels = (double)width * height;
+		width = std::max(1, (int)(width * estimateScale));
+		height = std::max(1, (int)(height * estimateScale));
+		targetFrameMs = 0.0f;
+	}
+
+	// --target-ms starts at the render scale, and never goes over it. A render size that was given stays that size
+	dynamicScale = renderScale;
+	dynamicScaleMax = renderScale;
+
+	if (renderSizeGiven && targetFrameMs > 0.0f)
+	{
+		std::cout << "--target-ms does not change a --render-size, the size stays " << width << "x" << height << std::endl;
+		targetFrameMs = 0.0f;
+	}
+
+	// only the fragment shader counts the work of its pixels
+	if (costView != COST_VIEW_OFF)
+	{
+		useWavefront = false;
+		useTiledRender = false;
+	}
+
+	// and the wavefront renderer does not count its rays
+	if (rayStats)
+		useWavefront = false;
+
+	// The average of --accumulate is of the same frame, so there is nothing for --temporal to use again,
+	// and the cost view counts the work of every pixel, which a pixel that is used again does not do
+	if (accumulateSamples > 0 || costView != COST_VIEW_OFF)
+		useTemporal = false;
+
+	// --temporal finds the triangle of every pixel in the hit buffer
+	if (useTemporal)
+		useHitBuffer = true;
+
+	// The jittered samples of --accumulate already smooth the edges.
+	// The edges of --adaptive-aa are found in the hit buffer
+	if (accumulateSamples > 0)
+		adaptiveSamples = 0;
+
+	if (adaptiveSamples > 0)
+		useHitBuffer = true;
+
+	// The average of --accumulate is the many samples that the denoiser stands in for, so it is not blurred,
+	// and the heatmap of the cost view is not noise. The denoiser is guided by the hit buffer
+	if (accumulateSamples > 0 || costView != COST_VIEW_OFF)
+		denoisePasses = 0;
+
+	if (denoisePasses > 0)
+		useHitBuffer = true;
+
+	// only the fragment shader traces the reflections and the shadows in a smaller image, has a hit buffer, and draws
+	// the reflection probes
+	if (reflectionScale > 1 || shadowScale > 1 || useHitBuffer || reflectionProbes > 0)
+	{
+		useWavefront = false;
+		useTiledRender = false;
+	}
+
+	// Only the fragment shader renders more than one view. The light lists of the tiles, the visibility
+	// buffer, and the camera of the frame before of --temporal are made from view 0, so they are not used either
+	if (numViews > 1)
+	{
+		useWavefront = false;
+		useTiledRender = false;
+		tiledLightCulling = false;
+		useVisibilityBuffer = false;
+		useTemporal = false;
+	}
+
+	// The rays of --camera are read by the fragment shader and the wavefront renderer. What is made from the corner rays
+	// or the matrix of the camera (the tiles and their lights, the visibility buffer, the bins, the rectangles of
+	// --dirty-rects, and the history of --temporal) would not match them. Only the fragment shader leaves the outside
+	// of the circle of a fisheye black
+	if (cameraModel >= 0)
+	{
+		if (cpuRender || hybridRender || numViews > 1 || stillWidth > 0 || useTemporal || dirtyRects)
+		{
+			std::cout << "--camera needs a GPU renderer, without --hybrid, --views, --still, --temporal, or --dirty-rects" << std::endl;
+			cameraModel = -1;
+		}
+		else
+		{
+			useTiledRender = false;
+			tiledLightCulling = false;
+			useVisibilityBuffer = false;
+			binTriangles = false;
+
+			if (cameraModel == CAMERA_FISHEYE)
+				useWavefront = false;
+		}
+	}
+
+	// --checkerboard is a way of --temporal
+	if (!useTemporal)
+		useCheckerboard = false;
+
+	// only the compute renderer has tiles that trace some of their pixels
+	if (variableRate && (!useTiledRender || useWavefront))
+	{
+		std::cout << "--foveated and --importance-map need the compute renderer of --tiled-render, which these options do not use" << std::endl;
+		variableRate = false;
+	}
+
+	// The CPU renderer renders at the output size, and has no GPU passes to time or count, no GPU memory,
+	// and nothing to read back. Its frames are timed as a whole, and printed at the end
+	if (cpuRender)
+	{
+		if (benchmarkRender)
+			std::cout << "--bench times the GPU renderers, it is not used with --cpu-render" << std::endl;
+
+		benchmarkRender = false;
+		rayStats = false;
+		timingLogName.clear();
+		frameReport = false;
+		memoryReport = false;
+		asyncReadback = false;
+	}
+
+	// The strip of the CPU is only the image of the fragment shader, at the output size, with one view,
+	// and it is put into the frame when it is read back with glReadPixels
+	if (hybridRender)
+	{
+		bool gpuOnly = useWavefront || useTiledRender || useVisibilityBuffer || useTemporal || accumulateSamples > 0
+			|| denoisePasses > 0 || reflectionScale > 1 || costView != COST_VIEW_OFF || numViews > 1;
+		bool scaled = renderScale != 1.0f || targetFrameMs > 0.0f;
+
+		if (cpuRender)
+		{
+			hybridRender = false;
+		}
+		else if (gpuOnly || scaled)
+		{
+			std::cout << "--hybrid needs the fragment shader at the output size, with one view and without passes that only the GPU has" << std::endl;
+			hybridRender = false;
+		}
+
+		asyncReadback = asyncReadback && !hybridRender;
+		hybridCpuRows = std::min(std::max((int)(hybridShare * outputHeight + 0.5f), 1), outputHeight - 1);
+	}
+
+	// The planes are only read by ffmpeg, from the slots of the ring. The shader writes 4 bytes at once, and the rows
+	// of U and V are for every 2 rows, so the width is a multiple of 8 and the height a multiple of 2
+	if (yuvReadback && (!streamVideo || !asyncReadback || frameBatch > 1 || remotePreviewPort > 0 || servePort > 0
+		|| outputWidth % 8 != 0 || outputHeight % 2 != 0))
+	{
+		std::cout << "--yuv-readback needs a streamed video with the readback ring, without --frame-batch, --remote-preview,"
+			" or --serve, and a width that is a multiple of 8 and a height that is a multiple of 2" << std::endl;
+		yuvReadback = false;
+	}
+
+	// the counters go next to the times, and the CPU renderer has no GPU passes
+	if (gpuCounters && timingLogName.empty())
+	{
+		std::cout << "--gpu-counters needs --timing-log, and a GPU renderer" << std::endl;
+		gpuCounters = false;
+	}
+
+	// only the server has numbers that change while it runs
+	if (metricsPort > 0 && servePort <= 0)
+	{
+		std::cout << "--metrics-port needs --serve" << std::endl;
+		metricsPort = 0;
+	}
+
+	// every job of the server has a pipe of its own
+	if (shmEncoder && servePort > 0)
+	{
+		std::cout << "--shm-encoder is not used with --serve" << std::endl;
+		shmEncoder = false;
+	}
+
+	// the CPU renderer tests the leaves with the fastest kernel this CPU can run, or the one that was asked for if it can
+	if (cpuKernel >= 0 && !cpuKernelSupported(cpuKernel))
+		std::cout << "this CPU cannot run --cpu-kernel " << cpuKernelNames[cpuKernel] << std::endl;
+
+	if (cpuKernel < 0 || !cpuKernelSupported(cpuKernel))
+		cpuKernel = pickCpuBlockKernel();
+
+	// the layers of a batch are the headless output, and they are read back like the ring, later
+	if (frameBatch > 1 && (!headless || !asyncReadback || cpuRender))
+	{
+		std::cout << "--frame-batch needs --headless and the readback ring, without --hybrid or --cpu-render" << std::endl;
+		frameBatch = 1;
+	}
+
+	// the renditions are blitted from the output that the GPU rendered, one frame at a time, and --serve has
+	// a video for every job
+	if ((proxyScale > 0.0f || thumbnailEvery > 0) && (cpuRender || hybridRender || frameBatch > 1 || servePort > 0))
+	{
+		std::cout << "--proxy and --thumbnails need a GPU renderer, without --cpu-render, --hybrid, --frame-batch, or --serve" << std::endl;
+		proxyScale = 0.0f;
+		thumbnailEvery = 0;
+	}
+
+	// only the two-level BVH reads the triangles of the meshes, the others read them in the world
+	// (and --temporal finds the mesh of a hit by the number of its triangle, which the pool changes)
+	if (geometryPoolMB > 0 && (accelBackend != ACCEL_TWO_LEVEL || cpuRender || hybridRender || useVisibilityBuffer || useTiledRender || useTemporal))
+	{
+		std::cout << "--geometry-pool needs --accel twolevel, without --cpu-render, --hybrid, --visibility, --tiled-render, or --temporal" << std::endl;
+		geometryPoolMB = 0;
+	}
+
+	if (sparsePool && geometryPoolMB == 0)
+	{
+		std::cout << "--sparse-pool needs --geometry-pool" << std::endl;
+		sparsePool = false;
+	}
+
+	// the copies are only in the BLAS of the two-level BVH, and the CPU renderer has none
+	// (and the pool only has room for the meshes)
+	if (lodGeometryFrom > 0 && (accelBackend != ACCEL_TWO_LEVEL || cpuRender || hybridRender || geometryPoolMB > 0))
+	{
+		std::cout << "--lod-geometry needs --accel twolevel, without --cpu-render, --hybrid, or --geometry-pool" << std::endl;
+		lodGeometryFrom = 0;
+	}
+
+	// The CPU renderer makes the scene of the next frame before it knows if it is a copy, the time of --realtime
+	// is never the same, and the frames of --accumulate are a still that gets better, which the copies would stop
+	if (dedupeFrames && (cpuRender || realtimeAnimation || accumulateSamples > 0))
+	{
+		std::cout << "--dedupe-frames needs the GPU, without --realtime or --accumulate" << std::endl;
+		dedupeFrames = false;
+	}
+
+	// Only the streamed video is uploaded, the saved frames and the videos made from them are files (--gpus and
+	// --farm make their video from saved frames too), and the jobs of --serve would all upload to the one object
+	if (!uploadUrl.empty() && (!streamVideo || servePort > 0 || gpuCount > 1 || !farmFolder.empty() || !farmWorkerFolder.empty()))
+	{
+		std::cout << "--upload needs the streamed video, without --export-png, --resume, --gpus, --farm, or --serve" << std::endl;
+		uploadUrl.clear();
+	}
+
+	// an url or keys that cannot work stop it before anything renders
+	if (!uploadUrl.empty() && !checkObjectStorage(uploadUrl))
+		uploadUrl.clear();
+
+	if (!sharedCacheUrl.empty() && !checkSharedCache(sharedCacheUrl))
+		sharedCacheUrl.clear();
+
+	// The bands are the quad of the fragment shader. The compute renderers and the passes of --temporal and --accumulate
+	// draw the whole frame at once
+	if (sliceBudgetMs > 0.0f && (useWavefront || useTiledRender || useTemporal || accumulateSamples > 0))
+	{
+		std::cout << "--slice-ms needs the fragment shader, without --wavefront, --tiled-render, --temporal, or --accumulate" << std::endl;
+		sliceBudgetMs = 0.0f;
+	}
+
+	// The grid has one buffer, which a second set would double, the time of --realtime is not known before the frame
+	// starts, and the CPU renderers move their own triangles
+	if (incrementalTLAS && accelBackend != ACCEL_TWO_LEVEL)
+	{
+		std::cout << "--incremental-tlas needs --accel twolevel" << std::endl;
+		incrementalTLAS = false;
+	}
+
+	// the batches of --shadow-batch only walk the TLAS, and the pool streams the meshes of the TLAS leaves
+	if (useInstanceGrid && (accelBackend != ACCEL_TWO_LEVEL || cpuRender || hybridRender || expandInstances || shadowBatch > 0 || geometryPoolMB > 0))
+	{
+		std::cout << "--instance-grid needs --accel twolevel, without --cpu-render, --hybrid, --expand-instances, --shadow-batch, or --geometry-pool" << std::endl;
+		useInstanceGrid = false;
+	}
+
+	if (overlapTransform && (accelBackend == ACCEL_GRID || realtimeAnimation || cpuRender || hybridRender))
+	{
+		std::cout << "--overlap-transform needs --accel brute, meshboxes, bvh, or twolevel, without --realtime, --cpu-render, or --hybrid" << std::endl;
+		overlapTransform = false;
+	}
+
+	// CpuRenderer.cpp makes the same random numbers as randomFloat, and no others
+	if (samplerKind != SAMPLER_WHITE && (cpuRender || hybridRender))
+	{
+		std::cout << "--sampler " << samplerNames[samplerKind] << " needs a GPU renderer, without --cpu-render or --hybrid" << std::endl;
+		samplerKind = SAMPLER_WHITE;
+	}
+
+	// the CPU renderers read the colors from the triangles themselves
+	if (materialTable && (cpuRender || hybridRender))
+	{
+		std::cout << "--material-table needs a GPU renderer, without --cpu-render or --hybrid" << std::endl;
+		materialTable = false;
+	}
+
+	// Only the instances of the TLAS have a time, the other structures, the compute renderer, and the visibility
+	// buffer use the triangles that Compute.glsl moved into the world, and the CPU renderers have no TLAS
+	if (motionBlur && (accelBackend != ACCEL_TWO_LEVEL || cpuRender || hybridRender || useVisibilityBuffer || (useTiledRender && !useWavefront)))
+	{
+		std::cout << "--motion-blur needs --accel twolevel, without --cpu-render, --hybrid, --visibility, or --tiled-render" << std::endl;
+		motionBlur = false;
+	}
+
+	// The lists are of the triangles in the world, which the two-level BVH and the CPU renderers do not shade with
+	if (lightOccluders > 0 && (accelBackend == ACCEL_TWO_LEVEL || cpuRender || hybridRender))
+	{
+		std::cout << "--light-occluders needs --accel brute, meshboxes, grid, or bvh, without --cpu-render or --hybrid" << std::endl;
+		lightOccluders = 0;
+	}
+
+	// the other structures are built again every frame, and the CPU renderers walk their own
+	if (bvhHotLayoutFrames > 0 && (accelBackend != ACCEL_TWO_LEVEL || cpuRender || hybridRender))
+	{
+		std::cout << "--bvh-hot-layout needs --accel twolevel, without --cpu-render or --hybrid" << std::endl;
+		bvhHotLayoutFrames = 0;
+	}
+
+	// only the two-level BVH has the shapes in it, the other structures are made of the triangles in the world
+	if (analyticPrimitives && accelBackend != ACCEL_TWO_LEVEL)
+	{
+		std::cout << "--analytic needs --accel twolevel" << std::endl;
+		analyticPrimitives = false;
+	}
+
+	// PNG and BMP are written by FreeImage
+	if (useDiskWriter && frameFormat != FRAME_FORMAT_QOI && frameFormat != FRAME_FORMAT_RAW && frameFormat != FRAME_FORMAT_MEZZANINE)
+	{
+		std::cout << "--disk-writer needs --frame-format qoi, raw, or mzf" << std::endl;
+		useDiskWriter = false;
+	}
+
+	// the tuner times the GPU renderer
+	if (autotune && (cpuRender || hybridRender))
+	{
+		std::cout << "--autotune needs the GPU renderer, without --cpu-render or --hybrid" << std::endl;
+		autotune = false;
+	}
+
+	// the keys are the ones of BuildBVH.glsl
+	if (fusedMorton && accelBackend != ACCEL_BVH)
+	{
+		std::cout << "--fused-morton needs --accel bvh" << std::endl;
+		fusedMorton = false;
+	}
+
+	// the keys of --fused-morton are one for every triangle, not one for every piece
+	if (earlySplitArea > 0.0f && (accelBackend != ACCEL_BVH || cpuRender || hybridRender || fusedMorton))
+	{
+		std::cout << "--early-split needs --accel bvh, without --cpu-render, --hybrid, or --fused-morton" << std::endl;
+		earlySplitArea = 0.0f;
+	}
+
+	// the other structures are not built by BuildBVH.glsl, and the CPU renderers build their own
+	if (irradianceProbes > 0 && (cpuRender || hybridRender))
+	{
+		std::cout << "--irradiance-probes needs a GPU renderer, without --cpu-render or --hybrid" << std::endl;
+		irradianceProbes = 0;
+	}
+
+	if (reflectionProbes > 0 && (cpuRender || hybridRender))
+	{
+		std::cout << "--reflection-probes needs the fragment shader, without --cpu-render or --hybrid" << std::endl;
+		reflectionProbes = 0;
+	}
+
+	if (bvhRestructureRounds > 0 && (accelBackend != ACCEL_BVH || cpuRender || hybridRender))
+	{
+		std::cout << "--bvh-restructure needs --accel bvh, without --cpu-render or --hybrid" << std::endl;
+		bvhRestructureRounds = 0;
+	}
+
+	// a replay is profiled, with or without --cpu-trace, and is not a video that could be captured again
+	if (!replayName.empty())
+	{
+		if (cpuTraceName.empty())
+			cpuTraceName = replayName + ".trace.json";
+
+		captureName = "";
+	}
+
+	// the tiles walk the BVH that BuildBVH.glsl makes, the other structures have no nodes over the triangles
+	if (tileFrustum && accelBackend != ACCEL_BVH)
+	{
+		std::cout << "--tile-frustum needs --accel bvh" << std::endl;
+		tileFrustum = false;
+	}
+
+	// the bins are made with the matrix of the first view, the others would miss triangles
+	if (binTriangles && numViews > 1)
+	{
+		std::cout << "--bin-triangles needs one view" << std::endl;
+		binTriangles = false;
+	}
+
+	// The region is only traced by the fragment shader, and the passes after it (and --temporal) use the pixels around it.
+	// The frames it goes over are read with FreeImage, or as they are, and --resume would skip them
+	if (regionWidth > 0)
+	{
+		regionX = std::max(0, std::min(regionX, outputWidth));
+		regionY = std::max(0, std::min(regionY, outputHeight));
+		regionWidth = std::min(regionWidth, outputWidth - regionX);
+		regionHeight = std::min(regionHeight, outputHeight - regionY);
+
+		if (regionWidth <= 0 || regionHeight <= 0)
+		{
+			std::cout << "--region is not inside of the " << outputWidth << "x" << outputHeight << " frame" << std::endl;
+			regionWidth = 0;
+		}
+		else if (cpuRender || hybridRender || useWavefront || useTiledRender || useTemporal || accumulateSamples > 0 ||
+			denoisePasses > 0 || numViews > 1 || stillWidth > 0 || frameBatch > 1 || yuvReadback || dirtyRects)
+		{
+			std::cout << "--region needs the fragment shader, without --hybrid, --temporal, --accumulate, --denoise, --views, --still, --frame-batch, --yuv-readback, or --dirty-rects" << std::endl;
+			regionWidth = 0;
+		}
+		else if (frameFormat == FRAME_FORMAT_QOI || frameFormat == FRAME_FORMAT_MEZZANINE)
+		{
+			std::cout << "--region goes over frames saved as png, bmp, or bgr" << std::endl;
+			regionWidth = 0;
+		}
+		else
+		{
+			resumeFrames = false;
+			targetFrameMs = 0.0f;
+			std::cout << "--region traces " << 100.0 * regionWidth * regionHeight / ((double)outputWidth * outputHeight) << "% of the pixels" << std::endl;
+		}
+	}
+
+	// The pixels that are not traced are the ones of the frame before, which only the framebuffer of --headless keeps
+	// (a window has another back buffer after every swap), and one layer of it. The passes after the fragment shader,
+	// and the renderers that are not the fragment shader, draw the whole frame again
+	if (dirtyRects && (!headless || frameBatch > 1 || cpuRender || hybridRender || useWavefront || useTiledRender ||
+		useTemporal || accumulateSamples > 0 || denoisePasses > 0))
+	{
+		std::cout << "--dirty-rects needs --headless and the fragment shader, without --frame-batch, --hybrid, --temporal, --accumulate, or --denoise" << std::endl;
+		dirtyRects = false;
+	}
+
+	// the CPU renderer uploads nothing, and the loader shares the context of a GLFW window, which --egl does not have
+	if (asyncUpload && (cpuRender || useEgl))
+	{
+		std::cout << "--async-upload needs the GPU, without --cpu-render or --egl" << std::endl;
+		asyncUpload = false;
+	}
+
+	// a file that cannot be read leaves the motion of the tutorial
+	if (!animationFile.empty() && !loadAnimation(animationFile, sceneAnimation))
+	{
+		std::cout << "--animation is not used" << std::endl;
+		sceneAnimation = AnimationTracks();
+	}
+
+	// the scene file is read before the scene is made, and its tracks take the place of the ones of --animation
+	if (!sceneFileName.empty())
+	{
+		if (loadSceneFile(sceneFileName, objColor, objReflectivity, sceneFile))
+		{
+			sceneFileTime = fileChangeTime(sceneFileName);
+			gltfFiles.insert(gltfFiles.end(), sceneFile.gltfFiles.begin(), sceneFile.gltfFiles.end());
+			useSceneFileCamera();
+
+			if (sceneFile.hasAnimation)
+				sceneAnimation = sceneFile.animation;
+		}
+		else
+		{
+			std::cout << "--scene is not used" << std::endl;
+			sceneFile = SceneFile();
+			sceneFileName.clear();
+		}
+	}
+
+	// the rest of the frames, if --frames did not say where to stop
+	if (lastFrame < 0 || lastFrame > maxFrames)
+		lastFrame = maxFrames;
+
+	return true;
+}
+
+// Make the window (or the context of --egl) and everything on the GPU, or only the scene for the CPU renderer,
+// and the choices of --autotune and --bvh-hot-layout, which are all that main renders with after the benchmarks.
+// Returns false if there is no context
+bool startRenderer()
+{
+	// Initializes the GLFW library. The context of --egl needs no window, and on Linux,
+	// glfwInit would fail without a display server anyway
+	if (!useEgl)
+		glfwInit();
+
+	// The CPU renderer has no window and no OpenGL
+	if (!cpuRender && useEgl)
+	{
+		if (!makeEglContext(std::max(renderGpu, 0)))
+			return false;
+	}
+	else if (!cpuRender)
+	{
+		// a headless render still needs a window for OpenGL, but it is never shown
+		if (headless)
+			glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		// some drivers only send their performance warnings to a debug context
+		if (glDebug)
+			glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+
+		// Creates a window given (width, height, title, monitorPtr, windowPtr).
+		// Don't worry about the last two, as they have to do with controlling which monitor to display on and having a reference to other windows. Leaving them as nullptr is fine.
+		window = glfwCreateWindow(outputWidth, outputHeight, "", nullptr, nullptr);
+
+		// --ui-thread shows the frames in a window of its own, which shares the textures of the hidden one
+		if (uiThread)
+		{
+			glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+			previewWindow = glfwCreateWindow(outputWidth, outputHeight, "", nullptr, window);
+
+			if (previewWindow != nullptr)
+				glfwSetKeyCallback(previewWindow, ui_key_callback);
+			else
+				std::cout << "could not make the window of --ui-thread, the frames are rendered headless" << std::endl;
+
+			uiThread = previewWindow != nullptr;
+		}
+
+		// This allows us to resize the window when we want to.
+		// A headless or scaled render keeps its size, because pixels and the readback ring are made for it
+		// With --preset and --target-ms, those change the render size instead
+		if (!headless && !renderIsScaled() && qualityPreset < 0 && targetFrameMs <= 0.0f)
+			glfwSetWindowSizeCallback(window, window_size_callback);
+
+		if (!headless)
+			glfwSetKeyCallback(window, key_callback);
+
+		// Makes the OpenGL context current for the created window.
+		glfwMakeContextCurrent(window);
+
+		// Sets the number of screen updates to wait before swapping the buffers.
+		// Headless, nothing is swapped, so nothing waits for the screen
+		glfwSwapInterval(headless ? 0 : 1);
+
+		if (renderGpu >= 0 && !useAffinityGpu(renderGpu))
+			std::cout << "this driver cannot put a context on GPU " << renderGpu << " (WGL_NV_gpu_affinity), using the one it picked" << std::endl;
+	}
+
+	// the trace starts before init, so that loading is in it too
+	if (!cpuTraceName.empty())
+	{
+		startProfiling();
+		nameProfileThread("render");
+	}
+
+	// Initializes most things needed before the main loop.
+	// The CPU renderer only needs the scene, and has no GPU to benchmark
+	if (cpuRender)
+	{
+		loadScene();
+	}
+	else
+	{
+		init();
+
+		// Only the frames of --realtime show the scene while the loader of --async-upload copies it in.
+		// The frames of a video wait for all of it, so the upload only overlaps the end of init
+		if (!realtimeAnimation)
+			finishAsyncUpload();
+
+		if (headless || renderIsScaled())
+			makeScreenFramebuffers();
+
+		if (uiThread)
+			makeUiPreviewTextures();
+
+		// before the benchmarks, so that they time the tuned choices
+		if (autotune && (retune || !tuneProfileLoaded))
+			runAutotune();
+
+		// and the new order of the BLAS. --bench-hot-layout makes it itself, after timing the old one
+		if (bvhHotLayoutFrames > 0 && !benchmarkHotLayout)
+			layoutBLASByVisits(bvhHotLayoutFrames);
+	}
+
+	return true;
+}
+
+// Delete what startRenderer made, and stop GLFW (or the context of --egl)
+void stopRenderer()
+{
+	// After the program is over, cleanup your data!
+	// The CPU renderer made no OpenGL objects
+	if (!cpuRender)
+	{
+		glDeleteProgram(draw_program);
+		glDeleteProgram(transform_program);
+		glDeleteProgram(bvh_program);
+		glDeleteProgram(radix_program);
+		glDeleteProgram(grid_program);
+		if (instance_grid_program)
+			glDeleteProgram(instance_grid_program);
+		glDeleteProgram(wavefront_program);
+		glDeleteProgram(visibility_program);
+		glDeleteProgram(light_cull_program);
+		glDeleteProgram(resolve_program);
+		glDeleteProgram(tiled_render_program);
+		glDeleteQueries(1, &waveTimerQuery);
+		glDeleteQueries(1, &hybridTimerQuery);
+		for (int i = 0; i < READBACK_RING_SLICES; i++)
+			gpuDeleteBuffers(1, &readbackRing[i].buffer);
+		if (batchTexture)
+		{
+			for (BatchSlot& slot : batchSlots)
+				gpuDeleteBuffers(1, &slot.buffer);
+			forgetGpuImage(GL_TEXTURE, batchTexture);
+			glDeleteTextures(1, &batchTexture);
+		}
+		if (outputFBO)
+		{
+			glDeleteFramebuffers(1, &outputFBO);
+			glDeleteRenderbuffers(1, &outputColor);
+		}
+		if (screenColor)
+		{
+			glDeleteFramebuffers(1, &screenFBO);
+			glDeleteRenderbuffers(1, &screenColor);
+		}
+	}
+
+	if (previewWindow != nullptr)
+	{
+		for (int i = 0; i < UI_PREVIEW_SLOTS; i++)
+		{
+			if (uiShownFences[i] != 0)
+				glDeleteSync(uiShownFences[i]);
+
+			uiShownFences[i] = 0;
+			forgetGpuImage(GL_TEXTURE, uiPreviewTextures[i]);
+		}
+
+		if (uiReadyFence != 0)
+			glDeleteSync(uiReadyFence);
+
+		uiReadyFence = 0;
+		glDeleteFramebuffers(UI_PREVIEW_SLOTS, uiPreviewFBOs);
+		glDeleteTextures(UI_PREVIEW_SLOTS, uiPreviewTextures);
+		glfwDestroyWindow(previewWindow);
+		previewWindow = nullptr;
+	}
+
+	if (useEgl)
+		destroyEglContext();
+
+	// Frees up GLFW memory
+	glfwTerminate();
+}
+
+// Unload the scenes of the CPU renderer, once nothing is building or tracing them. With --large-pages [1g], their
+// blocks, surfaces, and BVH are in the 2 MB (or 1 GB) pages of cpuSceneArena, so that walking a big BVH misses the
+// TLB less (see CpuArena.h), and the arena gives all of it back to the OS in one go
+void unloadCpuScenes()
+{
+	for (CpuFrame& frame : cpuFrames)
+	{
+		waitJob(frame.built);
+		frame.built = nullptr;
+		frame.scene = CpuScene();
+	}
+
+	releaseCpuNodeScenes();
+
+	if (cpuSceneArena.enabled)
+	{
+		std::cout << "the CPU scenes had " << (cpuArenaBytes(cpuSceneArena) >> 20) << " MB, "
+			<< (cpuArenaLargeBytes(cpuSceneArena) >> 20) << " MB of it in large pages" << std::endl;
+	}
+
+	cpuArenaRelease(cpuSceneArena);
+}
+
+// The pixels of the frames of the library, when they are not read back into the ring
+unsigned char* libraryPixels = nullptr;
+
+int rtStart(const char* options)
+{
+	if (libraryStarted)
+		return 0;
+
+	std::vector<std::string> args = splitOptions(options ? options : "");
+	args.insert(args.begin(), "library");
+
+	std::vector<char*> argv;
+	for (std::string& a : args)
+		argv.push_back(&a[0]);
+
+	if (!parseCommandLine((int)argv.size(), argv.data()))
+		return 0;
+
+	// The frames go to the callback as BGR, and there is no window to show them in, and no video
+	headless = true;
+	streamVideo = false;
+	yuvReadback = false;
+	dedupeFrames = false;
+
+	if (!resolveOptions())
+		return 0;
+
+	if (cpuRender && cpuThreads > 0)
+		jobThreads = cpuThreads - 1;
+
+	startJobs(jobThreads, numaJobs);
+
+	if (!startRenderer())
+	{
+		stopJobs();
+		return 0;
+	}
+
+	if (!cpuRender)
+		makeReadbackRing();
+
+	libraryPixels = new unsigned char[3 * outputWidth * outputHeight];
+	libraryStarted = true;
+	return 1;
+}
+
+int rtSetOptions(const char* options)
+{
+	std::string sceneBefore = sceneFileName;
+	std::string error;
+
+	if (!parseJobOptions(options ? options : "", error))
+	{
+		std::cout << error << std::endl;
+		return 0;
+	}
+
+	if (libraryStarted && sceneFileName != sceneBefore)
+	{
+		sceneFileTime = 0;
+		lastSceneFileCheck = -1.0;
+		updateSceneFile();
+	}
+
+	return 1;
+}
+
+int rtLoadScene(const char* fileName)
+{
+	if (!fileName || fileChangeTime(fileName) == 0)
+		return 0;
+
+	sceneFileName = fileName;
+
+	// rtStart loads it with the rest of the scene
+	if (!libraryStarted)
+		return 1;
+
+	sceneFileTime = 0;
+	lastSceneFileCheck = -1.0;
+	updateSceneFile();
+	return 1;
+}
+
+void rtSetCamera(const float* position, const float* target, const float* up, float fov)
+{
+	cameraStart = glm::make_vec3(position);
+	cameraTarget = glm::make_vec3(target);
+	cameraUp = glm::make_vec3(up);
+	cameraFov = fov;
+
+	// as when the browsers of --remote-preview move the camera
+	accumulatedSamples = 0;
+}
+
+void rtSetFrameCallback(RtFrameCallback callback, void* user)
+{
+	libraryFrameCallback = callback;
+	libraryFrameUser = user;
+}
+
+int rtRenderFrame(int frame)
+{
+	if (!libraryStarted || frame < 1 || frame > maxFrames)
+		return 0;
+
+	std::vector<bool> savedBefore(maxFrames + 1, false);
+	int nextFrame = frame;
+	lastFrame = frame;
+	frameStep = 1;
+
+	int rendered = renderFrameRange(libraryPixels, nextFrame, 1, savedBefore);
+
+	// the frame is still in the readback ring, and the callback gets it before this returns
+	if (asyncReadback)
+		finishAllReadbacks(rendered, true);
+
+	return rendered;
+}
+
+int rtFrameWidth()
+{
+	return outputWidth;
+}
+
+int rtFrameHeight()
+{
+	return outputHeight;
+}
+
+void rtStop()
+{
+	if (!libraryStarted)
+		return;
+
+	finishAsyncUpload();
+	unloadCpuScenes();
+	stopRenderer();
+	stopJobs();
+
+	delete[] libraryPixels;
+	libraryPixels = nullptr;
+	libraryStarted = false;
+}
+
+// The DLL of the Library configuration is only the functions of RayTracer.h
+#ifndef RAYTRACER_LIBRARY
+int main(int argc, char **argv)
+{
+	// Read the options first, so that everything after this can use them
+	parseCommandLine(argc, argv);
+
+	// Sending a job to the server of --serve renders nothing here, the server does
+	if (submitPort > 0)
+		return submitRenderJob(submitPort, submitOptions) ? 0 : 1;
+
+	// The copy that ffmpeg streams the video of --upload into only uploads it
+	if (uploadFromStdin)
+		return uploadStream(binaryStandardInput(), uploadUrl, (size_t)uploadPartMB << 20) ? 0 : 1;
+
+	// and the encoder of --shm-encoder only feeds the frames of the ring into ffmpeg
+	if (!encodeShmName.empty())
+		return runRingEncoder(encodeShmName) ? 0 : 1;
+
+	if (!resolveOptions())
+		return 1;
+
+	// Putting shards together does not render anything, so it does not need a window
+	if (!mergeShards.empty())
+	{
+		mergeShardVideos();
+		return 0;
+	}
+
+	if (mergeFrames)
+	{
+		encodeSavedFrames();
+		return 0;
+	}
+
+	// The coordinator of a farm renders nothing either, it hands out the chunks and makes the video from them.
+	// A worker only starts copies of itself, which render the chunks
+	if (!farmFolder.empty())
+	{
+		if (frameStep != 1)
+			std::cout << "--farm renders every frame from the first to the last, without the step of --frames" << std::endl;
+
+		runFarmCoordinator();
+		return 0;
+	}
+
+	if (!farmWorkerFolder.empty())
+		return runFarmWorker(argc, argv) ? 0 : 1;
+
+	// The copies on the GPUs render everything, this one only waits for them and makes the video
+	if (gpuCount > 1 && !cpuRender)
+	{
+		renderOnGpus(argc, argv);
+		return 0;
+	}
+
+	// The CPU renderer traces its tiles on the threads of the job system and the render thread
+	if (cpuRender && cpuThreads > 0)
+		jobThreads = cpuThreads - 1;
+
+	startJobs(jobThreads, numaJobs);
+
+	if (numaJobs)
+		std::cout << "the " << jobThreadCount() << " threads of the job system are on " << jobNumaNodes() << " NUMA nodes" << std::endl;
+
+	// Converting a model does not render anything either, but it parses on the jobs
+	if (!convertObjFile.empty())
+	{
+		std::vector<triangle> model;
+		bool converted = loadObj(convertObjFile, objColor, objReflectivity, model) && saveModel(convertModelFile, model, 0);
+
+		if (converted)
+			std::cout << "wrote " << model.size() << " triangles of " << convertObjFile << " to " << convertModelFile << std::endl;
+
+		stopJobs();
+		return converted ? 0 : 1;
+	}
+
+	if (!startRenderer())
+	{
+		stopJobs();
+		return 1;
+	}
+
+	// The benchmarks of the GPU renderers
+	if (!cpuRender)
+	{
+		if (benchmarkBVHFormats)
+			runBVHFormatBenchmark();
+
+		if (benchmarkAccels)
+			runAccelBenchmark();
+
+		if (benchmarkWavefront)
+			runWavefrontBenchmark();
+
+		if (benchmarkWaveSort)
+			runWaveSortBenchmark();
+
+		if (benchmarkSubgroupTraversal)
+			runSubgroupTraversalBenchmark();
+
+		if (benchmarkWaveIndirect)
+			runWaveIndirectBenchmark();
+
+		if (benchmarkTiledLights)
+			runTiledLightBenchmark();
+
+		if (benchmarkVisibility)
+			runVisibilityBenchmark();
+
+		if (benchmarkTriangleFormats)
+			runTriangleFormatBenchmark();
+
+		if (benchmarkTriangleKernels)
+			runTriangleKernelBenchmark();
+
+		if (benchmarkTransform)
+			runTransformBenchmark();
+
+		if (benchmarkTiledRender)
+			runTiledRenderBenchmark();
+
+		if (benchmarkShadowBatch)
+			runShadowBatchBenchmark();
+
+		if (benchmarkAnalytic)
+			runAnalyticBenchmark();
+
+		if (benchmarkHotLayout)
+			runHotLayoutBenchmark();
+
+		if (benchmarkRestructure)
+			runRestructureBenchmark();
+
+		if (benchmarkPixelOrder)
+			runPixelOrderBenchmark();
+
+		if (benchmarkLightGrid)
+			runLightGridBenchmark();
+
+		if (benchmarkUploads)
+			runUploadBenchmark();
+	}
+
+	// the kernels of the CPU renderer need no GPU, so they can be timed with or without --cpu-render
+	if (benchmarkCpuKernels)
+		runCpuKernelBenchmark();
+
+	if (benchmarkAnimation)
+		runAnimationBenchmark();
+
+	// the time of --realtime is not known before the frame, so there is nothing to precompute
+	if (precomputeFrames && !realtimeAnimation)
+		precomputeFrameScenes();
+
+	// --bench only measures, it does not make a video
+	if (benchmarkRender)
+	{
+		runRenderBenchmark();
+
+		if (benchmarkEmbree)
+			runEmbreeBenchmark();
+
+		if (memoryReport)
+			printGpuMemoryReport();
+
+		stopJobs();
+		glfwTerminate();
+		return 0;
+	}
+
+	// a replay only renders the frames of the capture
+	if (!replayName.empty())
+	{
+		bool replayed = runFrameReplay();
+
+		stopJobs();
+		glfwTerminate();
+		writeCpuTrace();
+		return replayed ? 0 : 1;
+	}
+
+	// an estimate only renders a few of the frames
+	if (estimateSamples > 0)
+	{
+		bool estimated = runRenderEstimate();
+
+		stopJobs();
+		glfwTerminate();
+		return estimated ? 0 : 1;
+	}
+
+	// a still is not a video either
+	if (stillWidth > 0)
+	{
+		bool written = renderStill();
+
+		stopJobs();
+		glfwTerminate();
+		return written ? 0 : 1;
+	}
+
+	// and neither do the golden frames
+	if (goldenMode != GOLDEN_OFF)
+	{
+		bool passed = runGoldenFrames();
+
+		if (memoryReport)
+			printGpuMemoryReport();
+
+		stopJobs();
+		glfwTerminate();
+		return passed ? 0 : 1;
+	}
+
+	if (!cpuRender)
+	{
+		makeReadbackRing();
+
+		if (benchmarkReadback)
+			runReadbackBenchmark();
+	}
+
+	if (benchmarkExport)
+		runExportBenchmark();
+
+	// Make the BYTE array, factor of 3 because it's RGB.
+	// This will hold each screenshot
+	unsigned char* pixels = new unsigned char[3 * outputWidth * outputHeight];
+
+	pickVideoEncoder();
+
+	if (remotePreviewPort > 0 && !startRemotePreview(remotePreviewPort, remotePreviewQuality))
+		remotePreviewPort = 0;
+
+	// the frames of the command line, or of all the jobs that are sent to the server
+	int framesRead = 0;
+
+	if (servePort > 0)
+	{
+		if (metricsPort > 0 && !startMetricsServer(metricsPort))
+			metricsPort = 0;
+
+		if (startRenderServer(servePort))
+			framesRead = serveRenderJobs(pixels);
+
+		stopRenderServer();
+		stopMetricsServer();
+	}
+	else if (uiThread)
+	{
+		framesRead = renderFramesBehindUi(pixels);
+	}
+	else
+	{
+		framesRead = renderFrames(pixels);
+	}
+
+	// the video can be over before the loader is
+	finishAsyncUpload();
+
+	stopRemotePreview();
+
+	if (geometryPoolMB > 0)
+	{
+		std::cout << "the geometry pool of " << poolCapacity << " triangles copied in " << streamedMeshes << " meshes ("
+			<< streamedTriangles << " triangles) and forgot " << streamEvictions << std::endl;
+
+		if (sparsePool)
+		{
+			size_t committed = std::count_if(poolPageUsers.begin(), poolPageUsers.end(), [](int users) { return users > 0; });
+			std::cout << "the sparse pool ended with " << committed << " of its " << poolPageUsers.size() << " pages of "
+				<< sparsePageSize / 1024 << " KB committed, for " << poolTriangles << " triangles" << std::endl;
+		}
+	}
+
+	if (framePoolFrames > 0)
+	{
+		std::cout << "saving " << framePoolFrames << " frames made " << framePoolAllocations << " allocations for "
+			<< queueDepth(freeFrames) << " pooled frames" << std::endl;
+	}
+
+	if (pipeFramesPushed > 0)
+	{
+		std::cout << "the pipe to ffmpeg held up to " << pipeFrames.stats.maxDepth.load() << " of " << PIPE_QUEUE_SIZE << " frames, and was full "
+			<< pipeFrames.stats.fullWaits.load() << " times" << std::endl;
+	}
+
+	stopPipeWriter();
+	freeFramePool();
+
+	if (diskWriter.running)
+	{
+		stopDiskWriter(diskWriter);
+
+		std::cout << "the disk writer wrote " << diskWriter.files << " files, " << diskWriter.bytes / (1024 * 1024)
+			<< " MB, with " << diskWriter.method << " (" << diskWriter.blockingFiles << " with blocking writes), and the encoding waited "
+			<< diskWriter.bufferWaits << " times for a buffer" << std::endl;
+	}
+
+	if (encodeQueueStalls > 0)
+		std::cout << "saving the frames was behind " << encodeQueueStalls << " times" << std::endl;
+
+	if (frameRing.waits > 0)
+		std::cout << "the frame ring was full " << frameRing.waits << " times" << std::endl;
+
+	if (savedFrames > 0)
+	{
+		std::cout << "saved " << savedFrames << " frames as " << frameFormatNames[frameFormat] << ": "
+			<< savedFrameBytes / savedFrames << " bytes and "
+			<< savedFrameSeconds * 1000.0 / savedFrames << " ms per frame" << std::endl;
+	}
+
+	if (memoryReport)
+		printGpuMemoryReport();
+
+	if (latencyReport)
+		printLatencyReport();
+
+	printGlDebugReport();
+
+	if (cpuRender && framesRead > 0)
+	{
+		std::cout << "rendered " << framesRead << " frames on the CPU: "
+			<< cpuRenderSeconds * 1000.0 / framesRead << " ms per frame" << std::endl;
+	}
+
+	if (duplicateFrames > 0)
+		std::cout << duplicateFrames << " frames were copies of the frame before, and were not rendered" << std::endl;
+
+	if (dirtyPixelsTotal > 0.0)
+		std::cout << "--dirty-rects traced " << 100.0 * dirtyPixelsTraced / dirtyPixelsTotal << "% of the pixels" << std::endl;
+
+	if (probeRefreshes > 0)
+		std::cout << "--reflection-probes drew the probes " << probeRefreshes << " times" << std::endl;
+
+	if (cameraRayUpdates > 0)
+		std::cout << "--camera " << cameraModelNames[cameraModel] << " made its rays " << cameraRayUpdates << " times" << std::endl;
+
+	if (overlappedFrames > 0)
+		std::cout << overlappedFrames << " frames had their triangles moved while the frame before rendered" << std::endl;
+
+	if (instanceGridBuilds > 0)
+		std::cout << "the instance grid was built " << instanceGridBuilds << " times, with up to " << instanceGridMost << " instances" << std::endl;
+
+	if (tlasUpdates > 0)
+	{
+		std::cout << "--incremental-tlas put in " << tlasInserts << " leaves, took out " << tlasRemoves << ", and moved " << tlasMoves
+			<< ", in " << 1000.0 * tlasUpdateSeconds / tlasUpdates << " ms per frame" << std::endl;
+	}
+
+	if (pipelinedHits > 0)
+		std::cout << pipelinedHits << " frames had their scene made while the frame before rendered" << std::endl;
+
+	if (hybridRender && hybridFrames > 0)
+	{
+		std::cout << "the CPU rendered " << 100.0 * hybridShareSum / hybridFrames << "% of the rows, and "
+			<< hybridCpuRows << " of " << outputHeight << " at the end" << std::endl;
+	}
+
+	delete[] pixels;
+
+	unloadCpuScenes();
+	stopRenderer();
+	
+	// every thread that records zones is done now
+	stopJobs();
+	writeCpuTrace();
 
 	return 0;
 }
+#endif
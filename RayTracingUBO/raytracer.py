@@ -0,0 +1,95 @@
+"""
+Title: Basic Ray Tracer
+File Name: raytracer.py
+
+The renderer of RayTracer.dll (the Library configuration of the project) for
+Python, with ctypes, so that a pipeline gets its frames without files or a
+process of its own:
+
+    import raytracer
+
+    renderer = raytracer.Renderer("--output-size 640x360 --scene shot.json")
+    renderer.set_camera((0, 8, 8), (0, 0.5, 0), (0, 1, 0), 45)
+    images = []
+
+    def frame(pixels, width, height, number):
+        # BGR, bottom row first, and only valid until this returns
+        images.append(numpy.frombuffer(pixels, numpy.uint8).reshape(height, width, 3)[::-1, :, ::-1].copy())
+
+    renderer.render_frame(1, frame)
+    renderer.stop()
+
+See RayTracer.h for what every function does.
+
+RayTracer.dll is 32-bit (the Library configuration is only Win32, because
+External Libraries has no 64-bit GLFW for Visual Studio), so this needs a
+32-bit Python. A 64-bit Python cannot load a 32-bit DLL.
+"""
+
+import ctypes
+import os
+import struct
+
+FRAME_CALLBACK = ctypes.CFUNCTYPE(None, ctypes.POINTER(ctypes.c_ubyte), ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_void_p)
+
+
+class Renderer:
+    """The renderer of the process (the DLL has one, so there is only one of these)"""
+
+    def __init__(self, options="", library=None):
+        if library is None:
+            library = os.path.join(os.path.dirname(os.path.abspath(__file__)), "RayTracer.dll")
+
+        # ctypes only says that the DLL is not a valid Win32 application
+        if os.name == "nt" and struct.calcsize("P") != 4:
+            raise RuntimeError("RayTracer.dll is 32-bit, and this Python is 64-bit: use a 32-bit Python")
+
+        self.lib = ctypes.CDLL(library)
+        self.lib.rtStart.argtypes = [ctypes.c_char_p]
+        self.lib.rtSetOptions.argtypes = [ctypes.c_char_p]
+        self.lib.rtLoadScene.argtypes = [ctypes.c_char_p]
+        self.lib.rtSetCamera.argtypes = [ctypes.POINTER(ctypes.c_float)] * 3 + [ctypes.c_float]
+        self.lib.rtSetFrameCallback.argtypes = [FRAME_CALLBACK, ctypes.c_void_p]
+        self.lib.rtRenderFrame.argtypes = [ctypes.c_int]
+
+        # the function of the frame that is being rendered, which the one callback of the DLL calls
+        self.on_frame = None
+        self.callback = FRAME_CALLBACK(self._frame)
+        self.lib.rtSetFrameCallback(self.callback, None)
+
+        if not self.lib.rtStart(options.encode()):
+            raise RuntimeError("the renderer did not start with " + repr(options))
+
+        self.width = self.lib.rtFrameWidth()
+        self.height = self.lib.rtFrameHeight()
+
+    def _frame(self, pixels, width, height, number, user):
+        if self.on_frame is not None:
+            # a view of the mapped buffer, not a copy
+            view = (ctypes.c_ubyte * (width * height * 3)).from_address(ctypes.addressof(pixels.contents))
+            self.on_frame(memoryview(view), width, height, number)
+
+    def set_options(self, options):
+        if not self.lib.rtSetOptions(options.encode()):
+            raise ValueError(repr(options) + " cannot be changed between frames")
+
+    def load_scene(self, scene_file):
+        if not self.lib.rtLoadScene(scene_file.encode()):
+            raise FileNotFoundError(scene_file)
+
+    def set_camera(self, position, target, up, fov):
+        vec3 = ctypes.c_float * 3
+        self.lib.rtSetCamera(vec3(*position), vec3(*target), vec3(*up), fov)
+
+    def render_frame(self, number, on_frame):
+        """Render frame number of the animation, and call on_frame(pixels, width, height, number) with it before this returns"""
+        self.on_frame = on_frame
+
+        try:
+            if not self.lib.rtRenderFrame(number):
+                raise IndexError("there is no frame " + str(number))
+        finally:
+            self.on_frame = None
+
+    def stop(self):
+        self.lib.rtStop()